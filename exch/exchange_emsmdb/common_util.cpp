@@ -2377,7 +2377,7 @@ int common_util_run()
 	} else if (mime_num > 16*1024) {
 		mime_num = 16*1024;
 	}
-	g_mime_pool = mime_pool_init(mime_num, 16, TRUE);
+	g_mime_pool = mime_pool_init(mime_num, TRUE);
 	if (NULL == g_mime_pool) {
 		printf("[exchange_emsmdb]: Failed to init MIME pool\n");
 		return -4;
@@ -2,6 +2,7 @@
 #include <cerrno>
 #include <cstdint>
 #include <memory>
+#include <new>
 #include <string>
 #include <gromox/mapidefs.h>
 #include "ftstream_producer.h"
@@ -147,6 +148,33 @@ static void ftstream_producer_record_wsp(
 	}
 }
 
+static BOOL ftstream_producer_reserve(
+	FTSTREAM_PRODUCER *pstream, uint32_t size)
+{
+	if (size <= pstream->buffer_size) {
+		return TRUE;
+	}
+	uint32_t new_size = pstream->buffer_size == 0 ?
+	                    FTSTREAM_PRODUCER_INITIAL_LENGTH : pstream->buffer_size;
+	while (new_size < size) {
+		new_size *= 2;
+	}
+	if (new_size > FTSTREAM_PRODUCER_BUFFER_LENGTH) {
+		new_size = FTSTREAM_PRODUCER_BUFFER_LENGTH;
+	}
+	std::unique_ptr<uint8_t[]> new_buff(new(std::nothrow) uint8_t[new_size]);
+	if (NULL == new_buff) {
+		fprintf(stderr, "E-1515: ENOMEM\n");
+		return FALSE;
+	}
+	if (0 != pstream->buffer_offset) {
+		memcpy(new_buff.get(), pstream->buffer.get(), pstream->buffer_offset);
+	}
+	pstream->buffer = std::move(new_buff);
+	pstream->buffer_size = new_size;
+	return TRUE;
+}
+
 static BOOL ftstream_producer_write_internal(
 	FTSTREAM_PRODUCER *pstream,
 	const void *pbuff, uint32_t size)
@@ -165,7 +193,7 @@ static BOOL ftstream_producer_write_internal(
 		}
 		if (0 != pstream->buffer_offset &&
 			pstream->buffer_offset != write(pstream->fd,
-			pstream->buffer, pstream->buffer_offset)) {
+			pstream->buffer.get(), pstream->buffer_offset)) {
 			return FALSE;	
 		}
 		pstream->buffer_offset = 0;
@@ -176,7 +204,11 @@ static BOOL ftstream_producer_write_internal(
 			return FALSE;
 		}
 	} else {
-		memcpy(pstream->buffer + pstream->buffer_offset, pbuff, size);
+		if (FALSE == ftstream_producer_reserve(
+			pstream, pstream->buffer_offset + size)) {
+			return FALSE;
+		}
+		memcpy(&pstream->buffer[pstream->buffer_offset], pbuff, size);
 		pstream->buffer_offset += size;
 	}
 	pstream->offset += size;
@@ -1018,7 +1050,7 @@ BOOL ftstream_producer::read_buffer(void *pbuff, uint16_t *plen, BOOL *pb_last)
 		if (-1 != pstream->fd) {
 			if (0 != pstream->buffer_offset &&
 				pstream->buffer_offset != write(pstream->fd,
-				pstream->buffer, pstream->buffer_offset)) {
+				pstream->buffer.get(), pstream->buffer_offset)) {
 				return FALSE;
 			}
 			lseek(pstream->fd, 0, SEEK_SET);
@@ -1068,8 +1100,8 @@ BOOL ftstream_producer::read_buffer(void *pbuff, uint16_t *plen, BOOL *pb_last)
 			if (*plen != read(pstream->fd, pbuff, *plen)) {
 				return FALSE;
 			}
-		} else {
-			memcpy(pbuff, pstream->buffer + pstream->read_offset, *plen);
+		} else if (*plen > 0) {
+			memcpy(pbuff, &pstream->buffer[pstream->read_offset], *plen);
 			pstream->read_offset += *plen;
 		}
 		*pb_last = FALSE;
@@ -1090,8 +1122,9 @@ BOOL ftstream_producer::read_buffer(void *pbuff, uint16_t *plen, BOOL *pb_last)
 		if (*plen != read(pstream->fd, pbuff, *plen)) {
 			return FALSE;
 		}
-	} else {
-		memcpy(pbuff, pstream->buffer + pstream->read_offset, *plen);
+	} else if (*plen > 0) {
+		/* the buffer is only allocated once something has been written */
+		memcpy(pbuff, &pstream->buffer[pstream->read_offset], *plen);
 		pstream->read_offset += *plen;
 	}
 	*pb_last = TRUE;
@@ -1106,5 +1139,10 @@ BOOL ftstream_producer::read_buffer(void *pbuff, uint16_t *plen, BOOL *pb_last)
 	pstream->buffer_offset = 0;
 	pstream->read_offset = 0;
 	pstream->b_read = FALSE;
+	/* do not let one large message pin a big buffer for the context's lifetime */
+	if (pstream->buffer_size > FTSTREAM_PRODUCER_INITIAL_LENGTH) {
+		pstream->buffer.reset();
+		pstream->buffer_size = 0;
+	}
 	return TRUE;
 }
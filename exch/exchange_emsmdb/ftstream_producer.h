@@ -8,6 +8,7 @@
 #include <sys/types.h>
 #define FTSTREAM_PRODUCER_POINT_LENGTH			1024
 #define FTSTREAM_PRODUCER_BUFFER_LENGTH			4*1024*1024
+#define FTSTREAM_PRODUCER_INITIAL_LENGTH		64*1024
 #define STRING_OPTION_NONE						0x00
 #define STRING_OPTION_UNICODE					0x01
 #define STRING_OPTION_CPID						0x02
@@ -34,8 +35,12 @@ struct FTSTREAM_PRODUCER {
 	int type = 0, fd = -1;
 	uint32_t offset = 0;
 	std::string path;
-	uint8_t buffer[FTSTREAM_PRODUCER_BUFFER_LENGTH]{};
-	uint32_t buffer_offset = 0, read_offset = 0;
+	/*
+	 * Allocated on first write and grown up to BUFFER_LENGTH; beyond that,
+	 * the stream spills to @path. Shrunk again once the reader drained it.
+	 */
+	std::unique_ptr<uint8_t[]> buffer;
+	uint32_t buffer_size = 0, buffer_offset = 0, read_offset = 0;
 	uint8_t string_option = 0;
 	LOGON_OBJECT *plogon = nullptr; /* plogon is a protected member */
 	DOUBLE_LIST bp_list{};
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
 // SPDX-FileCopyrightText: 2021 grommunio GmbH
 // This file is part of Gromox.
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <mutex>
@@ -10,6 +11,8 @@
 #include <utility>
 #include <vector>
 #include <libHX/string.h>
+#include <gromox/ab_base_cache.hpp>
+#include <gromox/ab_domain_tree.hpp>
 #include <gromox/defs.h>
 #include <gromox/fileio.h>
 #include <gromox/util.hpp>
@@ -40,10 +43,6 @@
 /* composed value, not in database, means ADDRESS_TYPE_NORMAL and SUB_TYPE_EQUIPMENT */
 #define ADDRESS_TYPE_EQUIPMENT				5
 
-#define BASE_STATUS_CONSTRUCTING			0
-#define BASE_STATUS_LIVING					1
-#define BASE_STATUS_DESTRUCTING				2
-
 #define MLIST_TYPE_NORMAL 					0
 #define MLIST_TYPE_GROUP					1
 #define MLIST_TYPE_DOMAIN					2
@@ -89,13 +88,12 @@ struct ab_sort_item {
 
 }
 
-static size_t g_base_size;
-static int g_file_blocks, g_ab_cache_interval;
+static int g_file_blocks;
 static std::atomic<bool> g_notify_stop{false};
 static pthread_t g_scan_id;
 static char g_nsp_org_name[256];
-static std::unordered_map<int, AB_BASE> g_base_hash;
-static std::mutex g_base_lock, g_remote_lock;
+static ab_base_cache<AB_BASE> g_base_cache;
+static std::mutex g_remote_lock;
 static LIB_BUFFER *g_file_allocator;
 
 static decltype(mysql_adaptor_get_org_domains) *get_org_domains;
@@ -214,8 +212,7 @@ void ab_tree_init(const char *org_name, size_t base_size,
 	int cache_interval, int file_blocks)
 {
 	gx_strlcpy(g_nsp_org_name, org_name, arsizeof(g_nsp_org_name));
-	g_base_size = base_size;
-	g_ab_cache_interval = cache_interval;
+	g_base_cache.init("exchange_nsp", base_size, cache_interval);
 	g_file_blocks = file_blocks;
 	g_notify_stop = true;
 }
@@ -275,12 +272,11 @@ void AB_BASE::unload()
 	auto pbase = this;
 	SINGLE_LIST_NODE *pnode;
 	
-	while ((pnode = single_list_pop_front(&pbase->list)) != nullptr) {
-		ab_tree_destruct_tree(&((DOMAIN_NODE*)pnode->pdata)->tree);
-		free(pnode->pdata);
-	}
-	while ((pnode = single_list_pop_front(&pbase->gal_list)) != nullptr)
-		ab_tree_put_snode(pnode);
+	while ((pnode = single_list_pop_front(&pbase->list)) != nullptr)
+		delete static_cast<DOMAIN_NODE *>(pnode->pdata);
+	pbase->gal_list.clear();
+	pbase->gal_names.clear();
+	pbase->gal_pos.clear();
 	while ((pnode = single_list_pop_front(&pbase->remote_list)) != nullptr) {
 		ab_tree_put_abnode(static_cast<AB_NODE *>(pnode->pdata));
 		ab_tree_put_snode(pnode);
@@ -294,7 +290,6 @@ void AB_BASE::unload()
 AB_BASE::AB_BASE()
 {
 	single_list_init(&list);
-	single_list_init(&gal_list);
 	single_list_init(&remote_list);
 }
 
@@ -305,7 +300,7 @@ void ab_tree_stop()
 		pthread_kill(g_scan_id, SIGALRM);
 		pthread_join(g_scan_id, NULL);
 	}
-	g_base_hash.clear();
+	g_base_cache.clear();
 	if (NULL != g_file_allocator) {
 		lib_buffer_free(g_file_allocator);
 		g_file_allocator = NULL;
@@ -360,8 +355,8 @@ static BOOL ab_tree_load_user(AB_NODE *pabnode,
 	}
 	pabnode->id = usr.id;
 	pabnode->minid = ab_tree_make_minid(MINID_TYPE_ADDRESS, usr.id);
-	((SIMPLE_TREE_NODE*)pabnode)->pdata = int_hash_query(
-							pbase->phash, pabnode->minid);
+	auto ppnode = static_cast<SIMPLE_TREE_NODE **>(int_hash_query(pbase->phash, pabnode->minid));
+	((SIMPLE_TREE_NODE*)pabnode)->pdata = ppnode != nullptr ? *ppnode : nullptr;
 	if (NULL == ((SIMPLE_TREE_NODE*)pabnode)->pdata) {
 		if (FALSE == ab_tree_cache_node(pbase, pabnode)) {
 			return FALSE;
@@ -379,8 +374,8 @@ static BOOL ab_tree_load_mlist(AB_NODE *pabnode,
 	pabnode->node_type = NODE_TYPE_MLIST;
 	pabnode->id = usr.id;
 	pabnode->minid = ab_tree_make_minid(MINID_TYPE_ADDRESS, usr.id);
-	((SIMPLE_TREE_NODE*)pabnode)->pdata = int_hash_query(
-							pbase->phash, pabnode->minid);
+	auto ppnode = static_cast<SIMPLE_TREE_NODE **>(int_hash_query(pbase->phash, pabnode->minid));
+	((SIMPLE_TREE_NODE*)pabnode)->pdata = ppnode != nullptr ? *ppnode : nullptr;
 	if (NULL == ((SIMPLE_TREE_NODE*)pabnode)->pdata) {
 		if (FALSE == ab_tree_cache_node(pbase, pabnode)) {
 			return FALSE;
@@ -398,9 +393,8 @@ static int ab_tree_cmpstring(const void *p1, const void *p2)
 	       static_cast<const ab_sort_item *>(p2)->string);
 }
 
-static BOOL ab_tree_load_class(
-	int class_id, SIMPLE_TREE *ptree,
-	SIMPLE_TREE_NODE *pnode, AB_BASE *pbase)
+static BOOL ab_tree_load_class(ab_class_rows &cr, SIMPLE_TREE *ptree,
+    SIMPLE_TREE_NODE *pnode, AB_BASE *pbase)
 {
 	int i;
 	int rows;
@@ -408,38 +402,32 @@ static BOOL ab_tree_load_class(
 	char temp_buff[1024];
 	SIMPLE_TREE_NODE *pclass;
 	
-	std::vector<sql_class> file_subclass;
-	if (!get_sub_classes(class_id, file_subclass))
-		return FALSE;
-	for (auto &&cls : file_subclass) {
+	for (auto &&sub : cr.sub) {
 		pabnode = ab_tree_get_abnode();
 		if (NULL == pabnode) {
 			return FALSE;
 		}
 		pabnode->node_type = NODE_TYPE_CLASS;
-		pabnode->id = cls.child_id;
-		pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, cls.child_id);
+		pabnode->id = sub.cls.child_id;
+		pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, sub.cls.child_id);
 		if (NULL == int_hash_query(pbase->phash, pabnode->minid)) {
 			if (FALSE == ab_tree_cache_node(pbase, pabnode)) {
 				return FALSE;
 			}
 		}
-		auto child_id = cls.child_id;
-		pabnode->d_info = new(std::nothrow) sql_class(std::move(cls));
+		pabnode->d_info = new(std::nothrow) sql_class(std::move(sub.cls));
 		if (pabnode->d_info == nullptr)
 			return false;
 		pclass = (SIMPLE_TREE_NODE*)pabnode;
 		simple_tree_add_child(ptree, pnode,
 			pclass, SIMPLE_TREE_ADD_LAST);
-		if (!ab_tree_load_class(child_id, ptree, pclass, pbase))
+		if (!ab_tree_load_class(sub, ptree, pclass, pbase))
 			return FALSE;
 	}
 
-	std::vector<sql_user> file_user;
-	rows = get_class_users(class_id, file_user);
-	if (-1 == rows) {
-		return FALSE;
-	} else if (0 == rows) {
+	auto &file_user = cr.users;
+	rows = file_user.size();
+	if (0 == rows) {
 		return TRUE;
 	}
 	auto parray = static_cast<ab_sort_item *>(malloc(sizeof(ab_sort_item) * rows));
@@ -490,21 +478,19 @@ static BOOL ab_tree_load_class(
 	return FALSE;
 }
 
-static BOOL ab_tree_load_tree(int domain_id,
+static BOOL ab_tree_load_tree(ab_domain_rows &&dr, int domain_id,
 	SIMPLE_TREE *ptree, AB_BASE *pbase)
 {
 	int i;
 	int rows;
 	AB_NODE *pabnode;
 	ab_sort_item *parray = nullptr;
-	sql_domain dinfo;
 	SIMPLE_TREE_NODE *pgroup;
 	SIMPLE_TREE_NODE *pclass;
 	SIMPLE_TREE_NODE *pdomain;
 	
     {
-	if (!get_domain_info(domain_id, dinfo))
-		return FALSE;
+	auto &dinfo = dr.info;
 	pabnode = ab_tree_get_abnode();
 	if (NULL == pabnode) {
 		return FALSE;
@@ -527,10 +513,8 @@ static BOOL ab_tree_load_tree(int domain_id,
 	pdomain = (SIMPLE_TREE_NODE*)pabnode;
 	simple_tree_set_root(ptree, pdomain);
 
-	std::vector<sql_group> file_group;
-	if (!get_domain_groups(domain_id, file_group))
-		return FALSE;
-	for (auto &&grp : file_group) {
+	for (auto &&gr : dr.groups) {
+		auto &grp = gr.grp;
 		pabnode = ab_tree_get_abnode();
 		if (NULL == pabnode) {
 			return FALSE;
@@ -541,45 +525,39 @@ static BOOL ab_tree_load_tree(int domain_id,
 		if (FALSE == ab_tree_cache_node(pbase, pabnode)) {
 			return FALSE;
 		}
-		auto grp_id = grp.id;
 		pabnode->d_info = new(std::nothrow) sql_group(std::move(grp));
 		if (pabnode->d_info == nullptr)
 			return false;
 		pgroup = (SIMPLE_TREE_NODE*)pabnode;
 		simple_tree_add_child(ptree, pdomain, pgroup, SIMPLE_TREE_ADD_LAST);
 		
-		std::vector<sql_class> file_class;
-		if (!get_group_classes(grp_id, file_class))
-			return FALSE;
-		for (auto &&cls : file_class) {
+		for (auto &&cr : gr.classes) {
 			pabnode = ab_tree_get_abnode();
 			if (NULL == pabnode) {
 				return FALSE;
 			}
 			pabnode->node_type = NODE_TYPE_CLASS;
-			pabnode->id = cls.child_id;
-			pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, cls.child_id);
+			pabnode->id = cr.cls.child_id;
+			pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, cr.cls.child_id);
 			if (NULL == int_hash_query(pbase->phash, pabnode->minid)) {
 				if (FALSE == ab_tree_cache_node(pbase, pabnode)) {
 					ab_tree_put_abnode(pabnode);
 					return FALSE;
 				}
 			}
-			pabnode->d_info = new(std::nothrow) sql_class(std::move(cls));
+			pabnode->d_info = new(std::nothrow) sql_class(std::move(cr.cls));
 			if (pabnode->d_info == nullptr)
 				return false;
 			pclass = (SIMPLE_TREE_NODE*)pabnode;
 			simple_tree_add_child(ptree, pgroup,
 				pclass, SIMPLE_TREE_ADD_LAST);
-			if (!ab_tree_load_class(cls.child_id, ptree, pclass, pbase))
+			if (!ab_tree_load_class(cr, ptree, pclass, pbase))
 				return FALSE;
 		}
 		
-		std::vector<sql_user> file_user;
-		rows = get_group_users(grp_id, file_user);
-		if (-1 == rows) {
-			return FALSE;
-		} else if (0 == rows) {
+		auto &file_user = gr.users;
+		rows = file_user.size();
+		if (0 == rows) {
 			continue;
 		}
 		parray = static_cast<ab_sort_item *>(malloc(sizeof(ab_sort_item) * rows));
@@ -623,11 +601,9 @@ static BOOL ab_tree_load_tree(int domain_id,
 		free(parray);
 	}
 	
-	std::vector<sql_user> file_user;
-	rows = get_domain_users(domain_id, file_user);
-	if (-1 == rows) {
-		return FALSE;
-	} else if (0 == rows) {
+	auto &file_user = dr.users;
+	rows = file_user.size();
+	if (0 == rows) {
 		return TRUE;
 	}
 	parray = static_cast<ab_sort_item *>(malloc(sizeof(ab_sort_item) * rows));
@@ -683,7 +659,6 @@ static BOOL ab_tree_load_tree(int domain_id,
 static void ab_tree_enum_nodes(SIMPLE_TREE_NODE *pnode, void *pparam)
 {
 	uint8_t node_type;
-	SINGLE_LIST_NODE *psnode;
 	
 	node_type = ab_tree_get_node_type(pnode);
 	if (node_type > 0x80) {
@@ -692,58 +667,37 @@ static void ab_tree_enum_nodes(SIMPLE_TREE_NODE *pnode, void *pparam)
 	if (NULL != pnode->pdata) {
 		return;	
 	}
-	psnode = ab_tree_get_snode();
-	if (NULL == psnode) {
-		return;
+	try {
+		static_cast<std::vector<SIMPLE_TREE_NODE *> *>(pparam)->push_back(pnode);
+	} catch (const std::bad_alloc &) {
 	}
-	psnode->pdata = pnode;
-	single_list_append_as_tail((SINGLE_LIST*)pparam, psnode);
 }
 
-static BOOL ab_tree_load_base(AB_BASE *pbase)
+static BOOL ab_tree_load_base(AB_BASE *pbase, const AB_BASE *prev)
 {
-	int i, num;
 	DOMAIN_NODE *pdomain;
 	char temp_buff[1024];
 	SIMPLE_TREE_NODE *proot;
 	SINGLE_LIST_NODE *pnode;
+	const ab_sql_ops ops = {get_domain_info, get_domain_groups,
+		get_group_classes, get_sub_classes, get_class_users,
+		get_group_users, get_domain_users};
+	auto load_domain = [&](int domain_id) {
+		return ab_tree_load_domain<AB_NODE, DOMAIN_NODE>(pbase, domain_id,
+		       prev, ops, ab_tree_destruct_tree, ab_tree_load_tree,
+		       ab_tree_cache_node);
+	};
 	
 	if (pbase->base_id > 0) {
 		std::vector<int> temp_file;
 		if (!get_org_domains(pbase->base_id, temp_file))
 			return FALSE;
-		for (auto domain_id : temp_file) {
-			pdomain = (DOMAIN_NODE*)malloc(sizeof(DOMAIN_NODE));
-			if (NULL == pdomain) {
+		for (auto domain_id : temp_file)
+			if (!load_domain(domain_id))
 				return FALSE;
-			}
-			pdomain->node.pdata = pdomain;
-			pdomain->domain_id = domain_id;
-			simple_tree_init(&pdomain->tree);
-			if (FALSE == ab_tree_load_tree(
-				domain_id, &pdomain->tree, pbase)) {
-				ab_tree_destruct_tree(&pdomain->tree);
-				free(pdomain);
-				return FALSE;
-			}
-			single_list_append_as_tail(&pbase->list, &pdomain->node);
-		}
 	} else {
-		pdomain = (DOMAIN_NODE*)malloc(sizeof(DOMAIN_NODE));
-		if (NULL == pdomain) {
+		if (!load_domain(-pbase->base_id))
 			return FALSE;
-		}
-		pdomain->node.pdata = pdomain;
-		int domain_id = -pbase->base_id;
-		pdomain->domain_id = -pbase->base_id;
-		simple_tree_init(&pdomain->tree);
-		if (FALSE == ab_tree_load_tree(
-			domain_id, &pdomain->tree, pbase)) {
-			ab_tree_destruct_tree(&pdomain->tree);
-			free(pdomain);
-			return FALSE;
-		}
-		single_list_append_as_tail(&pbase->list, &pdomain->node);
 	}
 	for (pnode=single_list_get_head(&pbase->list); NULL!=pnode;
 		pnode=single_list_get_after(&pbase->list, pnode)) {
@@ -755,152 +709,60 @@ static BOOL ab_tree_load_base(AB_BASE *pbase)
 		simple_tree_enum_from_node(proot,
 			ab_tree_enum_nodes, &pbase->gal_list);
 	}
-	num = single_list_get_nodes_num(&pbase->gal_list);
-	if (num <= 1) {
-		return TRUE;
-	}
-	auto parray = static_cast<ab_sort_item *>(malloc(sizeof(ab_sort_item) * num));
-	if (NULL == parray) {
-		return TRUE;
-	}
-	i = 0;
-	for (pnode=single_list_get_head(&pbase->gal_list); NULL!=pnode;
-		pnode=single_list_get_after(&pbase->gal_list, pnode)) {
-		ab_tree_get_display_name(static_cast<SIMPLE_TREE_NODE *>(pnode->pdata),
-			1252, temp_buff, arsizeof(temp_buff));
-		parray[i].pnode = static_cast<SIMPLE_TREE_NODE *>(pnode->pdata);
-		parray[i].string = strdup(temp_buff);
-		if (NULL == parray[i].string) {
-			for (i-=1; i>=0; i--) {
-				free(parray[i].string);
-			}
-			free(parray);
-			return TRUE;
+	/* Sort once at load time; sessions then use the arrays read-only. */
+	std::vector<std::pair<std::string, SIMPLE_TREE_NODE *>> sorted;
+	try {
+		sorted.reserve(pbase->gal_list.size());
+		for (auto tnode : pbase->gal_list) {
+			ab_tree_get_display_name(tnode, 1252, temp_buff, arsizeof(temp_buff));
+			sorted.emplace_back(temp_buff, tnode);
 		}
-		i ++;
-	}
-	qsort(parray, num, sizeof(ab_sort_item), ab_tree_cmpstring);
-	i = 0;
-	for (pnode=single_list_get_head(&pbase->gal_list); NULL!=pnode;
-		pnode=single_list_get_after(&pbase->gal_list, pnode)) {
-		pnode->pdata = parray[i].pnode;
-		free(parray[i].string);
-		i ++;
+		std::sort(sorted.begin(), sorted.end(),
+			[](const auto &a, const auto &b) {
+				return strcasecmp(a.first.c_str(), b.first.c_str()) < 0;
+			});
+		pbase->gal_names.resize(sorted.size());
+		pbase->gal_pos.reserve(sorted.size());
+		for (size_t i = 0; i < sorted.size(); ++i) {
+			pbase->gal_list[i] = sorted[i].second;
+			pbase->gal_names[i] = std::move(sorted[i].first);
+			pbase->gal_pos.emplace(ab_tree_get_node_minid(sorted[i].second), i);
+		}
+	} catch (const std::bad_alloc &) {
+		return FALSE;
 	}
-	free(parray);
 	return TRUE;
 }
 
-AB_BASE_REF ab_tree_get_base(int base_id)
+/*
+ * Build a complete base off to the side. When refreshing, the GUID of the
+ * previous snapshot is carried over so that existing sessions stay valid.
+ */
+static AB_BASE_REF ab_tree_build_base(int base_id, const AB_BASE *prev)
 {
-	int count;
-	AB_BASE *pbase;
-	
-	count = 0;
- RETRY_LOAD_BASE:
-	std::unique_lock bhold(g_base_lock);
-	auto it = g_base_hash.find(base_id);
-	if (it == g_base_hash.end()) {
-		if (g_base_hash.size() >= g_base_size) {
-			printf("[exchange_nsp]: W-1298: AB base hash is full\n");
-			return nullptr;
-		}
-		try {
-			auto xp = g_base_hash.try_emplace(base_id);
-			if (!xp.second)
-				return nullptr;
-			it = xp.first;
-			pbase = &xp.first->second;
-		} catch (const std::bad_alloc &) {
-			return nullptr;
-		}
-		pbase->base_id = base_id;
-		pbase->status = BASE_STATUS_CONSTRUCTING;
+	auto pbase = std::make_shared<AB_BASE>();
+	pbase->base_id = base_id;
+	if (prev != nullptr) {
+		pbase->guid = prev->guid;
+	} else {
 		pbase->guid = guid_random_new();
 		memcpy(pbase->guid.node, &base_id, sizeof(int));
-		pbase->phash = NULL;
-		bhold.unlock();
-		if (FALSE == ab_tree_load_base(pbase)) {
-			pbase->unload();
-			bhold.lock();
-			g_base_hash.erase(it);
-			bhold.unlock();
-			return nullptr;
-		}
-		time(&pbase->load_time);
-		bhold.lock();
-		pbase->status = BASE_STATUS_LIVING;
-	} else {
-		pbase = &it->second;
-		if (pbase->status != BASE_STATUS_LIVING) {
-			bhold.unlock();
-			count ++;
-			if (count > 60) {
-				return nullptr;
-			}
-			sleep(1);
-			goto RETRY_LOAD_BASE;
-		}
 	}
-	pbase->reference ++;
-	return AB_BASE_REF(pbase);
+	if (!ab_tree_load_base(pbase.get(), prev))
+		return nullptr;
+	return pbase;
 }
 
-void ab_tree_del::operator()(AB_BASE *pbase)
+AB_BASE_REF ab_tree_get_base(int base_id)
 {
-	std::lock_guard bhold(g_base_lock);
-	pbase->reference --;
+	return g_base_cache.get(base_id, ab_tree_build_base);
 }
 
 static void *nspab_scanwork(void *param)
 {
-	AB_BASE *pbase;
-	SINGLE_LIST_NODE *pnode;
-	
-	while (!g_notify_stop) {
-		pbase = NULL;
-		std::unique_lock bhold(g_base_lock);
-		for (auto &kvpair : g_base_hash) {
-			auto &base = kvpair.second;
-			if (base.status != BASE_STATUS_LIVING ||
-			    base.reference != 0 ||
-			    time(nullptr) - base.load_time < g_ab_cache_interval)
-				continue;
-			pbase = &base;
-			pbase->status = BASE_STATUS_CONSTRUCTING;
-			break;
-		}
-		bhold.unlock();
-		if (NULL == pbase) {
+	while (!g_notify_stop)
+		if (!g_base_cache.refresh_one(ab_tree_build_base))
 			sleep(1);
-			continue;
-		}
-		while ((pnode = single_list_pop_front(&pbase->list)) != nullptr) {
-			ab_tree_destruct_tree(&((DOMAIN_NODE*)pnode->pdata)->tree);
-			free(pnode->pdata);
-		}
-		while ((pnode = single_list_pop_front(&pbase->gal_list)) != nullptr)
-			ab_tree_put_snode(pnode);
-		while ((pnode = single_list_pop_front(&pbase->remote_list)) != nullptr) {
-			ab_tree_put_abnode(static_cast<AB_NODE *>(pnode->pdata));
-			ab_tree_put_snode(pnode);
-		}
-		if (NULL != pbase->phash) {
-			int_hash_free(pbase->phash);
-			pbase->phash = NULL;
-		}
-		if (FALSE == ab_tree_load_base(pbase)) {
-			pbase->unload();
-			bhold.lock();
-			g_base_hash.erase(pbase->base_id);
-			bhold.unlock();
-		} else {
-			bhold.lock();
-			time(&pbase->load_time);
-			pbase->status = BASE_STATUS_LIVING;
-			bhold.unlock();
-		}
-	}
 	return NULL;
 }
 
@@ -1483,8 +1345,7 @@ int ab_tree_get_guid_base_id(GUID guid)
 	int base_id;
 	
 	memcpy(&base_id, guid.node, sizeof(int));
-	std::lock_guard bhold(g_base_lock);
-	return g_base_hash.find(base_id) != g_base_hash.end() ? base_id : 0;
+	return g_base_cache.contains(base_id) ? base_id : 0;
 }
 
 ec_error_t ab_tree_fetchprop(SIMPLE_TREE_NODE *node, unsigned int codepage,
@@ -1562,7 +1423,27 @@ ec_error_t ab_tree_fetchprop(SIMPLE_TREE_NODE *node, unsigned int codepage,
 void ab_tree_invalidate_cache()
 {
 	printf("[exchange_nsp]: Invalidating AB caches\n");
-	std::unique_lock bl_hold(g_base_lock);
-	for (auto &kvpair : g_base_hash)
-		kvpair.second.load_time = 0;
+	g_base_cache.invalidate();
+}
+
+uint32_t ab_tree_gal_row(const AB_BASE *pbase, uint32_t minid)
+{
+	auto it = pbase->gal_pos.find(minid);
+	return it != pbase->gal_pos.cend() ? it->second : UINT32_MAX;
+}
+
+/*
+ * Row of the first GAL entry at or after @start whose (cp1252) display name
+ * sorts at or after @name, or gal_list.size() if there is none.
+ */
+uint32_t ab_tree_gal_seek(const AB_BASE *pbase, uint32_t start, const char *name)
+{
+	auto &v = pbase->gal_names;
+	if (start >= v.size())
+		return v.size();
+	auto it = std::lower_bound(v.cbegin() + start, v.cend(), name,
+	          [](const std::string &a, const char *b) {
+	          	return strcasecmp(a.c_str(), b) < 0;
+	          });
+	return it - v.cbegin();
 }
@@ -1,9 +1,9 @@
 #pragma once
-#include <atomic>
 #include <cstdint>
 #include <ctime>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <gromox/proc_common.h>
 #include <gromox/simple_tree.hpp>
@@ -30,11 +30,14 @@
 #define USER_STORE_PATH						9
 
 struct PROPERTY_VALUE;
+namespace gromox { struct ab_domain_tree; }
 
 struct DOMAIN_NODE {
 	SINGLE_LIST_NODE node;
-	int domain_id;
-	SIMPLE_TREE tree;
+	int domain_id = 0;
+	SIMPLE_TREE tree{};
+	/* owns the nodes of @tree; shared with later bases while unchanged */
+	std::shared_ptr<gromox::ab_domain_tree> owner;
 };
 
 struct AB_BASE {
@@ -43,18 +46,20 @@ struct AB_BASE {
 	void unload();
 
 	GUID guid{};
-	std::atomic<int> status{0}, reference{0};
-	time_t load_time = 0;
 	int base_id = 0;
-	SINGLE_LIST list, gal_list, remote_list{};
+	SINGLE_LIST list, remote_list{};
+	/*
+	 * GAL in display order; gal_pos maps minid to row, gal_names holds the
+	 * (codepage 1252) sort key of each row. All three are built at load
+	 * time and are read-only once the base is published.
+	 */
+	std::vector<SIMPLE_TREE_NODE *> gal_list;
+	std::vector<std::string> gal_names;
+	std::unordered_map<uint32_t, uint32_t> gal_pos;
 	INT_HASH_TABLE *phash = nullptr;
 };
 
-struct ab_tree_del {
-	void operator()(AB_BASE *);
-};
-
-using AB_BASE_REF = std::unique_ptr<AB_BASE, ab_tree_del>;
+using AB_BASE_REF = std::shared_ptr<AB_BASE>;
 
 extern void ab_tree_init(const char *org_name, size_t base_size, int cache_interval, int file_blocks);
 extern int ab_tree_run();
@@ -82,3 +87,5 @@ void ab_tree_get_server_dn(SIMPLE_TREE_NODE *pnode, char *dn, int length);
 int ab_tree_get_guid_base_id(GUID guid);
 extern ec_error_t ab_tree_fetchprop(SIMPLE_TREE_NODE *, unsigned int codepage, unsigned int proptag, PROPERTY_VALUE *);
 extern void ab_tree_invalidate_cache();
+extern uint32_t ab_tree_gal_seek(const AB_BASE *, uint32_t start, const char *name);
+extern uint32_t ab_tree_gal_row(const AB_BASE *, uint32_t minid);
@@ -611,32 +611,19 @@ uint32_t nsp_interface_unbind(NSPI_HANDLE *phandle, uint32_t reserved)
 	return MAPI_E_UNBINDSUCCESS;
 }
 
-static uint32_t nsp_interface_minid_in_list(
-	SINGLE_LIST *plist, uint32_t row)
+static uint32_t nsp_interface_minid_in_list(const AB_BASE *pbase, uint32_t row)
 {
-	size_t count = 0;
-	SINGLE_LIST_NODE *pnode;
-	
-	for (pnode=single_list_get_head(plist); NULL!=pnode;
-		pnode=single_list_get_after(plist, pnode)) {
-		if (count == row) {
-			return ab_tree_get_node_minid(static_cast<SIMPLE_TREE_NODE *>(pnode->pdata));
-		}
-		count ++;
-	}
-	return 0;
+	return row < pbase->gal_list.size() ?
+	       ab_tree_get_node_minid(pbase->gal_list[row]) : 0;
 }
 
 static void nsp_interface_position_in_list(const STAT *pstat,
-    SINGLE_LIST *plist, uint32_t *pout_row, uint32_t *pout_last_row,
+    const AB_BASE *pbase, uint32_t *pout_row, uint32_t *pout_last_row,
     uint32_t *pcount)
 {
-	BOOL b_found;
 	uint32_t row;
-	uint32_t minid;
-	SINGLE_LIST_NODE *pnode;
 
-	*pcount = single_list_get_nodes_num(plist);
+	*pcount = pbase->gal_list.size();
 	uint32_t last_row = *pcount > 0 ? *pcount - 1 : 0;
 	if (MID_CURRENT == pstat->cur_rec) {
 		/* fractional positioning MS-OXNSPI 3.1.4.5.2 */
@@ -652,22 +639,11 @@ static void nsp_interface_position_in_list(const STAT *pstat,
 		else if (MID_END_OF_TABLE ==  pstat->cur_rec) {
 			row = last_row + 1;
 		} else {
-			b_found = FALSE;
-			row = 0;
-			for (pnode=single_list_get_head(plist); NULL!=pnode;
-				pnode=single_list_get_after(plist, pnode)) {
-				minid = ab_tree_get_node_minid(static_cast<SIMPLE_TREE_NODE *>(pnode->pdata));
-				if (0 != minid && minid == pstat->cur_rec) {
-					b_found = TRUE;
-					break;
-				}
-				row ++;
-			}
-			if (FALSE == b_found) {
+			row = ab_tree_gal_row(pbase, pstat->cur_rec);
+			if (row == UINT32_MAX)
 				/* In this case the position is undefined.
 				   To avoid problems we will use first row */
 				row = 0;
-			}
 		}
 	}
 	*pout_row = row;
@@ -751,7 +727,6 @@ int nsp_interface_update_stat(NSPI_HANDLE handle,
 	uint32_t row;
 	uint32_t total;
 	uint32_t last_row;
-	SINGLE_LIST *pgal_list = nullptr;
 	SIMPLE_TREE_NODE *pnode = nullptr;
 	
 	if (NULL == pstat || CODEPAGE_UNICODE == pstat->codepage) {
@@ -767,9 +742,8 @@ int nsp_interface_update_stat(NSPI_HANDLE handle,
 		return ecError;
 	}
 	if (0 == pstat->container_id) {
-		pgal_list = &pbase->gal_list;
 		nsp_interface_position_in_list(pstat,
-			pgal_list, &row, &last_row, &total);
+			pbase.get(), &row, &last_row, &total);
 	} else {
 		pnode = ab_tree_minid_to_node(pbase.get(), pstat->container_id);
 		if (NULL == pnode) {
@@ -799,7 +773,7 @@ int nsp_interface_update_stat(NSPI_HANDLE handle,
 		pstat->cur_rec = MID_BEGINNING_OF_TABLE;
 	} else {
 		pstat->cur_rec = pstat->container_id == 0 ?
-		                 nsp_interface_minid_in_list(pgal_list, row) :
+		                 nsp_interface_minid_in_list(pbase.get(), row) :
 		                 nsp_interface_minid_in_table(pnode, row);
 		if (0 == pstat->cur_rec) {
 			row = 0;
@@ -840,9 +814,7 @@ int nsp_interface_query_rows(NSPI_HANDLE handle, uint32_t flags, STAT *pstat,
 	uint32_t last_row;
 	uint32_t start_pos, total;
 	NSP_PROPROW *prow;
-	SINGLE_LIST *pgal_list = nullptr;
 	SIMPLE_TREE_NODE *pnode = nullptr, *pnode1 = nullptr;
-	SINGLE_LIST_NODE *psnode;
 	BOOL b_ephid = (flags & FLAG_EPHID) ? TRUE : false;
 	
 	if (NULL == pstat || CODEPAGE_UNICODE == pstat->codepage) {
@@ -905,9 +877,8 @@ int nsp_interface_query_rows(NSPI_HANDLE handle, uint32_t flags, STAT *pstat,
 	
 	if (NULL == ptable) {
 		if (0 == pstat->container_id) {
-			pgal_list = &pbase->gal_list;
 			nsp_interface_position_in_list(pstat,
-				pgal_list, &start_pos, &last_row, &total);
+				pbase.get(), &start_pos, &last_row, &total);
 		} else {
 			pnode = ab_tree_minid_to_node(pbase.get(), pstat->container_id);
 			if (NULL == pnode) {
@@ -949,21 +920,18 @@ int nsp_interface_query_rows(NSPI_HANDLE handle, uint32_t flags, STAT *pstat,
 		}
 		size_t i = 0;
 		if (0 == pstat->container_id) {
-			for (psnode=single_list_get_head(pgal_list); NULL!=psnode;
-				psnode=single_list_get_after(pgal_list, psnode)) {
-				if (i >= start_pos && i < start_pos + tmp_count) {
-					prow = common_util_proprowset_enlarge(*pprows);
-					if (NULL == prow || NULL ==
-						common_util_propertyrow_init(prow)) {
-						result = ecMAPIOOM;
-						goto EXIT_QUERY_ROWS;
-					}
-					result = nsp_interface_fetch_row(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata),
-						b_ephid, pstat->codepage, pproptags, prow);
-					if (result != ecSuccess)
-						goto EXIT_QUERY_ROWS;
+			for (i = start_pos; i < start_pos + tmp_count &&
+			     i < pbase->gal_list.size(); ++i) {
+				prow = common_util_proprowset_enlarge(*pprows);
+				if (NULL == prow || NULL ==
+					common_util_propertyrow_init(prow)) {
+					result = ecMAPIOOM;
+					goto EXIT_QUERY_ROWS;
 				}
-				i ++;
+				result = nsp_interface_fetch_row(pbase->gal_list[i],
+					b_ephid, pstat->codepage, pproptags, prow);
+				if (result != ecSuccess)
+					goto EXIT_QUERY_ROWS;
 			}
 		} else {
 			do {
@@ -993,7 +961,7 @@ int nsp_interface_query_rows(NSPI_HANDLE handle, uint32_t flags, STAT *pstat,
 		} else {
 			if (0 == pstat->container_id) {
 				pstat->cur_rec = nsp_interface_minid_in_list(
-							pgal_list, start_pos + tmp_count);
+							pbase.get(), start_pos + tmp_count);
 			} else {
 				pstat->cur_rec = nsp_interface_minid_in_table(
 								pnode, start_pos + tmp_count);
@@ -1045,9 +1013,7 @@ int nsp_interface_seek_entries(NSPI_HANDLE handle, uint32_t reserved,
 	NSP_PROPROW *prow;
 	uint32_t tmp_minid;
 	char temp_name[1024];
-	SINGLE_LIST *pgal_list = nullptr;
 	SIMPLE_TREE_NODE *pnode = nullptr, *pnode1;
-	SINGLE_LIST_NODE *psnode;
 	
 	
 	if (NULL == pstat || CODEPAGE_UNICODE == pstat->codepage) {
@@ -1158,9 +1124,8 @@ int nsp_interface_seek_entries(NSPI_HANDLE handle, uint32_t reserved,
 		pstat->num_pos = row;
 	} else {
 		if (0 == pstat->container_id) {
-			pgal_list = &pbase->gal_list;
 			nsp_interface_position_in_list(pstat,
-				pgal_list, &start_pos, &last_row, &total);
+				pbase.get(), &start_pos, &last_row, &total);
 		} else {
 			pnode = ab_tree_minid_to_node(pbase.get(), pstat->container_id);
 			if (NULL == pnode) {
@@ -1182,34 +1147,34 @@ int nsp_interface_seek_entries(NSPI_HANDLE handle, uint32_t reserved,
 		}
 		size_t row = 0;
 		if (0 == pstat->container_id) {
-			for (psnode=single_list_get_head(pgal_list); NULL!=psnode;
-				psnode=single_list_get_after(pgal_list, psnode),row++) {
-				if (row < start_pos) {
-					continue;
-				}
-				ab_tree_get_display_name(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata),
-					pstat->codepage, temp_name, arsizeof(temp_name));
-				if (strcasecmp(temp_name, ptarget->value.pstr) >= 0) {
-					prow = common_util_proprowset_enlarge(*pprows);
-					if (NULL == prow ||
-						NULL == common_util_propertyrow_init(prow)) {
-						result = ecMAPIOOM;
-						goto EXIT_SEEK_ENTRIES;
-					}
-					if (nsp_interface_fetch_row(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata),
-					    TRUE, pstat->codepage, pproptags,
-					    prow) != ecSuccess) {
-						result = ecError;
-						goto EXIT_SEEK_ENTRIES;
-					}
-					break;
+			auto &gal = pbase->gal_list;
+			if (pstat->codepage == 1252) {
+				/* same key the GAL is sorted by */
+				row = ab_tree_gal_seek(pbase.get(), start_pos, ptarget->value.pstr);
+			} else {
+				for (row = start_pos; row < gal.size(); ++row) {
+					ab_tree_get_display_name(gal[row], pstat->codepage,
+						temp_name, arsizeof(temp_name));
+					if (strcasecmp(temp_name, ptarget->value.pstr) >= 0)
+						break;
 				}
 			}
-			if (NULL == psnode) {
+			if (row >= gal.size()) {
 				result = ecNotFound;
 				goto EXIT_SEEK_ENTRIES;
 			}
-			pstat->cur_rec = ab_tree_get_node_minid(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata));
+			prow = common_util_proprowset_enlarge(*pprows);
+			if (NULL == prow ||
+				NULL == common_util_propertyrow_init(prow)) {
+				result = ecMAPIOOM;
+				goto EXIT_SEEK_ENTRIES;
+			}
+			if (nsp_interface_fetch_row(gal[row], TRUE,
+			    pstat->codepage, pproptags, prow) != ecSuccess) {
+				result = ecError;
+				goto EXIT_SEEK_ENTRIES;
+			}
+			pstat->cur_rec = ab_tree_get_node_minid(gal[row]);
 		} else {
 			pnode1 = simple_tree_node_get_child(pnode);
 			do {
@@ -1558,10 +1523,8 @@ int nsp_interface_get_matches(NSPI_HANDLE handle, uint32_t reserved1,
 	NSP_PROPROW *prow;
 	char temp_path[256];
 	char temp_buff[1024];
-	SINGLE_LIST *pgal_list;
 	PROPERTY_VALUE prop_val;
 	SIMPLE_TREE_NODE *pnode;
-	SINGLE_LIST_NODE *psnode;
 	
 	
 	if (NULL == pstat || CODEPAGE_UNICODE == pstat->codepage) {
@@ -1659,28 +1622,21 @@ int nsp_interface_get_matches(NSPI_HANDLE handle, uint32_t reserved1,
 	}
 	if (NULL != pfilter) {
 		if (0 == pstat->container_id) {
-			pgal_list = &pbase->gal_list;
 			nsp_interface_position_in_list(pstat,
-				pgal_list, &start_pos, &last_row, &total);
-			size_t i = 0;
-			for (psnode=single_list_get_head(pgal_list); NULL!=psnode;
-				psnode=single_list_get_after(pgal_list, psnode)) {
-				if (i > last_row || (*ppoutmids)->cvalues > requested) {
+				pbase.get(), &start_pos, &last_row, &total);
+			auto &gal = pbase->gal_list;
+			for (size_t i = start_pos; i < gal.size(); ++i) {
+				if (i > last_row || (*ppoutmids)->cvalues > requested)
 					break;
-				} else if (i < start_pos) {
-					i ++;
-					continue;
-				}
-				if (nsp_interface_match_node(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata),
+				if (nsp_interface_match_node(gal[i],
 					pstat->codepage, pfilter)) {
 					pproptag = common_util_proptagarray_enlarge(*ppoutmids);
 					if (NULL == pproptag) {
 						result = ecMAPIOOM;
 						goto EXIT_GET_MATCHES;
 					}
-					*pproptag = ab_tree_get_node_minid(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata));
+					*pproptag = ab_tree_get_node_minid(gal[i]);
 				}
-				i ++;
 			}
 		} else {
 			pnode = ab_tree_minid_to_node(pbase.get(), pstat->container_id);
@@ -2019,10 +1975,8 @@ int nsp_interface_get_props(NSPI_HANDLE handle, uint32_t flags,
 	BOOL b_proptags;
 	uint32_t result;
 	uint32_t last_row;
-	SINGLE_LIST *pgal_list;
 	SIMPLE_TREE_NODE *pnode;
 	SIMPLE_TREE_NODE *pnode1;
-	SINGLE_LIST_NODE *psnode;
 	
 	
 	if (NULL == pstat) {
@@ -2054,21 +2008,16 @@ int nsp_interface_get_props(NSPI_HANDLE handle, uint32_t flags,
 	
 	if (pstat->cur_rec <= 0x10) {
 		if (0 == pstat->container_id) {
-			pgal_list = &pbase->gal_list;
+			auto &gal = pbase->gal_list;
 			if (MID_BEGINNING_OF_TABLE == pstat->cur_rec) {
-				psnode = single_list_get_head(pgal_list);
+				row = 0;
 			} else if (MID_END_OF_TABLE == pstat->cur_rec) {
-				psnode = single_list_get_tail(pgal_list);
+				row = gal.size() - 1;
 			} else {
 				nsp_interface_position_in_list(pstat,
-					pgal_list, &row, &last_row, &total);
-				size_t i;
-				for (i=0,psnode=single_list_get_head(pgal_list);
-				     psnode != NULL && i < row; ++i)
-					psnode = single_list_get_after(pgal_list, psnode);
-			}
-			pnode1 = psnode == nullptr ? nullptr :
-			         static_cast<decltype(pnode1)>(psnode->pdata);
+					pbase.get(), &row, &last_row, &total);
+			}
+			pnode1 = row < gal.size() ? gal[row] : nullptr;
 		} else {
 			pnode = ab_tree_minid_to_node(pbase.get(), pstat->container_id);
 			if (NULL == pnode) {
@@ -2170,9 +2119,7 @@ int nsp_interface_compare_mids(NSPI_HANDLE handle, uint32_t reserved,
 	uint32_t result;
 	uint32_t minid;
 	int pos1, pos2;
-	SINGLE_LIST *pgal_list;
 	SIMPLE_TREE_NODE *pnode;
-	SINGLE_LIST_NODE *psnode;
 	
 	
 	if (NULL != pstat && CODEPAGE_UNICODE == pstat->codepage) {
@@ -2192,18 +2139,12 @@ int nsp_interface_compare_mids(NSPI_HANDLE handle, uint32_t reserved,
 	pos2 = -1;
 	i = 0;
 	if (NULL == pstat || 0 == pstat->container_id) {
-		pgal_list = &pbase->gal_list;
-		for (psnode=single_list_get_head(pgal_list); NULL!=psnode;
-			psnode=single_list_get_after(pgal_list, psnode)) {
-			minid = ab_tree_get_node_minid(static_cast<SIMPLE_TREE_NODE *>(psnode->pdata));
-			if (minid == mid1) {
-				pos1 = i;
-			}
-			if (minid == mid2) {
-				pos2 = i;
-			}
-			i ++;
-		}
+		auto row1 = ab_tree_gal_row(pbase.get(), mid1);
+		auto row2 = ab_tree_gal_row(pbase.get(), mid2);
+		if (row1 != UINT32_MAX)
+			pos1 = row1;
+		if (row2 != UINT32_MAX)
+			pos2 = row2;
 	} else {
 		pnode = ab_tree_minid_to_node(pbase.get(), pstat->container_id);
 		if (NULL == pnode) {
@@ -2717,8 +2658,10 @@ static BOOL nsp_interface_resolve_node(SIMPLE_TREE_NODE *pnode,
 	if (NULL != strcasestr(dn, pstr)) {
 		return TRUE;
 	}
-	if (TRUE == ab_tree_node_to_dn(pnode, dn, sizeof(dn))
-		&& 0 == strcasecmp(dn, pstr)) {
+	/* Building the DN is comparatively costly; all of them start with /o= */
+	if (strncasecmp(pstr, "/o=", 3) == 0 &&
+	    ab_tree_node_to_dn(pnode, dn, sizeof(dn)) &&
+	    strcasecmp(dn, pstr) == 0) {
 		return TRUE;
 	}
 	ab_tree_get_department_name(pnode, dn);
@@ -2766,22 +2709,19 @@ static BOOL nsp_interface_resolve_node(SIMPLE_TREE_NODE *pnode,
 	return FALSE;
 }
 
-static SIMPLE_TREE_NODE* nsp_interface_resolve_gal(SINGLE_LIST *plist,
+static SIMPLE_TREE_NODE *nsp_interface_resolve_gal(const std::vector<SIMPLE_TREE_NODE *> &gal,
 	uint32_t codepage, char *pstr, BOOL *pb_ambiguous)
 {
-	SINGLE_LIST_NODE *pnode;
-	SIMPLE_TREE_NODE *ptnode;
+	SIMPLE_TREE_NODE *ptnode = nullptr;
 	
-	ptnode = NULL;
-	for (pnode=single_list_get_head(plist); NULL!=pnode;
-		pnode=single_list_get_after(plist, pnode)) {
-		if (!nsp_interface_resolve_node(static_cast<SIMPLE_TREE_NODE *>(pnode->pdata), codepage, pstr))
+	for (auto tnode : gal) {
+		if (!nsp_interface_resolve_node(tnode, codepage, pstr))
 			continue;
 		if (NULL != ptnode) {
 			*pb_ambiguous = TRUE;
 			return NULL;
 		} else {
-			ptnode = static_cast<decltype(ptnode)>(pnode->pdata);
+			ptnode = tnode;
 		}
 	}
 	if (NULL == ptnode) {
@@ -2964,7 +2904,7 @@ int nsp_interface_resolve_namesw(NSPI_HANDLE handle, uint32_t reserved,
 			} else {
 				ptoken = pstrs->ppstr[i];
 			}
-			pnode = nsp_interface_resolve_gal(&pbase->gal_list,
+			pnode = nsp_interface_resolve_gal(pbase->gal_list,
 						pstat->codepage, ptoken, &b_ambiguous);
 			if (NULL == pnode) {
 				if (TRUE == b_ambiguous) {
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <new>
 #include <string>
+#include <vector>
 #include <libHX/string.h>
 #include <gromox/defs.h>
 #include <gromox/mapidefs.h>
@@ -470,6 +471,13 @@ BOOL common_util_allocate_eid_from_folder(sqlite3 *psqlite,
 }
 
 BOOL common_util_allocate_cn(sqlite3 *psqlite, uint64_t *pcn)
+{
+	return common_util_allocate_cns(psqlite, 1, pcn);
+}
+
+/* reserve @count consecutive change numbers, the first is returned */
+BOOL common_util_allocate_cns(sqlite3 *psqlite, uint32_t count,
+    uint64_t *pbegin_cn)
 {
 	char sql_string[128];
 	
@@ -482,7 +490,8 @@ BOOL common_util_allocate_cn(sqlite3 *psqlite, uint64_t *pcn)
 	uint64_t last_cn = sqlite3_step(pstmt) == SQLITE_ROW ?
 	                   sqlite3_column_int64(pstmt, 0) : 0;
 	pstmt.finalize();
-	last_cn ++;
+	uint64_t begin_cn = last_cn + 1;
+	last_cn += count;
 	snprintf(sql_string, arsizeof(sql_string), "REPLACE INTO "
 				"configurations VALUES (%u, ?)",
 				CONFIG_ID_LAST_CHANGE_NUMBER);
@@ -493,7 +502,7 @@ BOOL common_util_allocate_cn(sqlite3 *psqlite, uint64_t *pcn)
 	if (sqlite3_step(pstmt) != SQLITE_DONE) {
 		return FALSE;
 	}
-	*pcn = last_cn;
+	*pbegin_cn = begin_cn;
 	return TRUE;
 }
 
@@ -4838,6 +4847,286 @@ BOOL common_util_evaluate_message_restriction(sqlite3 *psqlite,
 	return FALSE;
 }
 
+static bool rsql_isascii(const char *s)
+{
+	for (; *s != '\0'; ++s)
+		if (static_cast<unsigned char>(*s) >= 0x80)
+			return false;
+	return true;
+}
+
+static std::string rsql_like_escape(const char *s)
+{
+	std::string out;
+	for (; *s != '\0'; ++s) {
+		if (*s == '%' || *s == '_' || *s == '\\')
+			out += '\\';
+		out += *s;
+	}
+	return out;
+}
+
+/* RES_COUNT keeps state across messages; prefiltering would change its outcome. */
+static bool rsql_has_count(const RESTRICTION *pres)
+{
+	switch (pres->rt) {
+	case RES_AND:
+	case RES_OR:
+		for (size_t i = 0; i < pres->andor->count; ++i)
+			if (rsql_has_count(&pres->andor->pres[i]))
+				return true;
+		return false;
+	case RES_NOT:
+		return rsql_has_count(&pres->xnot->res);
+	case RES_COMMENT:
+		return pres->comment->pres != nullptr &&
+		       rsql_has_count(pres->comment->pres);
+	case RES_COUNT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Properties that gp_msgprop does not synthesize, i.e. whose value is the
+ * message_properties row itself and can be compared in SQL.
+ */
+static const char *rsql_stored_tags(uint32_t proptag, char *buf, size_t bufsize)
+{
+	switch (proptag) {
+	case PROP_TAG_MESSAGECLASS:
+	case PROP_TAG_MESSAGECLASS_STRING8:
+		snprintf(buf, bufsize, "%u,%u", PROP_TAG_MESSAGECLASS,
+		         PROP_TAG_MESSAGECLASS_STRING8);
+		return buf;
+	case PROP_TAG_MESSAGEDELIVERYTIME:
+	case PROP_TAG_CLIENTSUBMITTIME:
+	case PR_CREATION_TIME:
+	case PR_LAST_MODIFICATION_TIME:
+		snprintf(buf, bufsize, "%u", proptag);
+		return buf;
+	}
+	return nullptr;
+}
+
+static unsigned int rsql_translate(const RESTRICTION *pres,
+    std::string &expr, std::vector<std::string> &binds)
+{
+	char tags[32], sql_string[256];
+
+	switch (pres->rt) {
+	case RES_AND: {
+		unsigned int ret = RES_SQL_EXACT;
+		size_t n = 0;
+		expr += "(1";
+		for (size_t i = 0; i < pres->andor->count; ++i) {
+			std::string sub;
+			auto sub_ret = rsql_translate(&pres->andor->pres[i], sub, binds);
+			if (sub_ret == RES_SQL_NONE) {
+				ret = RES_SQL_PARTIAL;
+				continue;
+			}
+			if (sub_ret == RES_SQL_PARTIAL)
+				ret = RES_SQL_PARTIAL;
+			expr += " AND " + std::move(sub);
+			++n;
+		}
+		expr += ")";
+		return n == 0 && pres->andor->count > 0 ? RES_SQL_NONE : ret;
+	}
+	case RES_OR: {
+		/* every branch must be expressible; binds are kept in order */
+		unsigned int ret = RES_SQL_EXACT;
+		auto nbinds = binds.size();
+		expr += "(0";
+		for (size_t i = 0; i < pres->andor->count; ++i) {
+			std::string sub;
+			auto sub_ret = rsql_translate(&pres->andor->pres[i], sub, binds);
+			if (sub_ret == RES_SQL_NONE) {
+				binds.resize(nbinds);
+				return RES_SQL_NONE;
+			}
+			if (sub_ret == RES_SQL_PARTIAL)
+				ret = RES_SQL_PARTIAL;
+			expr += " OR " + std::move(sub);
+		}
+		expr += ")";
+		return ret;
+	}
+	case RES_NOT: {
+		std::string sub;
+		auto nbinds = binds.size();
+		if (rsql_translate(&pres->xnot->res, sub, binds) != RES_SQL_EXACT) {
+			binds.resize(nbinds);
+			return RES_SQL_NONE;
+		}
+		expr += "NOT " + std::move(sub);
+		return RES_SQL_EXACT;
+	}
+	case RES_COMMENT:
+		if (pres->comment->pres == nullptr) {
+			expr += "1";
+			return RES_SQL_EXACT;
+		}
+		return rsql_translate(pres->comment->pres, expr, binds);
+	case RES_NULL:
+		expr += "1";
+		return RES_SQL_EXACT;
+	case RES_EXIST:
+		if (rsql_stored_tags(pres->exist->proptag, tags, arsizeof(tags)) == nullptr)
+			return RES_SQL_NONE;
+		snprintf(sql_string, arsizeof(sql_string), "EXISTS (SELECT 1 FROM "
+		         "message_properties AS p WHERE p.message_id=messages.message_id"
+		         " AND p.proptag IN (%s))", tags);
+		expr += sql_string;
+		return RES_SQL_EXACT;
+	case RES_CONTENT: {
+		auto rcon = pres->cont;
+		auto type = PROP_TYPE(rcon->proptag);
+		if ((type != PT_STRING8 && type != PT_UNICODE) ||
+		    type != PROP_TYPE(rcon->propval.proptag) ||
+		    rcon->propval.pvalue == nullptr ||
+		    rsql_stored_tags(rcon->proptag, tags, arsizeof(tags)) == nullptr)
+			return RES_SQL_NONE;
+		auto str = static_cast<const char *>(rcon->propval.pvalue);
+		if (!rsql_isascii(str))
+			return RES_SQL_NONE;
+		bool b_icase = rcon->fuzzy_level & (FL_IGNORECASE | FL_LOOSE);
+		const char *cond;
+		switch (rcon->fuzzy_level & 0xFFFF) {
+		case FL_FULLSTRING:
+			cond = b_icase ? "p.propval=? COLLATE NOCASE" : "p.propval=?";
+			binds.emplace_back(str);
+			break;
+		case FL_SUBSTRING:
+			if (b_icase) {
+				cond = "p.propval LIKE ? ESCAPE '\\'";
+				binds.emplace_back("%" + rsql_like_escape(str) + "%");
+			} else {
+				cond = "instr(p.propval, ?)>0";
+				binds.emplace_back(str);
+			}
+			break;
+		case FL_PREFIX:
+			if (b_icase) {
+				cond = "p.propval LIKE ? ESCAPE '\\'";
+				binds.emplace_back(rsql_like_escape(str) + "%");
+			} else {
+				cond = "instr(p.propval, ?)=1";
+				binds.emplace_back(str);
+			}
+			break;
+		default:
+			return RES_SQL_NONE;
+		}
+		snprintf(sql_string, arsizeof(sql_string), "EXISTS (SELECT 1 FROM "
+		         "message_properties AS p WHERE p.message_id=messages.message_id"
+		         " AND p.proptag IN (%s) AND %s)", tags, cond);
+		expr += sql_string;
+		return RES_SQL_EXACT;
+	}
+	case RES_PROPERTY: {
+		auto rprop = pres->prop;
+		if (rprop->propval.pvalue == nullptr)
+			return RES_SQL_NONE;
+		if (rprop->proptag == PR_READ) {
+			if ((rprop->relop != RELOP_EQ && rprop->relop != RELOP_NE) ||
+			    PROP_TYPE(rprop->propval.proptag) != PT_BOOLEAN ||
+			    !exmdb_server_check_private())
+				return RES_SQL_NONE;
+			bool b_read = *static_cast<const uint8_t *>(rprop->propval.pvalue) != 0;
+			if (rprop->relop == RELOP_NE)
+				b_read = !b_read;
+			expr += b_read ? "messages.read_state<>0" : "messages.read_state=0";
+			return RES_SQL_EXACT;
+		}
+		if (rsql_stored_tags(rprop->proptag, tags, arsizeof(tags)) == nullptr)
+			return RES_SQL_NONE;
+		const char *op;
+		switch (rprop->relop) {
+		case RELOP_LT: op = "<"; break;
+		case RELOP_LE: op = "<="; break;
+		case RELOP_GT: op = ">"; break;
+		case RELOP_GE: op = ">="; break;
+		case RELOP_EQ: op = "="; break;
+		case RELOP_NE: op = "<>"; break;
+		default: return RES_SQL_NONE;
+		}
+		switch (PROP_TYPE(rprop->proptag)) {
+		case PT_STRING8:
+		case PT_UNICODE: {
+			/* strcasecmp order only agrees with NOCASE for (in)equality */
+			auto str = static_cast<const char *>(rprop->propval.pvalue);
+			if ((rprop->relop != RELOP_EQ && rprop->relop != RELOP_NE) ||
+			    (PROP_TYPE(rprop->propval.proptag) != PT_STRING8 &&
+			    PROP_TYPE(rprop->propval.proptag) != PT_UNICODE) ||
+			    !rsql_isascii(str))
+				return RES_SQL_NONE;
+			snprintf(sql_string, arsizeof(sql_string), "EXISTS (SELECT 1 FROM "
+			         "message_properties AS p WHERE p.message_id=messages.message_id"
+			         " AND p.proptag IN (%s) AND p.propval%s? COLLATE NOCASE)",
+			         tags, op);
+			binds.emplace_back(str);
+			break;
+		}
+		case PT_SYSTIME: {
+			if (PROP_TYPE(rprop->propval.proptag) != PT_SYSTIME)
+				return RES_SQL_NONE;
+			auto nt = *static_cast<const uint64_t *>(rprop->propval.pvalue);
+			if (nt > INT64_MAX)
+				return RES_SQL_NONE;
+			snprintf(sql_string, arsizeof(sql_string), "EXISTS (SELECT 1 FROM "
+			         "message_properties AS p WHERE p.message_id=messages.message_id"
+			         " AND p.proptag IN (%s) AND p.propval%s%lld)", tags, op,
+			         static_cast<long long>(nt));
+			break;
+		}
+		default:
+			return RES_SQL_NONE;
+		}
+		expr += sql_string;
+		return RES_SQL_EXACT;
+	}
+	case RES_BITMASK: {
+		auto rbm = pres->bm;
+		if (rbm->proptag != PR_MESSAGE_FLAGS || rbm->mask != MSGFLAG_READ ||
+		    !exmdb_server_check_private())
+			return RES_SQL_NONE;
+		expr += rbm->bitmask_relop == BMR_EQZ ?
+		        "messages.read_state=0" : "messages.read_state<>0";
+		return RES_SQL_EXACT;
+	}
+	default:
+		return RES_SQL_NONE;
+	}
+}
+
+/*
+ * Translate the supported part of a message restriction into a boolean SQL
+ * expression over the "messages" table of the store database (correlated
+ * by messages.message_id). Placeholders in @clause are to be bound, in
+ * order, to the strings in @binds.
+ */
+unsigned int common_util_restriction_to_sql(const RESTRICTION *pres,
+    std::string &clause, std::vector<std::string> &binds)
+{
+	clause.clear();
+	binds.clear();
+	try {
+		if (rsql_has_count(pres))
+			return RES_SQL_NONE;
+		auto ret = rsql_translate(pres, clause, binds);
+		if (ret != RES_SQL_NONE)
+			return ret;
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "E-1512: ENOMEM\n");
+	}
+	clause.clear();
+	binds.clear();
+	return RES_SQL_NONE;
+}
+
 BOOL common_util_check_search_result(sqlite3 *psqlite,
 	uint64_t folder_id, uint64_t message_id, BOOL *pb_exist)
 {
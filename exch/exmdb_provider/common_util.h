@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <string>
+#include <vector>
 #include <gromox/defs.h>
 #include <gromox/mail.hpp>
 #include <gromox/common_types.hpp>
@@ -93,6 +94,7 @@ BOOL common_util_allocate_eid(sqlite3 *psqlite, uint64_t *peid);
 BOOL common_util_allocate_eid_from_folder(sqlite3 *psqlite,
 	uint64_t folder_id, uint64_t *peid);
 BOOL common_util_allocate_cn(sqlite3 *psqlite, uint64_t *pcn);
+extern BOOL common_util_allocate_cns(sqlite3 *, uint32_t count, uint64_t *begin_cn);
 BOOL common_util_allocate_folder_art(sqlite3 *psqlite, uint32_t *part);
 BOOL common_util_check_allocated_eid(sqlite3 *psqlite,
 	uint64_t eid_val, BOOL *pb_result);
@@ -164,6 +166,17 @@ BOOL common_util_evaluate_folder_restriction(sqlite3 *psqlite,
 	uint64_t folder_id, const RESTRICTION *pres);
 BOOL common_util_evaluate_message_restriction(sqlite3 *psqlite,
 	uint32_t cpid, uint64_t message_id, const RESTRICTION *pres);
+/*
+ * How much of a message restriction common_util_restriction_to_sql could
+ * express. With RES_SQL_PARTIAL, the clause still holds for every matching
+ * message, but candidates need common_util_evaluate_message_restriction.
+ */
+enum {
+	RES_SQL_NONE,
+	RES_SQL_PARTIAL,
+	RES_SQL_EXACT,
+};
+extern unsigned int common_util_restriction_to_sql(const RESTRICTION *, std::string &clause, std::vector<std::string> &binds);
 BOOL common_util_check_search_result(sqlite3 *psqlite,
 	uint64_t folder_id, uint64_t message_id, BOOL *pb_exist);
 BOOL common_util_get_mid_string(sqlite3 *psqlite,
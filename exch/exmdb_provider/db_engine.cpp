@@ -1,4 +1,5 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <csignal>
@@ -6,6 +7,7 @@
 #include <condition_variable>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <gromox/database.h>
@@ -39,10 +41,30 @@
 
 #define MAX_DYNAMIC_NODES				100
 
+/*
+ * Search folder population evaluates this many messages per hold of the
+ * store lock; without a read-only handle, it pauses between chunks.
+ */
+#define SEARCH_CHUNK_SIZE				200
+#define SEARCH_YIELD_MSEC				10
+
+/*
+ * Rows a batch may add, change or remove in one table before the table is
+ * reloaded at commit time instead.
+ */
+#define MAX_BATCH_ROW_UPDATES			20
+
 using namespace gromox;
 
 namespace {
 
+struct SEARCH_CANDIDATE {
+	uint64_t message_id;
+	uint64_t change_num;
+	int64_t read_state;
+	bool b_match;
+};
+
 struct POPULATING_NODE {
 	DOUBLE_LIST_NODE node;
 	char *dir;
@@ -108,6 +130,32 @@ static DOUBLE_LIST g_populating_list1;
 
 static void db_engine_notify_content_table_modify_row(db_item_ptr &, uint64_t folder_id, uint64_t message_id);
 
+static bool db_engine_batch_defer(MEMORY_TABLES &tables, TABLE_NODE *ptable)
+{
+	if (!tables.b_batch)
+		return false;
+	if (!ptable->b_hint && ++ptable->batch_rows <= MAX_BATCH_ROW_UPDATES)
+		return false;
+	ptable->b_hint = TRUE;
+	return true;
+}
+
+/*
+ * A message or subfolder of @folder_id changed. In batch mode, the folder's
+ * own modification notice is sent only once, when the batch is committed.
+ */
+static void db_engine_notify_folder_touched(db_item_ptr &pdb, uint64_t folder_id)
+{
+	if (pdb->tables.b_batch) try {
+		pdb->tables.batch_folders.insert(folder_id);
+		return;
+	} catch (const std::bad_alloc &) {
+	}
+	auto parent_id = common_util_get_folder_parent_fid(pdb->psqlite, folder_id);
+	if (parent_id != 0)
+		db_engine_notify_folder_modification(pdb, parent_id, folder_id);
+}
+
 static void db_engine_load_dynamic_list(DB_ITEM *pdb)
 {
 	EXT_PULL ext_pull;
@@ -390,83 +438,190 @@ static void *mdpeng_scanwork(void *param)
 	return nullptr;
 }
 
-static BOOL db_engine_search_folder(const char *dir,
-	uint32_t cpid, uint64_t search_fid, uint64_t scope_fid,
-	const RESTRICTION *prestriction)
+/*
+ * Population works on a second, read-only handle when the journal is in WAL
+ * mode, so that restrictions can be evaluated while other threads hold the
+ * store lock. Without WAL, a reader would block writers, and evaluation falls
+ * back to the regular handle.
+ */
+static sqlite3 *db_engine_open_ro(const char *dir)
+{
+	char db_path[256];
+	char sql_string[64];
+	sqlite3 *psqlite = nullptr;
+
+	if (FALSE == g_wal)
+		return nullptr;
+	snprintf(db_path, arsizeof(db_path), "%s/exmdb/exchange.sqlite3", dir);
+	auto ret = sqlite3_open_v2(db_path, &psqlite, SQLITE_OPEN_READONLY, nullptr);
+	if (ret != SQLITE_OK) {
+		fprintf(stderr, "W-1510: sqlite3_open %s: %s\n", db_path, sqlite3_errstr(ret));
+		sqlite3_close(psqlite);
+		return nullptr;
+	}
+	sqlite3_busy_timeout(psqlite, DB_LOCK_TIMEOUT * 1000);
+	if (0 != g_mmap_size) {
+		snprintf(sql_string, arsizeof(sql_string), "PRAGMA mmap_size=%llu", LLU(g_mmap_size));
+		sqlite3_exec(psqlite, sql_string, nullptr, nullptr, nullptr);
+	}
+	return psqlite;
+}
+
+/*
+ * Collect the messages of @scope_fid that pass the SQL translation of the
+ * restriction. *@pb_exact tells whether they need no further evaluation.
+ */
+static BOOL db_engine_search_candidates(sqlite3 *psqlite, uint64_t scope_fid,
+    const RESTRICTION *prestriction, std::vector<SEARCH_CANDIDATE> &cands,
+    bool *pb_exact)
 {
 	char sql_string[128];
-	EID_ARRAY *pmessage_ids;
-	
-	auto pdb = db_engine_get_db(dir);
-	if (pdb == nullptr || pdb->psqlite == nullptr)
-		return FALSE;
+
 	snprintf(sql_string, arsizeof(sql_string), "SELECT is_search "
 	          "FROM folders WHERE folder_id=%llu", LLU(scope_fid));
-	auto pstmt = gx_sql_prep(pdb->psqlite, sql_string);
-	if (pstmt == nullptr) {
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr)
 		return FALSE;
-	}
-	if (SQLITE_ROW != sqlite3_step(pstmt)) {
+	if (SQLITE_ROW != sqlite3_step(pstmt))
 		return TRUE;
-	}
-	if (0 == sqlite3_column_int64(pstmt, 0)) {
-		snprintf(sql_string, arsizeof(sql_string), "SELECT message_id FROM"
-		          " messages WHERE parent_fid=%llu",
-		          static_cast<unsigned long long>(scope_fid));
-	} else {
-		snprintf(sql_string, arsizeof(sql_string), "SELECT message_id FROM"
-		          " search_result WHERE folder_id=%llu",
-		          static_cast<unsigned long long>(scope_fid));
-	}
+	bool b_search = sqlite3_column_int64(pstmt, 0) != 0;
 	pstmt.finalize();
-	pstmt = gx_sql_prep(pdb->psqlite, sql_string);
-	if (pstmt == nullptr) {
+	try {
+		std::string query = "SELECT message_id, change_number, "
+		                    "read_state FROM messages WHERE ";
+		std::string clause;
+		std::vector<std::string> binds;
+		auto ret = common_util_restriction_to_sql(prestriction, clause, binds);
+		*pb_exact = ret == RES_SQL_EXACT;
+		if (b_search)
+			snprintf(sql_string, arsizeof(sql_string), "message_id IN (SELECT "
+			         "message_id FROM search_result WHERE folder_id=%llu)",
+			         LLU(scope_fid));
+		else
+			snprintf(sql_string, arsizeof(sql_string),
+			         "parent_fid=%llu", LLU(scope_fid));
+		query += sql_string;
+		if (ret != RES_SQL_NONE)
+			query += " AND " + clause;
+		pstmt = gx_sql_prep(psqlite, query.c_str());
+		if (pstmt == nullptr)
+			return FALSE;
+		for (size_t i = 0; i < binds.size(); ++i)
+			sqlite3_bind_text(pstmt, i + 1, binds[i].c_str(), -1, SQLITE_STATIC);
+		while (SQLITE_ROW == sqlite3_step(pstmt))
+			cands.push_back({static_cast<uint64_t>(sqlite3_column_int64(pstmt, 0)),
+				static_cast<uint64_t>(sqlite3_column_int64(pstmt, 1)),
+				sqlite3_column_int64(pstmt, 2), false});
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "E-1511: ENOMEM\n");
 		return FALSE;
 	}
-	pmessage_ids = eid_array_init();
-	if (NULL == pmessage_ids) {
+	return TRUE;
+}
+
+/*
+ * Store one chunk of results. Candidates that were judged on the read-only
+ * handle (@b_verify) are accepted as-is only if they have not changed since;
+ * everything else is (re-)evaluated here, under the store lock. Messages
+ * that changed after being rejected are picked up by the dynamic event
+ * processing of the search folder.
+ */
+static BOOL db_engine_search_store(db_item_ptr &pdb, uint32_t cpid,
+    uint64_t search_fid, const RESTRICTION *prestriction, BOOL b_verify,
+    SEARCH_CANDIDATE *cands, size_t count)
+{
+	char sql_string[128];
+
+	auto pstmt = gx_sql_prep(pdb->psqlite, "SELECT change_number, "
+	             "read_state FROM messages WHERE message_id=?");
+	if (pstmt == nullptr)
 		return FALSE;
-	}
-	while (SQLITE_ROW == sqlite3_step(pstmt)) {
-		if (!eid_array_append(pmessage_ids,
-		    sqlite3_column_int64(pstmt, 0))) {
-			eid_array_free(pmessage_ids);
-			return FALSE;
+	snprintf(sql_string, arsizeof(sql_string), "REPLACE INTO search_result "
+	         "(folder_id, message_id) VALUES (%llu, ?)", LLU(search_fid));
+	auto pstmt1 = gx_sql_prep(pdb->psqlite, sql_string);
+	if (pstmt1 == nullptr)
+		return FALSE;
+	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+	for (size_t i = 0; i < count; ++i) {
+		auto &c = cands[i];
+		if (!b_verify) {
+			c.b_match = common_util_evaluate_message_restriction(
+			            pdb->psqlite, cpid, c.message_id, prestriction);
+		} else if (c.b_match) {
+			sqlite3_reset(pstmt);
+			sqlite3_bind_int64(pstmt, 1, c.message_id);
+			if (sqlite3_step(pstmt) != SQLITE_ROW) {
+				c.b_match = false;
+			} else if (static_cast<uint64_t>(sqlite3_column_int64(pstmt, 0)) != c.change_num ||
+			    sqlite3_column_int64(pstmt, 1) != c.read_state) {
+				c.b_match = common_util_evaluate_message_restriction(
+				            pdb->psqlite, cpid, c.message_id, prestriction);
+			}
 		}
+		if (!c.b_match)
+			continue;
+		sqlite3_reset(pstmt1);
+		sqlite3_bind_int64(pstmt1, 1, c.message_id);
+		if (sqlite3_step(pstmt1) != SQLITE_DONE)
+			c.b_match = false;
 	}
 	pstmt.finalize();
-	exmdb_server_build_environment(FALSE, TRUE, dir);
-	for (size_t i = 0, count = 0; i < pmessage_ids->count; ++i, ++count) {
-		if (g_notify_stop)
-			break;
-		if (200 == count) {
-			pdb.reset();
-			exmdb_server_free_environment();
-			sleep(1);
-			pdb = db_engine_get_db(dir);
-			if (pdb == nullptr || pdb->psqlite == nullptr) {
-				eid_array_free(pmessage_ids);
+	pstmt1.finalize();
+	sqlite3_exec(pdb->psqlite, "COMMIT TRANSACTION", nullptr, nullptr, nullptr);
+	for (size_t i = 0; i < count; ++i)
+		if (cands[i].b_match)
+			db_engine_proc_dynamic_event(pdb, cpid,
+				DYNAMIC_EVENT_NEW_MESSAGE, search_fid,
+				cands[i].message_id, 0);
+	return TRUE;
+}
+
+static BOOL db_engine_search_folder(const char *dir, sqlite3 *psqlite_ro,
+	uint32_t cpid, uint64_t search_fid, uint64_t scope_fid,
+	const RESTRICTION *prestriction)
+{
+	std::vector<SEARCH_CANDIDATE> cands;
+	bool b_exact = false;
+	
+	{
+		exmdb_server_build_environment(FALSE, TRUE, dir);
+		auto cl_0 = make_scope_exit(exmdb_server_free_environment);
+		if (psqlite_ro != nullptr) {
+			if (!db_engine_search_candidates(psqlite_ro, scope_fid,
+			    prestriction, cands, &b_exact))
+				return FALSE;
+		} else {
+			auto pdb = db_engine_get_db(dir);
+			if (pdb == nullptr || pdb->psqlite == nullptr)
+				return FALSE;
+			if (!db_engine_search_candidates(pdb->psqlite, scope_fid,
+			    prestriction, cands, &b_exact))
 				return FALSE;
-			}
-			exmdb_server_build_environment(FALSE, TRUE, dir);
-			count = 0;
-		}
-		if (TRUE == common_util_evaluate_message_restriction(
-			pdb->psqlite, cpid, pmessage_ids->pids[i], prestriction)) {
-			snprintf(sql_string, arsizeof(sql_string), "REPLACE INTO search_result "
-				"(folder_id, message_id) VALUES (%llu, %llu)",
-				LLU(search_fid), LLU(pmessage_ids->pids[i]));
-			if (SQLITE_OK == sqlite3_exec(pdb->psqlite,
-				sql_string, NULL, NULL, NULL)) {
-				db_engine_proc_dynamic_event(pdb, cpid,
-					DYNAMIC_EVENT_NEW_MESSAGE, search_fid,
-					pmessage_ids->pids[i], 0);
-			}
 		}
 	}
-	pdb.reset();
-	exmdb_server_free_environment();
-	eid_array_free(pmessage_ids);
+	for (size_t i = 0; i < cands.size(); i += SEARCH_CHUNK_SIZE) {
+		if (g_notify_stop)
+			break;
+		auto count = std::min(cands.size() - i, static_cast<size_t>(SEARCH_CHUNK_SIZE));
+		exmdb_server_build_environment(FALSE, TRUE, dir);
+		auto cl_1 = make_scope_exit(exmdb_server_free_environment);
+		if (psqlite_ro != nullptr)
+			for (size_t j = i; j < i + count; ++j)
+				cands[j].b_match = b_exact ||
+				                   common_util_evaluate_message_restriction(
+				                   psqlite_ro, cpid, cands[j].message_id,
+				                   prestriction);
+		auto pdb = db_engine_get_db(dir);
+		if (pdb == nullptr || pdb->psqlite == nullptr)
+			return FALSE;
+		if (!db_engine_search_store(pdb, cpid, search_fid, prestriction,
+		    psqlite_ro != nullptr ? TRUE : false, &cands[i], count))
+			return FALSE;
+		pdb.reset();
+		if (psqlite_ro == nullptr)
+			/* let waiting RPCs get hold of the store */
+			std::this_thread::sleep_for(std::chrono::milliseconds(SEARCH_YIELD_MSEC));
+	}
 	return TRUE;
 }
 
@@ -635,6 +790,29 @@ static void db_engine_notify_search_completion(db_item_ptr &pdb, uint64_t folder
 	}
 }
 
+/*
+ * Take the oldest request whose store is not already being populated by
+ * another thread, so that POPULATING_THREADS_NUM is spent on different
+ * stores rather than queueing up on one store lock. Requests for a busy
+ * store are left for the thread working on it.
+ */
+static DOUBLE_LIST_NODE *db_engine_pick_populating()
+{
+	for (auto pnode = double_list_get_head(&g_populating_list); pnode != nullptr;
+	     pnode = double_list_get_after(&g_populating_list, pnode)) {
+		auto psearch = static_cast<POPULATING_NODE *>(pnode->pdata);
+		DOUBLE_LIST_NODE *pnode1;
+		for (pnode1 = double_list_get_head(&g_populating_list1); pnode1 != nullptr;
+		     pnode1 = double_list_get_after(&g_populating_list1, pnode1))
+			if (strcmp(static_cast<POPULATING_NODE *>(pnode1->pdata)->dir,
+			    psearch->dir) == 0)
+				break;
+		if (pnode1 == nullptr)
+			return pnode;
+	}
+	return nullptr;
+}
+
 static void *mdpeng_thrwork(void *param)
 {
 	int table_num;
@@ -643,6 +821,7 @@ static void *mdpeng_thrwork(void *param)
 	EID_ARRAY *pfolder_ids;
 	DOUBLE_LIST_NODE *pnode;
 	POPULATING_NODE *psearch;
+	sqlite3 *psqlite_ro = nullptr;
 	
 	while (!g_notify_stop) {
 		std::unique_lock chold(g_cond_mutex);
@@ -652,8 +831,9 @@ static void *mdpeng_thrwork(void *param)
 		if (g_notify_stop)
 			break;
 		std::unique_lock lhold(g_list_lock);
-		pnode = double_list_pop_front(&g_populating_list);
+		pnode = db_engine_pick_populating();
 		if (NULL != pnode) {
+			double_list_remove(&g_populating_list, pnode);
 			double_list_append_as_tail(&g_populating_list1, pnode);
 		}
 		lhold.unlock();
@@ -684,15 +864,20 @@ static void *mdpeng_thrwork(void *param)
 				goto NEXT_SEARCH;
 			}
 		}
+		psqlite_ro = db_engine_open_ro(psearch->dir);
 		for (size_t i = 0; i < pfolder_ids->count; ++i) {
 			if (g_notify_stop)
 				break;
-			if (FALSE == db_engine_search_folder(
-				psearch->dir, psearch->cpid, psearch->folder_id,
+			if (FALSE == db_engine_search_folder(psearch->dir,
+				psqlite_ro, psearch->cpid, psearch->folder_id,
 				pfolder_ids->pids[i], psearch->prestriction)) {
 				break;	
 			}
 		}
+		if (psqlite_ro != nullptr) {
+			sqlite3_close(psqlite_ro);
+			psqlite_ro = nullptr;
+		}
 		if (!g_notify_stop) {
 			auto pdb = db_engine_get_db(psearch->dir);
 			if (NULL != pdb) {
@@ -701,10 +886,7 @@ static void *mdpeng_thrwork(void *param)
 						FALSE, TRUE, psearch->dir);
 					db_engine_notify_search_completion(
 						pdb, psearch->folder_id);
-					db_engine_notify_folder_modification(pdb,
-						common_util_get_folder_parent_fid(
-						pdb->psqlite, psearch->folder_id),
-						psearch->folder_id);
+					db_engine_notify_folder_touched(pdb, psearch->folder_id);
 					table_num = double_list_get_nodes_num(
 								&pdb->tables.table_list);
 					if (table_num > 0) {
@@ -971,6 +1153,15 @@ void db_engine_proc_dynamic_event(db_item_ptr &pdb, uint32_t cpid,
 	DYNAMIC_NODE *pdynamic;
 	DOUBLE_LIST_NODE *pnode;
 	
+	if (pdb->fb_index.b_loaded && event_type != DYNAMIC_EVENT_MOVE_FOLDER &&
+	    id1 == PRIVATE_FID_CALENDAR) {
+		try {
+			pdb->fb_index.dirty.insert(id2);
+		} catch (const std::bad_alloc &) {
+			/* cannot track it; have the next query rebuild */
+			pdb->fb_index.b_loaded = false;
+		}
+	}
 	if (DYNAMIC_EVENT_MOVE_FOLDER == event_type) {
 		if (FALSE == common_util_get_folder_type(
 			pdb->psqlite, id3, &folder_type)) {
@@ -1136,10 +1327,7 @@ void db_engine_proc_dynamic_event(db_item_ptr &pdb, uint32_t cpid,
 					if (TRUE == b_exist) {
 						db_engine_notify_content_table_modify_row(
 							pdb, pdynamic->folder_id, id2);
-						db_engine_notify_folder_modification(pdb,
-							common_util_get_folder_parent_fid(
-							pdb->psqlite, pdynamic->folder_id),
-							pdynamic->folder_id);
+						db_engine_notify_folder_touched(pdb, pdynamic->folder_id);
 						continue;
 					}
 					snprintf(sql_string, arsizeof(sql_string), "INSERT INTO search_result "
@@ -1439,6 +1627,174 @@ static BOOL db_engine_check_new_header(
 	return FALSE;
 }
 
+/* Renumber the visible rows of a categorized table from scratch. */
+static BOOL db_engine_reindex_table(sqlite3 *psqlite,
+	uint32_t table_id, uint32_t ccategories)
+{
+	uint32_t idx = 0;
+	char sql_string[128];
+	
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET idx=NULL", table_id);
+	if (SQLITE_OK != sqlite3_exec(psqlite, sql_string, NULL, NULL, NULL))
+		return FALSE;
+	snprintf(sql_string, arsizeof(sql_string), "SELECT row_id, row_stat"
+		" FROM t%u WHERE prev_id=?", table_id);
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr)
+		return FALSE;
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET"
+		" idx=? WHERE row_id=?", table_id);
+	auto pstmt1 = gx_sql_prep(psqlite, sql_string);
+	if (pstmt1 == nullptr)
+		return FALSE;
+	sqlite3_bind_int64(pstmt, 1, 0);
+	if (SQLITE_ROW == sqlite3_step(pstmt))
+		return common_util_indexing_sub_contents(ccategories,
+		       pstmt, pstmt1, &idx);
+	return TRUE;
+}
+
+/*
+ * Categorized tables: give the rows that were just linked in for message row
+ * @row_id (the message itself plus any header rows created for it; those
+ * still have count=1) their idx, and shift the rows behind them. This
+ * replaces renumbering the whole table. Returns FALSE if the caller has to
+ * renumber after all.
+ */
+static BOOL db_engine_index_new_rows(sqlite3 *psqlite,
+	uint32_t table_id, uint64_t row_id)
+{
+	size_t num = 0;
+	char sql_string[256];
+	uint64_t chain[MAXIMUM_SORT_COUNT + 1];
+	
+	snprintf(sql_string, arsizeof(sql_string), "SELECT parent_id, count,"
+		" row_stat, idx, prev_id, row_type FROM t%u WHERE row_id=?",
+		table_id);
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr)
+		return FALSE;
+	auto cur = row_id;
+	while (true) {
+		chain[num++] = cur;
+		sqlite3_bind_int64(pstmt, 1, cur);
+		if (sqlite3_step(pstmt) != SQLITE_ROW)
+			return FALSE;
+		cur = sqlite3_column_int64(pstmt, 0);
+		sqlite3_reset(pstmt);
+		if (cur == 0 || num >= GX_ARRAY_SIZE(chain))
+			break;
+		sqlite3_bind_int64(pstmt, 1, cur);
+		if (sqlite3_step(pstmt) != SQLITE_ROW)
+			return FALSE;
+		auto count = sqlite3_column_int64(pstmt, 1);
+		sqlite3_reset(pstmt);
+		if (count != 1)
+			break;
+	}
+	std::reverse(chain, chain + num);
+	/* chain[0] is the topmost new row, @cur its (existing) parent */
+	if (cur != 0) {
+		sqlite3_bind_int64(pstmt, 1, cur);
+		if (sqlite3_step(pstmt) != SQLITE_ROW)
+			return FALSE;
+		bool b_visible = sqlite3_column_type(pstmt, 3) != SQLITE_NULL &&
+		                 sqlite3_column_int64(pstmt, 2) != 0;
+		sqlite3_reset(pstmt);
+		if (!b_visible)
+			return TRUE;
+	}
+	size_t count = 1;
+	for (size_t i = 0; i + 1 < num; ++i, ++count) {
+		sqlite3_bind_int64(pstmt, 1, chain[i]);
+		if (sqlite3_step(pstmt) != SQLITE_ROW)
+			return FALSE;
+		auto row_stat = sqlite3_column_int64(pstmt, 2);
+		sqlite3_reset(pstmt);
+		if (0 == row_stat)
+			break;
+	}
+	/* the row in front is the previous sibling's last visible descendant */
+	sqlite3_bind_int64(pstmt, 1, chain[0]);
+	if (sqlite3_step(pstmt) != SQLITE_ROW)
+		return FALSE;
+	int64_t prev_id = sqlite3_column_int64(pstmt, 4);
+	sqlite3_reset(pstmt);
+	uint64_t front = prev_id > 0 ? prev_id : cur;
+	uint32_t idx = 0;
+	if (front != 0) {
+		snprintf(sql_string, arsizeof(sql_string), "SELECT a.row_id FROM t%u AS a"
+			" WHERE a.parent_id=? AND NOT EXISTS (SELECT 1 FROM t%u AS b"
+			" WHERE b.prev_id=a.row_id)", table_id, table_id);
+		auto pstmt1 = gx_sql_prep(psqlite, sql_string);
+		if (pstmt1 == nullptr)
+			return FALSE;
+		while (true) {
+			sqlite3_bind_int64(pstmt, 1, front);
+			if (sqlite3_step(pstmt) != SQLITE_ROW ||
+			    sqlite3_column_type(pstmt, 3) == SQLITE_NULL)
+				return FALSE;
+			idx = sqlite3_column_int64(pstmt, 3);
+			bool b_open = front != cur &&
+			              sqlite3_column_int64(pstmt, 5) == CONTENT_ROW_HEADER &&
+			              sqlite3_column_int64(pstmt, 2) != 0;
+			sqlite3_reset(pstmt);
+			if (!b_open)
+				break;
+			sqlite3_bind_int64(pstmt1, 1, front);
+			if (sqlite3_step(pstmt1) != SQLITE_ROW)
+				break;
+			front = sqlite3_column_int64(pstmt1, 0);
+			sqlite3_reset(pstmt1);
+		}
+	}
+	++idx;
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET idx=-(idx+%zu)"
+		" WHERE idx>=%u;UPDATE t%u SET idx=-idx WHERE idx<0",
+		table_id, count, idx, table_id);
+	if (sqlite3_exec(psqlite, sql_string, nullptr, nullptr, nullptr) != SQLITE_OK)
+		return FALSE;
+	for (size_t i = 0; i < count; ++i) {
+		snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET idx=%zu"
+			" WHERE row_id=%llu", table_id, idx + i, LLU(chain[i]));
+		if (sqlite3_exec(psqlite, sql_string, nullptr, nullptr, nullptr) != SQLITE_OK)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Categorized tables: close the gaps that removed rows left in the idx
+ * sequence. @pdel_list holds the ROWDEL_NODEs of the removed rows.
+ */
+static BOOL db_engine_unindex_rows(sqlite3 *psqlite,
+	uint32_t table_id, DOUBLE_LIST *pdel_list)
+{
+	char sql_string[256];
+	std::vector<uint32_t> idxs;
+	
+	try {
+		for (auto pnode = double_list_get_head(pdel_list); pnode != nullptr;
+		     pnode = double_list_get_after(pdel_list, pnode)) {
+			auto pdelnode = static_cast<ROWDEL_NODE *>(pnode->pdata);
+			if (0 != pdelnode->idx)
+				idxs.push_back(pdelnode->idx);
+		}
+	} catch (const std::bad_alloc &) {
+		return FALSE;
+	}
+	/* from the back, so that the remaining positions stay valid */
+	std::sort(idxs.begin(), idxs.end(), std::greater<>());
+	for (auto idx : idxs) {
+		snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET idx=-(idx-1)"
+			" WHERE idx>%u;UPDATE t%u SET idx=-idx WHERE idx<0",
+			table_id, idx, table_id);
+		if (sqlite3_exec(psqlite, sql_string, nullptr, nullptr, nullptr) != SQLITE_OK)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
     uint64_t folder_id, uint64_t message_id)
 {
@@ -1508,10 +1864,8 @@ static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
 			ptable->cpid, message_id, ptable->prestriction)) {
 			continue;
 		}
-		if (TRUE == pdb->tables.b_batch) {
-			ptable->b_hint = TRUE;
+		if (db_engine_batch_defer(pdb->tables, ptable))
 			continue;
-		}
 		if (NULL == padded_row) {
 			datagram.dir = (char*)exmdb_server_get_dir();
 			datagram.b_table = TRUE;
@@ -1871,6 +2225,7 @@ static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
 				}
 			}
 			b_resorted = FALSE;
+			bool b_reindex = false;
 			double_list_init(&notify_list);
 			for (size_t j = 0; j < multi_num; ++j) {
 				if (NULL != pmultival) {
@@ -2029,6 +2384,7 @@ static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
 						"ROLLBACK", NULL, NULL, NULL);
 					return;
 				}
+				uint64_t msg_row_id = row_id;
 				parent_id = 0;
 				while (TRUE) {
 					sqlite3_bind_int64(pstmt3, 1, row_id);
@@ -2061,6 +2417,9 @@ static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
 					}
 					db_engine_append_rowinfo_node(&notify_list, row_id);
 				}
+				if (!b_reindex && !db_engine_index_new_rows(
+				    pdb->tables.psqlite, ptable->table_id, msg_row_id))
+					b_reindex = true;
 				if (0 == ptable->extremum_tag) {
 					continue;
 				}
@@ -2166,6 +2525,7 @@ static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
 					continue;
 				}
 				/* position within the list has been changed */
+				b_reindex = true;
 				if (FALSE == db_engine_check_new_header(
 					&notify_list, row_id)) {
 					b_resorted = TRUE;
@@ -2212,41 +2572,12 @@ static void db_engine_notify_content_table_add_row(db_item_ptr &pdb,
 			pstmt1.finalize();
 			pstmt2.finalize();
 			pstmt4.finalize();
-			snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET idx=NULL", ptable->table_id);
-			if (SQLITE_OK != sqlite3_exec(pdb->tables.psqlite,
-				sql_string, NULL, NULL, NULL)) {
-				sqlite3_exec(pdb->tables.psqlite,
-					"ROLLBACK", NULL, NULL, NULL);
-				return;
-			}
-			snprintf(sql_string, arsizeof(sql_string), "SELECT row_id, row_stat"
-			" FROM t%u WHERE prev_id=?", ptable->table_id);
-			pstmt = gx_sql_prep(pdb->tables.psqlite, sql_string);
-			if (pstmt == nullptr) {
+			if (b_reindex && !db_engine_reindex_table(pdb->tables.psqlite,
+			    ptable->table_id, ptable->psorts->ccategories)) {
 				sqlite3_exec(pdb->tables.psqlite,
 					"ROLLBACK", NULL, NULL, NULL);
 				return;
 			}
-			snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET"
-				" idx=? WHERE row_id=?", ptable->table_id);
-			pstmt1 = gx_sql_prep(pdb->tables.psqlite, sql_string);
-			if (pstmt1 == nullptr) {
-				sqlite3_exec(pdb->tables.psqlite,
-					"ROLLBACK", NULL, NULL, NULL);
-				return;
-			}
-			idx = 0;
-			sqlite3_bind_int64(pstmt, 1, 0);
-			if (SQLITE_ROW == sqlite3_step(pstmt)) {
-				if (FALSE == common_util_indexing_sub_contents(
-					ptable->psorts->ccategories, pstmt, pstmt1, &idx)) {
-					sqlite3_exec(pdb->tables.psqlite,
-						"ROLLBACK", NULL, NULL, NULL);
-					return;
-				}
-			}
-			pstmt.finalize();
-			pstmt1.finalize();
 			sqlite3_exec(pdb->tables.psqlite,
 				"COMMIT TRANSACTION", NULL, NULL, NULL);
 			if (ptable->table_flags & TABLE_FLAG_NONOTIFICATIONS) {
@@ -2501,9 +2832,7 @@ void db_engine_notify_new_mail(db_item_ptr &pdb,
 	}
 	db_engine_notify_content_table_add_row(
 		pdb, folder_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, folder_id), folder_id);
+	db_engine_notify_folder_touched(pdb, folder_id);
 }
 
 void db_engine_notify_message_creation(db_item_ptr &pdb,
@@ -2567,9 +2896,7 @@ void db_engine_notify_message_creation(db_item_ptr &pdb,
 	}
 	db_engine_notify_content_table_add_row(
 		pdb, folder_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, folder_id), folder_id);
+	db_engine_notify_folder_touched(pdb, folder_id);
 }
 
 void db_engine_notify_link_creation(db_item_ptr &pdb,
@@ -2639,9 +2966,7 @@ void db_engine_notify_link_creation(db_item_ptr &pdb,
 	}
 	db_engine_notify_content_table_add_row(
 		pdb, parent_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, parent_id), parent_id);
+	db_engine_notify_folder_touched(pdb, parent_id);
 }
 
 static void db_engine_notify_hierarchy_table_add_row(db_item_ptr &pdb,
@@ -2882,9 +3207,7 @@ void db_engine_notify_folder_creation(db_item_ptr &pdb,
 	}
 	db_engine_notify_hierarchy_table_add_row(
 		pdb, parent_id, folder_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, parent_id), parent_id);
+	db_engine_notify_folder_touched(pdb, parent_id);
 }
 
 static void db_engine_update_prev_id(DOUBLE_LIST *plist,
@@ -3003,10 +3326,8 @@ static void db_engine_notify_content_table_delete_row(db_item_ptr &pdb,
 		if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
 			continue;
 		pstmt.finalize();
-		if (TRUE == pdb->tables.b_batch) {
-			ptable->b_hint = TRUE;
+		if (db_engine_batch_defer(pdb->tables, ptable))
 			continue;
-		}
 		if (NULL == pdeleted_row) {
 			datagram.dir = (char*)exmdb_server_get_dir();
 			datagram.b_table = TRUE;
@@ -3371,42 +3692,15 @@ static void db_engine_notify_content_table_delete_row(db_item_ptr &pdb,
 				"ROLLBACK", NULL, NULL, NULL);
 			continue;
 		}
-		if (TRUE == b_index) {
-			snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET idx=NULL", ptable->table_id);
-			if (SQLITE_OK != sqlite3_exec(pdb->tables.psqlite,
-				sql_string, NULL, NULL, NULL)) {
-				sqlite3_exec(pdb->tables.psqlite,
-					"ROLLBACK", NULL, NULL, NULL);
-				continue;
-			}
-			snprintf(sql_string, arsizeof(sql_string), "SELECT row_id, row_stat"
-					" FROM t%u WHERE prev_id=?", ptable->table_id);
-			pstmt = gx_sql_prep(pdb->tables.psqlite, sql_string);
-			if (pstmt == nullptr) {
-				sqlite3_exec(pdb->tables.psqlite,
-					"ROLLBACK", NULL, NULL, NULL);
-				continue;
-			}
-			snprintf(sql_string, arsizeof(sql_string), "UPDATE t%u SET"
-				" idx=? WHERE row_id=?", ptable->table_id);
-			pstmt1 = gx_sql_prep(pdb->tables.psqlite, sql_string);
-			if (pstmt1 == nullptr) {
-				sqlite3_exec(pdb->tables.psqlite,
-					"ROLLBACK", NULL, NULL, NULL);
-				continue;
-			}
-			idx = 0;
-			sqlite3_bind_int64(pstmt, 1, 0);
-			if (SQLITE_ROW == sqlite3_step(pstmt)) {
-				if (FALSE == common_util_indexing_sub_contents(
-					ptable->psorts->ccategories, pstmt, pstmt1, &idx)) {
-					sqlite3_exec(pdb->tables.psqlite,
-						"ROLLBACK", NULL, NULL, NULL);
-					continue;
-				}
-			}
-			pstmt.finalize();
-			pstmt1.finalize();
+		/* a moved header shifts whole subtrees; renumber in that case */
+		if ((TRUE == b_resorted || (TRUE == b_index &&
+		    !db_engine_unindex_rows(pdb->tables.psqlite,
+		    ptable->table_id, &tmp_list))) &&
+		    !db_engine_reindex_table(pdb->tables.psqlite,
+		    ptable->table_id, ptable->psorts->ccategories)) {
+			sqlite3_exec(pdb->tables.psqlite,
+				"ROLLBACK", NULL, NULL, NULL);
+			continue;
 		}
 		sqlite3_exec(pdb->tables.psqlite,
 			"COMMIT TRANSACTION", NULL, NULL, NULL);
@@ -3577,9 +3871,7 @@ void db_engine_notify_message_deletion(db_item_ptr &pdb,
 	}
 	db_engine_notify_content_table_delete_row(
 		pdb, folder_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, folder_id), folder_id);
+	db_engine_notify_folder_touched(pdb, folder_id);
 }
 
 void db_engine_notify_link_deletion(db_item_ptr &pdb,
@@ -3648,9 +3940,7 @@ void db_engine_notify_link_deletion(db_item_ptr &pdb,
 	}
 	db_engine_notify_content_table_delete_row(
 		pdb, parent_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, parent_id), parent_id);
+	db_engine_notify_folder_touched(pdb, parent_id);
 }
 
 static void db_engine_notify_hierarchy_table_delete_row(db_item_ptr &pdb,
@@ -3838,6 +4128,9 @@ static void db_engine_notify_content_table_modify_row(db_item_ptr &pdb,
 			folder_id != ptable->folder_id) {
 			continue;
 		}
+		if (TRUE == pdb->tables.b_batch && TRUE == ptable->b_hint) {
+			continue;
+		}
 		if (0 == ptable->instance_tag) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT count(*) "
 				"FROM t%u WHERE inst_id=%llu AND inst_num=0",
@@ -3852,6 +4145,8 @@ static void db_engine_notify_content_table_modify_row(db_item_ptr &pdb,
 		    sqlite3_column_int64(pstmt, 0) == 0)
 			continue;
 		pstmt.finalize();
+		if (db_engine_batch_defer(pdb->tables, ptable))
+			continue;
 		if (NULL == pmodified_row) {
 			datagram.dir = (char*)exmdb_server_get_dir();
 			datagram.b_table = TRUE;
@@ -4494,9 +4789,6 @@ static void db_engine_notify_content_table_modify_row(db_item_ptr &pdb,
 			return;
 		}
 		*ptnode = *ptable;
-		if (0 != ptable->psorts->ccategories) {
-			ptnode->table_flags |= TABLE_FLAG_NONOTIFICATIONS;
-		}
 		ptnode->node.pdata = ptnode;
 		double_list_append_as_tail(&tmp_list, &ptnode->node);
 	}
@@ -4517,21 +4809,11 @@ static void db_engine_notify_content_table_modify_row(db_item_ptr &pdb,
 				&pdb->tables.table_list, pnode1)) {
 				ptnode = (TABLE_NODE*)pnode1->pdata;
 				if (ptable->table_id == ptnode->table_id) {
+					/*
+					 * Categorized views get the row-level
+					 * notifications of the remove/re-add.
+					 */
 					ptnode->header_id = ptable->header_id;
-					if (0 != ptable->psorts->ccategories &&
-						0 == (ptnode->table_flags &
-						TABLE_FLAG_NONOTIFICATIONS)) {
-						if (FALSE == ptnode->b_search) {
-							datagram.db_notify.type =
-								DB_NOTIFY_TYPE_CONTENT_TABLE_CHANGED;
-						} else {
-							datagram.db_notify.type =
-								DB_NOTIFY_TYPE_SEARCH_TABLE_CHANGED;
-						}
-						datagram.id_array.pl = &ptable->table_id;
-						notification_agent_backward_notify(
-							ptable->remote_id, &datagram);
-					}
 					break;
 				}
 			}
@@ -4600,9 +4882,7 @@ void db_engine_notify_message_modification(db_item_ptr &pdb,
 	}
 	db_engine_notify_content_table_modify_row(
 		pdb, folder_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, folder_id), folder_id);
+	db_engine_notify_folder_touched(pdb, folder_id);
 }
 
 static void db_engine_notify_hierarchy_table_modify_row(db_item_ptr &pdb,
@@ -4932,15 +5212,11 @@ void db_engine_notify_message_movecopy(db_item_ptr &pdb,
 	if (FALSE == b_copy) {
 		db_engine_notify_content_table_delete_row(
 			pdb, old_fid, old_mid);
-		db_engine_notify_folder_modification(
-			pdb, common_util_get_folder_parent_fid(
-			pdb->psqlite, old_fid), old_fid);
+		db_engine_notify_folder_touched(pdb, old_fid);
 	}
 	db_engine_notify_content_table_add_row(
 		pdb, folder_id, message_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, folder_id), folder_id);
+	db_engine_notify_folder_touched(pdb, folder_id);
 }
 
 void db_engine_notify_folder_movecopy(db_item_ptr &pdb,
@@ -5019,15 +5295,11 @@ void db_engine_notify_folder_movecopy(db_item_ptr &pdb,
 	if (FALSE == b_copy) {
 		db_engine_notify_hierarchy_table_delete_row(
 			pdb, old_pid, old_fid);
-		db_engine_notify_folder_modification(
-			pdb, common_util_get_folder_parent_fid(
-			pdb->psqlite, old_pid), old_pid);
+		db_engine_notify_folder_touched(pdb, old_pid);
 	}
 	db_engine_notify_hierarchy_table_add_row(
 		pdb, parent_id, folder_id);
-	db_engine_notify_folder_modification(
-		pdb, common_util_get_folder_parent_fid(
-		pdb->psqlite, parent_id), parent_id);
+	db_engine_notify_folder_touched(pdb, parent_id);
 }
 
 void db_engine_notify_content_table_reload(db_item_ptr &pdb, uint32_t table_id)
@@ -5076,6 +5348,7 @@ void db_engine_commit_batch_mode(db_item_ptr &&pdb)
 	for (pnode=double_list_get_head(&pdb->tables.table_list); NULL!=pnode;
 		pnode=double_list_get_after(&pdb->tables.table_list, pnode)) {
 		ptable = (TABLE_NODE*)pnode->pdata;
+		ptable->batch_rows = 0;
 		if (TRUE == ptable->b_hint) {
 			if (NULL != ptable_ids) {
 				ptable_ids[table_num] = ptable->table_id;
@@ -5085,6 +5358,13 @@ void db_engine_commit_batch_mode(db_item_ptr &&pdb)
 		}
 	}
 	pdb->tables.b_batch = FALSE;
+	auto folders = std::move(pdb->tables.batch_folders);
+	pdb->tables.batch_folders.clear();
+	for (auto folder_id : folders) {
+		auto parent_id = common_util_get_folder_parent_fid(pdb->psqlite, folder_id);
+		if (parent_id != 0)
+			db_engine_notify_folder_modification(pdb, parent_id, folder_id);
+	}
 	pdb.reset();
 	dir = exmdb_server_get_dir();
 	while (0 != table_num) {
@@ -5103,6 +5383,8 @@ void db_engine_cancel_batch_mode(db_item_ptr &pdb)
 		pnode=double_list_get_after(&pdb->tables.table_list, pnode)) {
 		ptable = (TABLE_NODE*)pnode->pdata;
 		ptable->b_hint = FALSE;
+		ptable->batch_rows = 0;
 	}
 	pdb->tables.b_batch = FALSE;
+	pdb->tables.batch_folders.clear();
 }
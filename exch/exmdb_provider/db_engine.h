@@ -3,8 +3,12 @@
 #include <cstdint>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <gromox/element_data.hpp>
 #include <gromox/double_list.hpp>
+#include <gromox/freebusy.hpp>
 #include <gromox/mapi_types.hpp>
 #include <sqlite3.h>
 #define CONTENT_ROW_HEADER						1
@@ -54,6 +58,7 @@ struct TABLE_NODE {
 	uint32_t extremum_tag;
 	uint32_t header_id;
 	BOOL b_hint;		/* is table touched in batch-mode */
+	uint32_t batch_rows;	/* rows updated individually in batch-mode */
 };
 
 struct NSUB_NODE {
@@ -68,6 +73,8 @@ struct NSUB_NODE {
 
 #define CHANGE_MASK_HTML						0x01
 #define CHANGE_MASK_BODY						0x02
+#define CHANGE_MASK_RCPTS						0x04
+#define CHANGE_MASK_ATTACHMENTS						0x08
 
 struct INSTANCE_NODE {
 	DOUBLE_LIST_NODE node;
@@ -80,6 +87,10 @@ struct INSTANCE_NODE {
 	int type;
 	BOOL b_new;
 	uint8_t change_mask;
+	/* message whose recipients and attachments are not read in yet */
+	uint64_t lazy_mid;
+	/* their share of the stored message_size */
+	uint32_t lazy_child_size;
 	void *pcontent;
 };
 
@@ -87,10 +98,29 @@ struct INSTANCE_NODE {
 struct MEMORY_TABLES {
 	uint32_t last_id = 0;
 	BOOL b_batch = false;/* message database is in batch-mode */
+	/* folders whose modification notice is held back until batch commit */
+	std::unordered_set<uint64_t> batch_folders;
 	DOUBLE_LIST table_list{};
 	sqlite3 *psqlite = nullptr;
 };
 
+struct FB_APPOINTMENT {
+	uint64_t change_num = 0;
+	bool b_recurring = false;
+	/* recurring only: first start and last possible end of the series */
+	time_t series_start = 0, series_end = 0;
+	/* occurrences; for recurring series, only those within the horizon */
+	std::vector<freebusy_event> events;
+};
+
+/* materialized free/busy occurrences of the private calendar folder */
+struct FB_INDEX {
+	bool b_loaded = false;
+	time_t build_time = 0, horizon_start = 0, horizon_end = 0;
+	std::unordered_map<uint64_t, FB_APPOINTMENT> appts;
+	std::unordered_set<uint64_t> dirty; /* message ids to re-read */
+};
+
 struct DB_ITEM {
 	~DB_ITEM();
 	/* client reference count, item can be flushed into file system only count is 0 */
@@ -102,6 +132,7 @@ struct DB_ITEM {
 	DOUBLE_LIST nsub_list{};
 	DOUBLE_LIST instance_list{};
 	MEMORY_TABLES tables{};
+	FB_INDEX fb_index;
 };
 
 extern void db_engine_init(size_t table_size, int cache_interval, BOOL async, BOOL wal, uint64_t mmap_size, int threads_num);
@@ -16,7 +16,9 @@
 #include "exmdb_parser.h"
 #include "exmdb_listener.h"
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <cstdlib>
@@ -24,23 +26,68 @@
 #include <cstdio>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 
 using namespace gromox;
 
 static uint16_t g_listen_port;
-static int g_listen_sockd;
+static int g_listen_sockd, g_unix_sockd = -1;
+static char g_unix_path[256];
 static std::atomic<bool> g_notify_stop{false};
 static char g_listen_ip[40];
 static std::vector<std::string> g_acl_list;
 static pthread_t g_listener_id;
 
-static void *mdpls_thrwork(void *param)
+static int mdpls_accept_inet()
 {
-	int sockd;
 	uint8_t tmp_byte;
-	socklen_t addrlen;
 	char client_hostip[40];
 	struct sockaddr_storage peer_name;
+	socklen_t addrlen = sizeof(peer_name);
+	int sockd = accept(g_listen_sockd, reinterpret_cast<struct sockaddr *>(&peer_name), &addrlen);
+	if (-1 == sockd) {
+		return -1;
+	}
+	int ret = getnameinfo(reinterpret_cast<struct sockaddr *>(&peer_name),
+	          addrlen, client_hostip, sizeof(client_hostip),
+	          nullptr, 0, NI_NUMERICSERV | NI_NUMERICHOST);
+	if (ret != 0) {
+		printf("getnameinfo: %s\n", gai_strerror(ret));
+		close(sockd);
+		return -1;
+	}
+	if (std::find(g_acl_list.cbegin(), g_acl_list.cend(),
+	    client_hostip) == g_acl_list.cend()) {
+		tmp_byte = exmdb_response::ACCESS_DENY;
+		write(sockd, &tmp_byte, 1);
+		close(sockd);
+		return -1;
+	}
+	return sockd;
+}
+
+/* unix socket peers are admitted like loopback TCP peers */
+static int mdpls_accept_unix()
+{
+	uint8_t tmp_byte;
+	int sockd = accept4(g_unix_sockd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (-1 == sockd) {
+		return -1;
+	}
+	if (std::find(g_acl_list.cbegin(), g_acl_list.cend(), "::1") == g_acl_list.cend() &&
+	    std::find(g_acl_list.cbegin(), g_acl_list.cend(), "127.0.0.1") == g_acl_list.cend()) {
+		tmp_byte = exmdb_response::ACCESS_DENY;
+		write(sockd, &tmp_byte, 1);
+		close(sockd);
+		return -1;
+	}
+	return sockd;
+}
+
+static void *mdpls_thrwork(void *param)
+{
+	uint8_t tmp_byte;
+	struct pollfd pfd[2];
 	
 	while (NULL == common_util_lang_to_charset ||
 		NULL == common_util_cpid_to_charset ||
@@ -58,38 +105,30 @@ static void *mdpls_thrwork(void *param)
 			break;
 		sleep(1);	
 	}
+	pfd[0].fd = g_listen_sockd;
+	pfd[1].fd = g_unix_sockd;
+	pfd[0].events = pfd[1].events = POLLIN;
 	while (!g_notify_stop) {
 		/* wait for an incoming connection */
-        addrlen = sizeof(peer_name);
-        sockd = accept(g_listen_sockd, (struct sockaddr*)&peer_name, &addrlen);
-		if (-1 == sockd) {
-			continue;
-		}
-		int ret = getnameinfo(reinterpret_cast<struct sockaddr *>(&peer_name),
-		          addrlen, client_hostip, sizeof(client_hostip),
-		          nullptr, 0, NI_NUMERICSERV | NI_NUMERICHOST);
-		if (ret != 0) {
-			printf("getnameinfo: %s\n", gai_strerror(ret));
-			close(sockd);
-			continue;
-		}
-		if (std::find(g_acl_list.cbegin(), g_acl_list.cend(),
-		    client_hostip) == g_acl_list.cend()) {
-			tmp_byte = exmdb_response::ACCESS_DENY;
-			write(sockd, &tmp_byte, 1);
-			close(sockd);
+		if (poll(pfd, g_unix_sockd >= 0 ? 2 : 1, -1) <= 0)
 			continue;
+		for (unsigned int i = 0; i < 2 && !g_notify_stop; ++i) {
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+			int sockd = i == 0 ? mdpls_accept_inet() : mdpls_accept_unix();
+			if (sockd < 0)
+				continue;
+			auto pconnection = exmdb_parser_get_connection();
+			if (pconnection == nullptr) {
+				tmp_byte = exmdb_response::MAX_REACHED;
+				write(sockd, &tmp_byte, 1);
+				close(sockd);
+				continue;
+			}
+			pconnection->sockd = sockd;
+			pconnection->b_local = i == 1;
+			exmdb_parser_put_connection(std::move(pconnection));
 		}
-		auto pconnection = exmdb_parser_get_connection();
-		if (pconnection == nullptr) {
-			tmp_byte = exmdb_response::MAX_REACHED;
-			write(sockd, &tmp_byte, 1);
-			close(sockd);
-			continue;
-
-		}
-		pconnection->sockd = sockd;
-		exmdb_parser_put_connection(std::move(pconnection));
 	}
 	return nullptr;
 }
@@ -100,9 +139,44 @@ void exmdb_listener_init(const char *ip, uint16_t port)
 		gx_strlcpy(g_listen_ip, ip, GX_ARRAY_SIZE(g_listen_ip));
 	g_listen_port = port;
 	g_listen_sockd = -1;
+	g_unix_sockd = -1;
 	g_notify_stop = true;
 }
 
+/*
+ * Co-located clients find the server through its port number. Failing to
+ * set up the socket only costs them the fast path, so it is not fatal.
+ */
+static void exmdb_listener_run_unix()
+{
+	struct sockaddr_un un{};
+
+	exmdb_local_socket_path(g_listen_port, g_unix_path, GX_ARRAY_SIZE(g_unix_path));
+	if (strlen(g_unix_path) >= sizeof(un.sun_path)) {
+		*g_unix_path = '\0';
+		return;
+	}
+	un.sun_family = AF_UNIX;
+	gx_strlcpy(un.sun_path, g_unix_path, GX_ARRAY_SIZE(un.sun_path));
+	auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		printf("[exmdb_provider]: W-1508: socket AF_UNIX: %s\n", strerror(errno));
+		*g_unix_path = '\0';
+		return;
+	}
+	unlink(g_unix_path);
+	if (bind(fd, reinterpret_cast<struct sockaddr *>(&un), sizeof(un)) != 0 ||
+	    chmod(g_unix_path, 0660) != 0 || listen(fd, SOMAXCONN) != 0) {
+		printf("[exmdb_provider]: W-1509: %s: %s; local clients will use TCP\n",
+		       g_unix_path, strerror(errno));
+		close(fd);
+		unlink(g_unix_path);
+		*g_unix_path = '\0';
+		return;
+	}
+	g_unix_sockd = fd;
+}
+
 int exmdb_listener_run(const char *config_path)
 {
 	if (0 == g_listen_port) {
@@ -123,6 +197,7 @@ int exmdb_listener_run(const char *config_path)
 		close(g_listen_sockd);
 		return -5;
 	}
+	exmdb_listener_run_unix();
 	return 0;
 }
 
@@ -149,6 +224,8 @@ void exmdb_listener_stop()
 	if (!g_notify_stop) {
 		g_notify_stop = true;
 		shutdown(g_listen_sockd, SHUT_RDWR);
+		if (g_unix_sockd >= 0)
+			shutdown(g_unix_sockd, SHUT_RDWR);
 		pthread_kill(g_listener_id, SIGALRM);
 		pthread_join(g_listener_id, NULL);
 	}
@@ -156,4 +233,9 @@ void exmdb_listener_stop()
 		close(g_listen_sockd);
 		g_listen_sockd = -1;
 	}
+	if (g_unix_sockd >= 0) {
+		close(g_unix_sockd);
+		g_unix_sockd = -1;
+		unlink(g_unix_path);
+	}
 }
@@ -21,7 +21,10 @@
 #include "exmdb_ext.h"
 #include <gromox/list_file.hpp>
 #include <gromox/idset.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <pthread.h>
@@ -32,6 +35,10 @@
 #include <cstdio>
 #include <poll.h>
 
+/* bounds for the memfd a co-located client may offer */
+#define SHM_MIN_SIZE								(64 * 1024)
+#define SHM_MAX_SIZE								(64 * 1024 * 1024)
+
 static size_t g_max_threads, g_max_routers;
 static std::vector<EXMDB_ITEM> g_local_list;
 static std::unordered_set<std::shared_ptr<ROUTER_CONNECTION>> g_router_list;
@@ -43,6 +50,8 @@ EXMDB_CONNECTION::~EXMDB_CONNECTION()
 {
 	if (sockd >= 0)
 		close(sockd);
+	if (shm != nullptr)
+		munmap(shm, shm_size);
 }
 
 ROUTER_CONNECTION::ROUTER_CONNECTION()
@@ -733,6 +742,15 @@ static BOOL exmdb_parser_dispatch2(const EXMDB_REQUEST *prequest,
 				prequest->payload.get_public_folder_unread_count.username,
 				prequest->payload.get_public_folder_unread_count.folder_id,
 				&presponse->payload.get_public_folder_unread_count.count);
+	case exmdb_callid::GET_FREEBUSY_EVENTS:
+		return exmdb_server_get_freebusy_events(prequest->dir,
+				prequest->payload.get_freebusy_events.start_time,
+				prequest->payload.get_freebusy_events.end_time,
+				&presponse->payload.get_freebusy_events.events);
+	case exmdb_callid::ALLOCATE_CNS:
+		return exmdb_server_allocate_cns(prequest->dir,
+				prequest->payload.allocate_cns.count,
+				&presponse->payload.allocate_cns.begin_cn);
 	case exmdb_callid::UNLOAD_STORE:
 		return exmdb_server_unload_store(prequest->dir);
 	default:
@@ -758,6 +776,58 @@ static BOOL exmdb_parser_dispatch(const EXMDB_REQUEST *prequest,
 	return ret;
 }
 
+/*
+ * Read a frame length. The first frame on a unix socket connection may come
+ * with the client's memfd attached, which is kept in *pfd.
+ */
+static ssize_t mdpps_read_len(const EXMDB_CONNECTION &conn, uint32_t *plen,
+    int *pfd)
+{
+	if (!conn.b_local)
+		return read(conn.sockd, plen, sizeof(uint32_t));
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = {plen, sizeof(uint32_t)};
+	struct msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	auto ret = recvmsg(conn.sockd, &msg, MSG_CMSG_CLOEXEC);
+	if (ret <= 0)
+		return ret;
+	for (auto c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS ||
+		    c->cmsg_len < CMSG_LEN(sizeof(int)))
+			continue;
+		if (*pfd >= 0)
+			close(*pfd);
+		memcpy(pfd, CMSG_DATA(c), sizeof(int));
+	}
+	return ret;
+}
+
+/*
+ * Map the region offered by the client. The client must have sealed it
+ * against shrinking, or it could truncate it under our feet (SIGBUS).
+ * Takes ownership of @fd.
+ */
+static void mdpps_map_shm(EXMDB_CONNECTION &conn, int fd)
+{
+	struct stat sb;
+	auto seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &sb) != 0 ||
+	    sb.st_size < SHM_MIN_SIZE || sb.st_size > SHM_MAX_SIZE) {
+		close(fd);
+		return;
+	}
+	auto ptr = mmap(nullptr, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return;
+	conn.shm = ptr;
+	conn.shm_size = sb.st_size;
+}
+
 static void *mdpps_thrwork(void *pparam)
 {
 	int status;
@@ -772,7 +842,8 @@ static void *mdpps_thrwork(void *pparam)
 	uint8_t tmp_byte;
 	BOOL is_connected;
 	uint32_t buff_len;
-	uint8_t resp_buff[5]{};
+	uint8_t resp_buff[9]{};
+	int shm_fd = -1;
 	EXMDB_REQUEST request;
 	struct pollfd pfd_read;
 	EXMDB_RESPONSE response;
@@ -810,8 +881,9 @@ static void *mdpps_thrwork(void *pparam)
 			break;
 		}
 		if (NULL == pbuff) {
-			read_len = read(pconnection->sockd,
-					&buff_len, sizeof(uint32_t));
+			read_len = is_connected ?
+			           read(pconnection->sockd, &buff_len, sizeof(uint32_t)) :
+			           mdpps_read_len(*pconnection, &buff_len, &shm_fd);
 			if (read_len != sizeof(uint32_t)) {
 				break;
 			}
@@ -822,30 +894,43 @@ static void *mdpps_thrwork(void *pparam)
 				}
 				continue;
 			}
-			pbuff = malloc(buff_len);
-			if (NULL == pbuff) {
-				tmp_byte = exmdb_response::LACK_MEMORY;
-				write(pconnection->sockd, &tmp_byte, 1);
-				if (FALSE == is_connected) {
+			if (buff_len == EXMDB_SHM_FRAME && pconnection->shm != nullptr) {
+				memcpy(&buff_len, pconnection->shm, sizeof(uint32_t));
+				buff_len = le32_to_cpu(buff_len);
+				if (buff_len > pconnection->shm_size - sizeof(uint32_t)) {
+					tmp_byte = exmdb_response::PULL_ERROR;
+					write(pconnection->sockd, &tmp_byte, 1);
 					break;
 				}
-				buff_len = 0;
+				tmp_bin.pv = static_cast<char *>(pconnection->shm) + sizeof(uint32_t);
+				tmp_bin.cb = buff_len;
+			} else {
+				pbuff = malloc(buff_len);
+				if (NULL == pbuff) {
+					tmp_byte = exmdb_response::LACK_MEMORY;
+					write(pconnection->sockd, &tmp_byte, 1);
+					if (FALSE == is_connected) {
+						break;
+					}
+					buff_len = 0;
+				}
+				offset = 0;
+				continue;
 			}
-			offset = 0;
-			continue;
-		}
-		read_len = read(pconnection->sockd,
-		           static_cast<char *>(pbuff) + offset, buff_len - offset);
-		if (read_len <= 0) {
-			break;
-		}
-		offset += read_len;
-		if (offset < buff_len) {
-			continue;
+		} else {
+			read_len = read(pconnection->sockd,
+			           static_cast<char *>(pbuff) + offset, buff_len - offset);
+			if (read_len <= 0) {
+				break;
+			}
+			offset += read_len;
+			if (offset < buff_len) {
+				continue;
+			}
+			tmp_bin.pv = pbuff;
+			tmp_bin.cb = buff_len;
 		}
 		exmdb_server_build_environment(FALSE, b_private, NULL);
-		tmp_bin.pv = pbuff;
-		tmp_bin.cb = buff_len;
 		status = exmdb_ext_pull_request(&tmp_bin, &request);
 		free(pbuff);
 		pbuff = NULL;
@@ -863,9 +948,23 @@ static void *mdpps_thrwork(void *pparam)
 					exmdb_server_free_environment();
 					exmdb_server_set_remote_id(pconnection->remote_id.c_str());
 					is_connected = TRUE;
-					if (5 != write(pconnection->sockd, resp_buff, 5)) {
-						break;
+					uint32_t resp_len = 5;
+					if (shm_fd >= 0) {
+						mdpps_map_shm(*pconnection, shm_fd);
+						shm_fd = -1;
 					}
+					if (pconnection->shm != nullptr) {
+						/* tell the client its region is in use */
+						uint32_t v = cpu_to_le32(sizeof(uint32_t));
+						memcpy(&resp_buff[1], &v, sizeof(v));
+						v = cpu_to_le32(pconnection->shm_size);
+						memcpy(&resp_buff[5], &v, sizeof(v));
+						resp_len = 9;
+					}
+					auto ret = write(pconnection->sockd, resp_buff, resp_len);
+					memset(resp_buff, 0, sizeof(resp_buff));
+					if (ret < 0 || static_cast<size_t>(ret) != resp_len)
+						break;
 					offset = 0;
 					buff_len = 0;
 					continue;
@@ -884,6 +983,10 @@ static void *mdpps_thrwork(void *pparam)
 				} else {
 					prouter->remote_id = request.payload.listen_notification.remote_id;
 					exmdb_server_free_environment();
+					if (shm_fd >= 0) {
+						close(shm_fd);
+						shm_fd = -1;
+					}
 					if (5 != write(pconnection->sockd, resp_buff, 5)) {
 						break;
 					} else {
@@ -906,6 +1009,21 @@ static void *mdpps_thrwork(void *pparam)
 			}
 		} else if (!exmdb_parser_dispatch(&request, &response)) {
 			tmp_byte = exmdb_response::DISPATCH_ERROR;
+		} else if (pconnection->shm != nullptr &&
+		    (status = exmdb_ext_push_response(&response, &tmp_bin,
+		    pconnection->shm, pconnection->shm_size)) != EXT_ERR_BUFSIZE) {
+			exmdb_server_free_environment();
+			if (status != EXT_ERR_SUCCESS) {
+				tmp_byte = exmdb_response::PUSH_ERROR;
+				write(pconnection->sockd, &tmp_byte, 1);
+				break;
+			}
+			uint8_t hdr[5] = {exmdb_response::SUCCESS};
+			uint32_t marker = EXMDB_SHM_FRAME;
+			memcpy(&hdr[1], &marker, sizeof(marker));
+			if (write(pconnection->sockd, hdr, sizeof(hdr)) != sizeof(hdr))
+				break;
+			continue;
 		} else if (EXT_ERR_SUCCESS != exmdb_ext_push_response(&response, &tmp_bin)) {
 			tmp_byte = exmdb_response::PUSH_ERROR;
 		} else {
@@ -922,6 +1040,8 @@ static void *mdpps_thrwork(void *pparam)
 	}
 	close(pconnection->sockd);
 	pconnection->sockd = -1;
+	if (shm_fd >= 0)
+		close(shm_fd);
 	if (NULL != pbuff) {
 		free(pbuff);
 	}
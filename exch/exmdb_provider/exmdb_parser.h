@@ -23,6 +23,9 @@ class EXMDB_CONNECTION : public std::enable_shared_from_this<EXMDB_CONNECTION> {
 	pthread_t thr_id{};
 	std::string remote_id;
 	int sockd = -1;
+	bool b_local = false; /* unix socket; may pass a memfd */
+	void *shm = nullptr; /* region shared with the client, see exmdb_rpc.hpp */
+	uint32_t shm_size = 0;
 };
 
 struct ROUTER_CONNECTION {
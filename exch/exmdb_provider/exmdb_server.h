@@ -311,6 +311,8 @@ BOOL exmdb_server_delivery_message(const char *dir,
 	uint32_t cpid, const MESSAGE_CONTENT *pmsg,
 	const char *pdigest, uint32_t *presult);
 extern BOOL exmdb_server_write_message(const char *dir, const char *account, uint32_t cpid, uint64_t folder_id, const MESSAGE_CONTENT *, gxerr_t *);
+/* not an RPC: used by instance flushes whose recipients/attachments are unchanged */
+extern BOOL exmdb_server_write_message_ex(const char *dir, const char *account, uint32_t cpid, uint64_t folder_id, const MESSAGE_CONTENT *, BOOL b_children, uint32_t child_size, gxerr_t *);
 BOOL exmdb_server_read_message(const char *dir, const char *username,
 	uint32_t cpid, uint64_t message_id, MESSAGE_CONTENT **ppmsgctnt);
 BOOL exmdb_server_get_content_sync(const char *dir,
@@ -339,7 +341,10 @@ BOOL exmdb_server_check_contact_address(const char *dir,
 	const char *paddress, BOOL *pb_found);
 BOOL exmdb_server_get_public_folder_unread_count(const char *dir,
 	const char *username, uint64_t folder_id, uint32_t *pcount);
+extern BOOL exmdb_server_get_freebusy_events(const char *dir, uint64_t start_time, uint64_t end_time, FREEBUSY_EVENT_ARRAY *);
+extern BOOL exmdb_server_allocate_cns(const char *dir, uint32_t count, uint64_t *begin_cn);
 void exmdb_server_register_proc(void *pproc);
 BOOL exmdb_server_unload_store(const char *dir);
 extern void *instance_read_cid_content(uint64_t cid, uint32_t *plen);
 extern int instance_get_message_body(MESSAGE_CONTENT *, unsigned int tag, unsigned int cpid, TPROPVAL_ARRAY *);
+extern void instance_body_cache_init(size_t max_size);
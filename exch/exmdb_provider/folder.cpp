@@ -1321,6 +1321,11 @@ BOOL exmdb_server_empty_folder(const char *dir, uint32_t cpid,
 	folder_count = 0;
 	normal_size = 0;
 	fai_size = 0;
+	db_engine_begin_batch_mode(pdb);
+	auto cl_batch = make_scope_exit([&]() {
+		if (pdb != nullptr)
+			db_engine_cancel_batch_mode(pdb);
+	});
 	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", NULL, NULL, NULL);
 	if (FALSE == folder_empty_folder(pdb, cpid, username, fid_val,
 		b_hard, b_normal, b_fai, b_sub, pb_partial, &normal_size,
@@ -1383,6 +1388,7 @@ BOOL exmdb_server_empty_folder(const char *dir, uint32_t cpid,
 		return FALSE;
 	}
 	sqlite3_exec(pdb->psqlite, "COMMIT TRANSACTION", NULL, NULL, NULL);
+	db_engine_commit_batch_mode(std::move(pdb));
 	return TRUE;
 }
 
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Free/busy lookups against a materialized index of the calendar folder.
+ *
+ * The occurrences of every appointment are expanded once and kept with the
+ * DB_ITEM. db_engine_proc_dynamic_event marks changed messages dirty, and
+ * only those are re-read on the next query. The message count and highest
+ * change number of the folder are compared against the index on every
+ * query to catch changes that bypassed the dynamic event path.
+ *
+ * Recurring series are only expanded within a horizon around the build
+ * time; queries reaching past it expand the affected series on the fly.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <limits>
+#include <vector>
+#include <libHX/defs.h>
+#include <gromox/database.h>
+#include <gromox/freebusy.hpp>
+#include <gromox/mapidefs.h>
+#include <gromox/proptags.hpp>
+#include <gromox/rop_util.hpp>
+#include <gromox/tpropval_array.hpp>
+#include "common_util.h"
+#include "db_engine.h"
+#include "exmdb_server.h"
+#define FB_HORIZON_PAST				(31 * 86400)
+#define FB_HORIZON_FUTURE			(92 * 86400)
+/* re-anchor the horizon once per day */
+#define FB_REBUILD_INTERVAL			86400
+
+static constexpr time_t FB_TIME_MAX = std::numeric_limits<time_t>::max();
+
+static BOOL fb_get_proptags(sqlite3 *psqlite, uint32_t *tags)
+{
+	PROPERTY_NAME tmp_propnames[FB_PROP_COUNT];
+	PROPNAME_ARRAY propnames = {FB_PROP_COUNT, tmp_propnames};
+	PROPID_ARRAY propids;
+
+	freebusy_propnames(tmp_propnames);
+	if (!common_util_get_named_propids(psqlite, FALSE, &propnames, &propids))
+		return FALSE;
+	return freebusy_proptags(&propids, tags);
+}
+
+static BOOL fb_read_row(sqlite3 *psqlite, const uint32_t *tags,
+    uint64_t message_id, TPROPVAL_ARRAY *prow)
+{
+	uint32_t tmp_proptags[FB_PROP_COUNT+1];
+	PROPTAG_ARRAY proptags = {FB_PROP_COUNT + 1, tmp_proptags};
+
+	std::copy(tags, tags + FB_PROP_COUNT, tmp_proptags);
+	tmp_proptags[FB_PROP_COUNT] = PR_SUBJECT;
+	return common_util_get_properties(MESSAGE_PROPERTIES_TABLE,
+	       message_id, 0, psqlite, &proptags, prow);
+}
+
+static BOOL fb_load_appt(sqlite3 *psqlite, const uint32_t *tags,
+    uint64_t message_id, const FB_INDEX &idx, FB_APPOINTMENT &appt)
+{
+	TPROPVAL_ARRAY row;
+
+	if (!fb_read_row(psqlite, tags, message_id, &row))
+		return FALSE;
+	appt.events.clear();
+	auto pvalue = static_cast<uint8_t *>(tpropval_array_get_propval(&row, tags[FB_PROP_RECURRING]));
+	appt.b_recurring = pvalue != nullptr && *pvalue != 0;
+	if (!appt.b_recurring) {
+		/* cheap enough to keep whole, whatever the horizon */
+		freebusy_expand(&row, tags, 0, FB_TIME_MAX,
+			common_util_alloc, appt.events);
+		return TRUE;
+	}
+	auto pstart = static_cast<uint64_t *>(tpropval_array_get_propval(&row, tags[FB_PROP_START]));
+	auto pend = static_cast<uint64_t *>(tpropval_array_get_propval(&row, tags[FB_PROP_END]));
+	auto pclip = static_cast<uint64_t *>(tpropval_array_get_propval(&row, tags[FB_PROP_CLIPEND]));
+	appt.series_start = pstart == nullptr ? 0 : rop_util_nttime_to_unix(*pstart);
+	if (pclip == nullptr || pstart == nullptr || pend == nullptr) {
+		appt.series_end = FB_TIME_MAX;
+	} else {
+		/* clip end is the day of the last occurrence */
+		auto duration = rop_util_nttime_to_unix(*pend) - appt.series_start;
+		appt.series_end = rop_util_nttime_to_unix(*pclip) +
+		                  std::max(duration, static_cast<time_t>(0)) + 86400;
+	}
+	/* rows that cannot be expanded simply stay without occurrences */
+	freebusy_expand(&row, tags, idx.horizon_start, idx.horizon_end,
+		common_util_alloc, appt.events);
+	return TRUE;
+}
+
+static BOOL fb_index_build(sqlite3 *psqlite, const uint32_t *tags,
+    FB_INDEX &idx, time_t now)
+{
+	char sql_string[128];
+
+	idx.b_loaded = false;
+	idx.appts.clear();
+	idx.dirty.clear();
+	idx.build_time = now;
+	idx.horizon_start = now - FB_HORIZON_PAST;
+	idx.horizon_end = now + FB_HORIZON_FUTURE;
+	snprintf(sql_string, GX_ARRAY_SIZE(sql_string), "SELECT message_id,"
+	         " change_number FROM messages WHERE parent_fid=%llu"
+	         " AND is_associated=0", LLU(PRIVATE_FID_CALENDAR));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr)
+		return FALSE;
+	if (!common_util_begin_message_optimize(psqlite))
+		return FALSE;
+	while (sqlite3_step(pstmt) == SQLITE_ROW) {
+		uint64_t message_id = sqlite3_column_int64(pstmt, 0);
+		auto &appt = idx.appts[message_id];
+		appt.change_num = sqlite3_column_int64(pstmt, 1);
+		if (!fb_load_appt(psqlite, tags, message_id, idx, appt)) {
+			common_util_end_message_optimize();
+			idx.appts.clear();
+			return FALSE;
+		}
+	}
+	common_util_end_message_optimize();
+	idx.b_loaded = true;
+	return TRUE;
+}
+
+static BOOL fb_index_update(sqlite3 *psqlite, const uint32_t *tags,
+    FB_INDEX &idx, sqlite3_stmt *pstmt, uint64_t message_id)
+{
+	sqlite3_reset(pstmt);
+	sqlite3_bind_int64(pstmt, 1, message_id);
+	if (sqlite3_step(pstmt) != SQLITE_ROW) {
+		/* deleted or moved out of the calendar */
+		idx.appts.erase(message_id);
+		return TRUE;
+	}
+	uint64_t change_num = sqlite3_column_int64(pstmt, 0);
+	auto it = idx.appts.find(message_id);
+	if (it != idx.appts.end() && it->second.change_num == change_num)
+		return TRUE;
+	auto &appt = idx.appts[message_id];
+	appt.change_num = change_num;
+	return fb_load_appt(psqlite, tags, message_id, idx, appt);
+}
+
+static BOOL fb_index_sync(sqlite3 *psqlite, const uint32_t *tags,
+    FB_INDEX &idx) try
+{
+	char sql_string[128];
+	auto now = time(nullptr);
+
+	if (!idx.b_loaded || now - idx.build_time >= FB_REBUILD_INTERVAL)
+		return fb_index_build(psqlite, tags, idx, now);
+	if (idx.dirty.size() > 0) {
+		snprintf(sql_string, GX_ARRAY_SIZE(sql_string), "SELECT change_number"
+		         " FROM messages WHERE message_id=? AND parent_fid=%llu"
+		         " AND is_associated=0", LLU(PRIVATE_FID_CALENDAR));
+		auto pstmt = gx_sql_prep(psqlite, sql_string);
+		if (pstmt == nullptr)
+			return FALSE;
+		for (auto message_id : idx.dirty) {
+			if (!fb_index_update(psqlite, tags, idx, pstmt, message_id)) {
+				idx.b_loaded = false;
+				return FALSE;
+			}
+		}
+		idx.dirty.clear();
+	}
+	snprintf(sql_string, GX_ARRAY_SIZE(sql_string), "SELECT count(*),"
+	         " max(change_number) FROM messages WHERE parent_fid=%llu"
+	         " AND is_associated=0", LLU(PRIVATE_FID_CALENDAR));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
+		return FALSE;
+	uint64_t count = sqlite3_column_int64(pstmt, 0);
+	uint64_t max_cn = sqlite3_column_int64(pstmt, 1);
+	pstmt.finalize();
+	uint64_t idx_max_cn = 0;
+	for (const auto &[mid, appt] : idx.appts)
+		idx_max_cn = std::max(idx_max_cn, appt.change_num);
+	if (count == idx.appts.size() && max_cn == idx_max_cn)
+		return TRUE;
+	/* changed behind the back of the dynamic event path */
+	return fb_index_build(psqlite, tags, idx, now);
+} catch (const std::bad_alloc &) {
+	idx.b_loaded = false;
+	return FALSE;
+}
+
+static BOOL fb_copy_event(const freebusy_event &ev, FREEBUSY_EVENT &out)
+{
+	out.start_time = rop_util_unix_to_nttime(ev.start_time);
+	out.end_time = rop_util_unix_to_nttime(ev.end_time);
+	out.busy_type = ev.busy_type;
+	out.id = common_util_dup(ev.id.c_str());
+	if (out.id == nullptr)
+		return FALSE;
+	out.subject = nullptr;
+	if (ev.has_subject) {
+		out.subject = common_util_dup(ev.subject.c_str());
+		if (out.subject == nullptr)
+			return FALSE;
+	}
+	out.location = nullptr;
+	if (ev.has_location) {
+		out.location = common_util_dup(ev.location.c_str());
+		if (out.location == nullptr)
+			return FALSE;
+	}
+	out.b_meeting = ev.b_meeting ? TRUE : false;
+	out.b_recurring = ev.b_recurring ? TRUE : false;
+	out.b_exception = ev.b_exception ? TRUE : false;
+	out.b_reminder = ev.b_reminder ? TRUE : false;
+	out.b_private = ev.b_private ? TRUE : false;
+	return TRUE;
+}
+
+BOOL exmdb_server_get_freebusy_events(const char *dir, uint64_t start_nttime,
+    uint64_t end_nttime, FREEBUSY_EVENT_ARRAY *pevents) try
+{
+	uint32_t tags[FB_PROP_COUNT];
+
+	if (!exmdb_server_check_private())
+		return FALSE;
+	auto pdb = db_engine_get_db(dir);
+	if (pdb == nullptr || pdb->psqlite == nullptr)
+		return FALSE;
+	if (!fb_get_proptags(pdb->psqlite, tags))
+		return FALSE;
+	auto &idx = pdb->fb_index;
+	if (!fb_index_sync(pdb->psqlite, tags, idx))
+		return FALSE;
+	auto start_time = rop_util_nttime_to_unix(start_nttime);
+	auto end_time = rop_util_nttime_to_unix(end_nttime);
+	bool b_inside = start_time >= idx.horizon_start &&
+	                end_time <= idx.horizon_end;
+	std::vector<const freebusy_event *> hits;
+	std::vector<freebusy_event> extra;
+	for (const auto &[message_id, appt] : idx.appts) {
+		if (!appt.b_recurring || b_inside) {
+			for (const auto &ev : appt.events)
+				if (ev.end_time >= start_time && ev.start_time <= end_time)
+					hits.push_back(&ev);
+			continue;
+		}
+		if (appt.series_start > end_time || appt.series_end < start_time)
+			continue;
+		TPROPVAL_ARRAY row;
+		if (!fb_read_row(pdb->psqlite, tags, message_id, &row))
+			return FALSE;
+		freebusy_expand(&row, tags, start_time, end_time,
+			common_util_alloc, extra);
+	}
+	for (const auto &ev : extra)
+		hits.push_back(&ev);
+	std::sort(hits.begin(), hits.end(),
+		[](const freebusy_event *a, const freebusy_event *b) {
+			return a->start_time < b->start_time;
+		});
+	pevents->count = 0;
+	pevents->pevents = nullptr;
+	if (hits.size() == 0)
+		return TRUE;
+	pevents->pevents = cu_alloc<FREEBUSY_EVENT>(hits.size());
+	if (pevents->pevents == nullptr)
+		return FALSE;
+	for (auto ev : hits) {
+		if (!fb_copy_event(*ev, pevents->pevents[pevents->count]))
+			return FALSE;
+		++pevents->count;
+	}
+	return TRUE;
+} catch (const std::bad_alloc &) {
+	return FALSE;
+}
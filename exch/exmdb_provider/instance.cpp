@@ -45,27 +45,20 @@ static BOOL instance_read_message(
 
 static BOOL instance_identify_message(MESSAGE_CONTENT *pmsgctnt);
 
+static BOOL instance_load_children(sqlite3 *psqlite,
+	uint64_t message_id, uint32_t *plast_id, MESSAGE_CONTENT *pmsgctnt);
+
 static BOOL instance_load_message(sqlite3 *psqlite,
 	uint64_t message_id, uint32_t *plast_id,
-	MESSAGE_CONTENT **ppmsgctnt)
+	MESSAGE_CONTENT **ppmsgctnt, BOOL b_children)
 {
 	int i;
 	uint64_t cid;
-	uint32_t row_id;
-	uint32_t last_id;
 	uint32_t proptag;
-	uint64_t rcpt_id;
-	TARRAY_SET *prcpts;
 	char sql_string[256];
-	uint64_t message_id1;
 	TAGGED_PROPVAL propval;
 	PROPTAG_ARRAY proptags;
-	uint64_t attachment_id;
-	TPROPVAL_ARRAY *pproplist;
 	MESSAGE_CONTENT *pmsgctnt;
-	MESSAGE_CONTENT *pmsgctnt1;
-	ATTACHMENT_LIST *pattachments;
-	ATTACHMENT_CONTENT *pattachment;
 	
 	snprintf(sql_string, arsizeof(sql_string), "SELECT message_id FROM"
 	          " messages WHERE message_id=%llu", LLU(message_id));
@@ -180,42 +173,69 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 			break;
 		}
 	}
+	if (b_children && !instance_load_children(psqlite,
+	    message_id, plast_id, pmsgctnt)) {
+		message_content_free(pmsgctnt);
+		return FALSE;
+	}
+	*ppmsgctnt = pmsgctnt;
+	return TRUE;
+}
+
+/*
+ * Recipients and attachments (with their embedded messages) are only read
+ * when an operation on the instance needs them; attachment data stays a cid
+ * reference until the property itself is read.
+ */
+static BOOL instance_load_children(sqlite3 *psqlite,
+	uint64_t message_id, uint32_t *plast_id, MESSAGE_CONTENT *pmsgctnt)
+{
+	int i;
+	uint64_t cid;
+	uint32_t row_id;
+	uint32_t last_id;
+	uint64_t rcpt_id;
+	TARRAY_SET *prcpts;
+	char sql_string[256];
+	uint64_t message_id1;
+	TAGGED_PROPVAL propval;
+	PROPTAG_ARRAY proptags;
+	uint64_t attachment_id;
+	TPROPVAL_ARRAY *pproplist;
+	MESSAGE_CONTENT *pmsgctnt1;
+	ATTACHMENT_LIST *pattachments;
+	ATTACHMENT_CONTENT *pattachment;
+	
 	prcpts = tarray_set_init();
 	if (NULL == prcpts) {
-		message_content_free(pmsgctnt);
 		return FALSE;
 	}
 	message_content_set_rcpts_internal(pmsgctnt, prcpts);
 	snprintf(sql_string, arsizeof(sql_string), "SELECT recipient_id FROM"
 	          " recipients WHERE message_id=%llu", LLU(message_id));
-	pstmt = gx_sql_prep(psqlite, sql_string);
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
 	if (pstmt == nullptr) {
-		message_content_free(pmsgctnt);
 		return FALSE;
 	}
 	snprintf(sql_string, arsizeof(sql_string), "SELECT proptag FROM"
 		" recipients_properties WHERE recipient_id=?");
 	auto pstmt1 = gx_sql_prep(psqlite, sql_string);
 	if (pstmt1 == nullptr) {
-		message_content_free(pmsgctnt);
 		return FALSE;
 	}
 	row_id = 0;
 	while (SQLITE_ROW == sqlite3_step(pstmt)) {
 		pproplist = tpropval_array_init();
 		if (NULL == pproplist) {
-			message_content_free(pmsgctnt);
 			return FALSE;
 		}
 		if (!tarray_set_append_internal(prcpts, pproplist)) {
 			tpropval_array_free(pproplist);
-			message_content_free(pmsgctnt);
 			return FALSE;
 		}
 		propval.proptag = PROP_TAG_ROWID;
 		propval.pvalue = &row_id;
 		if (!tpropval_array_set_propval(pproplist, &propval)) {
-			message_content_free(pmsgctnt);
 			return FALSE;	
 		}
 		row_id ++;
@@ -229,7 +249,6 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 				&propval.pvalue) || NULL == propval.pvalue
 				||
 			    !tpropval_array_set_propval(pproplist, &propval)) {
-				message_content_free(pmsgctnt);
 				return FALSE;
 			}
 		}
@@ -239,7 +258,6 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 	pstmt1.finalize();
 	pattachments = attachment_list_init();
 	if (NULL == pattachments) {
-		message_content_free(pmsgctnt);
 		return FALSE;
 	}
 	message_content_set_attachments_internal(pmsgctnt, pattachments);
@@ -247,32 +265,27 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 	          "attachments WHERE message_id=%llu", LLU(message_id));
 	pstmt = gx_sql_prep(psqlite, sql_string);
 	if (pstmt == nullptr) {
-		message_content_free(pmsgctnt);
 		return FALSE;
 	}
 	snprintf(sql_string, arsizeof(sql_string), "SELECT message_id"
 			" FROM messages WHERE parent_attid=?");
 	pstmt1 = gx_sql_prep(psqlite, sql_string);
 	if (pstmt1 == nullptr) {
-		message_content_free(pmsgctnt);
 		return FALSE;
 	}
 	while (SQLITE_ROW == sqlite3_step(pstmt)) {
 		pattachment = attachment_content_init();
 		if (NULL == pattachment) {
-			message_content_free(pmsgctnt);
 			return FALSE;
 		}
 		if (FALSE == attachment_list_append_internal(
 			pattachments, pattachment)) {
 			attachment_content_free(pattachment);
-			message_content_free(pmsgctnt);
 			return FALSE;
 		}
 		propval.proptag = PROP_TAG_ATTACHNUMBER;
 		propval.pvalue = plast_id;
 		if (!tpropval_array_set_propval(&pattachment->proplist, &propval)) {
-			message_content_free(pmsgctnt);
 			return FALSE;	
 		}
 		(*plast_id) ++;
@@ -280,7 +293,6 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 		if (FALSE == common_util_get_proptags(
 			ATTACHMENT_PROPERTIES_TABLE,
 			attachment_id, psqlite, &proptags)) {
-			message_content_free(pmsgctnt);
 			return FALSE;
 		}
 		for (i=0; i<proptags.count; i++) {
@@ -293,7 +305,6 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 					static_cast<unsigned int>(proptags.pproptag[i]));
 				auto pstmt2 = gx_sql_prep(psqlite, sql_string);
 				if (pstmt2 == nullptr || sqlite3_step(pstmt2) != SQLITE_ROW) {
-					message_content_free(pmsgctnt);
 					return FALSE;
 				}
 				cid = sqlite3_column_int64(pstmt2, 0);
@@ -302,7 +313,6 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 				                  ID_TAG_ATTACHDATABINARY : ID_TAG_ATTACHDATAOBJECT;
 				propval.pvalue = &cid;
 				if (!tpropval_array_set_propval(&pattachment->proplist, &propval)) {
-					message_content_free(pmsgctnt);
 					return FALSE;
 				}
 				break;
@@ -315,7 +325,6 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 					&propval.pvalue) || NULL == propval.pvalue
 					||
 				    !tpropval_array_set_propval(&pattachment->proplist, &propval)) {
-					message_content_free(pmsgctnt);
 					return FALSE;
 				}
 				break;
@@ -326,15 +335,34 @@ static BOOL instance_load_message(sqlite3 *psqlite,
 			message_id1 = sqlite3_column_int64(pstmt1, 0);
 			last_id = 0;
 			if (FALSE == instance_load_message(psqlite,
-				message_id1, &last_id, &pmsgctnt1)) {
-				message_content_free(pmsgctnt);
+				message_id1, &last_id, &pmsgctnt1, TRUE)) {
 				return FALSE;
 			}
 			attachment_content_set_embedded_internal(pattachment, pmsgctnt1);
 		}
 		sqlite3_reset(pstmt1);
 	}
-	*ppmsgctnt = pmsgctnt;
+	return TRUE;
+}
+
+/*
+ * The part of the stored message_size that belongs to the recipients and
+ * attachments of @message_id, which @pmsgctnt (its properties only) lacks.
+ */
+static BOOL instance_stored_child_size(sqlite3 *psqlite, uint64_t message_id,
+    const MESSAGE_CONTENT *pmsgctnt, uint32_t *psize)
+{
+	char sql_string[128];
+	
+	snprintf(sql_string, arsizeof(sql_string), "SELECT message_size FROM"
+	          " messages WHERE message_id=%llu", LLU(message_id));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr || SQLITE_ROW != sqlite3_step(pstmt)) {
+		return FALSE;
+	}
+	uint32_t stored_size = sqlite3_column_int64(pstmt, 0);
+	uint32_t prop_size = common_util_calculate_message_size(pmsgctnt);
+	*psize = stored_size > prop_size ? stored_size - prop_size : 0;
 	return TRUE;
 }
 
@@ -418,7 +446,13 @@ BOOL exmdb_server_load_message_instance(const char *dir,
 	}
 	if (FALSE == instance_load_message(
 		pdb->psqlite, mid_val, &pinstance->last_id,
-		(MESSAGE_CONTENT**)&pinstance->pcontent)) {
+		(MESSAGE_CONTENT**)&pinstance->pcontent, FALSE) ||
+		(NULL != pinstance->pcontent && FALSE == instance_stored_child_size(
+		pdb->psqlite, mid_val, static_cast<MESSAGE_CONTENT *>(pinstance->pcontent),
+		&pinstance->lazy_child_size))) {
+		if (NULL != pinstance->pcontent) {
+			message_content_free(static_cast<MESSAGE_CONTENT *>(pinstance->pcontent));
+		}
 		common_util_end_message_optimize();
 		sqlite3_exec(pdb->psqlite, "ROLLBACK", NULL, NULL, NULL);
 		if (NULL != pinstance->username) {
@@ -438,12 +472,14 @@ BOOL exmdb_server_load_message_instance(const char *dir,
 		return TRUE;
 	}
 	pinstance->b_new = FALSE;
+	pinstance->lazy_mid = mid_val;
 	double_list_append_as_tail(&pdb->instance_list, &pinstance->node);
 	*pinstance_id = instance_id;
 	return TRUE;
 }
 
-static INSTANCE_NODE* instance_get_instance(db_item_ptr &pdb, uint32_t instance_id)
+/* look up an instance without reading in its recipients and attachments */
+static INSTANCE_NODE* instance_peek_instance(db_item_ptr &pdb, uint32_t instance_id)
 {
 	DOUBLE_LIST_NODE *pnode;
 	
@@ -456,6 +492,58 @@ static INSTANCE_NODE* instance_get_instance(db_item_ptr &pdb, uint32_t instance_
 	return NULL;
 }
 
+static BOOL instance_load_lazy_children(db_item_ptr &pdb,
+	INSTANCE_NODE *pinstance)
+{
+	uint32_t last_id;
+	MESSAGE_CONTENT *pmsgctnt;
+	
+	if (0 == pinstance->lazy_mid) {
+		return TRUE;
+	}
+	pmsgctnt = message_content_init();
+	if (NULL == pmsgctnt) {
+		return FALSE;
+	}
+	last_id = 0;
+	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", NULL, NULL, NULL);
+	if (FALSE == common_util_begin_message_optimize(pdb->psqlite)) {
+		sqlite3_exec(pdb->psqlite, "ROLLBACK", NULL, NULL, NULL);
+		message_content_free(pmsgctnt);
+		return FALSE;
+	}
+	BOOL b_result = instance_load_children(pdb->psqlite,
+	                pinstance->lazy_mid, &last_id, pmsgctnt);
+	common_util_end_message_optimize();
+	sqlite3_exec(pdb->psqlite, "COMMIT TRANSACTION", NULL, NULL, NULL);
+	if (FALSE == b_result) {
+		message_content_free(pmsgctnt);
+		return FALSE;
+	}
+	auto pdst = static_cast<MESSAGE_CONTENT *>(pinstance->pcontent);
+	message_content_set_rcpts_internal(pdst, pmsgctnt->children.prcpts);
+	message_content_set_attachments_internal(pdst,
+		pmsgctnt->children.pattachments);
+	pmsgctnt->children.prcpts = NULL;
+	pmsgctnt->children.pattachments = NULL;
+	message_content_free(pmsgctnt);
+	if (pinstance->last_id < last_id) {
+		pinstance->last_id = last_id;
+	}
+	pinstance->lazy_mid = 0;
+	return TRUE;
+}
+
+static INSTANCE_NODE* instance_get_instance(db_item_ptr &pdb, uint32_t instance_id)
+{
+	auto pinstance = instance_peek_instance(pdb, instance_id);
+	if (NULL == pinstance || INSTANCE_TYPE_MESSAGE != pinstance->type ||
+	    TRUE == instance_load_lazy_children(pdb, pinstance)) {
+		return pinstance;
+	}
+	return NULL;
+}
+
 BOOL exmdb_server_load_embedded_instance(const char *dir,
 	BOOL b_new, uint32_t attachment_instance_id,
 	uint32_t *pinstance_id)
@@ -584,7 +672,7 @@ BOOL exmdb_server_get_embedded_cn(const char *dir, uint32_t instance_id,
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance || INSTANCE_TYPE_MESSAGE != pinstance->type) {
 		return FALSE;
 	}
@@ -599,6 +687,7 @@ BOOL exmdb_server_reload_message_instance(
 	const char *dir, uint32_t instance_id, BOOL *pb_result)
 {
 	void *pvalue;
+	uint64_t mid_val;
 	uint32_t last_id;
 	uint32_t *pattach_id;
 	MESSAGE_CONTENT *pmsgctnt;
@@ -607,7 +696,7 @@ BOOL exmdb_server_reload_message_instance(
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance || INSTANCE_TYPE_MESSAGE != pinstance->type) {
 		return FALSE;
 	}
@@ -622,17 +711,21 @@ BOOL exmdb_server_reload_message_instance(
 			return FALSE;
 		}
 		last_id = 0;
+		mid_val = rop_util_get_gc_value(*static_cast<uint64_t *>(pvalue));
 		if (FALSE == instance_load_message(pdb->psqlite,
-			*(uint64_t*)pvalue, &last_id, &pmsgctnt)) {
+			mid_val, &last_id, &pmsgctnt, FALSE)) {
 			return FALSE;	
 		}
 		if (NULL == pmsgctnt) {
 			*pb_result = FALSE;
 			return TRUE;
 		}
-		if (pinstance->last_id < last_id) {
-			pinstance->last_id = last_id;
+		if (FALSE == instance_stored_child_size(pdb->psqlite,
+			mid_val, pmsgctnt, &pinstance->lazy_child_size)) {
+			message_content_free(pmsgctnt);
+			return FALSE;
 		}
+		pinstance->lazy_mid = mid_val;
 	} else {
 		auto pinstance1 = instance_get_instance(pdb, pinstance->parent_id);
 		if (NULL == pinstance1 || INSTANCE_TYPE_ATTACHMENT
@@ -663,6 +756,7 @@ BOOL exmdb_server_reload_message_instance(
 	}
 	message_content_free(static_cast<MESSAGE_CONTENT *>(pinstance->pcontent));
 	pinstance->pcontent = pmsgctnt;
+	pinstance->change_mask &= ~(CHANGE_MASK_RCPTS | CHANGE_MASK_ATTACHMENTS);
 	*pb_result = TRUE;
 	return TRUE;
 }
@@ -677,7 +771,7 @@ BOOL exmdb_server_clear_message_instance(
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance || INSTANCE_TYPE_MESSAGE != pinstance->type) {
 		return FALSE;
 	}
@@ -698,6 +792,8 @@ BOOL exmdb_server_clear_message_instance(
 	}
 	message_content_free(static_cast<MESSAGE_CONTENT *>(pinstance->pcontent));
 	pinstance->pcontent = pmsgctnt;
+	pinstance->lazy_mid = 0;
+	pinstance->change_mask |= CHANGE_MASK_RCPTS | CHANGE_MASK_ATTACHMENTS;
 	return TRUE;
 }
 
@@ -1235,6 +1331,7 @@ BOOL exmdb_server_write_message_instance(const char *dir,
 			}
 			message_content_set_rcpts_internal(
 				static_cast<MESSAGE_CONTENT *>(pinstance->pcontent), prcpts);
+			pinstance->change_mask |= CHANGE_MASK_RCPTS;
 			pproptags->pproptag[pproptags->count++] = PR_MESSAGE_RECIPIENTS;
 		}
 	}
@@ -1252,6 +1349,7 @@ BOOL exmdb_server_write_message_instance(const char *dir,
 			}
 			message_content_set_attachments_internal(
 				static_cast<MESSAGE_CONTENT *>(pinstance->pcontent), pattachments);
+			pinstance->change_mask |= CHANGE_MASK_ATTACHMENTS;
 			pproptags->pproptag[pproptags->count++] = PR_MESSAGE_ATTACHMENTS;
 		}
 	}
@@ -1545,6 +1643,7 @@ BOOL exmdb_server_delete_message_instance_attachment(
 	if (i >= pmsgctnt->children.pattachments->count) {
 		return TRUE;
 	}
+	pinstance->change_mask |= CHANGE_MASK_ATTACHMENTS;
 	attachment_list_remove(pmsgctnt->children.pattachments, i);
 	if (0 == pmsgctnt->children.pattachments->count) {
 		attachment_list_free(pmsgctnt->children.pattachments);
@@ -1572,7 +1671,7 @@ BOOL exmdb_server_flush_instance(const char *dir, uint32_t instance_id,
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance) {
 		return FALSE;
 	}
@@ -1640,6 +1739,7 @@ BOOL exmdb_server_flush_instance(const char *dir, uint32_t instance_id,
 				}
 			}
 		}
+		pinstance1->change_mask |= CHANGE_MASK_ATTACHMENTS;
 		*pe_result = GXERR_SUCCESS;
 		return TRUE;
 	}
@@ -1667,7 +1767,24 @@ BOOL exmdb_server_flush_instance(const char *dir, uint32_t instance_id,
 				return false;
 		}
 	}
-	pinstance->change_mask = 0;
+	/*
+	 * Recipient and attachment rows are only rewritten when they were
+	 * touched; the bits are dropped once the write has gone through.
+	 */
+	BOOL b_children = pinstance->b_new || (pinstance->change_mask &
+	                  (CHANGE_MASK_RCPTS | CHANGE_MASK_ATTACHMENTS)) ? TRUE : FALSE;
+	pinstance->change_mask &= CHANGE_MASK_RCPTS | CHANGE_MASK_ATTACHMENTS;
+	/*
+	 * Children that were never read in are untouched. Their share of the
+	 * size is carried over from the stored message_size, so the flush
+	 * does not have to read them.
+	 */
+	if (TRUE == b_children && FALSE ==
+		instance_load_lazy_children(pdb, pinstance)) {
+		return FALSE;
+	}
+	uint32_t child_size = 0 != pinstance->lazy_mid ?
+	                      pinstance->lazy_child_size : 0;
 	if (0 != pinstance->parent_id) {
 		auto pinstance1 = instance_get_instance(pdb, pinstance->parent_id);
 		if (NULL == pinstance1 ||
@@ -1768,10 +1885,21 @@ BOOL exmdb_server_flush_instance(const char *dir, uint32_t instance_id,
 	}
 	pdb.reset();
 	common_util_set_tls_var(pmsgctnt);
-	BOOL b_result = exmdb_server_write_message(dir, account, 0, folder_id,
-	                pmsgctnt, pe_result);
+	BOOL b_result = exmdb_server_write_message_ex(dir, account, 0,
+	                folder_id, pmsgctnt, b_children, child_size, pe_result);
 	common_util_set_tls_var(NULL);
-	return b_result;
+	if (FALSE == b_result || GXERR_SUCCESS != *pe_result) {
+		return b_result;
+	}
+	pdb = db_engine_get_db(dir);
+	if (pdb == nullptr) {
+		return TRUE;
+	}
+	pinstance = instance_peek_instance(pdb, instance_id);
+	if (NULL != pinstance) {
+		pinstance->change_mask &= ~(CHANGE_MASK_RCPTS | CHANGE_MASK_ATTACHMENTS);
+	}
+	return TRUE;
 }
 	
 BOOL exmdb_server_unload_instance(
@@ -1780,7 +1908,7 @@ BOOL exmdb_server_unload_instance(
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance) {
 		return TRUE;
 	}
@@ -1808,7 +1936,7 @@ BOOL exmdb_server_get_instance_all_proptags(
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance) {
 		return FALSE;
 	}
@@ -2268,12 +2396,12 @@ BOOL exmdb_server_get_instance_properties(
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance) {
 		return FALSE;
 	}
 	if (INSTANCE_TYPE_ATTACHMENT == pinstance->type) {
-		auto pinstance1 = instance_get_instance(pdb, pinstance->parent_id);
+		auto pinstance1 = instance_peek_instance(pdb, pinstance->parent_id);
 		if (NULL == pinstance1) {
 			return FALSE;
 		}
@@ -2287,6 +2415,24 @@ BOOL exmdb_server_get_instance_properties(
 		}
 		return TRUE;
 	}
+	for (i=0; i<pproptags->count && 0 != pinstance->lazy_mid; i++) {
+		switch (pproptags->pproptag[i]) {
+		case PR_MESSAGE_FLAGS:
+		case PR_MESSAGE_SIZE:
+		case PR_MESSAGE_SIZE_EXTENDED:
+		case PROP_TAG_HASATTACHMENTS:
+		case PR_DISPLAY_TO:
+		case PR_DISPLAY_TO_A:
+		case PR_DISPLAY_CC:
+		case PR_DISPLAY_CC_A:
+		case PR_DISPLAY_BCC:
+		case PR_DISPLAY_BCC_A:
+			if (FALSE == instance_load_lazy_children(pdb, pinstance)) {
+				return FALSE;
+			}
+			break;
+		}
+	}
 	pmsgctnt = static_cast<MESSAGE_CONTENT *>(pinstance->pcontent);
 	ppropvals->count = 0;
 	ppropvals->ppropval = cu_alloc<TAGGED_PROPVAL>(pproptags->count);
@@ -2579,7 +2725,7 @@ BOOL exmdb_server_set_instance_properties(const char *dir,
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance) {
 		return FALSE;
 	}
@@ -2872,7 +3018,7 @@ BOOL exmdb_server_remove_instance_properties(
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, instance_id);
+	auto pinstance = instance_peek_instance(pdb, instance_id);
 	if (NULL == pinstance) {
 		return FALSE;
 	}
@@ -2989,13 +3135,13 @@ BOOL exmdb_server_check_instance_cycle(const char *dir,
 	auto pdb = db_engine_get_db(dir);
 	if (pdb == nullptr || pdb->psqlite == nullptr)
 		return FALSE;
-	auto pinstance = instance_get_instance(pdb, dst_instance_id);
+	auto pinstance = instance_peek_instance(pdb, dst_instance_id);
 	while (NULL != pinstance && 0 != pinstance->parent_id) {
 		if (pinstance->parent_id == src_instance_id) {
 			*pb_cycle = TRUE;
 			return TRUE;
 		}
-		pinstance = instance_get_instance(pdb, pinstance->parent_id);
+		pinstance = instance_peek_instance(pdb, pinstance->parent_id);
 	}
 	*pb_cycle = FALSE;
 	return TRUE;
@@ -3013,6 +3159,7 @@ BOOL exmdb_server_empty_message_instance_rcpts(
 		return FALSE;
 	}
 	pmsgctnt = (MESSAGE_CONTENT*)pinstance->pcontent;
+	pinstance->change_mask |= CHANGE_MASK_RCPTS;
 	if (NULL != pmsgctnt->children.prcpts) {
 		tarray_set_free(pmsgctnt->children.prcpts);
 		pmsgctnt->children.prcpts = NULL;
@@ -3161,6 +3308,7 @@ BOOL exmdb_server_update_message_instance_rcpts(
 		return FALSE;
 	}
 	pmsgctnt = (MESSAGE_CONTENT*)pinstance->pcontent;
+	pinstance->change_mask |= CHANGE_MASK_RCPTS;
 	if (NULL == pmsgctnt->children.prcpts) {
 		pmsgctnt->children.prcpts = tarray_set_init();
 		if (NULL == pmsgctnt->children.prcpts) {
@@ -3253,6 +3401,7 @@ BOOL exmdb_server_copy_instance_rcpts(
 	}
 	((MESSAGE_CONTENT*)pinstance_dst->pcontent)->children.prcpts =
 															prcpts;
+	pinstance_dst->change_mask |= CHANGE_MASK_RCPTS;
 	*pb_result = TRUE;
 	return TRUE;
 }
@@ -3269,6 +3418,7 @@ BOOL exmdb_server_empty_message_instance_attachments(
 		return FALSE;
 	}
 	pmsgctnt = (MESSAGE_CONTENT*)pinstance->pcontent;
+	pinstance->change_mask |= CHANGE_MASK_ATTACHMENTS;
 	if (NULL != pmsgctnt->children.pattachments) {
 		attachment_list_free(pmsgctnt->children.pattachments);
 		pmsgctnt->children.pattachments = NULL;
@@ -3381,6 +3531,7 @@ BOOL exmdb_server_copy_instance_attachments(
 	}
 	((MESSAGE_CONTENT*)pinstance_dst->pcontent)->children.pattachments =
 															pattachments;
+	pinstance_dst->change_mask |= CHANGE_MASK_ATTACHMENTS;
 	return TRUE;
 }
 
@@ -3485,6 +3636,7 @@ BOOL exmdb_server_set_message_instance_conflict(const char *dir,
 		return FALSE;
 	}
 	pmsg = (MESSAGE_CONTENT*)pinstance->pcontent;
+	pinstance->change_mask |= CHANGE_MASK_ATTACHMENTS;
 	pvalue = tpropval_array_get_propval(
 		&pmsg->proplist, PROP_TAG_MESSAGESTATUS);
 	b_inconflict = FALSE;
@@ -2,7 +2,15 @@
 // SPDX-FileCopyrightText: 2020–2021 grommunio GmbH
 // This file is part of Gromox.
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
 #include <gromox/mapidefs.h>
 #include <gromox/scope.hpp>
 #include <gromox/tie.hpp>
@@ -26,9 +34,126 @@ struct instbody_free {
 		free(x);
 	}
 };
+
+enum {
+	BCONV_HTML_FROM_RTF,
+	BCONV_TEXT_FROM_HIGHER,
+	BCONV_HTML_FROM_LOWER,
+	BCONV_RTFCP_FROM_LOWER,
+};
+
+/*
+ * Converted bodies are keyed by the cid of the body they were made from.
+ * Writing a new body allocates a new cid, so old entries simply stop being
+ * asked for and fall off the LRU end. The inode/size/mtime of the source
+ * file guard against a cid number being handed out again (e.g. after a
+ * rolled-back transaction or a recreated store).
+ */
+struct bcache_key {
+	std::string name;
+	uint64_t ino = 0, size = 0, mtime = 0;
+};
+
+struct bcache_entry {
+	bcache_key key;
+	std::string data;
+};
 }
 
 static constexpr size_t UTF8LEN_MARKER_SIZE = sizeof(uint32_t);
+static std::mutex g_bcache_lock;
+static std::list<bcache_entry> g_bcache_lru; /* most recently used first */
+static std::unordered_map<std::string, std::list<bcache_entry>::iterator> g_bcache_index;
+static size_t g_bcache_used, g_bcache_max;
+
+void instance_body_cache_init(size_t max_size)
+{
+	g_bcache_max = max_size;
+}
+
+/*
+ * Build the cache key for a conversion whose input is the first of @tags
+ * present on the message. Returns false if nothing should be cached.
+ */
+static bool instance_bcache_key(MESSAGE_CONTENT *mc, unsigned int kind,
+    unsigned int cpid, std::initializer_list<unsigned int> tags, bcache_key &key)
+{
+	if (g_bcache_max == 0)
+		return false;
+	const uint64_t *cid = nullptr;
+	for (auto tag : tags) {
+		cid = static_cast<uint64_t *>(tpropval_array_get_propval(&mc->proplist, tag));
+		if (cid != nullptr)
+			break;
+	}
+	if (cid == nullptr)
+		return false;
+	auto dir = exmdb_server_get_dir();
+	char path[256];
+	struct stat sb;
+	snprintf(path, sizeof(path), "%s/cid/%llu", dir, static_cast<unsigned long long>(*cid));
+	if (stat(path, &sb) != 0)
+		return false;
+	key.name   = std::string(path) + ":" + std::to_string(kind) + ":" + std::to_string(cpid);
+	key.ino    = sb.st_ino;
+	key.size   = sb.st_size;
+	key.mtime  = static_cast<uint64_t>(sb.st_mtim.tv_sec) * 1000000000 + sb.st_mtim.tv_nsec;
+	return true;
+}
+
+static bool instance_bcache_get(const bcache_key &key, BINARY *&bin)
+{
+	std::lock_guard hold(g_bcache_lock);
+	auto it = g_bcache_index.find(key.name);
+	if (it == g_bcache_index.end())
+		return false;
+	auto &e = *it->second;
+	if (e.key.ino != key.ino || e.key.size != key.size ||
+	    e.key.mtime != key.mtime) {
+		g_bcache_used -= e.data.size();
+		g_bcache_lru.erase(it->second);
+		g_bcache_index.erase(it);
+		return false;
+	}
+	g_bcache_lru.splice(g_bcache_lru.begin(), g_bcache_lru, it->second);
+	bin = cu_alloc<BINARY>();
+	if (bin == nullptr)
+		return false;
+	bin->pv = common_util_alloc(e.data.size() + 1);
+	if (bin->pv == nullptr)
+		return false;
+	memcpy(bin->pv, e.data.data(), e.data.size());
+	bin->pc[e.data.size()] = '\0';
+	bin->cb = e.data.size();
+	return true;
+}
+
+static void instance_bcache_put(const bcache_key &key, const BINARY *bin)
+{
+	/* one huge body should not flush everything else */
+	if (bin->cb > g_bcache_max / 4)
+		return;
+	try {
+		std::lock_guard hold(g_bcache_lock);
+		auto it = g_bcache_index.find(key.name);
+		if (it != g_bcache_index.end()) {
+			g_bcache_used -= it->second->data.size();
+			g_bcache_lru.erase(it->second);
+			g_bcache_index.erase(it);
+		}
+		g_bcache_lru.push_front(bcache_entry{key, std::string(bin->pc, bin->cb)});
+		g_bcache_index.emplace(key.name, g_bcache_lru.begin());
+		g_bcache_used += bin->cb;
+		while (g_bcache_used > g_bcache_max && !g_bcache_lru.empty()) {
+			auto &e = g_bcache_lru.back();
+			g_bcache_used -= e.data.size();
+			g_bcache_index.erase(e.key.name);
+			g_bcache_lru.pop_back();
+		}
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "W-1514: ENOMEM while caching a converted body\n");
+	}
+}
 
 /* Get an arbitrary body, no fallbacks. */
 static int instance_get_raw(MESSAGE_CONTENT *mc, BINARY *&bin, unsigned int tag)
@@ -70,6 +195,11 @@ static int instance_get_rtf(MESSAGE_CONTENT *mc, BINARY *&bin)
 
 static int instance_conv_htmlfromhigher(MESSAGE_CONTENT *mc, BINARY *&bin)
 {
+	bcache_key key;
+	auto b_cache = instance_bcache_key(mc, BCONV_HTML_FROM_RTF, 0,
+	               {ID_TAG_RTFCOMPRESSED}, key);
+	if (b_cache && instance_bcache_get(key, bin))
+		return 1;
 	auto ret = instance_get_rtf(mc, bin);
 	if (ret <= 0)
 		return ret;
@@ -84,12 +214,21 @@ static int instance_conv_htmlfromhigher(MESSAGE_CONTENT *mc, BINARY *&bin)
 	if (bin->pv == nullptr)
 		return -1;
 	memcpy(bin->pv, outbuf.get(), outlen);
+	if (b_cache)
+		instance_bcache_put(key, bin);
 	return 1;
 }
 
 /* Always yields UTF-8 */
 static int instance_conv_textfromhigher(MESSAGE_CONTENT *mc, BINARY *&bin)
 {
+	auto cpraw = tpropval_array_get_propval(&mc->proplist, PR_INTERNET_CPID);
+	uint32_t orig_cpid = cpraw != nullptr ? *static_cast<uint32_t *>(cpraw) : 65001;
+	bcache_key key;
+	auto b_cache = instance_bcache_key(mc, BCONV_TEXT_FROM_HIGHER, orig_cpid,
+	               {ID_TAG_HTML, ID_TAG_RTFCOMPRESSED}, key);
+	if (b_cache && instance_bcache_get(key, bin))
+		return 1;
 	auto ret = instance_get_raw(mc, bin, ID_TAG_HTML);
 	if (ret == 0)
 		ret = instance_conv_htmlfromhigher(mc, bin);
@@ -99,23 +238,32 @@ static int instance_conv_textfromhigher(MESSAGE_CONTENT *mc, BINARY *&bin)
 	ret = html_to_plain(bin->pc, bin->cb, plainbuf);
 	if (ret < 0)
 		return 0;
-	auto cpraw = tpropval_array_get_propval(&mc->proplist, PR_INTERNET_CPID);
-	uint32_t orig_cpid = cpraw != nullptr ? *static_cast<uint32_t *>(cpraw) : 65001;
 	if (ret != 65001 && orig_cpid != 65001) {
 		bin->pv = common_util_convert_copy(TRUE, orig_cpid, plainbuf.c_str());
-		return bin->pv != nullptr ? 1 : -1;
+		if (bin->pv == nullptr)
+			return -1;
+		bin->cb = strlen(bin->pc);
+	} else {
+		/* Original already was UTF-8, or conversion to UTF-8 happened by HTP */
+		bin->pv = common_util_alloc(plainbuf.size() + 1);
+		if (bin->pv == nullptr)
+			return -1;
+		memcpy(bin->pv, plainbuf.c_str(), plainbuf.size() + 1);
+		bin->cb = plainbuf.size();
 	}
-	/* Original already was UTF-8, or conversion to UTF-8 happened by HTP */
-	bin->pv = common_util_alloc(plainbuf.size() + 1);
-	if (bin->pv == nullptr)
-		return -1;
-	memcpy(bin->pv, plainbuf.c_str(), plainbuf.size() + 1);
+	if (b_cache)
+		instance_bcache_put(key, bin);
 	return 1;
 }
 
 static int instance_conv_htmlfromlower(MESSAGE_CONTENT *mc,
     unsigned int cpid, BINARY *&bin)
 {
+	bcache_key key;
+	auto b_cache = instance_bcache_key(mc, BCONV_HTML_FROM_LOWER, cpid,
+	               {ID_TAG_BODY, ID_TAG_BODY_STRING8}, key);
+	if (b_cache && instance_bcache_get(key, bin))
+		return 1;
 	auto ret = instance_get_raw(mc, bin, ID_TAG_BODY);
 	if (ret > 0)
 		bin->pc += UTF8LEN_MARKER_SIZE;
@@ -137,11 +285,18 @@ static int instance_conv_htmlfromlower(MESSAGE_CONTENT *mc,
 	if (bin->pv == nullptr)
 		return -1;
 	memcpy(bin->pv, htmlout.get(), bin->cb + 1);
+	if (b_cache)
+		instance_bcache_put(key, bin);
 	return 1;
 }
 
 static int instance_conv_rtfcpfromlower(MESSAGE_CONTENT *mc, unsigned int cpid, BINARY *&bin)
 {
+	bcache_key key;
+	auto b_cache = instance_bcache_key(mc, BCONV_RTFCP_FROM_LOWER, cpid,
+	               {ID_TAG_BODY, ID_TAG_BODY_STRING8}, key);
+	if (b_cache && instance_bcache_get(key, bin))
+		return 1;
 	auto ret = instance_conv_htmlfromlower(mc, cpid, bin);
 	if (ret <= 0)
 		return ret;
@@ -157,6 +312,8 @@ static int instance_conv_rtfcpfromlower(MESSAGE_CONTENT *mc, unsigned int cpid,
 	if (bin->pv == nullptr)
 		return -1;
 	memcpy(bin->pv, rtfcpbin->pv, rtfcpbin->cb);
+	if (b_cache)
+		instance_bcache_put(key, bin);
 	return 1;
 }
 
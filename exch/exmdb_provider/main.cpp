@@ -18,6 +18,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <unistd.h>
 
 using namespace std::string_literals;
 
@@ -37,14 +38,16 @@ static void console_talk(int argc, char **argv, char *result, int length)
 						 "\t%s unload <maildir>\r\n"
 						 "\t    --unload the store\r\n"
 						 "\t%s info\r\n"
-						 "\t    --print the module information";
+						 "\t    --print the module information\r\n"
+						 "\t%s proxy\r\n"
+						 "\t    --print the exmdb connection statistics";
 
 	if (1 == argc) {
 		gx_strlcpy(result, "550 too few arguments", length);
 		return;
 	}
 	if (2 == argc && 0 == strcmp("--help", argv[1])) {
-		snprintf(result, length, help_string, argv[0], argv[0]);
+		snprintf(result, length, help_string, argv[0], argv[0], argv[0]);
 		result[length - 1] = '\0';
 		return;
 	}
@@ -59,6 +62,11 @@ static void console_talk(int argc, char **argv, char *result, int length)
 			exmdb_parser_get_param(ALIVE_ROUTER_CONNECTIONS));
 		return;
 	}
+	if (2 == argc && 0 == strcmp("proxy", argv[1])) {
+		auto offset = snprintf(result, length, "250 exmdb connections:\r\n");
+		exmdb_client_get_stats(result + offset, length - offset);
+		return;
+	}
 	if (3 == argc && 0 == strcmp("unload", argv[1])) {
 		if (TRUE == exmdb_server_unload_store(argv[2])) {
 			gx_strlcpy(result, "250 unload store OK", length);
@@ -229,6 +237,16 @@ static BOOL svc_exmdb_provider(int reason, void **ppdata)
 			populating_num = 10;
 		printf("[exmdb_provider]: populating threads"
 				" number is %d\n", populating_num);
+		
+		str_value = config_file_get_value(pconfig, "BODY_CACHE_SIZE");
+		uint64_t body_cache = str_value != nullptr ? atobyte(str_value) : 16ULL << 20;
+		if (0 == body_cache) {
+			printf("[exmdb_provider]: converted body cache is disabled\n");
+		} else {
+			bytetoa(body_cache, temp_buff);
+			printf("[exmdb_provider]: converted body cache size is %s\n", temp_buff);
+		}
+		instance_body_cache_init(body_cache);
 		if (!exmdb_provider_reload(pconfig))
 			return false;
 		
@@ -243,7 +261,12 @@ static BOOL svc_exmdb_provider(int reason, void **ppdata)
 			exmdb_parser_init(max_threads, max_routers);
 		}
 		exmdb_listener_init(listen_ip, listen_port);
-		exmdb_client_init(connection_num, threads_num);
+		exmdb_client_init(connection_num, threads_num,
+			(get_host_ID() + ":"s + std::to_string(getpid())).c_str());
+		exmdb_client_register_proc(reinterpret_cast<void *>(+[](const char *dir,
+			BOOL b_table, uint32_t notify_id, const DB_NOTIFY *pdb_notify) {
+				exmdb_server_event_proc(dir, b_table, notify_id, pdb_notify);
+			}));
 		
 		if (bounce_producer_run(get_data_path()) != 0) {
 			printf("[exmdb_provider]: failed to run bounce producer\n");
@@ -297,7 +320,9 @@ static BOOL svc_exmdb_provider(int reason, void **ppdata)
 			common_util_free();
 			return FALSE;
 		}
-		if (exmdb_client_run(get_config_path()) != 0) {
+		if (exmdb_client_run(get_config_path(), EXMDB_CLIENT_ALLOW_DIRECT,
+		    [](bool pvt) { exmdb_server_build_environment(false, pvt, nullptr); },
+		    exmdb_server_free_environment) != 0) {
 			printf("[exmdb_provider]: failed to run exmdb client\n");
 			exmdb_listener_stop();
 			exmdb_parser_stop();
@@ -33,8 +33,6 @@
 #define UI(x) static_cast<unsigned int>(x)
 #define LLU(x) static_cast<unsigned long long>(x)
 
-#define MIN_BATCH_MESSAGE_NUM						20
-
 using namespace std::string_literals;
 using namespace gromox;
 
@@ -313,10 +311,15 @@ BOOL exmdb_server_movecopy_messages(const char *dir,
 	} else {
 		b_check = FALSE;
 	}
-	BOOL b_batch = pmessage_ids->count >= MIN_BATCH_MESSAGE_NUM ? TRUE : false;
+	BOOL b_batch = pmessage_ids->count > 1 ? TRUE : false;
 	if (TRUE == b_batch) {
 		db_engine_begin_batch_mode(pdb);
 	}
+	/* error paths that do not cancel explicitly */
+	auto cl_batch = make_scope_exit([&]() {
+		if (b_batch && pdb != nullptr && pdb->tables.b_batch)
+			db_engine_cancel_batch_mode(pdb);
+	});
 	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", NULL, NULL, NULL);
 	snprintf(sql_string, arsizeof(sql_string), "SELECT parent_fid, "
 		"is_associated FROM messages WHERE message_id=?");
@@ -571,10 +574,15 @@ BOOL exmdb_server_delete_messages(const char *dir,
 	} else {
 		b_check = FALSE;
 	}
-	BOOL b_batch = pmessage_ids->count >= MIN_BATCH_MESSAGE_NUM ? TRUE : false;
+	BOOL b_batch = pmessage_ids->count > 1 ? TRUE : false;
 	if (TRUE == b_batch) {
 		db_engine_begin_batch_mode(pdb);
 	}
+	/* error paths that do not cancel explicitly */
+	auto cl_batch = make_scope_exit([&]() {
+		if (b_batch && pdb != nullptr && pdb->tables.b_batch)
+			db_engine_cancel_batch_mode(pdb);
+	});
 	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", NULL, NULL, NULL);
 	snprintf(sql_string, arsizeof(sql_string), "SELECT parent_fid, is_associated, "
 					"message_size FROM messages WHERE message_id=?");
@@ -2117,10 +2125,16 @@ static BOOL message_rectify_message(const char *account,
 	return TRUE;
 }
 	
+/*
+ * @b_children: replace the stored recipients and attachments of an existing
+ * message with those in @pmsgctnt; when FALSE they are left as they are.
+ * @child_size: size of stored children that are not in @pmsgctnt, added to
+ * the message size when they are left as they are.
+ */
 static BOOL message_write_message(BOOL b_internal, sqlite3 *psqlite,
 	const char *account, uint32_t cpid, BOOL b_embedded,
 	uint64_t parent_id, const MESSAGE_CONTENT *pmsgctnt,
-	uint64_t *pmessage_id)
+	BOOL b_children, uint32_t child_size, uint64_t *pmessage_id)
 {
 	BOOL b_cn;
 	XID tmp_xid;
@@ -2260,17 +2274,21 @@ static BOOL message_write_message(BOOL b_internal, sqlite3 *psqlite,
 				sql_string, NULL, NULL, NULL)) {
 				return FALSE;
 			}
-			snprintf(sql_string, arsizeof(sql_string), "DELETE FROM recipients"
-			        " WHERE message_id=%llu", LLU(*pmessage_id));
-			if (SQLITE_OK != sqlite3_exec(psqlite,
-				sql_string, NULL, NULL, NULL)) {
-				return FALSE;
-			}
-			snprintf(sql_string, arsizeof(sql_string), "DELETE FROM attachments"
-			        " WHERE message_id=%llu", LLU(*pmessage_id));
-			if (SQLITE_OK != sqlite3_exec(psqlite,
-				sql_string, NULL, NULL, NULL)) {
-				return FALSE;
+			if (FALSE == b_children) {
+				message_size += child_size;
+			} else {
+				snprintf(sql_string, arsizeof(sql_string), "DELETE FROM recipients"
+				        " WHERE message_id=%llu", LLU(*pmessage_id));
+				if (SQLITE_OK != sqlite3_exec(psqlite,
+					sql_string, NULL, NULL, NULL)) {
+					return FALSE;
+				}
+				snprintf(sql_string, arsizeof(sql_string), "DELETE FROM attachments"
+				        " WHERE message_id=%llu", LLU(*pmessage_id));
+				if (SQLITE_OK != sqlite3_exec(psqlite,
+					sql_string, NULL, NULL, NULL)) {
+					return FALSE;
+				}
 			}
 			snprintf(sql_string, arsizeof(sql_string), "DELETE FROM message_changes"
 			        "  WHERE message_id=%llu", LLU(*pmessage_id));
@@ -2286,6 +2304,7 @@ static BOOL message_write_message(BOOL b_internal, sqlite3 *psqlite,
 				return FALSE;
 			}
 		} else {
+			b_children = TRUE;
 			snprintf(sql_string, arsizeof(sql_string), "INSERT INTO messages (message_id,"
 				" parent_fid, parent_attid, is_associated, "
 				"change_number, message_size) VALUES (%llu, %llu, "
@@ -2368,7 +2387,7 @@ static BOOL message_write_message(BOOL b_internal, sqlite3 *psqlite,
 			return FALSE;	
 		}
 	}
-	if (NULL != pmsgctnt->children.prcpts) {
+	if (TRUE == b_children && NULL != pmsgctnt->children.prcpts) {
 		snprintf(sql_string, arsizeof(sql_string), "INSERT INTO recipients "
 		          "(message_id) VALUES (%llu)", LLU(*pmessage_id));
 		auto pstmt = gx_sql_prep(psqlite, sql_string);
@@ -2386,7 +2405,7 @@ static BOOL message_write_message(BOOL b_internal, sqlite3 *psqlite,
 			}
 		}
 	}
-	if (NULL != pmsgctnt->children.pattachments) {
+	if (TRUE == b_children && NULL != pmsgctnt->children.pattachments) {
 		snprintf(sql_string, arsizeof(sql_string), "INSERT INTO attachments"
 		          " (message_id) VALUES (%llu)", LLU(*pmessage_id));
 		auto pstmt = gx_sql_prep(psqlite, sql_string);
@@ -2407,7 +2426,7 @@ static BOOL message_write_message(BOOL b_internal, sqlite3 *psqlite,
 				if (FALSE == message_write_message(TRUE,
 					psqlite, account, cpid, TRUE, tmp_id,
 					pmsgctnt->children.pattachments->pplist[i]->pembedded,
-					&message_id)) {
+					TRUE, 0, &message_id)) {
 					return FALSE;
 				}
 				if (0 == message_id) {
@@ -2921,7 +2940,7 @@ static BOOL message_make_deferred_error_message(
 		return FALSE;
 	}
 	if (FALSE == message_write_message(FALSE, psqlite, username,
-		0, FALSE, PRIVATE_FID_DEFERRED_ACTION, pmsg, &mid_val)) {
+		0, FALSE, PRIVATE_FID_DEFERRED_ACTION, pmsg, TRUE, 0, &mid_val)) {
 		message_content_free(pmsg);
 		return FALSE;
 	}
@@ -3653,7 +3672,7 @@ static BOOL message_make_deferred_action_message(
 		return FALSE;
 	}
 	if (FALSE == message_write_message(FALSE, psqlite, username,
-		0, FALSE, PRIVATE_FID_DEFERRED_ACTION, pmsg, &mid_val)) {
+		0, FALSE, PRIVATE_FID_DEFERRED_ACTION, pmsg, TRUE, 0, &mid_val)) {
 		message_content_free(pmsg);
 		return FALSE;
 	}
@@ -4787,7 +4806,7 @@ BOOL exmdb_server_delivery_message(const char *dir,
 	}
 	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", NULL, NULL, NULL);
 	if (FALSE == message_write_message(FALSE, pdb->psqlite,
-		paccount, cpid, FALSE, fid_val, &tmp_msg, &message_id)) {
+		paccount, cpid, FALSE, fid_val, &tmp_msg, TRUE, 0, &message_id)) {
 		sqlite3_exec(pdb->psqlite, "ROLLBACK", NULL, NULL, NULL);
 		return FALSE;
 	}
@@ -4845,6 +4864,14 @@ BOOL exmdb_server_delivery_message(const char *dir,
 BOOL exmdb_server_write_message(const char *dir, const char *account,
     uint32_t cpid, uint64_t folder_id, const MESSAGE_CONTENT *pmsgctnt,
     gxerr_t *pe_result)
+{
+	return exmdb_server_write_message_ex(dir, account, cpid,
+	       folder_id, pmsgctnt, TRUE, 0, pe_result);
+}
+
+BOOL exmdb_server_write_message_ex(const char *dir, const char *account,
+    uint32_t cpid, uint64_t folder_id, const MESSAGE_CONTENT *pmsgctnt,
+    BOOL b_children, uint32_t child_size, gxerr_t *pe_result)
 {
 	BOOL b_exist;
 	void *pvalue;
@@ -4890,8 +4917,8 @@ BOOL exmdb_server_write_message(const char *dir, const char *account,
 		*(uint64_t*)pvalue = nt_time;
 	}
 	sqlite3_exec(pdb->psqlite, "BEGIN TRANSACTION", NULL, NULL, NULL);
-	if (FALSE == message_write_message(FALSE, pdb->psqlite,
-		account, cpid, FALSE, fid_val, pmsgctnt, &mid_val)) {
+	if (FALSE == message_write_message(FALSE, pdb->psqlite, account,
+		cpid, FALSE, fid_val, pmsgctnt, b_children, child_size, &mid_val)) {
 		sqlite3_exec(pdb->psqlite, "ROLLBACK", NULL, NULL, NULL);
 		return FALSE;
 	}
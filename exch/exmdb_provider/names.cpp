@@ -131,9 +131,9 @@ static constexpr const char *exmdb_rpc_names[] = {
 	E(COPY_INSTANCE_ATTACHMENTS),
 	E(CHECK_CONTACT_ADDRESS),
 	E(GET_PUBLIC_FOLDER_UNREAD_COUNT),
-	nullptr, /* x7b */
-	nullptr,
-	nullptr,
+	E(GET_FREEBUSY_EVENTS),
+	E(ALLOCATE_CNS),
+	nullptr, /* x7d */
 	nullptr,
 	nullptr,
 	E(UNLOAD_STORE),
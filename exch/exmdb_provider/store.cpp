@@ -19,6 +19,9 @@
 
 #define ALLOCATION_INTERVAL						24*60*60
 
+/* largest run of change numbers one ALLOCATE_CNS call may reserve */
+#define MAXIMUM_CN_ALLOCATION					0x10000
+
 using namespace gromox;
 
 namespace {
@@ -303,6 +306,21 @@ BOOL exmdb_server_allocate_cn(const char *dir, uint64_t *pcn)
 	return TRUE;
 }
 
+BOOL exmdb_server_allocate_cns(const char *dir, uint32_t count,
+    uint64_t *pbegin_cn)
+{
+	uint64_t change_num;
+	if (count == 0 || count > MAXIMUM_CN_ALLOCATION)
+		return FALSE;
+	auto pdb = db_engine_get_db(dir);
+	if (pdb == nullptr || pdb->psqlite == nullptr)
+		return FALSE;
+	if (!common_util_allocate_cns(pdb->psqlite, count, &change_num))
+		return FALSE;
+	*pbegin_cn = rop_util_make_eid_ex(1, change_num);
+	return TRUE;
+}
+
 /* if *pbegin_eid is 0, means too many
 	allocation requests within an interval */
 BOOL exmdb_server_allocate_ids(const char *dir,
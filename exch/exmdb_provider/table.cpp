@@ -1000,9 +1000,31 @@ static BOOL table_load_content_table(db_item_ptr &pdb, uint32_t cpid,
 		            " AND is_associated=0 AND is_deleted=%u",
 		            !!(table_flags & TABLE_FLAG_SOFTDELETES));
 	}
-	pstmt = gx_sql_prep(pdb->psqlite, sql_string);
-	if (pstmt == nullptr)
+	/*
+	 * Let SQLite discard what it can; only the untranslated remainder of
+	 * the restriction is evaluated per message. Sorting is not pushed
+	 * down: every matching row still goes through stbl into t%u, which
+	 * must hold all of them for positioning, collapse/expand and
+	 * notifications, so loading scales with the number of matches.
+	 */
+	bool b_exact = false;
+	try {
+		std::string query = sql_string, clause;
+		std::vector<std::string> binds;
+		auto ret = b_conversation || prestriction == nullptr ? RES_SQL_NONE :
+		           common_util_restriction_to_sql(prestriction, clause, binds);
+		if (ret != RES_SQL_NONE)
+			query += " AND " + clause;
+		b_exact = ret == RES_SQL_EXACT;
+		pstmt = gx_sql_prep(pdb->psqlite, query.c_str());
+		if (pstmt == nullptr)
+			return false;
+		for (size_t i = 0; i < binds.size(); ++i)
+			sqlite3_bind_text(pstmt, i + 1, binds[i].c_str(), -1, SQLITE_TRANSIENT);
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "E-1513: ENOMEM\n");
 		return false;
+	}
 	last_row_id = 0;
 	while (SQLITE_ROW == sqlite3_step(pstmt)) {
 		mid_val = sqlite3_column_int64(pstmt, 0);
@@ -1018,7 +1040,7 @@ static BOOL table_load_content_table(db_item_ptr &pdb, uint32_t cpid,
 			if (0 == parent_fid) {
 				continue;
 			}
-		} else if (prestriction != nullptr &&
+		} else if (prestriction != nullptr && !b_exact &&
 		    !common_util_evaluate_message_restriction(pdb->psqlite, cpid, mid_val, prestriction)) {
 			continue;
 		}
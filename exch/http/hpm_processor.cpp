@@ -178,28 +178,6 @@ static CONNECTION *hpm_processor_get_connection(unsigned int context_id)
 static HTTP_REQUEST *hpm_processor_get_request(unsigned int context_id)
 {
 	auto phttp = static_cast<HTTP_CONTEXT *>(http_parser_get_contexts_list()[context_id]);
-	mem_file_seek(&phttp->request.f_request_uri,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_host,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_user_agent,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_accept,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_accept_language,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_accept_encoding,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_content_type,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_content_length,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_transfer_encoding,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_cookie,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_seek(&phttp->request.f_others,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
 	return &phttp->request;
 }
 
@@ -483,7 +461,6 @@ int hpm_processor_console_talk(int argc,
 
 BOOL hpm_processor_get_context(HTTP_CONTEXT *phttp)
 {
-	int tmp_len;
 	BOOL b_chunked;
 	char tmp_buff[64];
 	uint64_t content_length;
@@ -492,23 +469,17 @@ BOOL hpm_processor_get_context(HTTP_CONTEXT *phttp)
 	for (const auto &p : g_plugin_list) {
 		auto pplugin = &p;
 		if (pplugin->interface.preproc(phttp->context_id)) {
-			tmp_len = mem_file_get_total_length(
-				&phttp->request.f_content_length);
-			if (0 == tmp_len) {
+			auto &cl = phttp->request.content_length;
+			if (cl.size() == 0) {
 				content_length = 0;
 			} else {
-				if (tmp_len >= 32) {
+				if (cl.size() >= 32) {
 					phpm_ctx->b_preproc = FALSE;
 					http_parser_log_info(phttp, 6, "length of "
 						"content-length is too long for hpm_processor");
 					return FALSE;
 				}
-				mem_file_seek(&phttp->request.f_content_length,
-					MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-				mem_file_read(&phttp->request.f_content_length,
-					tmp_buff, tmp_len);
-				tmp_buff[tmp_len] = '\0';
-				content_length = atoll(tmp_buff);
+				content_length = atoll(cl.data());
 			}
 			if (content_length > g_max_size) {
 				phpm_ctx->b_preproc = FALSE;
@@ -516,19 +487,8 @@ BOOL hpm_processor_get_context(HTTP_CONTEXT *phttp)
 					" is too long for hpm_processor");
 				return FALSE;
 			}
-			b_chunked = FALSE;
-			tmp_len = mem_file_get_total_length(
-				&phttp->request.f_transfer_encoding);
-			if (tmp_len > 0 && static_cast<size_t>(tmp_len) < GX_ARRAY_SIZE(tmp_buff)) {
-				mem_file_seek(&phttp->request.f_transfer_encoding,
-						MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-				mem_file_read(&phttp->request.f_transfer_encoding,
-					tmp_buff, tmp_len);
-				tmp_buff[tmp_len] = '\0';
-				if (0 == strcasecmp(tmp_buff, "chunked")) {
-					b_chunked = TRUE;
-				}
-			}
+			auto &te = phttp->request.transfer_encoding;
+			b_chunked = te.size() > 0 && strcasecmp(te.data(), "chunked") == 0 ? TRUE : false;
 			if (TRUE == b_chunked || content_length > g_cache_size) {
 				snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "/tmp/http-%u", phttp->context_id);
 				phpm_ctx->cache_fd = open(tmp_buff,
@@ -4,6 +4,7 @@
 /* http parser is a module, which first read data from socket, parses rpc over http and
    relay the stream to pdu processor. it also process other http request
  */ 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cerrno>
@@ -35,6 +36,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <openssl/err.h>
 #if (defined(LIBRESSL_VERSION_NUMBER) && LIBRESSL_VERSION_NUMBER < 0x2090000fL) || \
     (defined(OPENSSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER < 0x1010000fL)
@@ -44,6 +46,9 @@
 
 #define OUT_CHANNEL_MAX_LENGTH						0x40000000
 
+/* header storage per request; larger requests spill into more chunks */
+#define HTTP_ARENA_SIZE								4096
+
 using namespace gromox;
 
 namespace {
@@ -88,7 +93,6 @@ static int g_max_auth_times;
 static int g_block_auth_fail;
 static unsigned int g_timeout;
 static pthread_key_t g_context_key;
-static LIB_BUFFER *g_file_allocator;
 static std::vector<HTTP_CONTEXT> g_context_list;
 static std::vector<SCHEDULE_CONTEXT *> g_context_list2;
 static char g_certificate_path[256];
@@ -100,7 +104,7 @@ static LIB_BUFFER *g_outchannel_allocator;
 static std::mutex g_vconnection_lock;
 
 static void http_parser_context_clear(HTTP_CONTEXT *pcontext);
-static void http_parser_request_clear(HTTP_REQUEST *prequest);
+static void http_parser_request_clear(HTTP_CONTEXT *pcontext);
 
 void http_parser_init(size_t context_num, unsigned int timeout,
 	int max_auth_times, int block_auth_fail, BOOL support_ssl,
@@ -195,12 +199,6 @@ int http_parser_run()
 		CRYPTO_set_locking_callback(http_parser_ssl_locking);
 #endif
 	}
-	g_file_allocator = lib_buffer_init(FILE_ALLOC_SIZE,
-							g_context_num * 16, TRUE);
-	if (NULL == g_file_allocator) {
-		printf("[http_parser]: Failed to init mem file allocator\n");
-		return -6;
-	}
 	try {
 		g_context_list.resize(g_context_num);
 		g_context_list2.resize(g_context_num);
@@ -238,10 +236,6 @@ void http_parser_stop()
 	g_context_list2.clear();
 	g_context_list.clear();
 	g_vconnection_hash.clear();
-	if (NULL != g_file_allocator) {
-		lib_buffer_free(g_file_allocator);
-		g_file_allocator = NULL;
-	}
 	if (TRUE == g_support_ssl && NULL != g_ssl_ctx) {
 		SSL_CTX_free(g_ssl_ctx);
 		g_ssl_ctx = NULL;
@@ -306,40 +300,60 @@ void VCONN_REF::put()
 	pvconnection = nullptr;
 }
 
-static BOOL http_parser_request_head(MEM_FILE *pfile_others,
-	const char *field_name, char *field_value, int buff_len)
+static BOOL http_parser_add_field(HTTP_CONTEXT *pcontext,
+    std::string_view name, std::string_view value)
 {
-	int tmp_len;
-	int name_len;
-	char name_buff[64];
-	
-	mem_file_seek(pfile_others, MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	name_len = strlen(field_name);
-	if (name_len >= 64) {
-		return FALSE;
+	auto prequest = &pcontext->request;
+	if (prequest->others_num >= pcontext->others_max) {
+		auto max = pcontext->others_max == 0 ? 16 : 2 * pcontext->others_max;
+		auto others = static_cast<HTTP_FIELD *>(mem_arena_alloc(
+		              &pcontext->arena, sizeof(HTTP_FIELD) * max));
+		if (others == nullptr)
+			return FALSE;
+		std::copy(prequest->others, prequest->others + prequest->others_num, others);
+		prequest->others = others;
+		pcontext->others_max = max;
 	}
-	while (MEM_END_OF_FILE != mem_file_read(
-		pfile_others, &tmp_len, sizeof(int))) {
-		if (name_len == tmp_len) {
-			 mem_file_read(pfile_others, name_buff, tmp_len);
-			 if (0 == strncasecmp(name_buff, field_name, name_len)) {
-				 mem_file_read(pfile_others, &tmp_len, sizeof(int));
-				 if (tmp_len >= buff_len) {
-					 return FALSE;
-				 }
-				 mem_file_read(pfile_others, field_value, tmp_len);
-				 field_value[tmp_len] = '\0';
-				 return TRUE;
-			 }
-		} else {
-			mem_file_seek(pfile_others, MEM_FILE_READ_PTR,
-							tmp_len, MEM_FILE_SEEK_CUR);
-		}
-		mem_file_read(pfile_others, &tmp_len, sizeof(int));
-		mem_file_seek(pfile_others, MEM_FILE_READ_PTR,
-						tmp_len, MEM_FILE_SEEK_CUR);
+	prequest->others[prequest->others_num++] = {name, value};
+	return TRUE;
+}
+
+/*
+ * The fields point into the first block of stream_in, which is recycled
+ * once the body starts. Move the header block (up to, but excluding, the
+ * empty line at @end) into the arena in one piece and repoint the views.
+ */
+static BOOL http_parser_keep_header(HTTP_CONTEXT *pcontext, const char *end)
+{
+	auto begin = pcontext->hdr_start;
+	pcontext->hdr_start = nullptr;
+	if (begin == nullptr)
+		return TRUE;
+	size_t len = end - begin;
+	auto buf = static_cast<char *>(mem_arena_alloc(&pcontext->arena, len));
+	if (buf == nullptr)
+		return FALSE;
+	memcpy(buf, begin, len);
+	auto rebase = [&](std::string_view &v) {
+		if (v.data() >= begin && v.data() < end)
+			v = std::string_view(buf + (v.data() - begin), v.size());
+	};
+	auto prequest = &pcontext->request;
+	rebase(prequest->request_uri);
+	rebase(prequest->host);
+	rebase(prequest->user_agent);
+	rebase(prequest->accept);
+	rebase(prequest->accept_language);
+	rebase(prequest->accept_encoding);
+	rebase(prequest->content_type);
+	rebase(prequest->content_length);
+	rebase(prequest->transfer_encoding);
+	rebase(prequest->cookie);
+	for (size_t i = 0; i < prequest->others_num; ++i) {
+		rebase(prequest->others[i].name);
+		rebase(prequest->others[i].value);
 	}
-	return FALSE;
+	return TRUE;
 }
 
 static int http_parser_reconstruct_stream(
@@ -575,37 +589,54 @@ static int htparse_rdhead_no(HTTP_CONTEXT *pcontext, char *line, unsigned int li
 	size_t tmp_len1 = ptoken1 - ptoken - 1;
 	tmp_len = line_length - (ptoken1 + 6 - line);
 	if (0 != strncasecmp(ptoken1 + 1,
-	    "HTTP/", 5) || tmp_len >= 8) {
+	    "HTTP/", 5) || tmp_len >= 8 || tmp_len1 == 0 ||
+	    memchr(ptoken + 1, '\0', tmp_len1) != nullptr) {
 		http_parser_log_info(pcontext, 6, "request method error");
 		http_4xx(pcontext);
 		return X_LOOP;
 	}
-	if (FALSE == mod_rewrite_process(ptoken + 1,
-	    tmp_len1, &pcontext->request.f_request_uri)) {
-	    mem_file_write(&pcontext->request.f_request_uri,
-			ptoken + 1, tmp_len1);
-	}
 	memcpy(pcontext->request.version, ptoken1 + 6, tmp_len);
 	pcontext->request.version[tmp_len] = '\0';
+	pcontext->hdr_start = line;
+	*ptoken1 = '\0';
+	if (!mod_rewrite_process(ptoken + 1, tmp_len1, &pcontext->arena,
+	    &pcontext->request.request_uri))
+		pcontext->request.request_uri = std::string_view(ptoken + 1, tmp_len1);
 	return X_RUNOFF;
 }
 
+static bool htparse_set_field(std::string_view &field, std::string_view value,
+    bool b_unique)
+{
+	if (b_unique && field.size() > 0)
+		return false;
+	field = value;
+	return true;
+}
+
 static int htparse_rdhead_mt(HTTP_CONTEXT *pcontext, char *line, unsigned int line_length)
 {
 	auto ptoken = static_cast<char *>(memchr(line, ':', line_length));
-	if (NULL == ptoken) {
+	if (NULL == ptoken || memchr(line, '\0', line_length) != nullptr) {
 		http_parser_log_info(pcontext,
 			6, "request method error");
 		http_4xx(pcontext);
 		return X_LOOP;
 	}
 
-	size_t tmp_len = ptoken - line;
-	char field_name[64];
-	memcpy(field_name, line, tmp_len);
-	field_name[tmp_len] = '\0';
-	HX_strrtrim(field_name);
-	HX_strltrim(field_name);
+	auto name = line, name_end = ptoken;
+	while (name < name_end && (*name == ' ' || *name == '\t'))
+		++name;
+	while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t'))
+		--name_end;
+	if (name == name_end || std::any_of(name, name_end,
+	    [](unsigned char c) { return c <= ' ' || c == 0x7f; })) {
+		http_parser_log_info(pcontext, 6, "request header field malformed");
+		http_4xx(pcontext);
+		return X_LOOP;
+	}
+	*name_end = '\0';
+	std::string_view field_name(name, name_end - name);
 
 	ptoken++;
 	while (ptoken - line < line_length) {
@@ -614,51 +645,53 @@ static int htparse_rdhead_mt(HTTP_CONTEXT *pcontext, char *line, unsigned int li
 		}
 		ptoken++;
 	}
-	tmp_len = line_length - static_cast<size_t>(ptoken - line);
-	if (0 == strcasecmp(field_name, "Host")) {
-		mem_file_write(&pcontext->request.f_host,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name, "User-Agent")) {
-		mem_file_write(&pcontext->request.f_user_agent,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name, "Accept")) {
-		mem_file_write(&pcontext->request.f_accept,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name,
+	size_t tmp_len = line_length - static_cast<size_t>(ptoken - line);
+	/* the CR/LF behind the value has been consumed; terminate there */
+	line[line_length] = '\0';
+	std::string_view value(ptoken, tmp_len);
+	auto prequest = &pcontext->request;
+	bool b_ok = true;
+	if (0 == strcasecmp(name, "Host")) {
+		b_ok = htparse_set_field(prequest->host, value, true);
+	} else if (0 == strcasecmp(name, "User-Agent")) {
+		b_ok = htparse_set_field(prequest->user_agent, value, false);
+	} else if (0 == strcasecmp(name, "Accept")) {
+		b_ok = htparse_set_field(prequest->accept, value, false);
+	} else if (0 == strcasecmp(name,
 		"Accept-Language")) {
-		mem_file_write(&pcontext->request.f_accept_language,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name,
+		b_ok = htparse_set_field(prequest->accept_language, value, false);
+	} else if (0 == strcasecmp(name,
 		"Accept-Encoding")) {
-		mem_file_write(&pcontext->request.f_accept_encoding,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name,
+		b_ok = htparse_set_field(prequest->accept_encoding, value, false);
+	} else if (0 == strcasecmp(name,
 		"Content-Type")) {
-		mem_file_write(&pcontext->request.f_content_type,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name,
+		b_ok = htparse_set_field(prequest->content_type, value, false);
+	} else if (0 == strcasecmp(name,
 		"Content-Length")) {
-		mem_file_write(&pcontext->request.f_content_length,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name,
+		b_ok = htparse_set_field(prequest->content_length, value, true);
+	} else if (0 == strcasecmp(name,
 		"Transfer-Encoding")) {
-		mem_file_write(&pcontext->request.f_transfer_encoding,
-			ptoken, tmp_len);
-	} else if (0 == strcasecmp(field_name, "Cookie")) {
-		mem_file_write(&pcontext->request.f_cookie,
-			ptoken, tmp_len);
+		b_ok = htparse_set_field(prequest->transfer_encoding, value, true);
+	} else if (0 == strcasecmp(name, "Cookie")) {
+		b_ok = htparse_set_field(prequest->cookie, value, false);
 	} else {
-		if (0 == strcasecmp(field_name, "Connection") &&
+		if (0 == strcasecmp(name, "Connection") &&
 		    0 == strncasecmp(ptoken, "keep-alive", tmp_len)) {
 			/* for "Connection: Upgrade",
 				we treat it as "close" */
 			pcontext->b_close = FALSE;
 		}
-		uint32_t tmp_len1 = strlen(field_name);
-		mem_file_write(&pcontext->request.f_others, reinterpret_cast<char *>(&tmp_len1), sizeof(uint32_t));
-		mem_file_write(&pcontext->request.f_others, field_name, tmp_len1);
-		mem_file_write(&pcontext->request.f_others, reinterpret_cast<char *>(&tmp_len), sizeof(uint32_t));
-		mem_file_write(&pcontext->request.f_others, ptoken, tmp_len);
+		if (!http_parser_add_field(pcontext, field_name, value)) {
+			http_parser_log_info(pcontext, 6, "out of memory");
+			http_5xx(pcontext, "Resources exhausted", 503);
+			return X_LOOP;
+		}
+	}
+	if (!b_ok) {
+		/* conflicting framing or routing information */
+		http_parser_log_info(pcontext, 6, "duplicate %s field", name);
+		http_4xx(pcontext);
+		return X_LOOP;
 	}
 	return X_RUNOFF;
 }
@@ -757,24 +790,16 @@ static int htp_auth(HTTP_CONTEXT *pcontext)
 
 static int htp_delegate_rpc(HTTP_CONTEXT *pcontext, const STREAM &stream_1)
 {
-	auto tmp_len = mem_file_get_total_length(
-	               &pcontext->request.f_request_uri);
-	if (0 == tmp_len || tmp_len >= 1024) {
+	auto &uri = pcontext->request.request_uri;
+	if (uri.size() == 0 || uri.size() >= 1024) {
 		http_parser_log_info(pcontext, 6,
 			"rpcproxy request method error");
 		http_4xx(pcontext);
 		return X_LOOP;
 	}
-	char tmp_buff[2048];
-	tmp_len = mem_file_read(
-	          &pcontext->request.f_request_uri,
-	          tmp_buff, 1024);
-	if (tmp_len == MEM_END_OF_FILE) {
-		http_parser_log_info(pcontext, 6, "rpcproxy request method error");
-		http_4xx(pcontext);
-		return X_LOOP;
-	}
-	tmp_buff[tmp_len] = '\0';
+	char tmp_buff[1024];
+	memcpy(tmp_buff, uri.data(), uri.size());
+	tmp_buff[uri.size()] = '\0';
 
 	char *ptoken;
 	if (0 == strncmp(tmp_buff, "/rpc/rpcproxy.dll?", 18)) {
@@ -830,16 +855,13 @@ static int htp_delegate_rpc(HTTP_CONTEXT *pcontext, const STREAM &stream_1)
 		return X_LOOP;
 	}
 
-	tmp_len = mem_file_read(
-	          &pcontext->request.f_content_length,
-	          tmp_buff, 256);
-	if (MEM_END_OF_FILE == tmp_len) {
+	if (pcontext->request.content_length.size() == 0) {
 		http_parser_log_info(pcontext, 6,
 			"content-length of rpcproxy request error");
 		http_4xx(pcontext);
 		return X_LOOP;
 	}
-	pcontext->total_length = atoll(tmp_buff);
+	pcontext->total_length = atoll(pcontext->request.content_length.data());
 
 	/* ECHO request 0x0 ~ 0x10, MS-RPCH 2.1.2.15 */
 	if (pcontext->total_length > 0x10) {
@@ -990,6 +1012,11 @@ static int htparse_rdhead_st(HTTP_CONTEXT *pcontext, ssize_t actual_read)
 		}
 
 		/* meet the end of request header */
+		if (!http_parser_keep_header(pcontext, line)) {
+			http_parser_log_info(pcontext, 6, "out of memory");
+			http_5xx(pcontext, "Resources exhausted", 503);
+			return X_LOOP;
+		}
 		STREAM stream_1;
 		if (http_parser_reconstruct_stream(&pcontext->stream_in, &stream_1) < 0) {
 			http_parser_log_info(pcontext, 6, "out of memory");
@@ -999,13 +1026,14 @@ static int htparse_rdhead_st(HTTP_CONTEXT *pcontext, ssize_t actual_read)
 		stream_free(&pcontext->stream_in);
 		pcontext->stream_in = stream_1;
 
-		char tmp_buff[2048], tmp_buff1[1024];
+		char tmp_buff1[1024];
 		size_t decode_len = 0;
 		char *ptoken = nullptr;
-		if (http_parser_request_head(&pcontext->request.f_others,
-		    "Authorization", tmp_buff, GX_ARRAY_SIZE(tmp_buff)) &&
-		    strncasecmp(tmp_buff, "Basic ", 6) == 0 &&
-		    decode64(tmp_buff + 6, strlen(tmp_buff + 6), tmp_buff1, &decode_len) == 0 &&
+		auto auth = pcontext->request.field("Authorization");
+		if (auth.size() > 6 &&
+		    auth.size() - 6 <= (sizeof(tmp_buff1) - 1) / 3 * 4 &&
+		    strncasecmp(auth.data(), "Basic ", 6) == 0 &&
+		    decode64(auth.data() + 6, auth.size() - 6, tmp_buff1, &decode_len) == 0 &&
 		    (ptoken = strchr(tmp_buff1, ':')) != nullptr) {
 			*ptoken = '\0';
 			ptoken++;
@@ -1109,7 +1137,7 @@ static int htparse_wrrep_nobuf(HTTP_CONTEXT *pcontext)
 			if (TRUE == pcontext->b_close) {
 				return X_RUNOFF;
 			}
-			http_parser_request_clear(&pcontext->request);
+			http_parser_request_clear(pcontext);
 			hpm_processor_put_context(pcontext);
 			pcontext->sched_stat = SCHED_STAT_RDHEAD;
 			stream_clear(&pcontext->stream_out);
@@ -1124,7 +1152,7 @@ static int htparse_wrrep_nobuf(HTTP_CONTEXT *pcontext)
 			}
 			stream_clear(&pcontext->stream_in);
 			stream_clear(&pcontext->stream_out);
-			http_parser_request_clear(&pcontext->request);
+			http_parser_request_clear(pcontext);
 			unsigned int tmp_len = STREAM_BLOCK_SIZE;
 			pcontext->write_buff = stream_getbuffer_for_writing(&pcontext->stream_out, &tmp_len);
 			pcontext->write_length = 0;
@@ -1142,6 +1170,9 @@ static int htparse_wrrep_nobuf(HTTP_CONTEXT *pcontext)
 				"fastcgi excution time out");
 			http_5xx(pcontext, "FastCGI Timeout", 504);
 			return X_LOOP;
+		case RESPONSE_ERROR:
+			http_5xx(pcontext, "Bad FastCGI Gateway", 502);
+			return X_LOOP;
 		}
 		if (TRUE == mod_fastcgi_check_responded(pcontext)) {
 			if (!mod_fastcgi_read_response(pcontext) &&
@@ -1149,7 +1180,7 @@ static int htparse_wrrep_nobuf(HTTP_CONTEXT *pcontext)
 				if (TRUE == pcontext->b_close) {
 					return X_RUNOFF;
 				}
-				http_parser_request_clear(&pcontext->request);
+				http_parser_request_clear(pcontext);
 				pcontext->sched_stat = SCHED_STAT_RDHEAD;
 				stream_clear(&pcontext->stream_out);
 				return PROCESS_CONTINUE;
@@ -1158,20 +1189,26 @@ static int htparse_wrrep_nobuf(HTTP_CONTEXT *pcontext)
 			http_5xx(pcontext, "Bad FastCGI Gateway", 502);
 			return X_LOOP;
 		}
-	} else if (mod_cache_check_caching(pcontext) &&
-	    !mod_cache_read_response(pcontext)) {
-		if (FALSE == mod_cache_check_responded(pcontext)) {
-			http_5xx(pcontext);
-			return X_LOOP;
-		}
-		if (0 == stream_get_total_length(&pcontext->stream_out)) {
-			if (TRUE == pcontext->b_close) {
-				return X_RUNOFF;
+	} else if (mod_cache_check_caching(pcontext)) {
+		if (!mod_cache_read_response(pcontext)) {
+			if (FALSE == mod_cache_check_responded(pcontext)) {
+				http_5xx(pcontext);
+				return X_LOOP;
 			}
-			http_parser_request_clear(&pcontext->request);
-			pcontext->sched_stat = SCHED_STAT_RDHEAD;
-			stream_clear(&pcontext->stream_out);
-			return PROCESS_CONTINUE;
+			if (0 == stream_get_total_length(&pcontext->stream_out)) {
+				if (TRUE == pcontext->b_close) {
+					return X_RUNOFF;
+				}
+				http_parser_request_clear(pcontext);
+				pcontext->sched_stat = SCHED_STAT_RDHEAD;
+				stream_clear(&pcontext->stream_out);
+				return PROCESS_CONTINUE;
+			}
+		} else if (NULL != pcontext->write_buff ||
+		    pcontext->sendfile_fd >= 0) {
+			/* body segment handed out by mod_cache */
+			pcontext->write_offset = 0;
+			return X_RUNOFF;
 		}
 	}
 
@@ -1212,7 +1249,7 @@ static int htparse_wrrep_nobuf(HTTP_CONTEXT *pcontext)
 
 static int htparse_wrrep(HTTP_CONTEXT *pcontext)
 {
-	if (NULL == pcontext->write_buff) {
+	if (NULL == pcontext->write_buff && pcontext->sendfile_fd < 0) {
 		auto ret = htparse_wrrep_nobuf(pcontext);
 		if (ret != X_RUNOFF)
 			return ret;
@@ -1234,6 +1271,10 @@ static int htparse_wrrep(HTTP_CONTEXT *pcontext)
 		written_len = SSL_write(pcontext->connection.ssl,
 			      reinterpret_cast<char *>(pcontext->write_buff) + pcontext->write_offset,
 			written_len);
+	} else if (pcontext->sendfile_fd >= 0) {
+		off_t offset = pcontext->sendfile_offset + pcontext->write_offset;
+		written_len = sendfile(pcontext->connection.sockd,
+		              pcontext->sendfile_fd, &offset, written_len);
 	} else {
 		written_len = write(pcontext->connection.sockd,
 			      reinterpret_cast<char *>(pcontext->write_buff) + pcontext->write_offset,
@@ -1281,6 +1322,7 @@ static int htparse_wrrep(HTTP_CONTEXT *pcontext)
 	pcontext->write_offset = 0;
 	pcontext->write_buff = NULL;
 	pcontext->write_length = 0;
+	pcontext->sendfile_fd = -1;
 	if (CHANNEL_TYPE_OUT == pcontext->channel_type &&
 	    CHANNEL_STAT_OPENED == ((RPC_OUT_CHANNEL*)
 	    pcontext->pchannel)->channel_stat) {
@@ -1346,7 +1388,7 @@ static int htparse_wrrep(HTTP_CONTEXT *pcontext)
 		if (TRUE == pcontext->b_close) {
 			return X_RUNOFF;
 		}
-		http_parser_request_clear(&pcontext->request);
+		http_parser_request_clear(pcontext);
 		pcontext->sched_stat = SCHED_STAT_RDHEAD;
 	}
 	stream_clear(&pcontext->stream_out);
@@ -2030,17 +2072,8 @@ HTTP_CONTEXT::HTTP_CONTEXT()
     
     palloc_stream = blocks_allocator_get_allocator();
     pcontext->connection.sockd = -1;
-	mem_file_init(&pcontext->request.f_request_uri, g_file_allocator);
-	mem_file_init(&pcontext->request.f_host, g_file_allocator);
-	mem_file_init(&pcontext->request.f_user_agent, g_file_allocator);
-	mem_file_init(&pcontext->request.f_accept, g_file_allocator);
-	mem_file_init(&pcontext->request.f_accept_language, g_file_allocator);
-	mem_file_init(&pcontext->request.f_accept_encoding, g_file_allocator);
-	mem_file_init(&pcontext->request.f_content_type, g_file_allocator);
-	mem_file_init(&pcontext->request.f_content_length, g_file_allocator);
-	mem_file_init(&pcontext->request.f_transfer_encoding, g_file_allocator);
-	mem_file_init(&pcontext->request.f_cookie, g_file_allocator);
-	mem_file_init(&pcontext->request.f_others, g_file_allocator);
+	mem_arena_init(&pcontext->arena, HTTP_ARENA_SIZE);
+	http_parser_request_clear(pcontext);
     stream_init(&pcontext->stream_in, palloc_stream);
 	stream_init(&pcontext->stream_out, palloc_stream);
 	pcontext->node.pdata = pcontext;
@@ -2055,13 +2088,14 @@ static void http_parser_context_clear(HTTP_CONTEXT *pcontext)
     pcontext->connection.sockd = -1;
 	pcontext->sched_stat = 0;
 	
-	http_parser_request_clear(&pcontext->request);
+	http_parser_request_clear(pcontext);
 	
 	stream_clear(&pcontext->stream_in);
 	stream_clear(&pcontext->stream_out);
 	pcontext->write_buff = NULL;
 	pcontext->write_offset = 0;
 	pcontext->write_length = 0;
+	pcontext->sendfile_fd = -1;
 	pcontext->b_close = TRUE;
 	pcontext->b_authed = FALSE;
 	pcontext->auth_times = 0;
@@ -2074,22 +2108,22 @@ static void http_parser_context_clear(HTTP_CONTEXT *pcontext)
 	pcontext->pfast_context = NULL;
 }
 
-static void http_parser_request_clear(HTTP_REQUEST *prequest)
+static void http_parser_request_clear(HTTP_CONTEXT *pcontext)
 {
-	
+	auto prequest = &pcontext->request;
 	prequest->method[0] = '\0';
 	prequest->version[0] = '\0';
-	mem_file_clear(&prequest->f_request_uri);
-	mem_file_clear(&prequest->f_host);
-	mem_file_clear(&prequest->f_user_agent);
-	mem_file_clear(&prequest->f_accept);
-	mem_file_clear(&prequest->f_accept_language);
-	mem_file_clear(&prequest->f_accept_encoding);
-	mem_file_clear(&prequest->f_content_type);
-	mem_file_clear(&prequest->f_content_length);
-	mem_file_clear(&prequest->f_transfer_encoding);
-	mem_file_clear(&prequest->f_cookie);
-	mem_file_clear(&prequest->f_others);
+	prequest->request_uri = prequest->host = prequest->user_agent = "";
+	prequest->accept = prequest->accept_language = "";
+	prequest->accept_encoding = prequest->content_type = "";
+	prequest->content_length = prequest->transfer_encoding = "";
+	prequest->cookie = "";
+	prequest->others = nullptr;
+	prequest->others_num = 0;
+	pcontext->others_max = 0;
+	pcontext->hdr_start = nullptr;
+	/* all header storage of the request goes in one go */
+	mem_arena_clear(&pcontext->arena);
 }
 
 HTTP_CONTEXT::~HTTP_CONTEXT()
@@ -2097,17 +2131,7 @@ HTTP_CONTEXT::~HTTP_CONTEXT()
 	auto pcontext = this;
 	stream_free(&pcontext->stream_in);
 	stream_free(&pcontext->stream_out);
-	mem_file_free(&pcontext->request.f_request_uri);
-	mem_file_free(&pcontext->request.f_host);
-	mem_file_free(&pcontext->request.f_user_agent);
-	mem_file_free(&pcontext->request.f_accept);
-	mem_file_free(&pcontext->request.f_accept_language);
-	mem_file_free(&pcontext->request.f_accept_encoding);
-	mem_file_free(&pcontext->request.f_content_type);
-	mem_file_free(&pcontext->request.f_content_length);
-	mem_file_free(&pcontext->request.f_transfer_encoding);
-	mem_file_free(&pcontext->request.f_cookie);
-	mem_file_free(&pcontext->request.f_others);
+	mem_arena_free(&pcontext->arena);
 	
 	if (NULL != pcontext->connection.ssl) {
 		SSL_shutdown(pcontext->connection.ssl);
@@ -7,6 +7,7 @@
 #include <gromox/contexts_pool.hpp>
 #include "pdu_processor.h"
 #include <gromox/stream.hpp>
+#include <gromox/http_request.hpp>
 #include <gromox/mem_file.hpp>
 #include <ctime>
 #include <sys/time.h>
@@ -49,22 +50,6 @@ struct CONNECTION {
 	struct timeval last_timestamp;     /* last time when system got data from */
 };
 
-struct HTTP_REQUEST {
-	char		method[32];
-	MEM_FILE	f_request_uri;
-	char		version[8];
-	MEM_FILE	f_host;
-	MEM_FILE    f_user_agent;
-    MEM_FILE    f_accept;
-	MEM_FILE	f_accept_language;
-	MEM_FILE	f_accept_encoding;
-	MEM_FILE	f_content_type;
-	MEM_FILE	f_content_length;
-	MEM_FILE	f_transfer_encoding;
-	MEM_FILE	f_cookie;
-    MEM_FILE    f_others;
-};
-
 enum {
 	CHANNEL_TYPE_NONE = 0,
 	CHANNEL_TYPE_IN,
@@ -77,11 +62,17 @@ struct HTTP_CONTEXT final : public SCHEDULE_CONTEXT {
 
 	CONNECTION connection{};
 	HTTP_REQUEST request{};
+	MEM_ARENA arena{}; /* backs the header fields of request */
+	char *hdr_start = nullptr; /* request line while still in stream_in */
+	size_t others_max = 0;
 	uint64_t total_length = 0, bytes_rw = 0;
 	unsigned int sched_stat = 0;
 	STREAM stream_in{}, stream_out{};
 	void *write_buff = nullptr;
 	int write_offset = 0, write_length = 0;
+	/* file backing write_buff, if it may be sent with sendfile */
+	int sendfile_fd = -1;
+	uint64_t sendfile_offset = 0;
 	BOOL b_close = TRUE; /* Connection MIME Header for indicating closing */
 	BOOL b_authed = false;
 	int auth_times = 0;
@@ -91,7 +91,7 @@ int main(int argc, const char **argv)
 	int retcode = EXIT_FAILURE, block_interval_auth;
 	int console_server_port;
 	uint64_t hpm_cache_size;
-	int fastcgi_exec_timeout;
+	int fastcgi_exec_timeout, fastcgi_keepalive_conns;
 	uint64_t fastcgi_max_size;
 	struct passwd *puser_pass;
 	uint64_t fastcgi_cache_size;
@@ -495,6 +495,16 @@ int main(int argc, const char **argv)
 	}
 	itvltoa(fastcgi_exec_timeout, temp_buff);
 	printf("[http]: fastcgi excution time out is %s\n", temp_buff);
+	
+	if (!resource_get_integer("FASTCGI_KEEPALIVE_CONNS", &fastcgi_keepalive_conns)) {
+		fastcgi_keepalive_conns = 8;
+		resource_set_integer("FASTCGI_KEEPALIVE_CONNS", fastcgi_keepalive_conns);
+	} else if (fastcgi_keepalive_conns < 0) {
+		fastcgi_keepalive_conns = 0;
+		resource_set_integer("FASTCGI_KEEPALIVE_CONNS", fastcgi_keepalive_conns);
+	}
+	printf("[mod_fastcgi]: up to %d idle fastcgi connections are kept per back-end\n",
+	       fastcgi_keepalive_conns);
 	listener_init(listen_port, listen_ssl_port, mss_size);
 																			
 	if (0 != listener_run()) {
@@ -611,7 +621,7 @@ int main(int argc, const char **argv)
 		return EXIT_FAILURE;
 	}
 	mod_fastcgi_init(context_num, fastcgi_cache_size,
-		fastcgi_max_size, fastcgi_exec_timeout); 
+		fastcgi_max_size, fastcgi_exec_timeout, fastcgi_keepalive_conns);
  
 	if (0 != mod_fastcgi_run()) { 
 		printf("[system]: failed to run mod fastcgi\n");
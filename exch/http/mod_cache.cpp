@@ -33,15 +33,35 @@
 #include <ctime>
 #define HASH_GROWING_NUM			1000
 
+/* seconds for which a cached item is trusted without stat()ing the file */
+#define CACHE_RECHECK_INTERVAL		2
+
+/* largest piece of body handed to the socket in one go */
+#define CACHE_SEGMENT_SIZE			0x100000
+
+/* piece of body read into the heap for a TLS connection */
+#define CACHE_TLS_SEGMENT_SIZE		0x10000
+
 #define BOUNDARY_STRING				"00000000000000000001"
 
 namespace {
+/*
+ * A cache item holds what the response header needs to know about a file
+ * (identity, etag, date); the body is never kept in memory. Each response
+ * opens the file itself and either sendfile()s from it or, on TLS, reads
+ * it piecewise into a heap buffer, so a file truncated while being served
+ * ends the connection instead of faulting on a vanished page. Items are
+ * reference-counted by the contexts serving them; stale items linger on
+ * g_item_list until the last reference is dropped.
+ */
 struct CACHE_ITEM {
 	DOUBLE_LIST_NODE node;
 	char extention[16];
-	DATA_BLOB blob;
+	uint32_t length;
 	ino_t ino;
 	time_t mtime;
+	time_t checked; /* last time the file was stat()ed */
+	char etag[64], modified[64];
 	BOOL b_expired;
 	int reference;
 };
@@ -59,6 +79,8 @@ struct CACHE_CONTEXT {
 	int range_pos;
 	int range_num;
 	RANGE *prange;
+	int fd; /* the file being served, -1 for HEAD */
+	char *pbuff; /* body segment for TLS connections */
 };
 
 struct DIRECTORY_NODE {
@@ -77,6 +99,11 @@ static STR_HASH_TABLE *g_cache_hash;
 static CACHE_CONTEXT *g_context_list;
 
 
+static void mod_cache_free_item(CACHE_ITEM *pitem)
+{
+	free(pitem);
+}
+
 static void *mod_cache_scanwork(void *pparam)
 {
 	int count;
@@ -105,13 +132,12 @@ static void *mod_cache_scanwork(void *pparam)
 			if (0 == stat(tmp_key, &node_stat) &&
 				0 != S_ISREG(node_stat.st_mode) &&
 				node_stat.st_ino == pitem->ino &&
-				node_stat.st_size == pitem->blob.length &&
+				node_stat.st_size == pitem->length &&
 				node_stat.st_mtime == pitem->mtime) {
 				continue;
 			}
 			str_hash_iter_remove(iter);
-			free(pitem->blob.data);
-			free(pitem);
+			mod_cache_free_item(pitem);
 		}
 		str_hash_iter_free(iter);
 		count = 0;
@@ -203,6 +229,8 @@ int mod_cache_run()
 		return -2;
 	}
 	memset(g_context_list, 0, sizeof(CACHE_CONTEXT)*g_context_num);
+	for (int i = 0; i < g_context_num; ++i)
+		g_context_list[i].fd = -1;
 	g_cache_hash = str_hash_init(HASH_GROWING_NUM,
 						sizeof(CACHE_ITEM*), NULL);
 	if (NULL == g_cache_hash) {
@@ -242,8 +270,7 @@ void mod_cache_stop()
 		for (str_hash_iter_begin(iter); !str_hash_iter_done(iter);
 			str_hash_iter_forward(iter)) {
 			ppitem = static_cast<CACHE_ITEM **>(str_hash_iter_get_value(iter, nullptr));
-			free((*ppitem)->blob.data);
-			free(*ppitem);
+			mod_cache_free_item(*ppitem);
 		}
 		str_hash_iter_free(iter);
 		str_hash_free(g_cache_hash);
@@ -251,8 +278,7 @@ void mod_cache_stop()
 	}
 	while ((pnode = double_list_pop_front(&g_item_list)) != nullptr) {
 		pitem = (CACHE_ITEM*)pnode->pdata;
-		free(pitem->blob.data);
-		free(pitem);
+		mod_cache_free_item(pitem);
 	}
 }
 
@@ -337,32 +363,6 @@ static void mod_cache_serialize_etag(ino_t ino,
 	etag[offset] = '\0';
 }
 
-static BOOL mod_cache_get_others_field(MEM_FILE *pf_others,
-    const char *tag, char *value, size_t length)
-{
-	char tmp_buff[256];
-	uint32_t tag_len, val_len;
-	
-	mem_file_seek(pf_others, MEM_FILE_READ_PTR,
-		0, MEM_FILE_SEEK_BEGIN);
-	while (mem_file_read(pf_others, &tag_len, sizeof(uint32_t)) != MEM_END_OF_FILE) {
-		if (tag_len >= GX_ARRAY_SIZE(tmp_buff))
-			return FALSE;
-		mem_file_read(pf_others, tmp_buff, tag_len);
-		tmp_buff[tag_len] = '\0';
-		mem_file_read(pf_others, &val_len, sizeof(uint32_t));
-		if (0 == strcasecmp(tag, tmp_buff)) {
-			length = (length > val_len)?val_len:(length - 1);
-			mem_file_read(pf_others, value, length);
-			value[length] = '\0';
-			return TRUE;
-		}
-		mem_file_seek(pf_others, MEM_FILE_READ_PTR,
-			val_len, MEM_FILE_SEEK_CUR);
-	}
-	return FALSE;
-}
-
 static BOOL mod_cache_parse_rfc1123_dstring(
 	const char *dstring, time_t *pmtime)
 {
@@ -403,30 +403,24 @@ static BOOL mod_cache_response_unmodified(HTTP_CONTEXT *phttp)
 
 static BOOL mod_cache_response_single_header(HTTP_CONTEXT *phttp)
 {
-	char etag[128];
 	time_t cur_time;
 	struct tm tmp_tm;
 	int response_len;
 	char date_string[128];
 	CACHE_CONTEXT *pcontext;
 	char response_buff[1024];
-	char modified_string[128];
 	const char *pcontent_type;
 	
 	pcontext = mod_cache_get_cache_context(phttp);
 	time(&cur_time);
 	gmtime_r(&cur_time, &tmp_tm);
 	strftime(date_string, 128, "%a, %d %b %Y %T GMT", &tmp_tm);
-	gmtime_r(&pcontext->pitem->mtime, &tmp_tm);
-	strftime(modified_string, 128, "%a, %d %b %Y %T GMT", &tmp_tm);
-	mod_cache_serialize_etag(pcontext->pitem->ino,
-		pcontext->pitem->blob.length, pcontext->pitem->mtime, etag);
 	pcontent_type = system_services_extension_to_mime(
 							pcontext->pitem->extention);
 	if (NULL == pcontent_type) {
 		pcontent_type = "application/octet-stream";
 	}
-	if (pcontext->until != pcontext->pitem->blob.length) {
+	if (pcontext->until != pcontext->pitem->length) {
 		response_len = gx_snprintf(response_buff,
 		               GX_ARRAY_SIZE(response_buff),
 					"HTTP/1.1 206 Partial Content\r\n");
@@ -447,13 +441,13 @@ static BOOL mod_cache_response_single_header(HTTP_CONTEXT *phttp)
 					resource_get_string("HOST_ID"),
 					date_string, pcontent_type,
 					pcontext->until - pcontext->offset,
-					modified_string, etag);
-	if (pcontext->until != pcontext->pitem->blob.length) {
+					pcontext->pitem->modified, pcontext->pitem->etag);
+	if (pcontext->until != pcontext->pitem->length) {
 		response_len += gx_snprintf(response_buff + response_len,
 		                GX_ARRAY_SIZE(response_buff) - response_len,
 					"Content-Range: bytes %u-%u/%u\r\n\r\n",
 					pcontext->offset, pcontext->until - 1,
-					pcontext->pitem->blob.length);
+					pcontext->pitem->length);
 	} else {
 		memcpy(response_buff + response_len, "\r\n", 2);
 		response_len += 2;
@@ -489,7 +483,7 @@ static uint32_t mod_cache_calculate_content_length(CACHE_CONTEXT *pcontext)
 		content_length += 25 + sprintf(num_buff, "%u%u%u",
 								pcontext->prange[i].begin,
 								pcontext->prange[i].end,
-								pcontext->pitem->blob.length);
+								pcontext->pitem->length);
 		content_length += 2; /* \r\n */
 		content_length += pcontext->prange[i].end -
 						pcontext->prange[i].begin + 1;
@@ -502,7 +496,6 @@ static uint32_t mod_cache_calculate_content_length(CACHE_CONTEXT *pcontext)
 
 static BOOL mod_cache_response_multiple_header(HTTP_CONTEXT *phttp)
 {
-	char etag[128];
 	time_t cur_time;
 	struct tm tmp_tm;
 	int response_len;
@@ -510,16 +503,11 @@ static BOOL mod_cache_response_multiple_header(HTTP_CONTEXT *phttp)
 	uint32_t content_length;
 	CACHE_CONTEXT *pcontext;
 	char response_buff[1024];
-	char modified_string[128];
 	
 	pcontext = mod_cache_get_cache_context(phttp);
 	time(&cur_time);
 	gmtime_r(&cur_time, &tmp_tm);
 	strftime(date_string, 128, "%a, %d %b %Y %T GMT", &tmp_tm);
-	gmtime_r(&pcontext->pitem->mtime, &tmp_tm);
-	strftime(modified_string, 128, "%a, %d %b %Y %T GMT", &tmp_tm);
-	mod_cache_serialize_etag(pcontext->pitem->ino,
-		pcontext->pitem->blob.length, pcontext->pitem->mtime, etag);
 	content_length =  mod_cache_calculate_content_length(pcontext);	
 	response_len = gx_snprintf(response_buff, GX_ARRAY_SIZE(response_buff),
 					"HTTP/1.1 206 Partial Content\r\n"
@@ -532,7 +520,8 @@ static BOOL mod_cache_response_multiple_header(HTTP_CONTEXT *phttp)
 					"ETag: \"%s\"\r\n",
 					resource_get_string("HOST_ID"),
 					date_string, BOUNDARY_STRING,
-					content_length, modified_string, etag);
+					content_length, pcontext->pitem->modified,
+					pcontext->pitem->etag);
 	if (STREAM_WRITE_OK != stream_write(&phttp->stream_out,
 		response_buff, response_len)) {
 		return FALSE;	
@@ -636,6 +625,120 @@ static BOOL mod_cache_parse_range_value(char *value,
 	return TRUE;
 }
 
+static CACHE_ITEM *mod_cache_load_item(const char *path, const char *suffix)
+{
+	struct tm tmp_tm;
+	struct stat node_stat;
+	
+	int fd = open(path, O_RDONLY);
+	if (-1 == fd) {
+		return NULL;
+	}
+	if (0 != fstat(fd, &node_stat) ||
+		0 == S_ISREG(node_stat.st_mode) ||
+		node_stat.st_size >= 0xFFFFFFFF) {
+		close(fd);
+		return NULL;
+	}
+	auto pitem = static_cast<CACHE_ITEM *>(malloc(sizeof(CACHE_ITEM)));
+	if (NULL == pitem) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	gx_strlcpy(pitem->extention, suffix, GX_ARRAY_SIZE(pitem->extention));
+	pitem->length = node_stat.st_size;
+	pitem->ino = node_stat.st_ino;
+	pitem->mtime = node_stat.st_mtime;
+	pitem->checked = time(nullptr);
+	mod_cache_serialize_etag(pitem->ino,
+		pitem->length, pitem->mtime, pitem->etag);
+	gmtime_r(&pitem->mtime, &tmp_tm);
+	strftime(pitem->modified, GX_ARRAY_SIZE(pitem->modified),
+		"%a, %d %b %Y %T GMT", &tmp_tm);
+	pitem->b_expired = FALSE;
+	pitem->reference = 1;
+	return pitem;
+}
+
+static void mod_cache_release_item(CACHE_ITEM *pitem)
+{
+	std::unique_lock hhold(g_hash_lock);
+	pitem->reference --;
+	if (0 != pitem->reference || FALSE == pitem->b_expired) {
+		return;
+	}
+	double_list_remove(&g_item_list, &pitem->node);
+	hhold.unlock();
+	mod_cache_free_item(pitem);
+}
+
+/*
+ * Look up (or load) the item for @path and take a reference on it. Files
+ * served by mod_cache are expected to be replaced rather than rewritten in
+ * place; a hit is only revalidated against the file system once every
+ * CACHE_RECHECK_INTERVAL seconds.
+ */
+static CACHE_ITEM *mod_cache_acquire_item(const char *path, const char *suffix)
+{
+	CACHE_ITEM *pitem;
+	CACHE_ITEM **ppitem;
+	struct stat node_stat;
+	auto cur_time = time(nullptr);
+	
+	std::unique_lock hhold(g_hash_lock);
+	ppitem = static_cast<CACHE_ITEM **>(str_hash_query(g_cache_hash, path));
+	if (NULL != ppitem) {
+		pitem = *ppitem;
+		pitem->reference ++;
+		if (cur_time - pitem->checked < CACHE_RECHECK_INTERVAL) {
+			return pitem;
+		}
+		hhold.unlock();
+		BOOL b_valid = 0 == stat(path, &node_stat) &&
+			0 != S_ISREG(node_stat.st_mode) &&
+			pitem->ino == node_stat.st_ino &&
+			pitem->length == node_stat.st_size &&
+			pitem->mtime == node_stat.st_mtime ? TRUE : false;
+		hhold.lock();
+		if (TRUE == b_valid) {
+			pitem->checked = cur_time;
+			return pitem;
+		}
+		ppitem = static_cast<CACHE_ITEM **>(str_hash_query(g_cache_hash, path));
+		if (NULL != ppitem && pitem == *ppitem) {
+			str_hash_remove(g_cache_hash, path);
+			pitem->b_expired = TRUE;
+			pitem->node.pdata = pitem;
+			double_list_append_as_tail(&g_item_list, &pitem->node);
+		}
+		hhold.unlock();
+		mod_cache_release_item(pitem);
+	} else {
+		hhold.unlock();
+	}
+	pitem = mod_cache_load_item(path, suffix);
+	if (NULL == pitem) {
+		return NULL;
+	}
+	hhold.lock();
+	ppitem = static_cast<CACHE_ITEM **>(str_hash_query(g_cache_hash, path));
+	if (NULL == ppitem) {
+		if (1 == str_hash_add(g_cache_hash, path, &pitem)) {
+			return pitem;
+		}
+		if (TRUE == mod_cache_enlarge_hash() &&
+			1 == str_hash_add(g_cache_hash, path, &pitem)) {
+			return pitem;
+		}
+	}
+	/* lost the race, or no room: serve it without caching */
+	pitem->b_expired = TRUE;
+	pitem->node.pdata = pitem;
+	double_list_append_as_tail(&g_item_list, &pitem->node);
+	return pitem;
+}
+
 BOOL mod_cache_get_context(HTTP_CONTEXT *phttp)
 {
 	int fd;
@@ -647,7 +750,6 @@ BOOL mod_cache_get_context(HTTP_CONTEXT *phttp)
 	char domain[256];
 	CACHE_ITEM *pitem;
 	char tmp_path[512];
-	CACHE_ITEM **ppitem;
 	char tmp_buff[8192];
 	struct stat node_stat;
 	char request_uri[8192];
@@ -657,53 +759,32 @@ BOOL mod_cache_get_context(HTTP_CONTEXT *phttp)
 		0 != strcasecmp(phttp->request.method, "HEAD")) {
 		return FALSE;
 	}
-	auto tmp_len = mem_file_get_total_length(&phttp->request.f_content_length);
-	if (0 != tmp_len) {
-		if (tmp_len >= 32) {
-			return FALSE;
-		}
-		mem_file_seek(&phttp->request.f_content_length,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_content_length, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-		if (0 != atoll(tmp_buff)) {
-			return FALSE;
-		}
-	}
-	tmp_len = mem_file_get_total_length(&phttp->request.f_host);
-	if (tmp_len >= sizeof(domain)) {
+	auto &cl = phttp->request.content_length;
+	if (cl.size() >= 32 || (cl.size() > 0 && atoll(cl.data()) != 0))
+		return FALSE;
+	auto &host = phttp->request.host;
+	if (host.size() >= sizeof(domain)) {
 		http_parser_log_info(phttp, 6, "length of "
 			"request host is too long for mod_cache");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		gx_strlcpy(domain, phttp->connection.server_ip, GX_ARRAY_SIZE(domain));
-	} else {
-		mem_file_seek(&phttp->request.f_host,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_host, domain, tmp_len);
-		domain[tmp_len] = '\0';
-	}
+	gx_strlcpy(domain, host.size() == 0 ? phttp->connection.server_ip :
+	           host.data(), GX_ARRAY_SIZE(domain));
 	ptoken = strchr(domain, ':');
 	if (NULL != ptoken) {
 		*ptoken = '\0';
 	}
-	tmp_len = mem_file_get_total_length(
-		&phttp->request.f_request_uri);
-	if (0 == tmp_len) {
+	auto &uri = phttp->request.request_uri;
+	if (uri.size() == 0) {
 		http_parser_log_info(phttp, 6, "cannot"
 			" find request uri for mod_cache");
 		return FALSE;
-	} else if (tmp_len >= sizeof(tmp_buff)) {
+	} else if (uri.size() >= sizeof(request_uri)) {
 		http_parser_log_info(phttp, 6, "length of "
 			"request uri is too long for mod_cache");
 		return FALSE;
 	}
-	mem_file_seek(&phttp->request.f_request_uri,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_read(&phttp->request.f_request_uri, tmp_buff, tmp_len);
-	tmp_buff[tmp_len] = '\0';
-	if (FALSE == parse_uri(tmp_buff, request_uri)) {
+	if (FALSE == parse_uri(uri.data(), request_uri)) {
 		http_parser_log_info(phttp, 6, "request"
 				" uri format error for mod_cache");
 		return FALSE;
@@ -732,133 +813,73 @@ BOOL mod_cache_get_context(HTTP_CONTEXT *phttp)
 		return FALSE;
 	snprintf(tmp_path, GX_ARRAY_SIZE(tmp_path), "%s%s", it->dir.c_str(),
 	         request_uri + it->path.size());
-	if (0 != stat(tmp_path, &node_stat) ||
-		0 == S_ISREG(node_stat.st_mode)) {
-		return FALSE;
-	}
-	if (node_stat.st_size >= 0xFFFFFFFF) {
+	pitem = mod_cache_acquire_item(tmp_path, suffix);
+	if (NULL == pitem) {
 		return FALSE;
 	}
-	if (mod_cache_get_others_field(&phttp->request.f_others,
-	    "If-None-Match", tmp_buff, GX_ARRAY_SIZE(tmp_buff)) &&
-		TRUE == mod_cache_retrieve_etag(
-		tmp_buff, &ino, &size, &mtime)) {
-		if (ino == node_stat.st_ino &&
-			size == node_stat.st_size &&
-			mtime == node_stat.st_mtime) {
+	auto value = phttp->request.field("If-None-Match");
+	if (value.size() > 0 && TRUE == mod_cache_retrieve_etag(
+		value.data(), &ino, &size, &mtime)) {
+		if (ino == pitem->ino && size == pitem->length &&
+			mtime == pitem->mtime) {
+			mod_cache_release_item(pitem);
 			return mod_cache_response_unmodified(phttp);
 		}
 	} else {
-		if (mod_cache_get_others_field(&phttp->request.f_others,
-		    "If-Modified-Since", tmp_buff, GX_ARRAY_SIZE(tmp_buff)) &&
-			TRUE == mod_cache_parse_rfc1123_dstring(
-			tmp_buff, &mtime)) {
-			if (mtime == node_stat.st_mtime) {
+		value = phttp->request.field("If-Modified-Since");
+		if (value.size() > 0 && TRUE == mod_cache_parse_rfc1123_dstring(
+			value.data(), &mtime)) {
+			if (mtime == pitem->mtime) {
+				mod_cache_release_item(pitem);
 				return mod_cache_response_unmodified(phttp);
 			}
 		}
 	}
 	pcontext = mod_cache_get_cache_context(phttp);
 	memset(pcontext, 0, sizeof(CACHE_CONTEXT));
-	if (mod_cache_get_others_field(&phttp->request.f_others, "Range",
-	    tmp_buff, GX_ARRAY_SIZE(tmp_buff))) {
+	pcontext->fd = -1;
+	value = phttp->request.field("Range");
+	if (value.size() > 0) {
+		gx_strlcpy(tmp_buff, value.data(), GX_ARRAY_SIZE(tmp_buff));
 		if (FALSE == mod_cache_parse_range_value(
-			tmp_buff, node_stat.st_size, pcontext)) {
+			tmp_buff, pitem->length, pcontext)) {
 			http_parser_log_info(phttp, 6, "\"range\""
 				" value in http request header format"
 				" error for mod_cache");
+			mod_cache_release_item(pitem);
 			return FALSE;
 		}
 	} else {
 		pcontext->offset = 0;
-		pcontext->until = node_stat.st_size;
+		pcontext->until = pitem->length;
 	}
-	std::unique_lock hhold(g_hash_lock);
-	ppitem = static_cast<CACHE_ITEM **>(str_hash_query(g_cache_hash, tmp_path));
-	if (NULL != ppitem) {
-		pitem = *ppitem;
-		if (pitem->ino != node_stat.st_ino ||
-			pitem->blob.length != node_stat.st_size ||
-			pitem->mtime != node_stat.st_mtime) {
-			str_hash_remove(g_cache_hash, tmp_path);
-			if (pitem->reference > 0) {
-				pitem->b_expired = TRUE;
-				pitem->node.pdata = pitem;
-				double_list_append_as_tail(
-					&g_item_list, &pitem->node);
-			} else {
-				free(pitem->blob.data);
-				free(pitem);
-			}
-		} else {
-			pitem->reference ++;
-			pcontext->pitem = pitem;
-			return TRUE;
-		}
-	}
-	hhold.unlock();
-	pitem = static_cast<CACHE_ITEM *>(malloc(sizeof(*pitem)));
-	if (NULL == pitem) {
-		if (NULL != pcontext->prange) {
-			free(pcontext->prange);
-			pcontext->prange = NULL;
-		}
-		return FALSE;
-	}
-	strcpy(pitem->extention, suffix);
-	pitem->reference = 1;
-	pitem->ino = node_stat.st_ino;
-	pitem->blob.length = node_stat.st_size;
-	pitem->mtime = node_stat.st_mtime;
-	pitem->blob.data = static_cast<uint8_t *>(malloc(node_stat.st_size));
-	if (NULL == pitem->blob.data) {
-		free(pitem);
-		if (NULL != pcontext->prange) {
-			free(pcontext->prange);
-			pcontext->prange = NULL;
-		}
-		return FALSE;
+	pcontext->pitem = pitem;
+	if (0 == strcasecmp(phttp->request.method, "HEAD")) {
+		return TRUE;
 	}
+	/* the body is served from this descriptor, never from a mapping */
 	fd = open(tmp_path, O_RDONLY);
 	if (-1 == fd) {
-		free(pitem->blob.data);
-		free(pitem);
-		if (NULL != pcontext->prange) {
-			free(pcontext->prange);
-			pcontext->prange = NULL;
-		}
+		mod_cache_put_context(phttp);
 		return FALSE;
 	}
-	if (node_stat.st_size != read(fd,
-		pitem->blob.data, node_stat.st_size)) {
+	if (0 != fstat(fd, &node_stat) ||
+		node_stat.st_ino != pitem->ino ||
+		node_stat.st_size != pitem->length ||
+		node_stat.st_mtime != pitem->mtime) {
+		/* replaced since the item was checked; the next request reloads it */
 		close(fd);
-		free(pitem->blob.data);
-		free(pitem);
-		if (NULL != pcontext->prange) {
-			free(pcontext->prange);
-			pcontext->prange = NULL;
-		}
+		mod_cache_put_context(phttp);
 		return FALSE;
 	}
-	close(fd);
-	hhold.lock();
-	ppitem = static_cast<CACHE_ITEM **>(str_hash_query(g_cache_hash, tmp_path));
-	if (NULL == ppitem) {
-		if (1 != str_hash_add(g_cache_hash, tmp_path, &pitem)) {
-			if (FALSE == mod_cache_enlarge_hash()) {
-				goto INVALIDATE_ITEM;
-			}
-			str_hash_add(g_cache_hash, tmp_path, &pitem);
+	pcontext->fd = fd;
+	if (NULL != phttp->connection.ssl) {
+		pcontext->pbuff = static_cast<char *>(malloc(CACHE_TLS_SEGMENT_SIZE));
+		if (NULL == pcontext->pbuff) {
+			mod_cache_put_context(phttp);
+			return FALSE;
 		}
-		pitem->b_expired = FALSE;
-		pcontext->pitem = pitem;
-		return TRUE;
 	}
- INVALIDATE_ITEM:
-	pitem->b_expired = TRUE;
-	pitem->node.pdata = pitem;
-	double_list_append_as_tail(&g_item_list, &pitem->node);
-	pcontext->pitem = pitem;
 	return TRUE;
 }
 
@@ -868,24 +889,24 @@ void mod_cache_put_context(HTTP_CONTEXT *phttp)
 	CACHE_CONTEXT *pcontext;
 	
 	pcontext = mod_cache_get_cache_context(phttp);
-	if (NULL == pcontext->pitem) {
-		return;
+	if (-1 != pcontext->fd) {
+		close(pcontext->fd);
+		pcontext->fd = -1;
 	}
-	pitem = pcontext->pitem;
-	pcontext->pitem = NULL;
-	std::unique_lock hhold(g_hash_lock);
-	pitem->reference --;
-	if (0 != pitem->reference || FALSE == pitem->b_expired) {
-		return;
+	if (NULL != pcontext->pbuff) {
+		free(pcontext->pbuff);
+		pcontext->pbuff = NULL;
 	}
-	double_list_remove(&g_item_list, &pitem->node);
-	hhold.unlock();
-	free(pitem->blob.data);
-	free(pitem);
 	if (NULL != pcontext->prange) {
 		free(pcontext->prange);
 		pcontext->prange = NULL;
 	}
+	if (NULL == pcontext->pitem) {
+		return;
+	}
+	pitem = pcontext->pitem;
+	pcontext->pitem = NULL;
+	mod_cache_release_item(pitem);
 }
 
 BOOL mod_cache_check_responded(HTTP_CONTEXT *phttp)
@@ -896,6 +917,12 @@ BOOL mod_cache_check_responded(HTTP_CONTEXT *phttp)
 	return pcontext->b_header;
 }
 
+/*
+ * Each call yields one piece of the response: the header and the
+ * multipart boundaries go through stream_out. Body segments are handed to
+ * the parser as sendfile_fd/sendfile_offset on plain connections, and as
+ * write_buff holding a pread() copy on TLS connections.
+ */
 BOOL mod_cache_read_response(HTTP_CONTEXT *phttp)
 {
 	int tmp_len;
@@ -924,56 +951,67 @@ BOOL mod_cache_read_response(HTTP_CONTEXT *phttp)
 			mod_cache_put_context(phttp);
 			return FALSE;
 		}
+		return TRUE;
 	}
-	if (pcontext->until - pcontext->offset >=
-		STREAM_BLOCK_SIZE - 1) {
-		tmp_len = STREAM_BLOCK_SIZE - 1;
-	} else {
-		tmp_len = pcontext->until - pcontext->offset;
+	if (pcontext->offset < pcontext->until) {
+		if (NULL == phttp->connection.ssl) {
+			tmp_len = std::min(pcontext->until - pcontext->offset,
+			          static_cast<uint32_t>(CACHE_SEGMENT_SIZE));
+			phttp->sendfile_fd = pcontext->fd;
+			phttp->sendfile_offset = pcontext->offset;
+			phttp->write_length = tmp_len;
+			pcontext->offset += tmp_len;
+			return TRUE;
+		}
+		tmp_len = std::min(pcontext->until - pcontext->offset,
+		          static_cast<uint32_t>(CACHE_TLS_SEGMENT_SIZE));
+		auto ret = pread(pcontext->fd, pcontext->pbuff,
+		           tmp_len, pcontext->offset);
+		if (ret != tmp_len) {
+			/* file shrank under us; the promised length cannot be met */
+			http_parser_log_info(phttp, 6, "file "
+				"truncated while served by mod_cache");
+			phttp->b_close = TRUE;
+			mod_cache_put_context(phttp);
+			return FALSE;
+		}
+		phttp->write_buff = pcontext->pbuff;
+		phttp->write_length = tmp_len;
+		pcontext->offset += tmp_len;
+		return TRUE;
 	}
-	if (STREAM_WRITE_OK != stream_write(&phttp->stream_out,
-		pcontext->pitem->blob.data + pcontext->offset, tmp_len)) {
+	if (NULL == pcontext->prange) {
 		mod_cache_put_context(phttp);
 		return FALSE;
 	}
-	pcontext->offset += tmp_len;
-	if (pcontext->offset == pcontext->until) {
-		if (NULL != pcontext->prange) {
-			pcontext->range_pos ++;
-			if (pcontext->range_pos < pcontext->range_num) {
-				pcontext->offset = pcontext->prange[
-						pcontext->range_pos].begin;
-				pcontext->until = pcontext->prange[
-						pcontext->range_pos].end + 1;
-				pcontent_type = system_services_extension_to_mime(
-							pcontext->pitem->extention);
-				if (NULL == pcontent_type) {
-					pcontent_type = "application/octet-stream";
-				}
-				tmp_len = sprintf(tmp_buff,
-					"\r\n--%s\r\n"
-					"Content-Type: %s\r\n"
-					"Content-Range: bytes %u-%u/%u\r\n\r\n",
-					BOUNDARY_STRING, pcontent_type,
-					pcontext->prange[pcontext->range_pos].begin,
-					pcontext->prange[pcontext->range_pos].end,
-					pcontext->pitem->blob.length);
-			} else {
-				tmp_len = sprintf(tmp_buff,
-					"\r\n--%s--\r\n",
-					BOUNDARY_STRING);
-				free(pcontext->prange);
-				pcontext->prange = NULL;
-			}
-			if (STREAM_WRITE_OK != stream_write(
-				&phttp->stream_out, tmp_buff, tmp_len)) {
-				mod_cache_put_context(phttp);
-				return FALSE;
-			}
-			return TRUE;
+	pcontext->range_pos ++;
+	if (pcontext->range_pos < pcontext->range_num) {
+		pcontext->offset = pcontext->prange[
+				pcontext->range_pos].begin;
+		pcontext->until = pcontext->prange[
+				pcontext->range_pos].end + 1;
+		pcontent_type = system_services_extension_to_mime(
+					pcontext->pitem->extention);
+		if (NULL == pcontent_type) {
+			pcontent_type = "application/octet-stream";
 		}
+		tmp_len = sprintf(tmp_buff,
+			"\r\n--%s\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Range: bytes %u-%u/%u\r\n\r\n",
+			BOUNDARY_STRING, pcontent_type,
+			pcontext->prange[pcontext->range_pos].begin,
+			pcontext->prange[pcontext->range_pos].end,
+			pcontext->pitem->length);
+	} else {
+		tmp_len = sprintf(tmp_buff,
+			"\r\n--%s--\r\n",
+			BOUNDARY_STRING);
+		free(pcontext->prange);
+		pcontext->prange = NULL;
 	}
-	if (pcontext->offset == pcontext->until) {
+	if (STREAM_WRITE_OK != stream_write(
+		&phttp->stream_out, tmp_buff, tmp_len)) {
 		mod_cache_put_context(phttp);
 		return FALSE;
 	}
@@ -1,8 +1,11 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
 // SPDX-FileCopyrightText: 2021 grommunio GmbH
 // This file is part of Gromox.
+#include <algorithm>
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <unistd.h>
@@ -43,6 +46,10 @@
 
 #define FCGI_REQUEST_ID							1
 
+#define FCGI_KEEP_CONN							1
+
+/* seconds a pooled back-end connection may sit idle before it is dropped */
+#define FASTCGI_IDLE_TIMEOUT					60
 
 #define RECORD_TYPE_BEGIN_REQUEST				1
 #define RECORD_TYPE_ABORT_REQUEST				2
@@ -97,6 +104,11 @@ struct RECORD_HEADER {
 	uint8_t reserved;
 };
 
+struct FASTCGI_IDLE {
+	int sockd;
+	time_t last_time;
+};
+
 }
 
 static int g_context_num;
@@ -106,6 +118,10 @@ static uint64_t g_cache_size;
 static std::vector<FASTCGI_NODE> g_fastcgi_list;
 static FASTCGI_CONTEXT *g_context_list;
 static volatile int g_unavailable_times;
+static unsigned int g_max_idle;
+static std::mutex g_idle_lock;
+/* idle FCGI_KEEP_CONN connections by socket path, most recent last */
+static std::unordered_map<std::string, std::vector<FASTCGI_IDLE>> g_idle_list;
 
 static const FASTCGI_NODE *mod_fastcgi_find_backend(const char *domain,
     const char *uri_path, const char *file_name, const char *suffix,
@@ -132,13 +148,14 @@ static const FASTCGI_NODE *mod_fastcgi_find_backend(const char *domain,
 }
 
 void mod_fastcgi_init(int context_num, uint64_t cache_size, uint64_t max_size,
-    int exec_timeout)
+    int exec_timeout, unsigned int max_idle)
 {
 	g_context_num = context_num;
 	g_unavailable_times = 0;
 	g_cache_size = cache_size;
 	g_max_size = max_size;
 	g_exec_timeout = exec_timeout;
+	g_max_idle = max_idle;
 }
 
 static int mod_fastcgi_defaults()
@@ -215,6 +232,12 @@ int mod_fastcgi_run()
 
 void mod_fastcgi_stop()
 {
+	std::unique_lock hold(g_idle_lock);
+	for (const auto &[path, list] : g_idle_list)
+		for (const auto &conn : list)
+			close(conn.sockd);
+	g_idle_list.clear();
+	hold.unlock();
 	free(g_context_list);
 	g_context_list = NULL;
 }
@@ -244,7 +267,7 @@ static int mod_fastcgi_push_name_value(NDR_PUSH *pndr,
 	return ndr_push_array_uint8(pndr, reinterpret_cast<const uint8_t *>(pvalue), val_len);
 }
 
-static int mod_fastcgi_push_begin_request(NDR_PUSH *pndr)
+static int mod_fastcgi_push_begin_request(NDR_PUSH *pndr, uint8_t flags)
 {
 	TRY(ndr_push_uint8(pndr, FCGI_VERSION));
 	TRY(ndr_push_uint8(pndr, RECORD_TYPE_BEGIN_REQUEST));
@@ -258,7 +281,7 @@ static int mod_fastcgi_push_begin_request(NDR_PUSH *pndr)
 	/* begin request role */
 	TRY(ndr_push_uint16(pndr, ROLE_RESPONDER));
 	/* begin request flags */
-	TRY(ndr_push_uint8(pndr, 0));
+	TRY(ndr_push_uint8(pndr, flags));
 	/* begin request reserved bytes */
 	return ndr_push_zero(pndr, 5);
 }
@@ -344,32 +367,6 @@ static int mod_fastcgi_pull_record_header(
 	return ndr_pull_uint8(pndr, &pheader->reserved);
 }
 
-static BOOL mod_fastcgi_get_others_field(MEM_FILE *pf_others,
-    const char *tag, char *value, size_t length)
-{
-	char tmp_buff[256];
-	uint32_t tag_len, val_len;
-	
-	mem_file_seek(pf_others, MEM_FILE_READ_PTR,
-		0, MEM_FILE_SEEK_BEGIN);
-	while (mem_file_read(pf_others, &tag_len, sizeof(uint32_t)) != MEM_END_OF_FILE) {
-		if (tag_len >= GX_ARRAY_SIZE(tmp_buff))
-			return FALSE;
-		mem_file_read(pf_others, tmp_buff, tag_len);
-		tmp_buff[tag_len] = '\0';
-		mem_file_read(pf_others, &val_len, sizeof(int));
-		if (0 == strcasecmp(tag, tmp_buff)) {
-			length = (length > val_len)?val_len:(length - 1);
-			mem_file_read(pf_others, value, length);
-			value[length] = '\0';
-			return TRUE;
-		}
-		mem_file_seek(pf_others, MEM_FILE_READ_PTR,
-			val_len, MEM_FILE_SEEK_CUR);
-	}
-	return FALSE;
-}
-
 static int mod_fastcgi_connect_backend(const char *path)
 {
 	int sockd, len;
@@ -388,9 +385,63 @@ static int mod_fastcgi_connect_backend(const char *path)
 		close(sockd);
 		return -2;
 	}
+	/* writes are queued in pout when the back-end is not reading */
+	auto flags = fcntl(sockd, F_GETFL);
+	if (flags < 0 || fcntl(sockd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		close(sockd);
+		return -1;
+	}
 	return sockd;
 }
 
+/*
+ * Hand out a pooled connection to @path, or -1. php-fpm does not multiplex
+ * (FCGI_MPXS_CONNS=0), so a connection carries one request at a time and
+ * only comes back to the pool after its END_REQUEST has been read.
+ */
+static int mod_fastcgi_take_idle(const char *path)
+{
+	struct pollfd pfd_read;
+	auto cur_time = time(nullptr);
+	
+	while (TRUE) {
+		std::unique_lock hold(g_idle_lock);
+		auto it = g_idle_list.find(path);
+		if (it == g_idle_list.end() || it->second.size() == 0)
+			return -1;
+		auto conn = it->second.back();
+		it->second.pop_back();
+		hold.unlock();
+		if (cur_time - conn.last_time < FASTCGI_IDLE_TIMEOUT) {
+			/* the back-end has nothing to say on an idle connection, not even EOF */
+			pfd_read.fd = conn.sockd;
+			pfd_read.events = POLLIN|POLLPRI;
+			if (poll(&pfd_read, 1, 0) == 0)
+				return conn.sockd;
+		}
+		close(conn.sockd);
+	}
+}
+
+static void mod_fastcgi_put_idle(const char *path, int sockd) try
+{
+	auto cur_time = time(nullptr);
+	std::lock_guard hold(g_idle_lock);
+	auto &list = g_idle_list[path];
+	while (list.size() > 0 &&
+	    cur_time - list.front().last_time >= FASTCGI_IDLE_TIMEOUT) {
+		close(list.front().sockd);
+		list.erase(list.begin());
+	}
+	if (list.size() >= g_max_idle) {
+		close(sockd);
+		return;
+	}
+	list.push_back({sockd, cur_time});
+} catch (const std::bad_alloc &) {
+	close(sockd);
+}
+
 BOOL mod_fastcgi_get_context(HTTP_CONTEXT *phttp)
 {
 	BOOL b_index;
@@ -400,43 +451,31 @@ BOOL mod_fastcgi_get_context(HTTP_CONTEXT *phttp)
 	char suffix[16];
 	char domain[256];
 	char file_name[256];
-	char tmp_buff[8192];
 	char request_uri[8192];
 	uint64_t content_length;
 	
-	auto tmp_len = mem_file_get_total_length(&phttp->request.f_host);
-	if (tmp_len >= sizeof(domain)) {
+	auto &host = phttp->request.host;
+	if (host.size() >= sizeof(domain)) {
 		http_parser_log_info(phttp, 6, "length of "
 			"request host is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		gx_strlcpy(domain, phttp->connection.server_ip, GX_ARRAY_SIZE(domain));
-	} else {
-		mem_file_seek(&phttp->request.f_host,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_host, domain, tmp_len);
-		domain[tmp_len] = '\0';
-	}
+	gx_strlcpy(domain, host.size() == 0 ? phttp->connection.server_ip :
+	           host.data(), GX_ARRAY_SIZE(domain));
 	ptoken = strchr(domain, ':');
 	if (ptoken != nullptr)
 		*ptoken = '\0';
-	tmp_len = mem_file_get_total_length(
-		&phttp->request.f_request_uri);
-	if (0 == tmp_len) {
+	auto &uri = phttp->request.request_uri;
+	if (uri.size() == 0) {
 		http_parser_log_info(phttp, 6, "cannot "
 			"find request uri for mod_fastcgi");
 		return FALSE;
-	} else if (tmp_len >= sizeof(tmp_buff)) {
+	} else if (uri.size() >= sizeof(request_uri)) {
 		http_parser_log_info(phttp, 6, "length of "
 			"request uri is too long for mod_fastcgi");
 		return FALSE;
 	}
-	mem_file_seek(&phttp->request.f_request_uri,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_read(&phttp->request.f_request_uri, tmp_buff, tmp_len);
-	tmp_buff[tmp_len] = '\0';
-	if (FALSE == parse_uri(tmp_buff, request_uri)) {
+	if (FALSE == parse_uri(uri.data(), request_uri)) {
 		http_parser_log_info(phttp, 6, "request"
 			" uri format error for mod_fastcgi");
 		return FALSE;
@@ -451,8 +490,7 @@ BOOL mod_fastcgi_get_context(HTTP_CONTEXT *phttp)
 		ptoken1 = strchr(ptoken, '/');
 		if (ptoken1 != nullptr)
 			*ptoken1 = '\0';
-		tmp_len = strlen(ptoken);
-		if (tmp_len >= 16) {
+		if (strlen(ptoken) >= 16) {
 			http_parser_log_info(phttp, 6, "suffix in"
 				" request uri error for mod_fastcgi");
 			return FALSE;
@@ -475,50 +513,35 @@ BOOL mod_fastcgi_get_context(HTTP_CONTEXT *phttp)
 		return FALSE;
 	http_parser_log_info(phttp, 6, "http request \"%s\" "
 		"to \"%s\" will be relayed to fastcgi back-end %s",
-		tmp_buff, domain, pfnode->sock_path.c_str());
-	tmp_len = mem_file_get_total_length(&phttp->request.f_content_length);
-	if (0 == tmp_len) {
+		uri.data(), domain, pfnode->sock_path.c_str());
+	auto &cl = phttp->request.content_length;
+	if (cl.size() == 0) {
 		content_length = 0;
 	} else {
-		if (tmp_len >= 32) {
+		if (cl.size() >= 32) {
 			http_parser_log_info(phttp, 6, "length of "
 				"content-length is too long for mod_fastcgi");
 			return FALSE;
 		}
-		mem_file_seek(&phttp->request.f_content_length,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_content_length, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-		content_length = atoll(tmp_buff);
+		content_length = atoll(cl.data());
 	}
 	if (content_length > g_max_size) {
 		http_parser_log_info(phttp, 6, "content-length"
 			" is too long for mod_fastcgi");
 		return FALSE;
 	}
-	b_chunked = FALSE;
-	tmp_len = mem_file_get_total_length(&phttp->request.f_transfer_encoding);
-	if (tmp_len > 0 && tmp_len < 64) {
-		mem_file_seek(&phttp->request.f_transfer_encoding,
-				MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_transfer_encoding, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-		if (strcasecmp(tmp_buff, "chunked") == 0)
-			b_chunked = TRUE;
-	}
+	b_chunked = strcasecmp(phttp->request.transfer_encoding.data(),
+	            "chunked") == 0 ? TRUE : false;
 	auto pcontext = &g_context_list[phttp->context_id];
 	time(&pcontext->last_time);
 	pcontext->pfnode = pfnode;
-	if (TRUE == b_chunked || content_length > g_cache_size) {
-		snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "/tmp/http-%u", phttp->context_id);
-		pcontext->cache_fd = open(tmp_buff,
-			O_CREAT|O_TRUNC|O_RDWR, 0666);
-		if (pcontext->cache_fd == -1)
-			return FALSE;
-		pcontext->cache_size = 0;
-	} else {
-		pcontext->cache_fd = -1;
-	}
+	pcontext->cache_fd = -1;
+	pcontext->cache_size = 0;
+	pcontext->cache_alloc = 0;
+	pcontext->pcache = NULL;
+	pcontext->pout = nullptr;
+	pcontext->out_size = 0;
+	pcontext->out_alloc = 0;
 	pcontext->b_index = b_index;
 	pcontext->b_chunked = b_chunked;
 	if (TRUE == b_chunked) {
@@ -529,6 +552,7 @@ BOOL mod_fastcgi_get_context(HTTP_CONTEXT *phttp)
 	pcontext->content_length = content_length;
 	pcontext->cli_sockd = -1;
 	pcontext->b_header = FALSE;
+	pcontext->b_reusable = FALSE;
 	phttp->pfast_context = pcontext;
 	return TRUE;
 }
@@ -553,7 +577,6 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 	NDR_PUSH ndr_push;
 	char uri_path[8192];
 	char tmp_buff[8192];
-	struct stat node_stat;
 	
 	ndr_push_init(&ndr_push, pbuff, *plength,
 		NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
@@ -565,20 +588,14 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "USER_HOME", phttp->maildir));
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "USER_LANG", phttp->lang));
 	}
-	auto tmp_len = mem_file_get_total_length(&phttp->request.f_host);
-	if (tmp_len >= sizeof(domain)) {
+	auto &host = phttp->request.host;
+	if (host.size() >= sizeof(domain)) {
 		http_parser_log_info(phttp, 6, "length of "
 			"request host is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		gx_strlcpy(domain, phttp->connection.server_ip, GX_ARRAY_SIZE(domain));
-	} else {
-		mem_file_seek(&phttp->request.f_host,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_host, domain, tmp_len);
-		domain[tmp_len] = '\0';
-	}
+	gx_strlcpy(domain, host.size() == 0 ? phttp->connection.server_ip :
+	           host.data(), GX_ARRAY_SIZE(domain));
 	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_HOST", domain));
 	ptoken = strchr(domain, ':');
 	if (ptoken != nullptr)
@@ -593,25 +610,20 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 	snprintf(tmp_buff, arsizeof(tmp_buff), "HTTP/%s", phttp->request.version);
 	QRF(mod_fastcgi_push_name_value(&ndr_push, "SERVER_PROTOCOL", tmp_buff));
 	QRF(mod_fastcgi_push_name_value(&ndr_push, "REQUEST_METHOD", phttp->request.method));
-	tmp_len = mem_file_get_total_length(
-		&phttp->request.f_request_uri);
-	if (0 == tmp_len) {
+	auto &uri = phttp->request.request_uri;
+	if (uri.size() == 0) {
 		http_parser_log_info(phttp, 6, "cannot "
 			"find request uri for mod_fastcgi");
 		return FALSE;
-	} else if (tmp_len >= sizeof(tmp_buff)) {
+	} else if (uri.size() >= sizeof(tmp_buff)) {
 		http_parser_log_info(phttp, 6, "length of "
 			"request uri is too long for mod_fastcgi");
 		return FALSE;
 	}
-	mem_file_seek(&phttp->request.f_request_uri,
-		MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-	mem_file_read(&phttp->request.f_request_uri, tmp_buff, tmp_len);
-	tmp_buff[tmp_len] = '\0';
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "REQUEST_URI", tmp_buff));
-	ptoken = strchr(tmp_buff, '?');
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "QUERY_STRING", ptoken == nullptr ? "" : ++ptoken));
-	if (FALSE == parse_uri(tmp_buff, uri_path)) {
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "REQUEST_URI", uri.data()));
+	auto query = strchr(uri.data(), '?');
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "QUERY_STRING", query == nullptr ? "" : query + 1));
+	if (FALSE == parse_uri(uri.data(), uri_path)) {
 		http_parser_log_info(phttp, 6, "request"
 			" uri format error for mod_fastcgi");
 		return FALSE;
@@ -637,7 +649,7 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 		snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "%s/%s", pfnode->dir.c_str(), path_info);
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "PATH_TRANSLATED", tmp_buff));
 	}
-	tmp_len = pfnode->path.size();
+	auto tmp_len = pfnode->path.size();
 	if (TRUE == phttp->pfast_context->b_index) {
 		snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "%s%s", uri_path, pfnode->index.c_str());
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "SCRIPT_NAME", tmp_buff));
@@ -649,94 +661,43 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 		snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "%s%s", pfnode->dir.c_str(), uri_path + tmp_len);
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "SCRIPT_FILENAME", tmp_buff));
 	}
-	tmp_len = mem_file_get_total_length(&phttp->request.f_accept);
-	if (tmp_len > 1024) {
+	if (phttp->request.accept.size() > 1024) {
 		http_parser_log_info(phttp, 6, "length of "
 			"accept is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		tmp_buff[0] = '\0';
-	} else {
-		mem_file_seek(&phttp->request.f_accept,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_accept, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-	}
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_ACCEPT", tmp_buff));
-	tmp_len = mem_file_get_total_length(&phttp->request.f_user_agent);
-	if (tmp_len > 1024) {
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_ACCEPT", phttp->request.accept.data()));
+	if (phttp->request.user_agent.size() > 1024) {
 		http_parser_log_info(phttp, 6, "length of "
 			"user-agent is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		tmp_buff[0] = '\0';
-	} else {
-		mem_file_seek(&phttp->request.f_user_agent,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_user_agent, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-	}
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_USER_AGENT", tmp_buff));
-	tmp_len = mem_file_get_total_length(&phttp->request.f_accept_language);
-	if (tmp_len > 1024) {
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_USER_AGENT", phttp->request.user_agent.data()));
+	if (phttp->request.accept_language.size() > 1024) {
 		http_parser_log_info(phttp, 6, "length of "
 			"accept-language is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		tmp_buff[0] = '\0';
-	} else {
-		mem_file_seek(&phttp->request.f_accept_language,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_accept_language, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-	}
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_ACCEPT_LANGUAGE", tmp_buff));
-	tmp_len = mem_file_get_total_length(&phttp->request.f_accept_encoding);
-	if (tmp_len > 1024) {
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_ACCEPT_LANGUAGE", phttp->request.accept_language.data()));
+	if (phttp->request.accept_encoding.size() > 1024) {
 		http_parser_log_info(phttp, 6, "length of "
 			"accept-encoding is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		tmp_buff[0] = '\0';
-	} else {
-		mem_file_seek(&phttp->request.f_accept_encoding,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_accept_encoding, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-	}
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_ACCEPT_ENCODING", tmp_buff));
-	tmp_len = mem_file_get_total_length(&phttp->request.f_cookie);
-	if (tmp_len > 1024) {
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_ACCEPT_ENCODING", phttp->request.accept_encoding.data()));
+	if (phttp->request.cookie.size() > 1024) {
 		http_parser_log_info(phttp, 6, "length of "
 			"cookie is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 != tmp_len) {
-		mem_file_seek(&phttp->request.f_cookie,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_cookie, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_COOKIE", tmp_buff));
-	}
-	tmp_len = mem_file_get_total_length(&phttp->request.f_content_type);
-	if (tmp_len > 128) {
+	if (phttp->request.cookie.size() > 0)
+		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_COOKIE", phttp->request.cookie.data()));
+	if (phttp->request.content_type.size() > 128) {
 		http_parser_log_info(phttp, 6, "length of "
 			"content-type is too long for mod_fastcgi");
 		return FALSE;
 	}
-	if (0 == tmp_len) {
-		tmp_buff[0] = '\0';
-	} else {
-		mem_file_seek(&phttp->request.f_content_type,
-			MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
-		mem_file_read(&phttp->request.f_content_type, tmp_buff, tmp_len);
-		tmp_buff[tmp_len] = '\0';
-	}
-	QRF(mod_fastcgi_push_name_value(&ndr_push, "CONTENT_TYPE", tmp_buff));
+	QRF(mod_fastcgi_push_name_value(&ndr_push, "CONTENT_TYPE", phttp->request.content_type.data()));
 	if (NULL != phttp->connection.ssl) {
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "REQUEST_SCHEME", "https"));
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTPS", "on"));
@@ -747,26 +708,26 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_CONNECTION", "close"));
 	else
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_CONNECTION", "keep-alive"));
-	if (mod_fastcgi_get_others_field(&phttp->request.f_others, "Referer",
-	    tmp_buff, arsizeof(tmp_buff)))
-		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_REFERER", tmp_buff));
-	if (mod_fastcgi_get_others_field(&phttp->request.f_others, "Cache-Control",
-	    tmp_buff, arsizeof(tmp_buff)))
-		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_CACHE_CONTROL", tmp_buff));
-	for (const auto &hdr : pfnode->header_list)
-		if (mod_fastcgi_get_others_field(&phttp->request.f_others,
-		    hdr.c_str(), tmp_buff, GX_ARRAY_SIZE(tmp_buff)))
+	auto value = phttp->request.field("Referer");
+	if (value.size() > 0)
+		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_REFERER", value.data()));
+	value = phttp->request.field("Cache-Control");
+	if (value.size() > 0)
+		QRF(mod_fastcgi_push_name_value(&ndr_push, "HTTP_CACHE_CONTROL", value.data()));
+	for (const auto &hdr : pfnode->header_list) {
+		value = phttp->request.field(hdr.c_str());
+		if (value.size() > 0)
 			QRF(mod_fastcgi_push_name_value(&ndr_push,
-			    hdr.c_str(), tmp_buff));
+			    hdr.c_str(), value.data()));
+	}
 	if (FALSE == phttp->pfast_context->b_chunked) {
 		snprintf(tmp_buff, sizeof(tmp_buff), "%llu",
 		         static_cast<unsigned long long>(phttp->pfast_context->content_length));
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "CONTENT_LENGTH", tmp_buff));
 	} else {
-		if (fstat(phttp->pfast_context->cache_fd, &node_stat) != 0)
-			return FALSE;
+		/* the chunked body has been collected completely by now */
 		snprintf(tmp_buff, sizeof(tmp_buff), "%llu",
-		         static_cast<unsigned long long>(node_stat.st_size));
+		         static_cast<unsigned long long>(phttp->pfast_context->cache_size));
 		QRF(mod_fastcgi_push_name_value(&ndr_push, "CONTENT_LENGTH", tmp_buff));
 	}
 	QRF(mod_fastcgi_push_params_end(&ndr_push));
@@ -774,156 +735,279 @@ static BOOL mod_fastcgi_build_params(HTTP_CONTEXT *phttp,
 	return TRUE;
 }
 
-BOOL mod_fastcgi_relay_content(HTTP_CONTEXT *phttp)
+/* grow *pbuff to at least @need bytes (doubling, but not beyond @limit) */
+static BOOL mod_fastcgi_reserve(char **pbuff, uint64_t *palloc,
+    uint64_t need, uint64_t limit)
 {
-	void *pbuff;
-	int cli_sockd;
+	if (need <= *palloc)
+		return TRUE;
+	uint64_t size = std::max(*palloc, static_cast<uint64_t>(STREAM_BLOCK_SIZE));
+	while (size < need)
+		size *= 2;
+	size = std::max(std::min(size, limit), need);
+	auto pnew = static_cast<char *>(realloc(*pbuff, size));
+	if (NULL == pnew)
+		return FALSE;
+	*pbuff = pnew;
+	*palloc = size;
+	return TRUE;
+}
+
+/* write out as much of pout as the back-end takes without blocking */
+static BOOL mod_fastcgi_flush(FASTCGI_CONTEXT *pfast_context)
+{
+	uint64_t offset = 0;
+	
+	while (offset < pfast_context->out_size) {
+		auto ret = write(pfast_context->cli_sockd,
+		           pfast_context->pout + offset,
+		           pfast_context->out_size - offset);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (ret <= 0)
+			return FALSE;
+		offset += ret;
+	}
+	if (offset > 0) {
+		memmove(pfast_context->pout, pfast_context->pout + offset,
+			pfast_context->out_size - offset);
+		pfast_context->out_size -= offset;
+	}
+	return TRUE;
+}
+
+/*
+ * Pass @length bytes to the back-end. The socket is non-blocking; whatever
+ * it does not take right away is queued in pout and is sent by later calls
+ * or by mod_fastcgi_check_response. Only when more than fastcgi_cache_size
+ * is queued does the worker wait for the back-end to catch up.
+ */
+static BOOL mod_fastcgi_send(FASTCGI_CONTEXT *pfast_context,
+    const void *pbuff, size_t length)
+{
+	struct pollfd pfd_write;
+	
+	if (!mod_fastcgi_flush(pfast_context))
+		return FALSE;
+	if (0 == pfast_context->out_size) {
+		auto ret = write(pfast_context->cli_sockd, pbuff, length);
+		if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			return FALSE;
+		if (ret > 0) {
+			pbuff = static_cast<const char *>(pbuff) + ret;
+			length -= ret;
+		}
+		if (0 == length)
+			return TRUE;
+	}
+	if (!mod_fastcgi_reserve(&pfast_context->pout, &pfast_context->out_alloc,
+	    pfast_context->out_size + length, UINT64_MAX))
+		return FALSE;
+	memcpy(pfast_context->pout + pfast_context->out_size, pbuff, length);
+	pfast_context->out_size += length;
+	while (pfast_context->out_size > g_cache_size) {
+		pfd_write.fd = pfast_context->cli_sockd;
+		pfd_write.events = POLLOUT;
+		if (poll(&pfd_write, 1, SOCKET_TIMEOUT * 1000) != 1 ||
+		    !mod_fastcgi_flush(pfast_context))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Connect to the back-end (reusing a pooled connection if there is one)
+ * and send BEGIN_REQUEST and the PARAMS stream.
+ */
+static BOOL mod_fastcgi_begin_backend(HTTP_CONTEXT *phttp)
+{
+	int sockd;
 	int ndr_length;
 	NDR_PUSH ndr_push;
-	char tmp_path[256];
-	char tmp_buff[65535];
+	uint8_t begin_buff[16];
+	uint8_t end_buff[8];
 	uint8_t ndr_buff[65800];
+	auto pfast_context = phttp->pfast_context;
+	auto sock_path = pfast_context->pfnode->sock_path.c_str();
 	
-	ndr_push_init(&ndr_push, tmp_buff, 16,
+	ndr_push_init(&ndr_push, begin_buff, 16,
 		NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
-	if (mod_fastcgi_push_begin_request(&ndr_push) != NDR_ERR_SUCCESS ||
-	    ndr_push.offset != 16)
+	if (mod_fastcgi_push_begin_request(&ndr_push, g_max_idle > 0 ?
+	    FCGI_KEEP_CONN : 0) != NDR_ERR_SUCCESS || ndr_push.offset != 16)
 		return FALSE;
 	ndr_length = sizeof(ndr_buff);
 	if (!mod_fastcgi_build_params(phttp, ndr_buff, &ndr_length))
-		return FALSE;	
-	cli_sockd = mod_fastcgi_connect_backend(phttp->pfast_context->pfnode->sock_path.c_str());
-	if (cli_sockd < 0) {
-		http_parser_log_info(phttp, 6, "fail to "
-				"connect to fastcgi back-end %s",
-				phttp->pfast_context->pfnode->sock_path.c_str());
-		return FALSE;
-	}
-	if (16 != write(cli_sockd, tmp_buff, 16) ||
-		ndr_length != write(cli_sockd, ndr_buff,
-		ndr_length)) {
-		close(cli_sockd);
-		http_parser_log_info(phttp, 6, "fail to "
-			"write record to fastcgi back-end %s",
-			phttp->pfast_context->pfnode->sock_path.c_str());
 		return FALSE;
-	}
-	ndr_push_init(&ndr_push, tmp_buff, 8,
+	ndr_push_init(&ndr_push, end_buff, 8,
 		NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
 	if (NDR_ERR_SUCCESS != mod_fastcgi_push_params_begin(&ndr_push) ||
 		NDR_ERR_SUCCESS != mod_fastcgi_push_params_end(&ndr_push) ||
-		8 != ndr_push.offset || 8 != write(cli_sockd, tmp_buff, 8)) {
-		close(cli_sockd);
+		8 != ndr_push.offset)
+		return FALSE;
+	auto send_head = [&](int fd) {
+		pfast_context->cli_sockd = fd;
+		pfast_context->out_size = 0;
+		if (mod_fastcgi_send(pfast_context, begin_buff, 16) &&
+		    mod_fastcgi_send(pfast_context, ndr_buff, ndr_length) &&
+		    mod_fastcgi_send(pfast_context, end_buff, 8))
+			return true;
+		pfast_context->cli_sockd = -1;
+		return false;
+	};
+	sockd = mod_fastcgi_take_idle(sock_path);
+	if (sockd >= 0) {
+		if (send_head(sockd))
+			return TRUE;
+		/* closed by the back-end meanwhile; nothing is lost yet */
+		close(sockd);
+	}
+	sockd = mod_fastcgi_connect_backend(sock_path);
+	if (sockd < 0) {
 		http_parser_log_info(phttp, 6, "fail to "
-			"write record to fastcgi back-end %s",
-			phttp->pfast_context->pfnode->sock_path.c_str());
+				"connect to fastcgi back-end %s", sock_path);
 		return FALSE;
 	}
-	if (-1 == phttp->pfast_context->cache_fd) {
-		if (phttp->pfast_context->content_length == 0)
-			goto END_OF_STDIN;
-		unsigned int tmp_len = sizeof(tmp_buff);
-		while ((pbuff = stream_getbuffer_for_reading(&phttp->stream_in, &tmp_len)) != nullptr) {
-			if (tmp_len > phttp->pfast_context->content_length) {
-				stream_backward_reading_ptr(&phttp->stream_in,
-					tmp_len - phttp->pfast_context->content_length);
-				tmp_len = phttp->pfast_context->content_length;
-				phttp->pfast_context->content_length = 0;
-			} else{
-				phttp->pfast_context->content_length -= tmp_len;
-			}
-			ndr_push_init(&ndr_push, ndr_buff, sizeof(ndr_buff),
-						NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
-			if (NDR_ERR_SUCCESS != mod_fastcgi_push_stdin(
-				&ndr_push, pbuff, tmp_len)) {
-				close(cli_sockd);
-				http_parser_log_info(phttp, 6, "fail to "
-					"push stdin record for mod_fastcgi");
-				return FALSE;
-			}
-			if (ndr_push.offset != write(cli_sockd,
-				ndr_buff, ndr_push.offset)) {
-				close(cli_sockd);
-				http_parser_log_info(phttp, 6, "fail to "
-					"write record to fastcgi back-end %s",
-					phttp->pfast_context->pfnode->sock_path.c_str());
-				return FALSE;
-			}
-			if (phttp->pfast_context->content_length == 0)
-				break;
-			tmp_len = sizeof(tmp_buff);
-		}
-	} else {
-		lseek(phttp->pfast_context->cache_fd, 0, SEEK_SET);
-		while (TRUE) {
-			auto tmp_len = read(phttp->pfast_context->cache_fd,
-				tmp_buff, sizeof(tmp_buff));
-			if (tmp_len < 0) {
-				close(cli_sockd);
-				http_parser_log_info(phttp, 6, "fail to"
-					" read cache file for mod_fastcgi");
-				return FALSE;
-			} else if (0 == tmp_len) {
-				close(phttp->pfast_context->cache_fd);
-				phttp->pfast_context->cache_fd = -1;
-				snprintf(tmp_path, GX_ARRAY_SIZE(tmp_path), "/tmp/http-%u", phttp->context_id);
-				if (remove(tmp_path) < 0 && errno != ENOENT)
-					fprintf(stderr, "W-1362: remove %s: %s\n", tmp_path, strerror(errno));
-				break;
-			}
-			ndr_push_init(&ndr_push, ndr_buff, sizeof(ndr_buff),
-						NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
-			if (NDR_ERR_SUCCESS != mod_fastcgi_push_stdin(
-				&ndr_push, tmp_buff, tmp_len)) {
-				close(cli_sockd);
-				http_parser_log_info(phttp, 6, "fail to "
-					"push stdin record for mod_fastcgi");
-				return FALSE;
-			}
-			if (ndr_push.offset != write(cli_sockd,
-				ndr_buff, ndr_push.offset)) {
-				close(cli_sockd);
-				http_parser_log_info(phttp, 6, "fail to "
-					"write record to fastcgi back-end %s",
-					phttp->pfast_context->pfnode->sock_path.c_str());
-				return FALSE;
-			}
-		}
+	if (!send_head(sockd)) {
+		close(sockd);
+		http_parser_log_info(phttp, 6, "fail to "
+			"write record to fastcgi back-end %s", sock_path);
+		return FALSE;
 	}
- END_OF_STDIN:
+	return TRUE;
+}
+
+static BOOL mod_fastcgi_write_stdin(HTTP_CONTEXT *phttp,
+    const void *pbuff, uint16_t length)
+{
+	NDR_PUSH ndr_push;
+	uint8_t ndr_buff[65800];
+	
 	ndr_push_init(&ndr_push, ndr_buff, sizeof(ndr_buff),
 				NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
 	if (NDR_ERR_SUCCESS != mod_fastcgi_push_stdin(
-		&ndr_push, NULL, 0)) {
-		close(cli_sockd);
-		http_parser_log_info(phttp, 6, "fail to push "
-			"last empty stdin record for mod_fastcgi");
+		&ndr_push, pbuff, length)) {
+		http_parser_log_info(phttp, 6, "fail to "
+			"push stdin record for mod_fastcgi");
 		return FALSE;
 	}
-	if (ndr_push.offset != write(cli_sockd,
-		ndr_buff, ndr_push.offset)) {
-		close(cli_sockd);
-		http_parser_log_info(phttp, 6, "fail to write"
-			" last empty stdin to fastcgi back-end %s",
+	if (!mod_fastcgi_send(phttp->pfast_context, ndr_buff, ndr_push.offset)) {
+		http_parser_log_info(phttp, 6, "fail to "
+			"write record to fastcgi back-end %s",
 			phttp->pfast_context->pfnode->sock_path.c_str());
 		return FALSE;
 	}
-	phttp->pfast_context->cli_sockd = cli_sockd;
 	return TRUE;
 }
 
+/*
+ * Collect decoded chunked content. Up to g_cache_size is kept in memory;
+ * bodies beyond that go to /tmp/http-<context_id>.
+ */
+static BOOL mod_fastcgi_spool(HTTP_CONTEXT *phttp,
+    const void *pbuff, size_t length)
+{
+	char tmp_path[256];
+	auto pfast_context = phttp->pfast_context;
+	
+	if (-1 == pfast_context->cache_fd &&
+		pfast_context->cache_size + length <= g_cache_size) {
+		if (!mod_fastcgi_reserve(&pfast_context->pcache,
+		    &pfast_context->cache_alloc,
+		    pfast_context->cache_size + length, g_cache_size))
+			return FALSE;
+		memcpy(pfast_context->pcache + pfast_context->cache_size,
+			pbuff, length);
+		pfast_context->cache_size += length;
+		return TRUE;
+	}
+	if (-1 == pfast_context->cache_fd) {
+		snprintf(tmp_path, GX_ARRAY_SIZE(tmp_path), "/tmp/http-%u", phttp->context_id);
+		pfast_context->cache_fd = open(tmp_path,
+			O_CREAT|O_TRUNC|O_RDWR, 0666);
+		if (-1 == pfast_context->cache_fd)
+			return FALSE;
+		if (pfast_context->cache_size > 0 &&
+		    write(pfast_context->cache_fd, pfast_context->pcache,
+		    pfast_context->cache_size) != static_cast<ssize_t>(pfast_context->cache_size))
+			return FALSE;
+		free(pfast_context->pcache);
+		pfast_context->pcache = NULL;
+		pfast_context->cache_alloc = 0;
+	}
+	if (write(pfast_context->cache_fd, pbuff, length) !=
+	    static_cast<ssize_t>(length))
+		return FALSE;
+	pfast_context->cache_size += length;
+	return TRUE;
+}
+
+BOOL mod_fastcgi_relay_content(HTTP_CONTEXT *phttp)
+{
+	char tmp_path[256];
+	char tmp_buff[65535];
+	auto pfast_context = phttp->pfast_context;
+	
+	if (FALSE == pfast_context->b_chunked)
+		/* params and content went out while the body was being read */
+		return mod_fastcgi_write_stdin(phttp, NULL, 0);
+	if (!mod_fastcgi_begin_backend(phttp))
+		return FALSE;
+	if (-1 == pfast_context->cache_fd) {
+		for (uint64_t offset = 0; offset < pfast_context->cache_size; ) {
+			uint16_t tmp_len = std::min(pfast_context->cache_size - offset,
+			                   static_cast<uint64_t>(sizeof(tmp_buff)));
+			if (!mod_fastcgi_write_stdin(phttp,
+			    pfast_context->pcache + offset, tmp_len))
+				return FALSE;
+			offset += tmp_len;
+		}
+		return mod_fastcgi_write_stdin(phttp, NULL, 0);
+	}
+	lseek(pfast_context->cache_fd, 0, SEEK_SET);
+	while (TRUE) {
+		auto tmp_len = read(pfast_context->cache_fd,
+			tmp_buff, sizeof(tmp_buff));
+		if (tmp_len < 0) {
+			http_parser_log_info(phttp, 6, "fail to"
+				" read cache file for mod_fastcgi");
+			return FALSE;
+		} else if (0 == tmp_len) {
+			close(pfast_context->cache_fd);
+			pfast_context->cache_fd = -1;
+			snprintf(tmp_path, GX_ARRAY_SIZE(tmp_path), "/tmp/http-%u", phttp->context_id);
+			if (remove(tmp_path) < 0 && errno != ENOENT)
+				fprintf(stderr, "W-1362: remove %s: %s\n", tmp_path, strerror(errno));
+			break;
+		}
+		if (!mod_fastcgi_write_stdin(phttp, tmp_buff, tmp_len))
+			return FALSE;
+	}
+	return mod_fastcgi_write_stdin(phttp, NULL, 0);
+}
+
 void mod_fastcgi_put_context(HTTP_CONTEXT *phttp)
 {
 	char tmp_path[256];
+	auto pfast_context = phttp->pfast_context;
 	
-	if (-1 != phttp->pfast_context->cache_fd) {
-		close(phttp->pfast_context->cache_fd);
+	if (-1 != pfast_context->cache_fd) {
+		close(pfast_context->cache_fd);
 		snprintf(tmp_path, GX_ARRAY_SIZE(tmp_path), "/tmp/http-%u", phttp->context_id);
 		if (remove(tmp_path) < 0 && errno != ENOENT)
 			fprintf(stderr, "W-1361: remove %s: %s\n", tmp_path, strerror(errno));
 	}
-	if (phttp->pfast_context->cli_sockd != -1)
-		close(phttp->pfast_context->cli_sockd);
+	free(pfast_context->pcache);
+	pfast_context->pcache = NULL;
+	/* a back-end may answer before it has read all of the body */
+	free(pfast_context->pout);
+	pfast_context->pout = nullptr;
+	if (pfast_context->cli_sockd != -1) {
+		if (pfast_context->b_reusable && pfast_context->out_size == 0)
+			mod_fastcgi_put_idle(pfast_context->pfnode->sock_path.c_str(),
+				pfast_context->cli_sockd);
+		else
+			close(pfast_context->cli_sockd);
+	}
 	phttp->pfast_context = NULL;
 }
 
@@ -934,121 +1018,89 @@ BOOL mod_fastcgi_write_request(HTTP_CONTEXT *phttp)
 	void *pbuff;
 	char *ptoken;
 	char tmp_buff[1024];
+	auto pfast_context = phttp->pfast_context;
 	
-	if (phttp->pfast_context->b_end)
-		return TRUE;
-	if (-1 == phttp->pfast_context->cache_fd) {
-		if (phttp->pfast_context->content_length <=
-		    stream_get_total_length(&phttp->stream_in))
-			phttp->pfast_context->b_end = TRUE;	
+	if (pfast_context->b_end)
 		return TRUE;
-	}
-	if (FALSE == phttp->pfast_context->b_chunked) {
-		if (phttp->pfast_context->cache_size +
-		    stream_get_total_length(&phttp->stream_in) <
-		    phttp->pfast_context->content_length &&
-		    stream_get_total_length(&phttp->stream_in) < g_cache_size)
-			return TRUE;	
-		size = STREAM_BLOCK_SIZE;
-		while ((pbuff = stream_getbuffer_for_reading(&phttp->stream_in,
-		    reinterpret_cast<unsigned int *>(&size))) != nullptr) {
-			if (phttp->pfast_context->cache_size + size >
-				phttp->pfast_context->content_length) {
-				tmp_len = phttp->pfast_context->content_length
-							- phttp->pfast_context->cache_size;
-				stream_backward_reading_ptr(
-					&phttp->stream_in, size - tmp_len);
-				phttp->pfast_context->cache_size =
-					phttp->pfast_context->content_length;
-			} else {
-				phttp->pfast_context->cache_size += size;
-				tmp_len = size;
+	if (FALSE == pfast_context->b_chunked) {
+		/* forward whatever has arrived; stream_in is the only buffer */
+		if (-1 == pfast_context->cli_sockd &&
+		    !mod_fastcgi_begin_backend(phttp))
+			return FALSE;
+		unsigned int length = 0xFFFF;
+		while (pfast_context->content_length > 0 &&
+		    (pbuff = stream_getbuffer_for_reading(&phttp->stream_in,
+		    &length)) != nullptr) {
+			if (length > pfast_context->content_length) {
+				stream_backward_reading_ptr(&phttp->stream_in,
+					length - pfast_context->content_length);
+				length = pfast_context->content_length;
 			}
-			if (tmp_len != write(phttp->pfast_context->cache_fd,
-				pbuff, tmp_len)) {
-				http_parser_log_info(phttp, 6, "fail to"
-					" write cache file for mod_fastcgi");
+			pfast_context->content_length -= length;
+			if (!mod_fastcgi_write_stdin(phttp, pbuff, length))
 				return FALSE;
-			}
-			if (phttp->pfast_context->cache_size ==
-				phttp->pfast_context->content_length) {
-				phttp->pfast_context->b_end = TRUE;
-				return TRUE;
-			}
-			size = STREAM_BLOCK_SIZE;
+			length = 0xFFFF;
 		}
-	} else {
+		if (0 == pfast_context->content_length) {
+			pfast_context->b_end = TRUE;
+			return TRUE;
+		}
+		stream_clear(&phttp->stream_in);
+		return TRUE;
+	}
  CHUNK_BEGIN:
-		if (phttp->pfast_context->chunk_size ==
-			phttp->pfast_context->chunk_offset) {
-			size = stream_peek_buffer(&phttp->stream_in,
-										tmp_buff, 1024);
-			if (size < 5)
-				return TRUE;
-			if (0 == strncmp("0\r\n\r\n", tmp_buff, 5)) {
-				stream_forward_reading_ptr(&phttp->stream_in, 5);
-				phttp->pfast_context->b_end = TRUE;
-				return TRUE;
-			}
-			ptoken = static_cast<char *>(memmem(tmp_buff, size, "\r\n", 2));
-			if (NULL == ptoken) {
-				if (1024 == size) {
-					http_parser_log_info(phttp, 6, "fail to "
-						"parse chunked block for mod_fastcgi");
-					return FALSE;
-				}
-				return TRUE;
-			}
-			*ptoken = '\0';
-			phttp->pfast_context->chunk_size =
-					strtol(tmp_buff, NULL, 16);
-			if (0 == phttp->pfast_context->chunk_size) {
+	if (pfast_context->chunk_size == pfast_context->chunk_offset) {
+		size = stream_peek_buffer(&phttp->stream_in, tmp_buff, 1024);
+		if (size < 5)
+			return TRUE;
+		if (0 == strncmp("0\r\n\r\n", tmp_buff, 5)) {
+			stream_forward_reading_ptr(&phttp->stream_in, 5);
+			pfast_context->b_end = TRUE;
+			return TRUE;
+		}
+		ptoken = static_cast<char *>(memmem(tmp_buff, size, "\r\n", 2));
+		if (NULL == ptoken) {
+			if (1024 == size) {
 				http_parser_log_info(phttp, 6, "fail to "
 					"parse chunked block for mod_fastcgi");
 				return FALSE;
 			}
-			phttp->pfast_context->chunk_offset = 0;
-			tmp_len = ptoken + 2 - tmp_buff;
-			stream_forward_reading_ptr(
-				&phttp->stream_in, tmp_len);
+			return TRUE;
 		}
-		size = STREAM_BLOCK_SIZE;
-		while ((pbuff = stream_getbuffer_for_reading(&phttp->stream_in,
-		    reinterpret_cast<unsigned int *>(&size))) != nullptr) {
-			if (phttp->pfast_context->chunk_size >=
-				size + phttp->pfast_context->chunk_offset) {
-				if (size != write(phttp->pfast_context->cache_fd,
-					pbuff, size)) {
-					http_parser_log_info(phttp, 6, "fail to"
-						" write cache file for mod_fastcgi");
-					return FALSE;
-				}
-				phttp->pfast_context->chunk_offset += size;
-				phttp->pfast_context->cache_size += size;
-			} else {
-				tmp_len = phttp->pfast_context->chunk_size
-					- phttp->pfast_context->chunk_offset;
-				if (tmp_len != write(phttp->pfast_context->cache_fd,
-					pbuff, tmp_len)) {
-					http_parser_log_info(phttp, 6, "fail to"
-						" write cache file for mod_fastcgi");
-					return FALSE;
-				}
-				stream_backward_reading_ptr(
-					&phttp->stream_in, size - tmp_len);
-				phttp->pfast_context->cache_size += tmp_len;
-				phttp->pfast_context->chunk_offset =
-					phttp->pfast_context->chunk_size;
-			}
-			if (phttp->pfast_context->cache_size > g_max_size) {
-				http_parser_log_info(phttp, 6, "chunked content"
-						" length is too long for mod_fastcgi");
-				return FALSE;
-			}
-			if (phttp->pfast_context->chunk_offset ==
-			    phttp->pfast_context->chunk_size)
-				goto CHUNK_BEGIN;	
+		*ptoken = '\0';
+		pfast_context->chunk_size = strtol(tmp_buff, NULL, 16);
+		if (0 == pfast_context->chunk_size) {
+			http_parser_log_info(phttp, 6, "fail to "
+				"parse chunked block for mod_fastcgi");
+			return FALSE;
 		}
+		pfast_context->chunk_offset = 0;
+		tmp_len = ptoken + 2 - tmp_buff;
+		stream_forward_reading_ptr(&phttp->stream_in, tmp_len);
+	}
+	size = STREAM_BLOCK_SIZE;
+	while ((pbuff = stream_getbuffer_for_reading(&phttp->stream_in,
+	    reinterpret_cast<unsigned int *>(&size))) != nullptr) {
+		if (pfast_context->chunk_size >= size + pfast_context->chunk_offset) {
+			tmp_len = size;
+		} else {
+			tmp_len = pfast_context->chunk_size - pfast_context->chunk_offset;
+			stream_backward_reading_ptr(&phttp->stream_in, size - tmp_len);
+		}
+		if (pfast_context->cache_size + tmp_len > g_max_size) {
+			http_parser_log_info(phttp, 6, "chunked content"
+					" length is too long for mod_fastcgi");
+			return FALSE;
+		}
+		if (!mod_fastcgi_spool(phttp, pbuff, tmp_len)) {
+			http_parser_log_info(phttp, 6, "fail to"
+				" write cache file for mod_fastcgi");
+			return FALSE;
+		}
+		pfast_context->chunk_offset += tmp_len;
+		if (pfast_context->chunk_offset == pfast_context->chunk_size)
+			goto CHUNK_BEGIN;
+		size = STREAM_BLOCK_SIZE;
 	}
 	stream_clear(&phttp->stream_in);
 	return TRUE;
@@ -1094,11 +1146,24 @@ int mod_fastcgi_check_response(HTTP_CONTEXT *phttp)
 			(g_unavailable_times / context_num);
 	if (tv_msec > 999)
 		tv_msec = 999;
-	pfd_read.fd = phttp->pfast_context->cli_sockd;
+	auto pfast_context = phttp->pfast_context;
+	pfd_read.fd = pfast_context->cli_sockd;
 	pfd_read.events = POLLIN|POLLPRI;
+	if (pfast_context->out_size > 0)
+		pfd_read.events |= POLLOUT;
 	if (1 == poll(&pfd_read, 1, tv_msec)) {
-		g_unavailable_times = 0;
-		return RESPONSE_AVAILABLE;
+		if (pfd_read.revents & (POLLIN | POLLPRI) ||
+		    (pfd_read.revents & (POLLHUP | POLLERR) &&
+		    pfast_context->out_size == 0)) {
+			g_unavailable_times = 0;
+			return RESPONSE_AVAILABLE;
+		}
+		if (!mod_fastcgi_flush(pfast_context)) {
+			http_parser_log_info(phttp, 6, "fail to write record "
+				"to fastcgi back-end %s",
+				pfast_context->pfnode->sock_path.c_str());
+			return RESPONSE_ERROR;
+		}
 	}
 	g_unavailable_times ++;
 	if (time(nullptr) - phttp->pfast_context->last_time > g_exec_timeout)
@@ -1166,15 +1231,20 @@ BOOL mod_fastcgi_read_response(HTTP_CONTEXT *phttp)
 			ndr_pull_init(&ndr_pull, tmp_buff, tmp_len,
 				NDR_FLAG_NOALIGN|NDR_FLAG_BIGENDIAN);
 			if (mod_fastcgi_pull_end_request(&ndr_pull,
-			    header.padding_len, &end_request) != NDR_ERR_SUCCESS)
+			    header.padding_len, &end_request) != NDR_ERR_SUCCESS) {
 				http_parser_log_info(phttp, 6, "fail to"
 					" pull record body in mod_fastcgi");
-			else
+			} else {
 				http_parser_log_info(phttp, 6, "app_status %u, "
 						"protocol_status %d from fastcgi back-end"
 						" %s", end_request.app_status,
 						(int)end_request.protocol_status,
 						phttp->pfast_context->pfnode->sock_path.c_str());
+				/* the connection is at a record boundary again */
+				if (g_max_idle > 0 && end_request.protocol_status ==
+				    PROTOCOL_STATUS_REQUEST_COMPLETE)
+					phttp->pfast_context->b_reusable = TRUE;
+			}
 			if (phttp->pfast_context->b_header &&
 			    phttp->pfast_context->b_chunked)
 				stream_write(&phttp->stream_out, "0\r\n\r\n", 5);
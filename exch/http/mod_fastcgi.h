@@ -5,6 +5,7 @@
 #define RESPONSE_TIMEOUT				-1
 #define RESPONSE_WAITING				0
 #define RESPONSE_AVAILABLE				1
+#define RESPONSE_ERROR					-2
 
 struct FASTCGI_NODE;
 
@@ -17,15 +18,20 @@ struct FASTCGI_CONTEXT {
 	uint64_t content_length;
 	const FASTCGI_NODE *pfnode;
 	int cache_fd;
-	uint64_t cache_size;
+	uint64_t cache_size; /* chunked body bytes in pcache or cache_fd */
+	uint64_t cache_alloc; /* bytes allocated at pcache */
+	char *pcache;
+	char *pout; /* records the back-end socket has not taken yet */
+	uint64_t out_size, out_alloc;
 	int cli_sockd;
 	BOOL b_header; /* is response header met */
+	BOOL b_reusable; /* END_REQUEST seen, cli_sockd may be kept */
 	time_t last_time;
 };
 
 struct HTTP_CONTEXT;
 
-extern void mod_fastcgi_init(int context_num, uint64_t cache_size, uint64_t max_size, int exec_timeout);
+extern void mod_fastcgi_init(int context_num, uint64_t cache_size, uint64_t max_size, int exec_timeout, unsigned int max_idle);
 extern int mod_fastcgi_run();
 extern void mod_fastcgi_stop();
 BOOL mod_fastcgi_get_context(HTTP_CONTEXT *phttp);
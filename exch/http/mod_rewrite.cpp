@@ -238,7 +238,7 @@ int mod_rewrite_run(const char *sdlist) try
 }
 
 BOOL mod_rewrite_process(const char *uri_buff, size_t uri_len,
-    MEM_FILE *pf_request_uri)
+    MEM_ARENA *parena, std::string_view *puri)
 {
 	char tmp_buff[8192];
 	
@@ -250,7 +250,12 @@ BOOL mod_rewrite_process(const char *uri_buff, size_t uri_len,
 		tmp_buff[uri_len] = '\0';
 		if (mod_rewrite_rreplace(tmp_buff, sizeof(tmp_buff),
 		    &node.search_pattern, node.replace_string.c_str())) {
-			mem_file_write(pf_request_uri, tmp_buff, strlen(tmp_buff));
+			auto len = strlen(tmp_buff);
+			auto uri = static_cast<char *>(mem_arena_alloc(parena, len + 1));
+			if (uri == nullptr)
+				return FALSE;
+			memcpy(uri, tmp_buff, len + 1);
+			*puri = std::string_view(uri, len);
 			return TRUE;
 		}
 	}
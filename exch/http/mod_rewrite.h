@@ -1,6 +1,7 @@
 #pragma once
+#include <string_view>
 #include <gromox/common_types.hpp>
-#include <gromox/mem_file.hpp>
+#include <gromox/mem_arena.hpp>
 
 extern int mod_rewrite_run(const char *sdlist);
-extern BOOL mod_rewrite_process(const char *, size_t, MEM_FILE *);
+extern BOOL mod_rewrite_process(const char *, size_t, MEM_ARENA *, std::string_view *);
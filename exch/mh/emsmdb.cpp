@@ -512,11 +512,8 @@ static void produce_session(const char *tag, char *session)
  */
 MhEmsmdbPlugin::ProcRes MhEmsmdbPlugin::loadCookies(MhEmsmdbContext& ctx)
 {
-	char tmp_buff[1024];
-	size_t tmp_len = mem_file_read(&ctx.orig.f_cookie, tmp_buff, arsizeof(tmp_buff) - 1);
-	if (tmp_len != MEM_END_OF_FILE) {
-		tmp_buff[tmp_len] = '\0';
-		auto pparser = cookie_parser_init(tmp_buff);
+	if (ctx.orig.cookie.size() > 0) {
+		auto pparser = cookie_parser_init(ctx.orig.cookie.data());
 		auto string = cookie_parser_get(pparser, "sid");
 		if (string == nullptr || strlen(string) >= arsizeof(ctx.session_string))
 			return ctx.error_responsecode(RC_INVALID_CONTEXT_COOKIE);
@@ -781,15 +778,11 @@ static BOOL emsmdb_preproc(int context_id)
 	auto prequest = get_request(context_id);
 	if (strcasecmp(prequest->method, "POST") != 0)
 		return false;
-	char tmp_uri[1024];
-	size_t tmp_len = mem_file_read(&prequest->f_request_uri, tmp_uri, sizeof(tmp_uri)-1);
-	if (tmp_len == MEM_END_OF_FILE)
-		return false;
-	tmp_uri[tmp_len] = '\0';
-	if (strncasecmp(tmp_uri, "/mapi/emsmdb/?MailboxId=", 22) != 0)
+	auto uri = prequest->request_uri.data();
+	if (strncasecmp(uri, "/mapi/emsmdb/?MailboxId=", 22) != 0)
 		return false;
 	auto pconnection = get_connection(context_id);
-	set_ep_info(context_id, tmp_uri + 22, pconnection->server_port);
+	set_ep_info(context_id, uri + 22, pconnection->server_port);
 	return TRUE;
 }
 
@@ -13,43 +13,20 @@ MhContext::MhContext(int context_id) :
 	auth_info(get_auth_info(context_id)), start_time(time_point::clock::now())
 {}
 
-bool MhContext::getHeader(char* dest, size_t maxlen)
+bool MhContext::getHeader(const char *name, char *dest, size_t maxlen)
 {
-	uint32_t tmp_len;
-	mem_file_read(&orig.f_others, &tmp_len, sizeof(uint32_t));
-	if (tmp_len >= maxlen)
-		 return false;
-	mem_file_read(&orig.f_others, dest, tmp_len);
-	dest[tmp_len] = '\0';
+	auto value = orig.field(name);
+	if (value.size() >= maxlen)
+		return false;
+	memcpy(dest, value.data(), value.size() + 1);
 	return true;
 }
 
 bool MhContext::loadHeaders()
 {
-	uint32_t tmp_len;
-	char tmp_buff[1024];
-	while (mem_file_read(&orig.f_others, &tmp_len, sizeof(uint32_t)) != MEM_END_OF_FILE) {
-		if (tmp_len >= 11 && tmp_len <= 13) {
-			mem_file_read(&orig.f_others, tmp_buff, tmp_len);
-			if (strncasecmp(tmp_buff, "X-RequestId", 11) == 0) {
-				if (!getHeader(request_id, arsizeof(request_id)))
-					return false;
-				continue;
-			} else if (strncasecmp(tmp_buff, "X-ClientInfo", 12) == 0) {
-				if (!getHeader(client_info, arsizeof(client_info)))
-					return false;
-				continue;
-			} else if (strncasecmp(tmp_buff, "X-RequestType", 13) == 0) {
-				if (!getHeader(request_value, arsizeof(request_value)))
-					return false;
-				continue;
-			}
-		} else
-			mem_file_seek(&orig.f_others, MEM_FILE_READ_PTR, tmp_len, MEM_FILE_SEEK_CUR);
-		mem_file_read(&orig.f_others, &tmp_len, sizeof(uint32_t));
-		mem_file_seek(&orig.f_others, MEM_FILE_READ_PTR, tmp_len, MEM_FILE_SEEK_CUR);
-	}
-	return true;
+	return getHeader("X-RequestId", request_id, arsizeof(request_id)) &&
+	       getHeader("X-ClientInfo", client_info, arsizeof(client_info)) &&
+	       getHeader("X-RequestType", request_value, arsizeof(request_value));
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -87,7 +87,7 @@ extern size_t commonHeader(char *, size_t, const char *, const char *, const cha
 struct MhContext
 {
 	bool loadHeaders();
-	bool getHeader(char*, size_t);
+	bool getHeader(const char *name, char *dest, size_t maxlen);
 
 	BOOL unauthed() const;
 	BOOL error_responsecode(int) const;
@@ -357,20 +357,14 @@ HPM_ENTRY(hpm_mh_nsp);
  */
 static BOOL nsp_preproc(int context_id)
 {
-	size_t tmp_len;
-	char tmp_uri[1024];
-
 	auto prequest = get_request(context_id);
 	if (strcasecmp(prequest->method, "POST") != 0)
 		return false;
-	tmp_len = mem_file_read(&prequest->f_request_uri, tmp_uri, sizeof(tmp_uri));
-	if (tmp_len == MEM_END_OF_FILE)
-		return false;
-	tmp_uri[tmp_len] = '\0';
-	if (strncasecmp(tmp_uri, "/mapi/nspi/?MailboxId=", 22) != 0)
+	auto uri = prequest->request_uri.data();
+	if (strncasecmp(uri, "/mapi/nspi/?MailboxId=", 22) != 0)
 		return false;
 	auto pconnection = get_connection(context_id);
-	set_ep_info(context_id, tmp_uri + 22, pconnection->server_port);
+	set_ep_info(context_id, uri + 22, pconnection->server_port);
 	return TRUE;
 }
 
@@ -452,11 +446,8 @@ static void produce_session(const char *tag, char *session)
  */
 MhNspPlugin::ProcRes MhNspPlugin::loadCookies(MhNspContext& ctx)
 {
-	char tmp_buff[1024];
-	size_t tmp_len = mem_file_read(&ctx.orig.f_cookie, tmp_buff, arsizeof(tmp_buff) - 1);
-	if (tmp_len != MEM_END_OF_FILE) {
-		tmp_buff[tmp_len] = '\0';
-		auto pparser = cookie_parser_init(tmp_buff);
+	if (ctx.orig.cookie.size() > 0) {
+		auto pparser = cookie_parser_init(ctx.orig.cookie.data());
 		auto string = cookie_parser_get(pparser, "sid");
 		if (string == nullptr || strlen(string) >= arsizeof(ctx.session_string))
 			return ctx.error_responsecode(RC_INVALID_CONTEXT_COOKIE);
@@ -25,7 +25,9 @@ static char g_server_help[] =
 static char g_midb_help[] =
 	"250 MIDB DAEMON midb control help information:\r\n"
 	"\tmidb info\r\n"
-	"\t    --print the http parser info";
+	"\t    --print the http parser info\r\n"
+	"\tmidb proxy\r\n"
+	"\t    --print the exmdb connection statistics";
 
 static char g_system_help[] =
 	"250 MIDB DAEMON system help information:\r\n"
@@ -68,6 +70,12 @@ BOOL cmd_handler_midb_control(int argc, char** argv)
 			exmdb_client_get_param(LOST_PROXY_CONNECTIONS));
 		return TRUE;
 	}
+	if (2 == argc && 0 == strcmp(argv[1], "proxy")) {
+		char buf[TALK_BUFFER_LEN];
+		exmdb_client_get_stats(buf, GX_ARRAY_SIZE(buf));
+		console_server_reply_to_client("250 exmdb connections:\r\n%s", buf);
+		return TRUE;
+	}
 	console_server_reply_to_client("550 invalid argument %s", argv[1]);
 	return TRUE;
 }
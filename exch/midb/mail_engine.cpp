@@ -29,6 +29,7 @@
 #include "cmd_parser.h"
 #include "common_util.h"
 #include "mail_engine.h"
+#include "vanished.h"
 #include <gromox/double_list.hpp>
 #include <gromox/single_list.hpp>
 #include "exmdb_client.h"
@@ -50,8 +51,6 @@
 #define LLU(x) static_cast<unsigned long long>(x)
 #define S2A(x) reinterpret_cast<const char *>(x)
 
-#define FILENUM_PER_MIME				8
-
 #define CONFIG_ID_USERNAME				1
 
 #define MAX_DIGLEN						256*1024
@@ -187,6 +186,7 @@ struct SIMU_NODE {
 	DOUBLE_LIST_NODE node;
 	uint32_t idx;
 	uint32_t uid;
+	uint64_t modseq;
 	char *mid_string;
 	char *flags_buff;
 };
@@ -335,7 +335,7 @@ static uint64_t mail_engine_get_digest(sqlite3 *psqlite,
 	}
 	snprintf(sql_string, arsizeof(sql_string), "SELECT uid, recent, read,"
 		" unsent, flagged, replied, forwarded, deleted, ext,"
-		" folder_id FROM messages WHERE mid_string=?");
+		" folder_id, modseq FROM messages WHERE mid_string=?");
 	auto pstmt = gx_sql_prep(psqlite, sql_string);
 	if (pstmt == nullptr)
 		return 0;
@@ -362,6 +362,8 @@ static uint64_t mail_engine_get_digest(sqlite3 *psqlite,
 	set_digest(digest_buff, MAX_DIGLEN, "forwarded", tmp_buff);
 	snprintf(tmp_buff, arsizeof(tmp_buff), "%llu", sqlite3_column_int64(pstmt, 7));
 	set_digest(digest_buff, MAX_DIGLEN, "deleted", tmp_buff);
+	snprintf(tmp_buff, arsizeof(tmp_buff), "%llu", sqlite3_column_int64(pstmt, 10));
+	add_digest(digest_buff, MAX_DIGLEN, "modseq", tmp_buff);
 	if (SQLITE_NULL == sqlite3_column_type(pstmt, 8)) {
 		return folder_id;
 	}
@@ -1975,9 +1977,91 @@ static void mail_engine_extract_digest_fields(const char *digest,
 	}
 }
 
+/*
+ * Modification sequences (RFC 7162) are kept per folder. Several IMAP
+ * flags exist only in midb, so the counter is local rather than taken
+ * from the exmdb change numbers.
+ */
+static uint64_t mail_engine_next_modseq(sqlite3 *psqlite, uint64_t folder_id)
+{
+	char sql_string[256];
+
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE folders SET "
+	        "modseq=modseq+1 WHERE folder_id=%llu", LLU(folder_id));
+	if (SQLITE_OK != sqlite3_exec(psqlite,
+		sql_string, NULL, NULL, NULL)) {
+		return 0;
+	}
+	snprintf(sql_string, arsizeof(sql_string), "SELECT modseq FROM"
+	          " folders WHERE folder_id=%llu", LLU(folder_id));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
+		return 0;
+	return sqlite3_column_int64(pstmt, 0);
+}
+
+static void mail_engine_touch_message(sqlite3 *psqlite, uint64_t message_id)
+{
+	uint64_t modseq;
+	char sql_string[256];
+
+	snprintf(sql_string, arsizeof(sql_string), "SELECT folder_id FROM "
+	          "messages WHERE message_id=%llu", LLU(message_id));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
+		return;
+	modseq = mail_engine_next_modseq(psqlite,
+	         sqlite3_column_int64(pstmt, 0));
+	pstmt.finalize();
+	if (0 == modseq) {
+		return;
+	}
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET "
+	        "modseq=%llu WHERE message_id=%llu", LLU(modseq),
+	        LLU(message_id));
+	sqlite3_exec(psqlite, sql_string, NULL, NULL, NULL);
+}
+
+/*
+ * One modseq for all messages a sync batch inserts or updates, taken from
+ * the folder counter on the first of them.
+ */
+static uint64_t mail_engine_batch_modseq(sqlite3 *psqlite,
+	uint64_t folder_id, uint64_t *pmodseq)
+{
+	if (0 == *pmodseq) {
+		*pmodseq = mail_engine_next_modseq(psqlite, folder_id);
+	}
+	return *pmodseq;
+}
+
+/* remember the UID of a message about to be deleted for VANISHED */
+static void mail_engine_vanish_message(sqlite3 *psqlite, uint64_t message_id)
+{
+	uint32_t uid;
+	uint64_t modseq;
+	uint64_t folder_id;
+	char sql_string[256];
+
+	snprintf(sql_string, arsizeof(sql_string), "SELECT folder_id, uid "
+	          "FROM messages WHERE message_id=%llu", LLU(message_id));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
+		return;
+	folder_id = sqlite3_column_int64(pstmt, 0);
+	uid = sqlite3_column_int64(pstmt, 1);
+	pstmt.finalize();
+	modseq = mail_engine_next_modseq(psqlite, folder_id);
+	if (0 == modseq) {
+		return;
+	}
+	vanished_record(psqlite, folder_id, uid, modseq);
+}
+
 static void mail_engine_insert_message(sqlite3_stmt *pstmt,
 	uint32_t *puidnext, uint64_t message_id, const char *mid_string,
-	uint32_t message_flags, uint64_t received_time, uint64_t mod_time)
+	uint32_t message_flags, uint64_t received_time, uint64_t mod_time,
+	uint64_t modseq)
 {
 	MAIL imail;
 	size_t size;
@@ -2079,11 +2163,13 @@ static void mail_engine_insert_message(sqlite3_stmt *pstmt,
 	sqlite3_bind_text(pstmt, 9, rcpt, -1, SQLITE_STATIC);
 	sqlite3_bind_int64(pstmt, 10, size);
 	sqlite3_bind_int64(pstmt, 11, received_time);
+	sqlite3_bind_int64(pstmt, 12, modseq);
 	sqlite3_step(pstmt);
 }
 
 static void mail_engine_sync_message(IDB_ITEM *pidb,
 	sqlite3_stmt *pstmt, sqlite3_stmt *pstmt1, uint32_t *puidnext,
+	uint64_t folder_id, uint64_t *pmodseq,
 	uint64_t message_id, uint64_t received_time, const char *mid_string,
 	const char *mid_string1, uint64_t mod_time, uint64_t mod_time1,
 	uint32_t message_flags, uint8_t b_unsent, uint8_t b_read)
@@ -2099,13 +2185,14 @@ static void mail_engine_sync_message(IDB_ITEM *pidb,
 			sqlite3_reset(pstmt1);
 			sqlite3_bind_int64(pstmt1, 1, b_unsent1);
 			sqlite3_bind_int64(pstmt1, 2, b_read1);
-			sqlite3_bind_int64(pstmt1, 3, message_id);
-			if (SQLITE_DONE != sqlite3_step(pstmt1)) {
-				return;
-			}
+			sqlite3_bind_int64(pstmt1, 3, mail_engine_batch_modseq(
+				pidb->psqlite, folder_id, pmodseq));
+			sqlite3_bind_int64(pstmt1, 4, message_id);
+			sqlite3_step(pstmt1);
 		}
 		return;
 	}
+	mail_engine_vanish_message(pidb->psqlite, message_id);
 	snprintf(sql_string, arsizeof(sql_string), "DELETE FROM messages"
 	        " WHERE message_id=%llu", LLU(message_id));
 	if (SQLITE_OK != sqlite3_exec(pidb->psqlite,
@@ -2113,7 +2200,8 @@ static void mail_engine_sync_message(IDB_ITEM *pidb,
 		return;	
 	}
 	mail_engine_insert_message(pstmt, puidnext, message_id,
-			NULL, message_flags, received_time, mod_time);
+			NULL, message_flags, received_time, mod_time,
+			mail_engine_batch_modseq(pidb->psqlite, folder_id, pmodseq));
 }
 
 static BOOL mail_engine_sync_contents(IDB_ITEM *pidb, uint64_t folder_id)
@@ -2126,6 +2214,7 @@ static BOOL mail_engine_sync_contents(IDB_ITEM *pidb, uint64_t folder_id)
 	uint32_t uidnext1;
 	uint64_t mod_time;
 	uint64_t message_id;
+	uint64_t modseq = 0;
 	DOUBLE_LIST temp_list;
 	char sql_string[1024];
 	uint32_t message_flags;
@@ -2230,14 +2319,14 @@ static BOOL mail_engine_sync_contents(IDB_ITEM *pidb, uint64_t folder_id)
 	}
 	snprintf(sql_string, arsizeof(sql_string), "INSERT INTO messages (message_id, "
 		"folder_id, mid_string, mod_time, uid, unsent, read, subject,"
-		" sender, rcpt, size, received) VALUES (?, %llu, ?, ?, ?, ?, "
-		"?, ?, ?, ?, ?, ?)", LLU(folder_id));
+		" sender, rcpt, size, received, modseq) VALUES (?, %llu, ?, ?, "
+		"?, ?, ?, ?, ?, ?, ?, ?, ?)", LLU(folder_id));
 	auto pstmt2 = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt2 == nullptr) {
 		return FALSE;
 	}
 	snprintf(sql_string, arsizeof(sql_string), "UPDATE messages"
-		" SET unsent=?, read=? WHERE message_id=?");
+		" SET unsent=?, read=?, modseq=? WHERE message_id=?");
 	auto pstmt3 = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt3 == nullptr) {
 		return FALSE;
@@ -2253,10 +2342,13 @@ static BOOL mail_engine_sync_contents(IDB_ITEM *pidb, uint64_t folder_id)
 				S2A(sqlite3_column_text(pstmt, 1)),
 				sqlite3_column_int64(pstmt, 3),
 				sqlite3_column_int64(pstmt, 4),
-				sqlite3_column_int64(pstmt, 2));
+				sqlite3_column_int64(pstmt, 2),
+				mail_engine_batch_modseq(pidb->psqlite,
+				folder_id, &modseq));
 		} else {
 			mail_engine_sync_message(pidb,
-				pstmt2, pstmt3, &uidnext, message_id,
+				pstmt2, pstmt3, &uidnext, folder_id,
+				&modseq, message_id,
 				sqlite3_column_int64(pstmt, 4),
 				S2A(sqlite3_column_text(pstmt, 1)),
 				S2A(sqlite3_column_text(pstmt1, 1)),
@@ -2311,6 +2403,8 @@ static BOOL mail_engine_sync_contents(IDB_ITEM *pidb, uint64_t folder_id)
 			return FALSE;
 		}
 		while ((pnode = double_list_pop_front(&temp_list)) != nullptr) {
+			mail_engine_vanish_message(pidb->psqlite,
+				*(uint64_t*)pnode->pdata);
 			sqlite3_reset(pstmt);
 			sqlite3_bind_int64(pstmt, 1, *(uint64_t*)pnode->pdata);
 			if (SQLITE_DONE != sqlite3_step(pstmt)) {
@@ -2754,6 +2848,53 @@ static IDB_REF mail_engine_peek_idb(const char *path)
 	return IDB_REF(pidb);
 }
 
+static BOOL mail_engine_has_column(sqlite3 *psqlite, const char *query)
+{
+	sqlite3_stmt *pstmt = nullptr;
+
+	if (SQLITE_OK != sqlite3_prepare_v2(psqlite,
+	    query, -1, &pstmt, nullptr)) {
+		return FALSE;
+	}
+	sqlite3_finalize(pstmt);
+	return TRUE;
+}
+
+/* midb.sqlite3 files created before modseq tracking lack the columns */
+static void mail_engine_upgrade_modseq(sqlite3 *psqlite)
+{
+	if (TRUE == mail_engine_has_column(psqlite,
+	    "SELECT modseq FROM folders LIMIT 1")) {
+		if (TRUE == mail_engine_has_column(psqlite,
+		    "SELECT vanished_floor FROM folders LIMIT 1")) {
+			return;
+		}
+		if (SQLITE_OK != sqlite3_exec(psqlite,
+		    "ALTER TABLE folders ADD COLUMN vanished_floor INTEGER DEFAULT 0",
+		    nullptr, nullptr, nullptr)) {
+			fprintf(stderr, "W-1518: cannot add vanished_floor column to midb.sqlite3: %s\n",
+			        sqlite3_errmsg(psqlite));
+		}
+		return;
+	}
+	if (SQLITE_OK != sqlite3_exec(psqlite,
+	    "BEGIN TRANSACTION;"
+	    "ALTER TABLE folders ADD COLUMN modseq INTEGER DEFAULT 1;"
+	    "ALTER TABLE folders ADD COLUMN vanished_floor INTEGER DEFAULT 0;"
+	    "ALTER TABLE messages ADD COLUMN modseq INTEGER DEFAULT 1;"
+	    "CREATE INDEX fid_modseq_index ON messages(folder_id, modseq);"
+	    "CREATE TABLE vanished (folder_id INTEGER NOT NULL,"
+	    " uid INTEGER NOT NULL, modseq INTEGER NOT NULL,"
+	    " FOREIGN KEY (folder_id) REFERENCES folders (folder_id)"
+	    " ON DELETE CASCADE ON UPDATE CASCADE);"
+	    "CREATE INDEX fid_vanished_index ON vanished(folder_id, modseq);"
+	    "COMMIT TRANSACTION;", nullptr, nullptr, nullptr)) {
+		fprintf(stderr, "W-1516: cannot add modseq columns to midb.sqlite3: %s\n",
+		        sqlite3_errmsg(psqlite));
+		sqlite3_exec(psqlite, "ROLLBACK", nullptr, nullptr, nullptr);
+	}
+}
+
 static IDB_REF mail_engine_get_idb(const char *path)
 {
 	BOOL b_load;
@@ -2806,6 +2947,7 @@ static IDB_REF mail_engine_get_idb(const char *path)
 			sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
 		}
 		sqlite3_exec(pidb->psqlite, "DELETE FROM mapping", NULL, NULL, NULL);
+		mail_engine_upgrade_modseq(pidb->psqlite);
 		snprintf(sql_string, arsizeof(sql_string), "SELECT config_value FROM "
 			"configurations WHERE config_id=%u", CONFIG_ID_USERNAME);
 		auto pstmt = gx_sql_prep(pidb->psqlite, sql_string);
@@ -4165,6 +4307,7 @@ static int mail_engine_pfddt(int argc, char **argv, int sockd)
 	uint32_t unreads;
 	uint32_t recents;
 	uint32_t uidnext;
+	uint64_t modseq;
 	uint64_t uidvalid;
 	uint64_t folder_id;
 	char temp_buff[1024];
@@ -4197,7 +4340,7 @@ static int mail_engine_pfddt(int argc, char **argv, int sockd)
 	if (pidb == nullptr)
 		return MIDB_E_HASHTABLE_FULL;
 	snprintf(sql_string, arsizeof(sql_string), "SELECT folder_id,"
-				" uidnext FROM folders WHERE name=?");
+				" uidnext, modseq FROM folders WHERE name=?");
 	auto pstmt = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt == nullptr) {
 		return MIDB_E_NO_MEMORY;
@@ -4208,6 +4351,7 @@ static int mail_engine_pfddt(int argc, char **argv, int sockd)
 	}
 	folder_id = sqlite3_column_int64(pstmt, 0);
 	uidnext = sqlite3_column_int64(pstmt, 1);
+	modseq = sqlite3_column_int64(pstmt, 2);
 	pstmt.finalize();
 	snprintf(sql_string, arsizeof(sql_string), "SELECT count(message_id) "
 	          "FROM messages WHERE folder_id=%llu", LLU(folder_id));
@@ -4263,8 +4407,9 @@ static int mail_engine_pfddt(int argc, char **argv, int sockd)
 	pstmt.finalize();
 	pidb.reset();
 	uidvalid = folder_id;
-	temp_len = sprintf(temp_buff, "TRUE %u %u %u %llu %u %d\r\n",
-	           total, recents, unreads, LLU(uidvalid), uidnext + 1, offset);
+	temp_len = sprintf(temp_buff, "TRUE %u %u %u %llu %u %d %llu\r\n",
+	           total, recents, unreads, LLU(uidvalid), uidnext + 1, offset,
+	           LLU(modseq));
 	write(sockd, temp_buff, temp_len);
 	return 0;
 }
@@ -4364,9 +4509,10 @@ static int mail_engine_psiml(int argc, char **argv, int sockd)
 	char temp_line[1024];
 	char sql_string[1024];
 	const char *mid_string;
+	char since[32] = "";
 	char temp_buff[256*1024];
 	
-	if ((5 != argc && 7 != argc) || strlen(argv[1]) >= 256
+	if ((5 != argc && 7 != argc && 8 != argc) || strlen(argv[1]) >= 256
 		|| strlen(argv[2]) >= 1024) {
 		return MIDB_E_PARAMETER_ERROR;
 	}
@@ -4398,7 +4544,7 @@ static int mail_engine_psiml(int argc, char **argv, int sockd)
 	} else {
 		return MIDB_E_PARAMETER_ERROR;
 	}
-	if (7 == argc) {
+	if (7 == argc || 8 == argc) {
 		offset = atoi(argv[5]);
 		length = atoi(argv[6]);
 		if (length < 0) {
@@ -4408,6 +4554,14 @@ static int mail_engine_psiml(int argc, char **argv, int sockd)
 		offset = 0;
 		length = 0;
 	}
+	/*
+	 * With a lower modseq bound (CHANGEDSINCE), only the messages of the
+	 * range changed after it are listed, each line then being prefixed
+	 * with its position like in P-SIMU.
+	 */
+	if (8 == argc)
+		snprintf(since, arsizeof(since), " AND modseq>%llu",
+			strtoull(argv[7], nullptr, 0));
 	auto pidb = mail_engine_get_idb(argv[1]);
 	if (pidb == nullptr)
 		return MIDB_E_HASHTABLE_FULL;
@@ -4447,9 +4601,9 @@ static int mail_engine_psiml(int argc, char **argv, int sockd)
 		}
 		idx2 = idx1 + length - 1;
 		snprintf(sql_string, arsizeof(sql_string), "SELECT mid_string, uid, replied, "
-				"unsent, flagged, deleted, read, recent, forwarded FROM "
-				"messages WHERE folder_id=%llu AND idx>=%d AND idx<=%d "
-				"ORDER BY idx", LLU(folder_id), idx1, idx2);
+				"unsent, flagged, deleted, read, recent, forwarded, modseq, idx "
+				"FROM messages WHERE folder_id=%llu AND idx>=%d AND idx<=%d%s "
+				"ORDER BY idx", LLU(folder_id), idx1, idx2, since);
 	} else {
 		if (offset < 0) {
 			idx2 = offset*(-1);
@@ -4469,14 +4623,28 @@ static int mail_engine_psiml(int argc, char **argv, int sockd)
 		}
 		idx1 = idx2 - length + 1;
 		snprintf(sql_string, arsizeof(sql_string), "SELECT mid_string, uid, replied, "
-				"unsent, flagged, deleted, read, recent, forwarded FROM "
-				"messages WHERE folder_id=%llu AND idx>=%d AND idx<=%d "
-				"ORDER BY idx DESC", LLU(folder_id), idx1, idx2);
+				"unsent, flagged, deleted, read, recent, forwarded, modseq, idx "
+				"FROM messages WHERE folder_id=%llu AND idx>=%d AND idx<=%d%s "
+				"ORDER BY idx DESC", LLU(folder_id), idx1, idx2, since);
 	}
 	pstmt = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt == nullptr) {
 		return MIDB_E_NO_MEMORY;
 	}
+	if ('\0' != since[0]) {
+		char count_string[256];
+		snprintf(count_string, arsizeof(count_string), "SELECT "
+			"count(message_id) FROM messages WHERE folder_id=%llu AND "
+			"idx>=%d AND idx<=%d%s", LLU(folder_id), idx1, idx2, since);
+		auto pstmt1 = gx_sql_prep(pidb->psqlite, count_string);
+		if (pstmt1 == nullptr) {
+			return MIDB_E_NO_MEMORY;
+		}
+		if (SQLITE_ROW != sqlite3_step(pstmt1)) {
+			return MIDB_E_NO_FOLDER;
+		}
+		length = sqlite3_column_int64(pstmt1, 0);
+	}
 	temp_len = sprintf(temp_buff, "TRUE %d\r\n", length);
 	while (SQLITE_ROW == sqlite3_step(pstmt)) {
 		mid_string = S2A(sqlite3_column_text(pstmt, 0));
@@ -4514,9 +4682,17 @@ static int mail_engine_psiml(int argc, char **argv, int sockd)
 		flags_buff[flags_len] = ')';
 		flags_len ++;
 		flags_buff[flags_len] = '\0';
-		buff_len = gx_snprintf(temp_line, GX_ARRAY_SIZE(temp_line),
-			"%s %u %s\r\n", mid_string, uid,
-			flags_buff);
+		if ('\0' == since[0]) {
+			buff_len = gx_snprintf(temp_line, GX_ARRAY_SIZE(temp_line),
+				"%s %u %s %llu\r\n", mid_string, uid,
+				flags_buff, LLU(sqlite3_column_int64(pstmt, 9)));
+		} else {
+			int idx = sqlite3_column_int64(pstmt, 10);
+			buff_len = gx_snprintf(temp_line, GX_ARRAY_SIZE(temp_line),
+				"%d %s %u %s %llu\r\n", TRUE == b_asc ? idx - 1 :
+				total_mail - idx, mid_string, uid,
+				flags_buff, LLU(sqlite3_column_int64(pstmt, 9)));
+		}
 		if (256*1024 - temp_len < buff_len) {
 			write(sockd, temp_buff, temp_len);
 			temp_len = 0;
@@ -4544,11 +4720,17 @@ static int mail_engine_psimu(int argc, char **argv, int sockd)
 	char sql_string[1024];
 	DOUBLE_LIST temp_list;
 	DOUBLE_LIST_NODE *pnode;
+	char since[32] = "";
 	char temp_buff[256*1024];
 	
-	if (7 != argc || strlen(argv[1]) >= 256 || strlen(argv[2]) >= 1024) {
+	if ((7 != argc && 8 != argc) || strlen(argv[1]) >= 256
+		|| strlen(argv[2]) >= 1024) {
 		return MIDB_E_PARAMETER_ERROR;
 	}
+	/* optional lower modseq bound (CHANGEDSINCE), uses fid_modseq_index */
+	if (8 == argc)
+		snprintf(since, arsizeof(since), " AND modseq>%llu",
+			strtoull(argv[7], nullptr, 0));
 	if (0 == strcasecmp(argv[3], "RCV")) {
 		sort_field = FIELD_RECEIVED;
 	} else if (0 == strcasecmp(argv[3], "SUB")) {
@@ -4599,28 +4781,28 @@ static int mail_engine_psimu(int argc, char **argv, int sockd)
 	if (TRUE == b_asc) {
 		if (-1 == first && -1 == last) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu ORDER BY idx", LLU(folder_id));
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s ORDER BY idx", LLU(folder_id), since);
 		} else if (-1 == first) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid<=%u ORDER BY idx",
-				LLU(folder_id), last);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid<=%u ORDER BY idx",
+				LLU(folder_id), since, last);
 		} else if (-1 == last) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid>=%u ORDER BY idx",
-				LLU(folder_id), first);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid>=%u ORDER BY idx",
+				LLU(folder_id), since, first);
 		} else if (last == first) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid=%u",
-				LLU(folder_id), first);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid=%u",
+				LLU(folder_id), since, first);
 		} else {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid>=%u AND uid<=%u "
-				"ORDER BY idx", LLU(folder_id), first, last);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid>=%u AND uid<=%u "
+				"ORDER BY idx", LLU(folder_id), since, first, last);
 		}
 	} else {
 		snprintf(sql_string, arsizeof(sql_string), "SELECT count(message_id) "
@@ -4636,29 +4818,29 @@ static int mail_engine_psimu(int argc, char **argv, int sockd)
 		pstmt.finalize();
 		if (-1 == first && -1 == last) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded"
-				" FROM messages WHERE folder_id=%llu ORDER BY idx DESC",
-				LLU(folder_id));
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq"
+				" FROM messages WHERE folder_id=%llu%s ORDER BY idx DESC",
+				LLU(folder_id), since);
 		} else if (-1 == first) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid<=%u ORDER BY idx"
-				" DESC", LLU(folder_id), last);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid<=%u ORDER BY idx"
+				" DESC", LLU(folder_id), since, last);
 		} else if (-1 == last) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid>=%u ORDER BY idx"
-				" DESC", LLU(folder_id), first);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid>=%u ORDER BY idx"
+				" DESC", LLU(folder_id), since, first);
 		} else if (last == first) {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid=%u",
-				LLU(folder_id), first);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid=%u",
+				LLU(folder_id), since, first);
 		} else {
 			snprintf(sql_string, arsizeof(sql_string), "SELECT idx, mid_string, uid, "
-				"replied, unsent, flagged, deleted, read, recent, forwarded "
-				"FROM messages WHERE folder_id=%llu AND uid>=%u AND uid<=%u "
-				"ORDER BY idx DESC", LLU(folder_id), first, last);
+				"replied, unsent, flagged, deleted, read, recent, forwarded, modseq "
+				"FROM messages WHERE folder_id=%llu%s AND uid>=%u AND uid<=%u "
+				"ORDER BY idx DESC", LLU(folder_id), since, first, last);
 		}
 	}
 	auto pstmt = gx_sql_prep(pidb->psqlite, sql_string);
@@ -4682,6 +4864,7 @@ static int mail_engine_psimu(int argc, char **argv, int sockd)
 			return MIDB_E_NO_MEMORY;
 		}
 		psm_node->uid = sqlite3_column_int64(pstmt, 2);
+		psm_node->modseq = sqlite3_column_int64(pstmt, 10);
 		flags_buff[0] = '(';
 		flags_len = 1;
 		if (0 != sqlite3_column_int64(pstmt, 3)) {
@@ -4727,9 +4910,10 @@ static int mail_engine_psimu(int argc, char **argv, int sockd)
 	for (pnode=double_list_get_head(&temp_list); NULL!=pnode;
 		pnode=double_list_get_after(&temp_list, pnode)) {
 		auto psm_node = static_cast<SIMU_NODE *>(pnode->pdata);
-		buff_len = gx_snprintf(temp_line, GX_ARRAY_SIZE(temp_line), "%u %s %u %s\r\n",
+		buff_len = gx_snprintf(temp_line, GX_ARRAY_SIZE(temp_line), "%u %s %u %s %llu\r\n",
 					psm_node->idx - 1, psm_node->mid_string,
-					psm_node->uid, psm_node->flags_buff);
+					psm_node->uid, psm_node->flags_buff,
+					LLU(psm_node->modseq));
 		if (256*1024 - temp_len < buff_len) {
 			write(sockd, temp_buff, temp_len);
 			temp_len = 0;
@@ -5003,9 +5187,24 @@ static int mail_engine_pdtlu(int argc, char **argv, int sockd)
 	return 0;
 }
 
+static BOOL mail_engine_update_flag(sqlite3 *psqlite,
+	uint64_t message_id, const char *field, int value)
+{
+	char sql_string[256];
+
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET %s=%d"
+	        " WHERE message_id=%llu AND %s<>%d", field, value,
+	        LLU(message_id), field, value);
+	if (SQLITE_OK != sqlite3_exec(psqlite, sql_string, NULL, NULL, NULL)) {
+		return FALSE;
+	}
+	return sqlite3_changes(psqlite) > 0 ? TRUE : FALSE;
+}
+
 static int mail_engine_psflg(int argc, char **argv, int sockd)
 {
 	uint64_t read_cn;
+	BOOL b_changed = FALSE;
 	uint64_t message_id;
 	uint32_t tmp_proptag;
 	char sql_string[1024];
@@ -5038,9 +5237,8 @@ static int mail_engine_psflg(int argc, char **argv, int sockd)
 	message_id = sqlite3_column_int64(pstmt, 0);
 	pstmt.finalize();
 	if (NULL != strchr(argv[4], 'A')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET replied=1"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "replied", 1))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'U')) {
 		proptags.count = 1;
@@ -5061,32 +5259,35 @@ static int mail_engine_psflg(int argc, char **argv, int sockd)
 				return MIDB_E_NO_MEMORY;
 			}
 		}
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "unsent", 1))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'F')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET flagged=1"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "flagged", 1))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'W')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET forwarded=1"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "forwarded", 1))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'D')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET deleted=1"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "deleted", 1))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'S')) {
 		if (!exmdb_client::set_message_read_state(argv[1],
 			NULL, rop_util_make_eid_ex(1, message_id), 1, &read_cn)) {
 			return MIDB_E_NO_MEMORY;
 		}
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "read", 1))
+			b_changed = TRUE;
 	}
+	/* \Recent is session state and does not advance the modseq */
 	if (NULL != strchr(argv[4], 'R')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET recent=1"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		mail_engine_update_flag(pidb->psqlite, message_id, "recent", 1);
+	}
+	if (TRUE == b_changed) {
+		mail_engine_touch_message(pidb->psqlite, message_id);
 	}
 	pidb.reset();
 	write(sockd, "TRUE\r\n", 6);
@@ -5096,6 +5297,7 @@ static int mail_engine_psflg(int argc, char **argv, int sockd)
 static int mail_engine_prflg(int argc, char **argv, int sockd)
 {
 	uint64_t read_cn;
+	BOOL b_changed = FALSE;
 	uint64_t message_id;
 	uint32_t tmp_proptag;
 	char sql_string[1024];
@@ -5128,9 +5330,8 @@ static int mail_engine_prflg(int argc, char **argv, int sockd)
 	message_id = sqlite3_column_int64(pstmt, 0);
 	pstmt.finalize();
 	if (NULL != strchr(argv[4], 'A')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET replied=0"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "replied", 0))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'U')) {
 		proptags.count = 1;
@@ -5151,32 +5352,34 @@ static int mail_engine_prflg(int argc, char **argv, int sockd)
 				return MIDB_E_NO_MEMORY;
 			}
 		}
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "unsent", 0))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'F')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET flagged=0"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "flagged", 0))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'W')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET forwarded=0"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "forwarded", 0))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'D')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET deleted=0"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "deleted", 0))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'S')) {
 		if (!exmdb_client::set_message_read_state(argv[1],
 			NULL, rop_util_make_eid_ex(1, message_id), 0, &read_cn)) {
 			return MIDB_E_NO_MEMORY;
 		}
+		if (mail_engine_update_flag(pidb->psqlite, message_id, "read", 0))
+			b_changed = TRUE;
 	}
 	if (NULL != strchr(argv[4], 'R')) {
-		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET recent=0"
-		        " WHERE message_id=%llu", LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		mail_engine_update_flag(pidb->psqlite, message_id, "recent", 0);
+	}
+	if (TRUE == b_changed) {
+		mail_engine_touch_message(pidb->psqlite, message_id);
 	}
 	pidb.reset();
 	write(sockd, "TRUE\r\n", 6);
@@ -5187,6 +5390,7 @@ static int mail_engine_pgflg(int argc, char **argv, int sockd)
 {
 	int temp_len;
 	int flags_len;
+	uint64_t modseq;
 	char flags_buff[32];
 	char sql_string[256];
 	char temp_buff[1024];
@@ -5202,8 +5406,8 @@ static int mail_engine_pgflg(int argc, char **argv, int sockd)
 		return MIDB_E_NO_FOLDER;
 	}
 	snprintf(sql_string, arsizeof(sql_string), "SELECT folder_id, recent, "
-		"read, unsent, flagged, replied, forwarded, deleted "
-		"FROM messages WHERE mid_string=?");
+		"read, unsent, flagged, replied, forwarded, deleted, "
+		"modseq FROM messages WHERE mid_string=?");
 	auto pstmt = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt == nullptr) {
 		return MIDB_E_NO_MEMORY;
@@ -5243,12 +5447,125 @@ static int mail_engine_pgflg(int argc, char **argv, int sockd)
 		flags_buff[flags_len] = 'R';
 		flags_len ++;
 	}
+	modseq = sqlite3_column_int64(pstmt, 8);
 	pstmt.finalize();
 	pidb.reset();
 	flags_buff[flags_len] = ')';
 	flags_len ++;
 	flags_buff[flags_len] = '\0';
-	temp_len = sprintf(temp_buff, "TRUE %s\r\n", flags_buff);
+	temp_len = sprintf(temp_buff, "TRUE %s %llu\r\n", flags_buff, LLU(modseq));
+	write(sockd, temp_buff, temp_len);
+	return 0;
+}
+
+namespace {
+struct VNSH_HINT {
+	DOUBLE_LIST *plist;
+	uint32_t uidnext;
+};
+}
+
+static BOOL mail_engine_vnsh_hint(void *param, uint32_t *pfirst,
+	uint32_t *plast)
+{
+	auto phint = static_cast<VNSH_HINT *>(param);
+	uint32_t first = 0, last = 0;
+	DOUBLE_LIST_NODE *pnode;
+	
+	for (pnode=double_list_get_head(phint->plist); NULL!=pnode;
+		pnode=double_list_get_after(phint->plist, pnode)) {
+		auto pseq = static_cast<SEQUENCE_NODE *>(pnode->pdata);
+		uint32_t min = pseq->min, max = pseq->max;
+		if (pseq->max == static_cast<unsigned int>(-1)) {
+			if (pseq->min == static_cast<unsigned int>(-1)) {
+				min = max = phint->uidnext;
+			} else {
+				max = UINT32_MAX;
+			}
+		}
+		if (min < *pfirst) {
+			min = *pfirst;
+		}
+		if (max > *plast) {
+			max = *plast;
+		}
+		if (min > max || (0 != first && min > first) ||
+		    (min == first && max <= last)) {
+			continue;
+		}
+		first = min;
+		last = max;
+	}
+	if (0 == first) {
+		return FALSE;
+	}
+	*pfirst = first;
+	*plast = last;
+	return TRUE;
+}
+
+/*
+ * P-VNSH <path> <folder> <modseq> <after-uid> [<uid-set>]
+ *	One page of the UIDs expunged after modseq, as
+ *	"TRUE <full> <next-after-uid> [<sequence-set>]". next-after-uid is 0
+ *	on the last page. full=1 means modseq was below what is still kept,
+ *	and the set lists every UID that no longer exists.
+ */
+static int mail_engine_pvnsh(int argc, char **argv, int sockd)
+{
+	BOOL b_full;
+	int temp_len;
+	uint32_t last;
+	uint64_t modseq;
+	uint32_t after_uid;
+	VNSH_HINT hint;
+	char sql_string[1024];
+	char set_buff[MIDB_VNSH_PAGE_SIZE];
+	char temp_buff[MIDB_VNSH_PAGE_SIZE + 64];
+
+	if ((5 != argc && 6 != argc) || strlen(argv[1]) >= 256 ||
+		strlen(argv[2]) >= 1024) {
+		return MIDB_E_PARAMETER_ERROR;
+	}
+	modseq = strtoull(argv[3], nullptr, 0);
+	after_uid = strtoul(argv[4], nullptr, 0);
+	auto pidb = mail_engine_get_idb(argv[1]);
+	if (pidb == nullptr)
+		return MIDB_E_HASHTABLE_FULL;
+	snprintf(sql_string, arsizeof(sql_string), "SELECT folder_id,"
+				" uidnext FROM folders WHERE name=?");
+	auto pstmt = gx_sql_prep(pidb->psqlite, sql_string);
+	if (pstmt == nullptr) {
+		return MIDB_E_NO_MEMORY;
+	}
+	sqlite3_bind_text(pstmt, 1, argv[2], -1, SQLITE_STATIC);
+	if (SQLITE_ROW != sqlite3_step(pstmt)) {
+		return MIDB_E_NO_FOLDER;
+	}
+	auto folder_id = gx_sql_col_uint64(pstmt, 0);
+	hint.uidnext = sqlite3_column_int64(pstmt, 1);
+	pstmt.finalize();
+	hint.plist = NULL;
+	if (6 == argc) {
+		hint.plist = mail_engine_ct_parse_sequence(argv[5]);
+		if (NULL == hint.plist) {
+			return MIDB_E_PARAMETER_ERROR;
+		}
+	}
+	BOOL b_result = vanished_page(pidb->psqlite, folder_id, modseq,
+	                after_uid, NULL == hint.plist ? nullptr :
+	                mail_engine_vnsh_hint, &hint, set_buff,
+	                arsizeof(set_buff), &b_full, &last);
+	pidb.reset();
+	if (NULL != hint.plist) {
+		mail_engine_ct_free_sequence(hint.plist);
+	}
+	if (FALSE == b_result) {
+		return MIDB_E_NO_MEMORY;
+	}
+	temp_len = gx_snprintf(temp_buff, arsizeof(temp_buff),
+	           "TRUE %d %u%s%s\r\n", TRUE == b_full ? 1 : 0, last,
+	           '\0' == set_buff[0] ? "" : " ", set_buff);
 	write(sockd, temp_buff, temp_len);
 	return 0;
 }
@@ -5495,30 +5812,33 @@ static void mail_engine_add_notification_message(
 			sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
 		}
 	}
-	snprintf(sql_string, arsizeof(sql_string), "SELECT uidnext FROM"
-	          " folders WHERE folder_id=%llu", LLU(folder_id));
+	snprintf(sql_string, arsizeof(sql_string), "SELECT uidnext, modseq"
+	          " FROM folders WHERE folder_id=%llu", LLU(folder_id));
 	auto pstmt = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
 		return;
 	uidnext = sqlite3_column_int64(pstmt, 0);
+	auto modseq = gx_sql_col_uint64(pstmt, 1) + 1;
 	pstmt.finalize();
 	snprintf(sql_string, arsizeof(sql_string), "UPDATE folders SET"
-		" uidnext=uidnext+1, sort_field=%d "
-		"WHERE folder_id=%llu", FIELD_NONE, LLU(folder_id));
+		" uidnext=uidnext+1, modseq=%llu, sort_field=%d "
+		"WHERE folder_id=%llu", LLU(modseq), FIELD_NONE,
+		LLU(folder_id));
 	if (SQLITE_OK != sqlite3_exec(pidb->psqlite,
 		sql_string, NULL, NULL, NULL)) {
 		return;
 	}
 	snprintf(sql_string, arsizeof(sql_string), "INSERT INTO messages ("
 		"message_id, folder_id, mid_string, mod_time, uid, "
-		"unsent, read, subject, sender, rcpt, size, received)"
-		" VALUES (?, %llu, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+		"unsent, read, subject, sender, rcpt, size, received, "
+		"modseq) VALUES (?, %llu, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
 		LLU(folder_id));
 	pstmt = gx_sql_prep(pidb->psqlite, sql_string);
 	if (pstmt == nullptr)
 		return;	
 	mail_engine_insert_message(pstmt, &uidnext, message_id,
-		static_cast<const char *>(pvalue), message_flags, received_time, mod_time);
+		static_cast<const char *>(pvalue), message_flags, received_time,
+		mod_time, modseq);
 	pstmt.finalize();
 	if (NULL != strchr(flags_buff, 'F')) {
 		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET "
@@ -5549,6 +5869,7 @@ static void mail_engine_delete_notification_message(
 	    gx_sql_col_uint64(pstmt, 0) != folder_id)
 		return;
 	pstmt.finalize();
+	mail_engine_vanish_message(pidb->psqlite, message_id);
 	snprintf(sql_string, arsizeof(sql_string), "DELETE FROM messages"
 	        " WHERE message_id=%llu", LLU(message_id));
 	sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
@@ -5917,8 +6238,13 @@ static void mail_engine_modify_notification_message(
 		b_unsent = !!(message_flags & MSGFLAG_UNSENT);
 		b_read   = !!(message_flags & MSGFLAG_READ);
 		snprintf(sql_string, arsizeof(sql_string), "UPDATE messages SET read=%d, unsent=%d"
-		        " WHERE message_id=%llu", b_read, b_unsent, LLU(message_id));
-		sqlite3_exec(pidb->psqlite, sql_string, NULL, NULL, NULL);
+		        " WHERE message_id=%llu AND (read<>%d OR unsent<>%d)",
+		        b_read, b_unsent, LLU(message_id), b_read, b_unsent);
+		if (SQLITE_OK == sqlite3_exec(pidb->psqlite,
+			sql_string, NULL, NULL, NULL) &&
+			sqlite3_changes(pidb->psqlite) > 0) {
+			mail_engine_touch_message(pidb->psqlite, message_id);
+		}
 		return;
 	}
 	pvalue = common_util_get_propvals(&propvals, PR_LAST_MODIFICATION_TIME);
@@ -5937,6 +6263,7 @@ static void mail_engine_modify_notification_message(
 		goto UPDATE_MESSAGE_FLAGS;
 	}
 	pstmt.finalize();
+	mail_engine_vanish_message(pidb->psqlite, message_id);
 	snprintf(sql_string, arsizeof(sql_string), "DELETE FROM messages"
 	        " WHERE message_id=%llu", LLU(message_id));
 	if (SQLITE_OK != sqlite3_exec(pidb->psqlite,
@@ -5959,6 +6286,7 @@ static void mail_engine_notification_proc(const char *dir,
 	if (TRUE == b_table) {
 		return;
 	}
+	common_util_set_maildir(dir);
 	auto pidb = mail_engine_peek_idb(dir);
 	if (pidb == nullptr)
 		return;
@@ -6092,7 +6420,7 @@ int mail_engine_run()
 		printf("[mail_engine]: Failed to init oxcmail library\n");
 		return -1;
 	}
-	g_mime_pool = mime_pool_init(g_mime_num, FILENUM_PER_MIME, TRUE);
+	g_mime_pool = mime_pool_init(g_mime_num, TRUE);
 	if (NULL == g_mime_pool) {
 		printf("[mail_engine]: Failed to init MIME pool\n");
 		return -3;
@@ -6136,6 +6464,7 @@ int mail_engine_run()
 	cmd_parser_register_command("P-SFLG", mail_engine_psflg);
 	cmd_parser_register_command("P-RFLG", mail_engine_prflg);
 	cmd_parser_register_command("P-GFLG", mail_engine_pgflg);
+	cmd_parser_register_command("P-VNSH", mail_engine_pvnsh);
 	cmd_parser_register_command("P-SRHL", mail_engine_psrhl);
 	cmd_parser_register_command("P-SRHU", mail_engine_psrhu);
 	exmdb_client_register_proc(reinterpret_cast<void *>(mail_engine_notification_proc));
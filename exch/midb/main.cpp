@@ -5,6 +5,7 @@
 #include <atomic>
 #include <cerrno>
 #include <memory>
+#include <string>
 #include <libHX/option.h>
 #include <libHX/string.h>
 #include <gromox/defs.h>
@@ -365,7 +366,8 @@ int main(int argc, const char **argv)
 	common_util_init();
 	auto cl_0a = make_scope_exit([&]() { common_util_free(); });
 	
-	exmdb_client_init(proxy_num, stub_num);
+	exmdb_client_init(proxy_num, stub_num,
+		("midb:" + std::to_string(getpid())).c_str());
 	listener_init(listen_ip, listen_port);
 	auto cl_0b = make_scope_exit([&]() { listener_free(); });
 	mail_engine_init(charset, tmzone, org_name, table_size,
@@ -405,7 +407,10 @@ int main(int argc, const char **argv)
 		return 8;
 	}
 	auto cl_5 = make_scope_exit(mail_engine_stop);
-	if (exmdb_client_run(config_path) != 0) {
+	if (exmdb_client_run(config_path, EXMDB_CLIENT_SKIP_PUBLIC |
+	    EXMDB_CLIENT_SKIP_REMOTE,
+	    [](bool) { common_util_build_environment(""); },
+	    common_util_free_environment) != 0) {
 		printf("[system]: failed to run exmdb client\n");
 		return 9;
 	}
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Expunged UIDs for QRESYNC/VANISHED (RFC 7162). Each expunge leaves a row
+ * (folder_id, uid, modseq) in the "vanished" table. Only the newest
+ * VANISHED_KEEP rows of a folder are kept; folders.vanished_floor records
+ * the highest modseq pruned so far. A client whose modseq is below the
+ * floor cannot be answered from the table and gets a full resync instead:
+ * every UID up to UIDNEXT that no longer exists.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <gromox/database.h>
+#include <gromox/defs.h>
+#include <gromox/fileio.h>
+#include "vanished.h"
+#define LLU(x) static_cast<unsigned long long>(x)
+
+using namespace gromox;
+
+/* prune a folder every this many modseq steps */
+#define VANISHED_PRUNE_STEP				256
+
+namespace {
+
+struct VANISHED_PAGE {
+	char *buff;
+	size_t size, length;
+	uint32_t first_uid, last_uid; /* range being collected */
+	uint32_t done_uid;           /* end of the last range written */
+	BOOL b_stop;
+};
+
+}
+
+static BOOL vanished_flush(VANISHED_PAGE *ppage)
+{
+	char tmp_buff[24];
+
+	if (0 == ppage->first_uid) {
+		return TRUE;
+	}
+	int len = ppage->first_uid == ppage->last_uid ?
+	          gx_snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "%s%u",
+	          0 == ppage->length ? "" : ",", ppage->first_uid) :
+	          gx_snprintf(tmp_buff, GX_ARRAY_SIZE(tmp_buff), "%s%u:%u",
+	          0 == ppage->length ? "" : ",", ppage->first_uid,
+	          ppage->last_uid);
+	if (ppage->length + len >= ppage->size) {
+		/* page is full; the caller resumes after done_uid */
+		ppage->b_stop = TRUE;
+		return FALSE;
+	}
+	memcpy(ppage->buff + ppage->length, tmp_buff, len);
+	ppage->length += len;
+	ppage->buff[ppage->length] = '\0';
+	ppage->done_uid = ppage->last_uid;
+	ppage->first_uid = 0;
+	return TRUE;
+}
+
+static BOOL vanished_feed(VANISHED_PAGE *ppage, uint32_t first, uint32_t last)
+{
+	if (0 != ppage->first_uid) {
+		if (first <= ppage->last_uid || first - 1 == ppage->last_uid) {
+			if (last > ppage->last_uid) {
+				ppage->last_uid = last;
+			}
+			return TRUE;
+		}
+		if (FALSE == vanished_flush(ppage)) {
+			return FALSE;
+		}
+	}
+	ppage->first_uid = first;
+	ppage->last_uid = last;
+	return TRUE;
+}
+
+/* feed the parts of [first, last] that pass @filter */
+static void vanished_feed_range(VANISHED_PAGE *ppage, uint32_t first,
+	uint32_t last, VANISHED_FILTER filter, void *param)
+{
+	while (first <= last && FALSE == ppage->b_stop) {
+		uint32_t sub_first = first, sub_last = last;
+		if (NULL != filter && FALSE == filter(param, &sub_first, &sub_last)) {
+			return;
+		}
+		if (FALSE == vanished_feed(ppage, sub_first, sub_last) ||
+		    sub_last >= last) {
+			return;
+		}
+		first = sub_last + 1;
+	}
+}
+
+/* called with the modseq that the expunge advanced the folder to */
+void vanished_record(sqlite3 *psqlite, uint64_t folder_id,
+	uint32_t uid, uint64_t modseq)
+{
+	char sql_string[256];
+
+	snprintf(sql_string, arsizeof(sql_string), "INSERT INTO vanished "
+	        "(folder_id, uid, modseq) VALUES (%llu, %u, %llu)",
+	        LLU(folder_id), uid, LLU(modseq));
+	sqlite3_exec(psqlite, sql_string, NULL, NULL, NULL);
+	if (0 == modseq % VANISHED_PRUNE_STEP) {
+		vanished_prune(psqlite, folder_id, VANISHED_KEEP);
+	}
+}
+
+/* drop all but the newest @keep rows of a folder and raise its floor */
+BOOL vanished_prune(sqlite3 *psqlite, uint64_t folder_id, size_t keep)
+{
+	char sql_string[256];
+
+	snprintf(sql_string, arsizeof(sql_string), "SELECT modseq FROM "
+	         "vanished WHERE folder_id=%llu ORDER BY modseq DESC "
+	         "LIMIT 1 OFFSET %zu", LLU(folder_id), keep);
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr) {
+		return FALSE;
+	}
+	if (SQLITE_ROW != sqlite3_step(pstmt)) {
+		return TRUE;
+	}
+	auto cut = gx_sql_col_uint64(pstmt, 0);
+	pstmt.finalize();
+	snprintf(sql_string, arsizeof(sql_string), "DELETE FROM vanished "
+	         "WHERE folder_id=%llu AND modseq<=%llu", LLU(folder_id),
+	         LLU(cut));
+	if (SQLITE_OK != sqlite3_exec(psqlite,
+		sql_string, NULL, NULL, NULL)) {
+		return FALSE;
+	}
+	snprintf(sql_string, arsizeof(sql_string), "UPDATE folders SET "
+	         "vanished_floor=%llu WHERE folder_id=%llu AND "
+	         "vanished_floor<%llu", LLU(cut), LLU(folder_id), LLU(cut));
+	return SQLITE_OK == sqlite3_exec(psqlite,
+	       sql_string, NULL, NULL, NULL) ? TRUE : FALSE;
+}
+
+/*
+ * Write one page of the UIDs expunged after @modseq, starting above
+ * @after_uid, into @buff as a compact sequence set ("3:5,9"; empty if
+ * none).
+ *	@param
+ *		pb_full [out]		modseq is below the folder's floor (or
+ *							ahead of the folder, e.g. after midb.sqlite3
+ *							was rebuilt); the set then holds every UID
+ *							that no longer exists
+ *		plast [out]			0 when done, otherwise the UID to pass as
+ *							@after_uid for the next page
+ */
+BOOL vanished_page(sqlite3 *psqlite, uint64_t folder_id, uint64_t modseq,
+	uint32_t after_uid, VANISHED_FILTER filter, void *param, char *buff,
+	size_t size, BOOL *pb_full, uint32_t *plast)
+{
+	char sql_string[256];
+	VANISHED_PAGE page{buff, size};
+
+	if (size < 24) {
+		return FALSE;
+	}
+	buff[0] = '\0';
+	snprintf(sql_string, arsizeof(sql_string), "SELECT uidnext, modseq,"
+	         " vanished_floor FROM folders WHERE folder_id=%llu",
+	         LLU(folder_id));
+	auto pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr || SQLITE_ROW != sqlite3_step(pstmt)) {
+		return FALSE;
+	}
+	uint32_t uidnext = sqlite3_column_int64(pstmt, 0);
+	auto highest = gx_sql_col_uint64(pstmt, 1);
+	auto floor = gx_sql_col_uint64(pstmt, 2);
+	pstmt.finalize();
+	*pb_full = modseq < floor || modseq > highest ? TRUE : false;
+	if (FALSE == *pb_full) {
+		snprintf(sql_string, arsizeof(sql_string), "SELECT uid FROM "
+		         "vanished WHERE folder_id=%llu AND modseq>%llu AND "
+		         "uid>%u ORDER BY uid", LLU(folder_id), LLU(modseq),
+		         after_uid);
+	} else {
+		snprintf(sql_string, arsizeof(sql_string), "SELECT uid FROM "
+		         "messages WHERE folder_id=%llu AND uid>%u ORDER BY uid",
+		         LLU(folder_id), after_uid);
+	}
+	pstmt = gx_sql_prep(psqlite, sql_string);
+	if (pstmt == nullptr) {
+		return FALSE;
+	}
+	/* in full mode, the gaps between existing UIDs are what vanished */
+	uint64_t next_gap = static_cast<uint64_t>(after_uid) + 1;
+	while (FALSE == page.b_stop) {
+		int ret = sqlite3_step(pstmt);
+		if (SQLITE_ROW != ret && SQLITE_DONE != ret) {
+			return FALSE;
+		}
+		if (FALSE == *pb_full) {
+			if (SQLITE_DONE == ret) {
+				break;
+			}
+			uint32_t uid = sqlite3_column_int64(pstmt, 0);
+			vanished_feed_range(&page, uid, uid, filter, param);
+			continue;
+		}
+		uint64_t gap_end = SQLITE_ROW == ret ?
+		                   sqlite3_column_int64(pstmt, 0) :
+		                   static_cast<uint64_t>(uidnext) + 1;
+		if (next_gap < gap_end) {
+			vanished_feed_range(&page, next_gap, gap_end - 1,
+				filter, param);
+		}
+		next_gap = gap_end + 1;
+		if (SQLITE_DONE == ret) {
+			break;
+		}
+	}
+	if (FALSE == page.b_stop) {
+		vanished_flush(&page);
+	}
+	*plast = TRUE == page.b_stop ? page.done_uid : 0;
+	return TRUE;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <sqlite3.h>
+#include <gromox/common_types.hpp>
+
+/* number of expunged UIDs remembered per folder */
+#define VANISHED_KEEP					10000
+
+/*
+ * UID filter applied by vanished_page, e.g. a client's known-uids: narrows
+ * [*pfirst, *plast] to its lowest part that passes, FALSE if none does.
+ */
+typedef BOOL (*VANISHED_FILTER)(void *param, uint32_t *pfirst, uint32_t *plast);
+
+extern void vanished_record(sqlite3 *psqlite, uint64_t folder_id, uint32_t uid, uint64_t modseq);
+extern BOOL vanished_prune(sqlite3 *psqlite, uint64_t folder_id, size_t keep);
+extern BOOL vanished_page(sqlite3 *psqlite, uint64_t folder_id, uint64_t modseq, uint32_t after_uid, VANISHED_FILTER filter, void *param, char *buff, size_t size, BOOL *pb_full, uint32_t *plast);
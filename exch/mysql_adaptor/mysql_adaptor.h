@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <gromox/common_types.hpp>
+#include <gromox/sql_types.hpp>
 
 enum {
 	USER_PRIVILEGE_POP3_IMAP = 1 << 0,
@@ -22,27 +23,6 @@ struct mysql_adaptor_init_param {
 	bool enable_firsttimepw = false;
 };
 
-struct sql_domain {
-	std::string name, title, address;
-};
-
-struct sql_user {
-	int addr_type = 0, id = 0, list_type = 0, list_priv = 0;
-	std::string username, maildir;
-	std::vector<std::string> aliases; /* email addresses */
-	std::map<unsigned int, std::string> propvals;
-};
-
-struct sql_group {
-	int id;
-	std::string name, title;
-};
-
-struct sql_class {
-	int child_id;
-	std::string name;
-};
-
 extern void mysql_adaptor_init(mysql_adaptor_init_param &&);
 extern int mysql_adaptor_run();
 extern void mysql_adaptor_stop();
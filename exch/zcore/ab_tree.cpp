@@ -12,6 +12,8 @@
 #include <vector>
 #include <cstdint>
 #include <libHX/string.h>
+#include <gromox/ab_base_cache.hpp>
+#include <gromox/ab_domain_tree.hpp>
 #include <gromox/defs.h>
 #include <gromox/mapidefs.h>
 #include <gromox/util.hpp>
@@ -45,9 +47,6 @@
 /* composed value, not in database, means ADDRESS_TYPE_NORMAL and SUB_TYPE_EQUIPMENT */
 #define ADDRESS_TYPE_EQUIPMENT				5
 
-#define BASE_STATUS_CONSTRUCTING			0
-#define BASE_STATUS_LIVING					1
-#define BASE_STATUS_DESTRUCTING				2
 
 #define MLIST_TYPE_NORMAL 					0
 #define MLIST_TYPE_GROUP					1
@@ -96,13 +95,11 @@ struct SORT_ITEM {
 
 }
 
-static size_t g_base_size;
-static int g_file_blocks, g_ab_cache_interval;
+static int g_file_blocks;
 static std::atomic<bool> g_notify_stop{false};
 static pthread_t g_scan_id;
 static char g_zcab_org_name[256];
-static std::unordered_map<int, AB_BASE> g_base_hash;
-static std::mutex g_base_lock;
+static ab_base_cache<AB_BASE> g_base_cache;
 static LIB_BUFFER *g_file_allocator;
 static const uint8_t g_guid_nspi[] = {0xDC, 0xA7, 0x40, 0xC8,
 									   0xC0, 0x42, 0x10, 0x1A,
@@ -200,8 +197,7 @@ void ab_tree_init(const char *org_name, int base_size,
 	int cache_interval, int file_blocks)
 {
 	gx_strlcpy(g_zcab_org_name, org_name, arsizeof(g_zcab_org_name));
-	g_base_size = base_size;
-	g_ab_cache_interval = cache_interval;
+	g_base_cache.init("zcore", base_size, cache_interval);
 	g_file_blocks = file_blocks;
 	g_notify_stop = true;
 }
@@ -258,10 +254,8 @@ void AB_BASE::unload()
 	auto pbase = this;
 	SINGLE_LIST_NODE *pnode;
 	
-	while ((pnode = single_list_pop_front(&pbase->list)) != nullptr) {
-		ab_tree_destruct_tree(&((DOMAIN_NODE*)pnode->pdata)->tree);
-		free(pnode->pdata);
-	}
+	while ((pnode = single_list_pop_front(&pbase->list)) != nullptr)
+		delete static_cast<DOMAIN_NODE *>(pnode->pdata);
 	while ((pnode = single_list_pop_front(&pbase->gal_list)) != nullptr)
 		ab_tree_put_snode(pnode);
 	if (NULL != pbase->phash) {
@@ -277,7 +271,7 @@ void ab_tree_stop()
 		pthread_kill(g_scan_id, SIGALRM);
 		pthread_join(g_scan_id, NULL);
 	}
-	g_base_hash.clear();
+	g_base_cache.clear();
 	if (NULL != g_file_allocator) {
 		lib_buffer_free(g_file_allocator);
 		g_file_allocator = NULL;
@@ -331,8 +325,8 @@ static BOOL ab_tree_load_user(AB_NODE *pabnode, sql_user &&usr, AB_BASE *pbase)
 	}
 	pabnode->id = usr.id;
 	pabnode->minid = ab_tree_make_minid(MINID_TYPE_ADDRESS, usr.id);
-	((SIMPLE_TREE_NODE*)pabnode)->pdata = int_hash_query(
-							pbase->phash, pabnode->minid);
+	auto ppnode = static_cast<SIMPLE_TREE_NODE **>(int_hash_query(pbase->phash, pabnode->minid));
+	((SIMPLE_TREE_NODE*)pabnode)->pdata = ppnode != nullptr ? *ppnode : nullptr;
 	if (reinterpret_cast<SIMPLE_TREE_NODE *>(pabnode)->pdata == nullptr &&
 	    !ab_tree_cache_node(pbase, pabnode))
 		return FALSE;
@@ -345,8 +339,8 @@ static BOOL ab_tree_load_mlist(AB_NODE *pabnode, sql_user &&usr, AB_BASE *pbase)
 	pabnode->node_type = NODE_TYPE_MLIST;
 	pabnode->id = usr.id;
 	pabnode->minid = ab_tree_make_minid(MINID_TYPE_ADDRESS, usr.id);
-	((SIMPLE_TREE_NODE*)pabnode)->pdata = int_hash_query(
-							pbase->phash, pabnode->minid);
+	auto ppnode = static_cast<SIMPLE_TREE_NODE **>(int_hash_query(pbase->phash, pabnode->minid));
+	((SIMPLE_TREE_NODE*)pabnode)->pdata = ppnode != nullptr ? *ppnode : nullptr;
 	if (reinterpret_cast<SIMPLE_TREE_NODE *>(pabnode)->pdata == nullptr &&
 	    !ab_tree_cache_node(pbase, pabnode))
 		return FALSE;
@@ -359,45 +353,39 @@ static int ab_tree_cmpstring(const void *p1, const void *p2)
 	return strcasecmp(((SORT_ITEM*)p1)->string, ((SORT_ITEM*)p2)->string);
 }
 
-static BOOL ab_tree_load_class(
-	int class_id, SIMPLE_TREE *ptree,
-	SIMPLE_TREE_NODE *pnode, AB_BASE *pbase)
+static BOOL ab_tree_load_class(ab_class_rows &cr, SIMPLE_TREE *ptree,
+    SIMPLE_TREE_NODE *pnode, AB_BASE *pbase)
 {
 	int i;
 	int rows;
 	AB_NODE *pabnode;
 	char temp_buff[1024];
-	std::vector<sql_class> file_subclass;
 	SIMPLE_TREE_NODE *pclass;
 	
-	if (!system_services_get_sub_classes(class_id, file_subclass))
-		return FALSE;
-	for (auto &&cls : file_subclass) {
+	for (auto &&sub : cr.sub) {
 		pabnode = ab_tree_get_abnode();
 		if (NULL == pabnode) {
 			return FALSE;
 		}
 		pabnode->node_type = NODE_TYPE_CLASS;
-		pabnode->id = cls.child_id;
-		pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, cls.child_id);
+		pabnode->id = sub.cls.child_id;
+		pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, sub.cls.child_id);
 		if (int_hash_query(pbase->phash, pabnode->minid) == nullptr &&
 		    !ab_tree_cache_node(pbase, pabnode))
 			return FALSE;
-		pabnode->d_info = new(std::nothrow) sql_class(std::move(cls));
+		pabnode->d_info = new(std::nothrow) sql_class(std::move(sub.cls));
 		if (pabnode->d_info == nullptr)
 			return false;
 		pclass = (SIMPLE_TREE_NODE*)pabnode;
 		simple_tree_add_child(ptree, pnode,
 			pclass, SIMPLE_TREE_ADD_LAST);
-		if (!ab_tree_load_class(cls.child_id, ptree, pclass, pbase))
+		if (!ab_tree_load_class(sub, ptree, pclass, pbase))
 			return FALSE;
 	}
 
-	std::vector<sql_user> file_user;
-	rows = system_services_get_class_users(class_id, file_user);
-	if (-1 == rows) {
-		return FALSE;
-	} else if (0 == rows) {
+	auto &file_user = cr.users;
+	rows = file_user.size();
+	if (0 == rows) {
 		return TRUE;
 	}
 	auto parray = me_alloc<SORT_ITEM>(rows);
@@ -448,21 +436,19 @@ static BOOL ab_tree_load_class(
 	return FALSE;
 }
 
-static BOOL ab_tree_load_tree(int domain_id,
+static BOOL ab_tree_load_tree(ab_domain_rows &&dr, int domain_id,
 	SIMPLE_TREE *ptree, AB_BASE *pbase)
 {
 	int i;
 	int rows;
 	AB_NODE *pabnode;
 	SORT_ITEM *parray;
-	sql_domain dinfo;
 	SIMPLE_TREE_NODE *pgroup;
 	SIMPLE_TREE_NODE *pclass;
 	SIMPLE_TREE_NODE *pdomain;
 	
     {
-	if (!system_services_get_domain_info(domain_id, dinfo))
-		return FALSE;
+	auto &dinfo = dr.info;
 	pabnode = ab_tree_get_abnode();
 	if (NULL == pabnode) {
 		return FALSE;
@@ -485,10 +471,8 @@ static BOOL ab_tree_load_tree(int domain_id,
 	pdomain = (SIMPLE_TREE_NODE*)pabnode;
 	simple_tree_set_root(ptree, pdomain);
 
-	std::vector<sql_group> file_group;
-	if (!system_services_get_domain_groups(domain_id, file_group))
-		return FALSE;
-	for (auto &&grp : file_group) {
+	for (auto &&gr : dr.groups) {
+		auto &grp = gr.grp;
 		pabnode = ab_tree_get_abnode();
 		if (NULL == pabnode) {
 			return FALSE;
@@ -499,44 +483,38 @@ static BOOL ab_tree_load_tree(int domain_id,
 		if (FALSE == ab_tree_cache_node(pbase, pabnode)) {
 			return FALSE;
 		}
-		auto grp_id = grp.id;
 		pabnode->d_info = new(std::nothrow) sql_group(std::move(grp));
 		if (pabnode->d_info == nullptr)
 			return false;
 		pgroup = (SIMPLE_TREE_NODE*)pabnode;
 		simple_tree_add_child(ptree, pdomain, pgroup, SIMPLE_TREE_ADD_LAST);
 		
-		std::vector<sql_class> file_class;
-		if (!system_services_get_group_classes(grp_id, file_class))
-			return FALSE;
-		for (auto &&cls : file_class) {
+		for (auto &&cr : gr.classes) {
 			pabnode = ab_tree_get_abnode();
 			if (NULL == pabnode) {
 				return FALSE;
 			}
 			pabnode->node_type = NODE_TYPE_CLASS;
-			pabnode->id = cls.child_id;
-			pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, cls.child_id);
+			pabnode->id = cr.cls.child_id;
+			pabnode->minid = ab_tree_make_minid(MINID_TYPE_CLASS, cr.cls.child_id);
 			if (int_hash_query(pbase->phash, pabnode->minid) == nullptr &&
 			    !ab_tree_cache_node(pbase, pabnode)) {
 				ab_tree_put_abnode(pabnode);
 				return FALSE;
 			}
-			pabnode->d_info = new(std::nothrow) sql_class(std::move(cls));
+			pabnode->d_info = new(std::nothrow) sql_class(std::move(cr.cls));
 			if (pabnode->d_info == nullptr)
 				return false;
 			pclass = (SIMPLE_TREE_NODE*)pabnode;
 			simple_tree_add_child(ptree, pgroup,
 				pclass, SIMPLE_TREE_ADD_LAST);
-			if (!ab_tree_load_class(cls.child_id, ptree, pclass, pbase))
+			if (!ab_tree_load_class(cr, ptree, pclass, pbase))
 				return FALSE;
 		}
 		
-		std::vector<sql_user> file_user;
-		rows = system_services_get_group_users(grp_id, file_user);
-		if (-1 == rows) {
-			return FALSE;
-		} else if (0 == rows) {
+		auto &file_user = gr.users;
+		rows = file_user.size();
+		if (0 == rows) {
 			continue;
 		}
 		parray = me_alloc<SORT_ITEM>(rows);
@@ -580,11 +558,9 @@ static BOOL ab_tree_load_tree(int domain_id,
 		free(parray);
 	}
 
-	std::vector<sql_user> file_user;
-	rows = system_services_get_domain_users(domain_id, file_user);
-	if (-1 == rows) {
-		return FALSE;
-	} else if (0 == rows) {
+	auto &file_user = dr.users;
+	rows = file_user.size();
+	if (0 == rows) {
 		return TRUE;
 	}
 	parray = me_alloc<SORT_ITEM>(rows);
@@ -657,7 +633,7 @@ static void ab_tree_enum_nodes(SIMPLE_TREE_NODE *pnode, void *pparam)
 	single_list_append_as_tail((SINGLE_LIST*)pparam, psnode);
 }
 
-static BOOL ab_tree_load_base(AB_BASE *pbase)
+static BOOL ab_tree_load_base(AB_BASE *pbase, const AB_BASE *prev)
 {
 	int i, num;
 	SORT_ITEM *parray;
@@ -665,43 +641,29 @@ static BOOL ab_tree_load_base(AB_BASE *pbase)
 	char temp_buff[1024];
 	SIMPLE_TREE_NODE *proot;
 	SINGLE_LIST_NODE *pnode;
+	const ab_sql_ops ops = {system_services_get_domain_info,
+		system_services_get_domain_groups,
+		system_services_get_group_classes,
+		system_services_get_sub_classes,
+		system_services_get_class_users,
+		system_services_get_group_users,
+		system_services_get_domain_users};
+	auto load_domain = [&](int domain_id) {
+		return ab_tree_load_domain<AB_NODE, DOMAIN_NODE>(pbase, domain_id,
+		       prev, ops, ab_tree_destruct_tree, ab_tree_load_tree,
+		       ab_tree_cache_node);
+	};
 	
 	if (pbase->base_id > 0) {
 		std::vector<int> temp_file;
 		if (!system_services_get_org_domains(pbase->base_id, temp_file))
 			return FALSE;
-		for (auto domain_id : temp_file) {
-			pdomain = me_alloc<DOMAIN_NODE>();
-			if (NULL == pdomain) {
-				return FALSE;
-			}
-			pdomain->node.pdata = pdomain;
-			pdomain->domain_id = domain_id;
-			simple_tree_init(&pdomain->tree);
-			if (FALSE == ab_tree_load_tree(
-				domain_id, &pdomain->tree, pbase)) {
-				ab_tree_destruct_tree(&pdomain->tree);
-				free(pdomain);
+		for (auto domain_id : temp_file)
+			if (!load_domain(domain_id))
 				return FALSE;
-			}
-			single_list_append_as_tail(&pbase->list, &pdomain->node);
-		}
 	} else {
-		pdomain = me_alloc<DOMAIN_NODE>();
-		if (NULL == pdomain) {
+		if (!load_domain(-pbase->base_id))
 			return FALSE;
-		}
-		pdomain->node.pdata = pdomain;
-		int domain_id = -pbase->base_id;
-		pdomain->domain_id = domain_id;
-		simple_tree_init(&pdomain->tree);
-		if (FALSE == ab_tree_load_tree(
-			domain_id, &pdomain->tree, pbase)) {
-			ab_tree_destruct_tree(&pdomain->tree);
-			free(pdomain);
-			return FALSE;
-		}
-		single_list_append_as_tail(&pbase->list, &pdomain->node);
 	}
 	for (pnode=single_list_get_head(&pbase->list); NULL!=pnode;
 		pnode=single_list_get_after(&pbase->list, pnode)) {
@@ -748,109 +710,27 @@ static BOOL ab_tree_load_base(AB_BASE *pbase)
 	return TRUE;
 }
 
-AB_BASE_REF ab_tree_get_base(int base_id)
+static AB_BASE_REF ab_tree_build_base(int base_id, const AB_BASE *prev)
 {
-	int count;
-	AB_BASE *pbase;
-	
-	count = 0;
- RETRY_LOAD_BASE:
-	std::unique_lock bl_hold(g_base_lock);
-	auto it = g_base_hash.find(base_id);
-	if (it == g_base_hash.cend()) {
-		if (g_base_hash.size() >= g_base_size) {
-			printf("[exchange_nsp]: W-1290: AB base hash is full\n");
-			return nullptr;
-		}
-		try {
-			auto xp = g_base_hash.try_emplace(base_id);
-			if (!xp.second)
-				return nullptr;
-			it = xp.first;
-			pbase = &it->second;
-		} catch (const std::bad_alloc &) {
-			return nullptr;
-		}
-		pbase->base_id = base_id;
-		pbase->status = BASE_STATUS_CONSTRUCTING;
-		single_list_init(&pbase->list);
-		single_list_init(&pbase->gal_list);
-		bl_hold.unlock();
-		if (FALSE == ab_tree_load_base(pbase)) {
-			pbase->unload();
-			bl_hold.lock();
-			g_base_hash.erase(it);
-			return nullptr;
-		}
-		time(&pbase->load_time);
-		bl_hold.lock();
-		pbase->status = BASE_STATUS_LIVING;
-	} else {
-		pbase = &it->second;
-		if (pbase->status != BASE_STATUS_LIVING) {
-			bl_hold.unlock();
-			count ++;
-			if (count > 60) {
-				return nullptr;
-			}
-			sleep(1);
-			goto RETRY_LOAD_BASE;
-		}
-	}
-	pbase->reference ++;
-	return AB_BASE_REF(pbase);
+	auto pbase = std::make_shared<AB_BASE>();
+	pbase->base_id = base_id;
+	single_list_init(&pbase->list);
+	single_list_init(&pbase->gal_list);
+	if (!ab_tree_load_base(pbase.get(), prev))
+		return nullptr;
+	return pbase;
 }
 
-void ab_tree_del::operator()(AB_BASE *pbase)
+AB_BASE_REF ab_tree_get_base(int base_id)
 {
-	std::unique_lock bl_hold(g_base_lock);
-	pbase->reference --;
+	return g_base_cache.get(base_id, ab_tree_build_base);
 }
 
 static void *zcoreab_scanwork(void *param)
 {
-	SINGLE_LIST_NODE *pnode;
-	
-	while (!g_notify_stop) {
-		AB_BASE *pbase = nullptr;
-		auto now = time(nullptr);
-		std::unique_lock bl_hold(g_base_lock);
-		for (auto &pair : g_base_hash) {
-			if (pair.second.status != BASE_STATUS_LIVING ||
-			    pair.second.reference != 0 ||
-			    now - pair.second.load_time < g_ab_cache_interval)
-				continue;
-			pbase = &pair.second;
-			pbase->status = BASE_STATUS_CONSTRUCTING;
-			break;
-		}
-		bl_hold.unlock();
-		if (NULL == pbase) {
+	while (!g_notify_stop)
+		if (!g_base_cache.refresh_one(ab_tree_build_base))
 			sleep(1);
-			continue;
-		}
-		while ((pnode = single_list_pop_front(&pbase->list)) != nullptr) {
-			ab_tree_destruct_tree(&((DOMAIN_NODE*)pnode->pdata)->tree);
-			free(pnode->pdata);
-		}
-		while ((pnode = single_list_pop_front(&pbase->gal_list)) != nullptr)
-			ab_tree_put_snode(pnode);
-		if (NULL != pbase->phash) {
-			int_hash_free(pbase->phash);
-			pbase->phash = NULL;
-		}
-		if (FALSE == ab_tree_load_base(pbase)) {
-			pbase->unload();
-			bl_hold.lock();
-			g_base_hash.erase(pbase->base_id);
-			bl_hold.unlock();
-		} else {
-			bl_hold.lock();
-			time(&pbase->load_time);
-			pbase->status = BASE_STATUS_LIVING;
-			bl_hold.unlock();
-		}
-	}
 	return NULL;
 }
 
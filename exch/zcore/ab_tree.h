@@ -1,5 +1,4 @@
 #pragma once
-#include <atomic>
 #include <cstdint>
 #include <ctime>
 #include <memory>
@@ -39,10 +38,14 @@
 #define MINID_TYPE_GROUP					0x5
 #define MINID_TYPE_CLASS					0x6
 
+namespace gromox { struct ab_domain_tree; }
+
 struct DOMAIN_NODE {
 	SINGLE_LIST_NODE node;
-	int domain_id;
-	SIMPLE_TREE tree;
+	int domain_id = 0;
+	SIMPLE_TREE tree{};
+	/* owns the nodes of @tree; shared with later bases while unchanged */
+	std::shared_ptr<gromox::ab_domain_tree> owner;
 };
 
 struct AB_BASE {
@@ -50,18 +53,12 @@ struct AB_BASE {
 	~AB_BASE() { unload(); }
 	void unload();
 
-	std::atomic<int> status{0}, reference{0};
-	time_t load_time = 0;
 	int base_id = 0;
 	SINGLE_LIST list{}, gal_list{};
 	INT_HASH_TABLE *phash = nullptr;
 };
 
-struct ab_tree_del {
-	void operator()(AB_BASE *);
-};
-
-using AB_BASE_REF = std::unique_ptr<AB_BASE, ab_tree_del>;
+using AB_BASE_REF = std::shared_ptr<AB_BASE>;
 
 void ab_tree_init(const char *org_name, int base_size,
 	int cache_interval, int file_blocks);
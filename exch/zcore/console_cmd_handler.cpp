@@ -26,7 +26,9 @@ static char g_server_help[] =
 static char g_zcore_help[] =
 	"250 ZCORE DAEMON zcore control help information:\r\n"
 	"\tzcore info\r\n"
-	"\t    --print the http parser info";
+	"\t    --print the http parser info\r\n"
+	"\tzcore proxy\r\n"
+	"\t    --print the exmdb connection statistics";
 
 static char g_system_help[] =
 	"250 ZCORE DAEMON system help information:\r\n"
@@ -69,6 +71,12 @@ BOOL cmd_handler_zcore_control(int argc, char** argv)
 			exmdb_client_get_param(LOST_PROXY_CONNECTIONS));
 		return TRUE;
 	}
+	if (2 == argc && 0 == strcmp(argv[1], "proxy")) {
+		char buf[TALK_BUFFER_LEN];
+		exmdb_client_get_stats(buf, GX_ARRAY_SIZE(buf));
+		console_server_reply_to_client("250 exmdb connections:\r\n%s", buf);
+		return TRUE;
+	}
 	console_server_reply_to_client("550 invalid argument %s", argv[1]);
 	return TRUE;
 }
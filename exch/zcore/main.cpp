@@ -8,6 +8,7 @@
 #include <cerrno>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <libHX/option.h>
 #include <libHX/string.h>
 #include <gromox/exmdb_rpc.hpp>
@@ -387,7 +388,8 @@ int main(int argc, const char **argv)
 	}
 	printf("[system]: exmdb notify stub threads number is %d\n", stub_num);
 	
-	exmdb_client_init(proxy_num, stub_num);
+	exmdb_client_init(proxy_num, stub_num,
+		("zcore:" + std::to_string(getpid())).c_str());
 	str_value = config_file_get_value(pconfig, "ZARAFA_THREADS_NUM");
 	if (NULL == str_value) {
 		threads_num = 100;
@@ -526,7 +528,9 @@ int main(int argc, const char **argv)
 		return 10;
 	}
 	auto cl_7 = make_scope_exit(zarafa_server_stop);
-	if (exmdb_client_run(config_path) != 0) {
+	if (exmdb_client_run(config_path, EXMDB_CLIENT_NO_FLAGS,
+	    [](bool) { common_util_build_environment(); },
+	    common_util_free_environment) != 0) {
 		printf("[system]: failed to run exmdb client\n");
 		return 11;
 	}
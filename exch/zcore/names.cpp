@@ -94,13 +94,14 @@ static constexpr const char *zcore_rpc_names[] = {
 	E(GETUSERAVAILABILITY),
 	E(SETPASSWD),
 	E(LINKMESSAGE),
+	E(KEEPALIVE),
 };
 #undef E
 #undef EXP
 
 const char *zcore_rpc_idtoname(unsigned int i)
 {
-	static_assert(GX_ARRAY_SIZE(zcore_rpc_names) == zcore_callid::LINKMESSAGE + 1);
+	static_assert(GX_ARRAY_SIZE(zcore_rpc_names) == zcore_callid::KEEPALIVE + 1);
 	const char *s = i < GX_ARRAY_SIZE(zcore_rpc_names) ? zcore_rpc_names[i] : nullptr;
 	return s != nullptr ? s : "";
 }
@@ -1,9 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
 #include <atomic>
+#include <cerrno>
 #include <condition_variable>
 #include <csignal>
 #include <cstdint>
+#include <ctime>
 #include <mutex>
+#include <unordered_map>
 #include <gromox/defs.h>
 #include <gromox/zcore_rpc.hpp>
 #include <gromox/idset.hpp>
@@ -12,6 +15,7 @@
 #include "common_util.h"
 #include "zarafa_server.h"
 #include <gromox/mapi_types.hpp>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <pthread.h>
 #include <cstdlib>
@@ -20,6 +24,9 @@
 #include <cstdio>
 #include <poll.h>
 
+/* seconds a persistent connection may stay idle */
+#define KEEPALIVE_TIMEOUT				300
+
 using RPC_REQUEST = ZCORE_RPC_REQUEST;
 using RPC_RESPONSE = ZCORE_RPC_RESPONSE;
 
@@ -33,6 +40,7 @@ namespace {
 struct CLIENT_NODE {
 	DOUBLE_LIST_NODE node;
 	int clifd;
+	BOOL b_persistent;
 };
 }
 
@@ -42,6 +50,11 @@ static pthread_t *g_thread_ids;
 static DOUBLE_LIST g_conn_list;
 static std::condition_variable g_waken_cond;
 static std::mutex g_conn_lock, g_cond_mutex;
+static int g_epoll_fd = -1;
+static pthread_t g_idle_tid;
+static std::mutex g_idle_lock;
+/* persistent connections between requests, with the time they were parked */
+static std::unordered_map<int, time_t> g_idle_conns;
 unsigned int g_zrpc_debug;
 
 void rpc_parser_init(int thread_num)
@@ -50,7 +63,7 @@ void rpc_parser_init(int thread_num)
 	g_thread_num = thread_num;
 }
 
-BOOL rpc_parser_activate_connection(int clifd)
+static BOOL rpc_parser_enqueue(int clifd, BOOL b_persistent)
 {
 	auto pclient = me_alloc<CLIENT_NODE>();
 	if (NULL == pclient) {
@@ -58,6 +71,7 @@ BOOL rpc_parser_activate_connection(int clifd)
 	}
 	pclient->node.pdata = pclient;
 	pclient->clifd = clifd;
+	pclient->b_persistent = b_persistent;
 	std::unique_lock cl_hold(g_conn_lock);
 	double_list_append_as_tail(&g_conn_list, &pclient->node);
 	cl_hold.unlock();
@@ -65,6 +79,74 @@ BOOL rpc_parser_activate_connection(int clifd)
 	return TRUE;
 }
 
+BOOL rpc_parser_activate_connection(int clifd)
+{
+	return rpc_parser_enqueue(clifd, FALSE);
+}
+
+/*
+ * A client that sends a KEEPALIVE call once after connecting keeps the
+ * connection for any number of calls; each call is framed just as on a
+ * one-shot connection. Between calls, the connection waits in g_epoll_fd
+ * and is handed to the worker pool again once it turns readable. zcore
+ * servers predating this answer KEEPALIVE with PULL_ERROR, which tells the
+ * client to stay in one-shot mode.
+ */
+static void rpc_parser_park(int clifd)
+{
+	struct epoll_event ev{};
+	
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.fd = clifd;
+	std::lock_guard hold(g_idle_lock);
+	try {
+		g_idle_conns[clifd] = time(nullptr);
+	} catch (const std::bad_alloc &) {
+		close(clifd);
+		return;
+	}
+	if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, clifd, &ev) != 0) {
+		g_idle_conns.erase(clifd);
+		close(clifd);
+	}
+}
+
+static void *zcrp_idlework(void *param)
+{
+	int i, num;
+	time_t last_sweep = 0;
+	struct epoll_event events[64];
+	
+	while (!g_notify_stop) {
+		num = epoll_wait(g_epoll_fd, events, GX_ARRAY_SIZE(events), 1000);
+		std::unique_lock hold(g_idle_lock);
+		for (i=0; i<num; i++) {
+			auto clifd = events[i].data.fd;
+			epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, clifd, nullptr);
+			g_idle_conns.erase(clifd);
+			/* the next request, or EOF, which the worker will notice */
+			if (FALSE == rpc_parser_enqueue(clifd, TRUE)) {
+				close(clifd);
+			}
+		}
+		auto cur_time = time(nullptr);
+		if (cur_time == last_sweep) {
+			continue;
+		}
+		last_sweep = cur_time;
+		for (auto it = g_idle_conns.begin(); it != g_idle_conns.end(); ) {
+			if (cur_time - it->second < KEEPALIVE_TIMEOUT) {
+				++it;
+				continue;
+			}
+			epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, it->first, nullptr);
+			close(it->first);
+			it = g_idle_conns.erase(it);
+		}
+	}
+	return nullptr;
+}
+
 static int rpc_parser_dispatch(const RPC_REQUEST *prequest,
 	RPC_RESPONSE *presponse)
 {
@@ -657,6 +739,7 @@ static void *zcrp_thrwork(void *param)
 	RPC_REQUEST request;
 	struct pollfd fdpoll;
 	RPC_RESPONSE response;
+	BOOL b_persistent;
 	DOUBLE_LIST_NODE *pnode;
 
 
@@ -674,6 +757,7 @@ static void *zcrp_thrwork(void *param)
 		goto WAIT_CLIFD;
 	}
 	clifd = ((CLIENT_NODE*)pnode->pdata)->clifd;
+	b_persistent = ((CLIENT_NODE*)pnode->pdata)->b_persistent;
 	free(pnode->pdata);
 	
 	offset = 0;
@@ -718,6 +802,19 @@ static void *zcrp_thrwork(void *param)
 			break;
 		}
 	}
+	if (1 == buff_len && zcore_callid::KEEPALIVE ==
+		*static_cast<uint8_t *>(pbuff)) {
+		free(pbuff);
+		tmp_byte = zcore_response::SUCCESS;
+		fdpoll.events = POLLOUT|POLLWRBAND;
+		if (1 != poll(&fdpoll, 1, tv_msec) ||
+			1 != write(clifd, &tmp_byte, 1)) {
+			close(clifd);
+			goto NEXT_CLIFD;
+		}
+		rpc_parser_park(clifd);
+		goto NEXT_CLIFD;
+	}
 	common_util_build_environment();
 	tmp_bin.pv = pbuff;
 	tmp_bin.cb = buff_len;
@@ -764,6 +861,16 @@ static void *zcrp_thrwork(void *param)
 	}
 	common_util_free_environment();
 	fdpoll.events = POLLOUT|POLLWRBAND;
+	if (TRUE == b_persistent) {
+		if (1 == poll(&fdpoll, 1, tv_msec) &&
+			write(clifd, tmp_bin.pb, tmp_bin.cb) == static_cast<ssize_t>(tmp_bin.cb)) {
+			rpc_parser_park(clifd);
+		} else {
+			close(clifd);
+		}
+		free(tmp_bin.pb);
+		goto NEXT_CLIFD;
+	}
 	if (1 == poll(&fdpoll, 1, tv_msec)) {
 		write(clifd, tmp_bin.pb, tmp_bin.cb);
 	}
@@ -779,12 +886,27 @@ int rpc_parser_run()
 {
 	int i;
 	
+	g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (g_epoll_fd < 0) {
+		printf("[rpc_parser]: epoll_create: %s\n", strerror(errno));
+		return -1;
+	}
 	g_thread_ids = me_alloc<pthread_t>(g_thread_num);
 	if (NULL == g_thread_ids) {
+		close(g_epoll_fd);
+		g_epoll_fd = -1;
 		return -1;
 	}
 	g_notify_stop = false;
-	int ret = 0;
+	int ret = pthread_create(&g_idle_tid, nullptr, zcrp_idlework, nullptr);
+	if (ret != 0) {
+		free(g_thread_ids);
+		close(g_epoll_fd);
+		g_epoll_fd = -1;
+		printf("[rpc_parser]: failed to create idle thread: %s\n", strerror(ret));
+		return -2;
+	}
+	pthread_setname_np(g_idle_tid, "rpc/idle");
 	for (i=0; i<g_thread_num; i++) {
 		ret = pthread_create(&g_thread_ids[i], nullptr, zcrp_thrwork, nullptr);
 		if (ret != 0)
@@ -800,6 +922,9 @@ int rpc_parser_run()
 			pthread_join(g_thread_ids[i], nullptr);
 		}
 		free(g_thread_ids);
+		pthread_join(g_idle_tid, nullptr);
+		close(g_epoll_fd);
+		g_epoll_fd = -1;
 		printf("[rpc_parser]: failed to create pool thread: %s\n", strerror(ret));
 		return -2;
 	}
@@ -817,4 +942,10 @@ void rpc_parser_stop()
 		pthread_join(g_thread_ids[i], NULL);
 	}
 	free(g_thread_ids);
+	pthread_join(g_idle_tid, nullptr);
+	for (const auto &[clifd, since] : g_idle_conns)
+		close(clifd);
+	g_idle_conns.clear();
+	close(g_epoll_fd);
+	g_epoll_fd = -1;
 }
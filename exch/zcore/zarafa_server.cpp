@@ -1,16 +1,21 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
 // SPDX-FileCopyrightText: 2020–2021 grommunio GmbH
 // This file is part of Gromox.
+#include <algorithm>
 #include <atomic>
-#include <csignal>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <string>
+#include <string_view>
 #include <unistd.h>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 #include <sys/wait.h>
 #include <libHX/string.h>
 #include <gromox/defs.h>
@@ -71,20 +76,103 @@ struct user_info_del {
 	void operator()(USER_INFO *x);
 };
 
+/*
+ * Sessions, username mappings and notification items are spread over
+ * independently locked shards, so that RPCs for different users do not
+ * serialize on one table lock.
+ */
+struct session_shard {
+	std::mutex lock;
+	std::unordered_map<int, USER_INFO> sessions;
+};
+
+struct user_shard {
+	std::mutex lock;
+	std::unordered_map<std::string, int> users;
+};
+
+struct notify_shard {
+	std::mutex lock;
+	std::unordered_map<std::string, NOTIFY_ITEM> items;
+};
+
+/*
+ * Deadline of a session (user_id >= 0) or of a notification item (key).
+ * Entries are not removed when the deadline moves; the scan thread
+ * re-checks the object when an entry comes due.
+ */
+struct zs_timer {
+	time_t when;
+	int user_id;
+	std::string key;
+	bool operator>(const zs_timer &o) const { return when > o.when; }
+};
+
 }
 
 using USER_INFO_REF = std::unique_ptr<USER_INFO, user_info_del>;
 
+static constexpr size_t ZS_SHARDS = 16;
 static size_t g_table_size;
 static std::atomic<bool> g_notify_stop{false};
 static int g_ping_interval;
 static pthread_t g_scan_id;
 static int g_cache_interval;
 static pthread_key_t g_info_key;
-static std::mutex g_table_lock, g_notify_lock;
-static std::unordered_map<std::string, int> g_user_table;
-static std::unordered_map<std::string, NOTIFY_ITEM> g_notify_table;
-static std::unordered_map<int, USER_INFO> g_session_table;
+static session_shard g_session_shards[ZS_SHARDS];
+static user_shard g_user_shards[ZS_SHARDS];
+static notify_shard g_notify_shards[ZS_SHARDS];
+static std::atomic<size_t> g_session_count{0}, g_notify_count{0};
+static std::mutex g_timer_lock;
+static std::condition_variable g_timer_cond;
+static std::priority_queue<zs_timer, std::vector<zs_timer>,
+       std::greater<zs_timer>> g_timer_heap;
+
+static session_shard &zs_session_shard(int user_id)
+{
+	return g_session_shards[static_cast<unsigned int>(user_id) % ZS_SHARDS];
+}
+
+static user_shard &zs_user_shard(std::string_view username)
+{
+	return g_user_shards[std::hash<std::string_view>{}(username) % ZS_SHARDS];
+}
+
+static notify_shard &zs_notify_shard(std::string_view key)
+{
+	return g_notify_shards[std::hash<std::string_view>{}(key) % ZS_SHARDS];
+}
+
+static void zs_timer_push(time_t when, int user_id, std::string &&key)
+{
+	std::lock_guard tm_hold(g_timer_lock);
+	bool b_earlier = g_timer_heap.empty() || when < g_timer_heap.top().when;
+	g_timer_heap.push(zs_timer{when, user_id, std::move(key)});
+	if (b_earlier)
+		g_timer_cond.notify_one();
+}
+
+/* caller holds the shard lock of @pinfo */
+static void zs_arm_session(USER_INFO *pinfo, time_t when)
+{
+	if (pinfo->timer_due != 0 && pinfo->timer_due <= when)
+		return;
+	try {
+		zs_timer_push(when, pinfo->user_id, {});
+		pinfo->timer_due = when;
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "E-1504: ENOMEM\n");
+	}
+}
+
+static void zs_arm_notify(const std::string &key, time_t when)
+{
+	try {
+		zs_timer_push(when, -1, std::string(key));
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "E-1505: ENOMEM\n");
+	}
+}
 
 USER_INFO::USER_INFO()
 {
@@ -97,6 +185,7 @@ USER_INFO::USER_INFO(USER_INFO &&o) :
 	lang(std::move(o.lang)), maildir(std::move(o.maildir)),
 	homedir(std::move(o.homedir)), cpid(o.cpid), flags(o.flags),
 	last_time(o.last_time), reload_time(o.reload_time),
+	ping_time(o.ping_time), timer_due(o.timer_due),
 	ptree(std::move(o.ptree)), sink_list(o.sink_list)
 {
 	o.sink_list = {};
@@ -133,9 +222,10 @@ static USER_INFO_REF zarafa_server_query_session(GUID hsession)
 	int user_id;
 	
 	user_id = zarafa_server_get_user_id(hsession);
-	std::unique_lock tl_hold(g_table_lock);
-	auto iter = g_session_table.find(user_id);
-	if (iter == g_session_table.end())
+	auto &shard = zs_session_shard(user_id);
+	std::unique_lock tl_hold(shard.lock);
+	auto iter = shard.sessions.find(user_id);
+	if (iter == shard.sessions.end())
 		return nullptr;
 	auto pinfo = &iter->second;
 	if (guid_compare(&hsession, &pinfo->hsession) != 0)
@@ -156,7 +246,7 @@ USER_INFO *zarafa_server_get_info()
 void user_info_del::operator()(USER_INFO *pinfo)
 {
 	pinfo->lock.unlock();
-	std::unique_lock tl_hold(g_table_lock);
+	std::unique_lock tl_hold(zs_session_shard(pinfo->user_id).lock);
 	pinfo->reference --;
 	tl_hold.unlock();
 	pthread_setspecific(g_info_key, NULL);
@@ -179,136 +269,175 @@ NOTIFY_ITEM::~NOTIFY_ITEM()
 	double_list_free(&notify_list);
 }
 
-static void *zcorezs_scanwork(void *param)
+/* next instant at which the timer thread has to look at @pinfo */
+static time_t zs_session_due(const USER_INFO *pinfo, time_t cur_time)
+{
+	auto due = pinfo->reload_time + g_cache_interval;
+	bool b_idle = cur_time - pinfo->last_time >= g_cache_interval;
+	if (double_list_get_nodes_num(&pinfo->sink_list) == 0)
+		due = std::min(due, pinfo->last_time + g_cache_interval);
+	if (!b_idle)
+		due = std::min(due, pinfo->ping_time);
+	for (auto pnode = double_list_get_head(&pinfo->sink_list); pnode != nullptr;
+	     pnode = double_list_get_after(&pinfo->sink_list, pnode))
+		due = std::min(due, static_cast<SINK_NODE *>(pnode->pdata)->until_time);
+	return std::max(due, cur_time + 1);
+}
+
+static void zs_sink_timeout(SINK_NODE *psink_node)
 {
-	int count;
-	int tv_msec;
 	BINARY tmp_bin;
-	time_t cur_time;
 	uint8_t tmp_byte;
 	struct pollfd fdpoll;
 	ZCORE_RPC_RESPONSE response;
-	SINK_NODE *psink_node;
-	DOUBLE_LIST temp_list;
-	DOUBLE_LIST temp_list1;
-	DOUBLE_LIST_NODE *pnode;
-	DOUBLE_LIST_NODE *ptail;
-	
-	count = 0;
-	double_list_init(&temp_list);
-	double_list_init(&temp_list1);
+
 	response.call_id = zcore_callid::NOTIFDEQUEUE;
 	response.result = ecSuccess;
 	response.payload.notifdequeue.notifications.count = 0;
 	response.payload.notifdequeue.notifications.ppnotification = NULL;
-	while (!g_notify_stop) {
-		sleep(1);
-		count ++;
-		if (count >= g_ping_interval) {
-			count = 0;
+	if (TRUE == rpc_ext_push_response(&response, &tmp_bin)) {
+		fdpoll.fd = psink_node->clifd;
+		fdpoll.events = POLLOUT|POLLWRBAND;
+		if (1 == poll(&fdpoll, 1, SOCKET_TIMEOUT * 1000)) {
+			write(psink_node->clifd, tmp_bin.pb, tmp_bin.cb);
 		}
-		std::unique_lock tl_hold(g_table_lock);
-		time(&cur_time);
-		for (auto iter = g_session_table.begin(); iter != g_session_table.end(); ) {
-			auto pinfo = &iter->second;
-			if (0 != pinfo->reference) {
-				++iter;
-				continue;
-			}
-			ptail = double_list_get_tail(&pinfo->sink_list);
-			while ((pnode = double_list_pop_front(&pinfo->sink_list)) != nullptr) {
-				psink_node = (SINK_NODE*)pnode->pdata;
-				if (cur_time >= psink_node->until_time) {
-					double_list_append_as_tail(&temp_list1, pnode);
-				} else {
-					double_list_append_as_tail(
-						&pinfo->sink_list, pnode);
-				}
-				if (pnode == ptail) {
-					break;
-				}
-			}
-			if (cur_time - pinfo->reload_time >= g_cache_interval) {
-				common_util_build_environment();
-				auto ptree = object_tree_create(pinfo->get_maildir());
-				if (NULL != ptree) {
-					pinfo->ptree = std::move(ptree);
-					pinfo->reload_time = cur_time;
-				}
-				common_util_free_environment();
-				++iter;
-				continue;
-			}
-			if (cur_time - pinfo->last_time < g_cache_interval) {
-				if (0 != count) {
-					++iter;
-					continue;
-				}
-				pnode = me_alloc<DOUBLE_LIST_NODE>();
-				if (pnode == nullptr) {
-					++iter;
-					continue;
-				}
-				pnode->pdata = strdup(pinfo->get_maildir());
-				if (NULL == pnode->pdata) {
-					free(pnode);
-					++iter;
-					continue;
-				}
-				double_list_append_as_tail(&temp_list, pnode);
-				++iter;
-			} else {
-				if (0 != double_list_get_nodes_num(&pinfo->sink_list)) {
-					++iter;
-					continue;
-				}
-				common_util_build_environment();
-				pinfo->ptree.reset();
-				common_util_free_environment();
-				double_list_free(&pinfo->sink_list);
-				g_user_table.erase(pinfo->username);
-				iter = g_session_table.erase(iter);
-			}
+		free(tmp_bin.pb);
+		shutdown(psink_node->clifd, SHUT_WR);
+		if (read(psink_node->clifd, &tmp_byte, 1))
+			/* ignore */;
+	}
+	close(psink_node->clifd);
+	free(psink_node->sink.padvise);
+	free(psink_node);
+}
+
+static void zs_session_timer(int user_id, time_t when)
+{
+	std::string ping_dir, drop_user;
+	DOUBLE_LIST expired_list;
+	DOUBLE_LIST_NODE *pnode, *ptail;
+	auto cur_time = time(nullptr);
+	auto &shard = zs_session_shard(user_id);
+
+	double_list_init(&expired_list);
+	std::unique_lock tl_hold(shard.lock);
+	auto iter = shard.sessions.find(user_id);
+	if (iter == shard.sessions.end())
+		return;
+	auto pinfo = &iter->second;
+	if (pinfo->timer_due != when)
+		return; /* superseded by an earlier deadline */
+	pinfo->timer_due = 0;
+	if (0 != pinfo->reference) {
+		zs_arm_session(pinfo, cur_time + 1);
+		return;
+	}
+	ptail = double_list_get_tail(&pinfo->sink_list);
+	while ((pnode = double_list_pop_front(&pinfo->sink_list)) != nullptr) {
+		if (cur_time >= static_cast<SINK_NODE *>(pnode->pdata)->until_time)
+			double_list_append_as_tail(&expired_list, pnode);
+		else
+			double_list_append_as_tail(&pinfo->sink_list, pnode);
+		if (pnode == ptail)
+			break;
+	}
+	if (cur_time - pinfo->last_time >= g_cache_interval &&
+	    double_list_get_nodes_num(&pinfo->sink_list) == 0) {
+		try {
+			drop_user = pinfo->username;
+		} catch (const std::bad_alloc &) {
+			fprintf(stderr, "E-1506: ENOMEM\n");
 		}
-		tl_hold.unlock();
-		while ((pnode = double_list_pop_front(&temp_list)) != nullptr) {
+		common_util_build_environment();
+		pinfo->ptree.reset();
+		common_util_free_environment();
+		double_list_free(&pinfo->sink_list);
+		shard.sessions.erase(iter);
+		--g_session_count;
+	} else {
+		if (cur_time - pinfo->reload_time >= g_cache_interval) {
 			common_util_build_environment();
-			exmdb_client::ping_store(static_cast<char *>(pnode->pdata));
+			auto ptree = object_tree_create(pinfo->get_maildir());
+			if (NULL != ptree) {
+				pinfo->ptree = std::move(ptree);
+				pinfo->reload_time = cur_time;
+			}
 			common_util_free_environment();
-			free(pnode->pdata);
-			free(pnode);
-		}
-		while ((pnode = double_list_pop_front(&temp_list1)) != nullptr) {
-			psink_node = (SINK_NODE*)pnode->pdata;
-			if (TRUE == rpc_ext_push_response(
-				&response, &tmp_bin)) {
-				tv_msec = SOCKET_TIMEOUT * 1000;
-				fdpoll.fd = psink_node->clifd;
-				fdpoll.events = POLLOUT|POLLWRBAND;
-				if (1 == poll(&fdpoll, 1, tv_msec)) {
-					write(psink_node->clifd, tmp_bin.pb, tmp_bin.cb);
-				}
-				free(tmp_bin.pb);
-				shutdown(psink_node->clifd, SHUT_WR);
-				if (read(psink_node->clifd, &tmp_byte, 1))
-					/* ignore */;
+		} else if (cur_time >= pinfo->ping_time &&
+		    cur_time - pinfo->last_time < g_cache_interval) {
+			try {
+				ping_dir = pinfo->maildir;
+			} catch (const std::bad_alloc &) {
+				fprintf(stderr, "E-1507: ENOMEM\n");
 			}
-			close(psink_node->clifd);
-			free(psink_node->sink.padvise);
-			free(psink_node);
+			pinfo->ping_time = cur_time + g_ping_interval;
 		}
-		if (0 != count) {
+		zs_arm_session(pinfo, zs_session_due(pinfo, cur_time));
+	}
+	tl_hold.unlock();
+	if (!drop_user.empty()) {
+		auto &ushard = zs_user_shard(drop_user);
+		std::lock_guard ul_hold(ushard.lock);
+		auto uiter = ushard.users.find(drop_user);
+		if (uiter != ushard.users.end() && uiter->second == user_id)
+			ushard.users.erase(uiter);
+	}
+	if (!ping_dir.empty()) {
+		common_util_build_environment();
+		exmdb_client::ping_store(ping_dir.c_str());
+		common_util_free_environment();
+	}
+	while ((pnode = double_list_pop_front(&expired_list)) != nullptr)
+		zs_sink_timeout(static_cast<SINK_NODE *>(pnode->pdata));
+	double_list_free(&expired_list);
+}
+
+static void zs_notify_timer(const std::string &key)
+{
+	auto cur_time = time(nullptr);
+	auto &shard = zs_notify_shard(key);
+	std::unique_lock nl_hold(shard.lock);
+	auto iter = shard.items.find(key);
+	if (iter == shard.items.end())
+		return;
+	auto due = iter->second.last_time + g_cache_interval;
+	if (cur_time >= due) {
+		shard.items.erase(iter);
+		--g_notify_count;
+		return;
+	}
+	nl_hold.unlock();
+	zs_arm_notify(key, due);
+}
+
+/*
+ * Sleeps until the earliest deadline in the timer heap. Sessions and
+ * notification items are only looked at when one of their deadlines
+ * (idle expiry, tree reload, store ping, sink timeout) has come.
+ */
+static void *zcorezs_scanwork(void *param)
+{
+	std::unique_lock tm_hold(g_timer_lock);
+	while (!g_notify_stop) {
+		if (g_timer_heap.empty()) {
+			g_timer_cond.wait(tm_hold);
 			continue;
 		}
-		time(&cur_time);
-		std::unique_lock nl_hold(g_notify_lock);
-		for (auto iter1 = g_notify_table.begin(); iter1 != g_notify_table.end(); ) {
-			auto pnitem = &iter1->second;
-			if (cur_time - pnitem->last_time >= g_cache_interval)
-				iter1 = g_notify_table.erase(iter1);
-			else
-				++iter1;
+		auto when = g_timer_heap.top().when;
+		if (time(nullptr) < when) {
+			g_timer_cond.wait_until(tm_hold,
+				std::chrono::system_clock::from_time_t(when));
+			continue;
 		}
+		/* ordering only looks at .when, so the key may be moved out */
+		auto entry = std::move(const_cast<zs_timer &>(g_timer_heap.top()));
+		g_timer_heap.pop();
+		tm_hold.unlock();
+		if (entry.user_id >= 0)
+			zs_session_timer(entry.user_id, entry.when);
+		else
+			zs_notify_timer(entry.key);
+		tm_hold.lock();
 	}
 	return NULL;
 }
@@ -345,9 +474,10 @@ static void zarafa_server_notification_proc(const char *dir,
 	if (b_table)
 		return;
 	snprintf(tmp_buff, arsizeof(tmp_buff), "%u|%s", notify_id, dir);
-	std::unique_lock nl_hold(g_notify_lock);
-	auto iter = g_notify_table.find(tmp_buff);
-	if (iter == g_notify_table.end())
+	auto &nshard = zs_notify_shard(tmp_buff);
+	std::unique_lock nl_hold(nshard.lock);
+	auto iter = nshard.items.find(tmp_buff);
+	if (iter == nshard.items.end())
 		return;
 	auto pitem = &iter->second;
 	hsession = pitem->hsession;
@@ -655,8 +785,8 @@ static void zarafa_server_notification_proc(const char *dir,
 		return;
 	}
 	nl_hold.lock();
-	iter = g_notify_table.find(tmp_buff);
-	pitem = iter != g_notify_table.end() ? &iter->second : nullptr;
+	iter = nshard.items.find(tmp_buff);
+	pitem = iter != nshard.items.end() ? &iter->second : nullptr;
 	if (pitem != nullptr)
 		double_list_append_as_tail(&pitem->notify_list, pnode);
 	nl_hold.unlock();
@@ -690,12 +820,20 @@ int zarafa_server_run()
 
 void zarafa_server_stop()
 {
+	std::unique_lock tm_hold(g_timer_lock);
 	g_notify_stop = true;
-	pthread_kill(g_scan_id, SIGALRM);
+	g_timer_cond.notify_one();
+	tm_hold.unlock();
 	pthread_join(g_scan_id, NULL);
-	g_session_table.clear();
-	g_user_table.clear();
-	g_notify_table.clear();
+	for (auto &shard : g_session_shards)
+		shard.sessions.clear();
+	for (auto &shard : g_user_shards)
+		shard.users.clear();
+	for (auto &shard : g_notify_shards)
+		shard.items.clear();
+	g_session_count = 0;
+	g_notify_count = 0;
+	g_timer_heap = {};
 }
 
 void zarafa_server_free()
@@ -709,7 +847,7 @@ int zarafa_server_get_param(int param)
 	case USER_TABLE_SIZE:
 		return g_table_size;
 	case USER_TABLE_USED:
-		return g_user_table.size();
+		return g_session_count;
 	default:
 		return -1;
 	}
@@ -737,20 +875,28 @@ uint32_t zarafa_server_logon(const char *username,
 		return ecLoginFailure;
 	gx_strlcpy(tmp_name, username, GX_ARRAY_SIZE(tmp_name));
 	HX_strlower(tmp_name);
-	std::unique_lock tl_hold(g_table_lock);
-	auto iter = g_user_table.find(tmp_name);
-	if (iter != g_user_table.end()) {
+	auto &ushard = zs_user_shard(tmp_name);
+	std::unique_lock ul_hold(ushard.lock);
+	auto iter = ushard.users.find(tmp_name);
+	if (iter != ushard.users.end()) {
 		user_id = iter->second;
-		auto st_iter = g_session_table.find(user_id);
-		if (st_iter != g_session_table.end()) {
+		ul_hold.unlock();
+		auto &shard = zs_session_shard(user_id);
+		std::unique_lock tl_hold(shard.lock);
+		auto st_iter = shard.sessions.find(user_id);
+		if (st_iter != shard.sessions.end()) {
 			auto pinfo = &st_iter->second;
 			time(&pinfo->last_time);
 			*phsession = pinfo->hsession;
 			return ecSuccess;
 		}
-		g_user_table.erase(iter);
+		tl_hold.unlock();
+		ul_hold.lock();
+		iter = ushard.users.find(tmp_name);
+		if (iter != ushard.users.end() && iter->second == user_id)
+			ushard.users.erase(iter);
 	}
-	tl_hold.unlock();
+	ul_hold.unlock();
 	if (FALSE == system_services_get_id_from_username(
 		username, &user_id) ||
 		FALSE == system_services_get_homedir(
@@ -784,34 +930,38 @@ uint32_t zarafa_server_logon(const char *username,
 	tmp_info.flags = flags;
 	time(&tmp_info.last_time);
 	tmp_info.reload_time = tmp_info.last_time;
+	tmp_info.ping_time = tmp_info.last_time + g_ping_interval;
 	tmp_info.ptree = object_tree_create(maildir);
 	if (tmp_info.ptree == nullptr)
 		return ecError;
-	tl_hold.lock();
-	auto st_iter = g_session_table.find(user_id);
-	if (st_iter != g_session_table.end()) {
-		auto pinfo = &st_iter->second;
-		*phsession = pinfo->hsession;
-		return ecSuccess;
-	}
-	if (g_session_table.size() >= g_table_size)
-		return ecError;
 	try {
-		st_iter = g_session_table.try_emplace(user_id, std::move(tmp_info)).first;
+		ul_hold.lock();
+		ushard.users.insert_or_assign(tmp_name, user_id);
+		ul_hold.unlock();
 	} catch (const std::bad_alloc &) {
 		return ecError;
 	}
-	if (g_user_table.size() >= g_table_size) {
-		g_session_table.erase(user_id);
+	auto &shard = zs_session_shard(user_id);
+	std::unique_lock tl_hold(shard.lock);
+	auto st_iter = shard.sessions.find(user_id);
+	if (st_iter != shard.sessions.end()) {
+		auto pinfo = &st_iter->second;
+		*phsession = pinfo->hsession;
+		return ecSuccess;
+	}
+	if (g_session_count++ >= g_table_size) {
+		--g_session_count;
 		return ecError;
 	}
 	try {
-		g_user_table.try_emplace(tmp_name, user_id);
+		st_iter = shard.sessions.try_emplace(user_id, std::move(tmp_info)).first;
 	} catch (const std::bad_alloc &) {
-		g_session_table.erase(user_id);
+		--g_session_count;
 		return ecError;
 	}
-	*phsession = st_iter->second.hsession;
+	auto pinfo = &st_iter->second;
+	zs_arm_session(pinfo, zs_session_due(pinfo, pinfo->last_time));
+	*phsession = pinfo->hsession;
 	return ecSuccess;
 }
 
@@ -2642,17 +2792,21 @@ uint32_t zarafa_server_storeadvise(GUID hsession,
 		return ecError;
 	gx_strlcpy(dir, pstore->get_dir(), arsizeof(dir));
 	pinfo.reset();
-	std::unique_lock nl_hold(g_notify_lock);
-	if (g_notify_table.size() == g_table_size) {
-		nl_hold.unlock();
+	if (g_notify_count++ >= g_table_size) {
+		--g_notify_count;
 		exmdb_client::unsubscribe_notification(dir, *psub_id);
 		return ecError;
 	}
 	try {
 		auto tmp_buf = std::to_string(*psub_id) + "|" + dir;
-		g_notify_table.try_emplace(std::move(tmp_buf), hsession, hstore);
-	} catch (const std::bad_alloc &) {
+		auto &nshard = zs_notify_shard(tmp_buf);
+		std::unique_lock nl_hold(nshard.lock);
+		if (!nshard.items.try_emplace(tmp_buf, hsession, hstore).second)
+			--g_notify_count;
 		nl_hold.unlock();
+		zs_arm_notify(tmp_buf, time(nullptr) + g_cache_interval);
+	} catch (const std::bad_alloc &) {
+		--g_notify_count;
 		exmdb_client::unsubscribe_notification(dir, *psub_id);
 		return ecError;
 	}
@@ -2675,8 +2829,10 @@ uint32_t zarafa_server_unadvise(GUID hsession, uint32_t hstore,
 	pinfo.reset();
 	exmdb_client::unsubscribe_notification(dir.c_str(), sub_id);
 	auto tmp_buf = std::to_string(sub_id) + "|"s + std::move(dir);
-	std::unique_lock nl_hold(g_notify_lock);
-	g_notify_table.erase(std::move(tmp_buf));
+	auto &nshard = zs_notify_shard(tmp_buf);
+	std::unique_lock nl_hold(nshard.lock);
+	if (nshard.items.erase(tmp_buf) > 0)
+		--g_notify_count;
 	return ecSuccess;
 } catch (const std::bad_alloc &) {
 	fprintf(stderr, "E-1498: ENOMEM\n");
@@ -2708,9 +2864,10 @@ uint32_t zarafa_server_notifdequeue(const NOTIF_SINK *psink,
 			fprintf(stderr, "E-1496: ENOMEM\n");
 			continue;
 		}
-		std::unique_lock nl_hold(g_notify_lock);
-		auto iter = g_notify_table.find(std::move(tmp_buf));
-		if (iter == g_notify_table.end())
+		auto &nshard = zs_notify_shard(tmp_buf);
+		std::unique_lock nl_hold(nshard.lock);
+		auto iter = nshard.items.find(tmp_buf);
+		if (iter == nshard.items.end())
 			continue;
 		auto pnitem = &iter->second;
 		time(&pnitem->last_time);
@@ -2757,6 +2914,8 @@ uint32_t zarafa_server_notifdequeue(const NOTIF_SINK *psink,
 				psink->count*sizeof(ADVISE_INFO));
 	double_list_append_as_tail(
 		&pinfo->sink_list, &psink_node->node);
+	std::unique_lock tl_hold(zs_session_shard(pinfo->user_id).lock);
+	zs_arm_session(pinfo.get(), psink_node->until_time);
 	return ecNotFound;
 }
 
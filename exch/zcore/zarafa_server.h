@@ -31,7 +31,8 @@ struct USER_INFO {
 	int user_id = 0, domain_id = 0, org_id = 0;
 	std::string username, lang, maildir, homedir;
 	uint32_t cpid = 0, flags = 0;
-	time_t last_time = 0, reload_time = 0;
+	time_t last_time = 0, reload_time = 0, ping_time = 0;
+	time_t timer_due = 0; /* earliest armed deadline, 0 if none */
 	std::unique_ptr<OBJECT_TREE> ptree;
 	DOUBLE_LIST sink_list{};
 	std::unordered_map<int, long> extra_owner;
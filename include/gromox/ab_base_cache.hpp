@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later, OR GPL-2.0-or-later WITH licensing exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <unistd.h>
+
+namespace gromox {
+
+/*
+ * Cache of address book bases (one per organization or domain), shared by
+ * exchange_nsp and zcore.
+ *
+ * Bases are immutable snapshots handed out as shared_ptr. A refresh builds
+ * the replacement off to the side, without holding the lock, and then swaps
+ * the map slot. Readers keep whatever snapshot they already hold and never
+ * wait for a rebuild; only the very first load of a base blocks (other
+ * requesters for the same id poll until it is published, as before).
+ *
+ * Base must have a public member base_id. The loader is called as
+ * load(base_id, const Base *previous) and returns a fully-built
+ * std::shared_ptr<Base>, or nullptr on failure. Published bases are never
+ * written to by the cache; the time of the last (attempted) load is kept
+ * alongside in the map slot.
+ */
+template<typename Base> class ab_base_cache {
+	public:
+	using ref = std::shared_ptr<Base>;
+
+	void init(const char *tag, size_t max_bases, int interval)
+	{
+		m_tag = tag;
+		m_max = max_bases;
+		m_interval = interval;
+	}
+
+	template<typename F> ref get(int base_id, F &&load)
+	{
+		for (unsigned int count = 0; ; ++count) {
+			std::unique_lock hold(m_lock);
+			auto it = m_bases.find(base_id);
+			if (it != m_bases.end()) {
+				/* a nullptr slot means another thread is loading it */
+				if (it->second.base != nullptr)
+					return it->second.base;
+				hold.unlock();
+				if (count >= 60)
+					return nullptr;
+				sleep(1);
+				continue;
+			}
+			if (m_bases.size() >= m_max) {
+				printf("[%s]: W-1298: AB base hash is full\n", m_tag);
+				return nullptr;
+			}
+			try {
+				m_bases.emplace(base_id, slot{});
+			} catch (const std::bad_alloc &) {
+				return nullptr;
+			}
+			hold.unlock();
+			ref base;
+			try {
+				base = load(base_id, nullptr);
+			} catch (const std::bad_alloc &) {
+			}
+			hold.lock();
+			if (base == nullptr) {
+				m_bases.erase(base_id);
+				return nullptr;
+			}
+			auto &sl = m_bases[base_id];
+			sl.base = base;
+			sl.stamp = time(nullptr);
+			return base;
+		}
+	}
+
+	bool contains(int base_id)
+	{
+		std::lock_guard hold(m_lock);
+		return m_bases.find(base_id) != m_bases.end();
+	}
+
+	/*
+	 * Rebuild one base that is older than the cache interval. Returns
+	 * false if there was nothing to do.
+	 */
+	template<typename F> bool refresh_one(F &&load)
+	{
+		std::unique_lock hold(m_lock);
+		ref old;
+		auto now = time(nullptr);
+		for (const auto &[id, sl] : m_bases) {
+			if (sl.base != nullptr && now - sl.stamp >= m_interval) {
+				old = sl.base;
+				break;
+			}
+		}
+		hold.unlock();
+		if (old == nullptr)
+			return false;
+		ref fresh;
+		try {
+			fresh = load(old->base_id, old.get());
+		} catch (const std::bad_alloc &) {
+		}
+		hold.lock();
+		auto it = m_bases.find(old->base_id);
+		if (it == m_bases.end() || it->second.base != old)
+			/* cleared or replaced meanwhile */
+			return true;
+		/* on failure, keep serving the previous snapshot; retry next interval */
+		if (fresh != nullptr)
+			it->second.base = std::move(fresh);
+		it->second.stamp = now;
+		return true;
+	}
+
+	/* Mark all bases stale so that the scan thread rebuilds them. */
+	void invalidate()
+	{
+		std::lock_guard hold(m_lock);
+		for (auto &[id, sl] : m_bases)
+			sl.stamp = 0;
+	}
+
+	void clear()
+	{
+		std::lock_guard hold(m_lock);
+		m_bases.clear();
+	}
+
+	private:
+	struct slot {
+		ref base;
+		time_t stamp = 0;
+	};
+
+	std::mutex m_lock;
+	std::unordered_map<int, slot> m_bases;
+	const char *m_tag = "";
+	size_t m_max = 0;
+	int m_interval = 0;
+};
+
+}
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later, OR GPL-2.0-or-later WITH licensing exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gromox/common_types.hpp>
+#include <gromox/int_hash.hpp>
+#include <gromox/simple_tree.hpp>
+#include <gromox/single_list.hpp>
+#include <gromox/sql_types.hpp>
+
+namespace gromox {
+
+/*
+ * Domain trees of the address book bases of exchange_nsp and zcore (see
+ * ab_base_cache.hpp). Both modules build the same trees from the same
+ * mysql_adaptor rows and only differ in how they reach the service
+ * functions, which is what ab_sql_ops is for.
+ */
+struct ab_sql_ops {
+	BOOL (*get_domain_info)(int domain_id, sql_domain &);
+	BOOL (*get_domain_groups)(int domain_id, std::vector<sql_group> &);
+	BOOL (*get_group_classes)(int group_id, std::vector<sql_class> &);
+	BOOL (*get_sub_classes)(int class_id, std::vector<sql_class> &);
+	int (*get_class_users)(int class_id, std::vector<sql_user> &);
+	int (*get_group_users)(int group_id, std::vector<sql_user> &);
+	int (*get_domain_users)(int domain_id, std::vector<sql_user> &);
+};
+
+/* The rows of one domain, fetched once per (re)load. */
+struct ab_class_rows {
+	sql_class cls{};
+	std::vector<ab_class_rows> sub;
+	std::vector<sql_user> users;
+};
+
+struct ab_group_rows {
+	sql_group grp{};
+	std::vector<ab_class_rows> classes;
+	std::vector<sql_user> users;
+};
+
+struct ab_domain_rows {
+	sql_domain info;
+	std::vector<ab_group_rows> groups;
+	std::vector<sql_user> users;
+};
+
+extern BOOL ab_fetch_domain_rows(const ab_sql_ops &, int domain_id, ab_domain_rows &);
+extern std::string ab_domain_rows_key(const ab_domain_rows &);
+
+/*
+ * The nodes of one domain. A base refresh reuses the previous ab_domain_tree
+ * of a domain whose rows (@rows_key, the serialized ab_domain_rows) are
+ * unchanged, instead of building a copy. Only trees whose duplicate nodes
+ * (pdata) all point into the same tree are eligible, since the other trees
+ * of the old base go away with it.
+ */
+struct ab_domain_tree {
+	ab_domain_tree(void (*d)(SIMPLE_TREE *)) : destruct(d)
+	{
+		simple_tree_init(&tree);
+	}
+	~ab_domain_tree() { destruct(&tree); }
+	void operator=(ab_domain_tree &&) = delete;
+
+	SIMPLE_TREE tree{};
+	std::string rows_key;
+	bool self_contained = false;
+	void (*destruct)(SIMPLE_TREE *);
+};
+
+/* AB_NODE::node_type of class nodes (NODE_TYPE_CLASS in both modules) */
+static constexpr uint8_t ab_class_node_type = 0x83;
+
+struct ab_node_list {
+	std::vector<SIMPLE_TREE_NODE *> nodes;
+	bool fail = false;
+};
+
+extern BOOL ab_collect_nodes(SIMPLE_TREE *, ab_node_list &);
+
+/*
+ * @Node is the module's AB_NODE (a SIMPLE_TREE_NODE followed by node_type
+ * and minid).
+ */
+template<typename Node> BOOL ab_tree_self_contained(SIMPLE_TREE *ptree,
+    bool *pyes)
+{
+	auto proot = simple_tree_get_root(ptree);
+	*pyes = true;
+	if (proot == nullptr)
+		return TRUE;
+	ab_node_list nl;
+	if (!ab_collect_nodes(ptree, nl))
+		return FALSE;
+	for (auto tnode : nl.nodes) {
+		if (reinterpret_cast<Node *>(tnode)->node_type > 0x80 ||
+		    tnode->pdata == nullptr)
+			continue;
+		auto ptop = static_cast<SIMPLE_TREE_NODE *>(tnode->pdata);
+		for (auto up = ptop; up != nullptr; up = simple_tree_node_get_parent(up))
+			ptop = up;
+		if (ptop != proot) {
+			*pyes = false;
+			break;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Register the nodes of a tree from the previous base in @pbase->phash
+ * (via @cache_node). *padopted is false if some node is already claimed by
+ * another domain of the new base, in which case the domain has to be built
+ * anew.
+ */
+template<typename Node, typename Base, typename CacheNode>
+BOOL ab_tree_adopt_tree(Base *pbase, ab_domain_tree &dt, bool *padopted,
+    CacheNode &&cache_node)
+{
+	*padopted = false;
+	if (simple_tree_get_root(&dt.tree) == nullptr)
+		return TRUE;
+	ab_node_list nl;
+	if (!ab_collect_nodes(&dt.tree, nl))
+		return FALSE;
+	for (auto tnode : nl.nodes) {
+		auto pabnode = reinterpret_cast<Node *>(tnode);
+		if ((pabnode->node_type < 0x80 && tnode->pdata != nullptr) ||
+		    pabnode->node_type == ab_class_node_type)
+			continue;
+		if (pbase->phash != nullptr &&
+		    int_hash_query(pbase->phash, pabnode->minid) != nullptr)
+			return TRUE;
+	}
+	for (auto tnode : nl.nodes) {
+		auto pabnode = reinterpret_cast<Node *>(tnode);
+		if (pabnode->node_type < 0x80 && tnode->pdata != nullptr)
+			continue;
+		if (pabnode->node_type == ab_class_node_type &&
+		    pbase->phash != nullptr &&
+		    int_hash_query(pbase->phash, pabnode->minid) != nullptr)
+			continue;
+		if (!cache_node(pbase, pabnode))
+			return FALSE;
+	}
+	*padopted = true;
+	return TRUE;
+}
+
+/*
+ * Add domain @domain_id to @pbase. The rows are fetched once; when they
+ * equal those the domain's tree in @prev was built from, that tree is
+ * shared, otherwise @load_tree(rows, domain_id, tree, pbase) builds a new
+ * one. @destruct frees the nodes of a tree.
+ */
+template<typename Node, typename DomainNode, typename Base, typename LoadTree,
+    typename CacheNode>
+BOOL ab_tree_load_domain(Base *pbase, int domain_id, const Base *prev,
+    const ab_sql_ops &ops, void (*destruct)(SIMPLE_TREE *),
+    LoadTree &&load_tree, CacheNode &&cache_node) try
+{
+	std::unique_ptr<DomainNode> pdomain(new(std::nothrow) DomainNode);
+	if (pdomain == nullptr)
+		return FALSE;
+	pdomain->node.pdata = pdomain.get();
+	pdomain->domain_id = domain_id;
+	const DomainNode *pold = nullptr;
+	if (prev != nullptr) {
+		/* single_list has no const accessors; nothing is modified */
+		auto plist = const_cast<SINGLE_LIST *>(&prev->list);
+		for (auto pnode = single_list_get_head(plist); pnode != nullptr;
+		     pnode = single_list_get_after(plist, pnode)) {
+			auto d = static_cast<const DomainNode *>(pnode->pdata);
+			if (d->domain_id == domain_id) {
+				pold = d;
+				break;
+			}
+		}
+	}
+	ab_domain_rows rows;
+	if (!ab_fetch_domain_rows(ops, domain_id, rows))
+		return FALSE;
+	auto key = ab_domain_rows_key(rows);
+	if (pold != nullptr && pold->owner->self_contained &&
+	    pold->owner->rows_key == key) {
+		bool adopted = false;
+		if (!ab_tree_adopt_tree<Node>(pbase, *pold->owner, &adopted,
+		    cache_node))
+			return FALSE;
+		if (adopted) {
+			pdomain->owner = pold->owner;
+			pdomain->tree = pold->owner->tree;
+			single_list_append_as_tail(&pbase->list, &pdomain->node);
+			pdomain.release();
+			return TRUE;
+		}
+	}
+	pdomain->owner = std::make_shared<ab_domain_tree>(destruct);
+	auto &dt = *pdomain->owner;
+	if (!load_tree(std::move(rows), domain_id, &dt.tree, pbase) ||
+	    !ab_tree_self_contained<Node>(&dt.tree, &dt.self_contained))
+		return FALSE;
+	dt.rows_key = std::move(key);
+	pdomain->tree = dt.tree;
+	single_list_append_as_tail(&pbase->list, &pdomain->node);
+	pdomain.release();
+	return TRUE;
+} catch (const std::bad_alloc &) {
+	return FALSE;
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <gromox/defs.h>
+#include <gromox/exmdb_rpc.hpp>
+
+/*
+ * Connection pool towards remote exmdb servers, shared by all programs that
+ * speak the exmdb protocol as a client (zcore, midb, exmdb_provider's
+ * proxy mode).
+ */
+
+enum {
+	ALIVE_PROXY_CONNECTIONS,
+	LOST_PROXY_CONNECTIONS,
+};
+
+enum {
+	EXMDB_CLIENT_NO_FLAGS = 0,
+	/* ignore public stores from exmdb_list.txt */
+	EXMDB_CLIENT_SKIP_PUBLIC = 0x1U,
+	/* ignore stores that are not on this host */
+	EXMDB_CLIENT_SKIP_REMOTE = 0x2U,
+	/* do not connect to stores on this host; see exmdb_client_check_local */
+	EXMDB_CLIENT_ALLOW_DIRECT = 0x4U,
+};
+
+extern GX_EXPORT void exmdb_client_init(unsigned int conn_num, unsigned int threads_num, const char *remote_id);
+/*
+ * @build_env/@free_env bracket every use of exmdb_rpc_alloc by the pool's
+ * own threads; the argument tells whether the store is private.
+ */
+extern GX_EXPORT int exmdb_client_run(const char *cfgdir, unsigned int flags = EXMDB_CLIENT_NO_FLAGS, void (*build_env)(bool) = nullptr, void (*free_env)() = nullptr);
+extern GX_EXPORT void exmdb_client_stop();
+extern GX_EXPORT int exmdb_client_get_param(int param);
+/* human-readable per-server connection and latency statistics */
+extern GX_EXPORT void exmdb_client_get_stats(char *buf, size_t len);
+extern GX_EXPORT void exmdb_client_register_proc(void *pproc);
+extern GX_EXPORT BOOL exmdb_client_check_local(const char *prefix, BOOL *pb_private);
+extern GX_EXPORT BOOL exmdb_client_do_rpc(const char *dir, const EXMDB_REQUEST *, EXMDB_RESPONSE *);
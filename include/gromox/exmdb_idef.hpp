@@ -119,4 +119,6 @@ EXMIDL(unsubscribe_notification, (const char *dir, uint32_t sub_id))
 EXMIDL(transport_new_mail, (const char *dir, uint64_t folder_id, uint64_t message_id, uint32_t message_flags, const char *pstr_class))
 EXMIDL(check_contact_address, (const char *dir, const char *paddress, IDLOUT BOOL *b_found))
 EXMIDL(get_public_folder_unread_count, (const char *dir, const char *username, uint64_t folder_id, IDLOUT uint32_t *count))
+EXMIDL(get_freebusy_events, (const char *dir, uint64_t start_time, uint64_t end_time, IDLOUT FREEBUSY_EVENT_ARRAY *events))
+EXMIDL(allocate_cns, (const char *dir, uint32_t count, IDLOUT uint64_t *begin_cn))
 EXMIDL(unload_store, (const char *dir))
@@ -145,6 +145,8 @@ enum {
 	COPY_INSTANCE_ATTACHMENTS = 0x78,
 	CHECK_CONTACT_ADDRESS = 0x79,
 	GET_PUBLIC_FOLDER_UNREAD_COUNT = 0x7a,
+	GET_FREEBUSY_EVENTS = 0x7b,
+	ALLOCATE_CNS = 0x7c,
 	UNLOAD_STORE = 0x80,
 };
 }
@@ -807,6 +809,15 @@ struct EXREQ_GET_PUBLIC_FOLDER_UNREAD_COUNT {
 	uint64_t folder_id;
 };
 
+struct EXREQ_GET_FREEBUSY_EVENTS {
+	uint64_t start_time;
+	uint64_t end_time;
+};
+
+struct EXREQ_ALLOCATE_CNS {
+	uint32_t count;
+};
+
 union EXMDB_REQUEST_PAYLOAD {
 	EXREQ_CONNECT connect;
 	EXREQ_GET_NAMED_PROPIDS get_named_propids;
@@ -926,6 +937,8 @@ union EXMDB_REQUEST_PAYLOAD {
 	EXREQ_CHECK_CONTACT_ADDRESS check_contact_address;
 	EXREQ_TRANSPORT_NEW_MAIL transport_new_mail;
 	EXREQ_GET_PUBLIC_FOLDER_UNREAD_COUNT get_public_folder_unread_count;
+	EXREQ_GET_FREEBUSY_EVENTS get_freebusy_events;
+	EXREQ_ALLOCATE_CNS allocate_cns;
 };
 
 struct EXMDB_REQUEST {
@@ -1355,6 +1368,14 @@ struct EXRESP_GET_PUBLIC_FOLDER_UNREAD_COUNT {
 	uint32_t count;
 };
 
+struct EXRESP_GET_FREEBUSY_EVENTS {
+	FREEBUSY_EVENT_ARRAY events;
+};
+
+struct EXRESP_ALLOCATE_CNS {
+	uint64_t begin_cn;
+};
+
 union EXMDB_RESPONSE_PAYLOAD {
 	EXRESP_GET_ALL_NAMED_PROPIDS get_all_named_propids;
 	EXRESP_GET_NAMED_PROPIDS get_named_propids;
@@ -1452,6 +1473,8 @@ union EXMDB_RESPONSE_PAYLOAD {
 	EXRESP_SUBSCRIBE_NOTIFICATION subscribe_notification;
 	EXRESP_CHECK_CONTACT_ADDRESS check_contact_address;
 	EXRESP_GET_PUBLIC_FOLDER_UNREAD_COUNT get_public_folder_unread_count;
+	EXRESP_GET_FREEBUSY_EVENTS get_freebusy_events;
+	EXRESP_ALLOCATE_CNS allocate_cns;
 };
 
 struct EXMDB_RESPONSE {
@@ -1474,15 +1497,31 @@ struct exmdb_hell {
 	BOOL (*exec)(const char *, const EXMDB_REQUEST *, EXMDB_RESPONSE *);
 };
 
+/*
+ * Peers on the same host may talk over a unix socket instead of TCP. The
+ * client then hands a sealed memfd to the server together with its CONNECT
+ * request; a server that maps it answers CONNECT with a 4-byte payload
+ * holding the usable size. From then on, a request or response that fits
+ * is serialized into the shared region and only a marker crosses the
+ * socket: EXMDB_SHM_FRAME in place of the request length, or in place of
+ * the response length after the status byte. The region holds the frame
+ * exactly as it would have been sent (length prefix included). Since a
+ * connection carries one call at a time, a single region serves both
+ * directions.
+ */
+static constexpr uint32_t EXMDB_SHM_FRAME = UINT32_MAX;
+
 extern GX_EXPORT int exmdb_ext_pull_request(const BINARY *, EXMDB_REQUEST *);
-extern GX_EXPORT int exmdb_ext_push_request(const EXMDB_REQUEST *, BINARY *);
+/* With @buf, serialize into that fixed buffer (EXT_ERR_BUFSIZE if too small). */
+extern GX_EXPORT int exmdb_ext_push_request(const EXMDB_REQUEST *, BINARY *, void *buf = nullptr, uint32_t bufsize = 0);
 extern GX_EXPORT int exmdb_ext_pull_response(const BINARY *, EXMDB_RESPONSE *);
-extern GX_EXPORT int exmdb_ext_push_response(const EXMDB_RESPONSE *presponse, BINARY *);
+extern GX_EXPORT int exmdb_ext_push_response(const EXMDB_RESPONSE *presponse, BINARY *, void *buf = nullptr, uint32_t bufsize = 0);
 extern GX_EXPORT int exmdb_ext_pull_db_notify(const BINARY *, DB_NOTIFY_DATAGRAM *);
 extern GX_EXPORT int exmdb_ext_push_db_notify(const DB_NOTIFY_DATAGRAM *, BINARY *);
 extern GX_EXPORT const char *exmdb_rpc_strerror(unsigned int);
 extern GX_EXPORT BOOL exmdb_client_read_socket(int, BINARY *, long timeout = -1);
 extern GX_EXPORT BOOL exmdb_client_write_socket(int, const BINARY *, long timeout = -1);
+extern GX_EXPORT void exmdb_local_socket_path(uint16_t port, char *buf, size_t bufsize);
 
 extern GX_EXPORT void *(*exmdb_rpc_alloc)(size_t);
 extern GX_EXPORT void (*exmdb_rpc_free)(void *);
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gromox/ext_buffer.hpp>
+#include <gromox/ical.hpp>
+#include <gromox/mapi_types.hpp>
+
+/* Named properties consulted for free/busy, in freebusy_propnames order */
+enum {
+	FB_PROP_START, FB_PROP_END, FB_PROP_BUSYSTATUS, FB_PROP_RECURRING,
+	FB_PROP_RECUR, FB_PROP_SUBTYPE, FB_PROP_PRIVATE, FB_PROP_STATEFLAGS,
+	FB_PROP_CLIPEND, FB_PROP_LOCATION, FB_PROP_REMINDERSET, FB_PROP_GOID,
+	FB_PROP_TZSTRUCT, FB_PROP_COUNT,
+};
+
+/* One occurrence of an appointment as reported by free/busy queries */
+struct freebusy_event {
+	time_t start_time = 0, end_time = 0;
+	uint32_t busy_type = 0;
+	std::string id, subject, location;
+	bool has_subject = false, has_location = false;
+	bool b_meeting = false, b_recurring = false, b_exception = false;
+	bool b_reminder = false, b_private = false;
+};
+
+extern std::shared_ptr<ICAL_COMPONENT> tzstruct_to_vtimezone(int year, const char *tzid, TIMEZONESTRUCT *);
+extern BOOL freebusy_make_uid(const BINARY *goid, char *uid, size_t uid_size);
+extern void freebusy_propnames(PROPERTY_NAME *names);
+extern BOOL freebusy_proptags(const PROPID_ARRAY *, uint32_t *tags);
+/*
+ * Append the occurrences of one appointment which overlap [start, end].
+ * @row carries the FB_PROP_* properties (by the tags from
+ * freebusy_proptags) and PR_SUBJECT. Recurring series are expanded;
+ * @alloc is used for the decoded recurrence blob.
+ */
+extern BOOL freebusy_expand(const TPROPVAL_ARRAY *row, const uint32_t *tags, time_t start, time_t end, EXT_BUFFER_ALLOC alloc, std::vector<freebusy_event> &);
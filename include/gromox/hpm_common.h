@@ -3,6 +3,7 @@
 #include <typeinfo>
 #include <gromox/common_types.hpp>
 #include <gromox/defs.h>
+#include <gromox/http_request.hpp>
 #include <gromox/mem_file.hpp>
 #include <gromox/plugin.hpp>
 #include <openssl/ssl.h>
@@ -35,22 +36,6 @@ struct CONNECTION {
 	struct timeval	last_timestamp;
 };
 
-struct HTTP_REQUEST {
-	char		method[32];
-	MEM_FILE	f_request_uri;
-	char		version[8];
-	MEM_FILE	f_host;
-	MEM_FILE    f_user_agent;
-    MEM_FILE    f_accept;
-	MEM_FILE	f_accept_language;
-	MEM_FILE	f_accept_encoding;
-	MEM_FILE	f_content_type;
-	MEM_FILE	f_content_length;
-	MEM_FILE	f_transfer_encoding;
-	MEM_FILE	f_cookie;
-    MEM_FILE    f_others;
-};
-
 struct HTTP_AUTH_INFO {
 	BOOL b_authed;
 	const char* username;
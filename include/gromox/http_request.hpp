@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <strings.h>
+
+/*
+ * Views into the header block of a request, valid until the request is
+ * finished. Every view is followed by a NUL byte, so .data() may be handed
+ * to C string functions. Absent fields are empty strings.
+ */
+struct HTTP_FIELD {
+	std::string_view name, value;
+};
+
+struct HTTP_REQUEST {
+	char method[32];
+	char version[8];
+	std::string_view request_uri, host, user_agent, accept;
+	std::string_view accept_language, accept_encoding, content_type;
+	std::string_view content_length, transfer_encoding, cookie;
+	HTTP_FIELD *others; /* all remaining fields, in arrival order */
+	size_t others_num;
+
+	/* Value of the first remaining field called @name, or "" */
+	std::string_view field(const char *name) const
+	{
+		std::string_view n(name);
+		for (size_t i = 0; i < others_num; ++i)
+			if (others[i].name.size() == n.size() &&
+			    strncasecmp(others[i].name.data(), name, n.size()) == 0)
+				return others[i].value;
+		return "";
+	}
+};
@@ -1,6 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 #include <gromox/common_types.hpp>
 #include <gromox/defs.h>
 #include <pthread.h>
@@ -12,9 +14,19 @@ enum PARAM_TYPE {
     FREE_LIST_SIZE,
     ALLOCATED_NUM,
     MEM_ITEM_SIZE,
-    MEM_ITEM_NUM
+    MEM_ITEM_NUM,
+    MAG_HITS,       /* get/put served from the calling thread's magazine */
+    MAG_MISSES,     /* get/put that had to go to the shared free list */
+    POOL_CONTENDED, /* shared free list found locked by another thread */
 };
 
+struct lib_buffer_mag;
+
+/*
+ * Thread-safe pools additionally keep a small stack of free items per
+ * thread (a magazine), which is refilled from and flushed to the shared
+ * free list in batches, so that most get/put calls do not touch m_mutex.
+ */
 struct LIB_BUFFER {
     void*   heap_list_head;
     void*   free_list_head;
@@ -25,6 +37,10 @@ struct LIB_BUFFER {
     size_t  item_num;
     BOOL    is_thread_safe;
     pthread_mutex_t m_mutex;
+    size_t  mag_size;
+    size_t  contended;
+    uint64_t serial;
+    std::vector<lib_buffer_mag *> mags;
 };
 
 LIB_BUFFER* lib_buffer_init(size_t item_size, size_t item_num, BOOL is_thread_safe);
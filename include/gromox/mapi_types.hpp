@@ -885,6 +885,22 @@ struct IDSET {
 
 typedef DOUBLE_LIST PCL;
 
+/* One busy interval of the calendar folder (times in NT format) */
+struct FREEBUSY_EVENT {
+	uint64_t start_time;
+	uint64_t end_time;
+	uint32_t busy_type;
+	char *id;
+	char *subject; /* may be nullptr */
+	char *location; /* may be nullptr */
+	BOOL b_meeting, b_recurring, b_exception, b_reminder, b_private;
+};
+
+struct FREEBUSY_EVENT_ARRAY {
+	uint32_t count;
+	FREEBUSY_EVENT *pevents;
+};
+
 #define DB_NOTIFY_TYPE_NEW_MAIL									0x01
 #define DB_NOTIFY_TYPE_FOLDER_CREATED							0x02
 #define DB_NOTIFY_TYPE_MESSAGE_CREATED							0x03
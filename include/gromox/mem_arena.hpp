@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <gromox/common_types.hpp>
+
+/*
+ * Region allocator for data living exactly as long as one request or one
+ * message. Allocations are carved out of chunks and never freed one by one;
+ * mem_arena_clear releases everything at once, keeping the first chunk for
+ * the next round so that steady-state use does not touch malloc at all.
+ * Caution: Not thread-safe.
+ */
+struct MEM_ARENA_CHUNK;
+
+struct MEM_ARENA {
+	MEM_ARENA_CHUNK *head;   /* first chunk, survives mem_arena_clear */
+	MEM_ARENA_CHUNK *cur;    /* chunk that allocations are carved from */
+	size_t chunk_size;
+	size_t total;            /* bytes handed out since the last clear */
+	size_t limit;            /* cap on total, 0 for none */
+	uint32_t generation;     /* bumped by every clear */
+};
+
+void mem_arena_init(MEM_ARENA *parena, size_t chunk_size, size_t limit = 0);
+void *mem_arena_alloc(MEM_ARENA *parena, size_t size);
+BOOL mem_arena_extend(MEM_ARENA *parena, void *ptr, size_t old_size, size_t new_size);
+void mem_arena_clear(MEM_ARENA *parena);
+void mem_arena_free(MEM_ARENA *parena);
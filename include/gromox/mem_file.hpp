@@ -2,6 +2,7 @@
 #include <gromox/common_types.hpp>
 #include <gromox/lib_buffer.hpp>
 #include <gromox/double_list.hpp>
+#include <gromox/mem_arena.hpp>
 #include <sys/types.h>
 
 #define MEM_END_OF_FILE         0xFFFFFFFF      
@@ -19,7 +20,13 @@ enum {
     MEM_FILE_WRITE_PTR
 };
 
-/* struct for describing the mem file */
+/*
+ * struct for describing the mem file. A mem file initialized with an arena
+ * keeps its data in one contiguous buffer from that arena (the block
+ * fields are unused then); it must not be used across mem_arena_clear
+ * without a mem_file_clear. Writes to such a file store either all of the
+ * data or, when the arena is exhausted, none of it.
+ */
 struct MEM_FILE {
     DOUBLE_LIST_NODE    *pnode_rd;    /* node of current reading */
     DOUBLE_LIST_NODE    *pnode_wr;    /* node of current writing */
@@ -30,9 +37,14 @@ struct MEM_FILE {
     size_t            file_total_len; /* total file length */
     LIB_BUFFER        *allocator;     /* allocator for get blocks */
     DOUBLE_LIST        list;          /* list of blocks */
+    MEM_ARENA         *arena;         /* arena for the contiguous buffer */
+    char              *pbuf;          /* contiguous buffer */
+    size_t            buf_size;       /* capacity of contiguous buffer */
+    uint32_t          arena_gen;      /* arena generation pbuf belongs to */
 };
     
 void mem_file_init(MEM_FILE *pfile, LIB_BUFFER *palloc);
+void mem_file_init(MEM_FILE *pfile, MEM_ARENA *parena);
 size_t mem_file_read(MEM_FILE *pfile, void* pbuff, size_t size);
 size_t mem_file_readline(MEM_FILE *pfile, char* pbuff, size_t size);
 ssize_t mem_file_seek(MEM_FILE *pfile, int type, ssize_t offset, int opt);
@@ -12,3 +12,6 @@ enum {
 	MIDB_E_MAILBOX_FULL = 9,
 	MIDB_E_NO_DELETE = 10,
 };
+
+/* longest sequence-set in one P-VNSH reply */
+#define MIDB_VNSH_PAGE_SIZE (60 * 1024)
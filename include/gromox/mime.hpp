@@ -27,6 +27,7 @@ struct MIME {
 	char 		content_type[VALUE_LEN];
 	char		boundary_string[VALUE_LEN];
 	int			boundary_len;
+	MEM_ARENA	arena;		/* backs f_type_params and f_other_fields */
 	MEM_FILE	f_type_params;
 	MEM_FILE	f_other_fields;
 	BOOL		head_touched;
@@ -42,7 +43,7 @@ struct MIME {
 struct MAIL;
 
 extern GX_EXPORT bool mail_set_header(MAIL *, const char *hdr, const char *val);
-void mime_init(MIME *pmime, LIB_BUFFER *palloc);
+void mime_init(MIME *pmime);
 void mime_free(MIME *pmime);
 BOOL mime_retrieve(MIME *pmime_parent,
 	MIME *pmime, char* in_buff, size_t length);
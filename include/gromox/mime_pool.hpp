@@ -16,10 +16,9 @@ struct MIME_POOL {
 	pthread_mutex_t mutex;
 	MIME_POOL_NODE	*pbegin;
 	size_t			number;
-	LIB_BUFFER		*allocator;
 };
 
-MIME_POOL* mime_pool_init(size_t number, int ratio, BOOL thread_safe);
+MIME_POOL* mime_pool_init(size_t number, BOOL thread_safe);
 void mime_pool_free(MIME_POOL *pmime_pool);
 MIME* mime_pool_get(MIME_POOL *pmime_pool);
 void mime_pool_put(MIME *pmime);
@@ -0,0 +1,26 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+/* Rows handed out by the mysql_adaptor service (get_domain_info etc.) */
+struct sql_domain {
+	std::string name, title, address;
+};
+
+struct sql_user {
+	int addr_type = 0, id = 0, list_type = 0, list_priv = 0;
+	std::string username, maildir;
+	std::vector<std::string> aliases; /* email addresses */
+	std::map<unsigned int, std::string> propvals;
+};
+
+struct sql_group {
+	int id;
+	std::string name, title;
+};
+
+struct sql_class {
+	int child_id;
+	std::string name;
+};
@@ -98,6 +98,8 @@ enum {
 	GETUSERAVAILABILITY = 0x53,
 	SETPASSWD = 0x54,
 	LINKMESSAGE = 0x55,
+	/* connection-level, no payload: keep the connection for further calls */
+	KEEPALIVE = 0x56,
 };
 }
 
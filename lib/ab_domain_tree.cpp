@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later, OR GPL-2.0-or-later WITH licensing exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+#include <gromox/ab_domain_tree.hpp>
+
+namespace gromox {
+
+static BOOL ab_fetch_class_rows(const ab_sql_ops &ops, int class_id,
+    ab_class_rows &cr)
+{
+	std::vector<sql_class> file_subclass;
+	if (!ops.get_sub_classes(class_id, file_subclass))
+		return FALSE;
+	cr.sub.resize(file_subclass.size());
+	for (size_t i = 0; i < file_subclass.size(); ++i) {
+		cr.sub[i].cls = std::move(file_subclass[i]);
+		if (!ab_fetch_class_rows(ops, cr.sub[i].cls.child_id, cr.sub[i]))
+			return FALSE;
+	}
+	return ops.get_class_users(class_id, cr.users) >= 0 ? TRUE : false;
+}
+
+BOOL ab_fetch_domain_rows(const ab_sql_ops &ops, int domain_id,
+    ab_domain_rows &rows) try
+{
+	if (!ops.get_domain_info(domain_id, rows.info))
+		return FALSE;
+	std::vector<sql_group> file_group;
+	if (!ops.get_domain_groups(domain_id, file_group))
+		return FALSE;
+	rows.groups.resize(file_group.size());
+	for (size_t i = 0; i < file_group.size(); ++i) {
+		auto &gr = rows.groups[i];
+		gr.grp = std::move(file_group[i]);
+		std::vector<sql_class> file_class;
+		if (!ops.get_group_classes(gr.grp.id, file_class))
+			return FALSE;
+		gr.classes.resize(file_class.size());
+		for (size_t j = 0; j < file_class.size(); ++j) {
+			gr.classes[j].cls = std::move(file_class[j]);
+			if (!ab_fetch_class_rows(ops,
+			    gr.classes[j].cls.child_id, gr.classes[j]))
+				return FALSE;
+		}
+		if (ops.get_group_users(gr.grp.id, gr.users) < 0)
+			return FALSE;
+	}
+	return ops.get_domain_users(domain_id, rows.users) >= 0 ? TRUE : false;
+} catch (const std::bad_alloc &) {
+	return FALSE;
+}
+
+namespace {
+
+/* length-prefixed, so that no two different row sets serialize alike */
+struct rows_writer {
+	void add(uint64_t v) { s.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+	void add(const std::string &v) { add(v.size()); s += v; }
+	void add(const sql_domain &d) { add(d.name); add(d.title); add(d.address); }
+	void add(const sql_group &g) { add(g.id); add(g.name); add(g.title); }
+	void add(const sql_class &c) { add(c.child_id); add(c.name); }
+	void add(const sql_user &u)
+	{
+		add(u.addr_type);
+		add(u.id);
+		add(u.list_type);
+		add(u.list_priv);
+		add(u.username);
+		add(u.maildir);
+		add(u.aliases.size());
+		for (const auto &a : u.aliases)
+			add(a);
+		add(u.propvals.size());
+		for (const auto &[tag, val] : u.propvals) {
+			add(tag);
+			add(val);
+		}
+	}
+	void add(const ab_class_rows &cr)
+	{
+		add(cr.cls);
+		add(cr.sub);
+		add(cr.users);
+	}
+	void add(const ab_group_rows &gr)
+	{
+		add(gr.grp);
+		add(gr.classes);
+		add(gr.users);
+	}
+	template<typename T> void add(const std::vector<T> &v)
+	{
+		add(v.size());
+		for (const auto &e : v)
+			add(e);
+	}
+
+	std::string s;
+};
+
+}
+
+std::string ab_domain_rows_key(const ab_domain_rows &rows)
+{
+	rows_writer w;
+	w.add(rows.info);
+	w.add(rows.groups);
+	w.add(rows.users);
+	return std::move(w.s);
+}
+
+static void ab_collect_node(SIMPLE_TREE_NODE *pnode, void *pparam)
+{
+	auto nl = static_cast<ab_node_list *>(pparam);
+	try {
+		nl->nodes.push_back(pnode);
+	} catch (const std::bad_alloc &) {
+		nl->fail = true;
+	}
+}
+
+BOOL ab_collect_nodes(SIMPLE_TREE *ptree, ab_node_list &nl)
+{
+	auto proot = simple_tree_get_root(ptree);
+	if (proot != nullptr)
+		simple_tree_enum_from_node(proot, ab_collect_node, &nl);
+	return nl.fail ? false : TRUE;
+}
+
+}
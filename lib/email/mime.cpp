@@ -5,6 +5,8 @@
  * point. if user uses mime_write_content function, the mime will then maintain
  * its own buffer
  */
+#include <new>
+#include <string>
 #include <libHX/string.h>
 #include <gromox/fileio.h>
 #include <gromox/mail.hpp>
@@ -16,6 +18,10 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <cstdio>
+/* header storage per MIME part */
+#define MIME_ARENA_SIZE 1024
+/* most header memory one MIME part may take */
+#define MIME_ARENA_LIMIT (256 * 1024)
 
 static BOOL mime_parse_multiple(MIME *pmime);
 
@@ -31,10 +37,10 @@ bool mail_set_header(MAIL *mail, const char *hdr, const char *val)
 	return mime_set_field(static_cast<MIME *>(node->pdata), hdr, val);
 }
 
-void mime_init(MIME *pmime, LIB_BUFFER *palloc)
+void mime_init(MIME *pmime)
 {
 #ifdef _DEBUG_UMTA
-	if (NULL == pmime || NULL == palloc) {
+	if (NULL == pmime) {
 		debug_info("[mime]: NULL pointer found in mime_init");
 		return;
 	}
@@ -53,8 +59,9 @@ void mime_init(MIME *pmime, LIB_BUFFER *palloc)
 	pmime->content_length	 = 0;
 	pmime->first_boundary    = NULL;
 	pmime->last_boundary     = NULL;
-	mem_file_init(&pmime->f_type_params, palloc);
-	mem_file_init(&pmime->f_other_fields, palloc);
+	mem_arena_init(&pmime->arena, MIME_ARENA_SIZE, MIME_ARENA_LIMIT);
+	mem_file_init(&pmime->f_type_params, &pmime->arena);
+	mem_file_init(&pmime->f_other_fields, &pmime->arena);
 	
 }
 
@@ -86,6 +93,7 @@ void mime_free(MIME *pmime)
 	}
 	mem_file_free(&pmime->f_type_params);
 	mem_file_free(&pmime->f_other_fields);
+	mem_arena_free(&pmime->arena);
 	pmime->content_type[0]	 = '\0';
 	pmime->boundary_string[0]= '\0';
 	pmime->boundary_len		 = 0;
@@ -154,19 +162,21 @@ BOOL mime_retrieve(MIME *pmime_parent,
 				} else {
 					pmime->mime_type = SINGLE_MIME;
 				}
-			} else {
-				mem_file_write(&pmime->f_other_fields,
-						(char*)&mime_field.field_name_len,
-						sizeof(mime_field.field_name_len));
-				mem_file_write(&pmime->f_other_fields,
-						mime_field.field_name,
-						mime_field.field_name_len);
-				mem_file_write(&pmime->f_other_fields,
-			            (char*)&mime_field.field_value_len,
-				        sizeof(mime_field.field_value_len));
-				mem_file_write(&pmime->f_other_fields,
-						mime_field.field_value,
-						mime_field.field_value_len);
+			} else if (mem_file_write(&pmime->f_other_fields,
+			    &mime_field.field_name_len,
+			    sizeof(mime_field.field_name_len)) != sizeof(mime_field.field_name_len) ||
+			    mem_file_write(&pmime->f_other_fields,
+			    mime_field.field_name,
+			    mime_field.field_name_len) != mime_field.field_name_len ||
+			    mem_file_write(&pmime->f_other_fields,
+			    &mime_field.field_value_len,
+			    sizeof(mime_field.field_value_len)) != sizeof(mime_field.field_value_len) ||
+			    mem_file_write(&pmime->f_other_fields,
+			    mime_field.field_value,
+			    mime_field.field_value_len) != mime_field.field_value_len) {
+				/* head exceeds MIME_ARENA_LIMIT */
+				mime_clear(pmime);
+				return FALSE;
 			}
 			if ('\r' == in_buff[current_offset]) {
 				pmime->head_begin = in_buff;
@@ -293,7 +303,7 @@ void mime_clear(MIME *pmime)
     pmime->last_boundary     = NULL;
 	mem_file_clear(&pmime->f_type_params);
 	mem_file_clear(&pmime->f_other_fields);
-
+	mem_arena_clear(&pmime->arena);
 }
 
 /*
@@ -758,6 +768,98 @@ BOOL mime_search_field(MIME *pmime, const char *tag, int order, char *value,
 	return FALSE;
 }
 
+/*
+ *	append one tag-value pair with a single write, so that running into
+ *	MIME_ARENA_LIMIT leaves no half record behind
+ */
+static BOOL mime_append_pair(MEM_FILE *pfile, const char *tag,
+	const char *value)
+{
+	int tag_len = strlen(tag), val_len = strlen(value);
+	std::string rec;
+
+	try {
+		rec.reserve(2 * sizeof(int) + tag_len + val_len);
+		rec.append(reinterpret_cast<char *>(&tag_len), sizeof(int));
+		rec.append(tag, tag_len);
+		rec.append(reinterpret_cast<char *>(&val_len), sizeof(int));
+		rec.append(value, val_len);
+	} catch (const std::bad_alloc &) {
+		return FALSE;
+	}
+	return mem_file_write(pfile, rec.data(), rec.size()) == rec.size() ?
+	       TRUE : FALSE;
+}
+
+/*
+ *	drop the first (or, with b_all, every) pair named @tag and, if @value
+ *	is given, append the new pair. The copy is made on the heap and then
+ *	written back into the file's own buffer, so that repeated edits do not
+ *	pile up in the part's arena. On failure the file is left unchanged.
+ *	@param
+ *		pfound [out]		whether a pair was dropped
+ */
+static BOOL mime_rewrite_pairs(MEM_FILE *pfile, const char *tag,
+	BOOL b_all, const char *value, BOOL *pfound)
+{
+	size_t tag_size = strlen(tag);
+	std::string orig, rebuilt;
+
+	*pfound = FALSE;
+	try {
+		orig.resize(mem_file_get_total_length(pfile));
+		mem_file_seek(pfile, MEM_FILE_READ_PTR, 0, MEM_FILE_SEEK_BEGIN);
+		if (orig.size() > 0 && mem_file_read(pfile,
+		    orig.data(), orig.size()) != orig.size()) {
+			return FALSE;
+		}
+		rebuilt.reserve(orig.size());
+		size_t pos = 0;
+		while (pos + sizeof(int) <= orig.size()) {
+			int tag_len, val_len;
+			auto start = pos;
+			memcpy(&tag_len, &orig[pos], sizeof(int));
+			pos += sizeof(int);
+			if (tag_len < 0 || orig.size() - pos < static_cast<size_t>(tag_len) + sizeof(int)) {
+				break;
+			}
+			bool b_hit = (TRUE == b_all || FALSE == *pfound) &&
+			             static_cast<size_t>(tag_len) == tag_size &&
+			             0 == strncasecmp(tag, &orig[pos], tag_len);
+			pos += tag_len;
+			memcpy(&val_len, &orig[pos], sizeof(int));
+			pos += sizeof(int);
+			if (val_len < 0 || orig.size() - pos < static_cast<size_t>(val_len)) {
+				break;
+			}
+			pos += val_len;
+			if (b_hit) {
+				*pfound = TRUE;
+				continue;
+			}
+			rebuilt.append(orig, start, pos - start);
+		}
+	} catch (const std::bad_alloc &) {
+		return FALSE;
+	}
+	if (FALSE == *pfound) {
+		return NULL == value ? TRUE : mime_append_pair(pfile, tag, value);
+	}
+	mem_file_clear(pfile);
+	if (rebuilt.size() > 0 && mem_file_write(pfile,
+	    rebuilt.data(), rebuilt.size()) != rebuilt.size()) {
+		mem_file_write(pfile, orig.data(), orig.size());
+		return FALSE;
+	}
+	if (NULL != value && FALSE == mime_append_pair(pfile, tag, value)) {
+		/* the old content still fits the buffer it came from */
+		mem_file_clear(pfile);
+		mem_file_write(pfile, orig.data(), orig.size());
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /*
  *	set the mime field, if the tag is "content-type", the content type and
  *	content type paramerter list is set, but not f_other_fields! 
@@ -771,11 +873,8 @@ BOOL mime_search_field(MIME *pmime, const char *tag, int order, char *value,
  */
 BOOL mime_set_field(MIME *pmime, const char *tag, const char *value)
 {
-	MEM_FILE file_tmp;
-	int		tag_len, val_len;
 	char	tmp_buff[MIME_FIELD_LEN];
-	BOOL	found_tag = FALSE;
-	int		i, mark;
+	BOOL	found_tag;
 	
 #ifdef _DEBUG_UMTA
 	if (NULL == pmime || NULL == tag || NULL == value) {
@@ -793,58 +892,10 @@ BOOL mime_set_field(MIME *pmime, const char *tag, const char *value)
 		}
 		return TRUE;
 	}
-	mem_file_seek(&pmime->f_other_fields, MEM_FILE_READ_PTR, 0,
-		MEM_FILE_SEEK_BEGIN);
-	mark = -1;
-	while (MEM_END_OF_FILE != mem_file_read(&pmime->f_other_fields,
-		&tag_len, sizeof(int))) {
-		mark ++;
-		mem_file_read(&pmime->f_other_fields, tmp_buff, tag_len);
-		tmp_buff[tag_len] = '\0';
-		if (0 == strcasecmp(tag, tmp_buff)) {
-			found_tag = TRUE;
-			break;
-		} 
-		mem_file_read(&pmime->f_other_fields, &val_len, sizeof(int));
-		mem_file_seek(&pmime->f_other_fields, MEM_FILE_READ_PTR, val_len,
-			MEM_FILE_SEEK_CUR);
-	}
-	if (FALSE == found_tag){
-		tag_len = strlen(tag);
-		val_len = strlen(value);
-		mem_file_write(&pmime->f_other_fields, (char*)&tag_len, sizeof(int));
-		mem_file_write(&pmime->f_other_fields, (char*)tag, tag_len);
-		mem_file_write(&pmime->f_other_fields, (char*)&val_len, sizeof(int));
-		mem_file_write(&pmime->f_other_fields, (char*)value, val_len);
-	} else {
-		mem_file_init(&file_tmp, pmime->f_other_fields.allocator);
-		mem_file_seek(&pmime->f_other_fields, MEM_FILE_READ_PTR, 0, 
-			MEM_FILE_SEEK_BEGIN);
-		i = 0;
-		while (MEM_END_OF_FILE != mem_file_read(&pmime->f_other_fields, 
-			&tag_len, sizeof(int))) {
-			mem_file_read(&pmime->f_other_fields, tmp_buff, tag_len);
-			if (i != mark) {
-				mem_file_write(&file_tmp, (char*)&tag_len, sizeof(int));
-				mem_file_write(&file_tmp, tmp_buff, tag_len);
-			}
-			mem_file_read(&pmime->f_other_fields, &val_len, sizeof(int));
-			mem_file_read(&pmime->f_other_fields, tmp_buff, val_len);
-			if (i != mark) {
-				mem_file_write(&file_tmp, (char*)&val_len, sizeof(int));
-				mem_file_write(&file_tmp, tmp_buff, val_len);
-			}
-			i ++;
-		}
-		/* write the new tag-value at the end of mem file */
-		tag_len = strlen(tag);
-		val_len = strlen(value);
-		mem_file_write(&file_tmp, (char*)&tag_len, sizeof(int));
-		mem_file_write(&file_tmp, (char*)tag, tag_len);
-		mem_file_write(&file_tmp, (char*)&val_len, sizeof(int));
-		mem_file_write(&file_tmp, (char*)value, val_len);
-		mem_file_copy(&file_tmp, &pmime->f_other_fields);
-		mem_file_free(&file_tmp);
+	/* the new tag-value goes to the end of the mem file */
+	if (FALSE == mime_rewrite_pairs(&pmime->f_other_fields, tag,
+	    FALSE, value, &found_tag)) {
+		return FALSE;
 	}
 	pmime->head_touched = TRUE;
 	return TRUE;
@@ -863,8 +914,6 @@ BOOL mime_set_field(MIME *pmime, const char *tag, const char *value)
  */
 BOOL mime_append_field(MIME *pmime, const char *tag, const char *value)
 {
-	int	tag_len, val_len;
-	
 #ifdef _DEBUG_UMTA
 	if (NULL == pmime || NULL == tag || NULL == value) {
 		debug_info("[mime]: NULL pointer found in mime_append_field");
@@ -874,12 +923,9 @@ BOOL mime_append_field(MIME *pmime, const char *tag, const char *value)
 	if (0 == strcasecmp(tag, "Content-Type")) {
 		return FALSE;
 	}
-	tag_len = strlen(tag);
-	val_len = strlen(value);
-	mem_file_write(&pmime->f_other_fields, (char*)&tag_len, sizeof(int));
-	mem_file_write(&pmime->f_other_fields, (char*)tag, tag_len);
-	mem_file_write(&pmime->f_other_fields, (char*)&val_len, sizeof(int));
-	mem_file_write(&pmime->f_other_fields, (char*)value, val_len);
+	if (FALSE == mime_append_pair(&pmime->f_other_fields, tag, value)) {
+		return FALSE;
+	}
 	pmime->head_touched = TRUE;
 	return TRUE;
 }
@@ -895,39 +941,15 @@ BOOL mime_append_field(MIME *pmime, const char *tag, const char *value)
  */
 BOOL mime_remove_field(MIME *pmime, const char *tag)
 {
-	BOOL found_tag = false;
-	MEM_FILE file_tmp;
-	char tmp_buff[MIME_FIELD_LEN];
-	int tag_len, val_len;
+	BOOL found_tag;
 
 	if (0 == strcasecmp(tag, "Content-Type")) {
 		return FALSE;
 	}
-	mem_file_init(&file_tmp, pmime->f_other_fields.allocator);
-	mem_file_seek(&pmime->f_other_fields, MEM_FILE_READ_PTR, 0,
-		MEM_FILE_SEEK_BEGIN);
-	while (MEM_END_OF_FILE != mem_file_read(&pmime->f_other_fields,
-		&tag_len, sizeof(int))) {
-		mem_file_read(&pmime->f_other_fields, tmp_buff, tag_len);
-		tmp_buff[tag_len] = '\0';
-		if (0 == strcasecmp(tag, tmp_buff)) {
-			found_tag = TRUE;
-			mem_file_read(&pmime->f_other_fields, &val_len, sizeof(int));
-			mem_file_seek(&pmime->f_other_fields, MEM_FILE_READ_PTR, val_len,
-				MEM_FILE_SEEK_CUR);
-		} else {
-			mem_file_write(&file_tmp, (char*)&tag_len, sizeof(int));
-			mem_file_write(&file_tmp, (char*)tmp_buff, tag_len);
-			mem_file_read(&pmime->f_other_fields, &val_len, sizeof(int));
-			mem_file_read(&pmime->f_other_fields, tmp_buff, val_len);
-			mem_file_write(&file_tmp, (char*)&val_len, sizeof(int));
-			mem_file_write(&file_tmp, (char*)tmp_buff, val_len);
-		}
-	}
-	if (TRUE == found_tag) {
-		mem_file_copy(&file_tmp, &pmime->f_other_fields);
+	if (FALSE == mime_rewrite_pairs(&pmime->f_other_fields, tag,
+	    TRUE, NULL, &found_tag)) {
+		return FALSE;
 	}
-	mem_file_free(&file_tmp);
 	return found_tag;
 }
 
@@ -980,11 +1002,8 @@ BOOL mime_get_content_param(MIME *pmime, const char *tag, char *value,
  */
 BOOL mime_set_content_param(MIME *pmime, const char *tag, const char *value)
 {
-	MEM_FILE file_tmp;
-	int	tag_len, val_len;
-	char	tmp_buff[MIME_FIELD_LEN];
-	BOOL	found_tag = FALSE;
-	int		i, mark, boundary_len;
+	BOOL	found_tag;
+	int		boundary_len;
 	
 #ifdef _DEBUG_UMTA
 	if (NULL == pmime || NULL == tag || NULL == value) {
@@ -1010,57 +1029,9 @@ BOOL mime_set_content_param(MIME *pmime, const char *tag, const char *value)
 			pmime->boundary_len = boundary_len;
 		}
 	}
-	mem_file_seek(&pmime->f_type_params, MEM_FILE_READ_PTR, 0, 
-		MEM_FILE_SEEK_BEGIN);
-	mark = -1;
-	while (MEM_END_OF_FILE != mem_file_read(&pmime->f_type_params,
-		&tag_len, sizeof(int))) {
-		mark ++;
-		mem_file_read(&pmime->f_type_params, tmp_buff, tag_len);
-		tmp_buff[tag_len] = '\0';
-		if (0 == strcasecmp(tag, tmp_buff)) {
-			found_tag = TRUE;
-			break;
-		} 
-		mem_file_read(&pmime->f_type_params, &val_len, sizeof(int));
-		mem_file_read(&pmime->f_type_params, tmp_buff, val_len);
-	}
-	if (FALSE == found_tag){
-		tag_len = strlen(tag);
-		val_len = strlen(value);
-		mem_file_write(&pmime->f_type_params, (char*)&tag_len, sizeof(int));
-		mem_file_write(&pmime->f_type_params, (char*)tag, tag_len);
-		mem_file_write(&pmime->f_type_params, (char*)&val_len, sizeof(int));
-		mem_file_write(&pmime->f_type_params, (char*)value, val_len);
-	} else {
-		mem_file_init(&file_tmp, pmime->f_type_params.allocator);
-		mem_file_seek(&pmime->f_type_params, MEM_FILE_READ_PTR, 0, 
-			MEM_FILE_SEEK_BEGIN);
-		i = 0;
-		while (MEM_END_OF_FILE != mem_file_read(&pmime->f_type_params, 
-			(char*)&tag_len, sizeof(int))) {
-			mem_file_read(&pmime->f_type_params, tmp_buff, tag_len);
-			if (i != mark) {
-				mem_file_write(&file_tmp, (char*)&tag_len, sizeof(int));
-				mem_file_write(&file_tmp, tmp_buff, tag_len);
-			}
-			mem_file_read(&pmime->f_type_params, (char*)&val_len, sizeof(int));
-			mem_file_read(&pmime->f_type_params, tmp_buff, val_len);
-			if (i != mark) {
-				mem_file_write(&file_tmp, (char*)&val_len, sizeof(int));
-				mem_file_write(&file_tmp, tmp_buff, val_len);
-			}
-			i ++;
-		}
-		/* write the new tag-value at the end of mem file */
-		tag_len = strlen(tag);
-		val_len = strlen(value);
-		mem_file_write(&file_tmp, (char*)&tag_len, sizeof(int));
-		mem_file_write(&file_tmp, (char*)tag, tag_len);
-		mem_file_write(&file_tmp, (char*)&val_len, sizeof(int));
-		mem_file_write(&file_tmp, (char*)value, val_len);
-		mem_file_copy(&file_tmp, &pmime->f_type_params);
-		mem_file_free(&file_tmp);
+	if (FALSE == mime_rewrite_pairs(&pmime->f_type_params, tag,
+	    FALSE, value, &found_tag)) {
+		return FALSE;
 	}
 	pmime->head_touched = TRUE;
 	return TRUE;
@@ -5,12 +5,10 @@
 /*
  *	@param
  *		number			number of mimes
- *		ratio			proportion between mem file blocks and mime
- *						usually 4~256
  *	@return
  *		mime pool object
  */
-MIME_POOL* mime_pool_init(size_t number, int ratio, BOOL thread_safe)
+MIME_POOL* mime_pool_init(size_t number, BOOL thread_safe)
 {
 	size_t i;
 	MIME_POOL_NODE *ptemp_mime;
@@ -27,25 +25,12 @@ MIME_POOL* mime_pool_init(size_t number, int ratio, BOOL thread_safe)
 		free(pmime_pool);
 		return NULL;
 	}
-	if (ratio < 4) {
-		ratio = 4;
-	} else if (ratio > 256) {
-		ratio = 256;
-	}
-	pmime_pool->allocator = lib_buffer_init(FILE_ALLOC_SIZE,
-							number*ratio, thread_safe);
-	if (NULL == pmime_pool->allocator) {
-		debug_info("[mime_pool]: Failed to init file allocator");
-		free(pmime_pool->pbegin);
-		free(pmime_pool);
-		return NULL;
-	}
 	single_list_init(&pmime_pool->free_list);
 	for (i=0; i<number; i++) {
 		ptemp_mime = pmime_pool->pbegin + i;
 		ptemp_mime->node.pdata = ptemp_mime;
 		ptemp_mime->pool = pmime_pool;
-		mime_init(&ptemp_mime->mime, pmime_pool->allocator);
+		mime_init(&ptemp_mime->mime);
 		single_list_append_as_tail(&pmime_pool->free_list, &ptemp_mime->node);
 	}
 	if (TRUE == thread_safe) {
@@ -83,10 +68,6 @@ void mime_pool_free(MIME_POOL *pmime_pool)
 		free(pmime_pool->pbegin);
 		pmime_pool->pbegin = NULL;
 	}
-	if (NULL != pmime_pool->allocator) {
-		lib_buffer_free(pmime_pool->allocator);
-		pmime_pool->allocator = NULL;
-	}
     free(pmime_pool);
 }
 
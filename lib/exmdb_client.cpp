@@ -0,0 +1,951 @@
+// SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Pool of exmdb connections. Every connection carries one request at a
+ * time; the exmdb server works through a connection strictly in order, so
+ * sharing a socket between callers would only queue them behind each other.
+ *
+ * Idle sockets are watched with epoll by the scan thread. An idle socket
+ * that turns readable was closed (or garbled) by the server and is replaced
+ * at once, rather than being found out by the next caller. Keepalive pings
+ * only go to connections that would otherwise run into the server's idle
+ * timeout. Callers that find all connections of a server busy wait for one
+ * to be handed back instead of failing outright.
+ *
+ * Servers on this host are reached through their unix socket when they
+ * offer one, and each such connection shares a memfd region with the
+ * server for the payloads (see exmdb_rpc.hpp), so that large requests and
+ * responses are not copied through the socket.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <libHX/defs.h>
+#include <gromox/defs.h>
+#include <gromox/exmdb_client.hpp>
+#include <gromox/exmdb_rpc.hpp>
+#include <gromox/ext_buffer.hpp>
+#include <gromox/list_file.hpp>
+#include <gromox/socket.h>
+#define SOCKET_TIMEOUT								60
+/* latency histogram: bucket n counts requests that took < 2^n ms */
+#define LATENCY_BUCKETS								20
+/* payload region per connection to a co-located server; backed lazily */
+#define SHM_SIZE									(4 * 1024 * 1024)
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct remote_svr;
+struct remote_conn {
+	remote_svr *psvr = nullptr;
+	time_t last_time = 0;
+	int sockd = -1;
+	bool b_idle = false;
+	void *shm = nullptr;
+	uint32_t shm_size = 0;
+};
+
+struct remote_svr : public EXMDB_ITEM {
+	remote_svr(EXMDB_ITEM &&o) : EXMDB_ITEM(std::move(o)) {}
+
+	std::list<remote_conn> conn_list; /* idle connections */
+	std::condition_variable waitq;
+	unsigned int busy_num = 0, waiters = 0;
+	bool b_local = false;
+	std::atomic<uint64_t> rpc_num{0}, err_num{0}, reconn_num{0}, dead_num{0};
+	std::atomic<uint64_t> shm_num{0};
+	std::atomic<uint64_t> lat_total{0}, lat_max{0}; /* microseconds */
+	std::atomic<uint64_t> lat_hist[LATENCY_BUCKETS]{};
+};
+
+struct remote_conn_ref {
+	remote_conn_ref() = default;
+	remote_conn_ref(remote_conn_ref &&o) : tmplist(std::move(o.tmplist)) {}
+	~remote_conn_ref() { reset(true); }
+	remote_conn *operator->() { return &tmplist.front(); }
+	remote_conn &operator*() { return tmplist.front(); }
+	bool operator==(std::nullptr_t) const { return tmplist.size() == 0; }
+	bool operator!=(std::nullptr_t) const { return tmplist.size() != 0; }
+	void reset(bool lost = false);
+
+	std::list<remote_conn> tmplist;
+};
+
+struct agent_thread {
+	remote_svr *pserver = nullptr;
+	pthread_t thr_id{};
+	int sockd = -1;
+};
+
+}
+
+static unsigned int g_conn_num, g_threads_num, g_flags;
+static std::string g_remote_id;
+static std::atomic<bool> g_notify_stop{true};
+static bool g_scan_started;
+static pthread_t g_scan_id;
+static int g_epoll_fd = -1, g_event_fd = -1;
+static std::list<remote_conn> g_lost_list;
+static std::list<agent_thread> g_agent_list;
+static std::list<remote_svr> g_server_list;
+static std::vector<EXMDB_ITEM> g_local_list;
+static std::mutex g_server_lock;
+static void (*g_build_env)(bool);
+static void (*g_free_env)();
+static void (*exmdb_client_event_proc)(const char *dir,
+	BOOL b_table, uint32_t notify_id, const DB_NOTIFY *pdb_notify);
+
+static int cl_rd_sock(int fd, BINARY *b) { return exmdb_client_read_socket(fd, b, SOCKET_TIMEOUT * 1000); }
+static int cl_wr_sock(int fd, const BINARY *b) { return exmdb_client_write_socket(fd, b, SOCKET_TIMEOUT * 1000); }
+
+static void cl_build_env(const remote_svr *s)
+{
+	if (g_build_env != nullptr)
+		g_build_env(s->type == EXMDB_ITEM::EXMDB_PRIVATE);
+}
+
+static void cl_free_env()
+{
+	if (g_free_env != nullptr)
+		g_free_env();
+}
+
+static void cl_wake_scan()
+{
+	uint64_t one = 1;
+	if (write(g_event_fd, &one, sizeof(one)) != sizeof(one))
+		/* counter already pending */;
+}
+
+/* The following helpers are called with g_server_lock held. */
+static void cl_put_idle(std::list<remote_conn> &from,
+    std::list<remote_conn>::iterator it)
+{
+	auto psvr = it->psvr;
+	struct epoll_event ev{};
+
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = &*it;
+	it->b_idle = true;
+	if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, it->sockd, &ev) != 0)
+		/* still usable, just not watched */;
+	psvr->conn_list.splice(psvr->conn_list.end(), from, it);
+	if (psvr->waiters > 0)
+		psvr->waitq.notify_one();
+}
+
+static void cl_take_idle(std::list<remote_conn> &to,
+    std::list<remote_conn>::iterator it)
+{
+	auto psvr = it->psvr;
+	it->b_idle = false;
+	epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, it->sockd, nullptr);
+	to.splice(to.end(), psvr->conn_list, it);
+	++psvr->busy_num;
+}
+
+static void cl_drop_shm(remote_conn &conn)
+{
+	if (conn.shm != nullptr)
+		munmap(conn.shm, conn.shm_size);
+	conn.shm = nullptr;
+	conn.shm_size = 0;
+}
+
+static void cl_put_lost(std::list<remote_conn> &from,
+    std::list<remote_conn>::iterator it)
+{
+	close(it->sockd);
+	it->sockd = -1;
+	cl_drop_shm(*it);
+	it->b_idle = false;
+	g_lost_list.splice(g_lost_list.end(), from, it);
+	cl_wake_scan();
+}
+
+/* return a borrowed connection (from cl_take_idle) */
+static void cl_hand_back(std::list<remote_conn> &from,
+    std::list<remote_conn>::iterator it, bool lost)
+{
+	auto psvr = it->psvr;
+	--psvr->busy_num;
+	if (!lost) {
+		cl_put_idle(from, it);
+		return;
+	}
+	cl_put_lost(from, it);
+	/* nobody left to hand back a connection */
+	if (psvr->busy_num == 0 && psvr->waiters > 0)
+		psvr->waitq.notify_all();
+}
+
+int exmdb_client_get_param(int param)
+{
+	int total_num = 0;
+	std::lock_guard sv_hold(g_server_lock);
+
+	switch (param) {
+	case ALIVE_PROXY_CONNECTIONS:
+		for (const auto &srv : g_server_list)
+			total_num += srv.conn_list.size() + srv.busy_num;
+		return total_num;
+	case LOST_PROXY_CONNECTIONS:
+		return g_lost_list.size();
+	}
+	return -1;
+}
+
+void exmdb_client_get_stats(char *buf, size_t len)
+{
+	size_t offset = 0;
+
+	if (len == 0)
+		return;
+	*buf = '\0';
+	std::lock_guard sv_hold(g_server_lock);
+	for (const auto &srv : g_server_list) {
+		uint64_t rpc_num = srv.rpc_num, total = 0;
+		unsigned int p99 = 0;
+		for (; p99 < LATENCY_BUCKETS - 1; ++p99) {
+			total += srv.lat_hist[p99];
+			if (total * 100 >= rpc_num * 99)
+				break;
+		}
+		auto ret = snprintf(buf + offset, len - offset,
+		           "[%s]:%hu/%s: idle %zu, busy %u, rpc %llu, "
+		           "shm %llu, failed %llu, dead %llu, reconnects %llu, "
+		           "avg %lluus, max %lluus, p99 <%ums\r\n",
+		           srv.host.c_str(), srv.port, srv.prefix.c_str(),
+		           srv.conn_list.size(), srv.busy_num, LLU(rpc_num),
+		           LLU(srv.shm_num.load()),
+		           LLU(srv.err_num.load()), LLU(srv.dead_num.load()),
+		           LLU(srv.reconn_num.load()),
+		           LLU(rpc_num == 0 ? 0 : srv.lat_total / rpc_num),
+		           LLU(srv.lat_max.load()), 1U << p99);
+		if (ret < 0 || static_cast<size_t>(ret) >= len - offset)
+			break;
+		offset += ret;
+	}
+}
+
+static void cl_account(remote_svr *psvr, bool b_ok,
+    std::chrono::steady_clock::time_point start)
+{
+	uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+	                std::chrono::steady_clock::now() - start).count();
+	unsigned int bucket = 0;
+
+	++psvr->rpc_num;
+	if (!b_ok)
+		++psvr->err_num;
+	psvr->lat_total += usec;
+	auto prev = psvr->lat_max.load();
+	while (usec > prev && !psvr->lat_max.compare_exchange_weak(prev, usec))
+		/* retry */;
+	while (bucket < LATENCY_BUCKETS - 1 && usec >= (1000ULL << bucket))
+		++bucket;
+	++psvr->lat_hist[bucket];
+}
+
+static int cl_connect_unix(uint16_t port)
+{
+	struct sockaddr_un un{};
+
+	un.sun_family = AF_UNIX;
+	exmdb_local_socket_path(port, un.sun_path, GX_ARRAY_SIZE(un.sun_path));
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&un), sizeof(un)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* a region the server cannot be made to fault on: sealed against resizing */
+static void *cl_shm_create(int *pfd)
+{
+	int fd = memfd_create("exmdb_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return nullptr;
+	if (ftruncate(fd, SHM_SIZE) != 0 ||
+	    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+		close(fd);
+		return nullptr;
+	}
+	auto ptr = mmap(nullptr, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		close(fd);
+		return nullptr;
+	}
+	*pfd = fd;
+	return ptr;
+}
+
+/* send @b with @fd attached to its first byte */
+static BOOL cl_wr_sock_fd(int sockd, const BINARY *b, int fd)
+{
+	char cbuf[CMSG_SPACE(sizeof(int))]{};
+	struct iovec iov = {b->pb, b->cb};
+	struct msghdr msg{};
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	auto ret = sendmsg(sockd, &msg, MSG_NOSIGNAL);
+	if (ret <= 0)
+		return false;
+	if (static_cast<size_t>(ret) == b->cb)
+		return TRUE;
+	BINARY rest;
+	rest.cb = b->cb - ret;
+	rest.pb = b->pb + ret;
+	return cl_wr_sock(sockd, &rest);
+}
+
+/*
+ * Read a response on a connection with a shared region. The body is either
+ * in the region, in which case @bin points there and is only valid until
+ * the next request on @pconn, or follows on the socket.
+ */
+static BOOL cl_rd_conn(remote_conn *pconn, BINARY *bin)
+{
+	if (pconn->shm == nullptr)
+		return cl_rd_sock(pconn->sockd, bin);
+	uint8_t hdr[5];
+	size_t got = 0;
+	struct pollfd pfd = {pconn->sockd, POLLIN | POLLPRI};
+	while (got < sizeof(hdr)) {
+		if (poll(&pfd, 1, SOCKET_TIMEOUT * 1000) != 1)
+			return false;
+		auto ret = read(pconn->sockd, &hdr[got], sizeof(hdr) - got);
+		if (ret <= 0)
+			return false;
+		got += ret;
+		if (hdr[0] != exmdb_response::SUCCESS)
+			break; /* status byte only */
+	}
+	if (got < sizeof(hdr)) {
+		bin->cb = 1;
+		bin->pv = exmdb_rpc_alloc(1);
+		if (bin->pv == nullptr)
+			return false;
+		bin->pb[0] = hdr[0];
+		return TRUE;
+	}
+	uint32_t len;
+	memcpy(&len, &hdr[1], sizeof(len));
+	if (len == EXMDB_SHM_FRAME) {
+		memcpy(&len, static_cast<uint8_t *>(pconn->shm) + 1, sizeof(len));
+		len = le32_to_cpu(len);
+		if (len > pconn->shm_size - sizeof(hdr))
+			return false;
+		bin->cb = len + sizeof(hdr);
+		bin->pv = pconn->shm;
+		++pconn->psvr->shm_num;
+		return TRUE;
+	}
+	len = le32_to_cpu(len);
+	bin->cb = len + sizeof(hdr);
+	bin->pv = exmdb_rpc_alloc(bin->cb);
+	if (bin->pv == nullptr)
+		return false;
+	memcpy(bin->pb, hdr, sizeof(hdr));
+	while (got < bin->cb) {
+		if (poll(&pfd, 1, SOCKET_TIMEOUT * 1000) != 1)
+			return false;
+		auto ret = read(pconn->sockd, &bin->pb[got], bin->cb - got);
+		if (ret <= 0)
+			return false;
+		got += ret;
+	}
+	return TRUE;
+}
+
+/*
+ * Establish a connection to @pserver. Unless @b_listen, @pconn receives
+ * the shared region if the server took one.
+ */
+static int exmdb_client_connect_exmdb(remote_svr *pserver, BOOL b_listen,
+    remote_conn *pconn = nullptr)
+{
+	BINARY tmp_bin;
+	EXMDB_REQUEST request;
+	uint8_t response_code;
+	int shm_fd = -1;
+	void *shm = nullptr;
+
+	int sockd = pserver->b_local ? cl_connect_unix(pserver->port) : -1;
+	if (sockd >= 0 && !b_listen)
+		shm = cl_shm_create(&shm_fd);
+	else if (sockd < 0)
+		sockd = gx_inet_connect(pserver->host.c_str(), pserver->port, 0);
+	if (sockd < 0) {
+		static std::atomic<time_t> g_lastwarn_time;
+		auto prev = g_lastwarn_time.load();
+		auto next = prev + 60;
+		auto now = time(nullptr);
+		if (next <= now && g_lastwarn_time.compare_exchange_strong(prev, now))
+			fprintf(stderr, "gx_inet_connect exmdb_client@%s@[%s]:%hu: %s\n",
+			        g_remote_id.c_str(), pserver->host.c_str(),
+			        pserver->port, strerror(-sockd));
+	        return -1;
+	}
+	auto cl_fail = [&]() {
+		if (shm != nullptr)
+			munmap(shm, SHM_SIZE);
+		if (shm_fd >= 0)
+			close(shm_fd);
+		close(sockd);
+		return -1;
+	};
+	if (FALSE == b_listen) {
+		request.call_id = exmdb_callid::CONNECT;
+		request.payload.connect.prefix = deconst(pserver->prefix.c_str());
+		request.payload.connect.remote_id = deconst(g_remote_id.c_str());
+		request.payload.connect.b_private = pserver->type == EXMDB_ITEM::EXMDB_PRIVATE ? TRUE : false;
+	} else {
+		request.call_id = exmdb_callid::LISTEN_NOTIFICATION;
+		request.payload.listen_notification.remote_id = deconst(g_remote_id.c_str());
+	}
+	if (EXT_ERR_SUCCESS != exmdb_ext_push_request(&request, &tmp_bin)) {
+		return cl_fail();
+	}
+	if (shm_fd >= 0 ? !cl_wr_sock_fd(sockd, &tmp_bin, shm_fd) :
+	    !cl_wr_sock(sockd, &tmp_bin)) {
+		free(tmp_bin.pb);
+		return cl_fail();
+	}
+	free(tmp_bin.pb);
+	if (shm_fd >= 0) {
+		/* the server has its own reference now */
+		close(shm_fd);
+		shm_fd = -1;
+	}
+	cl_build_env(pserver);
+	if (!cl_rd_sock(sockd, &tmp_bin)) {
+		cl_free_env();
+		return cl_fail();
+	}
+	response_code = tmp_bin.pb[0];
+	if (response_code == exmdb_response::SUCCESS) {
+		uint32_t shm_size = 0;
+		if (tmp_bin.cb == 9 && shm != nullptr) {
+			memcpy(&shm_size, &tmp_bin.pb[5], sizeof(shm_size));
+			shm_size = le32_to_cpu(shm_size);
+		} else if (tmp_bin.cb != 5) {
+			cl_free_env();
+			printf("[exmdb_client]: response format error "
+			       "during connect to [%s]:%hu/%s\n",
+			       pserver->host.c_str(), pserver->port, pserver->prefix.c_str());
+			return cl_fail();
+		}
+		cl_free_env();
+		if (shm_size == 0 || shm_size > SHM_SIZE || pconn == nullptr) {
+			/* server declined the region */
+			if (shm != nullptr)
+				munmap(shm, SHM_SIZE);
+		} else {
+			pconn->shm = shm;
+			pconn->shm_size = shm_size;
+		}
+		return sockd;
+	}
+	printf("[exmdb_client]: Failed to connect to [%s]:%hu/%s: %s\n",
+	       pserver->host.c_str(), pserver->port, pserver->prefix.c_str(),
+	       exmdb_rpc_strerror(response_code));
+	cl_free_env();
+	return cl_fail();
+}
+
+/* milliseconds until the scan thread has something to do */
+static int cl_scan_timeout()
+{
+	std::lock_guard sv_hold(g_server_lock);
+	if (g_lost_list.size() > 0)
+		return 1000;
+	/*
+	 * Connections turning idle later than now cannot come due before
+	 * half the ping interval is over, so that is the longest nap.
+	 */
+	time_t due = time(nullptr) + (SOCKET_TIMEOUT - 3) / 2;
+	for (const auto &srv : g_server_list)
+		for (const auto &conn : srv.conn_list)
+			due = std::min(due, conn.last_time + SOCKET_TIMEOUT - 3);
+	auto wait = due - time(nullptr);
+	return wait <= 0 ? 0 : wait * 1000;
+}
+
+/* drop an idle connection that the server has closed */
+static void cl_check_idle(remote_conn *pconn)
+{
+	char c;
+
+	if (!pconn->b_idle)
+		return; /* borrowed in the meantime */
+	auto ret = recv(pconn->sockd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	/* EOF, error, or data nobody asked for */
+	auto psvr = pconn->psvr;
+	auto it = std::find_if(psvr->conn_list.begin(), psvr->conn_list.end(),
+	          [&](const remote_conn &e) { return &e == pconn; });
+	if (it == psvr->conn_list.end())
+		return;
+	epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, it->sockd, nullptr);
+	++psvr->dead_num;
+	cl_put_lost(psvr->conn_list, it);
+}
+
+static void *exmdbcl_scanwork(void *pparam)
+{
+	uint8_t resp_buff;
+	uint32_t ping_buff = 0;
+	struct pollfd pfd_read;
+	struct epoll_event events[64];
+	std::list<remote_conn> temp_list;
+
+	while (!g_notify_stop) {
+		auto num = epoll_wait(g_epoll_fd, events, GX_ARRAY_SIZE(events),
+		           cl_scan_timeout());
+		if (g_notify_stop)
+			break;
+		std::unique_lock sv_hold(g_server_lock);
+		for (int i = 0; i < num; ++i) {
+			if (events[i].data.ptr == nullptr) {
+				uint64_t cnt;
+				if (read(g_event_fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+					/* spurious */;
+				continue;
+			}
+			cl_check_idle(static_cast<remote_conn *>(events[i].data.ptr));
+		}
+		auto now_time = time(nullptr);
+		for (auto &srv : g_server_list) {
+			for (auto it = srv.conn_list.begin(); it != srv.conn_list.end(); ) {
+				auto next = std::next(it);
+				if (now_time - it->last_time >= SOCKET_TIMEOUT - 3)
+					cl_take_idle(temp_list, it);
+				it = next;
+			}
+		}
+		sv_hold.unlock();
+
+		while (temp_list.size() > 0) {
+			auto pconn = &temp_list.front();
+			bool b_ok = !g_notify_stop &&
+			            write(pconn->sockd, &ping_buff, sizeof(uint32_t)) == sizeof(uint32_t);
+			if (b_ok) {
+				pfd_read.fd = pconn->sockd;
+				pfd_read.events = POLLIN|POLLPRI;
+				b_ok = poll(&pfd_read, 1, SOCKET_TIMEOUT * 1000) == 1 &&
+				       read(pconn->sockd, &resp_buff, 1) == 1 &&
+				       resp_buff == exmdb_response::SUCCESS;
+			}
+			if (b_ok)
+				time(&pconn->last_time);
+			sv_hold.lock();
+			cl_hand_back(temp_list, temp_list.begin(), !b_ok);
+			sv_hold.unlock();
+		}
+
+		sv_hold.lock();
+		temp_list = std::move(g_lost_list);
+		g_lost_list.clear();
+		sv_hold.unlock();
+
+		while (temp_list.size() > 0) {
+			auto pconn = &temp_list.front();
+			if (g_notify_stop) {
+				sv_hold.lock();
+				g_lost_list.splice(g_lost_list.end(), temp_list, temp_list.begin());
+				sv_hold.unlock();
+				continue;
+			}
+			pconn->sockd = exmdb_client_connect_exmdb(pconn->psvr, FALSE, pconn);
+			sv_hold.lock();
+			if (-1 != pconn->sockd) {
+				if (pconn->last_time != 0)
+					++pconn->psvr->reconn_num;
+				time(&pconn->last_time);
+				cl_put_idle(temp_list, temp_list.begin());
+			} else {
+				g_lost_list.splice(g_lost_list.end(), temp_list, temp_list.begin());
+			}
+			sv_hold.unlock();
+		}
+	}
+	return NULL;
+}
+
+static void *exmdbcl_thrwork(void *pparam)
+{
+	int tv_msec;
+	BINARY tmp_bin;
+	uint8_t resp_code;
+	uint32_t buff_len, offset = 0;
+	uint8_t buff[0x8000];
+	struct pollfd pfd_read;
+	DB_NOTIFY_DATAGRAM notify;
+
+	auto pagent = static_cast<agent_thread *>(pparam);
+	while (!g_notify_stop) {
+		pagent->sockd = exmdb_client_connect_exmdb(
+							pagent->pserver, TRUE);
+		if (-1 == pagent->sockd) {
+			sleep(1);
+			continue;
+		}
+		buff_len = 0;
+		while (TRUE) {
+			tv_msec = SOCKET_TIMEOUT * 1000;
+			pfd_read.fd = pagent->sockd;
+			pfd_read.events = POLLIN|POLLPRI;
+			if (1 != poll(&pfd_read, 1, tv_msec)) {
+				close(pagent->sockd);
+				pagent->sockd = -1;
+				break;
+			}
+			if (0 == buff_len) {
+				if (sizeof(uint32_t) != read(pagent->sockd,
+					&buff_len, sizeof(uint32_t))) {
+					close(pagent->sockd);
+					pagent->sockd = -1;
+					break;
+				}
+				/* ping packet */
+				if (0 == buff_len) {
+					resp_code = exmdb_response::SUCCESS;
+					if (1 != write(pagent->sockd, &resp_code, 1)) {
+						close(pagent->sockd);
+						pagent->sockd = -1;
+						break;
+					}
+				}
+				offset = 0;
+				continue;
+			}
+			auto read_len = read(pagent->sockd, buff + offset, buff_len - offset);
+			if (read_len <= 0) {
+				close(pagent->sockd);
+				pagent->sockd = -1;
+				break;
+			}
+			offset += read_len;
+			if (offset != buff_len)
+				continue;
+			tmp_bin.cb = buff_len;
+			tmp_bin.pb = buff;
+			cl_build_env(pagent->pserver);
+			resp_code = exmdb_ext_pull_db_notify(&tmp_bin, &notify) == EXT_ERR_SUCCESS ?
+			            exmdb_response::SUCCESS : exmdb_response::PULL_ERROR;
+			if (1 != write(pagent->sockd, &resp_code, 1)) {
+				close(pagent->sockd);
+				pagent->sockd = -1;
+				cl_free_env();
+				break;
+			}
+			if (resp_code == exmdb_response::SUCCESS &&
+			    exmdb_client_event_proc != nullptr) {
+				for (size_t i = 0; i < notify.id_array.count; ++i)
+					exmdb_client_event_proc(notify.dir,
+						notify.b_table, notify.id_array.pl[i],
+						&notify.db_notify);
+			}
+			cl_free_env();
+			buff_len = 0;
+		}
+	}
+	return nullptr;
+}
+
+static remote_conn_ref exmdb_client_get_connection(const char *dir)
+{
+	remote_conn_ref fc;
+	auto i = std::find_if(g_server_list.begin(), g_server_list.end(),
+	         [&](const remote_svr &s) { return strncmp(dir, s.prefix.c_str(), s.prefix.size()) == 0; });
+	if (i == g_server_list.end()) {
+		printf("[exmdb_client]: cannot find remote server for %s\n", dir);
+		return fc;
+	}
+	std::unique_lock sv_hold(g_server_lock);
+	if (i->conn_list.size() == 0 && i->busy_num > 0) {
+		++i->waiters;
+		i->waitq.wait_for(sv_hold, SOCKET_TIMEOUT * 1s, [&]() {
+			return i->conn_list.size() > 0 || i->busy_num == 0 ||
+			       g_notify_stop;
+		});
+		--i->waiters;
+	}
+	if (i->conn_list.size() == 0) {
+		sv_hold.unlock();
+		++i->err_num;
+		printf("[exmdb_client]: no alive connection for [%s]:%hu/%s\n",
+		       i->host.c_str(), i->port, i->prefix.c_str());
+		return fc;
+	}
+	cl_take_idle(fc.tmplist, i->conn_list.begin());
+	return fc;
+}
+
+void remote_conn_ref::reset(bool lost)
+{
+	if (tmplist.size() == 0)
+		return;
+	std::lock_guard sv_hold(g_server_lock);
+	cl_hand_back(tmplist, tmplist.begin(), lost);
+	tmplist.clear();
+}
+
+void exmdb_client_init(unsigned int conn_num, unsigned int threads_num,
+    const char *remote_id)
+{
+	g_notify_stop = true;
+	g_conn_num = conn_num;
+	g_threads_num = threads_num;
+	g_remote_id = remote_id;
+}
+
+int exmdb_client_run(const char *cfgdir, unsigned int flags,
+    void (*build_env)(bool), void (*free_env)())
+{
+	std::vector<EXMDB_ITEM> xmlist;
+	size_t i = 0;
+
+	auto ret = list_file_read_exmdb("exmdb_list.txt", cfgdir, xmlist);
+	if (ret < 0) {
+		printf("[exmdb_client]: list_file_read_exmdb: %s\n", strerror(-ret));
+		return 1;
+	}
+	g_flags = flags;
+	g_build_env = build_env;
+	g_free_env = free_env;
+	g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	g_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (g_epoll_fd < 0 || g_event_fd < 0) {
+		printf("[exmdb_client]: epoll/eventfd: %s\n", strerror(errno));
+		return 2;
+	}
+	struct epoll_event ev{};
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+	if (epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, g_event_fd, &ev) != 0) {
+		printf("[exmdb_client]: epoll_ctl: %s\n", strerror(errno));
+		return 2;
+	}
+	g_notify_stop = false;
+	for (auto &&item : xmlist) {
+		if (flags & EXMDB_CLIENT_SKIP_PUBLIC &&
+		    item.type != EXMDB_ITEM::EXMDB_PRIVATE)
+			continue;
+		auto b_local = gx_peer_is_local(item.host.c_str());
+		if (flags & EXMDB_CLIENT_SKIP_REMOTE && !b_local)
+			continue;
+		if (flags & EXMDB_CLIENT_ALLOW_DIRECT && b_local) try {
+			g_local_list.push_back(std::move(item));
+			continue;
+		} catch (const std::bad_alloc &) {
+			printf("[exmdb_client]: Failed to allocate memory\n");
+			g_notify_stop = true;
+			return 3;
+		}
+		if (flags & EXMDB_CLIENT_ALLOW_DIRECT && g_conn_num == 0) {
+			printf("[exmdb_client]: there's remote store media "
+				"in exmdb list, but rpc proxy connection number is 0\n");
+			g_notify_stop = true;
+			return 4;
+		}
+
+		try {
+			g_server_list.emplace_back(std::move(item));
+		} catch (const std::bad_alloc &) {
+			printf("[exmdb_client]: Failed to allocate memory for exmdb\n");
+			g_notify_stop = true;
+			return 5;
+		}
+		auto &srv = g_server_list.back();
+		srv.b_local = b_local;
+		for (decltype(g_conn_num) j = 0; j < g_conn_num; ++j) {
+			remote_conn conn;
+			static_assert(std::is_same_v<decltype(g_server_list), std::list<decltype(g_server_list)::value_type>>,
+				"addrof remote_svrs must not change; remote_conn/agent_thread has a pointer to it");
+			conn.psvr = &srv;
+			try {
+				g_lost_list.push_back(std::move(conn));
+			} catch (const std::bad_alloc &) {
+				printf("[exmdb_client]: fail to "
+					"allocate memory for exmdb\n");
+				g_notify_stop = true;
+				return 6;
+			}
+		}
+		for (decltype(g_threads_num) j = 0; j < g_threads_num; ++j) {
+			try {
+				g_agent_list.push_back(agent_thread{});
+			} catch (const std::bad_alloc &) {
+				printf("[exmdb_client]: fail to "
+					"allocate memory for exmdb\n");
+				g_notify_stop = true;
+				return 7;
+			}
+			auto &ag = g_agent_list.back();
+			ag.pserver = &srv;
+			static_assert(std::is_same_v<decltype(g_agent_list), std::list<decltype(g_agent_list)::value_type>>,
+				"addrof agent_threads must not change; other thread has its address in use");
+			ret = pthread_create(&ag.thr_id, nullptr, exmdbcl_thrwork, &ag);
+			if (ret != 0) {
+				printf("[exmdb_client]: E-1441: pthread_create: %s\n", strerror(ret));
+				g_notify_stop = true;
+				g_agent_list.pop_back();
+				return 8;
+			}
+			char buf[32];
+			snprintf(buf, sizeof(buf), "exmdbcl/%zu", i);
+			pthread_setname_np(ag.thr_id, buf);
+		}
+		++i;
+	}
+	if (0 == g_conn_num) {
+		return 0;
+	}
+	ret = pthread_create(&g_scan_id, nullptr, exmdbcl_scanwork, nullptr);
+	if (ret != 0) {
+		printf("[exmdb_client]: failed to create proxy scan thread: %s\n", strerror(ret));
+		g_notify_stop = true;
+		return 9;
+	}
+	g_scan_started = true;
+	pthread_setname_np(g_scan_id, "exmdbcl/scan");
+	return 0;
+}
+
+void exmdb_client_stop()
+{
+	g_notify_stop = true;
+	if (g_scan_started) {
+		cl_wake_scan();
+		pthread_join(g_scan_id, NULL);
+		g_scan_started = false;
+	}
+	for (auto &ag : g_agent_list) {
+		pthread_kill(ag.thr_id, SIGALRM);
+		pthread_join(ag.thr_id, nullptr);
+		if (ag.sockd >= 0)
+			close(ag.sockd);
+	}
+	std::unique_lock sv_hold(g_server_lock);
+	for (auto &srv : g_server_list) {
+		srv.waitq.notify_all();
+		for (auto &conn : srv.conn_list) {
+			close(conn.sockd);
+			cl_drop_shm(conn);
+		}
+	}
+	sv_hold.unlock();
+	if (g_event_fd >= 0)
+		close(g_event_fd);
+	if (g_epoll_fd >= 0)
+		close(g_epoll_fd);
+	g_event_fd = g_epoll_fd = -1;
+}
+
+BOOL exmdb_client_check_local(const char *prefix, BOOL *pb_private)
+{
+	auto i = std::find_if(g_local_list.cbegin(), g_local_list.cend(),
+	         [&](const EXMDB_ITEM &s) { return strncmp(s.prefix.c_str(), prefix, s.prefix.size()) == 0; });
+	if (i == g_local_list.cend())
+		return false;
+	*pb_private = i->type == EXMDB_ITEM::EXMDB_PRIVATE ? TRUE : false;
+	return TRUE;
+}
+
+BOOL exmdb_client_do_rpc(const char *dir,
+	const EXMDB_REQUEST *prequest, EXMDB_RESPONSE *presponse)
+{
+	BINARY tmp_bin;
+	int status;
+
+	auto start = std::chrono::steady_clock::now();
+	auto pconn = exmdb_client_get_connection(dir);
+	if (pconn == nullptr)
+		return FALSE;
+	auto psvr = pconn->psvr;
+	if (pconn->shm != nullptr &&
+	    (status = exmdb_ext_push_request(prequest, &tmp_bin,
+	    pconn->shm, pconn->shm_size)) != EXT_ERR_BUFSIZE) {
+		if (status != EXT_ERR_SUCCESS) {
+			pconn.reset();
+			return FALSE;
+		}
+		uint32_t marker = EXMDB_SHM_FRAME;
+		if (write(pconn->sockd, &marker, sizeof(marker)) != sizeof(marker)) {
+			cl_account(psvr, false, start);
+			return FALSE;
+		}
+	} else if (EXT_ERR_SUCCESS != exmdb_ext_push_request(prequest, &tmp_bin)) {
+		pconn.reset();
+		return FALSE;
+	} else if (!cl_wr_sock(pconn->sockd, &tmp_bin)) {
+		free(tmp_bin.pb);
+		cl_account(psvr, false, start);
+		return FALSE;
+	} else {
+		free(tmp_bin.pb);
+	}
+	if (!cl_rd_conn(&*pconn, &tmp_bin)) {
+		cl_account(psvr, false, start);
+		return FALSE;
+	}
+	time(&pconn->last_time);
+	if (tmp_bin.cb < 5 || tmp_bin.pb[0] != exmdb_response::SUCCESS) {
+		pconn.reset();
+		cl_account(psvr, false, start);
+		return FALSE;
+	}
+	presponse->call_id = prequest->call_id;
+	tmp_bin.cb -= 5;
+	tmp_bin.pb += 5;
+	/* the body may live in the shared region; decode before handing back */
+	status = exmdb_ext_pull_response(&tmp_bin, presponse);
+	pconn.reset();
+	cl_account(psvr, true, start);
+	return status == EXT_ERR_SUCCESS ? TRUE : false;
+}
+
+void exmdb_client_register_proc(void *pproc)
+{
+	exmdb_client_event_proc = reinterpret_cast<decltype(exmdb_client_event_proc)>(pproc);
+}
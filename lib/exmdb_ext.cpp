@@ -8,6 +8,7 @@
 #include <gromox/defs.h>
 #include <gromox/exmdb_rpc.hpp>
 #include <gromox/ext_buffer.hpp>
+#include <gromox/paths.h>
 #include <gromox/scope.hpp>
 #include <gromox/rop_util.hpp>
 #include <gromox/idset.hpp>
@@ -2531,6 +2532,32 @@ static int exmdb_ext_push_get_public_folder_unread_count_request(
 	return pext->p_uint64(ppayload->get_public_folder_unread_count.folder_id);
 }
 
+static int exmdb_ext_pull_get_freebusy_events_request(
+	EXT_PULL *pext, REQUEST_PAYLOAD *ppayload)
+{
+	TRY(pext->g_uint64(&ppayload->get_freebusy_events.start_time));
+	return pext->g_uint64(&ppayload->get_freebusy_events.end_time);
+}
+
+static int exmdb_ext_push_get_freebusy_events_request(
+	EXT_PUSH *pext, const REQUEST_PAYLOAD *ppayload)
+{
+	TRY(pext->p_uint64(ppayload->get_freebusy_events.start_time));
+	return pext->p_uint64(ppayload->get_freebusy_events.end_time);
+}
+
+static int exmdb_ext_pull_allocate_cns_request(
+	EXT_PULL *pext, REQUEST_PAYLOAD *ppayload)
+{
+	return pext->g_uint32(&ppayload->allocate_cns.count);
+}
+
+static int exmdb_ext_push_allocate_cns_request(
+	EXT_PUSH *pext, const REQUEST_PAYLOAD *ppayload)
+{
+	return pext->p_uint32(ppayload->allocate_cns.count);
+}
+
 int exmdb_ext_pull_request(const BINARY *pbin_in,
 	EXMDB_REQUEST *prequest)
 {
@@ -2904,6 +2931,12 @@ int exmdb_ext_pull_request(const BINARY *pbin_in,
 	case exmdb_callid::GET_PUBLIC_FOLDER_UNREAD_COUNT:
 		return exmdb_ext_pull_get_public_folder_unread_count_request(
 										&ext_pull, &prequest->payload);
+	case exmdb_callid::GET_FREEBUSY_EVENTS:
+		return exmdb_ext_pull_get_freebusy_events_request(
+								&ext_pull, &prequest->payload);
+	case exmdb_callid::ALLOCATE_CNS:
+		return exmdb_ext_pull_allocate_cns_request(
+								&ext_pull, &prequest->payload);
 	case exmdb_callid::UNLOAD_STORE:
 		return EXT_ERR_SUCCESS;
 	default:
@@ -2912,12 +2945,12 @@ int exmdb_ext_pull_request(const BINARY *pbin_in,
 }
 
 int exmdb_ext_push_request(const EXMDB_REQUEST *prequest,
-	BINARY *pbin_out)
+	BINARY *pbin_out, void *buf, uint32_t bufsize)
 {
 	int status;
 	EXT_PUSH ext_push;
 	
-	if (!ext_push.init(nullptr, 0, EXT_FLAG_WCOUNT))
+	if (!ext_push.init(buf, bufsize, EXT_FLAG_WCOUNT))
 		return EXT_ERR_ALLOC;
 	status = ext_push.advance(sizeof(uint32_t));
 	if (EXT_ERR_SUCCESS != status) {
@@ -3417,6 +3450,14 @@ int exmdb_ext_push_request(const EXMDB_REQUEST *prequest,
 		status = exmdb_ext_push_get_public_folder_unread_count_request(
 										&ext_push, &prequest->payload);
 		break;
+	case exmdb_callid::GET_FREEBUSY_EVENTS:
+		status = exmdb_ext_push_get_freebusy_events_request(
+								&ext_push, &prequest->payload);
+		break;
+	case exmdb_callid::ALLOCATE_CNS:
+		status = exmdb_ext_push_allocate_cns_request(
+								&ext_push, &prequest->payload);
+		break;
 	case exmdb_callid::UNLOAD_STORE:
 		status = EXT_ERR_SUCCESS;
 		break;
@@ -4788,6 +4829,90 @@ static int exmdb_ext_push_get_public_folder_unread_count_response(
 	return pext->p_uint32(ppayload->get_public_folder_unread_count.count);
 }
 
+static int exmdb_ext_pull_get_freebusy_events_response(
+	EXT_PULL *pext, RESPONSE_PAYLOAD *ppayload)
+{
+	uint8_t tmp_byte;
+	auto r = &ppayload->get_freebusy_events.events;
+	
+	TRY(pext->g_uint32(&r->count));
+	if (r->count == 0) {
+		r->pevents = nullptr;
+		return EXT_ERR_SUCCESS;
+	}
+	r->pevents = pext->anew<FREEBUSY_EVENT>(r->count);
+	if (r->pevents == nullptr) {
+		r->count = 0;
+		return EXT_ERR_ALLOC;
+	}
+	for (size_t i = 0; i < r->count; ++i) {
+		auto ev = &r->pevents[i];
+		TRY(pext->g_uint64(&ev->start_time));
+		TRY(pext->g_uint64(&ev->end_time));
+		TRY(pext->g_uint32(&ev->busy_type));
+		TRY(pext->g_str(&ev->id));
+		TRY(pext->g_uint8(&tmp_byte));
+		ev->subject = nullptr;
+		if (tmp_byte != 0)
+			TRY(pext->g_str(&ev->subject));
+		TRY(pext->g_uint8(&tmp_byte));
+		ev->location = nullptr;
+		if (tmp_byte != 0)
+			TRY(pext->g_str(&ev->location));
+		TRY(pext->g_bool(&ev->b_meeting));
+		TRY(pext->g_bool(&ev->b_recurring));
+		TRY(pext->g_bool(&ev->b_exception));
+		TRY(pext->g_bool(&ev->b_reminder));
+		TRY(pext->g_bool(&ev->b_private));
+	}
+	return EXT_ERR_SUCCESS;
+}
+
+static int exmdb_ext_push_get_freebusy_events_response(
+	EXT_PUSH *pext, const RESPONSE_PAYLOAD *ppayload)
+{
+	auto r = &ppayload->get_freebusy_events.events;
+	
+	TRY(pext->p_uint32(r->count));
+	for (size_t i = 0; i < r->count; ++i) {
+		auto ev = &r->pevents[i];
+		TRY(pext->p_uint64(ev->start_time));
+		TRY(pext->p_uint64(ev->end_time));
+		TRY(pext->p_uint32(ev->busy_type));
+		TRY(pext->p_str(ev->id));
+		if (ev->subject == nullptr) {
+			TRY(pext->p_uint8(0));
+		} else {
+			TRY(pext->p_uint8(1));
+			TRY(pext->p_str(ev->subject));
+		}
+		if (ev->location == nullptr) {
+			TRY(pext->p_uint8(0));
+		} else {
+			TRY(pext->p_uint8(1));
+			TRY(pext->p_str(ev->location));
+		}
+		TRY(pext->p_bool(ev->b_meeting));
+		TRY(pext->p_bool(ev->b_recurring));
+		TRY(pext->p_bool(ev->b_exception));
+		TRY(pext->p_bool(ev->b_reminder));
+		TRY(pext->p_bool(ev->b_private));
+	}
+	return EXT_ERR_SUCCESS;
+}
+
+static int exmdb_ext_pull_allocate_cns_response(
+	EXT_PULL *pext, RESPONSE_PAYLOAD *ppayload)
+{
+	return pext->g_uint64(&ppayload->allocate_cns.begin_cn);
+}
+
+static int exmdb_ext_push_allocate_cns_response(
+	EXT_PUSH *pext, const RESPONSE_PAYLOAD *ppayload)
+{
+	return pext->p_uint64(ppayload->allocate_cns.begin_cn);
+}
+
 /* exmdb_callid::CONNECT, exmdb_callid::LISTEN_NOTIFICATION not included */
 int exmdb_ext_pull_response(const BINARY *pbin_in,
 	EXMDB_RESPONSE *presponse)
@@ -5133,6 +5258,12 @@ int exmdb_ext_pull_response(const BINARY *pbin_in,
 	case exmdb_callid::GET_PUBLIC_FOLDER_UNREAD_COUNT:
 		return exmdb_ext_pull_get_public_folder_unread_count_response(
 										&ext_pull, &presponse->payload);
+	case exmdb_callid::GET_FREEBUSY_EVENTS:
+		return exmdb_ext_pull_get_freebusy_events_response(
+								&ext_pull, &presponse->payload);
+	case exmdb_callid::ALLOCATE_CNS:
+		return exmdb_ext_pull_allocate_cns_response(
+								&ext_pull, &presponse->payload);
 	case exmdb_callid::UNLOAD_STORE:
 		return EXT_ERR_SUCCESS;
 	default:
@@ -5142,12 +5273,12 @@ int exmdb_ext_pull_response(const BINARY *pbin_in,
 
 /* exmdb_callid::CONNECT, exmdb_callid::LISTEN_NOTIFICATION not included */
 int exmdb_ext_push_response(const EXMDB_RESPONSE *presponse,
-	BINARY *pbin_out)
+	BINARY *pbin_out, void *buf, uint32_t bufsize)
 {
 	int status;
 	EXT_PUSH ext_push;
 	
-	if (!ext_push.init(nullptr, 0, EXT_FLAG_WCOUNT))
+	if (!ext_push.init(buf, bufsize, EXT_FLAG_WCOUNT))
 		return EXT_ERR_ALLOC;
 	status = ext_push.p_uint8(exmdb_response::SUCCESS);
 	if (EXT_ERR_SUCCESS != status) {
@@ -5616,6 +5747,14 @@ int exmdb_ext_push_response(const EXMDB_RESPONSE *presponse,
 		status = exmdb_ext_push_get_public_folder_unread_count_response(
 										&ext_push, &presponse->payload);
 		break;
+	case exmdb_callid::GET_FREEBUSY_EVENTS:
+		status = exmdb_ext_push_get_freebusy_events_response(
+								&ext_push, &presponse->payload);
+		break;
+	case exmdb_callid::ALLOCATE_CNS:
+		status = exmdb_ext_push_allocate_cns_response(
+								&ext_push, &presponse->payload);
+		break;
 	case exmdb_callid::UNLOAD_STORE:
 		status = EXT_ERR_SUCCESS;
 		break;
@@ -6105,3 +6244,8 @@ BOOL exmdb_client_write_socket(int fd, const BINARY *bin, long timeout_ms)
 			return TRUE;
 	}
 }
+
+void exmdb_local_socket_path(uint16_t port, char *buf, size_t bufsize)
+{
+	snprintf(buf, bufsize, PKGRUNDIR "/exmdb.%hu.sock", port);
+}
@@ -1,13 +1,199 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
 #include <pthread.h>
 #include <gromox/defs.h>
 #include <gromox/util.hpp>
 #include <gromox/lib_buffer.hpp>
 
+/* upper bound of items cached per thread and pool */
+#define LB_MAG_MAX			32
+/* stale per-thread entries are pruned once this many are present */
+#define LB_TLS_PRUNE		16
+
+namespace {
+
+struct lb_tls_ent {
+	LIB_BUFFER *buf;
+	uint64_t serial;
+	lib_buffer_mag *mag;
+};
+
+/* Magazines picked up by one thread; handed back when the thread ends */
+struct lb_tls {
+	~lb_tls();
+	std::vector<lb_tls_ent> ents;
+};
+
+}
+
+struct lib_buffer_mag {
+	std::mutex lock;
+	void *head = nullptr;
+	size_t count = 0, hits = 0, misses = 0;
+	bool in_use = false;
+};
+
 static constexpr auto wsize_al = roundup(WSIZE, sizeof(std::max_align_t));
+static std::atomic<uint64_t> g_lb_serial;
+static thread_local lb_tls g_lb_tls;
+
+/*
+ * Pools that are still alive, by serial. Lock order is registry, then
+ * LIB_BUFFER::m_mutex, then lib_buffer_mag::lock.
+ */
+static std::mutex &lb_reg_lock()
+{
+	static std::mutex m;
+	return m;
+}
+
+static std::unordered_map<uint64_t, LIB_BUFFER *> &lb_registry()
+{
+	static std::unordered_map<uint64_t, LIB_BUFFER *> r;
+	return r;
+}
+
+static inline size_t lb_item_size_al(const LIB_BUFFER *m_buf)
+{
+	return roundup(m_buf->item_size, sizeof(std::max_align_t));
+}
+
+static inline void *lb_next(const LIB_BUFFER *m_buf, void *item)
+{
+	void *next;
+	memcpy(&next, static_cast<char *>(item) + lb_item_size_al(m_buf), sizeof(void *));
+	return next;
+}
+
+static inline void lb_set_next(const LIB_BUFFER *m_buf, void *item, void *next)
+{
+	memcpy(static_cast<char *>(item) + lb_item_size_al(m_buf), &next, sizeof(void *));
+}
+
+static void lb_lock(LIB_BUFFER *m_buf)
+{
+	if (pthread_mutex_trylock(&m_buf->m_mutex) == 0)
+		return;
+	pthread_mutex_lock(&m_buf->m_mutex);
+	++m_buf->contended;
+}
+
+/* take one item off the shared free list or the heap; m_mutex held */
+static void *lb_take(LIB_BUFFER *m_buf)
+{
+	if (m_buf->free_list_size > 0) {
+		auto ret_buf = m_buf->free_list_head;
+		m_buf->free_list_head = lb_next(m_buf, ret_buf);
+#ifdef _DEBUG_UMTA
+		/* check memory */
+		lb_set_next(m_buf, ret_buf, nullptr);
+#endif
+		m_buf->free_list_size -= 1;
+		m_buf->allocated_num  += 1;
+		return ret_buf;
+	}
+	if (m_buf->allocated_num >= m_buf->item_num)
+		return nullptr;
+	auto phead = static_cast<char *>(m_buf->cur_heap_head);
+	lb_set_next(m_buf, phead, nullptr);
+	m_buf->cur_heap_head = phead + lb_item_size_al(m_buf) + wsize_al;
+	m_buf->allocated_num += 1;
+	return phead;
+}
+
+/* return one item to the shared free list; m_mutex held */
+static void lb_give(LIB_BUFFER *m_buf, void *item)
+{
+	lb_set_next(m_buf, item, m_buf->free_list_head);
+	m_buf->free_list_head = item;
+	m_buf->free_list_size += 1;
+	m_buf->allocated_num  -= 1;
+}
+
+/* move all of @mag back to the shared free list; both locks held */
+static void lb_mag_flush(LIB_BUFFER *m_buf, lib_buffer_mag *mag)
+{
+	while (mag->count > 0) {
+		auto item = mag->head;
+		mag->head = lb_next(m_buf, item);
+		--mag->count;
+		lb_give(m_buf, item);
+	}
+}
+
+lb_tls::~lb_tls()
+{
+	std::lock_guard rhold(lb_reg_lock());
+	auto &reg = lb_registry();
+	for (const auto &e : ents) {
+		auto it = reg.find(e.serial);
+		if (it == reg.end() || it->second != e.buf)
+			continue;
+		pthread_mutex_lock(&e.buf->m_mutex);
+		{
+			std::lock_guard mhold(e.mag->lock);
+			lb_mag_flush(e.buf, e.mag);
+			e.mag->in_use = false;
+		}
+		pthread_mutex_unlock(&e.buf->m_mutex);
+	}
+}
+
+/* Find or set up the calling thread's magazine for @m_buf. */
+static lib_buffer_mag *lb_mag_get(LIB_BUFFER *m_buf) try
+{
+	auto &ents = g_lb_tls.ents;
+	for (const auto &e : ents)
+		if (e.buf == m_buf && e.serial == m_buf->serial)
+			return e.mag;
+	/* an address may be reused by a later pool */
+	ents.erase(std::remove_if(ents.begin(), ents.end(),
+		[&](const lb_tls_ent &e) { return e.buf == m_buf; }), ents.end());
+	if (ents.size() >= LB_TLS_PRUNE) {
+		std::lock_guard rhold(lb_reg_lock());
+		auto &reg = lb_registry();
+		ents.erase(std::remove_if(ents.begin(), ents.end(),
+			[&](const lb_tls_ent &e) { return reg.find(e.serial) == reg.end(); }),
+			ents.end());
+	}
+	ents.reserve(ents.size() + 1);
+	lib_buffer_mag *mag = nullptr;
+	lb_lock(m_buf);
+	for (auto m : m_buf->mags) {
+		if (!m->in_use) {
+			mag = m;
+			break;
+		}
+	}
+	if (mag == nullptr) {
+		mag = new(std::nothrow) lib_buffer_mag;
+		if (mag != nullptr) {
+			try {
+				m_buf->mags.push_back(mag);
+			} catch (const std::bad_alloc &) {
+				delete mag;
+				mag = nullptr;
+			}
+		}
+	}
+	if (mag != nullptr)
+		mag->in_use = true;
+	pthread_mutex_unlock(&m_buf->m_mutex);
+	if (mag != nullptr)
+		ents.push_back({m_buf, m_buf->serial, mag});
+	return mag;
+} catch (const std::bad_alloc &) {
+	return nullptr;
+}
 
 /*
  *	init a buffer pool with specified item size and number
@@ -28,7 +214,7 @@ LIB_BUFFER* lib_buffer_init(size_t item_size, size_t item_num, BOOL is_thread_sa
 		debug_info("[lib_buffer]: lib_buffer_init, invalid parameter");
 		return NULL;
 	}
-	auto lib_buffer = static_cast<LIB_BUFFER *>(malloc(sizeof(LIB_BUFFER)));
+	auto lib_buffer = new(std::nothrow) LIB_BUFFER{};
 	if (lib_buffer == nullptr) {
 		debug_info("[lib_buffer]: lib_buffer_init, malloc lib_buffer fail");
 		return NULL;
@@ -38,7 +224,7 @@ LIB_BUFFER* lib_buffer_init(size_t item_size, size_t item_num, BOOL is_thread_sa
 	head_listp = malloc((item_size_al + wsize_al) * item_num);
 	if (head_listp == nullptr) {
 		debug_info("[lib_buffer]: lib_buffer_init, malloc head_listp fail");
-		free(lib_buffer);
+		delete lib_buffer;
 		return NULL;
 	}
 
@@ -53,6 +239,21 @@ LIB_BUFFER* lib_buffer_init(size_t item_size, size_t item_num, BOOL is_thread_sa
 	lib_buffer->item_size		= item_size;
 	lib_buffer->item_num		= item_num;
 	lib_buffer->is_thread_safe	= is_thread_safe;
+	lib_buffer->serial			= ++g_lb_serial;
+	/*
+	 * Small pools gain nothing from magazines; keep the cached share
+	 * low so that items parked in idle threads remain the exception.
+	 */
+	lib_buffer->mag_size		= 0;
+	if (is_thread_safe) {
+		auto mag_size = std::min(static_cast<size_t>(LB_MAG_MAX), item_num / 16);
+		if (mag_size >= 2) try {
+			std::lock_guard rhold(lb_reg_lock());
+			lb_registry().emplace(lib_buffer->serial, lib_buffer);
+			lib_buffer->mag_size = mag_size;
+		} catch (const std::bad_alloc &) {
+		}
+	}
 	return lib_buffer;
 }
 
@@ -71,9 +272,56 @@ void lib_buffer_free(LIB_BUFFER* m_buf)
 		return;
 	}
 #endif
+	if (m_buf->mag_size > 0) {
+		/* threads ending from now on will leave the magazines alone */
+		std::lock_guard rhold(lb_reg_lock());
+		lb_registry().erase(m_buf->serial);
+	}
+	for (auto mag : m_buf->mags)
+		delete mag;
 	pthread_mutex_destroy(&m_buf->m_mutex);
 	free(m_buf->heap_list_head);
-	free(m_buf);
+	delete m_buf;
+}
+
+/*
+ * Magazine empty: take half a magazine's worth from the shared list. If
+ * the pool is exhausted, take an item parked in another thread's magazine
+ * before giving up, so that the pool capacity stays what the caller asked
+ * for.
+ */
+static void *lb_refill(LIB_BUFFER *m_buf, lib_buffer_mag *mag)
+{
+	lb_lock(m_buf);
+	auto ret_buf = lb_take(m_buf);
+	if (ret_buf != nullptr) {
+		std::lock_guard mhold(mag->lock);
+		for (size_t i = 1; i < m_buf->mag_size / 2; ++i) {
+			auto item = lb_take(m_buf);
+			if (item == nullptr)
+				break;
+			lb_set_next(m_buf, item, mag->head);
+			mag->head = item;
+			++mag->count;
+		}
+		pthread_mutex_unlock(&m_buf->m_mutex);
+		return ret_buf;
+	}
+	for (auto other : m_buf->mags) {
+		std::lock_guard mhold(other->lock);
+		if (other->count == 0)
+			continue;
+		ret_buf = other->head;
+		other->head = lb_next(m_buf, ret_buf);
+		--other->count;
+		lb_set_next(m_buf, ret_buf, nullptr);
+		break;
+	}
+	pthread_mutex_unlock(&m_buf->m_mutex);
+	if (ret_buf == nullptr)
+		debug_info("[lib_buffer]: the total allocated buffer num"
+			" is larger than the initializing");
+	return ret_buf;
 }
 
 /*
@@ -89,59 +337,39 @@ void lib_buffer_free(LIB_BUFFER* m_buf)
  */
 void* lib_buffer_get(LIB_BUFFER* m_buf)
 {
-	void	*ret_buf	= NULL;
-	char	*phead		= NULL;
-
 #ifdef _DEBUG_UMTA
 	if (NULL == m_buf) {
 		debug_info("[lib_buffer]: lib_buffer_get, param NULL");
 		return NULL;
 	}
 #endif
-	if (TRUE == m_buf->is_thread_safe) {
-		pthread_mutex_lock(&m_buf->m_mutex);
-	}
-
-	auto item_size_al = roundup(m_buf->item_size, sizeof(std::max_align_t));
-	if (m_buf->free_list_size > 0) {
-		phead	= (char *)m_buf->free_list_head;
-		ret_buf = m_buf->free_list_head;
-		memcpy(&phead, phead + item_size_al, sizeof(void *));
-#ifdef _DEBUG_UMTA
-		/* check memory */
-		memset(ret_buf + item_size_al, 0, sizeof(void *));
-#endif
-
-		m_buf->free_list_head  = (void*)phead;
-		m_buf->free_list_size -= 1;
-		m_buf->allocated_num  += 1;
-		if (TRUE == m_buf->is_thread_safe) {
-			pthread_mutex_unlock(&m_buf->m_mutex);
-		}
-		return ret_buf;
-		
-	} 
-
-	
-	if (m_buf->allocated_num >= m_buf->item_num) {
-		debug_info("[lib_buffer]: the total allocated buffer num"
-			" is larger than the initializing");
-		if (TRUE == m_buf->is_thread_safe) {
-			pthread_mutex_unlock(&m_buf->m_mutex);
+	auto mag = m_buf->mag_size > 0 ? lb_mag_get(m_buf) : nullptr;
+	if (mag != nullptr) {
+		std::unique_lock mhold(mag->lock);
+		if (mag->count > 0) {
+			auto ret_buf = mag->head;
+			mag->head = lb_next(m_buf, ret_buf);
+			--mag->count;
+			++mag->hits;
+			mhold.unlock();
+			lb_set_next(m_buf, ret_buf, nullptr);
+			return ret_buf;
 		}
-		return NULL;
+		++mag->misses;
+		mhold.unlock();
+		return lb_refill(m_buf, mag);
 	}
 
-	phead	= (char*)m_buf->cur_heap_head;
-	ret_buf = m_buf->cur_heap_head;
-	memset(phead + item_size_al, 0, sizeof(void *));
-	phead  += item_size_al + wsize_al;
-	m_buf->cur_heap_head	= (void*)phead;
-	m_buf->allocated_num	+= 1;
-
+	if (TRUE == m_buf->is_thread_safe) {
+		lb_lock(m_buf);
+	}
+	auto ret_buf = lb_take(m_buf);
 	if (TRUE == m_buf->is_thread_safe) {
 		pthread_mutex_unlock(&m_buf->m_mutex);
 	}
+	if (ret_buf == nullptr)
+		debug_info("[lib_buffer]: the total allocated buffer num"
+			" is larger than the initializing");
 	return ret_buf;
 }
 /*
@@ -164,7 +392,7 @@ void lib_buffer_put(LIB_BUFFER* m_buf, void *item)
 		return;
 	}
 	pcur_item	= (char *)item;
-	auto item_size_al = roundup(m_buf->item_size, sizeof(std::max_align_t));
+	auto item_size_al = lb_item_size_al(m_buf);
 	memset(pcur_item, 0, item_size_al);
 #ifdef _DEBUG_UMTA
 	/* memory check */
@@ -174,13 +402,42 @@ void lib_buffer_put(LIB_BUFFER* m_buf, void *item)
 	}
 #endif
 
+	auto mag = m_buf->mag_size > 0 ? lb_mag_get(m_buf) : nullptr;
+	if (mag != nullptr) {
+		std::unique_lock mhold(mag->lock);
+		if (mag->count < m_buf->mag_size) {
+			lb_set_next(m_buf, item, mag->head);
+			mag->head = item;
+			++mag->count;
+			++mag->hits;
+			return;
+		}
+		++mag->misses;
+		/* full: hand half of it back along with @item */
+		void *chain = nullptr;
+		for (size_t i = 0; i < m_buf->mag_size / 2; ++i) {
+			auto next = mag->head;
+			mag->head = lb_next(m_buf, next);
+			--mag->count;
+			lb_set_next(m_buf, next, chain);
+			chain = next;
+		}
+		mhold.unlock();
+		lb_lock(m_buf);
+		while (chain != nullptr) {
+			auto next = lb_next(m_buf, chain);
+			lb_give(m_buf, chain);
+			chain = next;
+		}
+		lb_give(m_buf, item);
+		pthread_mutex_unlock(&m_buf->m_mutex);
+		return;
+	}
+
 	if (TRUE == m_buf->is_thread_safe) {
-		pthread_mutex_lock(&m_buf->m_mutex);
+		lb_lock(m_buf);
 	}
-	memcpy(pcur_item + item_size_al, &m_buf->free_list_head, sizeof(void *));
-	m_buf->free_list_head = item;
-	m_buf->free_list_size += 1;
-	m_buf->allocated_num  -= 1;
+	lb_give(m_buf, item);
 	if (TRUE == m_buf->is_thread_safe) {
 		pthread_mutex_unlock(&m_buf->m_mutex);
 	}
@@ -200,13 +457,21 @@ size_t lib_buffer_get_param(LIB_BUFFER* m_buf, PARAM_TYPE type) {
 		pthread_mutex_lock(&m_buf->m_mutex);
 	}
 
+	/* items parked in magazines are free, as far as callers are concerned */
+	size_t parked = 0, hits = 0, misses = 0;
+	for (auto mag : m_buf->mags) {
+		std::lock_guard mhold(mag->lock);
+		parked += mag->count;
+		hits += mag->hits;
+		misses += mag->misses;
+	}
 	switch (type) {
 
 	case FREE_LIST_SIZE:
-		ret_val = m_buf->free_list_size;
+		ret_val = m_buf->free_list_size + parked;
 		break;
 	case ALLOCATED_NUM:
-		ret_val = m_buf->allocated_num;
+		ret_val = m_buf->allocated_num - parked;
 		break;
 	case MEM_ITEM_SIZE:
 		ret_val = m_buf->item_size;
@@ -214,6 +479,15 @@ size_t lib_buffer_get_param(LIB_BUFFER* m_buf, PARAM_TYPE type) {
 	case MEM_ITEM_NUM:
 		ret_val = m_buf->item_num;
 		break;
+	case MAG_HITS:
+		ret_val = hits;
+		break;
+	case MAG_MISSES:
+		ret_val = misses;
+		break;
+	case POOL_CONTENDED:
+		ret_val = m_buf->contended;
+		break;
 	default:
 		debug_info("[lib_buffer]: unknown type %d", type);
 	}
@@ -1,4 +1,5 @@
 // SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+#include <algorithm>
 #include <climits>
 #include <cstdint>
 #include <memory>
@@ -14,6 +15,64 @@
 
 using namespace gromox;
 
+template<typename T> static inline T ext_le_swap(T v)
+{
+	if (sizeof(T) == 2)
+		return le16_to_cpu(v);
+	else if (sizeof(T) == 4)
+		return le32_to_cpu(v);
+	return le64_to_cpu(v);
+}
+
+template<typename T> static bool ext_pull_fits(const EXT_PULL &e, uint32_t count)
+{
+	return e.m_offset <= e.m_data_size &&
+	       static_cast<uint64_t>(count) * sizeof(T) <= e.m_data_size - e.m_offset;
+}
+
+/*
+ * Arrays of fixed-size integers are moved with one bounds check and one
+ * memcpy instead of a checked call per element. The element count is
+ * validated against the remaining input before the caller allocates.
+ */
+template<typename T> static int ext_pull_fixed_array(EXT_PULL &e, T *dst,
+    uint32_t count)
+{
+	if (!ext_pull_fits<T>(e, count))
+		return EXT_ERR_BUFSIZE;
+	/* empty arrays are nullptr, and memcpy must not see those */
+	if (count == 0)
+		return EXT_ERR_SUCCESS;
+	size_t bytes = sizeof(T) * count;
+	memcpy(dst, &e.m_udata[e.m_offset], bytes);
+	if (ext_le_swap<T>(1) != 1)
+		for (size_t i = 0; i < count; ++i)
+			dst[i] = ext_le_swap(dst[i]);
+	e.m_offset += bytes;
+	return EXT_ERR_SUCCESS;
+}
+
+template<typename T> static int ext_push_fixed_array(EXT_PUSH &e,
+    const T *src, uint32_t count)
+{
+	uint64_t bytes = static_cast<uint64_t>(count) * sizeof(T);
+	if (bytes > UINT32_MAX - e.m_offset || !e.check_ovf(static_cast<uint32_t>(bytes)))
+		return EXT_ERR_BUFSIZE;
+	if (count == 0)
+		return EXT_ERR_SUCCESS;
+	auto dst = &e.m_udata[e.m_offset];
+	if (ext_le_swap<T>(1) == 1) {
+		memcpy(dst, src, bytes);
+	} else {
+		for (size_t i = 0; i < count; ++i) {
+			auto v = ext_le_swap(src[i]);
+			memcpy(&dst[sizeof(T) * i], &v, sizeof(v));
+		}
+	}
+	e.m_offset += bytes;
+	return EXT_ERR_SUCCESS;
+}
+
 void EXT_PULL::init(const void *pdata, uint32_t data_size,
     EXT_BUFFER_ALLOC alloc, uint32_t flags)
 {
@@ -262,14 +321,14 @@ int EXT_PULL::g_uint16_a(SHORT_ARRAY *r)
 		r->ps = NULL;
 		return EXT_ERR_SUCCESS;
 	}
+	if (!ext_pull_fits<uint16_t>(*this, r->count))
+		return EXT_ERR_BUFSIZE;
 	r->ps = pext->anew<uint16_t>(r->count);
 	if (NULL == r->ps) {
 		r->count = 0;
 		return EXT_ERR_ALLOC;
 	}
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->g_uint16(&r->ps[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_pull_fixed_array(*this, r->ps, r->count);
 }
 
 int EXT_PULL::g_uint32_a(LONG_ARRAY *r)
@@ -280,14 +339,14 @@ int EXT_PULL::g_uint32_a(LONG_ARRAY *r)
 		r->pl = NULL;
 		return EXT_ERR_SUCCESS;
 	}
+	if (!ext_pull_fits<uint32_t>(*this, r->count))
+		return EXT_ERR_BUFSIZE;
 	r->pl = pext->anew<uint32_t>(r->count);
 	if (NULL == r->pl) {
 		r->count = 0;
 		return EXT_ERR_ALLOC;
 	}
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->g_uint32(&r->pl[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_pull_fixed_array(*this, r->pl, r->count);
 }
 
 int EXT_PULL::g_uint64_a(LONGLONG_ARRAY *r)
@@ -298,14 +357,14 @@ int EXT_PULL::g_uint64_a(LONGLONG_ARRAY *r)
 		r->pll = NULL;
 		return EXT_ERR_SUCCESS;
 	}
+	if (!ext_pull_fits<uint64_t>(*this, r->count))
+		return EXT_ERR_BUFSIZE;
 	r->pll = pext->anew<uint64_t>(r->count);
 	if (NULL == r->pll) {
 		r->count = 0;
 		return EXT_ERR_ALLOC;
 	}
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->g_uint64(&r->pll[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_pull_fixed_array(*this, r->pll, r->count);
 }
 
 int EXT_PULL::g_uint64_sa(LONGLONG_ARRAY *r)
@@ -319,14 +378,14 @@ int EXT_PULL::g_uint64_sa(LONGLONG_ARRAY *r)
 		r->pll = NULL;
 		return EXT_ERR_SUCCESS;
 	}
+	if (!ext_pull_fits<uint64_t>(*this, r->count))
+		return EXT_ERR_BUFSIZE;
 	r->pll = pext->anew<uint64_t>(r->count);
 	if (NULL == r->pll) {
 		r->count = 0;
 		return EXT_ERR_ALLOC;
 	}
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->g_uint64(&r->pll[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_pull_fixed_array(*this, r->pll, r->count);
 }
 
 int EXT_PULL::g_bin_a(BINARY_ARRAY *r)
@@ -979,14 +1038,14 @@ int EXT_PULL::g_proptag_a(PROPTAG_ARRAY *r)
 		r->pproptag = NULL;
 		return EXT_ERR_SUCCESS;
 	}
+	if (!ext_pull_fits<uint32_t>(*this, r->count))
+		return EXT_ERR_BUFSIZE;
 	r->pproptag = pext->anew<uint32_t>(strange_roundup(r->count, SR_GROW_PROPTAG_ARRAY));
 	if (NULL == r->pproptag) {
 		r->count = 0;
 		return EXT_ERR_ALLOC;
 	}
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->g_uint32(&r->pproptag[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_pull_fixed_array(*this, r->pproptag, r->count);
 }
 
 int EXT_PULL::g_proptag_a(LPROPTAG_ARRAY *r)
@@ -996,14 +1055,14 @@ int EXT_PULL::g_proptag_a(LPROPTAG_ARRAY *r)
 		r->pproptag = nullptr;
 		return EXT_ERR_SUCCESS;
 	}
+	if (!ext_pull_fits<uint32_t>(*this, r->cvalues))
+		return EXT_ERR_BUFSIZE;
 	r->pproptag = anew<uint32_t>(strange_roundup(r->cvalues, SR_GROW_PROPTAG_ARRAY));
 	if (r->pproptag == nullptr) {
 		r->cvalues = 0;
 		return EXT_ERR_ALLOC;
 	}
-	for (size_t i = 0; i < r->cvalues; ++i)
-		TRY(g_uint32(&r->pproptag[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_pull_fixed_array(*this, r->pproptag, r->cvalues);
 }
 
 int EXT_PULL::g_propname(PROPERTY_NAME *r)
@@ -2307,27 +2366,21 @@ int EXT_PUSH::p_uint16_a(const SHORT_ARRAY *r)
 {
 	auto pext = this;
 	TRY(pext->p_uint32(r->count));
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->p_uint16(r->ps[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_push_fixed_array(*this, r->ps, r->count);
 }
 
 int EXT_PUSH::p_uint32_a(const LONG_ARRAY *r)
 {
 	auto pext = this;
 	TRY(pext->p_uint32(r->count));
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->p_uint32(r->pl[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_push_fixed_array(*this, r->pl, r->count);
 }
 
 int EXT_PUSH::p_uint64_a(const LONGLONG_ARRAY *r)
 {
 	auto pext = this;
 	TRY(pext->p_uint32(r->count));
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->p_uint64(r->pll[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_push_fixed_array(*this, r->pll, r->count);
 }
 
 int EXT_PUSH::p_uint64_sa(const LONGLONG_ARRAY *r)
@@ -2336,9 +2389,7 @@ int EXT_PUSH::p_uint64_sa(const LONGLONG_ARRAY *r)
 	if (r->count > 0xFFFF)
 		return EXT_ERR_FORMAT;
 	TRY(pext->p_uint16(r->count));
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->p_uint64(r->pll[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_push_fixed_array(*this, r->pll, r->count);
 }
 
 int EXT_PUSH::p_bin_a(const BINARY_ARRAY *r)
@@ -2779,17 +2830,13 @@ int EXT_PUSH::p_proptag_a(const PROPTAG_ARRAY *r)
 	auto pext = this;
 	
 	TRY(pext->p_uint16(r->count));
-	for (size_t i = 0; i < r->count; ++i)
-		TRY(pext->p_uint32(r->pproptag[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_push_fixed_array(*this, r->pproptag, r->count);
 }
 
 int EXT_PUSH::p_proptag_a(const LPROPTAG_ARRAY *r)
 {
 	TRY(p_uint32(r->cvalues));
-	for (size_t i = 0; i < r->cvalues; ++i)
-		TRY(p_uint32(r->pproptag[i]));
-	return EXT_ERR_SUCCESS;
+	return ext_push_fixed_array(*this, r->pproptag, r->cvalues);
 }
 
 int EXT_PUSH::p_propname(const PROPERTY_NAME *r)
@@ -0,0 +1,1223 @@
+// SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+/*
+ * Free/busy helpers: expansion of appointment rows (including recurring
+ * series and their exceptions) into busy intervals.
+ *
+ * Converted timezone definitions and expanded instance lists are kept in
+ * two small process-wide LRU caches, since the same series tend to be
+ * expanded over the same windows again and again by polling clients.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <libHX/string.h>
+#include <gromox/defs.h>
+#include <gromox/ext_buffer.hpp>
+#include <gromox/freebusy.hpp>
+#include <gromox/guid.hpp>
+#include <gromox/ical.hpp>
+#include <gromox/mapidefs.h>
+#include <gromox/proptags.hpp>
+#include <gromox/rop_util.hpp>
+#include <gromox/tpropval_array.hpp>
+#include <gromox/util.hpp>
+
+using namespace gromox;
+
+namespace {
+
+struct fb_occurrence {
+	time_t start_time, end_time;
+	int exc_index; /* into the exception arrays, -1 for a regular one */
+};
+
+/* Occurrences of one series, for starts within [win_start, win_end]. */
+struct fb_expansion {
+	time_t win_start = 0, win_end = -1;
+	std::vector<fb_occurrence> list;
+};
+
+/*
+ * Keys are the raw blobs, so that lookups are exact. Each entry is charged
+ * with an approximate cost against a byte budget.
+ */
+template<typename V> class fb_lru {
+	public:
+	explicit fb_lru(size_t max_bytes) : m_max(max_bytes) {}
+
+	bool get(const std::string &key, V &out)
+	{
+		std::lock_guard hold(m_lock);
+		auto it = m_map.find(key);
+		if (it == m_map.end())
+			return false;
+		m_list.splice(m_list.begin(), m_list, it->second);
+		out = it->second->value;
+		return true;
+	}
+
+	void put(std::string &&key, const V &value, size_t cost) try
+	{
+		cost += key.size() + 64;
+		if (cost > m_max)
+			return;
+		std::lock_guard hold(m_lock);
+		auto it = m_map.find(key);
+		if (it != m_map.end()) {
+			auto node = it->second;
+			m_used -= node->cost;
+			m_map.erase(it);
+			m_list.erase(node);
+		}
+		m_list.push_front({std::move(key), value, cost});
+		try {
+			m_map.emplace(m_list.front().key, m_list.begin());
+		} catch (const std::bad_alloc &) {
+			m_list.pop_front();
+			return;
+		}
+		m_used += cost;
+		while (m_used > m_max) {
+			auto &e = m_list.back();
+			m_used -= e.cost;
+			m_map.erase(e.key);
+			m_list.pop_back();
+		}
+	} catch (const std::bad_alloc &) {
+	}
+
+	private:
+	struct entry {
+		std::string key;
+		V value;
+		size_t cost;
+	};
+	std::mutex m_lock;
+	std::list<entry> m_list;
+	std::unordered_map<std::string_view, typename std::list<entry>::iterator> m_map;
+	size_t m_used = 0, m_max;
+};
+
+}
+
+/* VTIMEZONE components are only ever read once built, so they can be shared */
+static fb_lru<std::shared_ptr<ICAL_COMPONENT>> g_fb_tz_cache(256 * 1024);
+static fb_lru<std::shared_ptr<const fb_expansion>> g_fb_expand_cache(8 * 1024 * 1024);
+/*
+ * Series are expanded over windows aligned to this many seconds (about 97
+ * days), so that queries for neighbouring ranges share one expansion. A
+ * cached window is grown up to FB_EXPAND_MAXSPANS granules.
+ */
+static constexpr time_t FB_EXPAND_GRANULE = 1 << 23;
+static constexpr time_t FB_EXPAND_MAXSPANS = 8;
+
+std::shared_ptr<ICAL_COMPONENT> tzstruct_to_vtimezone(int year,
+	const char *tzid, TIMEZONESTRUCT *ptzstruct)
+{
+	int day;
+	int order;
+	std::shared_ptr<ICAL_VALUE> pivalue;
+	char tmp_buff[1024];
+	
+	auto pcomponent = ical_new_component("VTIMEZONE");
+	if (NULL == pcomponent) {
+		return NULL;
+	}
+	auto piline = ical_new_simple_line("TZID", tzid);
+	if (NULL == piline) {
+		return NULL;
+	}
+	if (pcomponent->append_line(piline) < 0)
+		return nullptr;
+	/* STANDARD component */
+	auto pcomponent1 = ical_new_component("STANDARD");
+	if (NULL == pcomponent1) {
+		return NULL;
+	}
+	if (pcomponent->append_comp(pcomponent1) < 0)
+		return nullptr;
+	if (0 == ptzstruct->daylightdate.month) {
+		strcpy(tmp_buff, "16010101T000000");
+	} else {
+		if (0 == ptzstruct->standarddate.year) {
+			day = ical_get_dayofmonth(year,
+				ptzstruct->standarddate.month,
+				ptzstruct->standarddate.day,
+				ptzstruct->standarddate.dayofweek);
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
+				year, (int)ptzstruct->standarddate.month,
+				day, (int)ptzstruct->standarddate.hour,
+				(int)ptzstruct->standarddate.minute,
+				(int)ptzstruct->standarddate.second);
+		} else if (1 == ptzstruct->standarddate.year) {
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
+				year, (int)ptzstruct->standarddate.month,
+				(int)ptzstruct->standarddate.day,
+				(int)ptzstruct->standarddate.hour,
+				(int)ptzstruct->standarddate.minute,
+				(int)ptzstruct->standarddate.second);
+		} else {
+			return NULL;
+		}
+	}
+	piline = ical_new_simple_line("DTSTART", tmp_buff);
+	if (NULL == piline) {
+		return NULL;
+	}
+	if (pcomponent1->append_line(piline) < 0)
+		return nullptr;
+	if (0 != ptzstruct->daylightdate.month) {
+		if (0 == ptzstruct->standarddate.year) {
+			piline = ical_new_line("RRULE");
+			if (NULL == piline) {
+				return NULL;
+			}
+			if (pcomponent1->append_line(piline) < 0)
+				return nullptr;
+			pivalue = ical_new_value("FREQ");
+			if (NULL == pivalue) {
+				return NULL;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return nullptr;
+			if (!pivalue->append_subval("YEARLY"))
+				return NULL;
+			pivalue = ical_new_value("BYDAY");
+			if (NULL == pivalue) {
+				return NULL;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return nullptr;
+			order = ptzstruct->standarddate.day;
+			if (5 == order) {
+				order = -1;
+			}
+			switch (ptzstruct->standarddate.dayofweek) {
+			case 0:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dSU", order);
+				break;
+			case 1:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dMO", order);
+				break;
+			case 2:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dTU", order);
+				break;
+			case 3:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dWE", order);
+				break;
+			case 4:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dTH", order);
+				break;
+			case 5:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dFR", order);
+				break;
+			case 6:
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%dSA", order);
+				break;
+			default:
+				return NULL;
+			}
+			if (!pivalue->append_subval(tmp_buff))
+				return NULL;
+			pivalue = ical_new_value("BYMONTH");
+			if (NULL == pivalue) {
+				return NULL;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return nullptr;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->standarddate.month);
+			if (!pivalue->append_subval(tmp_buff))
+				return NULL;
+		} else if (1 == ptzstruct->standarddate.year) {
+			piline = ical_new_line("RRULE");
+			if (NULL == piline) {
+				return NULL;
+			}
+			if (pcomponent1->append_line(piline) < 0)
+				return nullptr;
+			pivalue = ical_new_value("FREQ");
+			if (NULL == pivalue) {
+				return NULL;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return nullptr;
+			if (!pivalue->append_subval("YEARLY"))
+				return NULL;
+			pivalue = ical_new_value("BYMONTHDAY");
+			if (NULL == pivalue) {
+				return NULL;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return nullptr;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->standarddate.day);
+			pivalue = ical_new_value("BYMONTH");
+			if (NULL == pivalue) {
+				return NULL;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return nullptr;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->standarddate.month);
+			if (!pivalue->append_subval(tmp_buff))
+				return NULL;
+		}
+	}
+	int utc_offset = -(ptzstruct->bias + ptzstruct->daylightbias);
+	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
+	utc_offset = abs(utc_offset);
+	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
+	piline = ical_new_simple_line("TZOFFSETFROM", tmp_buff);
+	if (piline == nullptr)
+		return nullptr;
+	if (pcomponent1->append_line(piline) < 0)
+		return nullptr;
+	utc_offset = -(ptzstruct->bias + ptzstruct->standardbias);
+	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
+	utc_offset = abs(utc_offset);
+	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
+	piline = ical_new_simple_line("TZOFFSETTO", tmp_buff);
+	if (piline == nullptr)
+		return nullptr;
+	if (pcomponent1->append_line(piline) < 0)
+		return nullptr;
+	if (0 == ptzstruct->daylightdate.month) {
+		return pcomponent;
+	}
+	/* DAYLIGHT component */
+	pcomponent1 = ical_new_component("DAYLIGHT");
+	if (NULL == pcomponent1) {
+		return NULL;
+	}
+	if (pcomponent->append_comp(pcomponent1) < 0)
+		return nullptr;
+	if (0 == ptzstruct->daylightdate.year) {
+		day = ical_get_dayofmonth(year,
+			ptzstruct->daylightdate.month,
+			ptzstruct->daylightdate.day,
+			ptzstruct->daylightdate.dayofweek);
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
+			year, (int)ptzstruct->daylightdate.month,
+			day, (int)ptzstruct->daylightdate.hour,
+			(int)ptzstruct->daylightdate.minute,
+			(int)ptzstruct->daylightdate.second);
+	} else if (1 == ptzstruct->daylightdate.year) {
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
+			year, (int)ptzstruct->daylightdate.month,
+			(int)ptzstruct->daylightdate.day,
+			(int)ptzstruct->daylightdate.hour,
+			(int)ptzstruct->daylightdate.minute,
+			(int)ptzstruct->daylightdate.second);
+	} else {
+		return NULL;
+	}
+	piline = ical_new_simple_line("DTSTART", tmp_buff);
+	if (NULL == piline) {
+		return NULL;
+	}
+	if (pcomponent1->append_line(piline) < 0)
+		return nullptr;
+	if (0 == ptzstruct->daylightdate.year) {
+		piline = ical_new_line("RRULE");
+		if (NULL == piline) {
+			return NULL;
+		}
+		if (pcomponent1->append_line(piline) < 0)
+			return nullptr;
+		pivalue = ical_new_value("FREQ");
+		if (NULL == pivalue) {
+			return NULL;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return nullptr;
+		if (!pivalue->append_subval("YEARLY"))
+			return NULL;
+		pivalue = ical_new_value("BYDAY");
+		if (NULL == pivalue) {
+			return NULL;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return nullptr;
+		order = ptzstruct->daylightdate.day;
+		if (5 == order) {
+			order = -1;
+		}
+		switch (ptzstruct->daylightdate.dayofweek) {
+		case 0:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dSU", order);
+			break;
+		case 1:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dMO", order);
+			break;
+		case 2:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dTU", order);
+			break;
+		case 3:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dWE", order);
+			break;
+		case 4:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dTH", order);
+			break;
+		case 5:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dFR", order);
+			break;
+		case 6:
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%dSA", order);
+			break;
+		default:
+			return NULL;
+		}
+		if (!pivalue->append_subval(tmp_buff))
+			return NULL;
+		pivalue = ical_new_value("BYMONTH");
+		if (NULL == pivalue) {
+			return NULL;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return nullptr;
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->daylightdate.month);
+		if (!pivalue->append_subval(tmp_buff))
+			return NULL;
+	} else if (1 == ptzstruct->daylightdate.year) {
+		piline = ical_new_line("RRULE");
+		if (NULL == piline) {
+			return NULL;
+		}
+		if (pcomponent1->append_line(piline) < 0)
+			return nullptr;
+		pivalue = ical_new_value("FREQ");
+		if (NULL == pivalue) {
+			return NULL;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return nullptr;
+		if (!pivalue->append_subval("YEARLY"))
+			return NULL;
+		pivalue = ical_new_value("BYMONTHDAY");
+		if (NULL == pivalue) {
+			return NULL;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return nullptr;
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->daylightdate.day);
+		pivalue = ical_new_value("BYMONTH");
+		if (NULL == pivalue) {
+			return NULL;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return nullptr;
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->daylightdate.month);
+		if (!pivalue->append_subval(tmp_buff))
+			return NULL;
+	}
+	utc_offset = -(ptzstruct->bias + ptzstruct->standardbias);
+	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
+	utc_offset = abs(utc_offset);
+	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
+	piline = ical_new_simple_line("TZOFFSETFROM", tmp_buff);
+	if (piline == nullptr)
+		return nullptr;
+	if (pcomponent1->append_line(piline) < 0)
+		return nullptr;
+	utc_offset = -(ptzstruct->bias + ptzstruct->daylightbias);
+	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
+	utc_offset = abs(utc_offset);
+	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
+	piline = ical_new_simple_line("TZOFFSETTO", tmp_buff);
+	if (piline == nullptr)
+		return nullptr;
+	if (pcomponent1->append_line(piline) < 0)
+		return nullptr;
+	return pcomponent;
+}
+
+static BOOL recurrencepattern_to_rrule(std::shared_ptr<ICAL_COMPONENT> ptz_component,
+	time_t whole_start_time, const APPOINTMENTRECURRENCEPATTERN *papprecurr,
+	ICAL_RRULE *pirrule)
+{
+	ICAL_TIME itime;
+	time_t unix_time;
+	uint64_t nt_time;
+	std::shared_ptr<ICAL_VALUE> pivalue;
+	char tmp_buff[1024];
+	
+	auto piline = ical_new_line("RRULE");
+	if (NULL == piline) {
+		return FALSE;
+	}
+	switch (papprecurr->recurrencepattern.patterntype) {
+	case PATTERNTYPE_DAY:
+		pivalue = ical_new_value("FREQ");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (!pivalue->append_subval("DAILY"))
+			return FALSE;
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+			papprecurr->recurrencepattern.period/1440);
+		pivalue = ical_new_value("INTERVAL");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (!pivalue->append_subval(tmp_buff))
+			return FALSE;
+		break;
+	case PATTERNTYPE_WEEK:
+		pivalue = ical_new_value("FREQ");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (!pivalue->append_subval("WEEKLY"))
+			return FALSE;
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+			papprecurr->recurrencepattern.period);
+		pivalue = ical_new_value("INTERVAL");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (!pivalue->append_subval(tmp_buff))
+			return FALSE;
+		pivalue = ical_new_value("BYDAY");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (WEEKRECURRENCEPATTERN_SU&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("SU"))
+				return FALSE;
+		}
+		if (WEEKRECURRENCEPATTERN_M&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("MO"))
+				return FALSE;
+		}
+		if (WEEKRECURRENCEPATTERN_TU&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("TU"))
+				return FALSE;
+		}
+		if (WEEKRECURRENCEPATTERN_W&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("WE"))
+				return FALSE;
+		}
+		if (WEEKRECURRENCEPATTERN_TH&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("TH"))
+				return FALSE;
+		}
+		if (WEEKRECURRENCEPATTERN_F&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("FR"))
+				return FALSE;
+		}
+		if (WEEKRECURRENCEPATTERN_SA&
+			papprecurr->recurrencepattern.
+			patterntypespecific.weekrecurrence) {
+			if (!pivalue->append_subval("SA"))
+				return FALSE;
+		}
+		break;
+	case PATTERNTYPE_MONTH:
+	case PATTERNTYPE_HJMONTH:
+		pivalue = ical_new_value("FREQ");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (0 != papprecurr->recurrencepattern.period%12) {
+			if (!pivalue->append_subval("MONTHLY"))
+				return FALSE;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+				papprecurr->recurrencepattern.period);
+			pivalue = ical_new_value("INTERVAL");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+			pivalue = ical_new_value("BYMONTHDAY");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (31 == papprecurr->recurrencepattern.
+				patterntypespecific.dayofmonth) {
+				strcpy(tmp_buff, "-1");
+			} else {
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+					papprecurr->recurrencepattern.
+					patterntypespecific.dayofmonth);
+			}
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+		} else {
+			if (!pivalue->append_subval("YEARLY"))
+				return FALSE;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+				papprecurr->recurrencepattern.period/12);
+			pivalue = ical_new_value("INTERVAL");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+			pivalue = ical_new_value("BYMONTHDAY");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (31 == papprecurr->recurrencepattern.
+				patterntypespecific.dayofmonth) {
+				strcpy(tmp_buff, "-1");
+			} else {
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+					papprecurr->recurrencepattern.
+					patterntypespecific.dayofmonth);
+			}
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+			pivalue = ical_new_value("BYMONTH");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			ical_get_itime_from_yearday(1601, 
+				papprecurr->recurrencepattern.firstdatetime/
+				1440 + 1, &itime);
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%u", itime.month);
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+		}
+		break;
+	case PATTERNTYPE_MONTHNTH:
+	case PATTERNTYPE_HJMONTHNTH:
+		pivalue = ical_new_value("FREQ");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (0 != papprecurr->recurrencepattern.period%12) {
+			if (!pivalue->append_subval("MONTHLY"))
+				return FALSE;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+				papprecurr->recurrencepattern.period);
+			pivalue = ical_new_value("INTERVAL");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+			pivalue = ical_new_value("BYDAY");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (WEEKRECURRENCEPATTERN_SU&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("SU"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_M&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("MO"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_TU&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("TU"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_W&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("WE"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_TH&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("TH"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_F&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("FR"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_SA&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("SA"))
+					return FALSE;
+			}
+			pivalue = ical_new_value("BYSETPOS");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (5 == papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.recurrencenum) {
+				strcpy(tmp_buff, "-1");
+			} else {
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+					papprecurr->recurrencepattern.
+					patterntypespecific.monthnth.recurrencenum);
+			}
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+		} else {
+			if (!pivalue->append_subval("YEARLY"))
+				return FALSE;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+				papprecurr->recurrencepattern.period/12);
+			pivalue = ical_new_value("INTERVAL");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+			pivalue = ical_new_value("BYDAY");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (WEEKRECURRENCEPATTERN_SU&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("SU"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_M&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("MO"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_TU&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("TU"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_W&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("WE"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_TH&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("TH"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_F&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("FR"))
+					return FALSE;
+			}
+			if (WEEKRECURRENCEPATTERN_SA&papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.weekrecurrence) {
+				if (!pivalue->append_subval("SA"))
+					return FALSE;
+			}
+			pivalue = ical_new_value("BYSETPOS");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			if (5 == papprecurr->recurrencepattern.
+				patterntypespecific.monthnth.recurrencenum) {
+				strcpy(tmp_buff, "-1");
+			} else {
+				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+					papprecurr->recurrencepattern.
+					patterntypespecific.monthnth.recurrencenum);
+			}
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+			pivalue = ical_new_value("BYMONTH");
+			if (NULL == pivalue) {
+				return FALSE;
+			}
+			if (piline->append_value(pivalue) < 0)
+				return false;
+			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+				papprecurr->recurrencepattern.firstdatetime);
+			if (!pivalue->append_subval(tmp_buff))
+				return FALSE;
+		}
+		break;
+	default:
+		return FALSE;
+	}
+	if (ENDTYPE_AFTER_N_OCCURRENCES ==
+		papprecurr->recurrencepattern.endtype) {
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
+			papprecurr->recurrencepattern.occurrencecount);
+		pivalue = ical_new_value("COUNT");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (!pivalue->append_subval(tmp_buff))
+			return FALSE;
+	} else if (ENDTYPE_AFTER_DATE ==
+		papprecurr->recurrencepattern.endtype) {
+		nt_time = papprecurr->recurrencepattern.enddate
+						+ papprecurr->starttimeoffset;
+		nt_time *= 600000000;
+		unix_time = rop_util_nttime_to_unix(nt_time);
+		ical_utc_to_datetime(ptz_component, unix_time, &itime);
+		snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02dZ",
+			itime.year, itime.month, itime.day,
+			itime.hour, itime.minute, itime.second);
+		pivalue = ical_new_value("UNTIL");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		if (!pivalue->append_subval(tmp_buff))
+			return FALSE;
+	}
+	if (PATTERNTYPE_WEEK == papprecurr->recurrencepattern.patterntype) {
+		pivalue = ical_new_value("WKST");
+		if (NULL == pivalue) {
+			return FALSE;
+		}
+		if (piline->append_value(pivalue) < 0)
+			return false;
+		switch (papprecurr->recurrencepattern.firstdow) {
+		case 0:
+			if (!pivalue->append_subval("SU"))
+				return FALSE;
+			break;
+		case 1:
+			if (!pivalue->append_subval("MO"))
+				return FALSE;
+			break;
+		case 2:
+			if (!pivalue->append_subval("TU"))
+				return FALSE;
+			break;
+		case 3:
+			if (!pivalue->append_subval("WE"))
+				return FALSE;
+			break;
+		case 4:
+			if (!pivalue->append_subval("TH"))
+				return FALSE;
+			break;
+		case 5:
+			if (!pivalue->append_subval("FR"))
+				return FALSE;
+			break;
+		case 6:
+			if (!pivalue->append_subval("SA"))
+				return FALSE;
+			break;
+		default:
+			return FALSE;
+		}
+	}
+	return ical_parse_rrule(
+		ptz_component, whole_start_time,
+		&piline->value_list, pirrule) ? TRUE : false;
+}
+
+static BOOL freebusy_recurrence_times(std::shared_ptr<ICAL_COMPONENT> ptz_component,
+	time_t whole_start_time, const APPOINTMENTRECURRENCEPATTERN *papprecurr,
+	time_t start_time, time_t end_time, std::vector<fb_occurrence> &list) try
+{
+	int i;
+	ICAL_TIME itime;
+	time_t tmp_time;
+	time_t tmp_time1;
+	uint64_t nt_time;
+	ICAL_RRULE irrule;
+	
+	if (FALSE == recurrencepattern_to_rrule(
+		ptz_component, whole_start_time,
+		papprecurr, &irrule)) {
+		return FALSE;	
+	}
+	do {
+		itime = ical_rrule_instance_itime(&irrule);
+		ical_itime_to_utc(ptz_component, itime, &tmp_time);
+		if (tmp_time < start_time) {
+			continue;
+		}
+		ical_itime_to_utc(NULL, itime, &tmp_time1);
+		for (i=0; i<papprecurr->exceptioncount; i++) {
+			nt_time = papprecurr->pexceptioninfo[i].originalstartdate;
+			nt_time *= 600000000;
+			if (tmp_time1 == rop_util_nttime_to_unix(nt_time)) {
+				break;
+			}
+		}
+		if (i < papprecurr->exceptioncount) {
+			continue;
+		}
+		list.push_back({tmp_time, tmp_time + (papprecurr->endtimeoffset
+		               - papprecurr->starttimeoffset) * 60, -1});
+		if (tmp_time >= end_time) {
+			break;
+		}
+	} while (ical_rrule_iterate(&irrule));
+	for (i=0; i<papprecurr->exceptioncount; i++) {
+		nt_time = papprecurr->pexceptioninfo[i].startdatetime;
+		nt_time *= 600000000;
+		tmp_time = rop_util_nttime_to_unix(nt_time);
+		ical_utc_to_datetime(NULL, tmp_time, &itime);
+		ical_itime_to_utc(ptz_component, itime, &tmp_time);
+		if (tmp_time >= start_time && tmp_time <= end_time) {
+			nt_time = papprecurr->pexceptioninfo[i].enddatetime;
+			nt_time *= 600000000;
+			tmp_time1 = rop_util_nttime_to_unix(nt_time);
+			ical_utc_to_datetime(NULL, tmp_time1, &itime);
+			ical_itime_to_utc(ptz_component, itime, &tmp_time1);
+			list.push_back({tmp_time, tmp_time1, i});
+		}
+	}
+	return TRUE;
+} catch (const std::bad_alloc &) {
+	return FALSE;
+}
+
+static std::shared_ptr<ICAL_COMPONENT> freebusy_get_vtimezone(const BINARY *ptzbin,
+    EXT_BUFFER_ALLOC alloc) try
+{
+	std::shared_ptr<ICAL_COMPONENT> ptz_component;
+	std::string key(ptzbin->pc, ptzbin->cb);
+	if (g_fb_tz_cache.get(key, ptz_component))
+		return ptz_component;
+	TIMEZONESTRUCT tzstruct;
+	EXT_PULL ext_pull;
+	ext_pull.init(ptzbin->pb, ptzbin->cb, alloc, EXT_FLAG_UTF16);
+	if (ext_pull.g_tzstruct(&tzstruct) != EXT_ERR_SUCCESS)
+		return nullptr;
+	ptz_component = tzstruct_to_vtimezone(1600, "timezone", &tzstruct);
+	if (ptz_component != nullptr)
+		/* a VTIMEZONE with its two rules is about this large */
+		g_fb_tz_cache.put(std::move(key), ptz_component, 2048);
+	return ptz_component;
+} catch (const std::bad_alloc &) {
+	return nullptr;
+}
+
+/*
+ * Produce the occurrences of a series that start within [start_time,
+ * end_time]. The cache is keyed by the series alone (its start, timezone
+ * and recurrence blob) and holds an expansion over an aligned window that
+ * covers the query; the result is clipped from that.
+ */
+static BOOL freebusy_cached_times(const BINARY *precur, const BINARY *ptzbin,
+    time_t whole_start_time, const APPOINTMENTRECURRENCEPATTERN *papprecurr,
+    time_t start_time, time_t end_time, EXT_BUFFER_ALLOC alloc,
+    std::vector<fb_occurrence> &list) try
+{
+	uint32_t tzlen = ptzbin != nullptr ? ptzbin->cb : 0;
+	std::string key;
+	key.reserve(sizeof(whole_start_time) + sizeof(tzlen) + tzlen + precur->cb);
+	key.append(reinterpret_cast<const char *>(&whole_start_time), sizeof(whole_start_time));
+	key.append(reinterpret_cast<const char *>(&tzlen), sizeof(tzlen));
+	if (ptzbin != nullptr)
+		key.append(ptzbin->pc, ptzbin->cb);
+	key.append(precur->pc, precur->cb);
+
+	auto clip = [&](const fb_expansion &x) {
+		for (const auto &occ : x.list)
+			if (occ.start_time >= start_time && occ.start_time <= end_time)
+				list.push_back(occ);
+	};
+	std::shared_ptr<const fb_expansion> cached;
+	if (g_fb_expand_cache.get(key, cached) &&
+	    cached->win_start <= start_time && end_time <= cached->win_end) {
+		clip(*cached);
+		return TRUE;
+	}
+	auto win_start = start_time - ((start_time % FB_EXPAND_GRANULE) +
+	                 FB_EXPAND_GRANULE) % FB_EXPAND_GRANULE;
+	auto win_end = win_start + ((end_time - win_start) / FB_EXPAND_GRANULE + 1) *
+	               FB_EXPAND_GRANULE - 1;
+	if (cached != nullptr) {
+		/* grow the cached window, unless that gets out of hand */
+		auto ws = std::min(win_start, cached->win_start);
+		auto we = std::max(win_end, cached->win_end);
+		if (we - ws < FB_EXPAND_MAXSPANS * FB_EXPAND_GRANULE) {
+			win_start = ws;
+			win_end = we;
+		}
+	}
+	std::shared_ptr<ICAL_COMPONENT> ptz_component;
+	if (ptzbin != nullptr) {
+		ptz_component = freebusy_get_vtimezone(ptzbin, alloc);
+		if (ptz_component == nullptr)
+			return FALSE;
+	}
+	auto x = std::make_shared<fb_expansion>();
+	x->win_start = win_start;
+	x->win_end = win_end;
+	if (!freebusy_recurrence_times(ptz_component, whole_start_time,
+	    papprecurr, win_start, win_end, x->list))
+		return FALSE;
+	clip(*x);
+	auto cost = x->list.size() * sizeof(fb_occurrence) + sizeof(*x);
+	g_fb_expand_cache.put(std::move(key), std::move(x), cost);
+	return TRUE;
+} catch (const std::bad_alloc &) {
+	return FALSE;
+}
+
+BOOL freebusy_make_uid(const BINARY *pglobal_obj, char *uid_buff, size_t uid_size)
+{
+	GUID guid;
+	time_t cur_time;
+	EXT_PULL ext_pull;
+	EXT_PUSH ext_push;
+	char tmp_buff[256];
+	char tmp_buff1[256];
+	GLOBALOBJECTID globalobjectid;
+	
+	if (NULL != pglobal_obj) {
+		ext_pull.init(pglobal_obj->pb, pglobal_obj->cb, malloc, 0);
+		if (ext_pull.g_goid(&globalobjectid) != EXT_ERR_SUCCESS)
+			return FALSE;
+		if (globalobjectid.data.cb >= 12 && 0 == memcmp(globalobjectid.data.pb,
+			"\x76\x43\x61\x6c\x2d\x55\x69\x64\x01\x00\x00\x00", 12)) {
+			if (globalobjectid.data.cb - 12 > sizeof(tmp_buff) - 1) {
+				memcpy(tmp_buff, globalobjectid.data.pb + 12,
+									sizeof(tmp_buff) - 1);
+				tmp_buff[sizeof(tmp_buff) - 1] = '\0';
+			} else {
+				memcpy(tmp_buff, globalobjectid.data.pb + 12,
+								globalobjectid.data.cb - 12);
+				tmp_buff[globalobjectid.data.cb - 12] = '\0';
+			}
+			free(globalobjectid.data.pv);
+			gx_strlcpy(uid_buff, tmp_buff, uid_size);
+		} else {
+			globalobjectid.year = 0;
+			globalobjectid.month = 0;
+			globalobjectid.day = 0;
+			auto ret = ext_push.init(tmp_buff, sizeof(tmp_buff), 0) &&
+			           ext_push.p_goid(&globalobjectid) == EXT_ERR_SUCCESS;
+			free(globalobjectid.data.pv);
+			if (!ret)
+				return false;
+			if (!encode_hex_binary(tmp_buff, ext_push.m_offset,
+			    tmp_buff1, sizeof(tmp_buff1)))
+				return FALSE;
+			HX_strupper(tmp_buff1);
+			gx_strlcpy(uid_buff, tmp_buff1, uid_size);
+		}
+	} else {
+		time(&cur_time);
+		memset(&globalobjectid, 0, sizeof(GLOBALOBJECTID));
+		memcpy(globalobjectid.arrayid,
+			"\x04\x00\x00\x00\x82\x00\xE0\x00"
+			"\x74\xC5\xB7\x10\x1A\x82\xE0\x08", 16);
+		globalobjectid.creationtime = rop_util_unix_to_nttime(cur_time);
+		globalobjectid.data.cb = 16;
+		globalobjectid.data.pv = tmp_buff1;
+		guid = guid_random_new();
+		if (!ext_push.init(tmp_buff1, 16, 0) ||
+		    ext_push.p_guid(&guid) != EXT_ERR_SUCCESS ||
+		    !ext_push.init(tmp_buff, sizeof(tmp_buff), 0) ||
+		    ext_push.p_goid(&globalobjectid) != EXT_ERR_SUCCESS)
+			return false;
+		if (!encode_hex_binary(tmp_buff, ext_push.m_offset, tmp_buff1,
+		    sizeof(tmp_buff1)))
+			return FALSE;
+		HX_strupper(tmp_buff1);
+		gx_strlcpy(uid_buff, tmp_buff1, uid_size);
+	}
+	return TRUE;
+}
+
+void freebusy_propnames(PROPERTY_NAME *names)
+{
+	static constexpr struct {
+		uint8_t pset;
+		uint32_t lid;
+	} fbprops[] = {
+		{PSETID_APPOINTMENT, PidLidAppointmentStartWhole},
+		{PSETID_APPOINTMENT, PidLidAppointmentEndWhole},
+		{PSETID_APPOINTMENT, PidLidBusyStatus},
+		{PSETID_APPOINTMENT, PidLidRecurring},
+		{PSETID_APPOINTMENT, PidLidAppointmentRecur},
+		{PSETID_APPOINTMENT, PidLidAppointmentSubType},
+		{PSETID_COMMON, PidLidPrivate},
+		{PSETID_APPOINTMENT, PidLidAppointmentStateFlags},
+		{PSETID_APPOINTMENT, PidLidClipEnd},
+		{PSETID_APPOINTMENT, PidLidLocation},
+		{PSETID_COMMON, PidLidReminderSet},
+		{PSETID_MEETING, PidLidGlobalObjectId},
+		{PSETID_APPOINTMENT, PidLidTimeZoneStruct},
+	};
+	static_assert(GX_ARRAY_SIZE(fbprops) == FB_PROP_COUNT);
+	for (size_t i = 0; i < FB_PROP_COUNT; ++i) {
+		rop_util_get_common_pset(fbprops[i].pset, &names[i].guid);
+		names[i].kind = MNID_ID;
+		names[i].lid = fbprops[i].lid;
+	}
+}
+
+BOOL freebusy_proptags(const PROPID_ARRAY *propids, uint32_t *tags)
+{
+	static constexpr uint16_t types[] = {
+		PT_SYSTIME, PT_SYSTIME, PT_LONG, PT_BOOLEAN, PT_BINARY,
+		PT_BOOLEAN, PT_BOOLEAN, PT_LONG, PT_SYSTIME, PT_UNICODE,
+		PT_BOOLEAN, PT_BINARY, PT_BINARY,
+	};
+	static_assert(GX_ARRAY_SIZE(types) == FB_PROP_COUNT);
+	if (propids->count != FB_PROP_COUNT)
+		return FALSE;
+	for (size_t i = 0; i < FB_PROP_COUNT; ++i)
+		tags[i] = PROP_TAG(types[i], propids->ppropid[i]);
+	return TRUE;
+}
+
+static bool fb_getbool(const TPROPVAL_ARRAY *row, uint32_t tag)
+{
+	auto v = static_cast<const uint8_t *>(tpropval_array_get_propval(row, tag));
+	return v != nullptr && *v != 0;
+}
+
+BOOL freebusy_expand(const TPROPVAL_ARRAY *row, const uint32_t *tags,
+    time_t start, time_t end, EXT_BUFFER_ALLOC alloc,
+    std::vector<freebusy_event> &events) try
+{
+	char uid_buff[256];
+	EXT_PULL ext_pull;
+	
+	auto pvalue = tpropval_array_get_propval(row, tags[FB_PROP_START]);
+	if (pvalue == nullptr)
+		return FALSE;
+	auto whole_start_time = rop_util_nttime_to_unix(*static_cast<uint64_t *>(pvalue));
+	pvalue = tpropval_array_get_propval(row, tags[FB_PROP_END]);
+	if (pvalue == nullptr)
+		return FALSE;
+	auto whole_end_time = rop_util_nttime_to_unix(*static_cast<uint64_t *>(pvalue));
+	if (!freebusy_make_uid(static_cast<BINARY *>(tpropval_array_get_propval(row,
+	    tags[FB_PROP_GOID])), uid_buff, arsizeof(uid_buff)))
+		return FALSE;
+	freebusy_event base;
+	base.id = uid_buff;
+	auto str = static_cast<const char *>(tpropval_array_get_propval(row, PR_SUBJECT));
+	if (str != nullptr) {
+		base.subject = str;
+		base.has_subject = true;
+	}
+	str = static_cast<const char *>(tpropval_array_get_propval(row, tags[FB_PROP_LOCATION]));
+	if (str != nullptr) {
+		base.location = str;
+		base.has_location = true;
+	}
+	base.b_reminder = fb_getbool(row, tags[FB_PROP_REMINDERSET]);
+	base.b_private = fb_getbool(row, tags[FB_PROP_PRIVATE]);
+	pvalue = tpropval_array_get_propval(row, tags[FB_PROP_BUSYSTATUS]);
+	if (pvalue != nullptr) {
+		base.busy_type = *static_cast<uint32_t *>(pvalue);
+		if (base.busy_type > 4)
+			base.busy_type = 0;
+	}
+	pvalue = tpropval_array_get_propval(row, tags[FB_PROP_STATEFLAGS]);
+	base.b_meeting = pvalue != nullptr && (*static_cast<uint32_t *>(pvalue) & 1);
+	if (!fb_getbool(row, tags[FB_PROP_RECURRING])) {
+		if (whole_end_time < start || whole_start_time > end)
+			return TRUE;
+		base.start_time = whole_start_time;
+		base.end_time = whole_end_time;
+		events.push_back(std::move(base));
+		return TRUE;
+	}
+
+	auto ptzbin = static_cast<BINARY *>(tpropval_array_get_propval(row, tags[FB_PROP_TZSTRUCT]));
+	auto precur = static_cast<BINARY *>(tpropval_array_get_propval(row, tags[FB_PROP_RECUR]));
+	if (precur == nullptr)
+		return FALSE;
+	APPOINTMENTRECURRENCEPATTERN apprecurr;
+	ext_pull.init(precur->pb, precur->cb, alloc, EXT_FLAG_UTF16);
+	if (ext_pull.g_apptrecpat(&apprecurr) != EXT_ERR_SUCCESS)
+		return FALSE;
+	/*
+	 * Occurrences are selected by their start time; widen the window by
+	 * one instance length so that those already running at @start are
+	 * reported, too.
+	 */
+	time_t duration = (static_cast<time_t>(apprecurr.endtimeoffset) -
+	                  apprecurr.starttimeoffset) * 60;
+	std::vector<fb_occurrence> list;
+	if (!freebusy_cached_times(precur, ptzbin, whole_start_time, &apprecurr,
+	    start - (duration > 0 ? duration : 0), end, alloc, list))
+		return FALSE;
+	base.b_recurring = true;
+	for (const auto &occ : list) {
+		if (occ.end_time < start || occ.start_time > end)
+			continue;
+		auto &ev = events.emplace_back(base);
+		ev.start_time = occ.start_time;
+		ev.end_time = occ.end_time;
+		if (occ.exc_index < 0 || occ.exc_index >= apprecurr.exceptioncount ||
+		    apprecurr.pextendedexception == nullptr)
+			continue;
+		auto pexception = &apprecurr.pexceptioninfo[occ.exc_index];
+		auto pex_exception = &apprecurr.pextendedexception[occ.exc_index];
+		ev.b_exception = true;
+		auto flags = pexception->overrideflags;
+		if (flags & OVERRIDEFLAG_MEETINGTYPE)
+			ev.b_meeting = pexception->meetingtype & 1;
+		if (flags & OVERRIDEFLAG_REMINDER)
+			ev.b_reminder = pexception->reminderset != 0;
+		if (flags & OVERRIDEFLAG_BUSYSTATUS)
+			ev.busy_type = pexception->busystatus;
+		if (flags & OVERRIDEFLAG_SUBJECT) {
+			ev.has_subject = pex_exception->subject != nullptr;
+			ev.subject = ev.has_subject ? pex_exception->subject : "";
+		}
+		if (flags & OVERRIDEFLAG_LOCATION) {
+			ev.has_location = pex_exception->location != nullptr;
+			ev.location = ev.has_location ? pex_exception->location : "";
+		}
+	}
+	return TRUE;
+} catch (const std::bad_alloc &) {
+	return FALSE;
+}
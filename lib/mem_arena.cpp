@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-only WITH linking exception
+#include <cstddef>
+#include <cstdlib>
+#include <gromox/defs.h>
+#include <gromox/mem_arena.hpp>
+
+struct MEM_ARENA_CHUNK {
+	MEM_ARENA_CHUNK *next;
+	size_t size, used;
+};
+
+static constexpr size_t chunk_hdr_al = roundup(sizeof(MEM_ARENA_CHUNK), sizeof(std::max_align_t));
+
+static inline char *mem_arena_data(MEM_ARENA_CHUNK *pchunk)
+{
+	return reinterpret_cast<char *>(pchunk) + chunk_hdr_al;
+}
+
+static MEM_ARENA_CHUNK *mem_arena_new_chunk(size_t size)
+{
+	auto pchunk = static_cast<MEM_ARENA_CHUNK *>(malloc(chunk_hdr_al + size));
+	if (NULL == pchunk) {
+		return NULL;
+	}
+	pchunk->next = NULL;
+	pchunk->size = size;
+	pchunk->used = 0;
+	return pchunk;
+}
+
+/*
+ *	@param
+ *		chunk_size		size of the regular chunks
+ *		limit			bytes that may be handed out between two
+ *						clears; 0 means unlimited
+ */
+void mem_arena_init(MEM_ARENA *parena, size_t chunk_size, size_t limit)
+{
+	parena->head = NULL;
+	parena->cur = NULL;
+	parena->chunk_size = roundup(chunk_size, sizeof(std::max_align_t));
+	parena->total = 0;
+	parena->limit = limit;
+	parena->generation = 0;
+}
+
+/*
+ *	allocate from the arena; the memory stays valid until the next
+ *	mem_arena_clear or mem_arena_free
+ */
+void *mem_arena_alloc(MEM_ARENA *parena, size_t size)
+{
+	auto size_al = roundup(size, sizeof(std::max_align_t));
+	if (0 != parena->limit && size_al > parena->limit - parena->total) {
+		return NULL;
+	}
+	if (NULL == parena->head) {
+		parena->head = mem_arena_new_chunk(parena->chunk_size);
+		if (NULL == parena->head) {
+			return NULL;
+		}
+		parena->cur = parena->head;
+	}
+	if (size_al > parena->chunk_size / 2) {
+		/* big pieces get a chunk of their own behind the first one */
+		auto pchunk = mem_arena_new_chunk(size_al);
+		if (NULL == pchunk) {
+			return NULL;
+		}
+		pchunk->used = size_al;
+		pchunk->next = parena->head->next;
+		parena->head->next = pchunk;
+		parena->total += size_al;
+		return mem_arena_data(pchunk);
+	}
+	auto pchunk = parena->cur;
+	if (pchunk->size - pchunk->used < size_al) {
+		pchunk = mem_arena_new_chunk(parena->chunk_size);
+		if (NULL == pchunk) {
+			return NULL;
+		}
+		pchunk->next = parena->cur->next;
+		parena->cur->next = pchunk;
+		parena->cur = pchunk;
+	}
+	auto ptr = mem_arena_data(pchunk) + pchunk->used;
+	pchunk->used += size_al;
+	parena->total += size_al;
+	return ptr;
+}
+
+/*
+ *	grow the most recent allocation in place, if it still fits into the
+ *	current chunk
+ *	@return
+ *		TRUE	ptr now has new_size bytes
+ *		FALSE	caller has to allocate anew and copy
+ */
+BOOL mem_arena_extend(MEM_ARENA *parena, void *ptr, size_t old_size,
+    size_t new_size)
+{
+	auto pchunk = parena->cur;
+	if (NULL == pchunk || NULL == ptr) {
+		return FALSE;
+	}
+	auto old_al = roundup(old_size, sizeof(std::max_align_t));
+	auto new_al = roundup(new_size, sizeof(std::max_align_t));
+	if (static_cast<char *>(ptr) + old_al != mem_arena_data(pchunk) + pchunk->used ||
+	    pchunk->used - old_al + new_al > pchunk->size) {
+		return FALSE;
+	}
+	if (0 != parena->limit && new_al > old_al &&
+	    new_al - old_al > parena->limit - parena->total) {
+		return FALSE;
+	}
+	pchunk->used = pchunk->used - old_al + new_al;
+	parena->total = parena->total - old_al + new_al;
+	return TRUE;
+}
+
+void mem_arena_clear(MEM_ARENA *parena)
+{
+	if (NULL == parena->head) {
+		return;
+	}
+	auto pchunk = parena->head->next;
+	while (NULL != pchunk) {
+		auto pnext = pchunk->next;
+		free(pchunk);
+		pchunk = pnext;
+	}
+	parena->head->next = NULL;
+	parena->head->used = 0;
+	parena->cur = parena->head;
+	parena->total = 0;
+	parena->generation ++;
+}
+
+void mem_arena_free(MEM_ARENA *parena)
+{
+	mem_arena_clear(parena);
+	free(parena->head);
+	parena->head = NULL;
+	parena->cur = NULL;
+}
@@ -3,8 +3,11 @@
  *	  mem file is actually like the file in disk, but mem file get blocks form
  *	  memory, it is virtual file. Caution: Not thread-safe.
  */
+#include <algorithm>
 #include <gromox/mem_file.hpp>
 #include <gromox/util.hpp>
+/* initial capacity of a contiguous (arena-backed) mem file */
+#define MEM_FILE_ARENA_MIN		64
 
 static DOUBLE_LIST_NODE* mem_file_append_node(MEM_FILE *pfile); 
 
@@ -44,6 +47,130 @@ void mem_file_init(MEM_FILE *pfile, LIB_BUFFER *palloc)
 
 }
 
+void mem_file_init(MEM_FILE *pfile, MEM_ARENA *parena)
+{
+	memset(pfile, 0, sizeof(MEM_FILE));
+	double_list_init(&pfile->list);
+	pfile->arena = parena;
+	pfile->arena_gen = parena->generation;
+}
+
+/*
+ *	  make room for @need bytes in a contiguous mem file, growing in place
+ *	  when the buffer is the last piece of the arena
+ */
+static BOOL mem_file_reserve(MEM_FILE *pfile, size_t need)
+{
+	if (pfile->arena_gen != pfile->arena->generation) {
+		/* arena was cleared under us; the old buffer is gone */
+		pfile->pbuf = NULL;
+		pfile->buf_size = 0;
+		pfile->arena_gen = pfile->arena->generation;
+	}
+	if (need <= pfile->buf_size) {
+		return TRUE;
+	}
+	auto new_size = std::max(need, std::max(2 * pfile->buf_size,
+	                static_cast<size_t>(MEM_FILE_ARENA_MIN)));
+	if (TRUE == mem_arena_extend(pfile->arena, pfile->pbuf,
+	    pfile->buf_size, new_size)) {
+		pfile->buf_size = new_size;
+		return TRUE;
+	}
+	auto pbuf = static_cast<char *>(mem_arena_alloc(pfile->arena, new_size));
+	if (NULL == pbuf) {
+		return FALSE;
+	}
+	if (pfile->file_total_len > 0) {
+		memcpy(pbuf, pfile->pbuf, pfile->file_total_len);
+	}
+	pfile->pbuf = pbuf;
+	pfile->buf_size = new_size;
+	return TRUE;
+}
+
+static size_t mem_file_readline_contig(MEM_FILE *pfile, char *pbuff, size_t size)
+{
+	if (pfile->rd_total_pos >= pfile->file_total_len) {
+		return MEM_END_OF_FILE;
+	}
+	size --;  /* reserve last byte for '\0' */
+	auto pstart = pfile->pbuf + pfile->rd_total_pos;
+	auto remains = pfile->file_total_len - pfile->rd_total_pos;
+	auto peol = static_cast<char *>(memchr(pstart, '\n', remains));
+	size_t actual_size = peol != NULL ? peol - pstart : remains;
+	if (actual_size > size) {
+		memcpy(pbuff, pstart, size);
+		pbuff[size] = '\0';
+		pfile->rd_total_pos += size;
+		return size;
+	}
+	memcpy(pbuff, pstart, actual_size);
+	pbuff[actual_size] = '\0';
+	pfile->rd_total_pos += actual_size + (peol != NULL ? 1 : 0);
+	return actual_size;
+}
+
+static size_t mem_file_read_contig(MEM_FILE *pfile, void *pbuff, size_t size)
+{
+	if (pfile->rd_total_pos >= pfile->file_total_len) {
+		return MEM_END_OF_FILE;
+	}
+	size = std::min(size, pfile->file_total_len - pfile->rd_total_pos);
+	memcpy(pbuff, pfile->pbuf + pfile->rd_total_pos, size);
+	pfile->rd_total_pos += size;
+	return size;
+}
+
+static ssize_t mem_file_seek_contig(MEM_FILE *pfile, int type,
+    ssize_t offset, int opt)
+{
+	auto ppos = MEM_FILE_READ_PTR == type ? &pfile->rd_total_pos :
+	            &pfile->wr_total_pos;
+	ssize_t len = pfile->file_total_len, pos = *ppos, new_pos;
+
+	switch (opt) {
+	case MEM_FILE_SEEK_BEGIN:
+		if (offset < 0) {
+			return 0;
+		}
+		*ppos = std::min(offset, len);
+		return 0;
+	case MEM_FILE_SEEK_CUR:
+		new_pos = std::clamp(pos + offset, static_cast<ssize_t>(0), len);
+		break;
+	case MEM_FILE_SEEK_END:
+		if (offset > 0) {
+			return 0;
+		}
+		new_pos = std::max(len + offset, static_cast<ssize_t>(0));
+		break;
+	default:
+		return -1;
+	}
+	*ppos = new_pos;
+	return new_pos - pos;
+}
+
+static size_t mem_file_write_contig(MEM_FILE *pfile, const void *pbuff,
+    size_t size)
+{
+	/*
+	 * all or nothing: the arena may be capped, and a half-written record
+	 * is worse than a missing one
+	 */
+	if (0 == size ||
+	    FALSE == mem_file_reserve(pfile, pfile->wr_total_pos + size)) {
+		return 0;
+	}
+	memcpy(pfile->pbuf + pfile->wr_total_pos, pbuff, size);
+	pfile->wr_total_pos += size;
+	if (pfile->wr_total_pos > pfile->file_total_len) {
+		pfile->file_total_len = pfile->wr_total_pos;
+	}
+	return size;
+}
+
 
 /*
  *	  retrieve pointer of the line following the read pointer
@@ -67,6 +194,9 @@ size_t mem_file_readline(MEM_FILE *pfile, char* pbuff, size_t size)
 	if (0 == size) {
 		return 0;
 	}
+	if (NULL != pfile->arena) {
+		return mem_file_readline_contig(pfile, pbuff, size);
+	}
 	
 	/* 
 	if the read pointer has reached the end of the mem file, return 
@@ -223,6 +353,9 @@ size_t	mem_file_read(MEM_FILE *pfile, void* pbuff, size_t size)
 	}
 #endif
 
+	if (NULL != pfile->arena) {
+		return mem_file_read_contig(pfile, pbuff, size);
+	}
 
 	if (pfile->rd_total_pos >= pfile->file_total_len) {
 		return MEM_END_OF_FILE;
@@ -295,6 +428,9 @@ ssize_t	mem_file_seek(MEM_FILE* pfile, int type, ssize_t offset, int opt)
 		return 0;
 	}
 #endif
+	if (NULL != pfile->arena) {
+		return mem_file_seek_contig(pfile, type, offset, opt);
+	}
 	switch(opt) {
 	case MEM_FILE_SEEK_BEGIN:
 		if (offset < 0) {
@@ -505,6 +641,9 @@ size_t mem_file_write(MEM_FILE *pfile, const void *pbuff, size_t size)
 		return 0;
 	}
 #endif
+	if (NULL != pfile->arena) {
+		return mem_file_write_contig(pfile, pbuff, size);
+	}
 
 	if (size > pfile->file_total_len - pfile->wr_total_pos) {
 		bytes_need = size - (pfile->file_total_len - pfile->wr_total_pos);
@@ -610,11 +749,18 @@ void mem_file_clear(MEM_FILE *pfile)
 {
 	DOUBLE_LIST_NODE *pnode, *phead;
 #ifdef _DEBUG_UMTA
-	if (NULL == pfile || NULL == pfile->allocator) {
+	if (NULL == pfile || (NULL == pfile->allocator && NULL == pfile->arena)) {
 		debug_info("[mem_file]: mem_file_clear, param NULL");
 		return;
 	}
 #endif
+	if (NULL != pfile->arena) {
+		/* keep the buffer; it is reclaimed with the arena */
+		pfile->wr_total_pos = 0;
+		pfile->rd_total_pos = 0;
+		pfile->file_total_len = 0;
+		return;
+	}
 	phead = double_list_get_head(&pfile->list);
 	pnode = double_list_get_tail(&pfile->list);
 	if (1 == double_list_get_nodes_num(&pfile->list)) {
@@ -643,11 +789,19 @@ void mem_file_free(MEM_FILE *pfile)
 {	 
 	DOUBLE_LIST_NODE *phead;
 #ifdef _DEBUG_UMTA
-	if (NULL == pfile || NULL == pfile->allocator) {
+	if (NULL == pfile || (NULL == pfile->allocator && NULL == pfile->arena)) {
 		debug_info("[mem_file]: mem_file_free, param NULL");
 		return;
 	}
 #endif
+	if (NULL != pfile->arena) {
+		mem_file_clear(pfile);
+		pfile->arena = NULL;
+		pfile->pbuf = NULL;
+		pfile->buf_size = 0;
+		double_list_free(&pfile->list);
+		return;
+	}
 	mem_file_clear(pfile);
 	phead = double_list_pop_front(&pfile->list);
 	lib_buffer_put(pfile->allocator, phead);
@@ -693,6 +847,37 @@ size_t mem_file_get_total_length(MEM_FILE *pfile)
 	return pfile->file_total_len;
 }
 
+/* copy where at least one side keeps its data contiguously */
+static size_t mem_file_copy_mixed(MEM_FILE *pfile_src, MEM_FILE *pfile_dst)
+{
+	size_t remains = pfile_src->file_total_len;
+
+	mem_file_clear(pfile_dst);
+	if (NULL != pfile_src->arena) {
+		if (remains > 0 && mem_file_write(pfile_dst,
+		    pfile_src->pbuf, remains) != remains) {
+			mem_file_clear(pfile_dst);
+			return 0;
+		}
+	} else {
+		for (auto pnode = double_list_get_head(&pfile_src->list);
+		     NULL != pnode && remains > 0;
+		     pnode = double_list_get_after(&pfile_src->list, pnode)) {
+			auto length = std::min(remains, static_cast<size_t>(FILE_BLOCK_SIZE));
+			if (mem_file_write(pfile_dst, pnode->pdata, length) != length) {
+				mem_file_clear(pfile_dst);
+				return 0;
+			}
+			remains -= length;
+		}
+	}
+	mem_file_seek(pfile_dst, MEM_FILE_READ_PTR, pfile_src->rd_total_pos,
+		MEM_FILE_SEEK_BEGIN);
+	mem_file_seek(pfile_dst, MEM_FILE_WRITE_PTR, pfile_src->wr_total_pos,
+		MEM_FILE_SEEK_BEGIN);
+	return pfile_dst->file_total_len;
+}
+
 /*
  *	copy mem file from one to another
  *	@param
@@ -713,6 +898,9 @@ size_t mem_file_copy(MEM_FILE *pfile_src, MEM_FILE *pfile_dst)
 	}
 #endif
 
+	if (NULL != pfile_src->arena || NULL != pfile_dst->arena) {
+		return mem_file_copy_mixed(pfile_src, pfile_dst);
+	}
 	mem_file_clear(pfile_dst);
 	nodes_num = double_list_get_nodes_num(&pfile_src->list);
 	for (i=0; i<nodes_num-1; i++) {
@@ -41,6 +41,17 @@ static int utf8_byte_num(unsigned char ch)
 	return byte_num;
 }
  
+/*
+ * Eight bytes at a time: true if none of them has the high bit set. The
+ * caller guarantees (via strlen) that there is no NUL within the word.
+ */
+static inline bool utf8_word_is_ascii(const char *p)
+{
+	uint64_t w;
+	memcpy(&w, p, sizeof(w));
+	return (w & UINT64_C(0x8080808080808080)) == 0;
+}
+
 /* check for invalid UTF-8 */
 BOOL utf8_check(const char *str)
 {
@@ -51,7 +62,12 @@ BOOL utf8_check(const char *str)
 	if (NULL == str) {
 		return FALSE;
 	}
-	while (*ptr != '\0') {
+	auto end = str + strlen(str);
+	while (ptr < end) {
+		if (byte_num == 0 && end - ptr >= 8 && utf8_word_is_ascii(ptr)) {
+			ptr += 8;
+			continue;
+		}
 		ch = (unsigned char)*ptr;
 		if (byte_num == 0) {
 			if (0 == (byte_num = utf8_byte_num(ch))) {
@@ -81,7 +97,13 @@ BOOL utf8_len(const char *str, int *plen)
 	const char *ptr = str;
 	
 	clen = strlen(str);
+	auto end = str + clen;
 	while (*ptr != '\0' && len < clen) {
+		if (end - ptr >= 8 && utf8_word_is_ascii(ptr)) {
+			ptr += 8;
+			len += 8;
+			continue;
+		}
 		ch = (unsigned char)*ptr;
 		if (0 == (byte_num = utf8_byte_num(ch))) {
 			return FALSE;
@@ -1110,6 +1132,19 @@ static char base64idx[128] = {
 		49,	   50,	  51,'\377','\377','\377','\377','\377'
 };
 
+static constexpr struct b64dec_table {
+	constexpr b64dec_table() : v()
+	{
+		const char alpha[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			"abcdefghijklmnopqrstuvwxyz0123456789+/";
+		for (size_t i = 0; i < sizeof(v); ++i)
+			v[i] = 0xFF;
+		for (uint8_t i = 0; i < 64; ++i)
+			v[static_cast<uint8_t>(alpha[i])] = i;
+	}
+	uint8_t v[256];
+} b64dec_tbl;
+
 static char hextab[] = "0123456789ABCDEF";
 
 
@@ -1225,6 +1260,24 @@ int decode64_ex(const char *_in, size_t inlen, void *vout,
 		return -1;
 	}
 	while (inpos < inLen) {
+		/*
+		 * Fast path for the common case of four consecutive alphabet
+		 * characters (no whitespace, padding or junk in between).
+		 */
+		if (inLen - inpos >= 4) {
+			auto q = reinterpret_cast<const uint8_t *>(&_in[inpos]);
+			a1 = b64dec_tbl.v[q[0]];
+			a2 = b64dec_tbl.v[q[1]];
+			a3 = b64dec_tbl.v[q[2]];
+			a4 = b64dec_tbl.v[q[3]];
+			if (((a1 | a2 | a3 | a4) & 0x80) == 0) {
+				inpos += 4;
+				out[outPos++] = (a1 << 2) | (a2 >> 4);
+				out[outPos++] = (a2 << 4) | (a3 >> 2);
+				out[outPos++] = (a3 << 6) | a4;
+				continue;
+			}
+		}
 		a1 = a2 = a3 = a4 = 0;
 		while (inpos < inLen) {
 			a1 = _in[inpos++] & 0xFF;
@@ -1478,6 +1531,16 @@ size_t qp_decode(void *voutput, const char *input, size_t length)
 	int c;
 	size_t i, cnt = 0;
 	for (i = 0; i < length; i++) {
+		/* pass runs of literal characters through in one go */
+		auto eq = static_cast<const char *>(memchr(&input[i], '=', length - i));
+		size_t run = eq != nullptr ? eq - &input[i] : length - i;
+		if (run > 0) {
+			memcpy(&output[cnt], &input[i], run);
+			cnt += run;
+			i += run;
+			if (i >= length)
+				break;
+		}
 
 		c = input[i];
 
@@ -1520,6 +1583,14 @@ ssize_t qp_decode_ex(void *voutput, size_t out_len, const char *input,
 	int c;
 	size_t i, cnt = 0;
 	for (i = 0; i < length; i++) {
+		auto eq = static_cast<const char *>(memchr(&input[i], '=', length - i));
+		size_t run = eq != nullptr ? eq - &input[i] : length - i;
+		if (run > 0) {
+			cnt += run;
+			i += run;
+			if (i >= length)
+				break;
+		}
 
 		c = input[i];
 
@@ -26,7 +26,6 @@
 #include <cstdio>
 #include <cstdlib>
 #define FILENUM_PER_CONTROL		32
-#define FILENUM_PER_MIME		32
 #define MAX_THROWING_NUM		16
 #define SCAN_INTERVAL			1
 #define MAX_TIMES_NOT_SERVED	5
@@ -260,7 +259,7 @@ int transporter_run()
 		single_list_append_as_tail(&g_free_list, &pcontext->node);
 	}
 
-	g_mime_pool = mime_pool_init(g_mime_num, FILENUM_PER_MIME, TRUE);
+	g_mime_pool = mime_pool_init(g_mime_num, TRUE);
 	if (NULL == g_mime_pool) {
 		transporter_collect_resource();
 		printf("[transporter]: Failed to init MIME pool\n");
@@ -13,6 +13,7 @@
 #include <libHX/string.h>
 #include <gromox/defs.h>
 #include <gromox/fileio.h>
+#include <gromox/midb.hpp>
 #include "imap_cmd_parser.h"
 #include "system_services.h"
 #include <gromox/mail_func.hpp>
@@ -240,6 +241,7 @@ static BOOL imap_cmd_parser_parse_fetch_args(DOUBLE_LIST *plist,
 			0 == strcasecmp(argv[i], "ENVELOPE") ||
 			0 == strcasecmp(argv[i], "FLAGS") ||
 			0 == strcasecmp(argv[i], "INTERNALDATE") ||
+			0 == strcasecmp(argv[i], "MODSEQ") ||
 			0 == strcasecmp(argv[i], "RFC822") ||
 			0 == strcasecmp(argv[i], "RFC822.HEADER") ||
 			0 == strcasecmp(argv[i], "RFC822.SIZE") ||
@@ -407,6 +409,7 @@ static BOOL imap_cmd_parser_parse_fetch_args(DOUBLE_LIST *plist,
 	double_list_init(&temp_list);
 	imap_cmd_parser_find_arg_node(plist, "UID", &temp_list);
 	imap_cmd_parser_find_arg_node(plist, "FLAGS", &temp_list);
+	imap_cmd_parser_find_arg_node(plist, "MODSEQ", &temp_list);
 	imap_cmd_parser_find_arg_node(plist, "INTERNALDATE", &temp_list);
 	imap_cmd_parser_find_arg_node(plist, "RFC822.SIZE", &temp_list);
 	imap_cmd_parser_find_arg_node(plist, "ENVELOPE", &temp_list);
@@ -957,6 +960,10 @@ static void imap_cmd_parser_process_fetch_item(IMAP_CONTEXT *pcontext,
 		} else if (strcasecmp(kw, "UID") == 0) {
 			buff_len += gx_snprintf(buff + buff_len,
 			            GX_ARRAY_SIZE(buff) - buff_len, "UID %d", pitem->uid);
+		} else if (strcasecmp(kw, "MODSEQ") == 0) {
+			buff_len += gx_snprintf(buff + buff_len,
+			            GX_ARRAY_SIZE(buff) - buff_len, "MODSEQ (%llu)",
+			            LLU(pitem->modseq));
 		} else if (strncasecmp(kw, "BODY[", 5) == 0 ||
 		    strncasecmp(kw, "BODY.PEEK[", 10) == 0) {
 			pbody = strchr(static_cast<char *>(pnode->pdata), '[');
@@ -1062,11 +1069,13 @@ static void imap_cmd_parser_store_flags(const char *cmd, const char *mid,
 	int id, unsigned int uid, int flag_bits, IMAP_CONTEXT *pcontext)
 {
 	int errnum;
+	BOOL b_echo;
 	char buff[1024];
+	uint64_t modseq;
 	int string_length;
 	char flags_string[128];
 	
-	string_length = 0;
+	b_echo = FALSE;
 	if (0 == strcasecmp(cmd, "FLAGS") ||
 		0 == strcasecmp(cmd, "FLAGS.SILENT")) {
 		system_services_unset_flags(pcontext->maildir,
@@ -1074,58 +1083,304 @@ static void imap_cmd_parser_store_flags(const char *cmd, const char *mid,
 			FLAG_FLAGGED|FLAG_DELETED|FLAG_SEEN|FLAG_DRAFT, &errnum);
 		system_services_set_flags(pcontext->maildir,
 			pcontext->selected_folder, mid, flag_bits, &errnum);
-		if (0 == strcasecmp(cmd, "FLAGS")) {
-			imap_cmd_parser_convert_flags_string(flag_bits, flags_string);
-			if (0 != uid) {
-				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-					"* %d FETCH (FLAGS %s UID %d)\r\n",
-					id, flags_string, uid);
-			} else {
-				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-					"* %d FETCH (FLAGS %s)\r\n",
-					id, flags_string);
-			}
-		}
+		b_echo = 0 == strcasecmp(cmd, "FLAGS") ? TRUE : FALSE;
 	} else if (0 == strcasecmp(cmd, "+FLAGS") ||
 		0 == strcasecmp(cmd, "+FLAGS.SILENT")) {
 		system_services_set_flags(pcontext->maildir,
 		pcontext->selected_folder, mid, flag_bits, &errnum);
-		if (0 == strcasecmp(cmd, "+FLAGS") && 
-			MIDB_RESULT_OK == system_services_get_flags(pcontext->maildir,
-		    pcontext->selected_folder, mid, &flag_bits, &errnum)) {
-			imap_cmd_parser_convert_flags_string(flag_bits, flags_string);
-			if (0 != uid) {
-				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-					"* %d FETCH (FLAGS %s UID %d)\r\n",
-					id, flags_string, uid);
-			} else {
-				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-					"* %d FETCH (FLAGS %s)\r\n",
-					id, flags_string);
-			}
-		}
+		b_echo = 0 == strcasecmp(cmd, "+FLAGS") ? TRUE : FALSE;
 	} else if (0 == strcasecmp(cmd, "-FLAGS") ||
 		0 == strcasecmp(cmd, "-FLAGS.SILENT")) {
 		system_services_unset_flags(pcontext->maildir,
 			pcontext->selected_folder, mid, flag_bits, &errnum);
-		if (0 == strcasecmp(cmd, "-FLAGS") &&
-			MIDB_RESULT_OK == system_services_get_flags(pcontext->maildir,
-		    pcontext->selected_folder, mid, &flag_bits, &errnum)) {
-			imap_cmd_parser_convert_flags_string(flag_bits, flags_string);
-			if (0 != uid) {
-				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-					"* %d FETCH (FLAGS %s UID %d)\r\n",
-					id, flags_string, uid);
-			} else {
-				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-					"* %d FETCH (FLAGS %s)\r\n",
-					id, flags_string);
+		b_echo = 0 == strcasecmp(cmd, "-FLAGS") ? TRUE : FALSE;
+	}
+	if ((FALSE == b_echo && FALSE == pcontext->b_condstore) ||
+	    MIDB_RESULT_OK != system_services_get_flags(pcontext->maildir,
+	    pcontext->selected_folder, mid, &flag_bits, &modseq, &errnum)) {
+		return;
+	}
+	if (TRUE == b_echo) {
+		imap_cmd_parser_convert_flags_string(flag_bits, flags_string);
+		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"* %d FETCH (FLAGS %s", id, flags_string);
+	} else {
+		/* RFC 7162 3.1.3: .SILENT still reports the new MODSEQ */
+		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"* %d FETCH (MODSEQ (%llu)", id, LLU(modseq));
+	}
+	if (0 != uid) {
+		string_length += gx_snprintf(buff + string_length,
+			GX_ARRAY_SIZE(buff) - string_length, " UID %d", uid);
+	}
+	if (TRUE == b_echo && TRUE == pcontext->b_condstore) {
+		string_length += gx_snprintf(buff + string_length,
+			GX_ARRAY_SIZE(buff) - string_length, " MODSEQ (%llu)",
+			LLU(modseq));
+	}
+	string_length += gx_snprintf(buff + string_length,
+		GX_ARRAY_SIZE(buff) - string_length, ")\r\n");
+	imap_parser_safe_write(pcontext, buff, string_length);
+}
+
+/*
+ * Append MODSEQ to a FETCH item list; RFC 7162 wants it whenever FLAGS is
+ * sent after CONDSTORE was enabled, and always with CHANGEDSINCE.
+ */
+static void imap_cmd_parser_append_modseq(DOUBLE_LIST *plist,
+	DOUBLE_LIST_NODE *pnode, BOOL b_force)
+{
+	DOUBLE_LIST_NODE *pnode1;
+	
+	for (pnode1=double_list_get_head(plist); NULL!=pnode1;
+		pnode1=double_list_get_after(plist, pnode1)) {
+		if (0 == strcasecmp((char*)pnode1->pdata, "MODSEQ")) {
+			return;
+		}
+		if (0 == strcasecmp((char*)pnode1->pdata, "FLAGS")) {
+			b_force = TRUE;
+		}
+	}
+	if (FALSE == b_force) {
+		return;
+	}
+	pnode->pdata = deconst("MODSEQ");
+	double_list_append_as_tail(plist, pnode);
+}
+
+/* parse the FETCH modifier list "(CHANGEDSINCE n [VANISHED])" */
+static BOOL imap_cmd_parser_parse_fetch_modifier(char *string,
+	uint64_t *pchangedsince, BOOL *pb_vanished)
+{
+	int i;
+	char *pend;
+	int temp_argc;
+	BOOL b_changedsince;
+	char *temp_argv[8];
+	
+	if ('(' != string[0] || ')' != string[strlen(string) - 1]) {
+		return FALSE;
+	}
+	temp_argc = parse_imap_args(string + 1, strlen(string) - 2,
+	            temp_argv, GX_ARRAY_SIZE(temp_argv));
+	if (temp_argc < 1) {
+		return FALSE;
+	}
+	b_changedsince = FALSE;
+	*pchangedsince = 0;
+	*pb_vanished = FALSE;
+	for (i=0; i<temp_argc; i++) {
+		if (0 == strcasecmp(temp_argv[i], "CHANGEDSINCE") &&
+			i + 1 < temp_argc) {
+			i ++;
+			*pchangedsince = strtoull(temp_argv[i], &pend, 10);
+			if ('\0' == temp_argv[i][0] || '\0' != *pend) {
+				return FALSE;
 			}
+			b_changedsince = TRUE;
+		} else if (0 == strcasecmp(temp_argv[i], "VANISHED")) {
+			*pb_vanished = TRUE;
+		} else {
+			return FALSE;
 		}
 	}
-	if (0 != string_length) {
-		imap_parser_safe_write(pcontext, buff, string_length);
+	return b_changedsince;
+}
+
+/* parse the STORE modifier list "(UNCHANGEDSINCE n)" */
+static BOOL imap_cmd_parser_parse_store_modifier(char *string,
+	uint64_t *punchangedsince)
+{
+	char *pend;
+	int temp_argc;
+	char *temp_argv[4];
+	
+	if ('(' != string[0] || ')' != string[strlen(string) - 1]) {
+		return FALSE;
+	}
+	temp_argc = parse_imap_args(string + 1, strlen(string) - 2,
+	            temp_argv, GX_ARRAY_SIZE(temp_argv));
+	if (2 != temp_argc || 0 != strcasecmp(temp_argv[0],
+		"UNCHANGEDSINCE") || '\0' == temp_argv[1][0]) {
+		return FALSE;
+	}
+	*punchangedsince = strtoull(temp_argv[1], &pend, 10);
+	return '\0' == *pend ? TRUE : FALSE;
+}
+
+/*
+ * Parse the SELECT/EXAMINE parameter list "(CONDSTORE)" or
+ * "(QRESYNC (uidvalidity modseq [known-uids]))". *pmodseq stays 0
+ * unless the client asked for a quick resynchronization.
+ */
+static BOOL imap_cmd_parser_parse_select_param(IMAP_CONTEXT *pcontext,
+	char *string, unsigned long *puidvalid, uint64_t *pmodseq,
+	char *known_uids, size_t size)
+{
+	int i;
+	size_t len;
+	char *pend;
+	int temp_argc;
+	int temp_argc1;
+	char *temp_argv[8];
+	char *temp_argv1[8];
+	
+	*pmodseq = 0;
+	known_uids[0] = '\0';
+	if ('(' != string[0] || ')' != string[strlen(string) - 1]) {
+		return FALSE;
+	}
+	temp_argc = parse_imap_args(string + 1, strlen(string) - 2,
+	            temp_argv, GX_ARRAY_SIZE(temp_argv));
+	if (temp_argc < 1) {
+		return FALSE;
+	}
+	for (i=0; i<temp_argc; i++) {
+		if (0 == strcasecmp(temp_argv[i], "CONDSTORE")) {
+			pcontext->b_condstore = TRUE;
+			continue;
+		}
+		/* QRESYNC is only permitted after "ENABLE QRESYNC" */
+		if (0 != strcasecmp(temp_argv[i], "QRESYNC") ||
+			FALSE == pcontext->b_qresync || i + 1 >= temp_argc) {
+			return FALSE;
+		}
+		i ++;
+		len = strlen(temp_argv[i]);
+		if (len < 2 || '(' != temp_argv[i][0] ||
+			')' != temp_argv[i][len - 1]) {
+			return FALSE;
+		}
+		temp_argc1 = parse_imap_args(temp_argv[i] + 1, len - 2,
+		             temp_argv1, GX_ARRAY_SIZE(temp_argv1));
+		if (temp_argc1 < 2 || temp_argc1 > 4) {
+			return FALSE;
+		}
+		*puidvalid = strtoul(temp_argv1[0], &pend, 10);
+		if ('\0' != *pend) {
+			return FALSE;
+		}
+		*pmodseq = strtoull(temp_argv1[1], &pend, 10);
+		if ('\0' != *pend || 0 == *pmodseq) {
+			return FALSE;
+		}
+		/* an oversized known-uids set is dropped, reporting more is legal */
+		if (temp_argc1 > 2 && '(' != temp_argv1[2][0] &&
+			strlen(temp_argv1[2]) < size) {
+			strcpy(known_uids, temp_argv1[2]);
+		}
 	}
+	return TRUE;
+}
+
+/*
+ * write "* VANISHED (EARLIER) uid-set" for UIDs expunged after modseq, one
+ * response per page handed out by midb. *pb_full is set if midb no longer
+ * remembers that far back; the sets then hold every UID that is gone.
+ * Returns 0, or the code to fail the command with.
+ */
+static int imap_cmd_parser_echo_vanished(IMAP_CONTEXT *pcontext,
+	uint64_t modseq, const char *uid_set, BOOL *pb_full)
+{
+	int errnum;
+	int set_len;
+	BOOL b_full;
+	uint32_t last;
+	uint32_t after_uid = 0;
+	char buff[MIDB_VNSH_PAGE_SIZE + 64];
+	static constexpr char prefix[] = "* VANISHED (EARLIER) ";
+	constexpr size_t prefix_len = sizeof(prefix) - 1;
+	
+	*pb_full = FALSE;
+	memcpy(buff, prefix, prefix_len);
+	do {
+		set_len = sizeof(buff) - prefix_len - 2;
+		switch (system_services_list_vanished(pcontext->maildir,
+		        pcontext->selected_folder, modseq, after_uid, uid_set,
+		        buff + prefix_len, &set_len, &b_full, &last, &errnum)) {
+		case MIDB_RESULT_OK:
+			break;
+		case MIDB_NO_SERVER:
+			return 1905;
+		case MIDB_RDWR_ERROR:
+			return 1906;
+		default:
+			return errnum | DISPATCH_MIDB;
+		}
+		if (TRUE == b_full) {
+			*pb_full = TRUE;
+		}
+		if (set_len > 0) {
+			memcpy(buff + prefix_len + set_len, "\r\n", 2);
+			stream_write(&pcontext->stream, buff, prefix_len + set_len + 2);
+		}
+		after_uid = last;
+	} while (0 != after_uid);
+	return 0;
+}
+
+/*
+ * QRESYNC part of SELECT/EXAMINE: report expunged UIDs and the messages
+ * whose flags changed after the modseq the client remembers. If midb can
+ * no longer tell what changed since then, every message is reported.
+ * Returns 0, or the code to fail the command with.
+ */
+static int imap_cmd_parser_qresync(IMAP_CONTEXT *pcontext,
+	uint64_t modseq, const char *known_uids)
+{
+	int errnum;
+	BOOL b_full;
+	XARRAY xarray;
+	char buff[1024];
+	int string_length;
+	DOUBLE_LIST list_seq;
+	char flags_string[128];
+	SEQUENCE_NODE sequence_node;
+	
+	auto ret = imap_cmd_parser_echo_vanished(pcontext, modseq,
+	           '\0' == known_uids[0] ? nullptr : known_uids, &b_full);
+	if (0 != ret) {
+		return ret;
+	}
+	if (TRUE == b_full) {
+		modseq = 0;
+	}
+	double_list_init(&list_seq);
+	sequence_node.node.pdata = &sequence_node;
+	sequence_node.min = 1;
+	sequence_node.max = -1;
+	double_list_append_as_tail(&list_seq, &sequence_node.node);
+	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
+	/* midb only returns the messages changed after @modseq */
+	switch (system_services_fetch_simple_uid(pcontext->maildir,
+	        pcontext->selected_folder, &list_seq, &xarray, modseq, &errnum)) {
+	case MIDB_RESULT_OK:
+		ret = 0;
+		break;
+	case MIDB_NO_SERVER:
+		ret = 1905;
+		break;
+	case MIDB_RDWR_ERROR:
+		ret = 1906;
+		break;
+	default:
+		ret = errnum | DISPATCH_MIDB;
+		break;
+	}
+	auto num = 0 == ret ? xarray_get_capacity(&xarray) : 0;
+	for (size_t i = 0; i < num; ++i) {
+		auto pitem = static_cast<MITEM *>(xarray_get_item(&xarray, i));
+		imap_cmd_parser_convert_flags_string(
+			pitem->flag_bits, flags_string);
+		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"* %d FETCH (UID %d FLAGS %s MODSEQ (%llu))\r\n",
+			pitem->id, pitem->uid, flags_string,
+			LLU(pitem->modseq));
+		stream_write(&pcontext->stream, buff, string_length);
+	}
+	xarray_free(&xarray);
+	double_list_free(&list_seq);
+	return ret;
 }
 
 static BOOL imap_cmd_parser_convert_imaptime(const char *str_time, time_t *ptime)
@@ -1416,7 +1671,8 @@ int imap_cmd_parser_capability(int argc, char **argv, IMAP_CONTEXT *pcontext)
 		HX_strlcat(ext_str, " ID", GX_ARRAY_SIZE(ext_str));
 	string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
 	                "* CAPABILITY IMAP4rev1 XLIST SPECIAL-USE "
-	                "UNSELECT UIDPLUS IDLE AUTH=LOGIN%s\r\n%s %s",
+	                "UNSELECT UIDPLUS IDLE AUTH=LOGIN ENABLE CONDSTORE "
+	                "QRESYNC%s\r\n%s %s",
 	                ext_str, argv[0], imap_reply_str);
 	imap_parser_safe_write(pcontext, buff, string_length);
 	return DISPATCH_CONTINUE;
@@ -1658,6 +1914,46 @@ int imap_cmd_parser_idle(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	return 1602;
 }
 
+int imap_cmd_parser_enable(int argc, char **argv, IMAP_CONTEXT *pcontext)
+{
+	int i;
+	char buff[1024];
+	size_t string_length = 0;
+	
+	if (pcontext->proto_stat < PROTO_STAT_AUTH) {
+		return 1804;
+	}
+	if (argc < 3) {
+		return 1800;
+	}
+	/* IMAP_CODE_2170031: OK ENABLE completed */
+	auto imap_reply_str = resource_get_imap_code(1731, 1, &string_length);
+	string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "* ENABLED");
+	/* unknown extensions are ignored as required by RFC 5161 */
+	for (i=2; i<argc; i++) {
+		if (0 == strcasecmp(argv[i], "CONDSTORE")) {
+			if (FALSE == pcontext->b_condstore) {
+				pcontext->b_condstore = TRUE;
+				string_length += gx_snprintf(buff + string_length,
+				                 GX_ARRAY_SIZE(buff) - string_length, " CONDSTORE");
+			}
+		} else if (0 == strcasecmp(argv[i], "QRESYNC")) {
+			/* QRESYNC implies CONDSTORE */
+			pcontext->b_condstore = TRUE;
+			if (FALSE == pcontext->b_qresync) {
+				pcontext->b_qresync = TRUE;
+				string_length += gx_snprintf(buff + string_length,
+				                 GX_ARRAY_SIZE(buff) - string_length, " QRESYNC");
+			}
+		}
+	}
+	string_length += gx_snprintf(buff + string_length,
+	                 GX_ARRAY_SIZE(buff) - string_length, "\r\n%s %s",
+	                 argv[0], imap_reply_str);
+	imap_parser_safe_write(pcontext, buff, string_length);
+	return DISPATCH_CONTINUE;
+}
+
 int imap_cmd_parser_select(int argc, char **argv, IMAP_CONTEXT *pcontext)
 {
 	int errnum;
@@ -1666,7 +1962,11 @@ int imap_cmd_parser_select(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	unsigned int uidnext;
 	unsigned long uidvalid;
 	int firstunseen;
+	uint64_t qr_modseq;
+	uint64_t highest_modseq;
+	unsigned long qr_uidvalid = 0;
 	size_t string_length = 0;
+	char known_uids[1024];
 	char temp_name[1024];
 	char buff[1024];
     
@@ -1678,14 +1978,27 @@ int imap_cmd_parser_select(int argc, char **argv, IMAP_CONTEXT *pcontext)
 		argv[2], temp_name)) {
 		return 1800;
 	}
+	qr_modseq = 0;
+	if (argc > 3 && (argc > 4 || FALSE ==
+		imap_cmd_parser_parse_select_param(pcontext, argv[3],
+		&qr_uidvalid, &qr_modseq, known_uids, sizeof(known_uids)))) {
+		return 1800;
+	}
 	if (PROTO_STAT_SELECT == pcontext->proto_stat) {
 		imap_parser_remove_select(pcontext);
 		pcontext->proto_stat = PROTO_STAT_AUTH;
 		pcontext->selected_folder[0] = '\0';
+		/* RFC 7162 3.2.11 */
+		if (TRUE == pcontext->b_qresync) {
+			string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			                "* OK [CLOSED] previous mailbox closed\r\n");
+			imap_parser_safe_write(pcontext, buff, string_length);
+		}
 	}
 	
 	switch (system_services_summary_folder(pcontext->maildir, temp_name,
-	        &exists, &recent, nullptr, &uidvalid, &uidnext, &firstunseen, &errnum)) {
+	        &exists, &recent, nullptr, &uidvalid, &uidnext, &firstunseen,
+	        &highest_modseq, &errnum)) {
 	case MIDB_RESULT_OK:
 		break;
 	case MIDB_NO_SERVER: {
@@ -1710,10 +2023,9 @@ int imap_cmd_parser_select(int argc, char **argv, IMAP_CONTEXT *pcontext)
 			"* %d RECENT\r\n"
 			"* OK [UNSEEN %d] message %d is first unseen\r\n"
 			"* OK [UIDVALIDITY %u] UIDs valid\r\n"
-			"* OK [UIDNEXT %d] predicted next UID\r\n"
-			"%s OK [READ-WRITE] SELECT completed\r\n", 
+			"* OK [UIDNEXT %d] predicted next UID\r\n", 
 			exists, recent, firstunseen, firstunseen,
-			(unsigned int)uidvalid, uidnext, argv[0]);
+			(unsigned int)uidvalid, uidnext);
 	} else {
 		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
 			"* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n"
@@ -1721,12 +2033,38 @@ int imap_cmd_parser_select(int argc, char **argv, IMAP_CONTEXT *pcontext)
 			"* %d EXISTS\r\n"
 			"* %d RECENT\r\n"
 			"* OK [UIDVALIDITY %u] UIDs valid\r\n"
-			"* OK [UIDNEXT %d] predicted next UID\r\n"
-			"%s OK [READ-WRITE] SELECT completed\r\n", 
-			exists, recent, (unsigned int)uidvalid, uidnext, argv[0]);
+			"* OK [UIDNEXT %d] predicted next UID\r\n", 
+			exists, recent, (unsigned int)uidvalid, uidnext);
 	}
-	imap_parser_safe_write(pcontext, buff, string_length);
-	return DISPATCH_CONTINUE;
+	string_length += gx_snprintf(buff + string_length,
+	                 GX_ARRAY_SIZE(buff) - string_length,
+	                 "* OK [HIGHESTMODSEQ %llu] modseq tracked\r\n",
+	                 LLU(highest_modseq));
+	if (0 == qr_modseq || qr_uidvalid != static_cast<unsigned int>(uidvalid)) {
+		string_length += gx_snprintf(buff + string_length,
+		                 GX_ARRAY_SIZE(buff) - string_length,
+		                 "%s OK [READ-WRITE] SELECT completed\r\n", argv[0]);
+		imap_parser_safe_write(pcontext, buff, string_length);
+		return DISPATCH_CONTINUE;
+	}
+	stream_clear(&pcontext->stream);
+	stream_write(&pcontext->stream, buff, string_length);
+	auto ret = imap_cmd_parser_qresync(pcontext, qr_modseq, known_uids);
+	if (0 != ret) {
+		/* a failed SELECT leaves no mailbox selected */
+		stream_clear(&pcontext->stream);
+		imap_parser_remove_select(pcontext);
+		pcontext->proto_stat = PROTO_STAT_AUTH;
+		pcontext->selected_folder[0] = '\0';
+		return ret;
+	}
+	string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+	                "%s OK [READ-WRITE] SELECT completed\r\n", argv[0]);
+	stream_write(&pcontext->stream, buff, string_length);
+	pcontext->write_length = 0;
+	pcontext->write_offset = 0;
+	pcontext->sched_stat = SCHED_STAT_WRLST;
+	return DISPATCH_BREAK;
 }
 
 int imap_cmd_parser_examine(int argc, char **argv, IMAP_CONTEXT *pcontext)
@@ -1737,7 +2075,11 @@ int imap_cmd_parser_examine(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	unsigned int uidnext;
 	unsigned long uidvalid;
 	int firstunseen;
+	uint64_t qr_modseq;
+	uint64_t highest_modseq;
+	unsigned long qr_uidvalid = 0;
 	size_t string_length = 0;
+	char known_uids[1024];
 	char temp_name[1024];
 	char buff[1024];
     
@@ -1749,13 +2091,26 @@ int imap_cmd_parser_examine(int argc, char **argv, IMAP_CONTEXT *pcontext)
 		argv[2], temp_name)) {
 		return 1800;
 	}
+	qr_modseq = 0;
+	if (argc > 3 && (argc > 4 || FALSE ==
+		imap_cmd_parser_parse_select_param(pcontext, argv[3],
+		&qr_uidvalid, &qr_modseq, known_uids, sizeof(known_uids)))) {
+		return 1800;
+	}
 	if (PROTO_STAT_SELECT == pcontext->proto_stat) {
 		imap_parser_remove_select(pcontext);
 		pcontext->proto_stat = PROTO_STAT_AUTH;
 		pcontext->selected_folder[0] = '\0';
+		/* RFC 7162 3.2.11 */
+		if (TRUE == pcontext->b_qresync) {
+			string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			                "* OK [CLOSED] previous mailbox closed\r\n");
+			imap_parser_safe_write(pcontext, buff, string_length);
+		}
 	}
 	switch (system_services_summary_folder(pcontext->maildir, temp_name,
-	        &exists, &recent, nullptr, &uidvalid, &uidnext, &firstunseen, &errnum)) {
+	        &exists, &recent, nullptr, &uidvalid, &uidnext, &firstunseen,
+	        &highest_modseq, &errnum)) {
 	case MIDB_RESULT_OK:
 		break;
 	case MIDB_NO_SERVER: {
@@ -1780,10 +2135,9 @@ int imap_cmd_parser_examine(int argc, char **argv, IMAP_CONTEXT *pcontext)
 			"* %d RECENT\r\n"
 			"* OK [UNSEEN %d] message %d is first unseen\r\n"
 			"* OK [UIDVALIDITY %u] UIDs valid\r\n"
-			"* OK [UIDNEXT %d] predicted next UID\r\n"
-			"%s OK [READ-ONLY] EXAMINE completed\r\n",
+			"* OK [UIDNEXT %d] predicted next UID\r\n",
 			exists, recent, firstunseen, firstunseen,
-			(unsigned int)uidvalid, uidnext, argv[0]);
+			(unsigned int)uidvalid, uidnext);
 	} else {
 		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
 			"* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n"
@@ -1791,12 +2145,38 @@ int imap_cmd_parser_examine(int argc, char **argv, IMAP_CONTEXT *pcontext)
 			"* %d EXISTS\r\n"
 			"* %d RECENT\r\n"
 			"* OK [UIDVALIDITY %u] UIDs valid\r\n"
-			"* OK [UIDNEXT %d] predicted next UID\r\n"
-			"%s OK [READ-ONLY] EXAMINE completed\r\n",
-			exists, recent, (unsigned int)uidvalid, uidnext, argv[0]);
+			"* OK [UIDNEXT %d] predicted next UID\r\n",
+			exists, recent, (unsigned int)uidvalid, uidnext);
 	}
-	imap_parser_safe_write(pcontext, buff, string_length);
-	return DISPATCH_CONTINUE;
+	string_length += gx_snprintf(buff + string_length,
+	                 GX_ARRAY_SIZE(buff) - string_length,
+	                 "* OK [HIGHESTMODSEQ %llu] modseq tracked\r\n",
+	                 LLU(highest_modseq));
+	if (0 == qr_modseq || qr_uidvalid != static_cast<unsigned int>(uidvalid)) {
+		string_length += gx_snprintf(buff + string_length,
+		                 GX_ARRAY_SIZE(buff) - string_length,
+		                 "%s OK [READ-ONLY] EXAMINE completed\r\n", argv[0]);
+		imap_parser_safe_write(pcontext, buff, string_length);
+		return DISPATCH_CONTINUE;
+	}
+	stream_clear(&pcontext->stream);
+	stream_write(&pcontext->stream, buff, string_length);
+	auto ret = imap_cmd_parser_qresync(pcontext, qr_modseq, known_uids);
+	if (0 != ret) {
+		/* a failed SELECT leaves no mailbox selected */
+		stream_clear(&pcontext->stream);
+		imap_parser_remove_select(pcontext);
+		pcontext->proto_stat = PROTO_STAT_AUTH;
+		pcontext->selected_folder[0] = '\0';
+		return ret;
+	}
+	string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+	                "%s OK [READ-ONLY] EXAMINE completed\r\n", argv[0]);
+	stream_write(&pcontext->stream, buff, string_length);
+	pcontext->write_length = 0;
+	pcontext->write_offset = 0;
+	pcontext->sched_stat = SCHED_STAT_WRLST;
+	return DISPATCH_BREAK;
 }
 
 int imap_cmd_parser_create(int argc, char **argv, IMAP_CONTEXT *pcontext)
@@ -2411,6 +2791,7 @@ int imap_cmd_parser_status(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	int unseen;
 	unsigned int uidnext;
 	BOOL b_first;
+	uint64_t highest_modseq;
 	unsigned long uidvalid;
 	int temp_argc;
 	char buff[1024];
@@ -2434,7 +2815,7 @@ int imap_cmd_parser_status(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	switch (system_services_summary_folder(
 		pcontext->maildir, temp_name, &exists, &recent,
-	        &unseen, &uidvalid, &uidnext, nullptr, &errnum)) {
+	        &unseen, &uidvalid, &uidnext, nullptr, &highest_modseq, &errnum)) {
 	case MIDB_RESULT_OK:
 		break;
 	case MIDB_NO_SERVER: {
@@ -2474,6 +2855,10 @@ int imap_cmd_parser_status(int argc, char **argv, IMAP_CONTEXT *pcontext)
 		} else if (0 == strcasecmp(temp_argv[i], "UNSEEN")) {
 			string_length += gx_snprintf(buff + string_length,
 			                 GX_ARRAY_SIZE(buff) - string_length, "UNSEEN %d", unseen);
+		} else if (0 == strcasecmp(temp_argv[i], "HIGHESTMODSEQ")) {
+			string_length += gx_snprintf(buff + string_length,
+			                 GX_ARRAY_SIZE(buff) - string_length, "HIGHESTMODSEQ %llu",
+			                 LLU(highest_modseq));
 		} else {
 			return 1800;
 		}
@@ -2627,7 +3012,7 @@ int imap_cmd_parser_append(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	for (i=0; i<10; i++) {
 		if (system_services_summary_folder(pcontext->maildir,
 		    temp_name, nullptr, nullptr, nullptr, &uidvalid, nullptr,
-		    nullptr, &errnum) == MIDB_RESULT_OK &&
+		    nullptr, nullptr, &errnum) == MIDB_RESULT_OK &&
 		    system_services_get_uid(pcontext->maildir, temp_name,
 		    mid_string.c_str(), &uid) == MIDB_RESULT_OK) {
 			string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
@@ -2904,7 +3289,7 @@ static int imap_cmd_parser_append_end2(int argc, char **argv, IMAP_CONTEXT *pcon
 	for (i=0; i<10; i++) {
 		if (system_services_summary_folder(pcontext->maildir,
 		    temp_name, nullptr, nullptr, nullptr, &uidvalid,
-		    nullptr, nullptr, &errnum) == MIDB_RESULT_OK &&
+		    nullptr, nullptr, nullptr, &errnum) == MIDB_RESULT_OK &&
 		    system_services_get_uid(pcontext->maildir, temp_name,
 		    pcontext->mid.c_str(), &uid) == MIDB_RESULT_OK) {
 			string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "%s %s [APPENDUID %u %d] %s",
@@ -3007,8 +3392,13 @@ int imap_cmd_parser_expunge(int argc, char **argv, IMAP_CONTEXT *pcontext)
 			auto eml_path = std::string(pcontext->maildir) + "/eml/" + pitem->mid;
 			remove(eml_path.c_str());
 			imap_parser_log_info(pcontext, 8, "message %s has been deleted", eml_path.c_str());
-			string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-				"* %d EXPUNGE\r\n", pitem->id - del_num);
+			if (TRUE == pcontext->b_qresync) {
+				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+					"* VANISHED %d\r\n", pitem->uid);
+			} else {
+				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+					"* %d EXPUNGE\r\n", pitem->id - del_num);
+			}
 			stream_write(&pcontext->stream, buff, string_length);
 			b_deleted = TRUE;
 			del_num ++;
@@ -3106,6 +3496,58 @@ int imap_cmd_parser_search(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	return DISPATCH_BREAK;
 }
 
+/*
+ * FETCH/UID FETCH with CHANGEDSINCE and items that need the message digests:
+ * the changed messages are looked up first by their modseq, and only their
+ * digests are loaded then, in batches of UID ranges.
+ */
+static int imap_cmd_parser_fetch_changed(IMAP_CONTEXT *pcontext,
+	DOUBLE_LIST *plist, BOOL b_uid, uint64_t changedsince,
+	XARRAY *pxarray, int *perrno)
+{
+	size_t count;
+	XARRAY xarray;
+	DOUBLE_LIST list_seq;
+	SEQUENCE_NODE sequence_nodes[1024];
+	
+	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
+	auto result = TRUE == b_uid ?
+	              system_services_fetch_simple_uid(pcontext->maildir,
+	              pcontext->selected_folder, plist, &xarray, changedsince, perrno) :
+	              system_services_fetch_simple(pcontext->maildir,
+	              pcontext->selected_folder, plist, &xarray, changedsince, perrno);
+	auto num = MIDB_RESULT_OK == result ? xarray_get_capacity(&xarray) : 0;
+	count = 0;
+	double_list_init(&list_seq);
+	for (size_t i = 0; i < num && MIDB_RESULT_OK == result; ++i) {
+		auto pitem = static_cast<MITEM *>(xarray_get_item(&xarray, i));
+		auto ptail = double_list_get_tail(&list_seq);
+		if (NULL != ptail && static_cast<SEQUENCE_NODE *>(
+		    ptail->pdata)->max + 1 == pitem->uid) {
+			static_cast<SEQUENCE_NODE *>(ptail->pdata)->max = pitem->uid;
+		} else {
+			sequence_nodes[count].node.pdata = &sequence_nodes[count];
+			sequence_nodes[count].min = pitem->uid;
+			sequence_nodes[count].max = pitem->uid;
+			double_list_append_as_tail(&list_seq, &sequence_nodes[count].node);
+			count ++;
+		}
+		if (i + 1 < num && count < GX_ARRAY_SIZE(sequence_nodes)) {
+			continue;
+		}
+		result = system_services_fetch_detail_uid(pcontext->maildir,
+		         pcontext->selected_folder, &list_seq, pxarray, perrno);
+		double_list_init(&list_seq);
+		count = 0;
+	}
+	double_list_free(&list_seq);
+	xarray_free(&xarray);
+	if (MIDB_RESULT_OK != result) {
+		system_services_free_result(pxarray);
+	}
+	return result;
+}
+
 int imap_cmd_parser_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 {
 	int errnum;
@@ -3114,6 +3556,8 @@ int imap_cmd_parser_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	BOOL b_data;
 	MITEM *pitem;
 	BOOL b_detail;
+	BOOL b_vanished;
+	uint64_t changedsince;
 	XARRAY xarray;
 	char buff[1024];
 	size_t string_length = 0;
@@ -3134,13 +3578,30 @@ int imap_cmd_parser_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 		tmp_argv, sizeof(tmp_argv)/sizeof(char*))) {
 		goto FETCH_PARAM_ERR;
 	}
+	/* VANISHED is only meaningful for UID FETCH */
+	if (argc > 4 && (argc > 5 || FALSE ==
+		imap_cmd_parser_parse_fetch_modifier(argv[4],
+		&changedsince, &b_vanished) || TRUE == b_vanished)) {
+		goto FETCH_PARAM_ERR;
+	}
+	if (argc > 4) {
+		pcontext->b_condstore = TRUE;
+	}
+	if (TRUE == pcontext->b_condstore) {
+		imap_cmd_parser_append_modseq(&list_data,
+			&nodes[1022], argc > 4 ? TRUE : FALSE);
+	}
 	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
-	if (TRUE == b_detail) {
+	if (argc > 4 && 0 != changedsince && TRUE == b_detail) {
+		result = imap_cmd_parser_fetch_changed(pcontext, &list_seq,
+		         FALSE, changedsince, &xarray, &errnum);
+	} else if (TRUE == b_detail) {
 		result = system_services_fetch_detail(pcontext->maildir,
 		         pcontext->selected_folder, &list_seq, &xarray, &errnum);
 	} else {
 		result = system_services_fetch_simple(pcontext->maildir,
-		         pcontext->selected_folder, &list_seq, &xarray, &errnum);
+		         pcontext->selected_folder, &list_seq, &xarray,
+		         argc > 4 ? changedsince : 0, &errnum);
 	}
 	switch(result) {
 	case MIDB_RESULT_OK:
@@ -3162,6 +3623,9 @@ int imap_cmd_parser_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	num = xarray_get_capacity(&xarray);
 	for (i=0; i<num; i++) {
 		pitem = (MITEM*)xarray_get_item(&xarray, i);
+		if (argc > 4 && pitem->modseq <= changedsince) {
+			continue;
+		}
 		imap_cmd_parser_process_fetch_item(pcontext,
 			b_data, pitem, pitem->id, &list_data);
 	}
@@ -3190,6 +3654,31 @@ int imap_cmd_parser_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	return 1800;
 }
 
+/*
+ * Add @num to the sequence set @set, joining it to the last range when it
+ * follows @*plast (the number added before, 0 for none).
+ */
+static BOOL imap_cmd_parser_seq_add(std::string &set,
+	unsigned int *plast, unsigned int num) try
+{
+	if (0 != *plast && num == *plast + 1) {
+		auto pos = set.find_last_of(",:");
+		if (std::string::npos != pos && ':' == set[pos]) {
+			set.erase(pos + 1);
+		} else {
+			set += ':';
+		}
+	} else if (!set.empty()) {
+		set += ',';
+	}
+	set += std::to_string(num);
+	*plast = num;
+	return TRUE;
+} catch (const std::bad_alloc &) {
+	fprintf(stderr, "E-1519: ENOMEM\n");
+	return FALSE;
+}
+
 int imap_cmd_parser_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 {
 	int errnum;
@@ -3200,12 +3689,27 @@ int imap_cmd_parser_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	int flag_bits;
 	int temp_argc;
 	char *temp_argv[8];
+	std::string modified;
+	uint64_t unchangedsince;
+	unsigned int modified_last = 0;
 	DOUBLE_LIST list_seq;
 	SEQUENCE_NODE sequence_nodes[1024];
 
 	if (PROTO_STAT_SELECT != pcontext->proto_stat) {
 		return 1805;
 	}
+	unchangedsince = UINT64_MAX;
+	if (argc > 3 && '(' == argv[3][0]) {
+		if (FALSE == imap_cmd_parser_parse_store_modifier(
+			argv[3], &unchangedsince)) {
+			return 1800;
+		}
+		pcontext->b_condstore = TRUE;
+		for (i=3; i<argc-1; i++) {
+			argv[i] = argv[i + 1];
+		}
+		argc --;
+	}
 	if (argc < 5 || !imap_cmd_parser_parse_sequence(&list_seq,
 	    sequence_nodes, argv[2]) || (0 != strcasecmp(argv[3],
 		"FLAGS") && 0 != strcasecmp(argv[3], "FLAGS.SILENT") &&
@@ -3245,7 +3749,7 @@ int imap_cmd_parser_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
 	result = system_services_fetch_simple(pcontext->maildir,
-	         pcontext->selected_folder, &list_seq, &xarray, &errnum);
+	         pcontext->selected_folder, &list_seq, &xarray, 0, &errnum);
 	switch(result) {
 	case MIDB_RESULT_OK:
 		break;
@@ -3265,12 +3769,31 @@ int imap_cmd_parser_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	num = xarray_get_capacity(&xarray);
 	for (i=0; i<num; i++) {
 		pitem = (MITEM*)xarray_get_item(&xarray, i);
+		if (pitem->modseq > unchangedsince) {
+			if (FALSE == imap_cmd_parser_seq_add(modified,
+			    &modified_last, pitem->id)) {
+				xarray_free(&xarray);
+				return 1918;
+			}
+			continue;
+		}
 		imap_cmd_parser_store_flags(argv[3], pitem->mid,
 			pitem->id, 0, flag_bits, pcontext);
 		imap_parser_modify_flags(pcontext, pitem->mid);
 	}
 	xarray_free(&xarray);
 	imap_parser_echo_modify(pcontext, NULL);
+	if (!modified.empty()) {
+		char buff[1024];
+		auto string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"%s OK [MODIFIED ", argv[0]);
+		imap_parser_safe_write(pcontext, buff, string_length);
+		imap_parser_safe_write(pcontext, modified.c_str(), modified.size());
+		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"] conditional STORE failed\r\n");
+		imap_parser_safe_write(pcontext, buff, string_length);
+		return DISPATCH_CONTINUE;
+	}
 	return 1721;
 }
 
@@ -3305,7 +3828,7 @@ int imap_cmd_parser_copy(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
 	result = system_services_fetch_simple(pcontext->maildir,
-	         pcontext->selected_folder, &list_seq, &xarray, &errnum);
+	         pcontext->selected_folder, &list_seq, &xarray, 0, &errnum);
 	switch(result) {
 	case MIDB_RESULT_OK:
 		break;
@@ -3324,7 +3847,7 @@ int imap_cmd_parser_copy(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	if (system_services_summary_folder(pcontext->maildir,
 	    temp_name, nullptr, nullptr, nullptr, &uidvalidity, nullptr,
-	    nullptr, &errnum) != MIDB_RESULT_OK)
+	    nullptr, nullptr, &errnum) != MIDB_RESULT_OK)
 		uidvalidity = 0;
 	b_copied = TRUE;
 	b_first = FALSE;
@@ -3468,7 +3991,10 @@ int imap_cmd_parser_uid_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	MITEM *pitem;
 	XARRAY xarray;
 	BOOL b_detail;
+	BOOL b_vanished;
 	char buff[1024];
+	std::string uid_set;
+	uint64_t changedsince;
 	size_t string_length = 0;
 	char* tmp_argv[128];
 	DOUBLE_LIST list_seq;
@@ -3480,7 +4006,21 @@ int imap_cmd_parser_uid_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	if (PROTO_STAT_SELECT != pcontext->proto_stat) {
 		return 1805;
 	}
-	if (argc < 5 || !imap_cmd_parser_parse_sequence(&list_seq,
+	b_vanished = FALSE;
+	if (argc < 5 || (argc > 5 && (argc > 6 || FALSE ==
+		imap_cmd_parser_parse_fetch_modifier(argv[5],
+		&changedsince, &b_vanished) || (TRUE == b_vanished &&
+		FALSE == pcontext->b_qresync)))) {
+		goto UID_FETCH_PARAM_ERR;
+	}
+	/* parse_sequence destroys the set, keep it for VANISHED */
+	if (TRUE == b_vanished) try {
+		uid_set = argv[3];
+	} catch (const std::bad_alloc &) {
+		fprintf(stderr, "E-1517: ENOMEM\n");
+		return 1918;
+	}
+	if (!imap_cmd_parser_parse_sequence(&list_seq,
 	    sequence_nodes, argv[3]))
 		goto UID_FETCH_PARAM_ERR;
 	if (FALSE == imap_cmd_parser_parse_fetch_args(
@@ -3498,34 +4038,64 @@ int imap_cmd_parser_uid_fetch(int argc, char **argv, IMAP_CONTEXT *pcontext)
 		nodes[1023].pdata = deconst("UID");
 		double_list_insert_as_head(&list_data, &nodes[1023]);
 	}
+	if (argc > 5) {
+		pcontext->b_condstore = TRUE;
+	}
+	if (TRUE == pcontext->b_condstore) {
+		imap_cmd_parser_append_modseq(&list_data,
+			&nodes[1022], argc > 5 ? TRUE : FALSE);
+	}
+	stream_clear(&pcontext->stream);
+	if (TRUE == b_vanished) {
+		BOOL b_full;
+		result = imap_cmd_parser_echo_vanished(pcontext,
+		         changedsince, uid_set.c_str(), &b_full);
+		if (0 != result) {
+			stream_clear(&pcontext->stream);
+			return result;
+		}
+		/* too old to tell what changed: report everything */
+		if (TRUE == b_full) {
+			changedsince = 0;
+		}
+	}
 	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
-	if (TRUE == b_detail) {
+	if (argc > 5 && 0 != changedsince && TRUE == b_detail) {
+		result = imap_cmd_parser_fetch_changed(pcontext, &list_seq,
+		         TRUE, changedsince, &xarray, &errnum);
+	} else if (TRUE == b_detail) {
 		result = system_services_fetch_detail_uid(pcontext->maildir,
 		         pcontext->selected_folder, &list_seq, &xarray, &errnum);
 	} else {
 		result = system_services_fetch_simple_uid(pcontext->maildir,
-		         pcontext->selected_folder, &list_seq, &xarray, &errnum);
+		         pcontext->selected_folder, &list_seq, &xarray,
+		         argc > 5 ? changedsince : 0, &errnum);
 	}
 	switch(result) {
 	case MIDB_RESULT_OK:
 		break;
 	case MIDB_NO_SERVER: {
+		stream_clear(&pcontext->stream);
 		xarray_free(&xarray);
 		return 1905;
 	}
 	case MIDB_RDWR_ERROR: {
+		stream_clear(&pcontext->stream);
 		xarray_free(&xarray);
 		return 1906;
 	}
 	default: {
+		stream_clear(&pcontext->stream);
 		xarray_free(&xarray);
 		return errnum | DISPATCH_MIDB;
 	}
 	}
-	stream_clear(&pcontext->stream);
 	num = xarray_get_capacity(&xarray);
 	for (i=0; i<num; i++) {
 		pitem = (MITEM*)xarray_get_item(&xarray, i);
+		if (argc > 5 && pitem->modseq <= changedsince) {
+			continue;
+		}
 		imap_cmd_parser_process_fetch_item(pcontext,
 			b_data, pitem, pitem->id, &list_data);
 	}
@@ -3566,12 +4136,27 @@ int imap_cmd_parser_uid_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	int flag_bits;
 	int temp_argc;
 	char *temp_argv[8];
+	std::string modified;
+	uint64_t unchangedsince;
+	unsigned int modified_last = 0;
 	DOUBLE_LIST list_seq;
 	SEQUENCE_NODE sequence_nodes[1024];
 
 	if (PROTO_STAT_SELECT != pcontext->proto_stat) {
 		return 1805;
 	}
+	unchangedsince = UINT64_MAX;
+	if (argc > 4 && '(' == argv[4][0]) {
+		if (FALSE == imap_cmd_parser_parse_store_modifier(
+			argv[4], &unchangedsince)) {
+			return 1800;
+		}
+		pcontext->b_condstore = TRUE;
+		for (i=4; i<argc-1; i++) {
+			argv[i] = argv[i + 1];
+		}
+		argc --;
+	}
 	if (argc < 6 || !imap_cmd_parser_parse_sequence(&list_seq,
 	    sequence_nodes, argv[3]) || (0 != strcasecmp(argv[4],
 		"FLAGS") && 0 != strcasecmp(argv[4], "FLAGS.SILENT") &&
@@ -3611,7 +4196,7 @@ int imap_cmd_parser_uid_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
 	result = system_services_fetch_simple_uid(pcontext->maildir,
-	         pcontext->selected_folder, &list_seq, &xarray, &errnum);
+	         pcontext->selected_folder, &list_seq, &xarray, 0, &errnum);
 	switch(result) {
 	case MIDB_RESULT_OK:
 		break;
@@ -3631,12 +4216,31 @@ int imap_cmd_parser_uid_store(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	num = xarray_get_capacity(&xarray);
 	for (i=0; i<num; i++) {
 		pitem = (MITEM*)xarray_get_item(&xarray, i);
+		if (pitem->modseq > unchangedsince) {
+			if (FALSE == imap_cmd_parser_seq_add(modified,
+			    &modified_last, pitem->uid)) {
+				xarray_free(&xarray);
+				return 1918;
+			}
+			continue;
+		}
 		imap_cmd_parser_store_flags(argv[4], pitem->mid,
 			pitem->id, pitem->uid, flag_bits, pcontext);
 		imap_parser_modify_flags(pcontext, pitem->mid);
 	}
 	xarray_free(&xarray);
 	imap_parser_echo_modify(pcontext, NULL);
+	if (!modified.empty()) {
+		char buff[1024];
+		auto string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"%s OK [MODIFIED ", argv[0]);
+		imap_parser_safe_write(pcontext, buff, string_length);
+		imap_parser_safe_write(pcontext, modified.c_str(), modified.size());
+		string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+			"] conditional UID STORE failed\r\n");
+		imap_parser_safe_write(pcontext, buff, string_length);
+		return DISPATCH_CONTINUE;
+	}
 	return 1724;
 }
 
@@ -3670,7 +4274,7 @@ int imap_cmd_parser_uid_copy(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	xarray_init(&xarray, imap_parser_get_xpool(), sizeof(MITEM));
 	result = system_services_fetch_simple_uid(pcontext->maildir,
-	         pcontext->selected_folder, &list_seq, &xarray, &errnum);
+	         pcontext->selected_folder, &list_seq, &xarray, 0, &errnum);
 	switch(result) {
 	case MIDB_RESULT_OK:
 		break;
@@ -3689,7 +4293,7 @@ int imap_cmd_parser_uid_copy(int argc, char **argv, IMAP_CONTEXT *pcontext)
 	}
 	if (system_services_summary_folder(pcontext->maildir,
 	    temp_name, nullptr, nullptr, nullptr, &uidvalidity,
-	    nullptr, nullptr, &errnum) != MIDB_RESULT_OK)
+	    nullptr, nullptr, nullptr, &errnum) != MIDB_RESULT_OK)
 		uidvalidity = 0;
 	b_copied = TRUE;
 	b_first = FALSE;
@@ -3844,8 +4448,13 @@ int imap_cmd_parser_uid_expunge(int argc, char **argv, IMAP_CONTEXT *pcontext)
 			auto eml_path = std::string(pcontext->maildir) + "/eml/" + pitem->mid;
 			remove(eml_path.c_str());
 			imap_parser_log_info(pcontext, 8, "message %s has been deleted", eml_path.c_str());
-			string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
-				"* %d EXPUNGE\r\n", pitem->id - del_num);
+			if (TRUE == pcontext->b_qresync) {
+				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+					"* VANISHED %d\r\n", pitem->uid);
+			} else {
+				string_length = gx_snprintf(buff, GX_ARRAY_SIZE(buff),
+					"* %d EXPUNGE\r\n", pitem->id - del_num);
+			}
 			stream_write(&pcontext->stream, buff, string_length);
 			b_deleted = TRUE;
 			del_num ++;
@@ -24,6 +24,7 @@ int imap_cmd_parser_username(int argc, char **argv, IMAP_CONTEXT *pcontext);
 int imap_cmd_parser_password(int argc, char **argv, IMAP_CONTEXT *pcontext);
 int imap_cmd_parser_login(int argc, char **argv, IMAP_CONTEXT *pcontext);
 int imap_cmd_parser_idle(int argc, char **argv, IMAP_CONTEXT *pcontext);
+int imap_cmd_parser_enable(int argc, char **argv, IMAP_CONTEXT *pcontext);
 int imap_cmd_parser_select(int argc, char **argv, IMAP_CONTEXT *pcontext);
 int imap_cmd_parser_examine(int argc, char **argv, IMAP_CONTEXT *pcontext);
 int imap_cmd_parser_create(int argc, char **argv, IMAP_CONTEXT *pcontext);
@@ -46,8 +46,6 @@
 
 #define SLEEP_BEFORE_CLOSE		usleep(1000)
 
-#define FILENUM_PER_MIME		8
-
 #define SCAN_INTERVAL			3600
 
 #define SELECT_INTERVAL			20*60
@@ -232,7 +230,7 @@ int imap_parser_run()
 	if (num > 800) {
 		num = 800;
 	}
-	g_mime_pool = mime_pool_init(num, FILENUM_PER_MIME, TRUE);
+	g_mime_pool = mime_pool_init(num, TRUE);
 	if (NULL == g_mime_pool) {
 		printf("[imap_parser]: Failed to init MIME pool\n");
 		return -6;
@@ -466,7 +464,8 @@ static int ps_stat_notifying(IMAP_CONTEXT *pcontext)
 {
 	int exists = 0, recent = 0, err = 0;
 	if (MIDB_RESULT_OK == system_services_summary_folder(pcontext->maildir,
-	    pcontext->selected_folder, &exists, &recent, NULL, NULL, NULL, NULL, &err)) {
+	    pcontext->selected_folder, &exists, &recent, NULL, NULL, NULL, NULL,
+	    nullptr, &err)) {
 		char temp_buff[64];
 		auto len = gx_snprintf(temp_buff, GX_ARRAY_SIZE(temp_buff),
 		           "* %d RECENT\r\n"
@@ -1389,6 +1388,7 @@ void imap_parser_echo_modify(IMAP_CONTEXT *pcontext, STREAM *pstream)
 	int flag_bits;
 	BOOL b_first;
 	BOOL b_modify;
+	uint64_t modseq;
 	char buff[1024];
 	char mid_string[256];
 	MEM_FILE temp_file;
@@ -1403,7 +1403,7 @@ void imap_parser_echo_modify(IMAP_CONTEXT *pcontext, STREAM *pstream)
 	
 	if (TRUE == b_modify && MIDB_RESULT_OK == system_services_summary_folder(
 		pcontext->maildir, pcontext->selected_folder, &exists, &recent, 
-		NULL, NULL, NULL, NULL, &err)) {
+		NULL, NULL, NULL, NULL, nullptr, &err)) {
 		tmp_len = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "* %d RECENT\r\n"
 									   "* %d EXISTS\r\n",
 									   recent, exists);
@@ -1428,7 +1428,8 @@ void imap_parser_echo_modify(IMAP_CONTEXT *pcontext, STREAM *pstream)
 		    pcontext->selected_folder, mid_string,
 		    reinterpret_cast<unsigned int *>(&id)) == MIDB_RESULT_OK &&
 			MIDB_RESULT_OK == system_services_get_flags(pcontext->maildir,
-			pcontext->selected_folder, mid_string, &flag_bits, &err)) {
+			pcontext->selected_folder, mid_string, &flag_bits,
+			&modseq, &err)) {
 			tmp_len = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "* %d FETCH (FLAGS (", id);
 			b_first = FALSE;
 			if (flag_bits & FLAG_RECENT) {
@@ -1474,7 +1475,11 @@ void imap_parser_echo_modify(IMAP_CONTEXT *pcontext, STREAM *pstream)
 				}
 				tmp_len += gx_snprintf(buff + tmp_len, GX_ARRAY_SIZE(buff) - tmp_len, "\\Draft");
 			}
-			tmp_len += gx_snprintf(buff + tmp_len, GX_ARRAY_SIZE(buff) - tmp_len, "))\r\n");
+			tmp_len += gx_snprintf(buff + tmp_len, GX_ARRAY_SIZE(buff) - tmp_len, ")");
+			if (pcontext->b_condstore)
+				tmp_len += gx_snprintf(buff + tmp_len, GX_ARRAY_SIZE(buff) - tmp_len,
+				           " MODSEQ (%llu)", LLU(modseq));
+			tmp_len += gx_snprintf(buff + tmp_len, GX_ARRAY_SIZE(buff) - tmp_len, ")\r\n");
 			if (NULL == pstream) {
 				if (NULL != pcontext->connection.ssl) {
 					SSL_write(pcontext->connection.ssl, buff, tmp_len);
@@ -1582,6 +1587,8 @@ static int imap_parser_dispatch_cmd2(int argc, char **argv, IMAP_CONTEXT *pconte
         return imap_cmd_parser_select(argc, argv, pcontext);
 	} else if (0 == strcasecmp(argv[1], "IDLE")) {
         return imap_cmd_parser_idle(argc, argv, pcontext);
+	} else if (0 == strcasecmp(argv[1], "ENABLE")) {
+		return imap_cmd_parser_enable(argc, argv, pcontext);
     } else if (0 == strcasecmp(argv[1], "EXAMINE")) {
         return imap_cmd_parser_examine(argc, argv, pcontext);
     } else if (0 == strcasecmp(argv[1], "CREATE")) {
@@ -1684,6 +1691,8 @@ static void imap_parser_context_clear(IMAP_CONTEXT *pcontext)
 	pcontext->selected_time = 0;
 	pcontext->selected_folder[0] = '\0';
 	pcontext->b_readonly = FALSE;
+	pcontext->b_condstore = FALSE;
+	pcontext->b_qresync = FALSE;
 	pcontext->tag_string[0] = '\0';
 	pcontext->command_len = 0;
 	pcontext->command_buffer[0] = '\0';
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <ctime>
 #include <string>
 #include <sys/time.h>
@@ -79,6 +80,7 @@ struct MITEM {
 	int id;
 	int uid;
 	char flag_bits;
+	uint64_t modseq;
 	MEM_FILE f_digest;
 };
 
@@ -97,6 +99,7 @@ struct IMAP_CONTEXT final : public SCHEDULE_CONTEXT {
 	char selected_folder[1024]{};
 	BOOL b_readonly = false; /* is selected folder read only, this is for the examine command */
 	BOOL b_modify = false;
+	BOOL b_condstore = false, b_qresync = false; /* RFC 7162 extensions enabled by the client */
 	MEM_FILE f_flags{};
 	char tag_string[32]{};
 	int command_len = 0;
@@ -38,6 +38,7 @@ E(get_flags)
 E(copy_mail)
 E(search)
 E(search_uid)
+E(list_vanished)
 E(install_event_stub)
 E(broadcast_event)
 E(broadcast_select)
@@ -90,6 +91,7 @@ int system_services_run()
 	E(system_services_copy_mail, "copy_mail");
 	E(system_services_search, "imap_search");
 	E(system_services_search_uid, "imap_search_uid");
+	E(system_services_list_vanished, "list_vanished");
 	E(system_services_install_event_stub, "install_event_stub");
 	E(system_services_broadcast_event, "broadcast_event");
 	E(system_services_broadcast_select, "broadcast_select");
@@ -136,6 +138,7 @@ void system_services_stop()
 	service_release("copy_mail", "system");
 	service_release("imap_search", "system");
 	service_release("imap_search_uid", "system");
+	service_release("list_vanished", "system");
 	service_release("install_event_stub", "system");
 	service_release("broadcast_event", "system");
 	service_release("broadcast_select", "system");
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <gromox/common_types.hpp>
 #include <gromox/mem_file.hpp>
 #include <gromox/xarray.hpp>
@@ -17,7 +18,7 @@ extern BOOL (*system_services_auth_login)(const char*, const char*, char*, char*
 extern int (*system_services_get_id)(const char*, const char*, const char*, unsigned int*);
 extern int (*system_services_get_uid)(const char*, const char*, const char*, unsigned int*);
 extern int (*system_services_summary_folder)(const char*, const char*, int *, int*, int*,
-	unsigned long*, unsigned int*, int *, int*);
+	unsigned long*, unsigned int*, int *, uint64_t *, int*);
 extern int (*system_services_make_folder)(const char*, const char*, int*);
 extern int (*system_services_remove_folder)(const char*, const char*, int*);
 extern int (*system_services_rename_folder)(const char*, const char*, const char*, int*);
@@ -31,18 +32,19 @@ extern int (*system_services_remove_mail)(const char*, const char*, SINGLE_LIST*
 extern int (*system_services_list_simple)(const char*, const char*, XARRAY*, int*);
 extern int (*system_services_list_deleted)(const char*, const char*, XARRAY*, int*);
 extern int (*system_services_list_detail)(const char*, const char*, XARRAY*, int*);
-extern int (*system_services_fetch_simple)(const char*, const char*, DOUBLE_LIST*, XARRAY*, int*);
+extern int (*system_services_fetch_simple)(const char*, const char*, DOUBLE_LIST*, XARRAY*, uint64_t, int*);
 extern int (*system_services_fetch_detail)(const char*, const char*, DOUBLE_LIST*, XARRAY*, int*);
-extern int (*system_services_fetch_simple_uid)(const char*, const char*, DOUBLE_LIST*, XARRAY*, int*);
+extern int (*system_services_fetch_simple_uid)(const char*, const char*, DOUBLE_LIST*, XARRAY*, uint64_t, int*);
 extern int (*system_services_fetch_detail_uid)(const char*, const char*, DOUBLE_LIST*, XARRAY*, int*);
 extern void (*system_services_free_result)(XARRAY*);
 extern int (*system_services_set_flags)(const char*, const char*, const char*, int, int*);
 extern int (*system_services_unset_flags)(const char*, const char*, const char*, int, int*);
-extern int (*system_services_get_flags)(const char*, const char*, const char*, int*, int*);
+extern int (*system_services_get_flags)(const char*, const char*, const char*, int*, uint64_t *, int*);
 extern int (*system_services_copy_mail)(const char*, const char*, const char*,
 	const char*, char*, int*);
 extern int (*system_services_search)(const char*, const char*, const char*, int, char**, char*, int*, int*);
 extern int (*system_services_search_uid)(const char*, const char*, const char*, int, char**, char*, int*, int*);
+extern int (*system_services_list_vanished)(const char *, const char *, uint64_t, uint32_t, const char *, char *, int *, BOOL *, uint32_t *, int *);
 extern void (*system_services_install_event_stub)(void (*)(char *));
 extern void (*system_services_broadcast_event)(const char*);
 extern void (*system_services_broadcast_select)(const char*, const char*);
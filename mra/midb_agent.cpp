@@ -9,6 +9,7 @@
 #include <libHX/string.h>
 #include <gromox/defs.h>
 #include <gromox/fileio.h>
+#include <gromox/midb.hpp>
 #include <gromox/msg_unit.hpp>
 #include <gromox/socket.h>
 #include <gromox/svc_common.h>
@@ -59,6 +60,7 @@ struct MITEM {
 	int id;
 	int uid;
 	char flag_bits;
+	uint64_t modseq;
 	MEM_FILE f_digest;
 };
 
@@ -92,11 +94,13 @@ static BOOL read_line(int sockd, char *buff, int length);
 static int connect_midb(const char *host, uint16_t port);
 static BOOL get_digest_string(const char *src, int length, const char *tag, char *buff, int buff_len);
 static BOOL get_digest_integer(const char *src, int length, const char *tag, int *pinteger);
+static uint64_t get_digest_modseq(const char *src, int length);
+static uint64_t parse_modseq(const char *flags);
 static int list_mail(const char *path, const char *folder, std::deque<MSG_UNIT> &, int *num, uint64_t *size);
 static int delete_mail(const char *path, const char *folder, SINGLE_LIST *plist);
 static int get_mail_id(const char *path, const char *folder, const char *mid_string, unsigned int *id);
 static int get_mail_uid(const char *path, const char *folder, const char *mid_string, unsigned int *uid);
-static int summary_folder(const char *path, const char *folder, int *exists, int *recent, int *unseen, unsigned long *uidvalid, unsigned int *uidnext, int *first_seen, int *perrno);
+static int summary_folder(const char *path, const char *folder, int *exists, int *recent, int *unseen, unsigned long *uidvalid, unsigned int *uidnext, int *first_seen, uint64_t *highest_modseq, int *perrno);
 static int make_folder(const char *path, const char *folder, int *perrno);
 static int remove_folder(const char *path, const char *folder, int *perrno);
 static int ping_mailbox(const char *path, int *perrno);
@@ -111,16 +115,17 @@ static int list_simple(const char *path, const char *folder, XARRAY *, int *perr
 static int list_deleted(const char *path, const char *folder, XARRAY *, int *perrno);
 static int list_detail(const char *path, const char *folder, XARRAY *pxarray, int *perrno);
 static void free_result(XARRAY *pxarray);
-static int fetch_simple(const char *path, const char *folder, DOUBLE_LIST *, XARRAY *, int *perrno);
+static int fetch_simple(const char *path, const char *folder, DOUBLE_LIST *, XARRAY *, uint64_t changedsince, int *perrno);
 static int fetch_detail(const char *path, const char *folder, DOUBLE_LIST *, XARRAY *, int *perrno);
-static int fetch_simple_uid(const char *path, const char *folder, DOUBLE_LIST *, XARRAY *, int *perrno);
+static int fetch_simple_uid(const char *path, const char *folder, DOUBLE_LIST *, XARRAY *, uint64_t changedsince, int *perrno);
 static int fetch_detail_uid(const char *path, const char *folder, DOUBLE_LIST *, XARRAY *, int *perrno);
 static int set_mail_flags(const char *path, const char *folder, const char *mid_string, int flag_bits, int *perrno);
 static int unset_mail_flags(const char *path, const char *folder, const char *mid_string, int flag_bits, int *perrno);
-static int get_mail_flags(const char *path, const char *folder, const char *mid_string, int *pflag_bits, int *perrno);
+static int get_mail_flags(const char *path, const char *folder, const char *mid_string, int *pflag_bits, uint64_t *pmodseq, int *perrno);
 static int copy_mail(const char *path, const char *src_folder, const char *mid_string, const char *dst_folder, char *dst_mid, int *perrno);
 static int imap_search(const char *path, const char *folder, const char *charset, int argc, char **argv, char *ret_buff, int *plen, int *perrno);
 static int imap_search_uid(const char *path, const char *folder, const char *charset, int argc, char **argv, char *ret_buff, int *plen, int *perrno);
+static int list_vanished(const char *path, const char *folder, uint64_t modseq, uint32_t after_uid, const char *uid_set, char *ret_buff, int *plen, BOOL *pb_full, uint32_t *plast, int *perrno);
 static BOOL check_full(const char *path);
 static void console_talk(int argc, char **argv, char *result, int length);
 
@@ -275,7 +280,7 @@ static BOOL svc_midb_agent(int reason, void **ppdata)
 		    !E(free_result) || !E(set_mail_flags) ||
 		    !E(unset_mail_flags) || !E(get_mail_flags) ||
 		    !E(copy_mail) || !E(imap_search) || !E(imap_search_uid) ||
-		    !E(check_full)) {
+		    !E(list_vanished) || !E(check_full)) {
 			printf("[midb_agent]: failed to register services\n");
 			return FALSE;
 		}
@@ -838,6 +843,76 @@ static int imap_search_uid(const char *path, const char *folder,
 
 }
 
+/*
+ * One page of the UIDs expunged after @modseq and above @after_uid. *plast
+ * is 0 on the last page, else the @after_uid for the next call. *pb_full
+ * says midb no longer knows that far back and lists every missing UID.
+ */
+static int list_vanished(const char *path, const char *folder,
+    uint64_t modseq, uint32_t after_uid, const char *uid_set, char *ret_buff,
+    int *plen, BOOL *pb_full, uint32_t *plast, int *perrno)
+{
+	int length;
+	char *pend;
+	char buff[256*1025];
+
+	auto pback = get_connection(path);
+	if (NULL == pback) {
+		return MIDB_NO_SERVER;
+	}
+	if (NULL == uid_set || '\0' == uid_set[0]) {
+		length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-VNSH %s %s %llu %u\r\n",
+					path, folder, static_cast<unsigned long long>(modseq),
+					after_uid);
+	} else {
+		length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-VNSH %s %s %llu %u %s\r\n",
+					path, folder, static_cast<unsigned long long>(modseq),
+					after_uid, uid_set);
+	}
+	if (length != write(pback->sockd, buff, length)) {
+		goto RDWR_ERROR;
+	}
+
+	if (FALSE == read_line(pback->sockd, buff, sizeof(buff))) {
+		goto RDWR_ERROR;
+	} else {
+		if (0 == strncmp(buff, "TRUE ", 5)) {
+			std::unique_lock sv_hold(g_server_lock);
+			double_list_append_as_tail(&pback->psvr->conn_list,
+				&pback->node);
+			sv_hold.unlock();
+			*pb_full = '1' == buff[5] ? TRUE : false;
+			*plast = strtoul(buff + 6, &pend, 10);
+			if (' ' == *pend) {
+				pend ++;
+			}
+			length = strlen(pend);
+			/* a page never exceeds MIDB_VNSH_PAGE_SIZE */
+			if (length > *plen) {
+				*perrno = MIDB_E_NO_MEMORY;
+				return MIDB_RESULT_ERROR;
+			}
+			*plen = length;
+			memcpy(ret_buff, pend, length);
+			return MIDB_RESULT_OK;
+		} else if (0 == strncmp(buff, "FALSE ", 6)) {
+			std::unique_lock sv_hold(g_server_lock);
+			double_list_append_as_tail(&pback->psvr->conn_list, &pback->node);
+			*perrno = atoi(buff + 6);
+			return MIDB_RESULT_ERROR;
+		} else {
+			goto RDWR_ERROR;
+		}
+	}
+
+ RDWR_ERROR:
+	close(pback->sockd);
+	pback->sockd = -1;
+	std::unique_lock sv_hold(g_server_lock);
+	double_list_append_as_tail(&g_lost_list, &pback->node);
+	return MIDB_RDWR_ERROR;
+}
+
 static int get_mail_id(const char *path, const char *folder,
     const char *mid_string, unsigned int *pid)
 {
@@ -925,7 +1000,8 @@ static int get_mail_uid(const char *path, const char *folder,
 
 static int summary_folder(const char *path, const char *folder, int *pexists,
 	int *precent, int *punseen, unsigned long *puidvalid,
-	unsigned int *puidnext, int *pfirst_unseen, int *perrno)
+	unsigned int *puidnext, int *pfirst_unseen, uint64_t *phighest_modseq,
+	int *perrno)
 {
 	int length;
 	char buff[1024];
@@ -933,6 +1009,7 @@ static int summary_folder(const char *path, const char *folder, int *pexists,
 	int unseen, first_unseen;
 	unsigned long uidvalid;
 	unsigned int uidnext;
+	unsigned long long highest_modseq = 1;
 
 	auto pback = get_connection(path);
 	if (NULL == pback) {
@@ -947,8 +1024,10 @@ static int summary_folder(const char *path, const char *folder, int *pexists,
 		goto RDWR_ERROR;
 	} else {
 		if (0 == strncmp(buff, "TRUE", 4)) {
-			if (6 != sscanf(buff, "TRUE %d %d %d %lu %u %d", &exists,
-				&recent, &unseen, &uidvalid, &uidnext, &first_unseen)) {
+			/* older midb does not report the highest modseq */
+			if (sscanf(buff, "TRUE %d %d %d %lu %u %d %llu", &exists,
+			    &recent, &unseen, &uidvalid, &uidnext, &first_unseen,
+			    &highest_modseq) < 6) {
 				*perrno = -1;
 				std::unique_lock sv_hold(g_server_lock);
 				double_list_append_as_tail(&pback->psvr->conn_list,
@@ -973,6 +1052,9 @@ static int summary_folder(const char *path, const char *folder, int *pexists,
 			if (NULL != pfirst_unseen) {
 				*pfirst_unseen = first_unseen + 1;
 			}
+			if (NULL != phighest_modseq) {
+				*phighest_modseq = highest_modseq;
+			}
 			
 			std::unique_lock sv_hold(g_server_lock);
 			double_list_append_as_tail(&pback->psvr->conn_list,
@@ -1731,6 +1813,7 @@ static int list_simple(const char *path, const char *folder, XARRAY *pxarray,
 						if (NULL != strchr(pspace1, 'R')) {
 							mitem.flag_bits |= FLAG_RECENT;
 						}
+						mitem.modseq = parse_modseq(pspace1);
 						xarray_append(pxarray, &mitem, mitem.uid);
 					} else {
 						b_format_error = TRUE;
@@ -2063,7 +2146,7 @@ static int list_detail(const char *path, const char *folder, XARRAY *pxarray,
 						"recent", &value) && 1 == value) {
 						mitem.flag_bits |= FLAG_RECENT;
 					}
-					
+					mitem.modseq = get_digest_modseq(temp_line, line_pos);
 					mem_file_init(&mitem.f_digest, g_file_allocator);
 					mem_file_write(&mitem.f_digest, temp_line, line_pos);
 					xarray_append(pxarray, &mitem, mitem.uid);
@@ -2148,8 +2231,13 @@ static void free_result(XARRAY *pxarray)
 	}
 }
 
+/*
+ * A nonzero @changedsince restricts the result to the messages whose modseq
+ * is above it (CHANGEDSINCE/QRESYNC); midb then prefixes each line with the
+ * message's position, as only some of the range are returned.
+ */
 static int fetch_simple(const char *path, const char *folder,
-    DOUBLE_LIST *plist, XARRAY *pxarray, int *perrno)
+    DOUBLE_LIST *plist, XARRAY *pxarray, uint64_t changedsince, int *perrno)
 {
 	int uid;
 	int lines;
@@ -2161,6 +2249,7 @@ static int fetch_simple(const char *path, const char *folder,
 	int line_pos;
 	int tv_msec;
 	MITEM mitem;
+	char *pline;
 	char *pspace;
 	char *pspace1;
 	char num_buff[32];
@@ -2180,17 +2269,22 @@ static int fetch_simple(const char *path, const char *folder,
 		auto pseq = static_cast<SEQUENCE_NODE *>(pnode->pdata);
 		if (pseq->max == -1) {
 			if (pseq->min == -1)
-				length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIML %s %s UID ASC -1 1\r\n",
+				length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIML %s %s UID ASC -1 1",
 						path, folder);
 			else
 				length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIML %s %s UID ASC %d "
-						"1000000000\r\n", path, folder,
+						"1000000000", path, folder,
 						pseq->min - 1);
 		} else {
-			length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIML %s %s UID ASC %d %d\r\n",
+			length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIML %s %s UID ASC %d %d",
 						path, folder, pseq->min - 1,
 						pseq->max - pseq->min + 1);
 		}
+		if (0 != changedsince) {
+			length += gx_snprintf(buff + length, GX_ARRAY_SIZE(buff) - length,
+						" %llu", static_cast<unsigned long long>(changedsince));
+		}
+		length += gx_snprintf(buff + length, GX_ARRAY_SIZE(buff) - length, "\r\n");
 		if (length != write(pback->sockd, buff, length)) {
 			goto RDWR_ERROR;
 		}
@@ -2248,7 +2342,15 @@ static int fetch_simple(const char *path, const char *folder,
 					count ++;
 				} else if ('\n' == buff[i] && '\r' == buff[i - 1]) {
 					temp_line[line_pos] = '\0';
-					pspace = strchr(temp_line, ' ');
+					pline = temp_line;
+					if (0 != changedsince) {
+						pline = strchr(temp_line, ' ');
+						if (NULL != pline) {
+							*pline = '\0';
+							pline ++;
+						}
+					}
+					pspace = NULL == pline ? NULL : strchr(pline, ' ');
 					if (NULL != pspace) {
 						pspace1 = strchr(pspace + 1, ' ');
 						if (NULL != pspace1) {
@@ -2262,8 +2364,9 @@ static int fetch_simple(const char *path, const char *folder,
 								assert(num > 0);
 								auto pitem = static_cast<MITEM *>(xarray_get_item(pxarray, num - 1));
 								pitem->uid = uid;
-								pitem->id = pseq->min + count - 1;
-								gx_strlcpy(pitem->mid, temp_line, GX_ARRAY_SIZE(pitem->mid));
+								pitem->id = 0 != changedsince ? atoi(temp_line) + 1 :
+								            pseq->min + count - 1;
+								gx_strlcpy(pitem->mid, pline, GX_ARRAY_SIZE(pitem->mid));
 								pitem->flag_bits = 0;
 								if (NULL != strchr(pspace1, 'A')) {
 									pitem->flag_bits |= FLAG_ANSWERED;
@@ -2283,6 +2386,7 @@ static int fetch_simple(const char *path, const char *folder,
 								if (NULL != strchr(pspace1, 'R')) {
 									pitem->flag_bits |= FLAG_RECENT;
 								}
+								pitem->modseq = parse_modseq(pspace1);
 							}
 						} else {
 							b_format_error = TRUE;
@@ -2490,7 +2594,7 @@ static int fetch_detail(const char *path, const char *folder,
 								"recent", &value) && 1 == value) {
 								pitem->flag_bits |= FLAG_RECENT;
 							}
-							
+							pitem->modseq = get_digest_modseq(temp_line, line_pos);
 							mem_file_init(&pitem->f_digest, g_file_allocator);
 							mem_file_write(&pitem->f_digest, temp_line, line_pos);
 						}
@@ -2563,7 +2667,7 @@ static int fetch_detail(const char *path, const char *folder,
 }
 
 static int fetch_simple_uid(const char *path, const char *folder,
-    DOUBLE_LIST *plist, XARRAY *pxarray, int *perrno)
+    DOUBLE_LIST *plist, XARRAY *pxarray, uint64_t changedsince, int *perrno)
 {
 	int uid;
 	int lines;
@@ -2593,8 +2697,13 @@ static int fetch_simple_uid(const char *path, const char *folder,
 	for (pnode=double_list_get_head(plist); NULL!=pnode;
 		pnode=double_list_get_after(plist, pnode)) {
 		auto pseq = static_cast<SEQUENCE_NODE *>(pnode->pdata);
-		length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIMU %s %s UID ASC %d %d\r\n", path, folder,
-					pseq->min, pseq->max);
+		if (0 != changedsince)
+			length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIMU %s %s UID ASC %d %d %llu\r\n",
+						path, folder, pseq->min, pseq->max,
+						static_cast<unsigned long long>(changedsince));
+		else
+			length = gx_snprintf(buff, GX_ARRAY_SIZE(buff), "P-SIMU %s %s UID ASC %d %d\r\n", path, folder,
+						pseq->min, pseq->max);
 		if (length != write(pback->sockd, buff, length)) {
 			goto RDWR_ERROR;
 		}
@@ -2691,6 +2800,7 @@ static int fetch_simple_uid(const char *path, const char *folder,
 									if (NULL != strchr(pspace2, 'R')) {
 										pitem->flag_bits |= FLAG_RECENT;
 									}
+									pitem->modseq = parse_modseq(pspace2);
 								}
 							} else {
 								b_format_error = TRUE;
@@ -2896,7 +3006,7 @@ static int fetch_detail_uid(const char *path, const char *folder,
 								"recent", &value) && 1 == value) {
 								pitem->flag_bits |= FLAG_RECENT;
 							}
-							
+							pitem->modseq = get_digest_modseq(pspace, temp_len);
 							mem_file_init(&pitem->f_digest, g_file_allocator);
 							mem_file_write(&pitem->f_digest, pspace, temp_len);
 						}
@@ -3125,7 +3235,7 @@ static int unset_mail_flags(const char *path, const char *folder,
 }
 	
 static int get_mail_flags(const char *path, const char *folder,
-    const char *mid_string, int *pflag_bits, int *perrno)
+    const char *mid_string, int *pflag_bits, uint64_t *pmodseq, int *perrno)
 {
 	int length;
 	char buff[1024];
@@ -3167,6 +3277,9 @@ static int get_mail_flags(const char *path, const char *folder,
 			if (NULL != strchr(buff + 5, 'R')) {
 				*pflag_bits |= FLAG_RECENT;
 			}
+			if (NULL != pmodseq) {
+				*pmodseq = parse_modseq(buff + 5);
+			}
 			return MIDB_RESULT_OK;
 		} else if (0 == strncmp(buff, "FALSE ", 6)) {
 			std::unique_lock sv_hold(g_server_lock);
@@ -3484,3 +3597,23 @@ static BOOL get_digest_integer(const char *src, int length, const char *tag, int
 	}
 	return FALSE;
 }
+
+static uint64_t get_digest_modseq(const char *src, int length)
+{
+	char num_buff[32];
+	
+	if (FALSE == get_digest_string(src, length, "modseq", num_buff, 32)) {
+		return 0;
+	}
+	return strtoull(num_buff, nullptr, 0);
+}
+
+/* midb appends the modseq after the "(flags)" token */
+static uint64_t parse_modseq(const char *flags)
+{
+	auto ptr = strchr(flags, ')');
+	if (NULL == ptr) {
+		return 0;
+	}
+	return strtoull(ptr + 1, nullptr, 0);
+}
@@ -669,6 +669,7 @@ PHP_RINIT_FUNCTION(mapi)
 
 PHP_RSHUTDOWN_FUNCTION(mapi)
 {
+	zarafa_client_rshutdown();
 	return SUCCESS;
 }
 
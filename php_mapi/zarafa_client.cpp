@@ -21,10 +21,36 @@
 #include <fcntl.h>
 #include <cerrno>
 #include <cstdint>
+#include <ctime>
+#include <poll.h>
+
+/*
+ * Persistent connections are dropped client-side well before zcore's
+ * KEEPALIVE_TIMEOUT, so that a call is never sent into a connection that
+ * zcore is just closing.
+ */
+#define ZCORE_IDLE_LIMIT 240
 
 using RPC_REQUEST = ZCORE_RPC_REQUEST;
 using RPC_RESPONSE = ZCORE_RPC_RESPONSE;
 
+/* persistent connection to zcore, -1 if none */
+static thread_local int g_zcore_fd = -1;
+static thread_local time_t g_zcore_last;
+/* zcore rejected KEEPALIVE (older version) */
+static thread_local bool g_zcore_oneshot;
+
+/*
+ * mapi.zcore_keepalive: 0 = one connection per call, 1 = keep the
+ * connection for the duration of a PHP request (default), 2 = keep it
+ * across requests served by the same process.
+ */
+static int zarafa_client_keepalive()
+{
+	auto val = zend_ini_string(const_cast<char *>("mapi.zcore_keepalive"), sizeof("mapi.zcore_keepalive") - 1, 0);
+	return val == nullptr || *val == '\0' ? 1 : strtol(val, nullptr, 0);
+}
+
 static int zarafa_client_connect()
 {
 	int sockd, len;
@@ -111,17 +137,91 @@ static zend_bool zarafa_client_write_socket(int sockd, const BINARY *pbin)
 	}
 }
 
+/*
+ * Returns a connection for one call; *pb_keep tells whether it may be
+ * reused afterwards.
+ */
+static int zarafa_client_get_connection(zend_bool *pb_keep)
+{
+	int sockd;
+	uint8_t tmp_byte;
+	struct pollfd fdpoll;
+	uint8_t hello[5] = {1, 0, 0, 0, zcore_callid::KEEPALIVE};
+	
+	*pb_keep = 0;
+	if (zarafa_client_keepalive() <= 0 || g_zcore_oneshot) {
+		return zarafa_client_connect();
+	}
+	if (g_zcore_fd >= 0) {
+		sockd = g_zcore_fd;
+		g_zcore_fd = -1;
+		fdpoll.fd = sockd;
+		fdpoll.events = POLLIN;
+		/* nothing, not even EOF, may be pending on an idle connection */
+		if (time(nullptr) - g_zcore_last < ZCORE_IDLE_LIMIT &&
+			0 == poll(&fdpoll, 1, 0)) {
+			*pb_keep = 1;
+			return sockd;
+		}
+		close(sockd);
+	}
+	sockd = zarafa_client_connect();
+	if (sockd < 0) {
+		return sockd;
+	}
+	/* length 1 (little-endian, as from rpc_ext_push_request), call id */
+	if (write(sockd, hello, sizeof(hello)) != sizeof(hello)) {
+		close(sockd);
+		return -1;
+	}
+	if (read(sockd, &tmp_byte, 1) == 1 &&
+		tmp_byte == zcore_response::SUCCESS) {
+		*pb_keep = 1;
+		return sockd;
+	}
+	close(sockd);
+	g_zcore_oneshot = true;
+	return zarafa_client_connect();
+}
+
+void zarafa_client_rshutdown()
+{
+	if (zarafa_client_keepalive() < 2 && g_zcore_fd >= 0) {
+		close(g_zcore_fd);
+		g_zcore_fd = -1;
+	}
+	/* look for a newer zcore again in the next request */
+	g_zcore_oneshot = false;
+}
+
+static void zarafa_client_put_connection(int sockd, zend_bool b_keep)
+{
+	if (!b_keep) {
+		close(sockd);
+		return;
+	}
+	g_zcore_fd = sockd;
+	g_zcore_last = time(nullptr);
+}
+
 zend_bool zarafa_client_do_rpc(
 	const RPC_REQUEST *prequest,
 	RPC_RESPONSE *presponse)
 {
 	int sockd;
+	zend_bool b_keep;
 	BINARY tmp_bin;
 	
 	if (!rpc_ext_push_request(prequest, &tmp_bin)) {
 		return 0;
 	}
-	sockd = zarafa_client_connect();
+	if (zcore_callid::NOTIFDEQUEUE == prequest->call_id) {
+		/* zcore holds on to the connection until an event arrives */
+		b_keep = 0;
+		sockd = zarafa_client_connect();
+	} else {
+		sockd = zarafa_client_get_connection(&b_keep);
+	}
 	if (sockd < 0) {
 		efree(tmp_bin.pb);
 		return 0;
@@ -136,7 +236,9 @@ zend_bool zarafa_client_do_rpc(
 		close(sockd);
 		return 0;
 	}
-	close(sockd);
+	/* error responses end the connection on the zcore side */
+	zarafa_client_put_connection(sockd, b_keep && tmp_bin.cb >= 5 &&
+		tmp_bin.pb[0] == zcore_response::SUCCESS);
 	if (tmp_bin.cb < 5 || tmp_bin.pb[0] != zcore_response::SUCCESS) {
 		if (NULL != tmp_bin.pb) {
 			efree(tmp_bin.pb);
@@ -13,6 +13,7 @@ struct ZCORE_RPC_REQUEST;
 struct ZCORE_RPC_RESPONSE;
 
 extern zend_bool zarafa_client_do_rpc(const ZCORE_RPC_REQUEST *, ZCORE_RPC_RESPONSE *);
+extern void zarafa_client_rshutdown();
 extern uint32_t zarafa_client_setpropval(GUID hsession, uint32_t hobject, uint32_t proptag, const void *pvalue);
 extern uint32_t zarafa_client_getpropval(GUID hsession, uint32_t hobject, uint32_t proptag, void **ppvalue);
 
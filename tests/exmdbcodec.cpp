@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Round-trips exmdb RPC requests and responses through the wire codec
+ * (exmdb_ext_push_* / exmdb_ext_pull_*) and compares the result with the
+ * input, both as socket frames and as frames in a shared memfd region.
+ * The fixed-size integer array (de)serializers underneath are exercised
+ * directly with empty, odd-length and maximum-length arrays.
+ * Exits non-zero on the first mismatch.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gromox/defs.h>
+#include <gromox/exmdb_rpc.hpp>
+#include <gromox/ext_buffer.hpp>
+#include <gromox/mapi_types.hpp>
+
+#define CHECK(e) do { \
+		if (!(e)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #e); \
+			return EXIT_FAILURE; \
+		} \
+	} while (false)
+
+static bool str_eq(const char *a, const char *b)
+{
+	if (a == nullptr || b == nullptr)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+/* The request frame starts with its 4-byte length, which the server strips. */
+static int roundtrip(const EXMDB_REQUEST &in, EXMDB_REQUEST &out)
+{
+	BINARY bin;
+	auto ret = exmdb_ext_push_request(&in, &bin);
+	if (ret != EXT_ERR_SUCCESS)
+		return ret;
+	uint32_t len;
+	memcpy(&len, bin.pb, sizeof(len));
+	if (le32_to_cpu(len) != bin.cb - sizeof(len)) {
+		free(bin.pb);
+		return EXT_ERR_FORMAT;
+	}
+	BINARY body{bin.cb - static_cast<uint32_t>(sizeof(len)), {bin.pb + sizeof(len)}};
+	ret = exmdb_ext_pull_request(&body, &out);
+	free(bin.pb);
+	return ret;
+}
+
+/* The response frame is the status byte and the payload length, then payload. */
+static int roundtrip(const EXMDB_RESPONSE &in, EXMDB_RESPONSE &out)
+{
+	BINARY bin;
+	auto ret = exmdb_ext_push_response(&in, &bin);
+	if (ret != EXT_ERR_SUCCESS)
+		return ret;
+	uint32_t len;
+	memcpy(&len, &bin.pb[1], sizeof(len));
+	if (bin.pb[0] != exmdb_response::SUCCESS ||
+	    le32_to_cpu(len) != bin.cb - 5) {
+		free(bin.pb);
+		return EXT_ERR_FORMAT;
+	}
+	BINARY body{bin.cb - 5, {bin.pb + 5}};
+	out.call_id = in.call_id;
+	ret = exmdb_ext_pull_response(&body, &out);
+	free(bin.pb);
+	return ret;
+}
+
+static int t_freebusy_events()
+{
+	EXMDB_REQUEST rq{}, rq2{};
+	char dir[] = "/var/lib/gromox/user/0/1";
+	rq.call_id = exmdb_callid::GET_FREEBUSY_EVENTS;
+	rq.dir = dir;
+	rq.payload.get_freebusy_events.start_time = 0x01d7a0b0c0d0e0f0ULL;
+	rq.payload.get_freebusy_events.end_time = 0x01d7b0b0c0d0e0f0ULL;
+	CHECK(roundtrip(rq, rq2) == EXT_ERR_SUCCESS);
+	CHECK(rq2.call_id == rq.call_id);
+	CHECK(str_eq(rq2.dir, dir));
+	CHECK(rq2.payload.get_freebusy_events.start_time == rq.payload.get_freebusy_events.start_time);
+	CHECK(rq2.payload.get_freebusy_events.end_time == rq.payload.get_freebusy_events.end_time);
+
+	char id0[] = "040000008200E00074C5B7101A82E008", id1[] = "0";
+	char subj[] = "Weekly sync", loc[] = "Room 4";
+	FREEBUSY_EVENT ev[3]{};
+	ev[0] = {0x01d7a0b0c0d0e0f0ULL, 0x01d7a0b1c0d0e0f0ULL, 2, id0, subj, loc, TRUE, TRUE, false, TRUE, false};
+	/* private event without details */
+	ev[1] = {0x01d7a0c0c0d0e0f0ULL, 0x01d7a0c1c0d0e0f0ULL, 3, id1, nullptr, nullptr, false, false, false, false, TRUE};
+	/* empty, but present, strings */
+	char empty[] = "";
+	ev[2] = {1, 2, 0, id1, empty, nullptr, false, TRUE, TRUE, false, false};
+	EXMDB_RESPONSE rs{}, rs2{};
+	rs.call_id = exmdb_callid::GET_FREEBUSY_EVENTS;
+	rs.payload.get_freebusy_events.events = {3, ev};
+	CHECK(roundtrip(rs, rs2) == EXT_ERR_SUCCESS);
+	auto &out = rs2.payload.get_freebusy_events.events;
+	CHECK(out.count == 3);
+	for (size_t i = 0; i < out.count; ++i) {
+		auto &a = ev[i], &b = out.pevents[i];
+		CHECK(a.start_time == b.start_time);
+		CHECK(a.end_time == b.end_time);
+		CHECK(a.busy_type == b.busy_type);
+		CHECK(str_eq(a.id, b.id));
+		CHECK(str_eq(a.subject, b.subject));
+		CHECK(str_eq(a.location, b.location));
+		CHECK(!a.b_meeting == !b.b_meeting);
+		CHECK(!a.b_recurring == !b.b_recurring);
+		CHECK(!a.b_exception == !b.b_exception);
+		CHECK(!a.b_reminder == !b.b_reminder);
+		CHECK(!a.b_private == !b.b_private);
+	}
+
+	/* no events */
+	rs.payload.get_freebusy_events.events = {0, nullptr};
+	CHECK(roundtrip(rs, rs2) == EXT_ERR_SUCCESS);
+	CHECK(rs2.payload.get_freebusy_events.events.count == 0);
+	CHECK(rs2.payload.get_freebusy_events.events.pevents == nullptr);
+	return EXIT_SUCCESS;
+}
+
+static int t_allocate_cns()
+{
+	EXMDB_REQUEST rq{}, rq2{};
+	char dir[] = "/var/lib/gromox/user/0/1";
+	rq.call_id = exmdb_callid::ALLOCATE_CNS;
+	rq.dir = dir;
+	rq.payload.allocate_cns.count = 0xfffffffeU;
+	CHECK(roundtrip(rq, rq2) == EXT_ERR_SUCCESS);
+	CHECK(rq2.call_id == exmdb_callid::ALLOCATE_CNS);
+	CHECK(str_eq(rq2.dir, dir));
+	CHECK(rq2.payload.allocate_cns.count == 0xfffffffeU);
+
+	EXMDB_RESPONSE rs{}, rs2{};
+	rs.call_id = exmdb_callid::ALLOCATE_CNS;
+	rs.payload.allocate_cns.begin_cn = 0x0000ffffffff0001ULL;
+	CHECK(roundtrip(rs, rs2) == EXT_ERR_SUCCESS);
+	CHECK(rs2.payload.allocate_cns.begin_cn == rs.payload.allocate_cns.begin_cn);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Frames placed in a sealed memfd region, as exmdb_client and exmdb_parser
+ * do for co-located peers, read back through a second mapping of the same
+ * descriptor (which is what the server holds).
+ */
+static int t_shm_frames()
+{
+	static constexpr size_t shm_size = 64 * 1024;
+	int fd = memfd_create("exmdbcodec", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	CHECK(fd >= 0);
+	CHECK(ftruncate(fd, shm_size) == 0);
+	CHECK(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0);
+	/* the peer cannot pull the region out from under the mapping */
+	CHECK(ftruncate(fd, shm_size / 2) != 0);
+	auto cl = static_cast<uint8_t *>(mmap(nullptr, shm_size,
+	          PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	CHECK(cl != MAP_FAILED);
+	auto sv = static_cast<uint8_t *>(mmap(nullptr, shm_size,
+	          PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	CHECK(sv != MAP_FAILED);
+	close(fd);
+
+	/* client request: length prefix, then the body */
+	EXMDB_REQUEST rq{}, rq2{};
+	char dir[] = "/var/lib/gromox/user/0/1";
+	rq.call_id = exmdb_callid::ALLOCATE_CNS;
+	rq.dir = dir;
+	rq.payload.allocate_cns.count = 4096;
+	BINARY bin{};
+	CHECK(exmdb_ext_push_request(&rq, &bin, cl, shm_size) == EXT_ERR_SUCCESS);
+	CHECK(bin.pb == cl);
+	uint32_t len;
+	memcpy(&len, sv, sizeof(len));
+	len = le32_to_cpu(len);
+	CHECK(len + sizeof(len) == bin.cb);
+	CHECK(len <= shm_size - sizeof(len));
+	BINARY body{len, {sv + sizeof(len)}};
+	CHECK(exmdb_ext_pull_request(&body, &rq2) == EXT_ERR_SUCCESS);
+	CHECK(rq2.call_id == exmdb_callid::ALLOCATE_CNS);
+	CHECK(str_eq(rq2.dir, dir));
+	CHECK(rq2.payload.allocate_cns.count == 4096);
+
+	/* server response: status byte, length, body; same region */
+	char id[] = "1", subj[] = "x";
+	FREEBUSY_EVENT ev[] = {{1, 2, 2, id, subj, nullptr, TRUE, false, false, false, false}};
+	EXMDB_RESPONSE rs{}, rs2{};
+	rs.call_id = exmdb_callid::GET_FREEBUSY_EVENTS;
+	rs.payload.get_freebusy_events.events = {1, ev};
+	CHECK(exmdb_ext_push_response(&rs, &bin, sv, shm_size) == EXT_ERR_SUCCESS);
+	CHECK(bin.pb == sv);
+	CHECK(cl[0] == exmdb_response::SUCCESS);
+	memcpy(&len, &cl[1], sizeof(len));
+	len = le32_to_cpu(len);
+	CHECK(len + 5 == bin.cb);
+	body = {len, {cl + 5}};
+	rs2.call_id = rs.call_id;
+	CHECK(exmdb_ext_pull_response(&body, &rs2) == EXT_ERR_SUCCESS);
+	CHECK(rs2.payload.get_freebusy_events.events.count == 1);
+	CHECK(str_eq(rs2.payload.get_freebusy_events.events.pevents[0].subject, subj));
+	CHECK(rs2.payload.get_freebusy_events.events.pevents[0].location == nullptr);
+
+	/* frames that do not fit fall back to the socket */
+	CHECK(exmdb_ext_push_request(&rq, &bin, cl, 8) == EXT_ERR_BUFSIZE);
+	CHECK(exmdb_ext_push_response(&rs, &bin, sv, 16) == EXT_ERR_BUFSIZE);
+	munmap(sv, shm_size);
+	munmap(cl, shm_size);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Push @in as a fixed-size integer array, pull it back into @out (whose
+ * storage is malloc'd and left to the caller) and check the wire length.
+ */
+template<typename A, typename P, typename G> static int
+array_roundtrip(const A &in, A &out, uint32_t wire_size, P push, G pull)
+{
+	EXT_PUSH ep;
+	if (!ep.init(nullptr, 0, 0))
+		return EXT_ERR_ALLOC;
+	auto ret = (ep.*push)(&in);
+	if (ret != EXT_ERR_SUCCESS)
+		return ret;
+	if (ep.m_offset != wire_size)
+		return EXT_ERR_FORMAT;
+	EXT_PULL epl;
+	epl.init(ep.m_udata, ep.m_offset, malloc, 0);
+	ret = (epl.*pull)(&out);
+	if (ret != EXT_ERR_SUCCESS)
+		return ret;
+	return epl.m_offset == ep.m_offset ? EXT_ERR_SUCCESS : EXT_ERR_FORMAT;
+}
+
+static int t_fixed_arrays()
+{
+	using push16 = int (EXT_PUSH::*)(const SHORT_ARRAY *);
+	using pull16 = int (EXT_PULL::*)(SHORT_ARRAY *);
+	using push32 = int (EXT_PUSH::*)(const LONG_ARRAY *);
+	using pull32 = int (EXT_PULL::*)(LONG_ARRAY *);
+	using push64 = int (EXT_PUSH::*)(const LONGLONG_ARRAY *);
+	using pull64 = int (EXT_PULL::*)(LONGLONG_ARRAY *);
+	using pushpt = int (EXT_PUSH::*)(const PROPTAG_ARRAY *);
+	using pullpt = int (EXT_PULL::*)(PROPTAG_ARRAY *);
+	using pushlpt = int (EXT_PUSH::*)(const LPROPTAG_ARRAY *);
+	using pulllpt = int (EXT_PULL::*)(LPROPTAG_ARRAY *);
+
+	/* empty arrays: count only, and nullptr on both sides */
+	SHORT_ARRAY sa{}, sa2{};
+	CHECK(array_roundtrip(sa, sa2, 4, static_cast<push16>(&EXT_PUSH::p_uint16_a),
+	      static_cast<pull16>(&EXT_PULL::g_uint16_a)) == EXT_ERR_SUCCESS);
+	CHECK(sa2.count == 0 && sa2.ps == nullptr);
+	LONGLONG_ARRAY la{}, la2{};
+	CHECK(array_roundtrip(la, la2, 2, static_cast<push64>(&EXT_PUSH::p_uint64_sa),
+	      static_cast<pull64>(&EXT_PULL::g_uint64_sa)) == EXT_ERR_SUCCESS);
+	CHECK(la2.count == 0 && la2.pll == nullptr);
+	PROPTAG_ARRAY pa{}, pa2{};
+	CHECK(array_roundtrip(pa, pa2, 2, static_cast<pushpt>(&EXT_PUSH::p_proptag_a),
+	      static_cast<pullpt>(&EXT_PULL::g_proptag_a)) == EXT_ERR_SUCCESS);
+	CHECK(pa2.count == 0 && pa2.pproptag == nullptr);
+	LPROPTAG_ARRAY lpa{}, lpa2{};
+	CHECK(array_roundtrip(lpa, lpa2, 4, static_cast<pushlpt>(&EXT_PUSH::p_proptag_a),
+	      static_cast<pulllpt>(&EXT_PULL::g_proptag_a)) == EXT_ERR_SUCCESS);
+	CHECK(lpa2.cvalues == 0 && lpa2.pproptag == nullptr);
+
+	/* odd lengths, with values that show a byte-order mix-up */
+	uint16_t s_in[] = {0x0102, 0xfffe, 0x8000};
+	sa = {3, s_in};
+	CHECK(array_roundtrip(sa, sa2, 4 + 6, static_cast<push16>(&EXT_PUSH::p_uint16_a),
+	      static_cast<pull16>(&EXT_PULL::g_uint16_a)) == EXT_ERR_SUCCESS);
+	CHECK(sa2.count == 3 && memcmp(sa2.ps, s_in, sizeof(s_in)) == 0);
+	free(sa2.ps);
+	uint32_t l_in[] = {0x01020304, 0xfffffffe, 0, 0x80000001, 7};
+	LONG_ARRAY lo{5, l_in}, lo2{};
+	CHECK(array_roundtrip(lo, lo2, 4 + 20, static_cast<push32>(&EXT_PUSH::p_uint32_a),
+	      static_cast<pull32>(&EXT_PULL::g_uint32_a)) == EXT_ERR_SUCCESS);
+	CHECK(lo2.count == 5 && memcmp(lo2.pl, l_in, sizeof(l_in)) == 0);
+	free(lo2.pl);
+	uint64_t ll_in[] = {0x0102030405060708ULL};
+	la = {1, ll_in};
+	CHECK(array_roundtrip(la, la2, 4 + 8, static_cast<push64>(&EXT_PUSH::p_uint64_a),
+	      static_cast<pull64>(&EXT_PULL::g_uint64_a)) == EXT_ERR_SUCCESS);
+	CHECK(la2.count == 1 && la2.pll[0] == ll_in[0]);
+	free(la2.pll);
+	uint32_t pt_in[] = {0x0037001f, 0x0e080003, 0x3001001f};
+	lpa = {3, pt_in};
+	CHECK(array_roundtrip(lpa, lpa2, 4 + 12, static_cast<pushlpt>(&EXT_PUSH::p_proptag_a),
+	      static_cast<pulllpt>(&EXT_PULL::g_proptag_a)) == EXT_ERR_SUCCESS);
+	CHECK(lpa2.cvalues == 3 && memcmp(lpa2.pproptag, pt_in, sizeof(pt_in)) == 0);
+	free(lpa2.pproptag);
+
+	/* the largest arrays a 16-bit count can describe */
+	auto big = static_cast<uint64_t *>(malloc(sizeof(uint64_t) * 0x10000));
+	CHECK(big != nullptr);
+	for (size_t i = 0; i < 0x10000; ++i)
+		big[i] = i * 0x0101010101010101ULL;
+	la = {0xffff, big};
+	CHECK(array_roundtrip(la, la2, 2 + 0xffff * 8, static_cast<push64>(&EXT_PUSH::p_uint64_sa),
+	      static_cast<pull64>(&EXT_PULL::g_uint64_sa)) == EXT_ERR_SUCCESS);
+	CHECK(la2.count == 0xffff && memcmp(la2.pll, big, 0xffff * 8) == 0);
+	free(la2.pll);
+	la.count = 0x10000;
+	CHECK(array_roundtrip(la, la2, 0, static_cast<push64>(&EXT_PUSH::p_uint64_sa),
+	      static_cast<pull64>(&EXT_PULL::g_uint64_sa)) == EXT_ERR_FORMAT);
+	pa = {0xffff, reinterpret_cast<uint32_t *>(big)};
+	CHECK(array_roundtrip(pa, pa2, 2 + 0xffff * 4, static_cast<pushpt>(&EXT_PUSH::p_proptag_a),
+	      static_cast<pullpt>(&EXT_PULL::g_proptag_a)) == EXT_ERR_SUCCESS);
+	CHECK(pa2.count == 0xffff && memcmp(pa2.pproptag, big, 0xffff * 4) == 0);
+	free(pa2.pproptag);
+	free(big);
+
+	/* a count beyond the remaining input fails before anything is allocated */
+	uint8_t trunc[] = {0xff, 0xff, 0xff, 0x3f, 1, 2, 3, 4};
+	EXT_PULL epl;
+	epl.init(trunc, sizeof(trunc), [](size_t) -> void * { abort(); }, 0);
+	CHECK(epl.g_uint32_a(&lo2) == EXT_ERR_BUFSIZE);
+	epl.init(trunc, 6, [](size_t) -> void * { abort(); }, 0);
+	trunc[0] = 2;
+	trunc[1] = trunc[2] = trunc[3] = 0;
+	CHECK(epl.g_uint16_a(&sa2) == EXT_ERR_BUFSIZE);
+	return EXIT_SUCCESS;
+}
+
+int main()
+{
+	/* decoded strings and arrays are left to the process exit */
+	if (t_freebusy_events() != EXIT_SUCCESS ||
+	    t_allocate_cns() != EXIT_SUCCESS ||
+	    t_shm_frames() != EXIT_SUCCESS ||
+	    t_fixed_arrays() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	printf("exmdbcodec: ok\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Round trips against a FastCGI responder the way mod_fastcgi talks to
+ * one: a fresh connection per request with the body spooled through a
+ * file first (the old behaviour), versus a FCGI_KEEP_CONN connection with
+ * the body streamed as STDIN records. Unless a socket is given, a stub
+ * responder is started on a temporary socket; it echoes the number of
+ * STDIN bytes it got, which is checked. To measure a real php-fpm:
+ *
+ *	tests/fcgibench [requests [body_size [socket script]]]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using clk = std::chrono::steady_clock;
+
+enum {
+	T_BEGIN_REQUEST = 1, T_END_REQUEST = 3, T_PARAMS = 4, T_STDIN = 5,
+	T_STDOUT = 6, T_STDERR = 7,
+};
+static constexpr uint8_t FCGI_KEEP_CONN = 1;
+
+static std::atomic<bool> g_stub_stop;
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+	for (size_t off = 0; off < len; ) {
+		auto ret = read(fd, static_cast<char *>(buf) + off, len - off);
+		if (ret <= 0)
+			return false;
+		off += ret;
+	}
+	return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	for (size_t off = 0; off < len; ) {
+		auto ret = write(fd, static_cast<const char *>(buf) + off, len - off);
+		if (ret <= 0)
+			return false;
+		off += ret;
+	}
+	return true;
+}
+
+static void put_record(std::string &out, uint8_t type, const void *data,
+    uint16_t len)
+{
+	uint8_t pad = (8 - len % 8) % 8;
+	uint8_t hdr[8] = {1, type, 0, 1, static_cast<uint8_t>(len >> 8),
+	                  static_cast<uint8_t>(len), pad, 0};
+	out.append(reinterpret_cast<char *>(hdr), sizeof(hdr));
+	out.append(static_cast<const char *>(data), len);
+	out.append(pad, '\0');
+}
+
+static void put_param(std::string &out, const char *name, const char *value)
+{
+	auto nl = strlen(name), vl = strlen(value);
+	out += static_cast<char>(nl);
+	out += static_cast<char>(vl);
+	out += name;
+	out += value;
+}
+
+/* read one record; @data receives its content without the padding */
+static bool get_record(int fd, uint8_t *type, std::string &data)
+{
+	uint8_t hdr[8];
+	if (!read_all(fd, hdr, sizeof(hdr)))
+		return false;
+	*type = hdr[1];
+	size_t len = (hdr[4] << 8) | hdr[5];
+	data.resize(len + hdr[6]);
+	if (!read_all(fd, data.data(), data.size()))
+		return false;
+	data.resize(len);
+	return true;
+}
+
+static void stub_serve(int fd)
+{
+	while (true) {
+		uint8_t type, flags = 0;
+		std::string data;
+		size_t stdin_len = 0;
+		bool in_done = false;
+		while (!in_done) {
+			if (!get_record(fd, &type, data)) {
+				close(fd);
+				return;
+			}
+			if (type == T_BEGIN_REQUEST && data.size() >= 3)
+				flags = data[2];
+			else if (type == T_STDIN && data.size() == 0)
+				in_done = true;
+			else if (type == T_STDIN)
+				stdin_len += data.size();
+		}
+		std::string out, body = "Status: 200\r\nContent-Type: text/plain\r\n\r\n" +
+		                        std::to_string(stdin_len);
+		put_record(out, T_STDOUT, body.data(), body.size());
+		put_record(out, T_STDOUT, "", 0);
+		uint8_t end[8]{};
+		put_record(out, T_END_REQUEST, end, sizeof(end));
+		if (!write_all(fd, out.data(), out.size()) ||
+		    !(flags & FCGI_KEEP_CONN)) {
+			close(fd);
+			return;
+		}
+	}
+}
+
+static void stub_main(int lsock)
+{
+	while (!g_stub_stop) {
+		int fd = accept(lsock, nullptr, nullptr);
+		if (fd < 0)
+			continue;
+		std::thread(stub_serve, fd).detach();
+	}
+}
+
+static int connect_to(const char *path)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	struct sockaddr_un un{};
+	un.sun_family = AF_UNIX;
+	snprintf(un.sun_path, sizeof(un.sun_path), "%s", path);
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&un), sizeof(un)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* returns the STDOUT payload, or an empty string on failure */
+static std::string do_request(int fd, const char *script,
+    const std::string &body, bool keep, bool spool)
+{
+	std::string out, params;
+	uint8_t begin[8] = {0, 1, static_cast<uint8_t>(keep ? FCGI_KEEP_CONN : 0)};
+	put_record(out, T_BEGIN_REQUEST, begin, sizeof(begin));
+	put_param(params, "REQUEST_METHOD", "POST");
+	put_param(params, "SCRIPT_FILENAME", script);
+	put_param(params, "CONTENT_LENGTH", std::to_string(body.size()).c_str());
+	put_record(out, T_PARAMS, params.data(), params.size());
+	put_record(out, T_PARAMS, "", 0);
+	if (!write_all(fd, out.data(), out.size()))
+		return {};
+	std::string src = body;
+	if (spool) {
+		char path[] = "/tmp/fcgibench-XXXXXX";
+		int tfd = mkstemp(path);
+		if (tfd < 0)
+			return {};
+		unlink(path);
+		bool ok = write_all(tfd, body.data(), body.size()) &&
+		          lseek(tfd, 0, SEEK_SET) == 0 &&
+		          read_all(tfd, src.data(), src.size());
+		close(tfd);
+		if (!ok)
+			return {};
+	}
+	for (size_t off = 0; off <= src.size(); ) {
+		uint16_t len = std::min(src.size() - off, static_cast<size_t>(0xFFF8));
+		out.clear();
+		put_record(out, T_STDIN, src.data() + off, len);
+		if (!write_all(fd, out.data(), out.size()))
+			return {};
+		if (len == 0)
+			break;
+		off += len;
+	}
+	std::string result, data;
+	uint8_t type;
+	while (get_record(fd, &type, data)) {
+		if (type == T_STDOUT)
+			result += data;
+		else if (type == T_END_REQUEST)
+			return result.empty() ? "-" : result;
+	}
+	return {};
+}
+
+static bool check_reply(const std::string &reply, size_t body_size, bool stub)
+{
+	if (reply.empty())
+		return false;
+	if (!stub)
+		return true;
+	auto pos = reply.find("\r\n\r\n");
+	return pos != reply.npos && reply.substr(pos + 4) == std::to_string(body_size);
+}
+
+int main(int argc, const char **argv)
+{
+	unsigned int nreq = argc >= 2 ? strtoul(argv[1], nullptr, 0) : 2000;
+	size_t body_size = argc >= 3 ? strtoul(argv[2], nullptr, 0) : 64 * 1024;
+	bool stub = argc < 5;
+	std::string sock_path = stub ? "" : argv[3];
+	const char *script = stub ? "/stub.php" : argv[4];
+	std::thread stub_thr;
+	int lsock = -1;
+
+	if (stub) {
+		char dir[] = "/tmp/fcgibench-XXXXXX";
+		if (mkdtemp(dir) == nullptr) {
+			perror("mkdtemp");
+			return EXIT_FAILURE;
+		}
+		sock_path = std::string(dir) + "/stub.sock";
+		lsock = socket(AF_UNIX, SOCK_STREAM, 0);
+		struct sockaddr_un un{};
+		un.sun_family = AF_UNIX;
+		snprintf(un.sun_path, sizeof(un.sun_path), "%s", sock_path.c_str());
+		if (lsock < 0 || bind(lsock, reinterpret_cast<struct sockaddr *>(&un),
+		    sizeof(un)) < 0 || listen(lsock, 64) < 0) {
+			perror("stub responder");
+			return EXIT_FAILURE;
+		}
+		stub_thr = std::thread(stub_main, lsock);
+	}
+	std::string body(body_size, 'x');
+	int ret = EXIT_SUCCESS;
+
+	printf("%-28s %10s %10s\n", "mode", "req/s", "us/req");
+	for (int keep = 0; keep <= 1; ++keep) {
+		int fd = -1;
+		auto start = clk::now();
+		unsigned int i;
+		for (i = 0; i < nreq; ++i) {
+			if (fd < 0)
+				fd = connect_to(sock_path.c_str());
+			if (fd < 0)
+				break;
+			auto reply = do_request(fd, script, body, keep, !keep);
+			if (!check_reply(reply, body_size, stub))
+				break;
+			if (!keep) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		auto s = std::chrono::duration<double>(clk::now() - start).count();
+		if (fd >= 0)
+			close(fd);
+		if (i != nreq) {
+			fprintf(stderr, "request %u failed (%s)\n", i,
+			        keep ? "keep-conn" : "connect-per-request");
+			ret = EXIT_FAILURE;
+			break;
+		}
+		printf("%-28s %10.0f %10.1f\n", keep ? "keep-conn, streamed" :
+		       "connect-per-request, spooled", s > 0 ? nreq / s : 0,
+		       nreq > 0 ? s * 1e6 / nreq : 0);
+	}
+	if (stub) {
+		g_stub_stop = true;
+		shutdown(lsock, SHUT_RDWR);
+		close(lsock);
+		stub_thr.join();
+		unlink(sock_path.c_str());
+		rmdir(sock_path.substr(0, sock_path.rfind('/')).c_str());
+	}
+	return ret;
+}
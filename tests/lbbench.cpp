@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Multi-threaded allocate/free throughput of a thread-safe LIB_BUFFER, with
+ * the magazine hit rate and shared-list contention. Each thread holds a
+ * few items at a time, like MIME parsing does with its blocks, and checks
+ * that nobody else was handed the same item meanwhile.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <gromox/double_list.hpp>
+#include <gromox/lib_buffer.hpp>
+
+using clk = std::chrono::steady_clock;
+
+static std::atomic<bool> g_bad;
+
+static void worker(LIB_BUFFER *pool, unsigned int tag, unsigned int rounds,
+    unsigned int hold)
+{
+	std::vector<uint32_t *> items(hold);
+	for (unsigned int r = 0; r < rounds; ++r) {
+		for (auto &p : items) {
+			p = static_cast<uint32_t *>(lib_buffer_get(pool));
+			if (p == nullptr || *p != 0) {
+				g_bad = true;
+				return;
+			}
+			*p = tag;
+		}
+		for (auto p : items) {
+			if (*p != tag)
+				g_bad = true;
+			lib_buffer_put(pool, p);
+		}
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	unsigned int max_thr = argc >= 2 ? strtoul(argv[1], nullptr, 0) :
+	                       std::max(std::thread::hardware_concurrency(), 1U);
+	unsigned int rounds = argc >= 3 ? strtoul(argv[2], nullptr, 0) : 200000;
+	unsigned int hold = argc >= 4 ? strtoul(argv[3], nullptr, 0) : 8;
+
+	printf("%7s %12s %8s %12s\n", "threads", "Mops/s", "hit%", "contended");
+	for (unsigned int nthr = 1; nthr <= max_thr; nthr *= 2) {
+		auto pool = lib_buffer_init(FILE_ALLOC_SIZE, 1024 * nthr, TRUE);
+		if (pool == nullptr) {
+			fprintf(stderr, "lib_buffer_init failed\n");
+			return EXIT_FAILURE;
+		}
+		std::vector<std::thread> thr;
+		auto start = clk::now();
+		for (unsigned int i = 0; i < nthr; ++i)
+			thr.emplace_back(worker, pool, i + 1, rounds, hold);
+		for (auto &t : thr)
+			t.join();
+		auto s = std::chrono::duration<double>(clk::now() - start).count();
+		double ops = 2.0 * nthr * rounds * hold;
+		double hits = lib_buffer_get_param(pool, MAG_HITS);
+		double misses = lib_buffer_get_param(pool, MAG_MISSES);
+		printf("%7u %12.2f %8.2f %12zu\n", nthr, s > 0 ? ops / s / 1e6 : 0,
+		       hits + misses > 0 ? 100 * hits / (hits + misses) : 0,
+		       lib_buffer_get_param(pool, POOL_CONTENDED));
+		if (lib_buffer_get_param(pool, ALLOCATED_NUM) != 0) {
+			fprintf(stderr, "items leaked\n");
+			g_bad = true;
+		}
+		lib_buffer_free(pool);
+		if (g_bad) {
+			fprintf(stderr, "item handed out twice or not zeroed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
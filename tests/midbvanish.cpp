@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Exercises the midb VANISHED bookkeeping behind P-VNSH (QRESYNC) on an
+ * in-memory database created from data/sqlite3_midb.txt (or argv[1]):
+ * sets since a modseq, known-uids filtering, paging, and the fallback to
+ * a full resync once the rows a client needs have been pruned.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sqlite3.h>
+#include <gromox/database.h>
+#include <gromox/fileio.h>
+#include "../exch/midb/vanished.h"
+
+using namespace gromox;
+
+#define CHECK(e) do { \
+		if (!(e)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #e); \
+			return EXIT_FAILURE; \
+		} \
+	} while (false)
+
+static constexpr uint64_t FID = 1;
+
+static uint64_t highest_modseq(sqlite3 *db)
+{
+	auto pstmt = gx_sql_prep(db, "SELECT modseq FROM folders WHERE folder_id=1");
+	if (pstmt == nullptr || sqlite3_step(pstmt) != SQLITE_ROW)
+		return 0;
+	return sqlite3_column_int64(pstmt, 0);
+}
+
+/* what mail_engine does for an expunge */
+static bool expunge(sqlite3 *db, uint32_t uid)
+{
+	char sql[256];
+	if (sqlite3_exec(db, "UPDATE folders SET modseq=modseq+1 WHERE folder_id=1",
+	    nullptr, nullptr, nullptr) != SQLITE_OK)
+		return false;
+	snprintf(sql, sizeof(sql), "DELETE FROM messages WHERE folder_id=1 AND uid=%u", uid);
+	if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+		return false;
+	vanished_record(db, FID, uid, highest_modseq(db));
+	return true;
+}
+
+/* all pages of one request, joined the way a client would see them */
+static bool collect(sqlite3 *db, uint64_t modseq, VANISHED_FILTER filter,
+    void *param, size_t page_size, std::string &out, BOOL *pb_full,
+    unsigned int *ppages)
+{
+	char buff[4096];
+	uint32_t after = 0, last;
+	BOOL b_full;
+	out.clear();
+	*ppages = 0;
+	*pb_full = false;
+	do {
+		if (!vanished_page(db, FID, modseq, after, filter, param,
+		    buff, page_size, &b_full, &last))
+			return false;
+		if (b_full)
+			*pb_full = TRUE;
+		if (*buff != '\0') {
+			if (!out.empty())
+				out += ',';
+			out += buff;
+		}
+		++*ppages;
+		after = last;
+	} while (after != 0);
+	return true;
+}
+
+static BOOL known_4_to_10(void *, uint32_t *pfirst, uint32_t *plast)
+{
+	if (*pfirst < 4)
+		*pfirst = 4;
+	if (*plast > 10)
+		*plast = 10;
+	return *pfirst <= *plast ? TRUE : false;
+}
+
+/* known-uids 4:6,9:12; counts the calls */
+static BOOL known_split(void *param, uint32_t *pfirst, uint32_t *plast)
+{
+	++*static_cast<unsigned int *>(param);
+	if (*pfirst <= 6) {
+		if (*pfirst < 4)
+			*pfirst = 4;
+		if (*plast > 6)
+			*plast = 6;
+	} else {
+		if (*pfirst < 9)
+			*pfirst = 9;
+		if (*plast > 12)
+			*plast = 12;
+	}
+	return *pfirst <= *plast ? TRUE : false;
+}
+
+int main(int argc, const char **argv)
+{
+	auto schema = slurp_file(argc >= 2 ? argv[1] : "data/sqlite3_midb.txt");
+	CHECK(!schema.empty());
+	sqlite3 *db = nullptr;
+	CHECK(sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE |
+	      SQLITE_OPEN_CREATE, nullptr) == SQLITE_OK);
+	CHECK(sqlite3_exec(db, schema.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK);
+	CHECK(sqlite3_exec(db, "INSERT INTO folders (folder_id, parent_fid,"
+	      " commit_max, name, uidnext) VALUES (1, 0, 0, 'inbox', 40)",
+	      nullptr, nullptr, nullptr) == SQLITE_OK);
+	for (unsigned int uid = 1; uid <= 40; ++uid) {
+		char sql[256];
+		snprintf(sql, sizeof(sql), "INSERT INTO messages (folder_id,"
+		         " mid_string, uid, subject, sender, rcpt, size, received)"
+		         " VALUES (1, 'm%u', %u, '', '', '', 0, 0)", uid, uid);
+		CHECK(sqlite3_exec(db, sql, nullptr, nullptr, nullptr) == SQLITE_OK);
+	}
+
+	std::string set;
+	BOOL b_full;
+	unsigned int pages;
+	auto m0 = highest_modseq(db);
+	CHECK(expunge(db, 3) && expunge(db, 4));
+	auto m1 = highest_modseq(db);
+	CHECK(expunge(db, 5) && expunge(db, 9));
+	std::string odd;
+	for (unsigned int uid = 11; uid <= 39; uid += 2) {
+		CHECK(expunge(db, uid));
+		odd += "," + std::to_string(uid);
+	}
+	auto m2 = highest_modseq(db);
+
+	/* CHANGEDSINCE/QRESYNC from various points */
+	CHECK(collect(db, m0, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(set == "3:5,9" + odd && !b_full && pages == 1);
+	CHECK(collect(db, m1, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(set == "5,9" + odd && !b_full);
+	CHECK(collect(db, m2, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(set.empty() && !b_full);
+
+	/* known-uids limits the report */
+	CHECK(collect(db, m0, known_4_to_10, nullptr, 4096, set, &b_full, &pages));
+	CHECK(set == "4:5,9" && !b_full);
+
+	/* small pages: nothing lost or repeated across the page boundaries */
+	CHECK(collect(db, m0, nullptr, nullptr, 24, set, &b_full, &pages));
+	CHECK(set == "3:5,9" + odd && pages > 1);
+
+	/* a modseq from the future (midb.sqlite3 rebuilt) forces a full resync */
+	CHECK(collect(db, m2 + 100, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(b_full && set == "3:5,9" + odd);
+
+	/* prune down to the newest two rows; m1 is now below the floor */
+	CHECK(vanished_prune(db, FID, 2));
+	auto pstmt = gx_sql_prep(db, "SELECT count(*), min(modseq) FROM vanished");
+	CHECK(pstmt != nullptr && sqlite3_step(pstmt) == SQLITE_ROW);
+	CHECK(sqlite3_column_int64(pstmt, 0) == 2);
+	pstmt.finalize();
+	CHECK(expunge(db, 40));
+	CHECK(collect(db, m1, nullptr, nullptr, 4096, set, &b_full, &pages));
+	/* every UID up to UIDNEXT that no longer exists */
+	CHECK(b_full && set == "3:5,9" + odd.substr(0, odd.size() - 3) + ",39:40");
+	CHECK(collect(db, m1, known_4_to_10, nullptr, 24, set, &b_full, &pages));
+	CHECK(b_full && set == "4:5,9");
+	/* full resyncs hand whole gaps to the filter, not single UIDs */
+	unsigned int calls = 0;
+	CHECK(collect(db, m1, known_split, &calls, 4096, set, &b_full, &pages));
+	CHECK(b_full && set == "4:5,9,11");
+	CHECK(calls < 30);
+	/* a gap far beyond the existing UIDs is one range */
+	CHECK(sqlite3_exec(db, "UPDATE folders SET uidnext=4000000000 WHERE "
+	      "folder_id=1", nullptr, nullptr, nullptr) == SQLITE_OK);
+	CHECK(collect(db, m1, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(b_full && set == "3:5,9" + odd.substr(0, odd.size() - 3) + ",39:4000000000");
+	/* clients at or above the floor still get the incremental answer */
+	CHECK(collect(db, m2, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(!b_full && set == "40");
+	CHECK(collect(db, m2 - 1, nullptr, nullptr, 4096, set, &b_full, &pages));
+	CHECK(!b_full && set == "39:40");
+	sqlite3_close(db);
+	printf("midbvanish: ok\n");
+	return EXIT_SUCCESS;
+}
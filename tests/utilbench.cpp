@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later WITH linking exception
+// SPDX-FileCopyrightText: 2021 grommunio GmbH
+// This file is part of Gromox.
+/*
+ * Throughput of the MIME transfer codecs and UTF-8 helpers from util.cpp on
+ * attachment-like payloads. Also cross-checks that each decoder reproduces
+ * the input of its encoder.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <gromox/util.hpp>
+
+using clk = std::chrono::steady_clock;
+
+static double mbps(size_t bytes, unsigned int rounds, clk::duration d)
+{
+	auto s = std::chrono::duration<double>(d).count();
+	return s > 0 ? bytes * static_cast<double>(rounds) / s / 1048576 : 0;
+}
+
+template<typename F> static void bench(const char *name, size_t bytes,
+    unsigned int rounds, F &&f)
+{
+	auto start = clk::now();
+	for (unsigned int i = 0; i < rounds; ++i)
+		f();
+	printf("%-14s %10.1f MB/s\n", name, mbps(bytes, rounds, clk::now() - start));
+}
+
+int main(int argc, const char **argv)
+{
+	size_t size = argc >= 2 ? strtoul(argv[1], nullptr, 0) : 4 << 20;
+	unsigned int rounds = argc >= 3 ? strtoul(argv[2], nullptr, 0) : 20;
+	std::mt19937 rng(42);
+
+	/* Binary attachment */
+	std::string bin(size, '\0');
+	for (auto &c : bin)
+		c = rng();
+	/* Mostly-ASCII text with some multi-byte characters */
+	static const char *const words[] = {"Hello", "world", "Grüße", "naïve", "€uro", "mail", "a=b", "\r\n"};
+	std::string text;
+	while (text.size() < size) {
+		text += words[rng() % GX_ARRAY_SIZE(words)];
+		text += ' ';
+	}
+
+	auto b64_len = (size + 2) / 3 * 4;
+	b64_len += 2 * b64_len / 76 + 2;
+	auto b64 = std::make_unique<char[]>(b64_len);
+	auto out_len = std::max(b64_len, 3 * text.size()) + 16;
+	auto out = std::make_unique<char[]>(out_len);
+	size_t b64_used = 0, outlen = 0;
+
+	bench("encode64_ex", size, rounds, [&]() {
+		encode64_ex(bin.data(), bin.size(), b64.get(), b64_len, &b64_used);
+	});
+	bench("decode64_ex", b64_used, rounds, [&]() {
+		decode64_ex(b64.get(), b64_used, out.get(), out_len, &outlen);
+	});
+	if (outlen != size || memcmp(out.get(), bin.data(), size) != 0) {
+		fprintf(stderr, "decode64_ex roundtrip mismatch\n");
+		return EXIT_FAILURE;
+	}
+	bench("encode64", size, rounds, [&]() {
+		encode64(bin.data(), bin.size(), b64.get(), b64_len, &b64_used);
+	});
+	bench("decode64", b64_used, rounds, [&]() {
+		decode64(b64.get(), b64_used, out.get(), &outlen);
+	});
+	if (outlen != size || memcmp(out.get(), bin.data(), size) != 0) {
+		fprintf(stderr, "decode64 roundtrip mismatch\n");
+		return EXIT_FAILURE;
+	}
+
+	auto qp = std::make_unique<char[]>(3 * text.size() + text.size() / 20 + 16);
+	ssize_t qp_len = 0;
+	bench("qp_encode_ex", text.size(), rounds, [&]() {
+		qp_len = qp_encode_ex(qp.get(), 3 * text.size() + 16, text.c_str(), text.size());
+	});
+	size_t qp_out = 0;
+	bench("qp_decode", qp_len, rounds, [&]() {
+		qp_out = qp_decode(out.get(), qp.get(), qp_len);
+	});
+	if (qp_out != text.size() || memcmp(out.get(), text.c_str(), qp_out) != 0) {
+		fprintf(stderr, "qp_decode roundtrip mismatch\n");
+		return EXIT_FAILURE;
+	}
+
+	BOOL ok = false;
+	bench("utf8_check", text.size(), rounds, [&]() { ok = utf8_check(text.c_str()); });
+	if (!ok) {
+		fprintf(stderr, "utf8_check rejected valid input\n");
+		return EXIT_FAILURE;
+	}
+	int chars = 0;
+	bench("utf8_len", text.size(), rounds, [&]() { utf8_len(text.c_str(), &chars); });
+	return EXIT_SUCCESS;
+}
@@ -7,6 +7,7 @@
 #include <libHX/string.h>
 #include <gromox/defs.h>
 #include <gromox/exmdb_rpc.hpp>
+#include <gromox/freebusy.hpp>
 #include <gromox/mapidefs.h>
 #include <gromox/scope.hpp>
 #include <gromox/socket.h>
@@ -88,14 +89,6 @@ struct QUERY_TABLE_REQUEST {
 	int32_t row_needed;
 };
 
-struct EVENT_NODE {
-	DOUBLE_LIST_NODE node;
-	time_t start_time;
-	time_t end_time;
-	EXCEPTIONINFO *pexception;
-	EXTENDEDEXCEPTION *pex_exception;
-};
-
 }
 
 using namespace gromox;
@@ -335,6 +328,39 @@ static BOOL exmdb_client_query_table(int sockd, const char *dir,
 	return ext_pull.g_tarray_set(pset) == EXT_ERR_SUCCESS ? TRUE : false;
 }
 
+/*
+ * Returns the exmdb_response code of the server, or -1 if the exchange
+ * itself failed.
+ */
+static int exmdb_client_get_freebusy_events(int sockd, const char *dir,
+	FREEBUSY_EVENT_ARRAY *pevents)
+{
+	BINARY tmp_bin;
+	EXMDB_REQUEST request;
+	EXMDB_RESPONSE response;
+	
+	request.call_id = exmdb_callid::GET_FREEBUSY_EVENTS;
+	request.dir = deconst(dir);
+	request.payload.get_freebusy_events.start_time = rop_util_unix_to_nttime(g_start_time);
+	request.payload.get_freebusy_events.end_time = rop_util_unix_to_nttime(g_end_time);
+	if (exmdb_ext_push_request(&request, &tmp_bin) != EXT_ERR_SUCCESS ||
+	    !exmdb_client_write_socket(sockd, &tmp_bin) ||
+	    !cl_rd_sock(sockd, &tmp_bin) || tmp_bin.cb < 1)
+		return -1;
+	if (tmp_bin.pb[0] != exmdb_response::SUCCESS)
+		return tmp_bin.pb[0];
+	if (tmp_bin.cb < 5)
+		return -1;
+	BINARY payload;
+	payload.cb = tmp_bin.cb - 5;
+	payload.pb = tmp_bin.pb + 5;
+	response.call_id = request.call_id;
+	if (exmdb_ext_pull_response(&payload, &response) != EXT_ERR_SUCCESS)
+		return -1;
+	*pevents = response.payload.get_freebusy_events.events;
+	return exmdb_response::SUCCESS;
+}
+
 static void cache_connection(const char *dir, int sockd)
 {
 	auto i = std::find_if(g_exmdb_list.begin(), g_exmdb_list.end(),
@@ -409,880 +435,6 @@ static int connect_exmdb(const char *dir)
 	return -1;
 }
 
-static std::shared_ptr<ICAL_COMPONENT> tzstruct_to_vtimezone(int year,
-	const char *tzid, TIMEZONESTRUCT *ptzstruct)
-{
-	int day;
-	int order;
-	std::shared_ptr<ICAL_VALUE> pivalue;
-	char tmp_buff[1024];
-	
-	auto pcomponent = ical_new_component("VTIMEZONE");
-	if (NULL == pcomponent) {
-		return NULL;
-	}
-	auto piline = ical_new_simple_line("TZID", tzid);
-	if (NULL == piline) {
-		return NULL;
-	}
-	if (pcomponent->append_line(piline) < 0)
-		return nullptr;
-	/* STANDARD component */
-	auto pcomponent1 = ical_new_component("STANDARD");
-	if (NULL == pcomponent1) {
-		return NULL;
-	}
-	if (pcomponent->append_comp(pcomponent1) < 0)
-		return nullptr;
-	if (0 == ptzstruct->daylightdate.month) {
-		strcpy(tmp_buff, "16010101T000000");
-	} else {
-		if (0 == ptzstruct->standarddate.year) {
-			day = ical_get_dayofmonth(year,
-				ptzstruct->standarddate.month,
-				ptzstruct->standarddate.day,
-				ptzstruct->standarddate.dayofweek);
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
-				year, (int)ptzstruct->standarddate.month,
-				day, (int)ptzstruct->standarddate.hour,
-				(int)ptzstruct->standarddate.minute,
-				(int)ptzstruct->standarddate.second);
-		} else if (1 == ptzstruct->standarddate.year) {
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
-				year, (int)ptzstruct->standarddate.month,
-				(int)ptzstruct->standarddate.day,
-				(int)ptzstruct->standarddate.hour,
-				(int)ptzstruct->standarddate.minute,
-				(int)ptzstruct->standarddate.second);
-		} else {
-			return NULL;
-		}
-	}
-	piline = ical_new_simple_line("DTSTART", tmp_buff);
-	if (NULL == piline) {
-		return NULL;
-	}
-	if (pcomponent1->append_line(piline) < 0)
-		return nullptr;
-	if (0 != ptzstruct->daylightdate.month) {
-		if (0 == ptzstruct->standarddate.year) {
-			piline = ical_new_line("RRULE");
-			if (NULL == piline) {
-				return NULL;
-			}
-			if (pcomponent1->append_line(piline) < 0)
-				return nullptr;
-			pivalue = ical_new_value("FREQ");
-			if (NULL == pivalue) {
-				return NULL;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return nullptr;
-			if (!pivalue->append_subval("YEARLY"))
-				return NULL;
-			pivalue = ical_new_value("BYDAY");
-			if (NULL == pivalue) {
-				return NULL;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return nullptr;
-			order = ptzstruct->standarddate.day;
-			if (5 == order) {
-				order = -1;
-			}
-			switch (ptzstruct->standarddate.dayofweek) {
-			case 0:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dSU", order);
-				break;
-			case 1:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dMO", order);
-				break;
-			case 2:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dTU", order);
-				break;
-			case 3:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dWE", order);
-				break;
-			case 4:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dTH", order);
-				break;
-			case 5:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dFR", order);
-				break;
-			case 6:
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%dSA", order);
-				break;
-			default:
-				return NULL;
-			}
-			if (!pivalue->append_subval(tmp_buff))
-				return NULL;
-			pivalue = ical_new_value("BYMONTH");
-			if (NULL == pivalue) {
-				return NULL;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return nullptr;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->standarddate.month);
-			if (!pivalue->append_subval(tmp_buff))
-				return NULL;
-		} else if (1 == ptzstruct->standarddate.year) {
-			piline = ical_new_line("RRULE");
-			if (NULL == piline) {
-				return NULL;
-			}
-			if (pcomponent1->append_line(piline) < 0)
-				return nullptr;
-			pivalue = ical_new_value("FREQ");
-			if (NULL == pivalue) {
-				return NULL;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return nullptr;
-			if (!pivalue->append_subval("YEARLY"))
-				return NULL;
-			pivalue = ical_new_value("BYMONTHDAY");
-			if (NULL == pivalue) {
-				return NULL;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return nullptr;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->standarddate.day);
-			pivalue = ical_new_value("BYMONTH");
-			if (NULL == pivalue) {
-				return NULL;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return nullptr;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->standarddate.month);
-			if (!pivalue->append_subval(tmp_buff))
-				return NULL;
-		}
-	}
-	int utc_offset = -(ptzstruct->bias + ptzstruct->daylightbias);
-	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
-	utc_offset = abs(utc_offset);
-	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
-	piline = ical_new_simple_line("TZOFFSETFROM", tmp_buff);
-	if (piline == nullptr)
-		return nullptr;
-	if (pcomponent1->append_line(piline) < 0)
-		return nullptr;
-	utc_offset = -(ptzstruct->bias + ptzstruct->standardbias);
-	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
-	utc_offset = abs(utc_offset);
-	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
-	piline = ical_new_simple_line("TZOFFSETTO", tmp_buff);
-	if (piline == nullptr)
-		return nullptr;
-	if (pcomponent1->append_line(piline) < 0)
-		return nullptr;
-	if (0 == ptzstruct->daylightdate.month) {
-		return pcomponent;
-	}
-	/* DAYLIGHT component */
-	pcomponent1 = ical_new_component("DAYLIGHT");
-	if (NULL == pcomponent1) {
-		return NULL;
-	}
-	if (pcomponent->append_comp(pcomponent1) < 0)
-		return nullptr;
-	if (0 == ptzstruct->daylightdate.year) {
-		day = ical_get_dayofmonth(year,
-			ptzstruct->daylightdate.month,
-			ptzstruct->daylightdate.day,
-			ptzstruct->daylightdate.dayofweek);
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
-			year, (int)ptzstruct->daylightdate.month,
-			day, (int)ptzstruct->daylightdate.hour,
-			(int)ptzstruct->daylightdate.minute,
-			(int)ptzstruct->daylightdate.second);
-	} else if (1 == ptzstruct->daylightdate.year) {
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02d",
-			year, (int)ptzstruct->daylightdate.month,
-			(int)ptzstruct->daylightdate.day,
-			(int)ptzstruct->daylightdate.hour,
-			(int)ptzstruct->daylightdate.minute,
-			(int)ptzstruct->daylightdate.second);
-	} else {
-		return NULL;
-	}
-	piline = ical_new_simple_line("DTSTART", tmp_buff);
-	if (NULL == piline) {
-		return NULL;
-	}
-	if (pcomponent1->append_line(piline) < 0)
-		return nullptr;
-	if (0 == ptzstruct->daylightdate.year) {
-		piline = ical_new_line("RRULE");
-		if (NULL == piline) {
-			return NULL;
-		}
-		if (pcomponent1->append_line(piline) < 0)
-			return nullptr;
-		pivalue = ical_new_value("FREQ");
-		if (NULL == pivalue) {
-			return NULL;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return nullptr;
-		if (!pivalue->append_subval("YEARLY"))
-			return NULL;
-		pivalue = ical_new_value("BYDAY");
-		if (NULL == pivalue) {
-			return NULL;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return nullptr;
-		order = ptzstruct->daylightdate.day;
-		if (5 == order) {
-			order = -1;
-		}
-		switch (ptzstruct->daylightdate.dayofweek) {
-		case 0:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dSU", order);
-			break;
-		case 1:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dMO", order);
-			break;
-		case 2:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dTU", order);
-			break;
-		case 3:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dWE", order);
-			break;
-		case 4:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dTH", order);
-			break;
-		case 5:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dFR", order);
-			break;
-		case 6:
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%dSA", order);
-			break;
-		default:
-			return NULL;
-		}
-		if (!pivalue->append_subval(tmp_buff))
-			return NULL;
-		pivalue = ical_new_value("BYMONTH");
-		if (NULL == pivalue) {
-			return NULL;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return nullptr;
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->daylightdate.month);
-		if (!pivalue->append_subval(tmp_buff))
-			return NULL;
-	} else if (1 == ptzstruct->daylightdate.year) {
-		piline = ical_new_line("RRULE");
-		if (NULL == piline) {
-			return NULL;
-		}
-		if (pcomponent1->append_line(piline) < 0)
-			return nullptr;
-		pivalue = ical_new_value("FREQ");
-		if (NULL == pivalue) {
-			return NULL;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return nullptr;
-		if (!pivalue->append_subval("YEARLY"))
-			return NULL;
-		pivalue = ical_new_value("BYMONTHDAY");
-		if (NULL == pivalue) {
-			return NULL;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return nullptr;
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->daylightdate.day);
-		pivalue = ical_new_value("BYMONTH");
-		if (NULL == pivalue) {
-			return NULL;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return nullptr;
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%d", (int)ptzstruct->daylightdate.month);
-		if (!pivalue->append_subval(tmp_buff))
-			return NULL;
-	}
-	utc_offset = -(ptzstruct->bias + ptzstruct->standardbias);
-	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
-	utc_offset = abs(utc_offset);
-	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
-	piline = ical_new_simple_line("TZOFFSETFROM", tmp_buff);
-	if (piline == nullptr)
-		return nullptr;
-	if (pcomponent1->append_line(piline) < 0)
-		return nullptr;
-	utc_offset = -(ptzstruct->bias + ptzstruct->daylightbias);
-	tmp_buff[0] = utc_offset >= 0 ? '+' : '-';
-	utc_offset = abs(utc_offset);
-	sprintf(tmp_buff + 1, "%02d%02d", utc_offset/60, utc_offset%60);
-	piline = ical_new_simple_line("TZOFFSETTO", tmp_buff);
-	if (piline == nullptr)
-		return nullptr;
-	if (pcomponent1->append_line(piline) < 0)
-		return nullptr;
-	return pcomponent;
-}
-
-static BOOL recurrencepattern_to_rrule(std::shared_ptr<ICAL_COMPONENT> ptz_component,
-	time_t whole_start_time, const APPOINTMENTRECURRENCEPATTERN *papprecurr,
-	ICAL_RRULE *pirrule)
-{
-	ICAL_TIME itime;
-	time_t unix_time;
-	uint64_t nt_time;
-	std::shared_ptr<ICAL_VALUE> pivalue;
-	char tmp_buff[1024];
-	
-	auto piline = ical_new_line("RRULE");
-	if (NULL == piline) {
-		return FALSE;
-	}
-	switch (papprecurr->recurrencepattern.patterntype) {
-	case PATTERNTYPE_DAY:
-		pivalue = ical_new_value("FREQ");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (!pivalue->append_subval("DAILY"))
-			return FALSE;
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-			papprecurr->recurrencepattern.period/1440);
-		pivalue = ical_new_value("INTERVAL");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (!pivalue->append_subval(tmp_buff))
-			return FALSE;
-		break;
-	case PATTERNTYPE_WEEK:
-		pivalue = ical_new_value("FREQ");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (!pivalue->append_subval("WEEKLY"))
-			return FALSE;
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-			papprecurr->recurrencepattern.period);
-		pivalue = ical_new_value("INTERVAL");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (!pivalue->append_subval(tmp_buff))
-			return FALSE;
-		pivalue = ical_new_value("BYDAY");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (WEEKRECURRENCEPATTERN_SU&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("SU"))
-				return FALSE;
-		}
-		if (WEEKRECURRENCEPATTERN_M&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("MO"))
-				return FALSE;
-		}
-		if (WEEKRECURRENCEPATTERN_TU&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("TU"))
-				return FALSE;
-		}
-		if (WEEKRECURRENCEPATTERN_W&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("WE"))
-				return FALSE;
-		}
-		if (WEEKRECURRENCEPATTERN_TH&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("TH"))
-				return FALSE;
-		}
-		if (WEEKRECURRENCEPATTERN_F&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("FR"))
-				return FALSE;
-		}
-		if (WEEKRECURRENCEPATTERN_SA&
-			papprecurr->recurrencepattern.
-			patterntypespecific.weekrecurrence) {
-			if (!pivalue->append_subval("SA"))
-				return FALSE;
-		}
-		break;
-	case PATTERNTYPE_MONTH:
-	case PATTERNTYPE_HJMONTH:
-		pivalue = ical_new_value("FREQ");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (0 != papprecurr->recurrencepattern.period%12) {
-			if (!pivalue->append_subval("MONTHLY"))
-				return FALSE;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-				papprecurr->recurrencepattern.period);
-			pivalue = ical_new_value("INTERVAL");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-			pivalue = ical_new_value("BYMONTHDAY");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (31 == papprecurr->recurrencepattern.
-				patterntypespecific.dayofmonth) {
-				strcpy(tmp_buff, "-1");
-			} else {
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-					papprecurr->recurrencepattern.
-					patterntypespecific.dayofmonth);
-			}
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-		} else {
-			if (!pivalue->append_subval("YEARLY"))
-				return FALSE;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-				papprecurr->recurrencepattern.period/12);
-			pivalue = ical_new_value("INTERVAL");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-			pivalue = ical_new_value("BYMONTHDAY");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (31 == papprecurr->recurrencepattern.
-				patterntypespecific.dayofmonth) {
-				strcpy(tmp_buff, "-1");
-			} else {
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-					papprecurr->recurrencepattern.
-					patterntypespecific.dayofmonth);
-			}
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-			pivalue = ical_new_value("BYMONTH");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			ical_get_itime_from_yearday(1601, 
-				papprecurr->recurrencepattern.firstdatetime/
-				1440 + 1, &itime);
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%u", itime.month);
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-		}
-		break;
-	case PATTERNTYPE_MONTHNTH:
-	case PATTERNTYPE_HJMONTHNTH:
-		pivalue = ical_new_value("FREQ");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (0 != papprecurr->recurrencepattern.period%12) {
-			if (!pivalue->append_subval("MONTHLY"))
-				return FALSE;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-				papprecurr->recurrencepattern.period);
-			pivalue = ical_new_value("INTERVAL");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-			pivalue = ical_new_value("BYDAY");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (WEEKRECURRENCEPATTERN_SU&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("SU"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_M&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("MO"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_TU&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("TU"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_W&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("WE"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_TH&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("TH"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_F&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("FR"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_SA&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("SA"))
-					return FALSE;
-			}
-			pivalue = ical_new_value("BYSETPOS");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (5 == papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.recurrencenum) {
-				strcpy(tmp_buff, "-1");
-			} else {
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-					papprecurr->recurrencepattern.
-					patterntypespecific.monthnth.recurrencenum);
-			}
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-		} else {
-			if (!pivalue->append_subval("YEARLY"))
-				return FALSE;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-				papprecurr->recurrencepattern.period/12);
-			pivalue = ical_new_value("INTERVAL");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-			pivalue = ical_new_value("BYDAY");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (WEEKRECURRENCEPATTERN_SU&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("SU"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_M&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("MO"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_TU&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("TU"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_W&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("WE"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_TH&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("TH"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_F&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("FR"))
-					return FALSE;
-			}
-			if (WEEKRECURRENCEPATTERN_SA&papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.weekrecurrence) {
-				if (!pivalue->append_subval("SA"))
-					return FALSE;
-			}
-			pivalue = ical_new_value("BYSETPOS");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			if (5 == papprecurr->recurrencepattern.
-				patterntypespecific.monthnth.recurrencenum) {
-				strcpy(tmp_buff, "-1");
-			} else {
-				snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-					papprecurr->recurrencepattern.
-					patterntypespecific.monthnth.recurrencenum);
-			}
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-			pivalue = ical_new_value("BYMONTH");
-			if (NULL == pivalue) {
-				return FALSE;
-			}
-			if (piline->append_value(pivalue) < 0)
-				return false;
-			snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-				papprecurr->recurrencepattern.firstdatetime);
-			if (!pivalue->append_subval(tmp_buff))
-				return FALSE;
-		}
-		break;
-	default:
-		return FALSE;
-	}
-	if (ENDTYPE_AFTER_N_OCCURRENCES ==
-		papprecurr->recurrencepattern.endtype) {
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%u",
-			papprecurr->recurrencepattern.occurrencecount);
-		pivalue = ical_new_value("COUNT");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (!pivalue->append_subval(tmp_buff))
-			return FALSE;
-	} else if (ENDTYPE_AFTER_DATE ==
-		papprecurr->recurrencepattern.endtype) {
-		nt_time = papprecurr->recurrencepattern.enddate
-						+ papprecurr->starttimeoffset;
-		nt_time *= 600000000;
-		unix_time = rop_util_nttime_to_unix(nt_time);
-		ical_utc_to_datetime(ptz_component, unix_time, &itime);
-		snprintf(tmp_buff, arsizeof(tmp_buff), "%04d%02d%02dT%02d%02d%02dZ",
-			itime.year, itime.month, itime.day,
-			itime.hour, itime.minute, itime.second);
-		pivalue = ical_new_value("UNTIL");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		if (!pivalue->append_subval(tmp_buff))
-			return FALSE;
-	}
-	if (PATTERNTYPE_WEEK == papprecurr->recurrencepattern.patterntype) {
-		pivalue = ical_new_value("WKST");
-		if (NULL == pivalue) {
-			return FALSE;
-		}
-		if (piline->append_value(pivalue) < 0)
-			return false;
-		switch (papprecurr->recurrencepattern.firstdow) {
-		case 0:
-			if (!pivalue->append_subval("SU"))
-				return FALSE;
-			break;
-		case 1:
-			if (!pivalue->append_subval("MO"))
-				return FALSE;
-			break;
-		case 2:
-			if (!pivalue->append_subval("TU"))
-				return FALSE;
-			break;
-		case 3:
-			if (!pivalue->append_subval("WE"))
-				return FALSE;
-			break;
-		case 4:
-			if (!pivalue->append_subval("TH"))
-				return FALSE;
-			break;
-		case 5:
-			if (!pivalue->append_subval("FR"))
-				return FALSE;
-			break;
-		case 6:
-			if (!pivalue->append_subval("SA"))
-				return FALSE;
-			break;
-		default:
-			return FALSE;
-		}
-	}
-	return ical_parse_rrule(
-		ptz_component, whole_start_time,
-		&piline->value_list, pirrule) ? TRUE : false;
-}
-
-static BOOL find_recurrence_times(std::shared_ptr<ICAL_COMPONENT> ptz_component,
-	time_t whole_start_time, const APPOINTMENTRECURRENCEPATTERN *papprecurr,
-	time_t start_time, time_t end_time, DOUBLE_LIST *plist)
-{
-	int i;
-	ICAL_TIME itime;
-	time_t tmp_time;
-	time_t tmp_time1;
-	uint64_t nt_time;
-	ICAL_RRULE irrule;
-	EVENT_NODE *pevnode;
-	
-	if (FALSE == recurrencepattern_to_rrule(
-		ptz_component, whole_start_time,
-		papprecurr, &irrule)) {
-		return FALSE;	
-	}
-	double_list_init(plist);
-	do {
-		itime = ical_rrule_instance_itime(&irrule);
-		ical_itime_to_utc(ptz_component, itime, &tmp_time);
-		if (tmp_time < start_time) {
-			continue;
-		}
-		ical_itime_to_utc(NULL, itime, &tmp_time1);
-		for (i=0; i<papprecurr->exceptioncount; i++) {
-			nt_time = papprecurr->pexceptioninfo[i].originalstartdate;
-			nt_time *= 600000000;
-			if (tmp_time1 == rop_util_nttime_to_unix(nt_time)) {
-				break;
-			}
-		}
-		if (i < papprecurr->exceptioncount) {
-			continue;
-		}
-		pevnode = static_cast<EVENT_NODE *>(malloc(sizeof(EVENT_NODE)));
-		pevnode->node.pdata = pevnode;
-		pevnode->start_time = tmp_time;
-		pevnode->end_time = tmp_time + (papprecurr->endtimeoffset
-								- papprecurr->starttimeoffset)*60;
-		pevnode->pexception = NULL;
-		pevnode->pex_exception = NULL;
-		double_list_append_as_tail(plist, &pevnode->node);
-		if (tmp_time >= end_time) {
-			break;
-		}
-	} while (ical_rrule_iterate(&irrule));
-	for (i=0; i<papprecurr->exceptioncount; i++) {
-		nt_time = papprecurr->pexceptioninfo[i].startdatetime;
-		nt_time *= 600000000;
-		tmp_time = rop_util_nttime_to_unix(nt_time);
-		ical_utc_to_datetime(NULL, tmp_time, &itime);
-		ical_itime_to_utc(ptz_component, itime, &tmp_time);
-		if (tmp_time >= start_time && tmp_time <= end_time) {
-			pevnode = static_cast<EVENT_NODE *>(malloc(sizeof(EVENT_NODE)));
-			pevnode->node.pdata = pevnode;
-			pevnode->start_time = tmp_time;
-			nt_time = papprecurr->pexceptioninfo[i].enddatetime;
-			nt_time *= 600000000;
-			tmp_time = rop_util_nttime_to_unix(nt_time);
-			ical_utc_to_datetime(NULL, tmp_time, &itime);
-			ical_itime_to_utc(ptz_component, itime, &tmp_time);
-			pevnode->end_time = tmp_time;
-			pevnode->pexception = papprecurr->pexceptioninfo + i;
-			pevnode->pex_exception = papprecurr->pextendedexception + i;
-			double_list_append_as_tail(plist, &pevnode->node);
-		}
-	}
-	return TRUE;
-}
-
-static BOOL make_ical_uid(BINARY *pglobal_obj, char *uid_buff)
-{
-	GUID guid;
-	time_t cur_time;
-	EXT_PULL ext_pull;
-	EXT_PUSH ext_push;
-	char tmp_buff[256];
-	char tmp_buff1[256];
-	GLOBALOBJECTID globalobjectid;
-	
-	if (NULL != pglobal_obj) {
-		ext_pull.init(pglobal_obj->pb, pglobal_obj->cb, malloc, 0);
-		if (ext_pull.g_goid(&globalobjectid) != EXT_ERR_SUCCESS)
-			return FALSE;
-		if (0 == memcmp(globalobjectid.data.pb,
-			"\x76\x43\x61\x6c\x2d\x55\x69\x64\x01\x00\x00\x00", 12)) {
-			if (globalobjectid.data.cb - 12 > sizeof(tmp_buff) - 1) {
-				memcpy(tmp_buff, globalobjectid.data.pb + 12,
-									sizeof(tmp_buff) - 1);
-				tmp_buff[sizeof(tmp_buff) - 1] = '\0';
-			} else {
-				memcpy(tmp_buff, globalobjectid.data.pb + 12,
-								globalobjectid.data.cb - 12);
-				tmp_buff[globalobjectid.data.cb - 12] = '\0';
-			}
-			strcpy(uid_buff, tmp_buff);
-		} else {
-			globalobjectid.year = 0;
-			globalobjectid.month = 0;
-			globalobjectid.day = 0;
-			if (!ext_push.init(tmp_buff, sizeof(tmp_buff), 0) ||
-			    ext_push.p_goid(&globalobjectid) != EXT_ERR_SUCCESS)
-				return false;
-			if (!encode_hex_binary(tmp_buff, ext_push.m_offset,
-			    tmp_buff1, sizeof(tmp_buff1)))
-				return FALSE;
-			HX_strupper(tmp_buff1);
-			strcpy(uid_buff, tmp_buff1);
-		}
-	} else {
-		time(&cur_time);
-		memset(&globalobjectid, 0, sizeof(GLOBALOBJECTID));
-		memcpy(globalobjectid.arrayid,
-			"\x04\x00\x00\x00\x82\x00\xE0\x00"
-			"\x74\xC5\xB7\x10\x1A\x82\xE0\x08", 16);
-		globalobjectid.creationtime = rop_util_unix_to_nttime(cur_time);
-		globalobjectid.data.cb = 16;
-		globalobjectid.data.pv = tmp_buff1;
-		guid = guid_random_new();
-		if (!ext_push.init(tmp_buff1, 16, 0) ||
-		    ext_push.p_guid(&guid) != EXT_ERR_SUCCESS ||
-		    !ext_push.init(tmp_buff, sizeof(tmp_buff), 0) ||
-		    ext_push.p_goid(&globalobjectid) != EXT_ERR_SUCCESS)
-			return false;
-		if (!encode_hex_binary(tmp_buff, ext_push.m_offset, tmp_buff1,
-		    sizeof(tmp_buff1)))
-			return FALSE;
-		HX_strupper(tmp_buff1);
-		strcpy(uid_buff, tmp_buff1);
-	}
-	return TRUE;
-}
-
 static void output_event(time_t start_time, time_t end_time,
 	uint32_t busy_type, const char *uid, const char *subject,
 	const char *location, BOOL b_meeting, BOOL b_recurring,
@@ -1344,144 +496,54 @@ static void output_event(time_t start_time, time_t end_time,
 	printf(b_private ? "\"IsPrivate\":true}" : "\"IsPrivate\":false}");
 }
 
-static BOOL get_freebusy(const char *dir)
+static void output_events_begin(const char *dir, uint32_t permission)
+{
+	printf("{\"dir\":\"%s\", \"permission\":", dir);
+	printf((permission & (frightsFreeBusyDetailed | frightsReadAny)) ?
+	       "\"detailed\", " : "\"simple\", ");
+	printf("\"events\":[");
+}
+
+/*
+ * Fallback for exmdb servers without GET_FREEBUSY_EVENTS: scan the
+ * calendar's content table and expand recurrences here.
+ */
+static BOOL get_freebusy_table(int sockd, const char *dir, uint32_t permission)
 {
-	int sockd;
-	void *pvalue;
-	BOOL b_first;
-	char *psubject;
-	BOOL b_private1 = false, b_meeting1;
-	char *plocation;
-	BOOL b_reminder1;
 	uint8_t tmp_true;
 	uint32_t table_id;
-	EXT_PULL ext_pull;
-	char uid_buff[256];
 	uint32_t row_count;
 	TARRAY_SET tmp_set;
-	uint32_t busy_type;
-	EVENT_NODE *pevnode;
 	uint64_t end_nttime;
-	uint32_t permission;
 	PROPID_ARRAY propids;
-	DOUBLE_LIST tmp_list;
-	time_t whole_end_time;
 	uint64_t start_nttime;
 	PROPTAG_ARRAY proptags;
-	uint32_t pidlidclipend;
-	uint32_t pidlidprivate;
-	TIMEZONESTRUCT tzstruct;
-	DOUBLE_LIST_NODE *pnode;
-	time_t whole_start_time;
-	uint32_t pidlidlocation;
 	RESTRICTION restriction;
-	uint32_t pidlidrecurring;
 	PROPNAME_ARRAY propnames;
-	uint32_t tmp_proptags[13];
-	uint32_t pidlidbusystatus;
+	uint32_t tags[FB_PROP_COUNT];
+	uint32_t tmp_proptags[FB_PROP_COUNT+1];
 	RESTRICTION *prestriction;
 	RESTRICTION *prestriction1;
 	RESTRICTION *prestriction2;
 	RESTRICTION *prestriction3;
-	uint32_t pidlidreminderset;
-	std::shared_ptr<ICAL_COMPONENT> ptz_component;
-	uint32_t pidlidtimezonestruct;
-	uint32_t pidlidglobalobjectid;
-	uint32_t pidlidappointmentrecur;
-	PROPERTY_NAME tmp_propnames[13];
-	uint32_t pidlidappointmentsubtype;
-	uint32_t pidlidappointmentendwhole;
-	uint32_t pidlidappointmentstateflags;
-	uint32_t pidlidappointmentstartwhole;
-	APPOINTMENTRECURRENCEPATTERN apprecurr;
-	
+	PROPERTY_NAME tmp_propnames[FB_PROP_COUNT];
 	
 	start_nttime = rop_util_unix_to_nttime(g_start_time);
 	end_nttime = rop_util_unix_to_nttime(g_end_time);
-	propnames.count = 13;
+	propnames.count = FB_PROP_COUNT;
 	propnames.ppropname = tmp_propnames;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[0].guid);
-	tmp_propnames[0].kind = MNID_ID;
-	tmp_propnames[0].lid = PidLidAppointmentStartWhole;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[1].guid);
-	tmp_propnames[1].kind = MNID_ID;
-	tmp_propnames[1].lid = PidLidAppointmentEndWhole;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[2].guid);
-	tmp_propnames[2].kind = MNID_ID;
-	tmp_propnames[2].lid = PidLidBusyStatus;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[3].guid);
-	tmp_propnames[3].kind = MNID_ID;
-	tmp_propnames[3].lid = PidLidRecurring;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[4].guid);
-	tmp_propnames[4].kind = MNID_ID;
-	tmp_propnames[4].lid = PidLidAppointmentRecur;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[5].guid);
-	tmp_propnames[5].kind = MNID_ID;
-	tmp_propnames[5].lid = PidLidAppointmentSubType;
-	rop_util_get_common_pset(PSETID_COMMON, &tmp_propnames[6].guid);
-	tmp_propnames[6].kind = MNID_ID;
-	tmp_propnames[6].lid = PidLidPrivate;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[7].guid);
-	tmp_propnames[7].kind = MNID_ID;
-	tmp_propnames[7].lid = PidLidAppointmentStateFlags;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[8].guid);
-	tmp_propnames[8].kind = MNID_ID;
-	tmp_propnames[8].lid = PidLidClipEnd;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[9].guid);
-	tmp_propnames[9].kind = MNID_ID;
-	tmp_propnames[9].lid = PidLidLocation;
-	rop_util_get_common_pset(PSETID_COMMON, &tmp_propnames[10].guid);
-	tmp_propnames[10].kind = MNID_ID;
-	tmp_propnames[10].lid = PidLidReminderSet;
-	rop_util_get_common_pset(PSETID_MEETING, &tmp_propnames[11].guid);
-	tmp_propnames[11].kind = MNID_ID;
-	tmp_propnames[11].lid = PidLidGlobalObjectId;
-	rop_util_get_common_pset(PSETID_APPOINTMENT, &tmp_propnames[12].guid);
-	tmp_propnames[12].kind = MNID_ID;
-	tmp_propnames[12].lid = PidLidTimeZoneStruct;
-	
-	sockd = connect_exmdb(dir);
-	if (-1 == sockd) {
-		return FALSE;
-	}
+	freebusy_propnames(tmp_propnames);
 	if (FALSE == exmdb_client_get_named_propids(
 		sockd, dir, FALSE, &propnames, &propids)) {
 		return FALSE;
 	}
-	if (propids.count != propnames.count) {
+	if (!freebusy_proptags(&propids, tags))
 		return FALSE;
-	}
-	pidlidappointmentstartwhole = PROP_TAG(PT_SYSTIME, propids.ppropid[0]);
-	pidlidappointmentendwhole = PROP_TAG(PT_SYSTIME, propids.ppropid[1]);
-	pidlidbusystatus = PROP_TAG(PT_LONG, propids.ppropid[2]);
-	pidlidrecurring = PROP_TAG(PT_BOOLEAN, propids.ppropid[3]);
-	pidlidappointmentrecur = PROP_TAG(PT_BINARY, propids.ppropid[4]);
-	pidlidappointmentsubtype = PROP_TAG(PT_BOOLEAN, propids.ppropid[5]);
-	pidlidprivate = PROP_TAG(PT_BOOLEAN, propids.ppropid[6]);
-	pidlidappointmentstateflags = PROP_TAG(PT_LONG, propids.ppropid[7]);
-	pidlidclipend = PROP_TAG(PT_SYSTIME, propids.ppropid[8]);
-	pidlidlocation = PROP_TAG(PT_UNICODE, propids.ppropid[9]);
-	pidlidreminderset = PROP_TAG(PT_BOOLEAN, propids.ppropid[10]);
-	pidlidglobalobjectid = PROP_TAG(PT_BINARY, propids.ppropid[11]);
-	pidlidtimezonestruct = PROP_TAG(PT_BINARY, propids.ppropid[12]);
+	auto pidlidappointmentstartwhole = tags[FB_PROP_START];
+	auto pidlidappointmentendwhole = tags[FB_PROP_END];
+	auto pidlidrecurring = tags[FB_PROP_RECURRING];
+	auto pidlidclipend = tags[FB_PROP_CLIPEND];
 	
-	if (NULL != g_username) {
-		if (FALSE == exmdb_client_check_folder_permission(
-			sockd, dir, rop_util_make_eid_ex(1, PRIVATE_FID_CALENDAR),
-			g_username, &permission)) {
-			close(sockd);
-			cache_connection(dir, -1);
-			return FALSE;
-		}
-		if (!(permission & (frightsFreeBusySimple |
-		    frightsFreeBusyDetailed | frightsReadAny))) {
-			printf("{\"dir\":\"%s\", \"permission\":\"none\"}\n", dir);
-			cache_connection(dir, sockd);
-			return TRUE;
-		}
-	} else {
-		permission = frightsFreeBusyDetailed | frightsReadAny;
-	}
 	tmp_true = 1;
 	restriction.rt = RES_OR;
 	restriction.pres = malloc(sizeof(RESTRICTION_AND_OR));
@@ -1625,159 +687,99 @@ static BOOL get_freebusy(const char *dir)
 		0, rop_util_make_eid_ex(1, PRIVATE_FID_CALENDAR),
 		NULL, TABLE_FLAG_NONOTIFICATIONS, &restriction, NULL,
 		&table_id, &row_count)) {
-		close(sockd);
-		cache_connection(dir, -1);
 		return FALSE;
 	}
-	proptags.count = 13;
+	proptags.count = FB_PROP_COUNT + 1;
 	proptags.pproptag = tmp_proptags;
-	tmp_proptags[0] = pidlidappointmentstartwhole;
-	tmp_proptags[1] = pidlidappointmentendwhole;
-	tmp_proptags[2] = pidlidbusystatus;
-	tmp_proptags[3] = pidlidrecurring;
-	tmp_proptags[4] = pidlidappointmentrecur;
-	tmp_proptags[5] = pidlidappointmentsubtype;
-	tmp_proptags[6] = pidlidprivate;
-	tmp_proptags[7] = pidlidappointmentstateflags;
-	tmp_proptags[8] = pidlidlocation;
-	tmp_proptags[9] = pidlidreminderset;
-	tmp_proptags[10] = pidlidglobalobjectid;
-	tmp_proptags[11] = pidlidtimezonestruct;
-	tmp_proptags[12] = PR_SUBJECT;
+	memcpy(tmp_proptags, tags, sizeof(tags));
+	tmp_proptags[FB_PROP_COUNT] = PR_SUBJECT;
 	if (FALSE == exmdb_client_query_table(sockd, dir, NULL,
 		0, table_id, &proptags, 0, row_count, &tmp_set)) {
-		close(sockd);
-		cache_connection(dir, -1);
 		return FALSE;	
 	}
-	printf("{\"dir\":\"%s\", \"permission\":", dir);
-	printf((permission & (frightsFreeBusyDetailed | frightsReadAny)) ?
-	       "\"detailed\", " : "\"simple\", ");
-	printf("\"events\":[");
-	b_first = FALSE;
+	output_events_begin(dir, permission);
+	BOOL b_first = FALSE;
+	std::vector<freebusy_event> events;
 	for (size_t i = 0; i < tmp_set.count; ++i) {
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidappointmentstartwhole);
-		if (NULL == pvalue) {
+		events.clear();
+		if (!freebusy_expand(tmp_set.pparray[i], tags, g_start_time,
+		    g_end_time, malloc, events))
 			continue;
-		}
-		whole_start_time = rop_util_nttime_to_unix(*(uint64_t*)pvalue);
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidappointmentendwhole);
-		if (NULL == pvalue) {
-			continue;
-		}
-		whole_end_time = rop_util_nttime_to_unix(*(uint64_t*)pvalue);
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidglobalobjectid);
-		if (!make_ical_uid(static_cast<BINARY *>(pvalue), uid_buff))
-			continue;
-		psubject = static_cast<char *>(tpropval_array_get_propval(tmp_set.pparray[i], PR_SUBJECT));
-		plocation = static_cast<char *>(tpropval_array_get_propval(
-		            tmp_set.pparray[i], pidlidlocation));
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidreminderset);
-		BOOL b_reminder = pvalue == nullptr || *static_cast<uint8_t *>(pvalue) == 0 ? false : TRUE;
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidprivate);
-		BOOL b_private = pvalue == nullptr || *static_cast<uint8_t *>(pvalue) == 0 ? false : TRUE;
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidbusystatus);
-		if (NULL == pvalue) {
-			busy_type = 0;
-		} else {
-			busy_type = *(uint32_t*)pvalue;
-			if (busy_type > 4) {
-				busy_type = 0;
-			}
-		}
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidappointmentstateflags);
-		BOOL b_meeting = pvalue == nullptr ? false :
-		                 (*static_cast<uint32_t *>(pvalue) & 1) ? TRUE : false;
-		pvalue = tpropval_array_get_propval(
-			tmp_set.pparray[i], pidlidrecurring);
-		if (NULL != pvalue && 0 != *(uint8_t*)pvalue) {
-			pvalue = tpropval_array_get_propval(
-				tmp_set.pparray[i], pidlidtimezonestruct);
-			if (NULL == pvalue) {
-				ptz_component = NULL;
-			} else {
-				ext_pull.init(static_cast<BINARY *>(pvalue)->pb,
-					static_cast<BINARY *>(pvalue)->cb, malloc, EXT_FLAG_UTF16);
-				if (ext_pull.g_tzstruct(&tzstruct) != EXT_ERR_SUCCESS)
-					continue;	
-				ptz_component = tzstruct_to_vtimezone(
-						1600, "timezone", &tzstruct);
-				if (NULL == ptz_component) {
-					continue;
-				}
-			}
-			pvalue = tpropval_array_get_propval(
-				tmp_set.pparray[i], pidlidappointmentrecur);
-			if (NULL == pvalue) {
-				continue;
-			}
-			ext_pull.init(static_cast<BINARY *>(pvalue)->pb,
-				static_cast<BINARY *>(pvalue)->cb, malloc, EXT_FLAG_UTF16);
-			if (ext_pull.g_apptrecpat(&apprecurr) != EXT_ERR_SUCCESS)
-				continue;
-			if (FALSE == find_recurrence_times(ptz_component,
-				whole_start_time, &apprecurr, g_start_time,
-				g_end_time, &tmp_list)) {
-				continue;	
-			}
-			while ((pnode = double_list_pop_front(&tmp_list)) != nullptr) {
-				pevnode = (EVENT_NODE*)pnode->pdata;
-				if (NULL != pevnode->pexception &&
-					NULL != pevnode->pex_exception) {
-					if (pevnode->pexception->overrideflags &
-						OVERRIDEFLAG_MEETINGTYPE) {
-						b_meeting1 = (pevnode->pexception->meetingtype & 1) ? TRUE : false;
-					} else {
-						b_meeting1 = b_meeting;
-					}
-					if (pevnode->pexception->overrideflags &
-						OVERRIDEFLAG_REMINDER) {
-						b_reminder1 = pevnode->pexception->reminderset == 0 ? false : TRUE;
-					} else {
-						b_reminder1 = b_reminder;
-					}
-					uint32_t busy_type1 = (pevnode->pexception->overrideflags & OVERRIDEFLAG_BUSYSTATUS) ?
-					                      pevnode->pexception->busystatus : busy_type;
-					auto psubject1  = (pevnode->pexception->overrideflags & OVERRIDEFLAG_SUBJECT) ?
-					                  pevnode->pex_exception->subject : psubject;
-					auto plocation1 = (pevnode->pexception->overrideflags & OVERRIDEFLAG_LOCATION) ?
-					                  pevnode->pex_exception->location : plocation;
-					if (TRUE == b_first) {
-						printf(",");
-					}
-					b_first = TRUE;
-					output_event(pevnode->start_time, pevnode->end_time,
-						busy_type1, uid_buff, psubject1, plocation1,
-						b_meeting1, TRUE, TRUE, b_reminder1, b_private1);
-				} else {
-					if (TRUE == b_first) {
-						printf(",");
-					}
-					b_first = TRUE;
-					output_event(pevnode->start_time, pevnode->end_time,
-						busy_type, uid_buff, psubject, plocation,
-						b_meeting, TRUE, FALSE, b_reminder, b_private);
-				}
-			}
-		} else {
+		for (const auto &ev : events) {
 			if (TRUE == b_first) {
 				printf(",");
 			}
 			b_first = TRUE;
-			output_event(whole_start_time, whole_end_time,
-				busy_type, uid_buff, psubject, plocation,
-				b_meeting, FALSE, FALSE, b_reminder, b_private);
+			output_event(ev.start_time, ev.end_time, ev.busy_type,
+				ev.id.c_str(),
+				ev.has_subject ? ev.subject.c_str() : nullptr,
+				ev.has_location ? ev.location.c_str() : nullptr,
+				ev.b_meeting, ev.b_recurring, ev.b_exception,
+				ev.b_reminder, ev.b_private);
 		}
 	}
 	printf("]}\n");
-	if (FALSE == exmdb_client_unload_table(sockd, dir, table_id)) {
+	return exmdb_client_unload_table(sockd, dir, table_id);
+}
+
+static BOOL get_freebusy(const char *dir)
+{
+	int sockd;
+	uint32_t permission;
+	FREEBUSY_EVENT_ARRAY events;
+	
+	sockd = connect_exmdb(dir);
+	if (-1 == sockd) {
+		return FALSE;
+	}
+	if (NULL != g_username) {
+		if (FALSE == exmdb_client_check_folder_permission(
+			sockd, dir, rop_util_make_eid_ex(1, PRIVATE_FID_CALENDAR),
+			g_username, &permission)) {
+			close(sockd);
+			cache_connection(dir, -1);
+			return FALSE;
+		}
+		if (!(permission & (frightsFreeBusySimple |
+		    frightsFreeBusyDetailed | frightsReadAny))) {
+			printf("{\"dir\":\"%s\", \"permission\":\"none\"}\n", dir);
+			cache_connection(dir, sockd);
+			return TRUE;
+		}
+	} else {
+		permission = frightsFreeBusyDetailed | frightsReadAny;
+	}
+	auto ret = exmdb_client_get_freebusy_events(sockd, dir, &events);
+	if (ret == exmdb_response::SUCCESS) {
+		output_events_begin(dir, permission);
+		for (size_t i = 0; i < events.count; ++i) {
+			auto &ev = events.pevents[i];
+			if (i > 0)
+				printf(",");
+			output_event(rop_util_nttime_to_unix(ev.start_time),
+				rop_util_nttime_to_unix(ev.end_time), ev.busy_type,
+				ev.id, ev.subject, ev.location, ev.b_meeting,
+				ev.b_recurring, ev.b_exception, ev.b_reminder,
+				ev.b_private);
+		}
+		printf("]}\n");
+		cache_connection(dir, sockd);
+		return TRUE;
+	}
+	close(sockd);
+	cache_connection(dir, -1);
+	/*
+	 * Servers predating GET_FREEBUSY_EVENTS cannot decode the request,
+	 * answer PULL_ERROR and drop the connection. Only then scan the
+	 * calendar table instead.
+	 */
+	if (ret != exmdb_response::PULL_ERROR)
+		return FALSE;
+	sockd = connect_exmdb(dir);
+	if (-1 == sockd) {
+		return FALSE;
+	}
+	if (!get_freebusy_table(sockd, dir, permission)) {
 		close(sockd);
 		cache_connection(dir, -1);
 		return FALSE;
@@ -8,6 +8,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <mysql.h>
 #include <string>
@@ -31,11 +32,23 @@
 #include <gromox/util.hpp>
 #include "genimport.hpp"
 
+/* change numbers reserved from the store per ALLOCATE_CNS call */
+#define EXM_CN_BATCH 256
+/* write_message requests sent before waiting for the oldest response */
+#define EXM_PIPELINE_DEPTH 16
+
 using namespace gromox;
 namespace exmdb_client = exmdb_client_remote;
 
 static std::string g_dstuser;
 static int g_socket = -1;
+static uint64_t g_cn_next, g_cn_end;
+/* identities of the messages whose write_message is still in flight */
+static std::deque<std::string> g_wr_pending;
+/* the connection broke; reported again by exm_flush() */
+static int g_wr_error;
+/* messages the server refused, which were skipped */
+static unsigned int g_wr_skipped;
 static unsigned int g_user_id;
 static std::string g_storedir_s;
 const char *g_storedir;
@@ -345,18 +358,101 @@ uint16_t gi_resolve_namedprop(const PROPERTY_NAME *pn_req)
 	return pid_rsp.ppropid[0];
 }
 
+/*
+ * A response went missing, so the ones still in flight can no longer be
+ * matched to their requests. Give up on the connection.
+ */
+static void exm_desync()
+{
+	if (g_socket >= 0) {
+		close(g_socket);
+		g_socket = -1;
+	}
+	for (const auto &ident : g_wr_pending)
+		fprintf(stderr, "exm: no response for message %s\n", ident.c_str());
+	g_wr_pending.clear();
+	if (g_wr_error == 0)
+		g_wr_error = -EIO;
+}
+
+static void exm_skip(const char *ident, const char *why)
+{
+	fprintf(stderr, "exm: message %s was not written (%s), skipping\n",
+	        ident, why);
+	++g_wr_skipped;
+}
+
+/*
+ * Collect write_message responses until at most @keep are outstanding.
+ * Messages the server refused are logged and skipped; only a broken
+ * connection is an error.
+ */
+static int exm_drain(unsigned int keep)
+{
+	while (g_wr_pending.size() > keep) {
+		BINARY tb;
+		if (!exmdb_client_read_socket(g_socket, &tb)) {
+			fprintf(stderr, "exm: write_message RPC failed (timeout?)\n");
+			exm_desync();
+			return -EIO;
+		}
+		auto ident = std::move(g_wr_pending.front());
+		g_wr_pending.pop_front();
+		auto cl_0 = make_scope_exit([&]() { free(tb.pb); });
+		if (tb.cb < 5 || tb.pb[0] != exmdb_response::SUCCESS) {
+			exm_skip(ident.c_str(), "write_message RPC failed");
+			continue;
+		}
+		EXMDB_RESPONSE rsp;
+		rsp.call_id = exmdb_callid::WRITE_MESSAGE;
+		BINARY tb2 = tb;
+		tb2.cb -= 5;
+		tb2.pb += 5;
+		if (exmdb_ext_pull_response(&tb2, &rsp) != EXT_ERR_SUCCESS) {
+			exm_skip(ident.c_str(), "bad response");
+		} else if (rsp.payload.write_message.e_result != 0) {
+			char why[32];
+			snprintf(why, arsizeof(why), "gxerr %d",
+			         rsp.payload.write_message.e_result);
+			exm_skip(ident.c_str(), why);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Returns a negative errno if the connection broke, otherwise the number
+ * of messages that were skipped.
+ */
+int exm_flush()
+{
+	auto ret = exm_drain(0);
+	if (ret != 0 || g_wr_error != 0)
+		return ret != 0 ? ret : g_wr_error;
+	return g_wr_skipped;
+}
+
 static BOOL exm_dorpc(const char *dir, const EXMDB_REQUEST *prequest, EXMDB_RESPONSE *presponse)
 {
 	BINARY tb;
+	/*
+	 * Responses arrive in order; get the pipelined ones out of the way.
+	 * If that fails, the import is already broken.
+	 */
+	if (exm_drain(0) != 0 || g_socket < 0)
+		return false;
 	if (exmdb_ext_push_request(prequest, &tb) != EXT_ERR_SUCCESS)
 		return false;
 	if (!exmdb_client_write_socket(g_socket, &tb)) {
 		free(tb.pb);
+		exm_desync();
 		return false;
 	}
 	free(tb.pb);
-	if (!exmdb_client_read_socket(g_socket, &tb))
+	if (!exmdb_client_read_socket(g_socket, &tb)) {
+		exm_desync();
 		return false;
+	}
 	auto cl_0 = make_scope_exit([&]() { free(tb.pb); });
 	if (tb.cb < 5 || tb.pb[0] != exmdb_response::SUCCESS)
 		return false;
@@ -423,12 +519,25 @@ static int exm_connect(const char *dir)
 	return -1;
 }
 
+static int exm_allocate_cn(uint64_t *change_num)
+{
+	if (g_cn_next == g_cn_end) {
+		uint64_t begin_cn = 0;
+		if (!exmdb_client::allocate_cns(g_storedir, EXM_CN_BATCH, &begin_cn))
+			return -EIO;
+		g_cn_next = rop_util_get_gc_value(begin_cn);
+		g_cn_end = g_cn_next + EXM_CN_BATCH;
+	}
+	*change_num = rop_util_make_eid_ex(1, g_cn_next++);
+	return 0;
+}
+
 int exm_create_folder(uint64_t parent_fld, TPROPVAL_ARRAY *props, bool o_excl,
     uint64_t *new_fld_id)
 {
 	uint64_t change_num = 0;
-	if (!exmdb_client::allocate_cn(g_storedir, &change_num)) {
-		fprintf(stderr, "exm: allocate_cn(fld) RPC failed\n");
+	if (exm_allocate_cn(&change_num) != 0) {
+		fprintf(stderr, "exm: allocate_cns(fld) RPC failed\n");
 		return -EIO;
 	}
 	SIZED_XID zxid;
@@ -495,14 +604,18 @@ int exm_create_folder(uint64_t parent_fld, TPROPVAL_ARRAY *props, bool o_excl,
 	return 0;
 }
 
-int exm_create_msg(uint64_t parent_fld, MESSAGE_CONTENT *ctnt)
+/*
+ * The message is sent without waiting for the server's reply; up to
+ * EXM_PIPELINE_DEPTH writes are in flight. Messages the server refuses are
+ * logged under @ident and skipped. A negative return value means that the
+ * import cannot go on. Call exm_flush() at the end of the import.
+ */
+int exm_create_msg(uint64_t parent_fld, MESSAGE_CONTENT *ctnt,
+    const char *ident)
 {
-	uint64_t msg_id = 0, change_num = 0;
-	if (!exmdb_client::allocate_message_id(g_storedir, parent_fld, &msg_id)) {
-		fprintf(stderr, "exm: allocate_message_id RPC failed (timeout?)\n");
-		return -EIO;
-	} else if (!exmdb_client::allocate_cn(g_storedir, &change_num)) {
-		fprintf(stderr, "exm: allocate_cn(msg) RPC failed\n");
+	uint64_t change_num = 0;
+	if (exm_allocate_cn(&change_num) != 0) {
+		fprintf(stderr, "exm: allocate_cns(msg) RPC failed\n");
 		return -EIO;
 	}
 
@@ -540,23 +653,37 @@ int exm_create_msg(uint64_t parent_fld, MESSAGE_CONTENT *ctnt)
 		if (!tpropval_array_set_propval(props, PR_LAST_MODIFICATION_TIME, &last_time))
 			return -ENOMEM;
 	}
-	if (!tpropval_array_set_propval(props, PROP_TAG_MID, &msg_id) ||
-	    !tpropval_array_set_propval(props, PROP_TAG_CHANGENUMBER, &change_num) ||
+	/* The message id is allocated by write_message itself. */
+	tpropval_array_remove_propval(props, PROP_TAG_MID);
+	if (!tpropval_array_set_propval(props, PROP_TAG_CHANGENUMBER, &change_num) ||
 	    !tpropval_array_set_propval(props, PR_CHANGE_KEY, &bxid) ||
 	    !tpropval_array_set_propval(props, PR_PREDECESSOR_CHANGE_LIST, pclbin.get())) {
 		fprintf(stderr, "exm: tpropval: ENOMEM\n");
 		return -ENOMEM;
 	}
-	gxerr_t e_result = GXERR_SUCCESS;
-	if (!exmdb_client::write_message(g_storedir, g_dstuser.c_str(), 65001,
-	    parent_fld, ctnt, &e_result)) {
-		fprintf(stderr, "exm: write_message RPC failed\n");
-		return -EIO;
-	} else if (e_result != 0) {
-		fprintf(stderr, "exm: write_message: gxerr %d\n", e_result);
+	EXMDB_REQUEST rq;
+	rq.call_id = exmdb_callid::WRITE_MESSAGE;
+	rq.dir = deconst(g_storedir);
+	rq.payload.write_message.account = deconst(g_dstuser.c_str());
+	rq.payload.write_message.cpid = 65001;
+	rq.payload.write_message.folder_id = parent_fld;
+	rq.payload.write_message.pmsgctnt = ctnt;
+	if (g_socket < 0)
+		return g_wr_error != 0 ? g_wr_error : -EIO;
+	BINARY tb;
+	if (exmdb_ext_push_request(&rq, &tb) != EXT_ERR_SUCCESS) {
+		exm_skip(ident, "cannot encode write_message request");
+		return 0;
+	}
+	auto ok = exmdb_client_write_socket(g_socket, &tb);
+	free(tb.pb);
+	if (!ok) {
+		fprintf(stderr, "exm: write_message RPC for message %s failed\n", ident);
+		exm_desync();
 		return -EIO;
 	}
-	return 0;
+	g_wr_pending.emplace_back(ident);
+	return exm_drain(EXM_PIPELINE_DEPTH - 1);
 }
 
 static std::string sql_escape(MYSQL *sqh, const char *in)
@@ -91,5 +91,6 @@ extern void gi_name_map_read(const void *, size_t, gi_name_map &);
 extern void gi_name_map_write(const gi_name_map &);
 extern uint16_t gi_resolve_namedprop(const PROPERTY_NAME *);
 extern int exm_create_folder(uint64_t parent_fld, TPROPVAL_ARRAY *props, bool o_excl, uint64_t *new_fld_id);
-extern int exm_create_msg(uint64_t parent_fld, MESSAGE_CONTENT *);
+extern int exm_create_msg(uint64_t parent_fld, MESSAGE_CONTENT *, const char *ident);
+extern int exm_flush();
 extern int gi_setup(const char *dstmbox);
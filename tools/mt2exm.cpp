@@ -3,12 +3,14 @@
 // This file is part of Gromox.
 #include <cerrno>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
 #include <unistd.h>
 #include <utility>
 #include <libHX/option.h>
+#include <gromox/defs.h>
 #include <gromox/ext_buffer.hpp>
 #include <gromox/scope.hpp>
 #include <gromox/tie.hpp>
@@ -213,7 +215,9 @@ static int exm_message(const ob_desc &obd, MESSAGE_CONTENT &ctnt)
 		return 0;
 	}
 	exm_adjust_namedprops(ctnt.proplist);
-	return exm_create_msg(folder_it->second.fid_to, &ctnt);
+	char ident[32];
+	snprintf(ident, arsizeof(ident), "NID %lxh", static_cast<unsigned long>(obd.nid));
+	return exm_create_msg(folder_it->second.fid_to, &ctnt, ident);
 }
 
 static int exm_packet(const void *buf, size_t bufsize)
@@ -276,7 +280,17 @@ int main(int argc, const char **argv) try
 		ret = fullread(STDIN_FILENO, buf.get(), xsize);
 		if (ret < 0 || static_cast<size_t>(ret) != xsize)
 			throw YError("PG-1006: %s", strerror(errno));
-		exm_packet(buf.get(), xsize);
+		/* refused messages are skipped; this is the connection failing */
+		auto pret = exm_packet(buf.get(), xsize);
+		if (pret < 0)
+			throw YError("PG-1146: %s", strerror(-pret));
+	}
+	auto ret = exm_flush();
+	if (ret < 0)
+		throw YError("PG-1147: %s", strerror(-ret));
+	if (ret > 0) {
+		fprintf(stderr, "mt2exm: %d message(s) could not be imported\n", ret);
+		return EXIT_FAILURE;
 	}
 	return EXIT_SUCCESS;
 } catch (const std::exception &e) {
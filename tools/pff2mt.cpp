@@ -1,22 +1,31 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 // SPDX-FileCopyrightText: 2021 grommunio GmbH
 // This file is part of Gromox.
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstdarg>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <condition_variable>
 #include <cstring>
 #include <ctime>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <unistd.h>
 #include <libpff.h>
 #include <libHX/option.h>
 #include <libHX/string.h>
 #include <gromox/ext_buffer.hpp>
 #include <gromox/fileio.h>
+#include <gromox/scope.hpp>
 #include <gromox/tarray_set.hpp>
 #include <gromox/tie.hpp>
 #include <gromox/tpropval_array.hpp>
@@ -54,6 +63,7 @@ struct libpff_record_set_del { void operator()(libpff_record_set_t *x) { libpff_
 struct libpff_record_entry_del { void operator()(libpff_record_entry_t *x) { libpff_record_entry_free(&x, nullptr); } };
 struct libpff_multi_value_del { void operator()(libpff_multi_value_t *x) { libpff_multi_value_free(&x, nullptr); } };
 struct libpff_noop_del { void operator()(void *x) { } };
+struct stdlib_free { void operator()(void *x) { free(x); } };
 
 using libpff_error_ptr        = std::unique_ptr<libpff_error_t, libpff_error_del>;
 using libpff_file_ptr         = std::unique_ptr<libpff_file_t, libpff_file_del>;
@@ -101,14 +111,62 @@ enum {
 	NID_SEARCH_GATHERER_FOLDER_QUEUE = 0x320 | NID_TYPE_INTERNAL,
 };
 
+/* One framed object of the output stream */
+struct pff_record {
+	std::unique_ptr<uint8_t[], stdlib_free> data;
+	size_t size = 0;
+};
+
+/*
+ * Emits records in the order in which the hierarchy walk numbered them,
+ * regardless of which thread finished first. At most @window records may
+ * be outstanding, and records that are done but not yet due are held back
+ * only up to @max_bytes. The next due record is always accepted, so one
+ * huge message cannot stall the stream.
+ */
+class pff_writer {
+	public:
+	void init(size_t window, size_t max_bytes);
+	bool reserve(uint64_t *seq);
+	void put(uint64_t seq, pff_record &&);
+	void abort(const char *msg);
+	bool aborted();
+	const char *error() const { return m_error.c_str(); }
+
+	private:
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::map<uint64_t, pff_record> m_ready;
+	uint64_t m_seq = 0, m_next = 0;
+	size_t m_window = 1, m_bytes = 0, m_max_bytes = 0;
+	bool m_writing = false, m_abort = false;
+	std::string m_error;
+};
+
+/* A top-level message handed to the worker pool */
+struct pff_job {
+	uint64_t seq = 0, folder_id = 0;
+	uint32_t ident = 0;
+	unsigned int depth = 0;
+};
+
 }
 
+/* completed messages held back while waiting for their turn */
+#define PFF_MAX_PENDING (256 * 1024 * 1024)
+
 using namespace std::string_literals;
 using namespace gromox;
 
 static gi_folder_map_t g_folder_map;
-static unsigned int g_splice;
+static unsigned int g_splice, g_threads;
+static pff_writer g_writer;
+static std::mutex g_job_lock;
+static std::condition_variable g_job_cond;
+static std::deque<pff_job> g_jobs;
+static bool g_jobs_done;
 static const struct HXoption g_options_table[] = {
+	{nullptr, 'j', HXTYPE_UINT, &g_threads, nullptr, nullptr, 0, "Number of threads extracting messages (default: number of CPUs)", "N"},
 	{nullptr, 'p', HXTYPE_NONE, &g_show_props, nullptr, nullptr, 0, "Show properties in detail (if -t)"},
 	{nullptr, 's', HXTYPE_NONE, &g_splice, nullptr, nullptr, 0, "Splice PFF objects into existing store hierarchy"},
 	{nullptr, 't', HXTYPE_NONE, &g_show_tree, nullptr, nullptr, 0, "Show tree-based analysis of the archive"},
@@ -119,6 +177,104 @@ static const struct HXoption g_options_table[] = {
 static void do_print(unsigned int depth, libpff_item_t *);
 static int do_item(unsigned int, const parent_desc &, libpff_item_t *);
 
+void pff_writer::init(size_t window, size_t max_bytes)
+{
+	m_window = window;
+	m_max_bytes = max_bytes;
+	m_ready.clear();
+	m_seq = m_next = m_bytes = 0;
+	m_writing = m_abort = false;
+	m_error.clear();
+}
+
+/* Number the next record; blocks while too many are outstanding. */
+bool pff_writer::reserve(uint64_t *seq)
+{
+	std::unique_lock hold(m_lock);
+	m_cond.wait(hold, [&]() { return m_abort || m_seq - m_next < m_window; });
+	if (m_abort)
+		return false;
+	*seq = m_seq++;
+	return true;
+}
+
+void pff_writer::put(uint64_t seq, pff_record &&rec)
+{
+	std::unique_lock hold(m_lock);
+	m_cond.wait(hold, [&]() {
+		return m_abort || seq == m_next || m_bytes + rec.size <= m_max_bytes;
+	});
+	if (m_abort)
+		return;
+	auto size = rec.size;
+	m_ready.emplace(seq, std::move(rec));
+	m_bytes += size;
+	/* whoever is already writing will pick this one up as well */
+	if (m_writing)
+		return;
+	m_writing = true;
+	while (!m_abort && m_ready.size() > 0 && m_ready.begin()->first == m_next) {
+		auto node = m_ready.extract(m_ready.begin());
+		auto &r = node.mapped();
+		hold.unlock();
+		uint64_t xsize = cpu_to_le64(r.size);
+		bool ok = write(STDOUT_FILENO, &xsize, sizeof(xsize)) == sizeof(xsize) &&
+		          write(STDOUT_FILENO, r.data.get(), r.size) == static_cast<ssize_t>(r.size);
+		int se = errno;
+		hold.lock();
+		m_bytes -= r.size;
+		++m_next;
+		if (!ok && !m_abort) {
+			m_abort = true;
+			m_error = "PF-1140: write: "s + strerror(se);
+		}
+		m_cond.notify_all();
+	}
+	m_writing = false;
+}
+
+void pff_writer::abort(const char *msg)
+{
+	std::lock_guard hold(m_lock);
+	if (!m_abort) {
+		m_abort = true;
+		m_error = msg;
+	}
+	m_cond.notify_all();
+}
+
+bool pff_writer::aborted()
+{
+	std::lock_guard hold(m_lock);
+	return m_abort;
+}
+
+static void pff_job_push(pff_job &&job)
+{
+	std::lock_guard hold(g_job_lock);
+	g_jobs.push_back(std::move(job));
+	g_job_cond.notify_one();
+}
+
+static bool pff_job_pop(pff_job &job)
+{
+	std::unique_lock hold(g_job_lock);
+	g_job_cond.wait(hold, []() { return g_jobs_done || g_jobs.size() > 0; });
+	if (g_jobs.size() == 0)
+		return false;
+	job = std::move(g_jobs.front());
+	g_jobs.pop_front();
+	return true;
+}
+
+static void pff_jobs_finish()
+{
+	std::lock_guard hold(g_job_lock);
+	g_jobs_done = true;
+	g_job_cond.notify_all();
+}
+
+
 static YError az_error(const char *prefix, const libpff_error_ptr &err)
 {
 	char buf[160];
@@ -482,9 +638,13 @@ static int do_folder(unsigned int depth, const parent_desc &parent,
 	ep.p_uint32(parent.type);
 	ep.p_uint64(parent.folder_id);
 	ep.p_tpropval_a(props.get());
-	uint64_t xsize = cpu_to_le64(ep.m_offset);
-	write(STDOUT_FILENO, &xsize, sizeof(xsize));
-	write(STDOUT_FILENO, ep.m_vdata, ep.m_offset);
+	uint64_t seq = 0;
+	if (!g_writer.reserve(&seq))
+		return -ECANCELED;
+	pff_record rec;
+	rec.size = ep.m_offset;
+	rec.data.reset(ep.release());
+	g_writer.put(seq, std::move(rec));
 	return 0;
 }
 
@@ -525,9 +685,72 @@ static message_content_ptr extract_message(unsigned int depth,
 	return ctnt;
 }
 
+static pff_record serialize_message(uint32_t ident, uint64_t folder_id,
+    const MESSAGE_CONTENT *ctnt)
+{
+	EXT_PUSH ep;
+	if (!ep.init(nullptr, 0, EXT_FLAG_WCOUNT))
+		throw std::bad_alloc();
+	if (ep.p_uint32(MAPI_MESSAGE) != EXT_ERR_SUCCESS ||
+	    ep.p_uint32(ident) != EXT_ERR_SUCCESS ||
+	    ep.p_uint32(MAPI_FOLDER) != EXT_ERR_SUCCESS ||
+	    ep.p_uint64(folder_id) != EXT_ERR_SUCCESS ||
+	    ep.p_msgctnt(ctnt) != EXT_ERR_SUCCESS)
+		throw YError("PF-1058");
+	pff_record rec;
+	rec.size = ep.m_offset;
+	rec.data.reset(ep.release());
+	return rec;
+}
+
+/*
+ * Each worker reads through its own libpff handle (libpff objects must not
+ * be shared between threads) and looks its messages up by identifier.
+ */
+static void pff_worker(const char *filename)
+{
+	libpff_error_ptr err;
+	libpff_file_ptr file;
+	if (libpff_file_initialize(&unique_tie(file), &unique_tie(err)) < 1) {
+		g_writer.abort(az_error("PF-1141", err).what());
+		return;
+	}
+	if (libpff_file_open(file.get(), filename, LIBPFF_OPEN_READ, &~unique_tie(err)) < 1) {
+		g_writer.abort(az_error("PF-1142", err).what());
+		return;
+	}
+	pff_job job;
+	while (pff_job_pop(job)) {
+		if (g_writer.aborted())
+			continue;
+		try {
+			libpff_item_ptr item;
+			if (libpff_file_get_item_by_identifier(file.get(), job.ident,
+			    &unique_tie(item), &~unique_tie(err)) < 1)
+				throw az_error("PF-1143", err);
+			auto parent = parent_desc::as_folder(job.folder_id);
+			auto ctnt = extract_message(job.depth, parent, item.get());
+			g_writer.put(job.seq, serialize_message(job.ident, job.folder_id, ctnt.get()));
+		} catch (const std::exception &e) {
+			g_writer.abort(e.what());
+		}
+	}
+}
+
 static int do_message(unsigned int depth, const parent_desc &parent,
     libpff_item_t *item, uint32_t ident)
 {
+	if (parent.type == MAPI_FOLDER && g_threads > 1) {
+		/* Normal message; extracted by the worker pool */
+		pff_job job;
+		job.folder_id = parent.folder_id;
+		job.ident = ident;
+		job.depth = depth;
+		if (!g_writer.reserve(&job.seq))
+			return -ECANCELED;
+		pff_job_push(std::move(job));
+		return 0;
+	}
 	auto ctnt = extract_message(depth, parent, item);
 	if (parent.type == MAPI_ATTACH)
 		attachment_content_set_embedded_internal(parent.attach, ctnt.release());
@@ -537,18 +760,10 @@ static int do_message(unsigned int depth, const parent_desc &parent,
 	/* Normal message, not embedded */
 	if (g_show_tree)
 		gi_dump_msgctnt(depth, *ctnt);
-	EXT_PUSH ep;
-	if (!ep.init(nullptr, 0, EXT_FLAG_WCOUNT))
-		throw std::bad_alloc();
-	if (ep.p_uint32(MAPI_MESSAGE) != EXT_ERR_SUCCESS ||
-	    ep.p_uint32(ident) != EXT_ERR_SUCCESS ||
-	    ep.p_uint32(parent.type) != EXT_ERR_SUCCESS ||
-	    ep.p_uint64(parent.folder_id) != EXT_ERR_SUCCESS ||
-	    ep.p_msgctnt(ctnt.get()) != EXT_ERR_SUCCESS)
-		throw YError("PF-1058");
-	uint64_t xsize = cpu_to_le64(ep.m_offset);
-	write(STDOUT_FILENO, &xsize, sizeof(xsize));
-	write(STDOUT_FILENO, ep.m_vdata, ep.m_offset);
+	uint64_t seq = 0;
+	if (!g_writer.reserve(&seq))
+		return -ECANCELED;
+	g_writer.put(seq, serialize_message(ident, parent.folder_id, ctnt.get()));
 	return 0;
 }
 
@@ -734,7 +949,6 @@ static void npg_ent(gi_name_map &map, libpff_record_entry_t *rent)
 		return;
 	if (libpff_name_to_id_map_entry_get_type(nti_entry.get(), &nti_type, nullptr) < 1)
 		return;
-	struct stdlib_free { void operator()(void *x) { free(x); } };
 	std::unique_ptr<char[], stdlib_free> pnstr;
 	PROPERTY_NAME pn_req{};
 	if (libpff_name_to_id_map_entry_get_guid(nti_entry.get(),
@@ -843,9 +1057,41 @@ static int do_file(const char *filename) try
 	gi_dump_name_map(name_map);
 	gi_name_map_write(name_map);
 
-	if (g_show_tree)
+	if (g_show_tree) {
 		fprintf(stderr, "Object tree:\n");
-	return do_item(0, {}, root.get());
+		/* tree output from several threads would interleave */
+		g_threads = 1;
+	} else if (g_threads == 0) {
+		g_threads = std::max(std::thread::hardware_concurrency(), 1U);
+	}
+	g_writer.init(4 * g_threads, PFF_MAX_PENDING);
+	g_jobs.clear();
+	g_jobs_done = false;
+	std::vector<std::thread> workers;
+	auto cl_0 = make_scope_exit([&]() {
+		if (workers.size() == 0)
+			return;
+		/* unwinding from an exception: release anyone waiting for a turn */
+		g_writer.abort("PF-1145: aborted");
+		pff_jobs_finish();
+		for (auto &t : workers)
+			t.join();
+	});
+	if (g_threads > 1)
+		for (unsigned int i = 0; i < g_threads; ++i)
+			workers.emplace_back(pff_worker, filename);
+	auto ret = do_item(0, {}, root.get());
+	if (ret < 0)
+		g_writer.abort(("PF-1144: "s + strerror(-ret)).c_str());
+	pff_jobs_finish();
+	for (auto &t : workers)
+		t.join();
+	workers.clear();
+	if (g_writer.aborted()) {
+		fprintf(stderr, "pff: %s\n", g_writer.error());
+		return -ECANCELED;
+	}
+	return ret;
 } catch (const char *e) {
 	fprintf(stderr, "pff: Exception: %s\n", e);
 	return -ECANCELED;
@@ -863,7 +1109,7 @@ int main(int argc, const char **argv)
 	if (HX_getopt(g_options_table, &argc, &argv, HXOPT_USAGEONERR) != HXOPT_ERR_SUCCESS)
 		return EXIT_FAILURE;
 	if (argc != 2) {
-		fprintf(stderr, "Usage: gromox-pff2mt [-pst] input.pst | gromox-mt2.... \n");
+		fprintf(stderr, "Usage: gromox-pff2mt [-pst] [-j n] input.pst | gromox-mt2.... \n");
 		return EXIT_FAILURE;
 	}
 	if (isatty(STDOUT_FILENO)) {